@@ -15,11 +15,21 @@
 #include "libgibbs/include/optimizer/ast_set.hpp"
 #include "libgibbs/include/conditions.hpp"
 #include "libgibbs/include/utils/ast_caching.hpp"
+#include "libgibbs/include/utils/ast_serialization.hpp"
+#include "libgibbs/include/utils/compiled_expr.hpp"
+#include "libgibbs/include/utils/energy_device.hpp"
+#include "libgibbs/include/utils/evaluation_trace.hpp"
+#include "libgibbs/include/utils/fixed_shape_kernels.hpp"
+#include "libgibbs/include/utils/magnetic_kernel.hpp"
+#include "libgibbs/include/utils/memory_footprint.hpp"
+#include "libgibbs/include/utils/native_kernel.hpp"
+#include "libgibbs/include/utils/sublattice_layout.hpp"
 #include "libtdb/include/structure.hpp"
 #include <boost/bimap.hpp>
 #include <boost/numeric/ublas/symmetric.hpp>
 #include <boost/numeric/ublas/vector.hpp>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <list>
 #include <vector>
@@ -28,11 +38,48 @@
 // A CompositionSet works with libtdb's Phase class
 // Its purpose is to handle the optimizer's specific configuration for the given conditions and models
 // Multiple CompositionSets of the same Phase can be created to handle miscibility gaps
+// All const member functions may be called by several threads at once: the compiled model is
+// immutable and shared, the derivative trees are built once under a lock, and all scratch space
+// lives in caller-owned objects (CompiledBinding, CompiledJet), which should be one per thread
 class CompositionSet
 {
 public:
     double evaluate_objective ( evalconditions const&, boost::bimap<std::string, int> const &, double* const ) const;
     double evaluate_objective ( evalconditions const&, std::map<std::string,double> const & ) const;
+    // Energies of npoints points stored contiguously; point i starts at points + i*main_indices.size()
+    void evaluate_objective_batch (
+        evalconditions const&,
+        boost::bimap<std::string, int> const &,
+        double const* const points,
+        std::size_t const npoints,
+        double* const out ) const;
+    // Same as above, with points laid out according to get_variable_map()
+    void evaluate_objective_batch (
+        evalconditions const&,
+        double const* const points,
+        std::size_t const npoints,
+        double* const out ) const;
+    // Same as above, with point i starting at points + i*stride, e.g., to skip a trailing energy coordinate
+    void evaluate_objective_batch (
+        evalconditions const&,
+        double const* const points,
+        std::size_t const npoints,
+        std::size_t const stride,
+        double* const out ) const;
+    std::vector<double> evaluate_objective_batch (
+        evalconditions const&,
+        std::vector<std::vector<double>> const &points ) const;
+    // Same as the strided variant above in single precision (see CompiledExpression::evaluate_batch()),
+    // for ranking points where double precision is not needed
+    void evaluate_objective_batch (
+        evalconditions const&,
+        float const* const points,
+        std::size_t const npoints,
+        std::size_t const stride,
+        float* const out ) const;
+    // Load the objective programs onto device, for points laid out according to get_variable_map()
+    // The caller holds device.lock() until it has waited for its last batch
+    void load_objective ( EnergyDevice &device, evalconditions const& conditions ) const;
     std::map<int,double> evaluate_objective_gradient (
         evalconditions const&, boost::bimap<std::string, int> const &, double* const ) const;
     std::map<int,double> evaluate_single_phase_objective_gradient (
@@ -41,35 +88,129 @@ public:
         evalconditions const &, std::map<std::string,double> const & ) const;
     std::map<int,double> evaluate_single_phase_objective_gradient (
         evalconditions const &, std::map<std::string,double> const & ) const;
+    // Gradient of the phase energy with respect to the variables of get_variable_map()
     std::vector<double> evaluate_internal_objective_gradient (
-        evalconditions const& conditions, double* const ) const;
+        evalconditions const& conditions, double const* const ) const;
+    // Same as above, fused with the phase energy (returned), for a binding from bind ( conditions, get_variable_map() );
+    // gradient must have room for get_variable_map().size() entries
+    double evaluate_internal_objective_gradient (
+        CompiledBinding const &binding,
+        double const* const x,
+        double* const gradient,
+        CompiledJet &workspace ) const;
+    // Dense, row-major Hessian of the phase energy for the same binding, without the phase fraction;
+    // hessian must have room for get_variable_map().size() squared entries, and workspace needs a Hessian
+    void evaluate_internal_objective_hessian (
+        CompiledBinding const &binding,
+        double const* const x,
+        double* const hessian,
+        CompiledJet &workspace ) const;
+    // product = Hessian of the phase energy times direction, both indexed like x, for the same binding;
+    // one sweep over the models per call instead of one per variable. With native kernels, which only
+    // provide the whole Hessian, it is formed and multiplied, so workspace needs a Hessian
+    void evaluate_internal_objective_hessian_vector (
+        CompiledBinding const &binding,
+        double const* const x,
+        double const* const direction,
+        double* const product,
+        CompiledJet &workspace ) const;
     std::map<std::list<int>,double> evaluate_objective_hessian (
         evalconditions const&, boost::bimap<std::string, int> const &, double* const ) const;
+    // Phase energy (not multiplied by the phase fraction) with the gradient and Hessian of the objective,
+    // in one pass over the models; derivatives are added to the maps as in the two functions above
+    void evaluate_objective_derivatives (
+        evalconditions const&,
+        boost::bimap<std::string, int> const &,
+        double* const,
+        double &objective,
+        std::map<int,double> &gradient,
+        std::map<std::list<int>,double> &hessian ) const;
     boost::numeric::ublas::symmetric_matrix<double,boost::numeric::ublas::lower> evaluate_objective_hessian_matrix (
         evalconditions const& conditions,
         boost::bimap<std::string, int> const &main_indices,
         std::vector<double> const &x ) const;
     std::set<std::list<int>> hessian_sparsity_structure ( boost::bimap<std::string, int> const & ) const;
+    // First and lower-triangular second derivative ASTs of the models
+    // They are only built the first time they are needed, e.g., not at all for phases dropped after global minimization
+    ast_set const& get_derivative_trees() const;
+
+    // Dense variants of the functions above, for evaluating many points with the same conditions and variable map
+    // bind() resolves the variables once and specializes the programs to the state variables (shared by
+    // all composition sets of the phase for the last few conditions); results are added to caller-provided arrays indexed like x,
+    // and workspace (sized by jet_workspace()) is reused between calls, so nothing is allocated per call
+    CompiledBinding bind ( evalconditions const&, boost::bimap<std::string, int> const & ) const;
+    CompiledJet jet_workspace ( bool const with_hessian ) const;
+    double evaluate_objective ( CompiledBinding const &binding, double const* const x ) const;
+    void add_objective_gradient (
+        CompiledBinding const &binding,
+        double const* const x,
+        double* const gradient,
+        CompiledJet &workspace ) const;
+    // Where the lower triangle of this composition set's block of the objective Hessian goes in a sparse
+    // array, resolved once so that each evaluation is one pass over contiguous lists without lookups
+    // The entries of one composition set are disjoint from those of any other
+    struct HessianScatter {
+        std::vector<std::pair<std::size_t,int>> model_entries; // model Hessian entry (slot1 * n + slot2) -> position
+        std::vector<std::pair<std::size_t,int>> fraction_entries; // model gradient slot -> position of its phase fraction coupling
+    };
+    // Entries that are not in sparsity_structure are skipped
+    HessianScatter hessian_positions ( CompiledBinding const &binding, std::set<std::list<int>> const &sparsity_structure ) const;
+    // values[position] += scale * (objective Hessian entry) for every entry of scatter
+    void add_objective_hessian (
+        CompiledBinding const &binding,
+        double const* const x,
+        double const scale,
+        HessianScatter const &scatter,
+        double* const values,
+        CompiledJet &workspace ) const;
+    // The two functions above in two steps, so that one evaluation can serve several callers at the same x:
+    // evaluate_model_jet() stores the value and derivatives of the models in workspace, these add them
+    void evaluate_model_jet ( CompiledBinding const &binding, double const* const x, bool const with_hessian, CompiledJet &workspace ) const;
+    void add_objective_gradient (
+        CompiledBinding const &binding,
+        CompiledJet const &jet,
+        double const* const x,
+        double* const gradient ) const;
+    void add_objective_hessian (
+        CompiledBinding const &binding,
+        CompiledJet const &jet,
+        double const* const x,
+        double const scale,
+        HessianScatter const &scatter,
+        double* const values ) const;
+
+    // Translate the models and their derivative trees into native kernels (see native_kernel.hpp), compiled into
+    // a shared object in cache_directory or reused from there, and evaluate single points and jets with them from now on;
+    // batches stay with the vectorized interpreter. Unbound variables and domain errors raise floating_point_error.
+    // Returns false, leaving the interpreter in use, if the kernels cannot be compiled or loaded
+    bool use_native_kernels ( std::string const &cache_directory );
+    bool has_native_kernels() const {
+        return static_cast<bool> ( native_kernels );
+    }
 
     // make CompositionSet from existing Phase
+    // parameter_index, if given, must index pset; the models then look their parameters up in it
     CompositionSet (
         const Phase &phaseobj,
         const parameter_set &pset,
         const sublattice_set &sublset,
-        boost::bimap<std::string, int> const &main_indices );
+        boost::bimap<std::string, int> const &main_indices,
+        ParameterIndex const *parameter_index = nullptr );
 
     // make CompositionSet from another CompositionSet; used for miscibility gaps
-    // this will create a copy
+    // the energy models and their programs are shared with other, only the variable names differ
     CompositionSet (
         const CompositionSet &other,
         const std::map<std::string,double> &new_starting_point,
         const std::string &new_name );
     
-    // copy CompositionSet -- use rename with the same name
-    CompositionSet ( const CompositionSet &other ) 
-    : CompositionSet( other, other.get_starting_point(), other.name() ) {}
-    
-    // copy assignment -- use rename with the same name
+    // read a CompositionSet written by serialize(); only the programs are recompiled
+    explicit CompositionSet ( ASTReader &reader );
+
+    // copy CompositionSet; unlike the rename constructor, nothing is renamed or recompiled
+    CompositionSet ( const CompositionSet &other );
+
+    // copy assignment
     CompositionSet& operator= ( const CompositionSet &other ) {
         if (this != &other) {
             CompositionSet new_self(other);
@@ -78,35 +219,46 @@ public:
         return *this;
     }
 
-    CompositionSet() { }
+    CompositionSet() : tree_data ( std::make_shared<ast_set>() ), tree_data_built ( true ), compiled_model ( std::make_shared<CompiledModel>() ), phase_fraction_slot ( 0 ) { }
 
     CompositionSet ( CompositionSet &&other ) {
         cset_name = std::move ( other.cset_name );
-        models = std::move ( other.models );
         jac_g_trees = std::move ( other.jac_g_trees );
         hessian_data = std::move ( other.hessian_data );
+        derivative_variables = std::move ( other.derivative_variables );
         tree_data = std::move ( other.tree_data );
+        tree_data_built = other.tree_data_built;
         first_derivatives = std::move ( other.first_derivatives );
-        symbols = std::move ( other.symbols );
         cm = std::move ( other.cm );
         phase_indices = std::move ( other.phase_indices );
         constraint_null_space_matrix = std::move ( other.constraint_null_space_matrix );
+        layout = std::move ( other.layout );
         starting_point = std::move ( other.starting_point );
         gradient_projector = std::move ( other.gradient_projector );
+        compiled_model = std::move ( other.compiled_model );
+        binding_slots = std::move ( other.binding_slots );
+        native_kernels = std::move ( other.native_kernels );
+        phase_fraction_slot = other.phase_fraction_slot;
     }
     CompositionSet& operator= ( CompositionSet &&other ) {
         cset_name = std::move ( other.cset_name );
-        models = std::move ( other.models );
         jac_g_trees = std::move ( other.jac_g_trees );
         hessian_data = std::move ( other.hessian_data );
+        derivative_variables = std::move ( other.derivative_variables );
         tree_data = std::move ( other.tree_data );
+        tree_data_built = other.tree_data_built;
         first_derivatives = std::move ( other.first_derivatives );
-        symbols = std::move ( other.symbols );
         cm = std::move ( other.cm );
         phase_indices = std::move ( other.phase_indices );
         constraint_null_space_matrix = std::move ( other.constraint_null_space_matrix );
+        layout = std::move ( other.layout );
         starting_point = std::move ( other.starting_point );
         gradient_projector = std::move ( other.gradient_projector );
+        compiled_model = std::move ( other.compiled_model );
+        binding_slots = std::move ( other.binding_slots );
+        native_kernels = std::move ( other.native_kernels );
+        phase_fraction_slot = other.phase_fraction_slot;
+        return *this;
     }
     const std::vector<jacobian_entry>& get_jacobian() const {
         return jac_g_trees;
@@ -117,15 +269,24 @@ public:
     const boost::bimap<std::string, int>& get_variable_map() const {
         return phase_indices;
     };
+    // The sublattices of the phase in flat arrays, in the order of get_variable_map()
+    const SublatticeLayout& sublattice_layout() const {
+        return layout;
+    }
     const boost::numeric::ublas::matrix<double>& get_constraint_null_space_matrix() const {
         return constraint_null_space_matrix;
     };
     const boost::numeric::ublas::matrix<double>& get_gradient_projector() const {
         return gradient_projector;
     };
+    // symbols of the energy models, named after the phase they were built for (see get_model_phase_name())
     const ASTSymbolMap& get_symbols() const {
-        return symbols;
+        return compiled_model->symbols;
     };
+    // name of the composition set the energy models were built for; shared by all its miscibility gap copies
+    const std::string& get_model_phase_name() const {
+        return compiled_model->phase_name;
+    }
 
     void set_name ( const std::string &name ) {
         cset_name = name;
@@ -139,20 +300,130 @@ public:
     std::map<std::string,double> get_starting_point() const {
         return starting_point;
     }
+    // write the models, derivative trees, constraints and basis matrices
+    void serialize ( ASTWriter &writer ) const;
+    // node counts of the compiled model programs, summed over all models
+    CompiledStatistics get_compiled_statistics() const;
+    // sampled counts and timings of energy and derivative evaluations, shared by all composition sets of the phase;
+    // tracing is enabled by EvaluationTrace::set_sampling_period()
+    EvaluationStatistics get_energy_statistics() const {
+        return compiled_model->energy_trace.statistics();
+    }
+    EvaluationStatistics get_derivative_statistics() const {
+        return compiled_model->derivative_trace.statistics();
+    }
+    // Estimated memory by component (see memory_footprint.hpp); the compiled model and the derivative trees,
+    // which copies and miscibility gap composition sets share, are skipped if they are in counted already
+    MemoryFootprint memory_footprint ( SharedObjects &counted ) const;
+    MemoryFootprint memory_footprint() const {
+        SharedObjects counted;
+        return memory_footprint ( counted );
+    }
 private:
     std::string cset_name;
     std::map<std::string,double> starting_point; // starting point for optimizing this composition set
-    std::map<std::string,std::unique_ptr<EnergyModel>> models;
     std::map<int,boost::spirit::utree> first_derivatives;
     boost::bimap<std::string, int> phase_indices;
     std::vector<jacobian_entry> jac_g_trees;
     hessian_set hessian_data;
-    ast_set tree_data;
-    ASTSymbolMap symbols; // maps special symbols to ASTs and their derivatives
+    // This phase's variables, in main_indices order with their main_indices positions; used to build tree_data
+    // Named after compiled_model->phase_name, like the models they are differentiated from
+    std::vector<std::pair<std::string,int>> derivative_variables;
+    // Built on demand by get_derivative_trees(), in the style of CachedAbstractSyntaxTree
+    // The trees are never modified once built, so copies of this composition set share them
+    // instead of copying every node; the rename constructor makes its own renamed set
+    void build_derivative_trees() const;
+    mutable std::shared_ptr<const ast_set> tree_data;
+    mutable bool tree_data_built;
+    mutable std::mutex tree_data_mutex; // guards tree_data and tree_data_built; never copied or moved
     ConstraintManager cm; // handles constraints internal to the phase, e.g., site fraction balances
-    void build_constraint_basis_matrices ( sublattice_set const &sublset );
+    SublatticeLayout layout;
+    void build_constraint_basis_matrices();
     boost::numeric::ublas::matrix<double> constraint_null_space_matrix;
     boost::numeric::ublas::matrix<double> gradient_projector;
+
+    // The energy models and their flattened programs (see compiled_expr.hpp) depend only on the phase.
+    // They are never modified after construction, so the composition sets of a miscibility gap share them
+    // and differ only in the variable names their bindings resolve.
+    struct CompiledModel {
+        std::string phase_name; // prefix of the variable names in the models and programs
+        std::map<std::string,std::unique_ptr<EnergyModel>> models;
+        ASTSymbolMap symbols; // maps special symbols to ASTs and their derivatives
+        CompiledSlotTable slots; // variables referenced by all compiled programs
+        std::vector<CompiledExpression> objective; // one program per energy model
+        EvaluationTrace energy_trace; // counters only; the programs are never modified
+        EvaluationTrace derivative_trace;
+        // objective specialized by bind() to the most recently bound state variables, most recent first
+        struct SpecializedObjective {
+            std::vector<double> statevar_values;
+            std::vector<bool> statevar_bound;
+            std::shared_ptr<const std::vector<CompiledExpression>> programs;
+            std::shared_ptr<const std::vector<double>> fixed_shape_constants; // T and coefficient_programs; null if unbound
+            std::shared_ptr<const std::vector<CompiledExpression>> magnetic_programs; // null if unbound
+        };
+        mutable std::list<SpecializedObjective> specialized_objective;
+        mutable std::mutex specialized_objective_mutex;
+        // The ideal mixing program, and the excess program if fixed_shape_excess, are replaced by a kernel
+        // for the sublattice shape of the phase (see fixed_shape_kernels.hpp) where bind() can supply its constants;
+        // null for other shapes. The interactions and the ASTs of their coefficients are kept to serialize them
+        std::unique_ptr<const FixedShapeModel> fixed_shape;
+        bool fixed_shape_excess = false;
+        std::vector<FixedShapeInteraction> interactions;
+        std::vector<boost::spirit::utree> interaction_coefficients;
+        std::vector<CompiledExpression> coefficient_programs; // of the conditions only
+        std::vector<bool> fixed_shape_programs; // objective program -> replaced by fixed_shape
+        // The magnetic program is replaced by magnetic where bind() can specialize the programs of its Curie
+        // temperature and mean magnetic moment; null without magnetic ordering. The ASTs of those and the
+        // factors of IHJMagneticModel are kept to serialize them
+        std::unique_ptr<const MagneticKernel> magnetic;
+        std::vector<boost::spirit::utree> magnetic_parameters; // Curie temperature, mean magnetic moment; empty if none
+        double afm_factor = 0;
+        double sro_enthalpy_order_fraction = 0;
+        std::vector<CompiledExpression> magnetic_programs; // of magnetic_parameters
+        std::size_t magnetic_program = 0; // objective program replaced by magnetic
+        std::size_t temperature_slot = 0; // statevar slot of T, or slots.statevars.size() if no program uses it
+    };
+    static void compile_expressions ( CompiledModel &model );
+    // Build model.fixed_shape after compile_expressions(), with model.interactions if with_excess
+    static void compile_fixed_shape ( CompiledModel &model, SublatticeLayout const &layout, bool const with_excess );
+    // Build model.magnetic after compile_expressions(), from model.magnetic_parameters
+    static void compile_magnetic ( CompiledModel &model, SublatticeLayout const &layout );
+    // Whether objective program i is evaluated by the fixed-shape or magnetic kernel for binding instead
+    bool replaced_program ( CompiledBinding const &binding, std::size_t const i ) const {
+        return ( binding.kernel_constants && compiled_model->fixed_shape_programs[i] )
+               || ( binding.kernel_programs && i == compiled_model->magnetic_program );
+    }
+    // Add the energies of the fixed-shape and magnetic kernels to out, if binding has their inputs
+    void add_kernel_batch ( CompiledBinding const &binding, double const* const points, std::size_t const npoints,
+                            std::size_t const stride, double* const out ) const;
+    // The jets of the Curie temperature and mean magnetic moment at x, as workspace.nested[0] and [1];
+    // with their gradients and the products of their Hessians with workspace.direction if direction_product
+    void evaluate_magnetic_parameters ( CompiledBinding const &binding, double const* const x, bool const with_hessian,
+                                        bool const direction_product, CompiledJet &workspace ) const;
+    // The objective programs to evaluate with binding: specialized to its state variables if bind() made it
+    std::vector<CompiledExpression> const& objective_programs ( CompiledBinding const &binding ) const {
+        return binding.specialized ? *binding.specialized : compiled_model->objective;
+    }
+    // Use model for this composition set, renaming the slot variables if its phase name differs
+    void share_model ( std::shared_ptr<const CompiledModel> model );
+    // Sum of the value and derivatives of all models w.r.t. the compiled slots
+    CompiledJet evaluate_model_jet ( CompiledBinding const &binding, double const* const x, bool const with_hessian ) const;
+    // Scale a model jet by the phase fraction and add it to the objective gradient/Hessian
+    void add_objective_gradient ( CompiledBinding const &binding, CompiledJet const &jet, double const* const x, std::map<int,double> &gradient ) const;
+    void add_objective_hessian ( CompiledBinding const &binding, CompiledJet const &jet, double const* const x, std::map<std::list<int>,double> &hessian ) const;
+    std::shared_ptr<const CompiledModel> compiled_model;
+    CompiledSlotTable binding_slots; // compiled_model->slots with the variable names of this composition set
+    // Kernels built by use_native_kernels() against compiled_model->slots; shared like the compiled model
+    struct NativeModel {
+        std::unique_ptr<NativeKernelLibrary> library;
+        NativeKernelFunction energy; // out[0]
+        NativeKernelFunction gradient; // out[slot], as in CompiledJet
+        NativeKernelFunction hessian; // out[slot1 * n + slot2], as in CompiledJet
+    };
+    std::shared_ptr<const NativeModel> native_kernels;
+    // The x and state arguments of the native kernels, one after the other; unbound entries are NaN
+    void native_arguments ( CompiledBinding const &binding, double const* const x, std::vector<double> &arguments ) const;
+    std::size_t phase_fraction_slot;
 };
 
 #endif
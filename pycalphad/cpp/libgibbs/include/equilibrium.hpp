@@ -11,18 +11,37 @@
 // declaration for Equilibrium object
 
 #include <iostream>
+#include <list>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <utility>
 #include <memory>
+#include <mutex>
 #include <boost/timer/timer.hpp>
 #include <boost/shared_ptr.hpp>
 #include <coin/IpIpoptApplication.hpp>
 #include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/optimizer/compact_result.hpp"
+#include "libgibbs/include/optimizer/compiled_system.hpp"
 #include "libgibbs/include/optimizer/equilibriumresult.hpp"
+#include "libgibbs/include/optimizer/global_hull_cache.hpp"
+#include "libgibbs/include/optimizer/result_cache.hpp"
+#include "libgibbs/include/optimizer/solve_control.hpp"
+#include "libgibbs/include/utils/memory_footprint.hpp"
 #include "libtdb/include/database.hpp"
 
+// How an Equilibrium is solved
+struct EquilibriumSolverOptions {
+	EquilibriumSolverOptions() : reduced_space(false), newton_max_variables(0), memory_accounting(false), trace(false), print_level(6) { }
+	bool reduced_space; // Ipopt solves the problem with the site fraction balance constraints eliminated (see ReducedGibbsOpt)
+	std::size_t newton_max_variables; // smaller problems are tried with NewtonGibbsSolver before Ipopt; 0 disables it
+	bool memory_accounting; // record the memory footprint of the solver (see Equilibrium::solver_footprint()), which walks every AST
+	bool trace; // keep the SolverTrace of every Ipopt solve with its result (see Equilibrium::trace())
+	std::vector<Optimizer::StoppingRule> stopping_rules; // an Ipopt solve ends as soon as one of these returns true
+	int print_level; // of Ipopt's own output; 0 silences it
+};
+
 /*
  * What this class needs to do:
  * This class will be the foundational piece of how TDBread interacts with
@@ -63,26 +82,154 @@ private:
 	const std::string sourcename; // descriptor for the source of the equilibrium data
 	const evalconditions conditions; // thermodynamic conditions of the equilibrium
 	Optimizer::EquilibriumResult<Ipopt::Number> result; // equilibrium data from the optimization
+	PhaseMemoryFootprint solver_memory; // of the solver at the end of the solve, if EquilibriumSolverOptions::memory_accounting
+	Equilibrium(const CompiledSystem &system, const evalconditions &conds, const Ipopt::SmartPtr<Ipopt::IpoptApplication> &solver,
+		const Optimizer::EquilibriumResult<Ipopt::Number> *warm_start, GlobalHullCache *hull_cache,
+		const Optimizer::SolveControl *control = nullptr, const EquilibriumSolverOptions &options = EquilibriumSolverOptions());
+	// A result calculated before, e.g., from an EquilibriumResultCache
+	Equilibrium(const std::string &source_name, const evalconditions &conds, Optimizer::EquilibriumResult<Ipopt::Number> &&stored);
+	friend class EquilibriumFactory; // shares its global hulls between equilibria
 public:
 	Equilibrium(const Database &DB, const evalconditions &conds, const Ipopt::SmartPtr<Ipopt::IpoptApplication> &solver);
+	// Start from the solution of previous, e.g., the preceding point of a step or map calculation
+	Equilibrium(const Database &DB, const evalconditions &conds, const Ipopt::SmartPtr<Ipopt::IpoptApplication> &solver,
+		const Equilibrium &previous);
+	// Reuse the models of system, which must have been built for the elements and phases of conds
+	Equilibrium(const CompiledSystem &system, const evalconditions &conds, const Ipopt::SmartPtr<Ipopt::IpoptApplication> &solver);
+	Equilibrium(const CompiledSystem &system, const evalconditions &conds, const Ipopt::SmartPtr<Ipopt::IpoptApplication> &solver,
+		const Equilibrium &previous);
 	Equilibrium(const Equilibrium &) = delete;
 	Equilibrium& operator=(const Equilibrium &) = delete;
 	double GibbsEnergy() { return result.energy(); };
+	int iterations() const { return result.itercount; };
+	// Call counts and wall time of each stage of the calculation
+	const StageProfile& profile() const { return result.profile; };
+	// The values of the solution, e.g., to checkpoint them
+	const Optimizer::EquilibriumResult<Ipopt::Number>& solution() const { return result; };
+	// Estimated memory held by the result: the composition sets of its phases, and the values of the solution
+	PhaseMemoryFootprint memory_footprint() const;
+	// Estimated memory the solver held besides the composition sets, e.g., constraint ASTs, compiled programs,
+	// evaluation workspaces and the global hull; empty unless the factory had SetMemoryAccounting(true)
+	const PhaseMemoryFootprint& solver_footprint() const { return solver_memory; };
+	// Every iteration of the solve; null unless the factory had SetSolverTrace(true), or the equilibrium was
+	// solved by NewtonGibbsSolver or taken from the result cache
+	const Optimizer::SolverTrace* trace() const { return result.trace.get(); };
 	double mole_fraction(const std::string &specname);
 	double mole_fraction(const std::string &specname, const std::string &phasename);
 	std::string print() const;
 };
 
+class EquilibriumWorkerPool; // see EquilibriumFactory::submit()
+
+// Handle to an equilibrium submitted to the workers of an EquilibriumFactory; copies refer to the same calculation
+class EquilibriumJob {
+public:
+	struct State; // shared with the worker solving it
+	EquilibriumJob() { }
+	explicit EquilibriumJob(std::shared_ptr<State> job_state) : state(std::move(job_state)) { }
+	// Blocks until the calculation has ended and returns it, or rethrows its error
+	// (equilibrium_error if it was cancelled or timed out)
+	boost::shared_ptr<Equilibrium> get() const;
+	bool ready() const;
+	// Blocks for at most seconds; true if the calculation has ended
+	bool wait_for(double seconds) const;
+	// A queued calculation is never started; a running one stops at its next solver iteration
+	void cancel();
+private:
+	std::shared_ptr<State> state;
+};
+
 class EquilibriumFactory {
 private:
 	Ipopt::SmartPtr<Ipopt::IpoptApplication> app; // pointer to Ipopt
+	// Systems built so far, reused by every create() with the same database, elements and phases
+	std::list<CompiledSystem> systems;
+	// Global hulls of recent (system, T, P), so that equilibria differing only in composition skip global minimization
+	GlobalHullCache hulls;
+	std::string cache_directory; // on-disk cache of compiled systems; disabled if empty
+	EquilibriumSolverOptions solver_options; // passed to every Equilibrium, and to the workers of submit()
+	// Descriptors of the compact results so far, one per system and set of variables, phases and conditions
+	std::list<std::pair<const CompiledSystem*, std::shared_ptr<const Optimizer::ResultDescriptor>>> descriptors;
+	// Results of recent create() and create_compact(), if enabled by SetResultCache()
+	std::unique_ptr<EquilibriumResultCache> results;
+	const CompiledSystem& get_system(const Database &, const evalconditions &);
+	// The descriptor of result among descriptors, or null
+	std::shared_ptr<const Optimizer::ResultDescriptor> find_descriptor(const CompiledSystem &, const Optimizer::EquilibriumResult<Ipopt::Number> &);
+	// Looks in results first; with no warm_start, a near result there serves as one
+	boost::shared_ptr<Equilibrium> solve(const CompiledSystem &, const evalconditions &, const Optimizer::EquilibriumResult<Ipopt::Number> *warm_start,
+		const Optimizer::SolveControl *control);
+	Optimizer::CompactEquilibriumResult create_compact(const Database &, const evalconditions &, const Optimizer::EquilibriumResult<Ipopt::Number> *);
+	std::shared_ptr<EquilibriumWorkerPool> workers; // started by StartWorkers() or the first submit()
+	std::mutex workers_mutex; // guards workers, so that several threads may submit at once
+	bool pin_workers; // bind the workers of submit() to CPUs
 public:
 	EquilibriumFactory();
+	~EquilibriumFactory(); // cancels all submitted jobs which have not ended
 	// EquilibriumFactory is noncopyable
 	EquilibriumFactory(const EquilibriumFactory&)=delete;
 	EquilibriumFactory & operator=(const EquilibriumFactory&) = delete;
 	boost::shared_ptr<Equilibrium> create(const Database &, const evalconditions &);
+	// Warm-start from the solution of a neighbouring equilibrium
+	boost::shared_ptr<Equilibrium> create(const Database &, const evalconditions &, const Equilibrium &previous);
+	// Warm-start from values without phases, e.g., from CheckpointedResult::expand()
+	boost::shared_ptr<Equilibrium> create(const Database &, const evalconditions &, const Optimizer::EquilibriumResult<Ipopt::Number> &previous);
+	// control may stop the solve from another thread
+	boost::shared_ptr<Equilibrium> create(const Database &, const evalconditions &, const Optimizer::SolveControl &control);
+	// Queue the calculation for the worker threads, each of which has its own Ipopt instance and compiled systems,
+	// so submit() may be called from several threads, and at the same time as create(); DB must outlive the job
+	// A timeout > 0 limits the seconds the job may spend solving. Blocks while the queue is full.
+	EquilibriumJob submit(const Database &DB, const evalconditions &conds, double timeout = 0);
+	// Queues all of the calculations, in order
+	std::vector<EquilibriumJob> submit(const Database &DB, const std::vector<evalconditions> &conds, double timeout = 0);
+	// Starts the workers of submit(), cancelling the jobs of any previous ones
+	// threads == 0 uses one worker per hardware thread; queue_capacity == 0 allows 16 queued jobs per worker
+	void StartWorkers(std::size_t threads = 0, std::size_t queue_capacity = 0);
+	// Bind each worker of submit() to one CPU, spread over the NUMA nodes, before it builds its solver, so that
+	// its compiled systems stay in the memory of its node (see WorkerPlacement); off by default.
+	// Workers started afterwards do the same
+	void SetWorkerPinning(bool enabled) { pin_workers = enabled; }
+	bool GetWorkerPinning() const { return pin_workers; }
+	// As create(), but only the values of the result are kept, e.g., for the points of a map;
+	// the models are shared by all results with the same phases
+	Optimizer::CompactEquilibriumResult create_compact(const Database &, const evalconditions &);
+	Optimizer::CompactEquilibriumResult create_compact(const Database &, const evalconditions &, const Optimizer::CompactEquilibriumResult &previous);
 	Ipopt::SmartPtr<Ipopt::IpoptApplication> GetIpopt();
+	// e.g., after the Database has been modified; the workers of submit() keep theirs until StartWorkers() is called again
+	void ClearSystemCache() { hulls.clear(); descriptors.clear(); systems.clear(); }
+	const GlobalHullCache& GetHullCache() const { return hulls; }
+	// Read and write compiled systems in directory, so that other processes can skip building them
+	// Workers started afterwards use the same directory
+	void SetCacheDirectory(const std::string &directory) { cache_directory = directory; }
+	const std::string& GetCacheDirectory() const { return cache_directory; }
+	// Solve in the null space of the site fraction balance constraints of each phase, with fewer variables
+	// and constraints; workers started afterwards do the same
+	void SetReducedSpace(bool enabled) { solver_options.reduced_space = enabled; }
+	bool GetReducedSpace() const { return solver_options.reduced_space; }
+	// Equilibria with at most max_variables variables are solved by NewtonGibbsSolver, falling back to Ipopt
+	// if it fails, e.g., because a phase vanishes; 0 (the default) always uses Ipopt. Workers started afterwards do the same
+	void SetNewtonMaxVariables(std::size_t max_variables) { solver_options.newton_max_variables = max_variables; }
+	std::size_t GetNewtonMaxVariables() const { return solver_options.newton_max_variables; }
+	// Record Equilibrium::solver_footprint() of every solve; off by default, since it walks every AST.
+	// Workers started afterwards do the same
+	void SetMemoryAccounting(bool enabled) { solver_options.memory_accounting = enabled; }
+	bool GetMemoryAccounting() const { return solver_options.memory_accounting; }
+	// Record every iteration of every Ipopt solve (see Equilibrium::trace()); workers started afterwards do the same
+	void SetSolverTrace(bool enabled) { solver_options.trace = enabled; }
+	bool GetSolverTrace() const { return solver_options.trace; }
+	// Stop an Ipopt solve once rule returns true, e.g., Optimizer::stop_when_stable(); the iterate at that point
+	// is the solution. Rules are tried in the order they were added; workers started afterwards use them too
+	void AddStoppingRule(const Optimizer::StoppingRule &rule) { solver_options.stopping_rules.push_back(rule); }
+	void ClearStoppingRules() { solver_options.stopping_rules.clear(); }
+	// Ipopt's print_level (6 by default); with 0 Ipopt prints nothing, which saves time in long calculations.
+	// Workers started afterwards do the same
+	void SetSolverPrintLevel(int level);
+	int GetSolverPrintLevel() const { return solver_options.print_level; }
+	// Keep up to max_bytes of recent results, so that create() and create_compact() under the same conditions
+	// return them without solving, and those under nearby conditions start from them; 0 (the default) disables it.
+	// The workers of submit() do not use it.
+	void SetResultCache(std::size_t max_bytes) { results.reset(max_bytes > 0 ? new EquilibriumResultCache(max_bytes) : nullptr); }
+	// Null if disabled; e.g., to save() the results for another process, or to load() them
+	EquilibriumResultCache* GetResultCache() { return results.get(); }
 };
 
 #endif
@@ -10,9 +10,18 @@
 
 // declaration for Mesh object
 
+#include <iosfwd>
 #include <unordered_map>
+#include <map>
 #include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
 #include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/equilibrium_fwd.hpp"
+#include "libgibbs/include/optimizer/compact_result.hpp"
+
+class Database;
+class EquilibriumFactory;
 
 
 enum class MeshAxisType : unsigned int {
@@ -28,15 +37,69 @@ struct MeshAxis {
 	MeshAxis(const double &argmin, const double &argmax, const double &subint, const MeshAxisType &type);
 };
 
+// A box of grid points, from lower to upper (inclusive) on every axis
+struct MeshCell {
+	std::vector<std::size_t> lower;
+	std::vector<std::size_t> upper;
+};
+
+// Results of solving every point of a Mesh
+// Points are ordered row-major over axis_names (the last axis varies fastest)
+struct MeshResult {
+	std::vector<std::string> axis_names; // sorted by name
+	std::vector<std::vector<double>> axis_values; // grid values of each axis
+	std::vector<double> coordinates; // point i, axis j is at i*axis_names.size()+j
+	std::vector<double> energies; // Gibbs energy of each point; NaN if the point failed
+	std::map<std::size_t,std::string> failures; // point -> error message
+	std::vector<boost::shared_ptr<Equilibrium>> equilibria; // full results; only filled if requested
+	// Only filled by Mesh::solve_adaptive(), which solves some of the grid points:
+	std::vector<std::size_t> grid_points; // row-major index of each point on the grid of axis_values
+	std::vector<std::vector<std::string>> stable_phases; // of each point, as CompactEquilibriumResult::stable_phases()
+	std::vector<MeshCell> cells; // the cells it did not split, which tile the grid; all of their corners are solved
+	std::vector<Optimizer::CompactEquilibriumResult> solutions; // of each point; only filled if requested
+	std::size_t size() const { return energies.size(); }
+	// One tab-separated line per point: the axis values, then the energy (nan if it failed)
+	// The first line names the columns; failures follow as "# point: message" lines
+	void write(std::ostream &stream) const;
+};
+
 class Mesh {
 private:
 	// collection of evalconditions objects
 	const evalconditions startpoint;
 	std::unordered_map<std::string,MeshAxis> axes;
+	std::string checkpoint_path; // solve() resumes from and appends to this file; disabled if empty
+	std::size_t checkpoint_interval; // points per append
+	bool pin_workers; // bind each worker thread other than the calling one to a CPU
 public:
 	Mesh(const evalconditions &);
 	void SetMeshAxis(const std::string &var, const double &min, const double &max, const double &subinterval, const MeshAxisType &);
 	void SetMeshAxis(const std::string &var, const double &min, const double &max, const double &subinterval);
 	void SetMeshAxis(const std::string &var, const double &min, const double &max);
+	// Grid values of one axis, in increasing order
+	static std::vector<double> ExpandAxis(const MeshAxis &);
+	// Conditions of every grid point, in the order used by MeshResult
+	std::vector<evalconditions> ExpandPoints(std::vector<std::string> &axis_names, std::vector<std::vector<double>> &axis_values) const;
+	// Make solve() write every finished point to path (see ResultCheckpoint), flush_interval points at a time,
+	// and skip the points already there from an earlier run on the same grid and starting point, so that a run
+	// which died can be resumed; restored points have no equilibria, and their neighbours are warm-started from them
+	void SetCheckpoint(const std::string &path, std::size_t flush_interval = 64);
+	// Bind each worker thread of solve() and solve_adaptive() to one CPU, spread over the NUMA nodes, before it
+	// builds its solver, so that its solver and compiled systems stay in the memory of its node (see WorkerPlacement)
+	// The calling thread is never moved. Off by default, as it suits a machine given over to one calculation
+	void SetWorkerPinning(bool enabled);
+	// Calculate the equilibrium at every grid point
+	// factory is used by the calling thread; every other worker thread creates its own solver
+	// threads == 0 uses one worker per hardware thread
+	// Neighbouring points along the last axis are warm-started from each other
+	MeshResult solve(const Database &DB, EquilibriumFactory &factory, std::size_t threads = 0, bool keep_equilibria = false) const;
+	// Calculate the equilibrium on the same grid adaptively: first every coarse_stride-th grid value of each axis
+	// (and the last one), then the corners of the halves of each cell whose solved corners differ in their
+	// stable phases, until those cells are one grid interval wide. A phase region which lies entirely inside
+	// a coarse cell, touching none of its corners, is missed. New points are warm-started from the nearest
+	// corner of the cell they split; threads as in solve(). The result has only the solved points, in grid order
+	// keep_solutions keeps the compact result of every point, e.g., for a PropertyTable
+	MeshResult solve_adaptive(const Database &DB, EquilibriumFactory &factory, std::size_t coarse_stride = 8, std::size_t threads = 0,
+		bool keep_solutions = false) const;
 };
 #endif
@@ -0,0 +1,36 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#ifndef MESH_MPI_INCLUDED
+#define MESH_MPI_INCLUDED
+
+// declaration for solving a Mesh across the ranks of an MPI communicator
+// Only available if libgibbs is built with LIBGIBBS_WITH_MPI defined (and linked to MPI)
+
+#ifdef LIBGIBBS_WITH_MPI
+
+#include <string>
+#include <mpi.h>
+#include "libgibbs/include/mesh.hpp"
+
+/*
+ * Every rank of comm must call SolveMeshDistributed() with the same Mesh, and its own copy of the
+ * same Database, so that only point numbers, energies and error messages cross the network.
+ * Rank 0 hands out chunks of whole rows (along the last axis, so that neighbouring points can still
+ * warm-start each other) to the other ranks as they ask for work. Chunks shrink as the mesh runs
+ * out, so a rank stuck in a slow, multi-phase region does not hold up the end of the run.
+ * Each of the other ranks solves its chunks with factory, which keeps its compiled systems between
+ * chunks; give the factories a shared cache directory so that the systems are built only once.
+ * Rank 0 returns the whole result, and writes it to result_path unless that is empty (see MeshResult::write());
+ * the other ranks return an empty MeshResult. With a single rank, the mesh is solved by Mesh::solve().
+ */
+MeshResult SolveMeshDistributed(const Mesh &mesh, const Database &DB, EquilibriumFactory &factory, MPI_Comm comm,
+		const std::string &result_path = std::string());
+
+#endif
+
+#endif
@@ -16,12 +16,14 @@
 #include "libtdb/include/structure.hpp"
 #include "libtdb/include/parameter.hpp"
 #include "libgibbs/include/utils/ast_caching.hpp"
+#include "libgibbs/include/utils/parameter_index.hpp"
 #include <boost/spirit/include/support_utree.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/composite_key.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/range/irange.hpp>
+#include <map>
 #include <string>
 #include <sstream>
 
@@ -38,13 +40,18 @@ struct sublattice_entry {
 				opt_index(opt_index_),
 				num_sites(num_sites_),
 				phase(phase_),
-				species(species_) {}
-	const std::string name() const {
+				species(species_) {
 		// std::to_string exists in C++11 but some compilers are buggy
 		std::stringstream ss;
 		ss << phase << "_" << index << "_" << species;
-		return (const std::string)ss.str();
+		variable_name = ss.str();
 	}
+	// PHASE_INDEX_SPECIES; formatted once, as the models ask for it for every term they build
+	const std::string& name() const {
+		return variable_name;
+	}
+private:
+	std::string variable_name;
 };
 
 /* Tags for multi-indexing */
@@ -133,6 +140,9 @@ public:
 	EnergyModel(const std::string &phasename, const sublattice_set &subl_set) {
 		// implementation
 	};
+	// restore a model from its AST and symbol table, e.g., after reading them from a cache
+	EnergyModel(const boost::spirit::utree &ast, const ASTSymbolMap &symbols) :
+		model_ast(ast), ast_symbol_table(symbols) { }
 	const boost::spirit::utree& get_ast() const { return model_ast; }
 	const boost::iterator_range<ASTSymbolMap::const_iterator> get_symbol_table() const {
 	    return boost::make_iterator_range ( ast_symbol_table.begin(), ast_symbol_table.end() );
@@ -141,9 +151,12 @@ public:
         const std::string &old_phase_name,
         const std::string &new_phase_name
     ) const;
+    std::unique_ptr<EnergyModel> clone() const;
 protected:
 	boost::spirit::utree model_ast;
 	ASTSymbolMap ast_symbol_table; // storage for expensive, repeating ASTs behind a symbol
+	// if set, find_parameter_ast() looks parameters up here instead of searching the view; only used while building
+	const ParameterIndex *parameter_index = nullptr;
 	EnergyModel& operator=( const EnergyModel& );
         EnergyModel( const EnergyModel &other ) {
             this->model_ast = other.model_ast;
@@ -156,6 +169,11 @@ protected:
 			const double &degree,
 			const boost::spirit::utree &input_tree
 			);
+	boost::spirit::utree add_interaction_polynomial (
+			const std::string &lhs_varname,
+			const std::string &rhs_varname,
+			const std::map<double,boost::spirit::utree> &coefficients // degree -> parameter
+			);
 	void normalize_utree(boost::spirit::utree &input_tree, const sublattice_set_view &ssv);
 	boost::spirit::utree find_parameter_ast(const sublattice_set_view &subl_view, const parameter_set_view &param_view);
 	boost::spirit::utree permute_site_fractions (
@@ -185,7 +203,8 @@ public:
 	PureCompoundEnergyModel(
 			const std::string &phasename,
 			const sublattice_set &subl_set,
-			const parameter_set &param_set
+			const parameter_set &param_set,
+			const ParameterIndex *index = nullptr // index of param_set, if any
 			);
 };
 
@@ -205,7 +224,8 @@ public:
 	RedlichKisterExcessEnergyModel(
 			const std::string &phasename,
 			const sublattice_set &subl_set,
-			const parameter_set &param_set
+			const parameter_set &param_set,
+			const ParameterIndex *index = nullptr // index of param_set, if any
 			);
 };
 
@@ -216,8 +236,23 @@ public:
 			const sublattice_set &subl_set,
 			const parameter_set &param_set,
 			const double &afm_factor,
-			const double &sro_enthalpy_order_fraction
+			const double &sro_enthalpy_order_fraction,
+			const ParameterIndex *index = nullptr // index of param_set, if any
 			);
+	// false if the phase has no magnetic contribution
+	bool has_ordering() const { return ordering; }
+	// The Curie temperature and the mean magnetic moment in terms of the site fractions, before the AFM factor
+	// is applied; the energy is a fixed function of these, T and the two factors (see MagneticKernel)
+	const boost::spirit::utree& curie_temperature() const { return curie_temperature_ast; }
+	const boost::spirit::utree& mean_magnetic_moment() const { return mean_magnetic_moment_ast; }
+	double afm_factor() const { return afm; }
+	double sro_enthalpy_order_fraction() const { return sro_fraction; }
+private:
+	bool ordering;
+	boost::spirit::utree curie_temperature_ast;
+	boost::spirit::utree mean_magnetic_moment_ast;
+	double afm;
+	double sro_fraction;
 };
 
 #endif
@@ -15,6 +15,7 @@
 #define INCLUDED_AST_SET
 
 #include <string>
+#include <utility>
 #include <sstream>
 #include <set>
 #include <list>
@@ -29,11 +30,26 @@ struct ast_entry {
 	std::list<std::string> diffvars; // variables of differentiation
 	std::string model_name;
 	boost::spirit::utree ast;
+	// tree is taken over with swap(); utree has no move constructor, and derivative trees are large
 	ast_entry (
 			std::list<std::string> dv, std::string mod_name, boost::spirit::utree tree) :
-				diffvars(dv),
-				model_name(mod_name),
-				ast(tree) {}
+				diffvars(std::move(dv)),
+				model_name(std::move(mod_name)) {
+		ast.swap(tree);
+	}
+	ast_entry (ast_entry const&) = default;
+	ast_entry (ast_entry &&other) :
+				diffvars(std::move(other.diffvars)),
+				model_name(std::move(other.model_name)) {
+		ast.swap(other.ast);
+	}
+	ast_entry& operator= (ast_entry const&) = default;
+	ast_entry& operator= (ast_entry &&other) {
+		diffvars = std::move(other.diffvars);
+		model_name = std::move(other.model_name);
+		ast.swap(other.ast);
+		return *this;
+	}
 	std::list<std::string>::size_type ast_derivative_order() const {
 		return diffvars.size();
 	}
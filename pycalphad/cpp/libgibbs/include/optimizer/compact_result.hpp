@@ -0,0 +1,113 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Equilibrium results stored as dense vectors against a shared descriptor of the problem
+
+#ifndef INCLUDED_COMPACT_RESULT
+#define INCLUDED_COMPACT_RESULT
+
+#include "libgibbs/include/compositionset.hpp"
+#include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/optimizer/equilibriumresult.hpp"
+#include <boost/bimap.hpp>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Optimizer {
+
+/* An EquilibriumResult owns a copy of the composition set of every phase, with all of its ASTs,
+ * and names every value by a string, which is fine for one calculation but not for the 10^5
+ * points of a map. A CompactEquilibriumResult keeps only the values, as dense vectors, and a
+ * shared pointer to a ResultDescriptor, which holds everything else: the names of the values,
+ * the phases and their composition sets. Results whose problems have the same variables, phases
+ * and conditions (but not the same values) share a descriptor; see EquilibriumFactory::create_compact().
+ * Derived quantities are calculated when they are asked for, with the composition sets of the descriptor.
+ * Descriptors are immutable once built.
+ */
+class ResultDescriptor {
+public:
+	struct PhaseEntry {
+		std::string name;
+		PhaseStatus status;
+		std::size_t phase_fraction; // position of the phase fraction in the variables
+		std::vector<std::size_t> coordinates; // position in the variables of each coordinate of the phase's SublatticeLayout
+		CompositionSet compositionset;
+	};
+	// Takes the composition sets out of result
+	explicit ResultDescriptor(EquilibriumResult<double> &result);
+	// Copies the composition sets of result
+	explicit ResultDescriptor(const EquilibriumResult<double> &result);
+	ResultDescriptor(const ResultDescriptor &) = delete;
+	ResultDescriptor & operator=(const ResultDescriptor &) = delete;
+
+	// Can the values of result be stored against this descriptor?
+	bool matches(const EquilibriumResult<double> &result) const;
+
+	// Variables are ordered by name, as in EquilibriumResult::variables
+	const std::vector<std::string>& variable_names() const { return variables; }
+	const boost::bimap<std::string, int>& variable_map() const { return variable_indices; }
+	const std::vector<std::string>& constraint_names() const { return constraints; }
+	// The state variables, then the mole fractions, of the conditions
+	const std::vector<char>& statevar_names() const { return statevars; }
+	const std::vector<std::string>& xfrac_names() const { return xfracs; }
+	const std::vector<std::string>& elements() const { return system_elements; }
+	const std::vector<PhaseEntry>& phases() const { return phase_entries; }
+	// Throws unknown_symbol_error if there is no such phase
+	const PhaseEntry& phase(const std::string &name) const;
+private:
+	// Everything but the composition sets of the phases
+	void describe(const EquilibriumResult<double> &result);
+	std::vector<std::string> variables;
+	boost::bimap<std::string, int> variable_indices;
+	std::vector<std::string> constraints;
+	std::vector<char> statevars;
+	std::vector<std::string> xfracs;
+	std::vector<std::string> system_elements;
+	std::vector<PhaseEntry> phase_entries;
+};
+
+class CompactEquilibriumResult {
+public:
+	CompactEquilibriumResult() : walltime(0), itercount(0), N(0) { }
+	// The values of result; descriptor is used if it matches result, otherwise a new one takes the composition sets of result
+	CompactEquilibriumResult(EquilibriumResult<double> &&result, std::shared_ptr<const ResultDescriptor> descriptor);
+	// The values of a result without phases, e.g., from expand(), which has the variables, constraints and conditions of descriptor
+	CompactEquilibriumResult(const EquilibriumResult<double> &values, std::shared_ptr<const ResultDescriptor> descriptor);
+
+	double walltime; // Wall clock time to perform calculation
+	int itercount; // Number of iterations to perform calculation
+	double N; // Total system size in moles
+	std::shared_ptr<const ResultDescriptor> descriptor;
+	std::vector<double> x; // by descriptor->variable_names()
+	std::vector<double> lower_multipliers; // as x
+	std::vector<double> upper_multipliers; // as x
+	std::vector<double> constraint_multipliers; // by descriptor->constraint_names()
+	std::vector<double> condition_values; // by descriptor->statevar_names(), then descriptor->xfrac_names()
+
+	// The conditions of the calculation, rebuilt from condition_values
+	evalconditions conditions() const;
+	// Throws unknown_symbol_error for unknown names
+	double variable(const std::string &name) const;
+	double phase_fraction(const std::string &phase) const;
+	double mole_fraction(const std::string &species, const std::string &phase) const;
+	double mole_fraction(const std::string &species) const; // of the whole system
+	// Phases with a phase fraction above minimum_fraction, sorted; a phase appears once per composition set,
+	// e.g., FCC_A1 twice for both sides of a miscibility gap in it
+	std::vector<std::string> stable_phases(double minimum_fraction = 1e-6) const;
+	double energy(const std::string &phase) const; // per mole of formula units of the phase
+	double energy() const; // of the system
+	// The values in the form of an EquilibriumResult without phases, e.g., to warm-start a neighbouring calculation
+	EquilibriumResult<double> expand() const;
+	// As expand(), with the phases, each with a copy of the composition set of the descriptor
+	EquilibriumResult<double> restore() const;
+};
+}
+
+#endif
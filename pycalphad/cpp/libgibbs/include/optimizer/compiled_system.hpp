@@ -0,0 +1,89 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// declaration for CompiledSystem class
+
+#ifndef INCLUDED_COMPILED_SYSTEM
+#define INCLUDED_COMPILED_SYSTEM
+
+#include "libgibbs/include/compositionset.hpp"
+#include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/models.hpp"
+#include "libgibbs/include/utils/parameter_index.hpp"
+#include "libtdb/include/structure.hpp"
+#include "libtdb/include/database.hpp"
+#include <boost/bimap.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// The part of an equilibrium calculation that does not depend on the state variables or the
+// overall composition: the models of every entered phase, their derivative trees, constraint
+// basis matrices and compiled programs.
+// It is built once per (Database, elements, entered phases) and can be shared by any number of
+// GibbsOpt objects, which copy the composition sets they need and bind the conditions to them.
+class CompiledSystem {
+public:
+    // Only conditions.elements and conditions.phases are used
+    CompiledSystem ( const Database &DB, const evalconditions &conditions );
+    // As above, but the composition sets are read from a file in cache_directory if one was written
+    // for the same elements, phases and parameters; otherwise they are built and written there
+    // An empty cache_directory disables the cache
+    CompiledSystem ( const Database &DB, const evalconditions &conditions, const std::string &cache_directory );
+    CompiledSystem ( const CompiledSystem & ) = delete;
+    CompiledSystem& operator= ( const CompiledSystem & ) = delete;
+
+    // Can this system be used to calculate an equilibrium of DB under conditions?
+    bool matches ( const Database &DB, const evalconditions &conditions ) const;
+
+    const std::string& source_name() const {
+        return sourcename;
+    }
+    const std::vector<std::string>& elements() const {
+        return system_elements;
+    }
+    // Entered phases
+    const Phase_Collection& phases() const {
+        return phase_col;
+    }
+    const sublattice_set& sublattices() const {
+        return main_ss;
+    }
+    const boost::bimap<std::string, int>& variable_map() const {
+        return main_indices;
+    }
+    // One composition set per entered phase, named after the phase
+    const std::map<std::string,CompositionSet>& composition_sets() const {
+        return comp_sets;
+    }
+    // Hash of everything the composition sets are built from; names the cache file
+    std::uint64_t cache_key() const {
+        return key;
+    }
+private:
+    static std::set<std::string> entered_phases ( const evalconditions &conditions );
+    void build_composition_sets ( const Database &DB );
+    bool read_cache ( const std::string &path );
+    void write_cache ( const std::string &path ) const;
+    std::uint64_t key;
+    const Database* database; // only used to identify the database
+    std::string sourcename;
+    std::vector<std::string> system_elements;
+    std::set<std::string> entered_phase_names; // including any that are not in the database
+    Phase_Collection phase_col;
+    sublattice_set main_ss;
+    boost::bimap<std::string, int> main_indices;
+    std::map<std::string,CompositionSet> comp_sets;
+    // Held so that systems built from the same database one after another share one index
+    std::shared_ptr<const ParameterIndex> parameter_index;
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
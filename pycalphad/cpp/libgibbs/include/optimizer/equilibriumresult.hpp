@@ -12,6 +12,8 @@
 
 #include "libgibbs/include/compositionset.hpp"
 #include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/optimizer/solver_trace.hpp"
+#include "libgibbs/include/utils/stage_profile.hpp"
 #include "libtdb/include/logging.hpp"
 #include <map>
 #include <string>
@@ -53,7 +55,6 @@ public:
     Optimizer::PhaseStatus status; // Phase status
     std::vector<Sublattice<T> > sublattices; // Sublattices in phase
     CompositionSet compositionset; // CompositionSet object (contains model ASTs)
-    mutable logger pot_log;
     T mole_fraction(const std::string &) const; //  Mole fraction of species in phase
     T energy(const std::map<std::string,T> &variables, const evalconditions &conditions) const { // Energy of the phase
             return compositionset.evaluate_objective(conditions, variables);
@@ -65,7 +66,8 @@ public:
             // Some phases,  e.g.,  line compounds, only have well-defined chemical potentials at
             // multi-phase equilibrium,  so they will have to be calculated together.
             BOOST_LOG_NAMED_SCOPE("Phase::chemical_potential");
-            BOOST_LOG_CHANNEL_SEV(pot_log, "optimizer", debug) << "mu " << name << " in " << compositionset.name();
+            logger pot_log(journal::keywords::channel = "optimizer"); // local, so concurrent calls share no state
+            BOOST_LOG_SEV(pot_log, debug) << "mu " << name << " in " << compositionset.name();
             if (name == "VA") return 0; // chemical potential of vacancy is defined to be zero
             T ret_potential;
             std::size_t total_site_count = 0;
@@ -176,9 +178,15 @@ public:
 	typedef std::map<std::string, T> VariableMap;
 	double walltime; // Wall clock time to perform calculation
 	int itercount; // Number of iterations to perform calculation
+	StageProfile profile; // Call counts and wall time of the setup, global minimization and solver callbacks
+	std::shared_ptr<const SolverTrace> trace; // Every iteration of the solver, if it was asked for; null otherwise
 	T N; // Total system size in moles (TODO: should eventually be a fixed variable accessed by variables["N"])
 	PhaseMap phases; // Phases in equilibrium
 	VariableMap variables; // optimized values of all variables
+	// Multipliers at the solution; with variables they can warm-start a neighbouring calculation
+	VariableMap lower_multipliers; // bound multipliers z_L of all variables
+	VariableMap upper_multipliers; // bound multipliers z_U of all variables
+	VariableMap constraint_multipliers; // constraint multipliers, by constraint name
 	// TODO: One day all state variables should be fixed variables in the optimization, and evalconditions should go away
 	evalconditions conditions; // conditions object for the Equilibrium
 
@@ -198,18 +206,28 @@ public:
 	EquilibriumResult(EquilibriumResult &&other) :
 		walltime(other.walltime),
 		itercount(other.itercount),
+		profile(std::move(other.profile)),
+		trace(std::move(other.trace)),
 		N(other.N),
-		phases(std::move(other.phases),
+		phases(std::move(other.phases)),
 		variables(std::move(other.variables)),
-		conditions(std::move(other.conditions))) {
+		lower_multipliers(std::move(other.lower_multipliers)),
+		upper_multipliers(std::move(other.upper_multipliers)),
+		constraint_multipliers(std::move(other.constraint_multipliers)),
+		conditions(std::move(other.conditions)) {
 	}
 
 	EquilibriumResult & operator= (EquilibriumResult &&other) {
 		this->walltime = other.walltime;
 		this->itercount = other.itercount;
+		this->profile = std::move(other.profile);
+		this->trace = std::move(other.trace);
 		this->N = other.N;
 		this->phases = std::move(other.phases);
 		this->variables = std::move(other.variables);
+		this->lower_multipliers = std::move(other.lower_multipliers);
+		this->upper_multipliers = std::move(other.upper_multipliers);
+		this->constraint_multipliers = std::move(other.constraint_multipliers);
 		this->conditions = std::move(other.conditions);
 		return *this;
 	}
@@ -0,0 +1,84 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Global hulls kept between equilibrium calculations at the same temperature and pressure
+
+#ifndef INCLUDED_GLOBAL_HULL_CACHE
+#define INCLUDED_GLOBAL_HULL_CACHE
+
+#include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/optimizer/compiled_system.hpp"
+#include "libgibbs/include/optimizer/lower_hull_minimization.hpp"
+#include "libgibbs/include/optimizer/utils/simplicial_facet.hpp"
+#include "libgibbs/include/utils/memory_footprint.hpp"
+#include "libgibbs/include/utils/stage_profile.hpp"
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+/* The global hull found by GlobalMinimizer::run() depends on the entered phases and the
+ * state variables, but not on the overall composition, which is only used by find_tie_points().
+ * GlobalHullCache keeps the hulls of the most recently used (system, state variables, entered
+ * phases) so that, e.g., every point of an isothermal section samples the phases only once.
+ * N is not part of the key, since the hull is per mole of formula units.
+ * The CompiledSystems must outlive the cache, or the cache must be cleared first.
+ * A GlobalHullCache is not thread-safe.
+ */
+class GlobalHullCache {
+public:
+    typedef Optimizer::LowerHullGlobalMinimizer<Optimizer::details::SimplicialFacet<double>,double,double> MinimizerType;
+    typedef MinimizerType::HullMapType::HullEntryType HullEntryType;
+
+    explicit GlobalHullCache ( const std::size_t capacity = 8 );
+    GlobalHullCache ( const GlobalHullCache & ) = delete;
+    GlobalHullCache& operator= ( const GlobalHullCache & ) = delete;
+
+    // The minimizer holding the global hull of system under conditions, running it first if there is none
+    // The stages of that run are added to profile
+    MinimizerType& hull ( const CompiledSystem &system, const evalconditions &conditions, StageProfile &profile );
+    // Points on the tie hyperplane of conditions.xfrac, found on the cached hull
+    // The time of the search is added to profile as "global minimization: tie points"
+    std::vector<HullEntryType> find_tie_points ( const CompiledSystem &system, const evalconditions &conditions, StageProfile &profile );
+
+    void clear() {
+        entries.clear();
+    }
+    std::size_t size() const {
+        return entries.size();
+    }
+    std::size_t hits() const {
+        return hit_count;
+    }
+    std::size_t misses() const {
+        return miss_count;
+    }
+    // Of the minimizers of all cached hulls
+    MemoryFootprint memory_footprint() const {
+        MemoryFootprint footprint;
+        for ( auto i = entries.cbegin(); i != entries.cend(); ++i ) {
+            footprint += i->minimizer->memory_footprint();
+        }
+        return footprint;
+    }
+private:
+    struct Entry {
+        const CompiledSystem* system;
+        std::map<char,double> statevars; // without N
+        std::set<std::string> entered_phases;
+        std::unique_ptr<MinimizerType> minimizer;
+    };
+    std::list<Entry> entries; // most recently used first
+    std::size_t capacity;
+    std::size_t hit_count;
+    std::size_t miss_count;
+};
+
+#endif
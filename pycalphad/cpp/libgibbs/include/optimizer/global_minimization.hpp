@@ -12,19 +12,31 @@
 
 #include "libgibbs/include/compositionset.hpp"
 #include "libgibbs/include/models.hpp"
+#include "libgibbs/include/optimizer/utils/energy_cache.hpp"
 #include "libgibbs/include/optimizer/utils/ezd_minimization.hpp"
 #include "libgibbs/include/optimizer/utils/hull_mapping.hpp"
 #include "libgibbs/include/optimizer/utils/convex_hull.hpp"
+#include "libgibbs/include/optimizer/utils/facet_index.hpp"
 #include "libgibbs/include/utils/for_each_pair.hpp"
+#include "libgibbs/include/utils/memory_footprint.hpp"
 #include "libgibbs/include/utils/site_fraction_convert.hpp"
+#include "libgibbs/include/utils/stage_profile.hpp"
+#include "libgibbs/include/utils/sublattice_symmetry.hpp"
 #include "libtdb/include/logging.hpp"
 #include <boost/assert.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/concept_check.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include <functional>
 #include <list>
+#include <map>
 #include <limits>
+#include <memory>
 #include <set>
+#include <thread>
 
 namespace Optimizer {
 
@@ -46,15 +58,122 @@ public:
 protected:
     HullMapType hull_map;
     std::vector<FacetType> candidate_facets;
+    details::FacetIndex<CoordinateType> facet_index; // bounding boxes of candidate_facets in reduced mole fractions
+    // One per phase during run(), so each point is evaluated at most once; kept afterwards for its counters
+    std::map<std::string,std::shared_ptr<details::EnergyCache>> energy_caches;
+    StageProfile profile; // reset by run(); the sampling and hull stages are summed over all phases
     mutable logger class_log;
     double critical_edge_length; // minimum length of a tie line
     std::size_t initial_subdivisions_per_axis; // initial discretization to find spinodals
     std::size_t refinement_subdivisions_per_axis; // during mesh refinement
     std::size_t max_search_depth; // maximum recursive depth
     bool discard_unstable; // when sampling points, discard unstable ones before refinement
+    std::size_t worker_threads; // phases sampled concurrently by run(); point_sample() and internal_hull() must be reentrant
+    std::size_t threads_per_phase; // set by run(): the share of worker_threads available within one point_sample()
+    bool single_precision_sampling; // see set_single_precision_sampling()
+    std::shared_ptr<EnergyDevice> energy_device; // see set_energy_device(); may be null
+    bool filter_tie_facets; // see set_tie_facet_filtering()
+    double phase_pruning_margin; // see set_phase_pruning(); 0 disables pruning
+    std::size_t pruning_sample_budget; // quasirandom points per phase in the coarse pass
+    std::set<std::string> pruned_phases; // sampled only coarsely by the last run()
+    // Phases listed here are sampled with this many quasirandom points instead of by simplex subdivision
+    std::map<std::string,std::size_t> sample_point_budgets;
+    // Groups of equivalent sublattices declared for a phase; see set_sublattice_symmetry()
+    std::map<std::string,std::vector<std::vector<std::size_t>>> declared_symmetries;
+    bool detect_symmetries; // see set_sublattice_symmetry_detection()
+    std::map<std::string,SublatticeSymmetry> phase_symmetries; // used by the last run(), for phases that have one
 public:
     typedef typename HullMapType::PointType PointType;
     typedef typename HullMapType::GlobalPointType GlobalPointType;
+    typedef typename HullMapType::PointCloudType PointCloudType;
+protected:
+    // Create a callback function for energy calculation for this phase
+    std::function<EnergyType(const PointType&)> internal_energy_function (
+        CompositionSet const& cmp,
+        evalconditions const& conditions
+    ) const {
+        details::EnergyCache* const cache = energy_cache ( cmp );
+        if ( cache ) {
+            return [cache] (const PointType& point) {
+                return cache->energy ( &point[0] );
+            };
+        }
+        return [&cmp,&conditions] (const PointType& point) {
+            return cmp.evaluate_objective(conditions,cmp.get_variable_map(),const_cast<EnergyType*>(&point[0]));
+        };
+    }
+    // Calculate the "true energies" of the midpoints of edges between points, based on their IDs
+    // If the phases are distinct, the "true energy" is infinite (indicates true line)
+    // The edges of one call are grouped by phase, and the midpoints of each phase evaluated in one batch
+    // The hull map must already contain the points
+    // Points of a symmetric phase only stand for their orbits, so the "true energy" of an edge there is the lowest
+    // of the midpoints between the first point and every image of the second
+    details::MidpointEnergyBatch global_midpoint_energies_function (
+        std::map<std::string,CompositionSet> const& phase_list,
+        evalconditions const& conditions
+    ) const {
+        std::vector<CompositionSet const*> comp_sets;
+        std::vector<SublatticeSymmetry const*> symmetries;
+        for ( std::size_t phase_id = 0; phase_id < hull_map.phase_count(); ++phase_id ) {
+            auto current_comp_set = phase_list.find ( hull_map.phase_name_of_id ( phase_id ) );
+            BOOST_ASSERT ( current_comp_set != phase_list.end() );
+            comp_sets.push_back ( &current_comp_set->second );
+            auto symmetry = phase_symmetries.find ( hull_map.phase_name_of_id ( phase_id ) );
+            symmetries.push_back ( symmetry != phase_symmetries.end() ? &symmetry->second : nullptr );
+        }
+        return [this,comp_sets,symmetries,conditions]
+        ( const std::vector<std::pair<std::size_t,std::size_t>> &edges, std::vector<double> &energies )
+        {
+            // Can't calculate a "true energy" if the tie points are different phases
+            energies.assign ( edges.size(), std::numeric_limits<EnergyType>::max() );
+            std::vector<std::vector<std::size_t>> phase_edges ( comp_sets.size() ); // phase -> edges of that phase
+            for ( std::size_t edge = 0; edge < edges.size(); ++edge ) {
+                const std::size_t point1_id = edges[edge].first;
+                const std::size_t point2_id = edges[edge].second;
+                BOOST_ASSERT ( point1_id < hull_map.size() );
+                BOOST_ASSERT ( point2_id < hull_map.size() );
+                if ( point1_id == point2_id ) energies[edge] = hull_map.energy ( point1_id );
+                else if ( hull_map.phase_id ( point1_id ) == hull_map.phase_id ( point2_id ) ) {
+                    phase_edges[hull_map.phase_id ( point1_id )].push_back ( edge );
+                }
+            }
+            std::vector<double> midpoints;
+            std::vector<double> phase_energies;
+            std::vector<double> images;
+            std::vector<std::size_t> midpoint_edges; // index into current_edges of each midpoint
+            for ( std::size_t phase_id = 0; phase_id < comp_sets.size(); ++phase_id ) {
+                const std::vector<std::size_t> &current_edges = phase_edges[phase_id];
+                if ( current_edges.empty() ) continue;
+                // The energy of the average of the internal degrees of freedom
+                const std::size_t dimension = comp_sets[phase_id]->get_variable_map().size();
+                SublatticeSymmetry const* const symmetry = symmetries[phase_id];
+                midpoints.clear();
+                midpoint_edges.clear();
+                for ( std::size_t i = 0; i < current_edges.size(); ++i ) {
+                    const details::PointView<CoordinateType> point1 = hull_map.internal_coordinates ( edges[current_edges[i]].first );
+                    const details::PointView<CoordinateType> point2 = hull_map.internal_coordinates ( edges[current_edges[i]].second );
+                    images.clear();
+                    std::size_t image_count = 1;
+                    if ( symmetry ) image_count = symmetry->images ( &point2[0], images );
+                    else images.assign ( point2.begin(), point2.begin() + dimension );
+                    for ( std::size_t image = 0; image < image_count; ++image ) {
+                        double const* const other = &images[image * dimension];
+                        for ( std::size_t coord = 0; coord < dimension; ++coord ) {
+                            midpoints.push_back ( ( point1[coord] + other[coord] ) / 2 );
+                        }
+                        midpoint_edges.push_back ( i );
+                    }
+                }
+                phase_energies.resize ( midpoint_edges.size() );
+                comp_sets[phase_id]->evaluate_objective_batch ( conditions, &midpoints[0], midpoint_edges.size(), dimension, &phase_energies[0] );
+                for ( std::size_t i = 0; i < midpoint_edges.size(); ++i ) {
+                    EnergyType &energy = energies[current_edges[midpoint_edges[i]]];
+                    energy = std::min<EnergyType> ( energy, phase_energies[i] );
+                }
+            }
+        };
+    }
+public:
     
     GlobalMinimizer() {
         critical_edge_length = 0.05;
@@ -62,78 +181,194 @@ public:
         refinement_subdivisions_per_axis = 2;
         max_search_depth = 5;
         discard_unstable = true;
+        worker_threads = std::thread::hardware_concurrency();
+        threads_per_phase = 1;
+        single_precision_sampling = false;
+        filter_tie_facets = false;
+        phase_pruning_margin = 0;
+        pruning_sample_budget = 64;
+        detect_symmetries = false;
+    }
+
+    /* Evaluate the energies of sampled points in single precision, with twice as many points per
+     * block and half the memory traffic, when they are only needed to find the internal hulls.
+     * The points on the internal hulls are then evaluated again in double precision before the
+     * global hull, so its facets and everything after (refinement, the final solve) are exact.
+     * Error bound: a float energy is within about k * 2^-24 * S of the double one, where k is the
+     * number of operations of the energy program and S the sum of the magnitudes of its terms
+     * (see CompiledExpression::evaluate_batch()); for typical databases, where S is 1e4 to 1e6
+     * J/mol, this is well below 1 J/mol. It can only affect which points within that distance of
+     * an internal hull are kept. The largest error seen is logged by run().
+     */
+    void set_single_precision_sampling ( const bool single_precision ) {
+        single_precision_sampling = single_precision;
+    }
+
+    /* Evaluate the quasirandom samples of budgeted phases (see set_sample_point_budget()) on device,
+     * e.g., EnergyDevice::open(), and keep only the points that can be on their internal hulls.
+     * Phases sampled concurrently take turns on the device. Null restores evaluation on the CPU.
+     */
+    void set_energy_device ( std::shared_ptr<EnergyDevice> device ) {
+        energy_device = device;
     }
 
-    virtual std::vector<PointType> point_sample(
+    // Keep only global hull facets with at least one true tie line edge, whose midpoint (within one
+    // phase) is higher in energy than the lever rule; by default every lower facet is kept
+    void set_tie_facet_filtering ( const bool filter ) {
+        filter_tie_facets = filter;
+    }
+
+    /* Before sampling, run a coarse pass of coarse_points quasirandom points (and the end-members) per
+     * phase and build the lower hull of all of them. Phases whose coarse points all lie more than margin
+     * (J/mol) above that hull are very unlikely to touch the global hull, so they are not sampled
+     * further: their coarse points still go into the global hull, which keeps a pruned phase that
+     * does reach it at some point. A margin of 0 samples every phase in full.
+     */
+    void set_phase_pruning ( const double margin, const std::size_t coarse_points = 64 ) {
+        phase_pruning_margin = margin;
+        pruning_sample_budget = coarse_points;
+    }
+    // Phases that the last run() sampled only coarsely
+    std::set<std::string> const& get_pruned_phases() const {
+        return pruned_phases;
+    }
+
+    // Sample phase_name with a fixed number of quasirandom points; a budget of 0 restores simplex subdivision
+    void set_sample_point_budget ( const std::string &phase_name, const std::size_t point_budget ) {
+        if ( point_budget == 0 ) sample_point_budgets.erase ( phase_name );
+        else sample_point_budgets[phase_name] = point_budget;
+    }
+
+    /* Declare groups of equivalent sublattices of phase_name (indices in its sublattice order), e.g., the four
+     * fcc sublattices of an L1_2 ordering model: every permutation of their site fractions must leave the energy
+     * unchanged. Only the fundamental domain of the symmetry (see SublatticeSymmetry) is then sampled, each orbit
+     * is evaluated once and the internal hull is built from up to SublatticeSymmetry::order() times fewer points;
+     * the global hull is unaffected, since the points of an orbit have the same mole fractions and energy. Other
+     * copies are only made where the global hull needs them: to test whether an edge within the phase is a true
+     * tie line. No groups removes the declaration. Declarations are checked by run(), which throws
+     * range_check_error if the sublattices differ in site count or species.
+     */
+    void set_sublattice_symmetry ( const std::string &phase_name, std::vector<std::vector<std::size_t>> groups ) {
+        if ( groups.empty() ) declared_symmetries.erase ( phase_name );
+        else declared_symmetries[phase_name] = std::move ( groups );
+    }
+    // Find the symmetries of phases without a declared one by SublatticeSymmetry::detect() at the start of run()
+    void set_sublattice_symmetry_detection ( const bool detect ) {
+        detect_symmetries = detect;
+    }
+    // The symmetry of phase_name in the last run(), or none
+    SublatticeSymmetry get_sublattice_symmetry ( const std::string &phase_name ) const {
+        auto symmetry = phase_symmetries.find ( phase_name );
+        return symmetry != phase_symmetries.end() ? symmetry->second : SublatticeSymmetry();
+    }
+
+    // The last coordinate of each sampled point is its energy
+    virtual PointCloudType point_sample(
         CompositionSet const& cmp,
         sublattice_set const& sublset,
         evalconditions const& conditions
         ) {
+        details::EnergyCache* const cache = energy_cache ( cmp );
+        auto point_budget = sample_point_budgets.find ( cmp.name() );
+        if ( point_budget != sample_point_budgets.end() ) {
+            // Use a fixed budget of low-discrepancy points to sample the space
+            if ( cache && energy_device ) {
+                return details::QuasirandomSimplexSample(cmp, sublset, conditions, point_budget->second, threads_per_phase, *cache, *energy_device);
+            }
+            if ( cache ) {
+                return details::QuasirandomSimplexSample(cmp, sublset, conditions, point_budget->second, threads_per_phase, *cache);
+            }
+            return details::QuasirandomSimplexSample(cmp, sublset, conditions, point_budget->second, threads_per_phase);
+        }
         BOOST_ASSERT(initial_subdivisions_per_axis>0);
         // Use adaptive simplex subdivision to sample the space
+        if ( cache ) {
+            return details::AdaptiveSimplexSample(cmp, sublset, conditions, initial_subdivisions_per_axis, refinement_subdivisions_per_axis, discard_unstable, *cache, threads_per_phase);
+        }
         return details::AdaptiveSimplexSample(cmp, sublset, conditions, initial_subdivisions_per_axis, refinement_subdivisions_per_axis, discard_unstable);
     };
-    virtual std::vector<PointType> internal_hull(
+    virtual PointCloudType internal_hull(
         CompositionSet const& cmp,
-        std::vector<PointType> const& points,
+        PointCloudType const& points,
         std::set<std::size_t> const& dependent_dimensions,
         evalconditions const& conditions
     ) {
         BOOST_ASSERT(critical_edge_length>0);
-        // Create a callback function for energy calculation for this phase
-        auto calculate_energy = [&cmp,&conditions] (const PointType& point) {
-            return cmp.evaluate_objective(conditions,cmp.get_variable_map(),const_cast<EnergyType*>(&point[0]));
-        };
-        // Use qhull to get the hull
+        // Calculate the full convex hull and keep its lower facets
         return details::internal_lower_convex_hull( points, 
                                                     dependent_dimensions, 
                                                     critical_edge_length, 
-                                                    calculate_energy 
+                                                    internal_energy_function ( cmp, conditions )
                                                   );
     };
     virtual std::vector<FacetType> global_hull(
-        std::vector<PointType> const& points,
+        PointCloudType const& points,
         std::map<std::string,CompositionSet> const& phase_list,
         evalconditions const& conditions
     ) {
         BOOST_ASSERT(critical_edge_length>0);
-        // Calculate the "true energy" of the midpoint of two points, based on their IDs
-        // If the phases are distinct, the "true energy" is infinite (indicates true line)
-        auto calculate_global_midpoint_energy = [this,&conditions,&phase_list] 
-        (const std::size_t point1_id, const std::size_t point2_id) 
-        { 
-            BOOST_ASSERT ( point1_id < hull_map.size() );
-            BOOST_ASSERT ( point2_id < hull_map.size() );
-            if ( point1_id == point2_id) return hull_map[point1_id].energy;
-            if (hull_map[point1_id].phase_name != hull_map[point2_id].phase_name) {
-                // Can't calculate a "true energy" if the tie points are different phases
-                return std::numeric_limits<EnergyType>::max();
-            }
-            // Return the energy of the average of the internal degrees of freedom
-            else {
-                PointType midpoint ( hull_map[point1_id].internal_coordinates );
-                PointType point2 ( hull_map[point2_id].internal_coordinates );
-                auto current_comp_set = phase_list.find ( hull_map[point1_id].phase_name );
-                std::transform ( 
-                point2.begin(), 
-                                point2.end(),
-                                midpoint.begin(),
-                                midpoint.begin(),
-                                std::plus<EnergyType>()
-                ); // sum points together
-                for (auto &coord : midpoint) coord /= 2; // divide by two
-                auto calculate_energy = [&] (const PointType& point) {
-                    return current_comp_set->second.evaluate_objective(conditions,current_comp_set->second.get_variable_map(),const_cast<EnergyType*>(&point[0]));
-                };
-                return  calculate_energy ( midpoint ); 
-            }
-        };
-        // Use qhull to get the global hull
+        // Calculate the full global convex hull and keep its lower facets
         return details::global_lower_convex_hull( points, 
                                                   critical_edge_length, 
-                                                  calculate_global_midpoint_energy
+                                                  global_midpoint_energies_function ( phase_list, conditions ),
+                                                  filter_tie_facets
                                                 );
     };
+    // The coarse points of the phases to prune (see set_phase_pruning()), and no points for the others
+    std::vector<PointCloudType> prune_phases (
+        std::vector<typename std::map<std::string,CompositionSet>::const_iterator> const &phases,
+        sublattice_set const &sublset,
+        evalconditions const& conditions,
+        std::vector<std::string> const &components
+    ) {
+        std::vector<PointCloudType> coarse_samples ( phases.size() );
+        if ( phase_pruning_margin <= 0 || phases.size() < 2 || components.size() < 2 ) return coarse_samples;
+        // Mole fractions of all components, then the energy; the dependent mole fraction is dropped
+        const std::size_t global_dimension = components.size()+1;
+        details::LowerConvexHull hull ( global_dimension, std::set<std::size_t> { components.size()-1 }, true );
+        std::vector<PointCloudType> global_samples ( phases.size(), PointCloudType ( global_dimension ) );
+        for ( std::size_t phase_id = 0; phase_id < phases.size(); ++phase_id ) {
+            CompositionSet const &cmp = phases[phase_id]->second;
+            const SublatticeLayout &layout = cmp.sublattice_layout();
+            coarse_samples[phase_id] = details::QuasirandomSimplexSample ( cmp, sublset, conditions, pruning_sample_budget, 1,
+                                                                           *energy_cache ( cmp ) );
+            const PointCloudType &coarse = coarse_samples[phase_id];
+            PointCloudType &global = global_samples[phase_id];
+            global.resize ( coarse.size() );
+            if ( coarse.empty() ) continue;
+            const MoleFractionMatrix mole_fractions ( layout, components );
+            mole_fractions.convert ( coarse.data(), coarse.size(), coarse.dimension(), global.data(), global.dimension() );
+            for ( std::size_t i = 0; i < coarse.size(); ++i ) {
+                global[i][components.size()] = coarse[i][layout.coordinate_count()];
+            }
+            hull.add_points ( global );
+        }
+        std::vector<PointCloudType> pruned_samples ( phases.size() );
+        if ( !hull.full_dimensional() ) return pruned_samples;
+        const std::vector<details::LowerConvexHull::Facet> facets = hull.lower_facets();
+        if ( facets.empty() ) return pruned_samples;
+        for ( std::size_t phase_id = 0; phase_id < phases.size(); ++phase_id ) {
+            const PointCloudType &global = global_samples[phase_id];
+            // Smallest distance in energy of this phase's points above the hull; the hull is convex,
+            // so its height at a point is the largest of its facet planes there
+            double gap = std::numeric_limits<double>::max();
+            for ( std::size_t i = 0; i < global.size(); ++i ) {
+                double height = -std::numeric_limits<double>::max();
+                for ( const auto &facet : facets ) {
+                    double plane = facet.offset;
+                    for ( std::size_t dim = 0; dim+1 < components.size(); ++dim ) plane += facet.normal[dim] * global[i][dim];
+                    height = std::max ( height, -plane / facet.normal.back() );
+                }
+                gap = std::min ( gap, global[i][components.size()] - height );
+            }
+            if ( global.empty() || gap <= phase_pruning_margin ) continue;
+            BOOST_LOG_SEV ( class_log, debug ) << phases[phase_id]->first << " pruned: at least " << gap << " J/mol above the coarse hull";
+            pruned_phases.insert ( phases[phase_id]->first );
+            pruned_samples[phase_id] = std::move ( coarse_samples[phase_id] );
+        }
+        BOOST_LOG_SEV ( class_log, debug ) << "pruned " << pruned_phases.size() << " of " << phases.size() << " phases";
+        return pruned_samples;
+    }
     /* GlobalMinimizer works by taking the phase information for the system and a
      * list of functors that implement point sampling and convex hull calculation.
      * Once GlobalMinimizer is constructed, the user can filter against the calculated grid.
@@ -146,74 +381,173 @@ public:
     {
         BOOST_LOG_NAMED_SCOPE ( "GlobalMinimizer::run" );
         BOOST_LOG_CHANNEL_SEV ( class_log, "optimizer", debug ) << "enter";
-        std::vector<PointType> temporary_hull_storage;
 
         BOOST_ASSERT(critical_edge_length>0);
         BOOST_ASSERT(initial_subdivisions_per_axis>0);
         BOOST_ASSERT(refinement_subdivisions_per_axis>0);
         BOOST_ASSERT(max_search_depth>=0);
         
+        // The phases are independent until the global hull is computed,
+        // so they are sampled concurrently and merged afterwards in phase_list order
+        struct PhaseSample {
+            PointCloudType hull_points;
+            PointCloudType global_points; // mole fractions of all components, then the energy
+            std::exception_ptr error;
+            double sampling_seconds = 0;
+            double hull_seconds = 0;
+        };
+        std::set<std::string> component_set;
         for ( auto comp_set = phase_list.begin(); comp_set != phase_list.end(); ++comp_set ) {
-            std::set<std::size_t> dependent_dimensions;
-            std::size_t current_dependent_dimension = 0;
-            // Create a callback function for energy calculation for this phase
-            auto calculate_energy = [&comp_set,&conditions] (const PointType& point) {
-                return comp_set->second.evaluate_objective(conditions,comp_set->second.get_variable_map(),const_cast<EnergyType*>(&point[0]));
-            };
-            // Determine the indices of the dependent dimensions
-            boost::multi_index::index<sublattice_set,phase_subl>::type::iterator ic0,ic1;
-            int sublindex = 0;
-            ic0 = boost::multi_index::get<phase_subl> ( sublset ).lower_bound ( boost::make_tuple ( comp_set->first, sublindex ) );
-            ic1 = boost::multi_index::get<phase_subl> ( sublset ).upper_bound ( boost::make_tuple ( comp_set->first, sublindex ) );
-            
-            while ( ic0 != ic1 ) {
-                const std::size_t number_of_species = std::distance ( ic0,ic1 );
-                if ( number_of_species > 0 ) {
-                    // Last component is dependent dimension
-                    current_dependent_dimension += (number_of_species-1);
-                    dependent_dimensions.insert(current_dependent_dimension);
-                    ++current_dependent_dimension;
-                }
-                // Next sublattice
-                ++sublindex;
-                ic0 = boost::multi_index::get<phase_subl> ( sublset ).lower_bound ( boost::make_tuple ( comp_set->first, sublindex ) );
-                ic1 = boost::multi_index::get<phase_subl> ( sublset ).upper_bound ( boost::make_tuple ( comp_set->first, sublindex ) );
+            const std::vector<std::string> &phase_components = comp_set->second.sublattice_layout().components();
+            component_set.insert ( phase_components.begin(), phase_components.end() );
+        }
+        // The global coordinates of every point are stored in this (sorted) order
+        const std::vector<std::string> components ( component_set.begin(), component_set.end() );
+        hull_map.reset ( components );
+        profile = StageProfile();
+        std::vector<typename std::map<std::string,CompositionSet>::const_iterator> phases;
+        energy_caches.clear();
+        phase_symmetries.clear();
+        for ( auto comp_set = phase_list.begin(); comp_set != phase_list.end(); ++comp_set ) {
+            phases.push_back ( comp_set );
+            SublatticeSymmetry symmetry;
+            auto declared = declared_symmetries.find ( comp_set->first );
+            if ( declared != declared_symmetries.end() ) {
+                symmetry = SublatticeSymmetry ( comp_set->second.sublattice_layout(), declared->second );
             }
+            else if ( detect_symmetries ) {
+                symmetry = SublatticeSymmetry::detect ( comp_set->second, conditions );
+            }
+            if ( !symmetry.empty() ) {
+                BOOST_LOG_SEV ( class_log, debug ) << comp_set->first << " is sampled in 1/" << symmetry.order() << " of its site fraction space";
+                phase_symmetries[comp_set->first] = symmetry;
+            }
+            // Created before sampling starts; each worker only uses the caches of its own phases
+            energy_caches[comp_set->second.name()] = std::make_shared<details::EnergyCache> ( comp_set->second, conditions, 1e-10,
+                                                                                              single_precision_sampling, symmetry );
+        }
+        std::vector<PhaseSample> samples ( phases.size() );
+        pruned_phases.clear();
+        std::vector<PointCloudType> pruned_samples;
+        {
+            const StageProfile::Scope stage_timer ( profile, "global minimization: phase pruning" );
+            pruned_samples = prune_phases ( phases, sublset, conditions, components );
+        }
+
+        auto sample_phase = [&] ( const std::size_t phase_id ) {
+            auto comp_set = phases[phase_id];
+            PhaseSample &sample = samples[phase_id];
+            const SublatticeLayout &layout = comp_set->second.sublattice_layout();
+            // The last component of each sublattice is a dependent dimension
+            const std::set<std::size_t> dependent_dimensions = layout.dependent_dimensions();
             // Sample the composition space of this phase
-            auto phase_points = this->point_sample ( comp_set->second, sublset, conditions );
+            const auto sampling_start = std::chrono::steady_clock::now();
+            // Pruned phases keep the points of the coarse pass
+            auto phase_points = pruned_samples[phase_id].empty() ? this->point_sample ( comp_set->second, sublset, conditions )
+                                : std::move ( pruned_samples[phase_id] );
+            const auto hull_start = std::chrono::steady_clock::now();
             // Calculate the phase's internal convex hull and store the result
-            auto phase_hull_points = this->internal_hull ( comp_set->second, phase_points, dependent_dimensions, conditions );
+            sample.hull_points = this->internal_hull ( comp_set->second, phase_points, dependent_dimensions, conditions );
+            sample.sampling_seconds = std::chrono::duration<double> ( hull_start - sampling_start ).count();
+            sample.hull_seconds = std::chrono::duration<double> ( std::chrono::steady_clock::now() - hull_start ).count();
+            const std::size_t point_count = sample.hull_points.size();
+            // Calculate the energies of all hull points of this phase at once
+            std::vector<EnergyType> energies ( point_count );
+            if ( point_count > 0 ) {
+                // The hull points were sampled, so their energies are already known, if only in single precision
+                details::EnergyCache &cache = *energy_cache ( comp_set->second );
+                if ( cache.single_precision() ) {
+                    cache.exact_energies ( sample.hull_points.data(), point_count, sample.hull_points.dimension(), &energies[0] );
+                    if ( sample.hull_points.dimension() > layout.coordinate_count() ) {
+                        for ( std::size_t i = 0; i < point_count; ++i ) {
+                            sample.hull_points[i][layout.coordinate_count()] = energies[i];
+                        }
+                    }
+                }
+                else {
+                    cache.energies ( sample.hull_points.data(), point_count, sample.hull_points.dimension(), &energies[0] );
+                }
+            }
+            // Mole fractions of all hull points in one pass, written straight into the rows of global_points
+            sample.global_points = PointCloudType ( components.size()+1 );
+            sample.global_points.resize ( point_count );
+            if ( point_count > 0 ) {
+                BOOST_ASSERT ( sample.hull_points.dimension() >= layout.coordinate_count() );
+                const MoleFractionMatrix mole_fractions ( layout, components );
+                mole_fractions.convert ( sample.hull_points.data(), point_count, sample.hull_points.dimension(),
+                                         sample.global_points.data(), sample.global_points.dimension() );
+                for ( std::size_t i = 0; i < point_count; ++i ) {
+                    sample.global_points[i][components.size()] = energies[i];
+                }
+            }
+        };
+        const std::size_t thread_count = std::min ( std::max ( worker_threads, std::size_t ( 1 ) ), phases.size() );
+        threads_per_phase = std::max ( worker_threads / std::max ( thread_count, std::size_t ( 1 ) ), std::size_t ( 1 ) );
+        std::atomic<std::size_t> next_phase ( 0 );
+        auto worker = [&] () {
+            for ( std::size_t phase_id = next_phase++; phase_id < phases.size(); phase_id = next_phase++ ) {
+                try {
+                    sample_phase ( phase_id );
+                } catch ( ... ) {
+                    samples[phase_id].error = std::current_exception();
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for ( std::size_t i = 1; i < thread_count; ++i ) {
+            workers.emplace_back ( worker );
+        }
+        worker(); // this thread works too
+        for ( auto &thread : workers ) {
+            thread.join();
+        }
+        BOOST_LOG_SEV ( class_log, debug ) << "sampled " << phases.size() << " phases using " << std::max ( thread_count, std::size_t ( 1 ) ) << " threads";
+        for ( auto cache = energy_caches.cbegin(); cache != energy_caches.cend(); ++cache ) {
+            BOOST_LOG_SEV ( class_log, debug ) << cache->first << " energy cache: " << cache->second->hits() << " hits, " 
+                                               << cache->second->misses() << " misses, " << cache->second->size() << " points";
+            if ( cache->second->single_precision() ) {
+                BOOST_LOG_SEV ( class_log, debug ) << cache->first << " largest single precision error: " << cache->second->max_single_precision_error();
+            }
+        }
+        if ( EvaluationTrace::sampling_period() > 0 ) {
+            for ( auto phase : phases ) {
+                const EvaluationStatistics energy_stats = phase->second.get_energy_statistics();
+                const EvaluationStatistics derivative_stats = phase->second.get_derivative_statistics();
+                BOOST_LOG_SEV ( class_log, debug ) << phase->first << " evaluations: " << energy_stats.points << " energies in "
+                                                   << energy_stats.calls << " calls (about " << energy_stats.estimated_seconds() << " s), "
+                                                   << derivative_stats.points << " derivatives (about " << derivative_stats.estimated_seconds() << " s)";
+            }
+        }
+
+        for ( std::size_t phase_id = 0; phase_id < phases.size(); ++phase_id ) {
+            PhaseSample &sample = samples[phase_id];
+            if ( sample.error ) {
+                std::rethrow_exception ( sample.error );
+            }
+            profile.add ( "global minimization: sampling", sample.sampling_seconds );
+            profile.add ( "global minimization: internal hulls", sample.hull_seconds );
             // TODO: Apply phase-specific constraints to internal dof and globally
             // Add all points from this phase's convex hull to our internal hull map
-            for ( auto point : phase_hull_points ) {
-                // All points added to the hull_map could possibly be on the global hull
-                auto global_point = convert_site_fractions_to_mole_fractions ( comp_set->first, sublset, point );
-                PointType ordered_global_point;  
-                ordered_global_point.reserve ( global_point.size()+1 );
-                for ( auto pt : global_point ) ordered_global_point.push_back ( pt.second );
-                double energy = calculate_energy ( point );
-                hull_map.insert_point ( 
-                comp_set->first, 
-                energy, 
-                point,
-                global_point
-                );
-                ordered_global_point.push_back ( energy );
-                temporary_hull_storage.push_back ( std::move ( ordered_global_point ) );
-            }
+            // All points added to the hull_map could possibly be on the global hull
+            hull_map.insert_points ( phases[phase_id]->first, sample.hull_points, sample.global_points );
         }
         // TODO: Add points and set options related to activity constraints here
         // Determine the facets on the global convex hull of all phase's energy landscapes
-        candidate_facets = this->global_hull ( temporary_hull_storage, phase_list, conditions );
+        // The hull reads the global coordinates and energies of the hull map in place
+        {
+            const StageProfile::Scope stage_timer ( profile, "global minimization: global hull" );
+            candidate_facets = this->global_hull ( hull_map.global_points(), phase_list, conditions );
+        }
         BOOST_LOG_SEV ( class_log, debug ) << "candidate_facets.size() = " << candidate_facets.size();
         // Mark all hull entries that are on the global hull
-        for ( auto facet : candidate_facets ) {
+        for ( auto const &facet : candidate_facets ) {
             for ( auto point : facet.vertices ) {
                 const std::size_t point_id = point;
                 // point_id is on the global hull
                 hull_map.set_global_hull_status ( point_id, true);
             }
         }
+        build_facet_index();
     }
     
     typename HullMapType::HullEntryContainerType get_hull_entries() const {
@@ -222,98 +556,124 @@ public:
     std::vector<FacetType> get_facets() const {
         return candidate_facets;
     }
+    // The energy cache of a phase from the last run(), or nullptr
+    details::EnergyCache const* get_energy_cache ( const std::string &phase_name ) const {
+        auto cache = energy_caches.find ( phase_name );
+        return cache != energy_caches.end() ? cache->second.get() : nullptr;
+    }
+    // Time spent in each stage of run() and find_tie_points()
+    StageProfile const& get_profile() const {
+        return profile;
+    }
+    // Estimated memory of what the last run() left (see memory_footprint.hpp); the points sampled for each
+    // phase are in hull_map, and the energy caches hold one entry per point evaluated
+    MemoryFootprint memory_footprint() const {
+        MemoryFootprint footprint;
+        footprint.add ( "hull_map", hull_map.memory_bytes(), hull_map.size() );
+        std::size_t facet_bytes = candidate_facets.capacity() * sizeof ( FacetType );
+        for ( auto i = candidate_facets.cbegin(); i != candidate_facets.cend(); ++i ) {
+            facet_bytes += i->normal.capacity() * sizeof ( CoordinateType ) + i->vertices.capacity() * sizeof ( std::size_t )
+                           + i->basis_matrix.size1() * i->basis_matrix.size2() * sizeof ( CoordinateType );
+        }
+        footprint.add ( "candidate_facets", facet_bytes, candidate_facets.size() );
+        footprint.add ( "facet_index", facet_index.memory_bytes(), facet_index.size() );
+        for ( auto i = energy_caches.cbegin(); i != energy_caches.cend(); ++i ) {
+            if ( !i->second ) continue;
+            footprint.add ( "energy caches", sizeof ( *i ) + tree_node_overhead + sizeof ( details::EnergyCache ) + i->second->memory_bytes(),
+                            i->second->size() );
+        }
+        return footprint;
+    }
     
+    /* Find the facet of the global hull containing the overall composition of conditions
+     * and the barycentric coordinates of the composition in it, i.e., the lever rule
+     * fraction of each of its vertices. Components missing from conditions.xfrac make up
+     * the balance. Of several facets that contain the point (on shared edges),
+     * the one with the smallest area is chosen. Returns false if no facet contains it.
+     */
+    bool locate_facet ( 
+        evalconditions const& conditions,
+        std::size_t &facet_id,
+        std::vector<CoordinateType> &vertex_fractions
+        ) const {
+        const double tolerance = 1e-12; // for points on facet boundaries
+        const std::vector<std::string> &components = hull_map.component_names();
+        if ( components.empty() || candidate_facets.empty() ) return false;
+        // Mole fractions of all components but the last, which is dropped from the facets' coordinates
+        std::vector<CoordinateType> trial_point ( components.size() ); // the last entry is 1
+        CoordinateType balance = 1;
+        std::size_t balance_component = components.size();
+        for ( std::size_t i = 0; i < components.size(); ++i ) {
+            auto coord = conditions.xfrac.find ( components[i] );
+            if ( coord == conditions.xfrac.end() ) {
+                balance_component = i;
+                continue;
+            }
+            balance -= coord->second;
+            if ( i + 1 < components.size() ) trial_point[i] = coord->second;
+        }
+        if ( balance_component + 1 < components.size() ) trial_point[balance_component] = balance;
+        trial_point[components.size()-1] = 1;
+
+        bool found = false;
+        std::vector<CoordinateType> fractions;
+        auto check_facet = [&] ( const std::size_t candidate_id ) {
+            const FacetType &facet = candidate_facets[candidate_id];
+            if ( found && facet.area >= candidate_facets[facet_id].area ) return;
+            if ( facet.basis_matrix.size1() == 0 ) {
+                // Special case: a single point and no composition dependence
+                fractions.assign ( facet.vertices.size(), CoordinateType ( 1 ) / facet.vertices.size() );
+            }
+            else {
+                // The barycentric coordinates of the trial point are all nonnegative inside the facet
+                BOOST_ASSERT ( facet.basis_matrix.size2() == trial_point.size() );
+                fractions.assign ( facet.basis_matrix.size1(), 0 );
+                for ( std::size_t row = 0; row < facet.basis_matrix.size1(); ++row ) {
+                    for ( std::size_t column = 0; column < trial_point.size(); ++column ) {
+                        fractions[row] += facet.basis_matrix ( row, column ) * trial_point[column];
+                    }
+                    if ( fractions[row] < -tolerance ) return;
+                }
+            }
+            found = true;
+            facet_id = candidate_id;
+            vertex_fractions = fractions;
+        };
+        if ( facet_index.size() == candidate_facets.size() ) {
+            facet_index.query ( &trial_point[0], tolerance, check_facet );
+        }
+        else {
+            // No index, e.g., for a unary system
+            for ( std::size_t i = 0; i < candidate_facets.size(); ++i ) check_facet ( i );
+        }
+        return found;
+    }
+
     std::vector<typename HullMapType::HullEntryType> find_tie_points ( 
         evalconditions const& conditions
         ) {
+        std::vector<CoordinateType> phase_fractions;
+        return find_tie_points ( conditions, phase_fractions );
+    }
+    // As above; phase_fractions receives the lever rule fraction of each returned point,
+    // summed over the vertices of the facet it stands for
+    std::vector<typename HullMapType::HullEntryType> find_tie_points ( 
+        evalconditions const& conditions,
+        std::vector<CoordinateType> &phase_fractions
+        ) {
         BOOST_LOG_NAMED_SCOPE ( "GlobalMinimizer::find_tie_points" );
+        const StageProfile::Scope stage_timer ( profile, "global minimization: tie points" );
         const double critical_edge_length = 0.05;
-        // Filter candidate facets based on user-specified constraints
         std::set<std::size_t> candidate_ids; // ensures returned points are unique
-        std::vector<FacetType> pre_candidate_facets; // check all facets before adding to candidates
         std::vector<typename HullMapType::HullEntryType> candidates;
+        phase_fractions.clear();
         BOOST_LOG_SEV ( class_log, debug ) << "candidate_facets.size() = " << candidate_facets.size();
-        for ( auto facet : candidate_facets ) {
-            std::stringstream logbuf;
-            logbuf << "Checking facet ";
-            logbuf << "[";
-            for ( auto point : facet.vertices ) {
-                const std::size_t point_id = point;
-                auto point_entry = hull_map [ point_id ];
-                logbuf << "(";
-                for ( auto coord : point_entry.global_coordinates ) {
-                    logbuf << coord.first << ":" << coord.second << ",";
-                }
-                logbuf << ")";
-            }
-            logbuf << "]";
-            BOOST_LOG_SEV ( class_log, debug ) << logbuf.str();
-            bool failed_conditions = false;
-            
-            // Determine if the user-specified point is inside this facet
-            boost::numeric::ublas::vector<CoordinateType> trial_point ( conditions.xfrac.size()+1 );
-            for ( auto coord = conditions.xfrac.begin(); coord !=  conditions.xfrac.end(); ++coord) {
-                trial_point [ std::distance(conditions.xfrac.begin(),coord) ] = coord->second;
-            }
-            trial_point [ conditions.xfrac.size() ] = 1;
-            BOOST_LOG_SEV ( class_log, debug ) << "trial_point: " << trial_point;
-            BOOST_LOG_SEV ( class_log, debug ) << "facet.basis_matrix: " << facet.basis_matrix;
-            auto trial_vector = boost::numeric::ublas::prod ( facet.basis_matrix, trial_point );
-            BOOST_LOG_SEV ( class_log, debug ) << "trial_vector: " << trial_vector;
-            for ( auto coord : trial_vector ) {
-                if ( coord < 0 ) {
-                    failed_conditions = true;
-                    break;
-                }
-            }
-            std::cout << "POINT DEBUGGING" << std::endl;
-            for ( auto hull_entry : hull_map.get_all_points() ) {
-                for ( auto coord : hull_entry.global_coordinates ) {
-                    std::cout << coord.second << " ";
-                }
-                std::cout  << std::endl;
-            }
-            std::cout << "FACET DEBUGGING" << std::endl;
-            for ( auto facet : candidate_facets ) {
-                for ( auto vertex : facet.vertices ) {
-                    std::cout << vertex << " ";
-                }
-                std::cout << std::endl;
-            }
-            
-            if ( !failed_conditions ) {
-                // This is a pre-candidate facet!
-                // It's possible we will have more than one due to edge/corner cases
-                // We can select some method of choosing between them
-                pre_candidate_facets.push_back ( facet );
-                std::stringstream logbuf;
-                logbuf << "Candidate facet ";
-                for ( auto point : facet.vertices ) {
-                    const std::size_t point_id = point;
-                    auto point_entry = hull_map [ point_id ];
-                    logbuf << "[";
-                    for ( auto coord : point_entry.internal_coordinates ) {
-                        logbuf << coord << ",";
-                    }
-                    logbuf << "]";
-                    logbuf << "{";
-                        for ( auto coord : point_entry.global_coordinates ) {
-                            logbuf << coord.first << ":" << coord.second << ",";
-                        }
-                        logbuf << "}";
-                }
-                BOOST_LOG_SEV ( class_log, debug ) << logbuf.str();
-            }
-        }
-        
-        // Sort candidate_facets by area; choose candidate facet with smallest area
-        // If two candidate facets have the same area, we just choose the first one
-        auto facet_area_comparator = [] (const FacetType &a,const FacetType &b) { return a.area<b.area; };
-        std::sort ( pre_candidate_facets.begin(), pre_candidate_facets.end() , facet_area_comparator );
-        
-        if ( pre_candidate_facets.size() == 0 ) return candidates; // No candidate facets; return empty-handed
-        
-        auto final_facet = pre_candidate_facets.begin();
+
+        std::size_t facet_id;
+        std::vector<CoordinateType> vertex_fractions;
+        if ( !locate_facet ( conditions, facet_id, vertex_fractions ) ) return candidates; // No candidate facets; return empty-handed
+        const FacetType* const final_facet = &candidate_facets[facet_id];
+        BOOST_LOG_SEV ( class_log, debug ) << "Candidate facet " << facet_id << " with " << final_facet->vertices.size() << " vertices";
 
         // final_facet satisfies all the conditions; return its tie points
         
@@ -324,27 +684,16 @@ public:
             ) { 
                 const std::size_t point1_id = *point1;
                 const std::size_t point2_id = *point2;
-                auto point1_entry = hull_map [ point1_id ];
-                auto point2_entry = hull_map [ point2_id ];
-                if ( point1_entry.phase_name != point2_entry.phase_name ) {
+                if ( hull_map.phase_id ( point1_id ) != hull_map.phase_id ( point2_id ) ) {
                     // phases differ; definitely a tie line
-                    BOOST_LOG_SEV ( class_log, debug ) << "Adding tie points " << point1_id << "(" << point1_entry.phase_name << ") and " << point2_id << "(" << point2_entry.phase_name << ")";
+                    BOOST_LOG_SEV ( class_log, debug ) << "Adding tie points " << point1_id << "(" << hull_map.phase_name ( point1_id ) << ") and " << point2_id << "(" << hull_map.phase_name ( point2_id ) << ")";
                     candidate_ids.insert ( point1_id );
                     candidate_ids.insert ( point2_id );
                 }
                 else {
                     // phases are the same -- does a tie line span a miscibility gap?
                     // use internal coordinates to check
-                    CoordinateType distance = 0;
-                    auto difference = point2_entry.internal_coordinates;
-                    auto diff_iter = difference.begin();
-                    
-                    for ( auto coord = point1_entry.internal_coordinates.begin(); coord != point1_entry.internal_coordinates.end(); ++coord) {
-                        *(diff_iter++) -= *coord;
-                    }
-                    for (auto coord : difference) { distance += std::pow(coord,2); }
-                    
-                    distance = sqrt ( distance );
+                    const CoordinateType distance = internal_distance ( point1_id, point2_id );
                        
                     if (distance > critical_edge_length) {
                         // the tie line is sufficiently long
@@ -361,20 +710,9 @@ public:
             for ( auto point2 = point1; ++point2 != candidate_ids.end(); /**/ ) {
                 const std::size_t point1_id = *point1;
                 const std::size_t point2_id = *point2;
-                auto point1_entry = hull_map [ point1_id ];
-                auto point2_entry = hull_map [ point2_id ];
                 // don't merge points from different phases
-                if ( point1_entry.phase_name != point2_entry.phase_name ) { continue; }
-                CoordinateType distance = 0;
-                auto difference = point2_entry.internal_coordinates;
-                auto diff_iter = difference.begin();
-                
-                for ( auto coord = point1_entry.internal_coordinates.begin(); coord != point1_entry.internal_coordinates.end(); ++coord) {
-                    *(diff_iter++) -= *coord;
-                }
-                for (auto coord : difference) { distance += std::pow(coord,2); }
-                
-                distance = sqrt ( distance );
+                if ( hull_map.phase_id ( point1_id ) != hull_map.phase_id ( point2_id ) ) { continue; }
+                const CoordinateType distance = internal_distance ( point1_id, point2_id );
                 
                 if (distance <= critical_edge_length) {
                     // this tie line is not real; remove one of the points (arbitrarily, point2)
@@ -395,11 +733,77 @@ public:
             candidate_ids.insert ( *( final_facet->vertices.begin() ) );
         }
         
+        // Each vertex's lever rule fraction goes to the closest tie point of the same phase
+        std::map<std::size_t,CoordinateType> candidate_fractions;
+        for ( std::size_t vertex = 0; vertex < final_facet->vertices.size(); ++vertex ) {
+            const std::size_t vertex_id = final_facet->vertices[vertex];
+            std::size_t closest_id = *candidate_ids.begin();
+            CoordinateType closest_distance = std::numeric_limits<CoordinateType>::max();
+            for ( auto point_id : candidate_ids ) {
+                if ( hull_map.phase_id ( point_id ) != hull_map.phase_id ( vertex_id ) ) continue;
+                const CoordinateType distance = internal_distance ( point_id, vertex_id );
+                if ( distance < closest_distance ) {
+                    closest_distance = distance;
+                    closest_id = point_id;
+                }
+            }
+            candidate_fractions[closest_id] += vertex < vertex_fractions.size() ? vertex_fractions[vertex] : 0;
+        }
+
         // Dereference point IDs to hull entries
         for (auto point_id : candidate_ids) {
             candidates.push_back ( hull_map [ point_id ] );
+            phase_fractions.push_back ( candidate_fractions[point_id] );
+        }
+        return candidates;
+    }
+protected:
+    details::EnergyCache* energy_cache ( CompositionSet const& cmp ) const {
+        auto cache = energy_caches.find ( cmp.name() );
+        return cache != energy_caches.end() ? cache->second.get() : nullptr;
+    }
+private:
+    // Bounding boxes of the candidate facets in the mole fractions of all components but the last
+    void build_facet_index() {
+        const std::size_t dimension = hull_map.component_names().size() - 1;
+        if ( dimension == 0 ) {
+            facet_index.clear();
+            return;
+        }
+        std::vector<CoordinateType> lower, upper;
+        lower.reserve ( candidate_facets.size() * dimension );
+        upper.reserve ( candidate_facets.size() * dimension );
+        for ( auto const &facet : candidate_facets ) {
+            for ( std::size_t k = 0; k < dimension; ++k ) {
+                CoordinateType facet_lower = std::numeric_limits<CoordinateType>::max();
+                CoordinateType facet_upper = std::numeric_limits<CoordinateType>::lowest();
+                for ( auto vertex : facet.vertices ) {
+                    const CoordinateType coord = hull_map.global_coordinates ( vertex ) [k];
+                    facet_lower = std::min ( facet_lower, coord );
+                    facet_upper = std::max ( facet_upper, coord );
+                }
+                lower.push_back ( facet_lower );
+                upper.push_back ( facet_upper );
+            }
+        }
+        facet_index.build ( dimension, std::move ( lower ), std::move ( upper ) );
+    }
+    // Euclidean distance between the internal coordinates of two points of the same phase
+    CoordinateType internal_distance ( const std::size_t point1_id, const std::size_t point2_id ) const {
+        const details::PointView<CoordinateType> point1 = hull_map.internal_coordinates ( point1_id );
+        const details::PointView<CoordinateType> point2 = hull_map.internal_coordinates ( point2_id );
+        BOOST_ASSERT ( point1.size() == point2.size() );
+        CoordinateType distance = 0;
+        for ( std::size_t i = 0; i < point1.size(); ++i ) {
+            distance += std::pow ( point2[i] - point1[i], 2 );
+        }
+        return sqrt ( distance );
+    }
+    void log_global_coordinates ( std::ostream &logbuf, const std::size_t point_id ) const {
+        const details::PointView<CoordinateType> global_point = hull_map.global_coordinates ( point_id );
+        for ( std::size_t i = 0; i < global_point.size(); ++i ) {
+            logbuf << hull_map.component_names()[i] << ":" << global_point[i] << ",";
         }
-        return std::move( candidates );
     }
 };
 
@@ -0,0 +1,65 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Repeatable timings of the kernels of an equilibrium calculation
+
+#ifndef INCLUDED_KERNEL_BENCHMARK
+#define INCLUDED_KERNEL_BENCHMARK
+
+#include "libgibbs/include/conditions.hpp"
+#include "libtdb/include/database.hpp"
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Optimizer {
+
+struct KernelBenchmarkOptions {
+    KernelBenchmarkOptions() : min_seconds ( 0.5 ), min_iterations ( 1 ), equilibrium ( true ) { }
+    double min_seconds; // each kernel is repeated until it has run for this long
+    std::size_t min_iterations; // ... and at least this many times
+    bool equilibrium; // also time full Equilibrium solves (requires Ipopt)
+};
+
+// One timed kernel; times are per iteration, in nanoseconds
+struct KernelBenchmarkRecord {
+    KernelBenchmarkRecord() : iterations ( 0 ), real_time ( 0 ), cpu_time ( 0 ), items_per_iteration ( 0 ) { }
+    std::string name; // kernel/label[/phase]
+    std::size_t iterations;
+    double real_time;
+    double cpu_time;
+    std::size_t items_per_iteration; // e.g., ASTs walked or points sampled; 0 if not meaningful
+};
+
+/*
+ * Times each kernel of the calculation of an equilibrium of DB under conditions:
+ * building the CompiledSystem, and, for each entered phase, CompositionSet construction
+ * (including the derivative trees), process_utree over the derivative trees, the objective
+ * gradient and Hessian at the centre of the site fraction space, AdaptiveSimplexSample and
+ * internal_lower_convex_hull with the defaults of GlobalMinimizer; then a complete
+ * GlobalMinimizer run, whose global_lower_convex_hull time is reported separately,
+ * and a full Equilibrium solve.
+ * label names the case in the results, e.g., "alfe_sei/1000K".
+ * Errors from the calculation are not caught.
+ *
+ * The example databases (alfe_sei.TDB, crfeni_mie.tdb, bigrose.tdb, crtiv_ghosh.tdb)
+ * at fixed conditions make a reference set whose results can be compared between releases.
+ */
+std::vector<KernelBenchmarkRecord> benchmark_kernels (
+    std::string const &label,
+    Database const &DB,
+    evalconditions const &conditions,
+    KernelBenchmarkOptions const &options = KernelBenchmarkOptions() );
+
+// Writes records in the JSON format of Google Benchmark (--benchmark_format=json),
+// so that existing tools can compare runs
+void write_benchmark_json ( std::ostream &stream, std::vector<KernelBenchmarkRecord> const &records );
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+ 
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Global minimization using hulls that only contain the lower envelope of the energy
+
+#ifndef INCLUDED_LOWER_HULL_MINIMIZATION
+#define INCLUDED_LOWER_HULL_MINIMIZATION
+
+#include "libgibbs/include/optimizer/global_minimization.hpp"
+#include "libgibbs/include/optimizer/utils/convex_hull.hpp"
+#include "libgibbs/include/optimizer/utils/lower_convex_hull.hpp"
+#include <boost/assert.hpp>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Optimizer {
+
+/* LowerHullGlobalMinimizer only ever builds the lower convex hull:
+ * the energy is always the last coordinate, so a point at infinite energy
+ * closes the hull from above and the upper hull is never computed.
+ * The facets it finds are the same as GlobalMinimizer's, but binary and ternary
+ * systems, where most sampled points lie above the lower hull, are much faster.
+ */
+template <
+typename FacetType,
+typename CoordinateType = double, 
+typename EnergyType = CoordinateType
+>
+class LowerHullGlobalMinimizer : public GlobalMinimizer<FacetType,CoordinateType,EnergyType> {
+public:
+    typedef GlobalMinimizer<FacetType,CoordinateType,EnergyType> BaseType;
+    typedef typename BaseType::PointType PointType;
+    typedef typename BaseType::PointCloudType PointCloudType;
+
+    virtual PointCloudType internal_hull(
+        CompositionSet const& cmp,
+        PointCloudType const& points,
+        std::set<std::size_t> const& dependent_dimensions,
+        evalconditions const& conditions
+    ) {
+        BOOST_ASSERT(this->critical_edge_length>0);
+        BOOST_ASSERT(points.size()>0);
+        details::LowerConvexHull hull ( points.dimension(), dependent_dimensions, true );
+        return details::internal_lower_convex_hull( hull,
+                                                    points, 
+                                                    dependent_dimensions, 
+                                                    this->critical_edge_length, 
+                                                    this->internal_energy_function ( cmp, conditions )
+                                                  );
+    };
+    virtual std::vector<FacetType> global_hull(
+        PointCloudType const& points,
+        std::map<std::string,CompositionSet> const& phase_list,
+        evalconditions const& conditions
+    ) {
+        BOOST_ASSERT(this->critical_edge_length>0);
+        BOOST_ASSERT(points.size()>0);
+        // The dependent mole fraction (second to last coordinate) is dropped
+        const std::size_t point_dimension = points.dimension();
+        details::LowerConvexHull hull ( point_dimension, std::set<std::size_t> { point_dimension-2 }, true );
+        return details::global_lower_convex_hull( hull,
+                                                  points, 
+                                                  this->critical_edge_length, 
+                                                  this->global_midpoint_energies_function ( phase_list, conditions ),
+                                                  this->filter_tie_facets
+                                                );
+    };
+};
+
+} //namespace Optimizer
+
+#endif
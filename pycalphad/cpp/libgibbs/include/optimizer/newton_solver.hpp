@@ -0,0 +1,63 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// newton_solver.hpp -- declaration for the dense Newton solver of small equilibria
+
+#ifndef INCLUDED_NEWTON_SOLVER
+#define INCLUDED_NEWTON_SOLVER
+
+#include "libtdb/include/logging.hpp"
+#include "libgibbs/include/optimizer/solve_control.hpp"
+#include <coin/IpTNLP.hpp>
+#include <vector>
+
+/* Damped Newton iteration on the first-order conditions of a TNLP with equality constraints,
+ * for problems of a few dozen variables, where setting up Ipopt's interior point method and
+ * sparse factorization costs more than the chemistry. Every iteration solves the dense KKT system
+ *   [ H  J^T ] [ dx ]     [ grad f + J^T lambda ]
+ *   [ J   0  ] [ dl ] = - [ g                   ]
+ * and backtracks along the step until the norm of the right hand side decreases.
+ * Variables with equal bounds are held fixed; the others must stay strictly within their bounds,
+ * so the iteration gives up when a bound would become active (e.g., a phase vanishes), as it
+ * does on a singular KKT matrix or after max_iterations. A converged point is only accepted if
+ * H is positive definite on the null space of J; otherwise it is a saddle point or a maximum.
+ * When the iteration gives up, nothing has been passed to the TNLP's finalize_solution(), and
+ * another solver can start over on the same TNLP.
+ */
+class NewtonGibbsSolver {
+public:
+	explicit NewtonGibbsSolver(Ipopt::TNLP &problem);
+	Ipopt::Index variable_count() const { return n; }
+	// On success the solution is passed to the TNLP's finalize_solution() and true is returned
+	// control (may be null) is checked once per iteration
+	bool solve(const Optimizer::SolveControl *control = nullptr);
+	Ipopt::Index iterations() const { return iteration_count; }
+
+	Ipopt::Index max_iterations; // default 50
+	double tolerance; // of the constraint residuals, and of the Lagrangian gradient relative to the objective gradient
+private:
+	// Evaluates the objective, constraints and Jacobian at x and the KKT residual at (x, lambda);
+	// returns its Euclidean norm over the free variables and the constraints, or a negative number
+	// if an evaluation failed
+	double evaluate_residual(const std::vector<double> &x, const std::vector<double> &lambda, bool new_x);
+	// Whether the Hessian of the Lagrangian at (x, lambda), projected onto the null space of the
+	// Jacobian over the free variables, is positive definite; x must be the point of the last evaluate_residual()
+	bool reduced_hessian_positive_definite(const std::vector<double> &x, const std::vector<double> &lambda);
+
+	mutable logger opto_log; // Boost Log object
+	Ipopt::TNLP &nlp;
+	Ipopt::Index n, m, nnz_jac, nnz_h;
+	Ipopt::Index iteration_count;
+	std::vector<double> x_l, x_u, g_l; // g_l == g_u, as all constraints are equalities
+	std::vector<Ipopt::Index> free_variables; // variables with x_l < x_u, in the order of the KKT system
+	std::vector<Ipopt::Index> jac_rows, jac_cols, hess_rows, hess_cols;
+	// At the point of the last evaluate_residual()
+	double objective, gradient_norm;
+	std::vector<double> gradient, constraints, jacobian, residual; // residual: grad f + J^T lambda (all n), then g - g_l
+};
+
+#endif
@@ -16,25 +16,45 @@
 #include "libgibbs/include/models.hpp"
 #include "libgibbs/include/constraint.hpp"
 #include "libgibbs/include/compositionset.hpp"
+#include "libgibbs/include/optimizer/compiled_system.hpp"
 #include "libgibbs/include/optimizer/equilibriumresult.hpp"
+#include "libgibbs/include/optimizer/global_hull_cache.hpp"
+#include "libgibbs/include/optimizer/solve_control.hpp"
+#include "libgibbs/include/optimizer/solver_trace.hpp"
+#include "libgibbs/include/utils/compiled_expr.hpp"
 #include "libgibbs/include/utils/math_expr.hpp"
+#include "libgibbs/include/utils/memory_footprint.hpp"
+#include "libgibbs/include/utils/stage_profile.hpp"
 #include <coin/IpTNLP.hpp>
 #include <boost/spirit/include/support_utree.hpp>
 #include <boost/bimap.hpp>
+#include <chrono>
+#include <functional>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <memory>
 #include <set>
+#include <vector>
 
 using namespace Ipopt;
 typedef std::map<std::string, int> index_table; // matches variable names to Ipopt indices
 
 class GibbsOpt : public TNLP {
 public:
+	// If previous_result is specified, the variables and multipliers of that result are used as the
+	// starting point wherever they exist in this problem; it must stay alive until the solve ends
 	GibbsOpt(
 		const Database &DB,
-		const evalconditions &sysstate);
+		const evalconditions &sysstate,
+		const Optimizer::EquilibriumResult<Ipopt::Number> *previous_result = nullptr);
+	// Reuse the models of system, which must have been built for the elements and phases of sysstate
+	// If hull_cache is specified, the global hull is taken from it (and built there if it has none)
+	GibbsOpt(
+		const CompiledSystem &system,
+		const evalconditions &sysstate,
+		const Optimizer::EquilibriumResult<Ipopt::Number> *previous_result = nullptr,
+		GlobalHullCache *hull_cache = nullptr);
 	virtual ~GibbsOpt();
 	/**@name Overloaded from TNLP */
 	//@{
@@ -89,9 +109,58 @@ public:
 		Number obj_value,
 		const IpoptData* ip_data,
 		IpoptCalculatedQuantities* ip_cq);
+
+	/** Called once per iteration; returning false stops the solve (with User_Requested_Stop) */
+	virtual bool intermediate_callback(AlgorithmMode mode,
+		Index iter, Number obj_value,
+		Number inf_pr, Number inf_du,
+		Number mu, Number d_norm,
+		Number regularization_size,
+		Number alpha_du, Number alpha_pr,
+		Index ls_trials,
+		const IpoptData* ip_data,
+		IpoptCalculatedQuantities* ip_cq);
 	//@}
 
-	Optimizer::EquilibriumResult<Ipopt::Number>&& get_result() { return std::move(result); };
+	// Stop the solve when control asks for it; control must stay alive until the solve ends
+	void set_control(const Optimizer::SolveControl *solve_control) {
+		control = solve_control;
+	}
+	// Record a SolverTrace of the next solve if record_trace or rules is not empty; the trace is returned with
+	// the result if record_trace, and the solve stops as soon as one of rules returns true for it.
+	// rules must stay alive until the solve ends
+	void set_telemetry(const bool record_trace, const std::vector<Optimizer::StoppingRule> &rules);
+	// The solve was stopped by one of the rules of set_telemetry(), rather than by the SolveControl
+	bool stopped_early() const {
+		return stopped_by_rule;
+	}
+
+	// True if every constraint is linear, so that the solver may evaluate the constraint Jacobian only once
+	bool constraints_linear() const {
+		return nonlinear_constraints.empty();
+	}
+
+	// The variables of one composition set, for solvers which work in its constraint null space
+	struct PhaseVariables {
+		const CompositionSet *comp_set; // valid until finalize_solution()
+		Ipopt::Index phase_fraction_index;
+		std::vector<Ipopt::Index> site_fraction_indices; // in the coordinate order of comp_set->sublattice_layout()
+	};
+	// One per composition set, in the order of comp_sets
+	std::vector<PhaseVariables> phase_variables() const;
+	// Indices of the site fraction balance constraints, one per sublattice with more than one species
+	const std::vector<Ipopt::Index>& sublattice_balance_constraints() const {
+		return sublattice_balance_indices;
+	}
+
+	// Estimated memory of the composition sets (until finalize_solution() moves them into the result) and of
+	// everything else the solver holds, including what the global minimization of the ctor left, if it ran one
+	PhaseMemoryFootprint memory_footprint() const;
+
+	Optimizer::EquilibriumResult<Ipopt::Number>&& get_result() {
+		result.profile.merge(profile);
+		return std::move(result);
+	};
 
 private:
 	/**@name Methods to block default compiler methods.
@@ -119,7 +188,78 @@ private:
 	std::set<std::list<Ipopt::Index>> hess_sparsity_structure; // Hessian sparsity structure
 	hessian_set constraint_hessian_data; // Hessian ASTs of objective
 	std::vector<Ipopt::Index> fixed_indices; // Indices of variables that are fixed at unity
+	std::vector<Ipopt::Index> sublattice_balance_indices; // Indices of the SublatticeBalanceConstraints in cm
+	// The constraint ASTs above, compiled once against one slot table: every variable name is interned
+	// as a slot when the programs are built, and constraint_binding maps the slots to main_indices,
+	// so the callbacks never look up or compare names
+	CompiledSlotTable constraint_slots;
+	CompiledBinding constraint_binding;
+	// A program of the constraints that does not read x has the same value throughout the solve,
+	// so it is evaluated once, in the ctor, and the callbacks only copy that value
+	struct ConstraintProgram {
+		explicit ConstraintProgram(CompiledExpression program) : program(std::move(program)), constant(false), value(0) { }
+		CompiledExpression program;
+		bool constant; // program is not variable_dependent(); value holds its value
+		double value;
+		double evaluate(CompiledBinding const &binding, const Number* x) const {
+			return constant ? value : program.evaluate(binding, x);
+		}
+	};
+	// Each constraint is classified when it is built: LINEAR if none of its Jacobian entries depend on x,
+	// BILINEAR (e.g., phase fraction times site fraction) if none of its Hessian entries do
+	enum class ConstraintLinearity { LINEAR, BILINEAR, NONLINEAR };
+	std::vector<CompiledExpression> constraint_programs; // lhs - rhs of each constraint of cm
+	std::vector<ConstraintLinearity> constraint_linearity; // one per constraint of cm
+	// LINEAR constraints are evaluated as offset + sum of coefficient * x[index] instead of by their programs
+	struct LinearConstraint {
+		Ipopt::Index cons_index;
+		double offset; // value at x = 0
+		std::vector<std::pair<Ipopt::Index,double>> coefficients;
+	};
+	std::vector<LinearConstraint> linear_constraints;
+	std::vector<Ipopt::Index> nonlinear_constraints; // the others, evaluated by constraint_programs
+	std::vector<ConstraintProgram> jacobian_programs; // one per entry of jac_g_trees
+	// one list of (constraint, program) per entry of constraint_hessian_data
+	std::vector<std::vector<std::pair<Ipopt::Index,ConstraintProgram>>> constraint_hessian_programs;
 	std::map<std::string,CompositionSet> comp_sets; // All composition sets
+	// Everything eval_f, eval_grad_f and eval_h need about one composition set, resolved once in the ctor
+	struct DenseEvaluation {
+		const CompositionSet* comp_set;
+		CompiledBinding binding; // variables and conditions bound to main_indices
+		Ipopt::Index phase_fraction_index;
+		CompositionSet::HessianScatter hessian_positions; // entries of the objective Hessian -> indices into the Hessian values
+		CompiledJet workspace; // model value and derivatives at the current iterate, as far as they are current
+		double energy; // model value at the current iterate, if energy_current
+		bool energy_current;
+		bool gradient_current; // workspace holds the gradient (and energy) at the current iterate
+		bool hessian_current; // ... and the Hessian
+	};
+	std::vector<DenseEvaluation> dense_evaluation; // one per composition set, in the order of comp_sets
+	std::vector<Ipopt::Number> phase_energies; // eval_f: phase fraction times energy of each entry of dense_evaluation
+	// Calls task for every entry of dense_evaluation, on several threads if calls of stage have so far
+	// taken more than parallel_callback_seconds on average; task must only write the outputs of its own
+	// composition set, so results do not depend on the number of threads
+	void for_each_composition_set(char const* const stage, std::function<void(DenseEvaluation&)> const &task);
+	// Ipopt passes new_x == false when x is the same as in the previous callback; otherwise the
+	// evaluations of the previous iterate are dropped. Every callback calls this first.
+	void new_iterate(bool new_x);
+	bool hessian_requested; // eval_h has been called, so eval_grad_f evaluates the Hessian too
+	std::size_t worker_threads; // at most this many threads evaluate composition sets in one callback
+	double parallel_callback_seconds; // below this, starting threads costs more than it saves
+	std::vector<Ipopt::Index> constraint_hessian_positions; // index into the Hessian values of each entry of constraint_hessian_data
+	const Optimizer::EquilibriumResult<Ipopt::Number> *warm_start; // Neighbouring solution to start from (may be null)
+	const Optimizer::SolveControl *control; // Cancellation and timeout of the solve (may be null)
+	StageProfile profile; // setup, including global minimization, and each Ipopt callback
+	// Telemetry of set_telemetry()
+	std::unique_ptr<Optimizer::SolverTrace> trace; // null unless it was asked for
+	const std::vector<Optimizer::StoppingRule> *stopping_rules; // null if there are none
+	bool keep_trace; // trace goes to the result, rather than only to stopping_rules
+	bool stopped_by_rule;
+	std::vector<Ipopt::Number> trace_fractions; // of each entry of dense_evaluation at the last eval_f
+	std::vector<Ipopt::Number> trace_energies; // ditto
+	double traced_callback_seconds; // spent in the eval_* stages of profile up to the previous iteration
+	std::chrono::steady_clock::time_point trace_start;
+	MemoryFootprint minimizer_footprint; // of the GlobalMinimizer run by the ctor; empty if the hull came from a GlobalHullCache
 
 	Optimizer::EquilibriumResult<Ipopt::Number> result; // data structure for final result
 };
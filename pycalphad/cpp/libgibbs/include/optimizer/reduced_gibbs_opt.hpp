@@ -0,0 +1,101 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// reduced_gibbs_opt.hpp -- declaration for the reduced-space Gibbs energy optimizer
+
+#ifndef INCLUDED_REDUCED_GIBBS_OPT
+#define INCLUDED_REDUCED_GIBBS_OPT
+
+#include "libtdb/include/logging.hpp"
+#include "libgibbs/include/optimizer/opt_Gibbs.hpp"
+#include <coin/IpTNLP.hpp>
+#include <utility>
+#include <vector>
+
+/* The problem of a GibbsOpt with its site fraction balance constraints eliminated.
+ * The site fractions of each composition set are x0 + Z z, where x0 puts every species of a
+ * sublattice at the same fraction and Z is the orthonormal constraint null space matrix of the
+ * CompositionSet; the optimizer works on the phase fractions and the z of every composition set.
+ * The bounds of the site fractions become linear inequality constraints on z. Every callback
+ * maps its arguments to the full problem and its results back, so the models are evaluated as
+ * usual, and finalize_solution() hands the full solution, including the multipliers of the
+ * eliminated constraints, to the GibbsOpt.
+ */
+class ReducedGibbsOpt : public TNLP {
+public:
+	// full must stay alive until the solve ends; its result is taken with full->get_result()
+	explicit ReducedGibbsOpt(GibbsOpt *full);
+	virtual ~ReducedGibbsOpt() { }
+	/**@name Overloaded from TNLP */
+	//@{
+	virtual bool get_nlp_info(Index& n, Index& m, Index& nnz_jac_g,
+		Index& nnz_h_lag, IndexStyleEnum& index_style);
+	virtual bool get_bounds_info(Index n, Number* x_l, Number* x_u,
+		Index m, Number* g_l, Number* g_u);
+	virtual bool get_starting_point(Index n, bool init_x, Number* x,
+		bool init_z, Number* z_L, Number* z_U,
+		Index m, bool init_lambda,
+		Number* lambda);
+	virtual bool eval_f(Index n, const Number* x, bool new_x, Number& obj_value);
+	virtual bool eval_grad_f(Index n, const Number* x, bool new_x, Number* grad_f);
+	virtual bool eval_g(Index n, const Number* x, bool new_x, Index m, Number* g);
+	virtual bool eval_jac_g(Index n, const Number* x, bool new_x,
+		Index m, Index nele_jac, Index* iRow, Index *jCol,
+		Number* values);
+	virtual bool eval_h(Index n, const Number* x, bool new_x,
+		Number obj_factor, Index m, const Number* lambda,
+		bool new_lambda, Index nele_hess, Index* iRow,
+		Index* jCol, Number* values);
+	virtual void finalize_solution(SolverReturn status,
+		Index n, const Number* x, const Number* z_L, const Number* z_U,
+		Index m, const Number* g, const Number* lambda,
+		Number obj_value,
+		const IpoptData* ip_data,
+		IpoptCalculatedQuantities* ip_cq);
+	virtual bool intermediate_callback(AlgorithmMode mode,
+		Index iter, Number obj_value,
+		Number inf_pr, Number inf_du,
+		Number mu, Number d_norm,
+		Number regularization_size,
+		Number alpha_du, Number alpha_pr,
+		Index ls_trials,
+		const IpoptData* ip_data,
+		IpoptCalculatedQuantities* ip_cq);
+	//@}
+private:
+	ReducedGibbsOpt(const ReducedGibbsOpt&);
+	ReducedGibbsOpt& operator=(const ReducedGibbsOpt&);
+	typedef std::vector<std::pair<Ipopt::Index,double>> Combination; // (index, coefficient) pairs
+	// Entry of a reduced Jacobian or Hessian: values[position] += coefficient * full values[source]
+	struct Scatter {
+		Ipopt::Index source;
+		Ipopt::Index position;
+		double coefficient;
+	};
+	// Sets full_x from the reduced x
+	void expand(const Number* x);
+
+	mutable logger opto_log; // Boost Log object
+	GibbsOpt *full;
+	Ipopt::Index full_n, full_m, full_nnz_jac, full_nnz_h;
+	Ipopt::Index reduced_n, reduced_m; // size of the reduced problem
+	std::vector<double> offset; // x0: the full variables at z = 0 and phase fractions of 0
+	std::vector<Combination> full_columns; // full variable -> reduced variables it depends on
+	std::vector<std::pair<Ipopt::Index,Ipopt::Index>> phase_fractions; // (reduced variable, full variable)
+	std::vector<Ipopt::Index> kept_constraints; // full constraint of each of the first kept_constraints.size() rows
+	std::vector<Ipopt::Index> bound_rows; // full variable of each of the remaining rows
+	std::vector<bool> eliminated; // one per full constraint: a sublattice balance constraint
+	std::vector<Ipopt::Index> full_jac_rows, full_jac_cols; // sparsity structure of the full Jacobian
+	std::vector<Ipopt::Index> jac_rows, jac_cols; // ... and of the reduced one
+	std::vector<Scatter> jac_scatter; // kept constraint rows; entries of bound rows are constant
+	std::vector<double> jac_constant; // values of the reduced Jacobian from bound rows, zero elsewhere
+	std::vector<Ipopt::Index> hess_rows, hess_cols; // sparsity structure of the reduced Hessian (lower triangle)
+	std::vector<Scatter> hess_scatter;
+	std::vector<double> full_x, full_grad, full_g, full_lambda, full_jac, full_hess; // work space
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Results of recent equilibrium calculations, looked up by their conditions
+
+#ifndef INCLUDED_RESULT_CACHE
+#define INCLUDED_RESULT_CACHE
+
+#include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/optimizer/compact_result.hpp"
+#include "libgibbs/include/optimizer/compiled_system.hpp"
+#include "libgibbs/include/optimizer/equilibriumresult.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Services ask for the same equilibria over and over: repeated temperature steps, overlapping
+ * regions of maps, several users looking at the same alloy. EquilibriumResultCache keeps the
+ * values of recent results, keyed on the CompiledSystem::cache_key() of their system (which
+ * covers the database parameters, elements and entered phases), the status of every phase and
+ * the state variables and mole fractions, rounded to multiples of statevar_quantum and
+ * xfrac_quantum. A result under the same key is returned as it is; otherwise the nearest result
+ * of the same system and phases, if it is near enough, can warm-start the calculation.
+ * The least recently used results are dropped when their (estimated) size exceeds max_bytes.
+ * The cache can be written to a file and read back, e.g., by another process; the composition
+ * sets are not written, so results read from a file only serve as warm starts until they
+ * have been calculated again. An EquilibriumResultCache is not thread-safe.
+ */
+class EquilibriumResultCache {
+public:
+    explicit EquilibriumResultCache ( const std::size_t max_bytes = std::size_t ( 64 ) << 20 );
+    EquilibriumResultCache ( const EquilibriumResultCache & ) = delete;
+    EquilibriumResultCache& operator= ( const EquilibriumResultCache & ) = delete;
+
+    // The result under the key of conditions, if it is there with a descriptor of its phases
+    bool find ( const CompiledSystem &system, const evalconditions &conditions, Optimizer::CompactEquilibriumResult &result );
+    // The values, without phases, of the stored result nearest to conditions, if one of the same system,
+    // phases and condition names is at most near_distance away: the largest difference of a state variable
+    // relative to max(1, |value|) or of a mole fraction
+    bool nearest ( const CompiledSystem &system, const evalconditions &conditions, Optimizer::EquilibriumResult<double> &seed );
+    // Store result, which was calculated for system under conditions, replacing any result under the same key
+    void insert ( const CompiledSystem &system, const evalconditions &conditions, const Optimizer::CompactEquilibriumResult &result );
+
+    // Write every stored result to path; returns false if it could not be written
+    bool save ( const std::string &path ) const;
+    // Add the results written to path by save(), up to max_bytes; returns false if it could not be read
+    bool load ( const std::string &path );
+
+    void set_quanta ( const double statevars, const double xfracs ) {
+        statevar_quantum = statevars;
+        xfrac_quantum = xfracs;
+    }
+    void set_near_distance ( const double distance ) {
+        near_distance = distance;
+    }
+    void clear() {
+        entries.clear();
+        index.clear();
+        total_bytes = 0;
+    }
+    std::size_t size() const {
+        return entries.size();
+    }
+    std::size_t bytes() const {
+        return total_bytes;
+    }
+    std::size_t hits() const {
+        return hit_count;
+    }
+    std::size_t near_hits() const {
+        return near_hit_count;
+    }
+    std::size_t misses() const {
+        return miss_count;
+    }
+private:
+    struct Entry {
+        std::string key; // system, phases and quantised conditions
+        std::string group; // system, phases and the names of the conditions: what must match for a near hit
+        std::uint64_t system; // CompiledSystem::cache_key()
+        Optimizer::EquilibriumResult<double> values; // as from CompactEquilibriumResult::expand()
+        std::shared_ptr<const Optimizer::ResultDescriptor> descriptor; // null if read from a file
+        std::size_t bytes;
+    };
+    std::string key_of ( const std::uint64_t system, const evalconditions &conditions, const bool quantised ) const;
+    void insert ( const std::uint64_t system, Optimizer::EquilibriumResult<double> &&values,
+                  std::shared_ptr<const Optimizer::ResultDescriptor> descriptor );
+
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string,std::list<Entry>::iterator> index; // by Entry::key
+    std::size_t max_bytes;
+    std::size_t total_bytes;
+    double statevar_quantum;
+    double xfrac_quantum;
+    double near_distance;
+    std::size_t hit_count;
+    std::size_t near_hit_count;
+    std::size_t miss_count;
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,102 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Solved points of a long calculation, appended to a file so that it can be resumed
+
+#ifndef INCLUDED_RESULT_CHECKPOINT
+#define INCLUDED_RESULT_CHECKPOINT
+
+#include "libgibbs/include/optimizer/equilibriumresult.hpp"
+#include "libgibbs/include/optimizer/phasestatus.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Names shared by the checkpointed results of problems with the same variables, phases and conditions
+struct CheckpointLayout {
+    std::vector<std::string> variable_names; // ordered by name, as in EquilibriumResult::variables
+    std::vector<std::string> constraint_names;
+    std::vector<char> statevar_names;
+    std::vector<std::string> xfrac_names;
+    std::vector<std::string> elements;
+    std::vector<std::string> phase_names;
+    std::vector<Optimizer::PhaseStatus> phase_statuses;
+    std::vector<std::size_t> phase_fractions; // position of each phase fraction in the variables
+};
+
+// The solved state of one point: everything of an EquilibriumResult but its phases, as dense vectors
+struct CheckpointedResult {
+    CheckpointedResult() : point ( 0 ), walltime ( 0 ), itercount ( 0 ), N ( 0 ), energy ( 0 ) { }
+    std::size_t point;
+    std::string error; // why the point failed; empty if it was solved
+    std::shared_ptr<const CheckpointLayout> layout; // null if the point failed
+    double walltime;
+    int itercount;
+    double N;
+    double energy; // of the system
+    std::vector<double> x; // by layout->variable_names
+    std::vector<double> lower_multipliers;
+    std::vector<double> upper_multipliers;
+    std::vector<double> constraint_multipliers; // by layout->constraint_names
+    std::vector<double> condition_values; // by layout->statevar_names, then layout->xfrac_names
+
+    // Sorted names of the phases (without #n) whose fraction exceeds minimum_fraction
+    std::vector<std::string> stable_phases ( const double minimum_fraction = 1e-6 ) const;
+    // In the form of an EquilibriumResult without phases, e.g., to warm-start a neighbouring point
+    Optimizer::EquilibriumResult<double> expand() const;
+};
+
+/* A mapping run of several hours should not be lost with the process that runs it.
+ * ResultCheckpoint collects the results of finished points and appends them to its file in chunks,
+ * each with the names of its layouts followed by the dense values of its points, and a hash
+ * of the chunk, so that a chunk cut short by a crash is recognised and dropped when the file is
+ * opened again. The file starts with a key of the calculation (e.g., a hash of the grid and the
+ * starting conditions); a file with another key, or in another format, is started over.
+ * The results read back are in restored(), and the caller skips those points.
+ * Composition sets are not written, so a restored result cannot be evaluated; it has the
+ * energy of the system, and expand() gives the values to warm-start a neighbouring point.
+ * add() and flush() may be called from several threads.
+ */
+class ResultCheckpoint {
+public:
+    // Reads the points already in path, if it was written for the same key
+    ResultCheckpoint ( const std::string &path, const std::uint64_t key, const std::size_t flush_interval = 64 );
+    ResultCheckpoint ( const ResultCheckpoint & ) = delete;
+    ResultCheckpoint& operator= ( const ResultCheckpoint & ) = delete;
+    ~ResultCheckpoint(); // flushes whatever has not been written
+
+    // Results read from the file, by point
+    const std::unordered_map<std::size_t,CheckpointedResult>& restored() const {
+        return restored_points;
+    }
+    // A solved point; written with the next flush, which happens after every flush_interval points
+    void add ( const std::size_t point, const Optimizer::EquilibriumResult<double> &result, const double energy );
+    void add_failure ( const std::size_t point, const std::string &message );
+    // Appends the points added since the last flush; returns false if the file could not be written
+    bool flush();
+private:
+    bool flush_pending(); // requires mutex
+    bool start_file ( const std::vector<std::string> &chunks ); // requires mutex
+    std::shared_ptr<const CheckpointLayout> layout_of ( const Optimizer::EquilibriumResult<double> &result ); // requires mutex
+
+    const std::string path;
+    const std::uint64_t key;
+    const std::size_t flush_interval;
+    std::unordered_map<std::size_t,CheckpointedResult> restored_points;
+    std::list<std::shared_ptr<const CheckpointLayout>> layouts; // of the points so far, most recently used first
+    std::vector<CheckpointedResult> pending; // added since the last flush
+    bool started; // the file has been (re)written with its header
+    std::mutex mutex; // guards layouts and pending, and the writing of the file
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,51 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Chemical potentials and thermal properties of compact equilibrium results, in batches
+
+#ifndef INCLUDED_RESULT_PROPERTIES
+#define INCLUDED_RESULT_PROPERTIES
+
+#include "libgibbs/include/optimizer/compact_result.hpp"
+#include <vector>
+
+namespace Optimizer {
+
+/* Phase::chemical_potential() evaluates the gradient of the phase again for every species, through
+ * the name-keyed overloads of CompositionSet. The functions here evaluate the energy and gradient
+ * of each phase once, with CompositionSet::evaluate_internal_objective_gradient(), and derive the
+ * chemical potentials of all elements from them in the same way (Hillert, 2008, p. 77-78).
+ * H, S and Cp come from central differences of the phase energies in T, at fixed site fractions;
+ * H and S of the system are therefore exact at equilibrium, but its Cp leaves out the heat of the
+ * change of the phase fractions and constitutions with T.
+ * All values are per mole of formula units, as CompactEquilibriumResult::energy().
+ */
+struct PhaseProperties {
+	double energy; // G
+	double enthalpy;
+	double entropy;
+	double heat_capacity; // Cp
+	std::vector<double> chemical_potentials; // by ResultDescriptor::elements(); NaN if not defined by this phase alone
+};
+
+struct ResultProperties {
+	double energy;
+	double enthalpy;
+	double entropy;
+	double heat_capacity;
+	// by ResultDescriptor::elements(), from the phases with a fraction above 1e-6, as in Equilibrium::print()
+	std::vector<double> chemical_potentials;
+	std::vector<PhaseProperties> phases; // by ResultDescriptor::phases()
+};
+
+ResultProperties evaluate_properties(const CompactEquilibriumResult &result);
+// The same for every result; results with the same descriptor and state variables share their bindings,
+// so batches sorted by T (e.g., the points of an isothermal section) specialize the models once per T
+std::vector<ResultProperties> evaluate_properties(const std::vector<CompactEquilibriumResult> &results);
+}
+
+#endif
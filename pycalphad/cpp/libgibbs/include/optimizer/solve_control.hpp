@@ -0,0 +1,48 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Cancellation and timeout of a running equilibrium calculation
+
+#ifndef INCLUDED_SOLVE_CONTROL
+#define INCLUDED_SOLVE_CONTROL
+
+#include <atomic>
+#include <chrono>
+
+namespace Optimizer {
+
+/* A SolveControl lets another thread stop an equilibrium calculation. GibbsOpt checks it once per
+ * Ipopt iteration, in intermediate_callback(), and Equilibrium before the solve starts; a stopped
+ * calculation fails with equilibrium_error. A step that does not return to the solver, e.g.,
+ * global minimization, is not interrupted.
+ */
+class SolveControl {
+public:
+	typedef std::chrono::steady_clock clock;
+	SolveControl() : cancelled(false), deadline(clock::time_point::max()) { }
+	SolveControl(const SolveControl &) = delete;
+	SolveControl & operator=(const SolveControl &) = delete;
+
+	// May be called from any thread
+	void cancel() { cancelled = true; }
+	// Stop once seconds have passed from now; seconds <= 0 removes the limit
+	// Not thread-safe: set it before the calculation starts
+	void set_timeout(const double seconds) {
+		deadline = seconds > 0 ?
+			clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds)) :
+			clock::time_point::max();
+	}
+	bool is_cancelled() const { return cancelled; }
+	bool timed_out() const { return deadline != clock::time_point::max() && clock::now() > deadline; }
+	bool stop_requested() const { return is_cancelled() || timed_out(); }
+private:
+	std::atomic<bool> cancelled;
+	clock::time_point deadline;
+};
+}
+
+#endif
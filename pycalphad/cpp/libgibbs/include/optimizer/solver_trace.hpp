@@ -0,0 +1,91 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Per-iteration telemetry of an equilibrium solve, and rules to stop it early
+
+#ifndef INCLUDED_SOLVER_TRACE
+#define INCLUDED_SOLVER_TRACE
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Optimizer {
+
+// The state of one Ipopt iteration, as passed to intermediate_callback()
+struct SolverIteration {
+    int iteration;
+    bool restoration; // in the feasibility restoration phase
+    double objective;
+    double primal_infeasibility; // inf_pr
+    double dual_infeasibility; // inf_du
+    double barrier; // mu
+    double step_norm; // d_norm, of the primal step
+    double primal_step; // alpha_pr
+    double dual_step; // alpha_du
+    int line_search_trials;
+    double callback_seconds; // spent in the eval_* callbacks since the previous iteration
+    double elapsed_seconds; // since the solve started
+};
+
+/* SolverTrace records every iteration of a solve in two flat vectors: the values of SolverIteration,
+ * and the fraction and molar energy of each composition set, in the order of phases().
+ * The phase values are those of the last point at which the objective was evaluated, which is
+ * normally the accepted iterate (the last trial point of the line search).
+ * About 100 bytes per iteration plus 16 per composition set, so it can be kept with every result.
+ */
+class SolverTrace {
+public:
+    explicit SolverTrace ( std::vector<std::string> phase_names ) : phase_names ( std::move ( phase_names ) ) { }
+
+    // Names of the composition sets
+    const std::vector<std::string>& phases() const {
+        return phase_names;
+    }
+    std::size_t size() const {
+        return iteration_values.size();
+    }
+    bool empty() const {
+        return iteration_values.empty();
+    }
+    const std::vector<SolverIteration>& iterations() const {
+        return iteration_values;
+    }
+    const SolverIteration& back() const {
+        return iteration_values.back();
+    }
+    double phase_fraction ( const std::size_t iteration, const std::size_t phase ) const {
+        return phase_values[2 * ( iteration * phase_names.size() + phase )];
+    }
+    double phase_energy ( const std::size_t iteration, const std::size_t phase ) const {
+        return phase_values[2 * ( iteration * phase_names.size() + phase ) + 1];
+    }
+
+    // fractions and energies have one entry per phase
+    void add ( const SolverIteration &values, const std::vector<double> &fractions, const std::vector<double> &energies );
+    // One line per iteration, like Ipopt's own iteration output, with the timings
+    std::string print() const;
+private:
+    std::vector<std::string> phase_names;
+    std::vector<SolverIteration> iteration_values;
+    std::vector<double> phase_values; // fraction, energy of each phase of each iteration
+};
+
+// Called after every iteration with the trace so far; returning true stops the solve,
+// and the current iterate becomes the solution
+typedef std::function<bool ( const SolverTrace& )> StoppingRule;
+
+// Stops once, for iterations consecutive iterations, the same composition sets have had a fraction
+// above minimum_fraction and the molar energy of each has changed by less than energy_tolerance,
+// while the primal infeasibility has stayed below max_infeasibility
+StoppingRule stop_when_stable ( const double energy_tolerance, const std::size_t iterations = 3,
+                                const double max_infeasibility = 1e-8, const double minimum_fraction = 1e-6 );
+}
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
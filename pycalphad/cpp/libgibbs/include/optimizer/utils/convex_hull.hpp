@@ -8,29 +8,74 @@
 #ifndef INCLUDED_CONVEX_HULL
 #define INCLUDED_CONVEX_HULL
 
+#include "libgibbs/include/optimizer/utils/lower_convex_hull.hpp"
+#include "libgibbs/include/optimizer/utils/point_cloud.hpp"
 #include "libgibbs/include/optimizer/utils/simplicial_facet.hpp"
 #include <map>
 #include <string>
 #include <vector>
 #include <set>
 #include <functional>
+#include <utility>
 
 namespace Optimizer {
     namespace details {
         
-        // Calculation of the internal lower convex hull of a set of points
-        std::vector<std::vector<double>> internal_lower_convex_hull ( 
-        const std::vector<std::vector<double>> &points, 
+        // Relative energy tolerance of cull_above_reference_hull() for the hulls below
+        constexpr const double reference_hull_tolerance = 1e-6;
+
+        // Ids of the points (the last coordinate is the energy) that can be vertices of their lower convex hull:
+        // those at most tolerance (relative) above the lower hull of the lowest points at the vertices of the
+        // composition domain, e.g., the pure end-members. Each dependent dimension closes a group of coordinates
+        // that sum to 1. All points are kept if a vertex of the domain has no point, or too few points remain.
+        std::vector<std::size_t> cull_above_reference_hull (
+        const PointCloud<double> &points,
+        const std::set<std::size_t> &dependent_dimensions,
+        const double tolerance
+        );
+
+        // Calculation of the internal lower convex hull of a set of points (the last coordinate is the energy)
+        // The result is the internal coordinates, without energies, of the points found
+        // Points above the hull of the pure end-members are culled before the hull is built
+        PointCloud<double> internal_lower_convex_hull ( 
+        const PointCloud<double> &points, 
+        const std::set<std::size_t> &dependent_dimensions,
+        const double critical_edge_length,
+        const std::function<double(const std::vector<double>&)> calculate_objective
+        );
+        // As above, for a hull kept between calls (constructed with dependent_dimensions dropped):
+        // new_points are added to it, only the facets they affect are recalculated,
+        // and the result covers all points of the hull
+        PointCloud<double> internal_lower_convex_hull ( 
+        LowerConvexHull &hull,
+        const PointCloud<double> &new_points, 
         const std::set<std::size_t> &dependent_dimensions,
         const double critical_edge_length,
         const std::function<double(const std::vector<double>&)> calculate_objective
         );
         
+        // "True energies" of the midpoints of edges (pairs of point ids) of the global hull, one per edge,
+        // written to energies; the largest double for edges between different phases (always tie lines)
+        typedef std::function<void(const std::vector<std::pair<std::size_t,std::size_t>>&, std::vector<double>&)> MidpointEnergyBatch;
+
         // Calculation of the global convex hull of a system
+        // With filter_tie_facets, only facets with at least one true tie line edge are returned; the
+        // midpoints of all edges are collected first and calculate_midpoint_energies is called once
+        std::vector<SimplicialFacet<double>> global_lower_convex_hull (
+            const PointCloud<double> &points,
+            const double critical_edge_length,
+            const MidpointEnergyBatch calculate_midpoint_energies,
+            const bool filter_tie_facets = false
+        );
+        // As above, for a hull kept between calls (constructed with the dependent
+        // mole fraction, the second to last coordinate, dropped); point ids continue
+        // from the points already in the hull
         std::vector<SimplicialFacet<double>> global_lower_convex_hull (
-            const std::vector<std::vector<double>> &points,
+            LowerConvexHull &hull,
+            const PointCloud<double> &new_points,
             const double critical_edge_length,
-            const std::function<double(const std::size_t, const std::size_t)> calculate_midpoint_energy
+            const MidpointEnergyBatch calculate_midpoint_energies,
+            const bool filter_tie_facets = false
         );
         
         // Adds dependent degrees of freedom back to a point
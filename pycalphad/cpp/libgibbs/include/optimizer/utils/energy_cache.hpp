@@ -0,0 +1,100 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Memoized energies of the points of one phase under fixed conditions
+
+#ifndef INCLUDED_ENERGY_CACHE
+#define INCLUDED_ENERGY_CACHE
+
+#include "libgibbs/include/compositionset.hpp"
+#include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/utils/compiled_expr.hpp"
+#include "libgibbs/include/utils/sublattice_symmetry.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Optimizer { namespace details {
+
+/* EnergyCache remembers the energy of every point of a phase it has seen,
+ * so that each point is evaluated at most once during global minimization.
+ * Points are laid out according to phase.get_variable_map(); coordinates
+ * are compared after rounding to a multiple of the resolution.
+ * The conditions are copied, but the phase must outlive the cache.
+ * With single_precision, points missing from energies() are evaluated in float (see
+ * CompiledExpression::evaluate_batch()), which is enough to rank sampled points;
+ * exact_energies() evaluates such approximate entries again in double.
+ * With a symmetry, points are keyed by their image in its fundamental domain, so that all the
+ * points of an orbit share one entry and are evaluated once; the samplers also read it from here.
+ * An EnergyCache is not thread-safe; use one per phase and thread.
+ */
+class EnergyCache {
+public:
+    EnergyCache ( CompositionSet const &phase, evalconditions const &conditions, const double resolution = 1e-10,
+                  const bool single_precision = false, SublatticeSymmetry symmetry = SublatticeSymmetry() );
+
+    double energy ( double const* const point );
+    // Energies of npoints points; point i starts at points + i*stride
+    // Points that are missing are evaluated together by the batch evaluator
+    void energies ( double const* const points, const std::size_t npoints, const std::size_t stride, double* const out );
+    // As energies(), but every energy is a double precision one; approximate entries are replaced
+    void exact_energies ( double const* const points, const std::size_t npoints, const std::size_t stride, double* const out );
+    // Record an energy that was calculated elsewhere, e.g., together with a gradient
+    void insert ( double const* const point, const double energy );
+
+    std::size_t hits() const {
+        return hit_count;
+    }
+    std::size_t misses() const {
+        return miss_count;
+    }
+    std::size_t size() const {
+        return values.size();
+    }
+    // Heap bytes of the cached points: a hash node with its key, and the buckets
+    std::size_t memory_bytes() const {
+        return values.size() * ( sizeof ( KeyType ) + sizeof ( Entry ) + 2 * sizeof ( void* ) + dimension * sizeof ( std::int64_t ) )
+               + values.bucket_count() * sizeof ( void* );
+    }
+    bool single_precision() const {
+        return single;
+    }
+    SublatticeSymmetry const& symmetry() const {
+        return phase_symmetry;
+    }
+    // Largest difference between an approximate energy and its exact one, as found by exact_energies()
+    double max_single_precision_error() const {
+        return max_rounding_error;
+    }
+private:
+    struct Entry {
+        double energy;
+        bool approximate; // evaluated in single precision
+    };
+    typedef std::vector<std::int64_t> KeyType;
+    struct KeyHash {
+        std::size_t operator() ( const KeyType &key ) const;
+    };
+    KeyType make_key ( double const* const point ) const;
+
+    CompositionSet const* phase;
+    evalconditions conditions;
+    CompiledBinding binding;
+    std::size_t dimension;
+    double resolution;
+    bool single;
+    SublatticeSymmetry phase_symmetry;
+    std::unordered_map<KeyType,Entry,KeyHash> values;
+    std::size_t hit_count;
+    std::size_t miss_count;
+    double max_rounding_error;
+};
+
+} // namespace details
+} // namespace Optimizer
+
+#endif
@@ -15,11 +15,26 @@
 #include "libgibbs/include/models.hpp"
 #include "libgibbs/include/compositionset.hpp"
 #include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/optimizer/utils/energy_cache.hpp"
+#include "libgibbs/include/optimizer/utils/point_cloud.hpp"
+#include "libgibbs/include/utils/energy_device.hpp"
 #include <vector>
 
 namespace Optimizer { namespace details {
 
-std::vector<std::vector<double>>  AdaptiveSimplexSample(
+// Flag the points (laid out according to phase.get_variable_map()) at which the Hessian of
+// the energy, projected into the null space of the phase's constraints, is positive definite
+// Hessians are evaluated and factorized in blocks of points; for phases with many feasible directions, the
+// smallest eigenvalue is first estimated by Lanczos iteration on Hessian-vector products, and a point is
+// only factorized if that is too close to zero to decide
+std::vector<bool> StabilityMask(
+		CompositionSet const &phase,
+		evalconditions const& conditions,
+		PointCloud<double> const &points
+		);
+
+// Each sampled point is followed by its energy
+PointCloud<double> AdaptiveSimplexSample(
 		CompositionSet const &phase,
 		sublattice_set const &sublset,
 		evalconditions const& conditions,
@@ -27,6 +42,51 @@ std::vector<std::vector<double>>  AdaptiveSimplexSample(
                 const std::size_t refinement_subdivisions_per_axis,
                 const bool discard_unstable
 		);
+// As above; all energies go through energy_cache, which remembers them for later queries
+// The unstable regions are refined concurrently by worker_threads threads (0 for one per core)
+// Only the fundamental domain of energy_cache.symmetry() is sampled: one combination of subsimplices per orbit
+PointCloud<double> AdaptiveSimplexSample(
+		CompositionSet const &phase,
+		sublattice_set const &sublset,
+		evalconditions const& conditions,
+                const std::size_t initial_subdivisions_per_axis,
+                const std::size_t refinement_subdivisions_per_axis,
+                const bool discard_unstable,
+                EnergyCache &energy_cache,
+                std::size_t worker_threads = 1
+		);
+
+// Sample a fixed number of points, for phases where uniform subdivision would need too many
+// The pure end-members and point_budget Halton points in the product of the sublattice simplices
+// are returned, each followed by its energy; worker_threads threads generate the coordinates
+PointCloud<double> QuasirandomSimplexSample(
+		CompositionSet const &phase,
+		sublattice_set const &sublset,
+		evalconditions const& conditions,
+                const std::size_t point_budget,
+                const std::size_t worker_threads
+		);
+// As above; all energies go through energy_cache, which remembers them for later queries
+// The points are folded into the fundamental domain of energy_cache.symmetry(), which gets the whole budget
+PointCloud<double> QuasirandomSimplexSample(
+		CompositionSet const &phase,
+		sublattice_set const &sublset,
+		evalconditions const& conditions,
+                const std::size_t point_budget,
+                const std::size_t worker_threads,
+                EnergyCache &energy_cache
+		);
+// As above, with the energies evaluated on device in batches, overlapped with an incremental
+// lower hull on the CPU; only the end-members and the vertices of that hull are returned
+PointCloud<double> QuasirandomSimplexSample(
+		CompositionSet const &phase,
+		sublattice_set const &sublset,
+		evalconditions const& conditions,
+                const std::size_t point_budget,
+                const std::size_t worker_threads,
+                EnergyCache &energy_cache,
+                EnergyDevice &device
+		);
 }
 }
 
@@ -0,0 +1,145 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Bounding volume hierarchy over the facets of a convex hull, for point location
+
+#ifndef INCLUDED_FACET_INDEX
+#define INCLUDED_FACET_INDEX
+
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+namespace Optimizer { namespace details {
+
+/* FacetIndex finds the facets whose axis-aligned bounding boxes contain a point.
+ * The facets of a lower hull tile the composition space, so only a few boxes
+ * contain any given point, and a query visits O(log n) nodes of the tree.
+ * Boxes are given in the coordinates the caller queries in, e.g., the mole
+ * fractions without the dependent component.
+ */
+template <typename CoordinateType = double>
+class FacetIndex {
+public:
+    FacetIndex() : box_dimension ( 0 ) { }
+
+    // Box i spans [lower[i*dimension+k], upper[i*dimension+k]] in coordinate k
+    void build ( const std::size_t dimension, std::vector<CoordinateType> lower, std::vector<CoordinateType> upper ) {
+        BOOST_ASSERT ( lower.size() == upper.size() );
+        BOOST_ASSERT ( dimension == 0 || lower.size() % dimension == 0 );
+        box_dimension = dimension;
+        box_lower = std::move ( lower );
+        box_upper = std::move ( upper );
+        nodes.clear();
+        const std::size_t box_count = dimension > 0 ? box_lower.size() / dimension : 0;
+        order.resize ( box_count );
+        std::iota ( order.begin(), order.end(), 0 );
+        if ( box_count > 0 ) {
+            nodes.resize ( 1 );
+            build_node ( 0, 0, box_count );
+        }
+    }
+    void clear() {
+        build ( 0, std::vector<CoordinateType>(), std::vector<CoordinateType>() );
+    }
+    std::size_t size() const {
+        return order.size();
+    }
+    // Heap bytes of the boxes and the tree
+    std::size_t memory_bytes() const {
+        std::size_t bytes = ( box_lower.capacity() + box_upper.capacity() ) * sizeof ( CoordinateType )
+                            + order.capacity() * sizeof ( std::size_t ) + nodes.capacity() * sizeof ( Node );
+        for ( auto i = nodes.cbegin(); i != nodes.cend(); ++i ) {
+            bytes += ( i->lower.capacity() + i->upper.capacity() ) * sizeof ( CoordinateType );
+        }
+        return bytes;
+    }
+
+    // Calls visit ( facet_id ) for every box containing point, widened by tolerance
+    template <typename Visitor>
+    void query ( CoordinateType const* const point, const CoordinateType tolerance, Visitor &&visit ) const {
+        if ( nodes.empty() ) return;
+        std::vector<std::size_t> stack { 0 };
+        while ( !stack.empty() ) {
+            const Node &node = nodes[stack.back()];
+            stack.pop_back();
+            if ( !contains ( node.lower.data(), node.upper.data(), point, tolerance ) ) continue;
+            if ( node.left == 0 ) {
+                for ( std::size_t i = node.begin; i < node.end; ++i ) {
+                    const std::size_t facet_id = order[i];
+                    if ( contains ( box_lower.data() + facet_id * box_dimension, box_upper.data() + facet_id * box_dimension, point, tolerance ) ) {
+                        visit ( facet_id );
+                    }
+                }
+            }
+            else {
+                stack.push_back ( node.left );
+                stack.push_back ( node.left + 1 );
+            }
+        }
+    }
+private:
+    static constexpr std::size_t leaf_size = 4;
+    struct Node {
+        std::vector<CoordinateType> lower;
+        std::vector<CoordinateType> upper;
+        std::size_t begin, end; // range of order covered by this node
+        std::size_t left; // index of the left child, followed by the right one; 0 for a leaf
+    };
+    bool contains ( CoordinateType const* const lower, CoordinateType const* const upper,
+                    CoordinateType const* const point, const CoordinateType tolerance ) const {
+        for ( std::size_t k = 0; k < box_dimension; ++k ) {
+            if ( point[k] < lower[k] - tolerance || point[k] > upper[k] + tolerance ) return false;
+        }
+        return true;
+    }
+    // Fills nodes[node_id] for order[begin,end), splitting it at the median of the box centres along the widest extent
+    void build_node ( const std::size_t node_id, const std::size_t begin, const std::size_t end ) {
+        Node node;
+        node.begin = begin;
+        node.end = end;
+        node.left = 0;
+        node.lower.assign ( box_lower.begin() + order[begin] * box_dimension, box_lower.begin() + ( order[begin] + 1 ) * box_dimension );
+        node.upper.assign ( box_upper.begin() + order[begin] * box_dimension, box_upper.begin() + ( order[begin] + 1 ) * box_dimension );
+        for ( std::size_t i = begin + 1; i < end; ++i ) {
+            for ( std::size_t k = 0; k < box_dimension; ++k ) {
+                node.lower[k] = std::min ( node.lower[k], box_lower[order[i] * box_dimension + k] );
+                node.upper[k] = std::max ( node.upper[k], box_upper[order[i] * box_dimension + k] );
+            }
+        }
+        if ( end - begin > leaf_size ) {
+            std::size_t axis = 0;
+            for ( std::size_t k = 1; k < box_dimension; ++k ) {
+                if ( node.upper[k] - node.lower[k] > node.upper[axis] - node.lower[axis] ) axis = k;
+            }
+            const std::size_t middle = begin + ( end - begin ) / 2;
+            std::nth_element ( order.begin() + begin, order.begin() + middle, order.begin() + end,
+            [this,axis] ( const std::size_t a, const std::size_t b ) {
+                return box_lower[a * box_dimension + axis] + box_upper[a * box_dimension + axis]
+                       < box_lower[b * box_dimension + axis] + box_upper[b * box_dimension + axis];
+            } );
+            // The children are adjacent
+            node.left = nodes.size();
+            nodes.resize ( nodes.size() + 2 );
+            build_node ( node.left, begin, middle );
+            build_node ( node.left + 1, middle, end );
+        }
+        nodes[node_id] = std::move ( node );
+    }
+    std::size_t box_dimension;
+    std::vector<CoordinateType> box_lower;
+    std::vector<CoordinateType> box_upper;
+    std::vector<std::size_t> order; // facet ids, grouped by node
+    std::vector<Node> nodes;
+};
+
+} // namespace details
+} // namespace Optimizer
+
+#endif
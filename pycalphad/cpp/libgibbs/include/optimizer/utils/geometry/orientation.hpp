@@ -9,10 +9,10 @@
 
 #ifndef INCLUDED_ORIENTATION
 #define INCLUDED_ORIENTATION
-#include "libgibbs/include/utils/determinant.hpp"
+#include "libgibbs/include/utils/small_matrix.hpp"
 #include <boost/numeric/ublas/matrix.hpp>
-#include <boost/numeric/ublas/matrix_proxy.hpp>
 #include <boost/assert.hpp>
+#include <vector>
 
 /* The orientation is the signed volume of the simplex spanned by the hyperplane
  * and the candidate point, up to a constant factor depending on the dimension of
@@ -23,22 +23,23 @@
 template <typename VectorType, typename DataType>
 double orientation ( const boost::numeric::ublas::matrix<DataType> &hyperplane_points , 
                   const VectorType &candidate_point ) {
-    using namespace boost::numeric::ublas;
     BOOST_ASSERT ( candidate_point.size() == hyperplane_points.size2() );
-    matrix<DataType> orientation_test_matrix (hyperplane_points.size1()+1, hyperplane_points.size2()+1);
-    matrix_row<DataType> last_row ( orientation_test_matrix, orientation_test_matrix.size1() );
-    matrix_column<DataType> last_column ( orientation_test_matrix, orientation_test_matrix.size2() );
-    // Fill the last column with 1's
-    for (auto i = 0; i < orientation_test_matrix.size1(); ++i) {
-        last_column ( i ) = 1;
+    const std::size_t rows = hyperplane_points.size1()+1;
+    const std::size_t columns = hyperplane_points.size2()+1;
+    BOOST_ASSERT ( rows == columns );
+    // Row-major test matrix: the hyperplane points, then the candidate point, with a last column of 1's
+    std::vector<DataType> orientation_test_matrix ( rows * columns );
+    for ( std::size_t i = 0; i < hyperplane_points.size1(); ++i ) {
+        for ( std::size_t j = 0; j < hyperplane_points.size2(); ++j ) {
+            orientation_test_matrix[i*columns+j] = hyperplane_points ( i,j );
+        }
+        orientation_test_matrix[i*columns+columns-1] = 1;
     }
-    // Fill the upper left part of the test matrix with the hyperplane points
-    subrange ( orientation_test_matrix, 0,hyperplane_points.size1(), 0,hyperplane_points.size2() ) = hyperplane_points;
-    // Fill the last row with the coordinates of the candidate point
     for ( auto i = candidate_point.cbegin(); i != candidate_point.cend(); ++i) {
-        last_row ( std::distance( candidate_point.cbegin(), i ) ) = *i;
+        orientation_test_matrix[(rows-1)*columns+std::distance( candidate_point.cbegin(), i )] = *i;
     }
+    orientation_test_matrix[rows*columns-1] = 1;
     // Calculate and return the determinant of the orientation test matrix
-    return determinant ( orientation_test_matrix );
+    return dense_determinant ( orientation_test_matrix.data(), rows );
 }
 #endif
\ No newline at end of file
@@ -10,7 +10,10 @@
 #ifndef INCLUDED_HULL_MAPPING
 #define INCLUDED_HULL_MAPPING
 
+#include "libgibbs/include/optimizer/utils/point_cloud.hpp"
+#include <boost/assert.hpp>
 #include <boost/noncopyable.hpp>
+#include <algorithm>
 #include <map>
 #include <string>
 #include <vector>
@@ -55,6 +58,9 @@ struct ConvexHullEntry {
  * The point IDs of the vertices of the candidate facet are used to find each vertex's
  * internal degrees of freedom; this is the composition of that phase. Using the constraints
  * we fix a point inside the facet and use the lever rule to find the phase fractions.
+ * Entries are addressed by point ID in constant time: phase names are stored once and
+ * referred to by small integer ids, internal coordinates are rows of one PointCloud per
+ * phase and global mole fractions are dense rows, one column per component.
  */
 template <typename CoordinateType = double, typename EnergyType = CoordinateType>
 class ConvexHullMap {
@@ -63,31 +69,124 @@ public:
     typedef std::vector<HullEntryType> HullEntryContainerType;
     typedef typename HullEntryType::PointType PointType;
     typedef typename HullEntryType::GlobalPointType GlobalPointType;
-    const HullEntryType operator[] ( const std::size_t index ) { 
-        auto return_iter = all_points.cbegin();
-        std::advance(return_iter, index);
-        return (const HullEntryType) *return_iter;
+    typedef PointCloud<CoordinateType> PointCloudType;
+    // Forget all points; global coordinates will be stored for component_names, in that order
+    void reset ( const std::vector<std::string> &component_names ) {
+        components = component_names;
+        phase_names.clear();
+        phase_points.clear();
+        entry_phase.clear();
+        entry_row.clear();
+        global_hull_status.clear();
+        global_points_with_energy = PointCloudType ( components.size()+1 );
     };
+    // A copy of one entry; the accessors below avoid building it
+    const HullEntryType operator[] ( const std::size_t index ) const { 
+        HullEntryType hull_entry;
+        hull_entry.phase_name = phase_name ( index );
+        hull_entry.on_global_hull = on_global_hull ( index );
+        hull_entry.energy = energy ( index );
+        const PointView<CoordinateType> internal_point = internal_coordinates ( index );
+        hull_entry.internal_coordinates.assign ( internal_point.begin(), internal_point.end() );
+        const PointView<CoordinateType> global_point = global_coordinates ( index );
+        for ( std::size_t i = 0; i < components.size(); ++i ) {
+            hull_entry.global_coordinates[components[i]] = global_point[i];
+        }
+        return hull_entry;
+    };
+    // Access without copying; views are invalidated by inserting points
+    // Phases are numbered in the order their first point was inserted
+    std::size_t phase_count () const { return phase_names.size(); }
+    const std::string& phase_name_of_id ( const std::size_t phase_id ) const { return phase_names[phase_id]; }
+    std::size_t phase_id ( const std::size_t index ) const {
+        BOOST_ASSERT ( index < size() );
+        return entry_phase[index];
+    }
+    const std::string& phase_name ( const std::size_t index ) const { return phase_names[phase_id ( index )]; }
+    bool on_global_hull ( const std::size_t index ) const {
+        BOOST_ASSERT ( index < size() );
+        return global_hull_status[index];
+    }
+    EnergyType energy ( const std::size_t index ) const { return global_points_with_energy[index][components.size()]; }
+    PointView<CoordinateType> internal_coordinates ( const std::size_t index ) const {
+        return phase_points[phase_id ( index )].row ( entry_row[index] );
+    }
+    // Mole fractions, in the order of component_names()
+    PointView<CoordinateType> global_coordinates ( const std::size_t index ) const {
+        return PointView<CoordinateType> ( global_points_with_energy[index], components.size() );
+    }
     void set_global_hull_status ( const std::size_t index, const bool status ) {
-        auto iter = all_points.begin();
-        std::advance(iter, index);
-        iter->on_global_hull = status;
+        BOOST_ASSERT ( index < size() );
+        global_hull_status[index] = status;
     };
     void insert_point ( const std::string &phase_name, const EnergyType &energy, 
                         const PointType &internal_coordinates, const GlobalPointType &global_coordinates ) {
-        HullEntryType hull_entry;
-        hull_entry.phase_name = phase_name;
-        hull_entry.on_global_hull = false; // by default
-        hull_entry.energy = energy;
-        hull_entry.internal_coordinates = internal_coordinates;
-        hull_entry.global_coordinates = global_coordinates;
-        all_points.push_back ( hull_entry );
+        if ( components.empty() && size() == 0 ) {
+            std::vector<std::string> component_names;
+            for ( auto coord : global_coordinates ) component_names.push_back ( coord.first );
+            reset ( component_names );
+        }
+        PointCloudType internal_point ( internal_coordinates.size() );
+        internal_point.push_back ( internal_coordinates );
+        PointCloudType global_point ( components.size()+1 );
+        CoordinateType* const row = global_point.push_back();
+        for ( std::size_t i = 0; i < components.size(); ++i ) {
+            auto coord = global_coordinates.find ( components[i] );
+            if ( coord != global_coordinates.end() ) row[i] = coord->second;
+        }
+        row[components.size()] = energy;
+        insert_points ( phase_name, internal_point, global_point );
+    };
+    // Row i of global_coordinates (the components from reset(), then the energy) belongs to internal_coordinates row i
+    void insert_points ( const std::string &phase_name, 
+                         const PointCloudType &internal_coordinates, const PointCloudType &global_coordinates ) {
+        BOOST_ASSERT ( internal_coordinates.size() == global_coordinates.size() );
+        BOOST_ASSERT ( global_coordinates.dimension() == global_points_with_energy.dimension() );
+        auto phase = std::find ( phase_names.begin(), phase_names.end(), phase_name );
+        const std::size_t phase_id = std::distance ( phase_names.begin(), phase );
+        if ( phase == phase_names.end() ) {
+            phase_names.push_back ( phase_name );
+            phase_points.emplace_back ( internal_coordinates.dimension() );
+        }
+        BOOST_ASSERT ( phase_points[phase_id].dimension() == internal_coordinates.dimension() );
+        const std::size_t first_row = phase_points[phase_id].size();
+        phase_points[phase_id].append ( internal_coordinates );
+        global_points_with_energy.append ( global_coordinates );
+        for ( std::size_t i = 0; i < internal_coordinates.size(); ++i ) {
+            entry_phase.push_back ( phase_id );
+            entry_row.push_back ( first_row + i );
+            global_hull_status.push_back ( false ); // by default
+        }
     };
-    HullEntryContainerType get_all_points () const { return all_points; }
-    std::size_t size () const { return all_points.size(); }
+    HullEntryContainerType get_all_points () const {
+        HullEntryContainerType all_points;
+        all_points.reserve ( size() );
+        for ( std::size_t i = 0; i < size(); ++i ) all_points.push_back ( ( *this ) [i] );
+        return all_points;
+    }
+    std::size_t size () const { return entry_phase.size(); }
+    const std::vector<std::string>& component_names () const { return components; }
+    // Heap bytes of all points and their bookkeeping
+    std::size_t memory_bytes () const {
+        std::size_t bytes = global_points_with_energy.memory_bytes() + phase_points.capacity() * sizeof ( PointCloudType )
+                            + entry_phase.capacity() * sizeof ( std::size_t ) + entry_row.capacity() * sizeof ( std::size_t )
+                            + global_hull_status.capacity() / 8
+                            + ( components.capacity() + phase_names.capacity() ) * sizeof ( std::string );
+        for ( auto i = phase_points.cbegin(); i != phase_points.cend(); ++i ) bytes += i->memory_bytes();
+        return bytes;
+    }
+    // Global coordinates of all entries in ID order, each followed by its energy;
+    // this is the input of the global hull
+    const PointCloudType& global_points () const { return global_points_with_energy; }
 private:
-    // entries should be inserted in global ID order
-    HullEntryContainerType all_points;
+    std::vector<std::string> components;
+    std::vector<std::string> phase_names;
+    std::vector<PointCloudType> phase_points; // internal coordinates of all entries of each phase
+    // entries are inserted in global ID order
+    std::vector<std::size_t> entry_phase; // index into phase_names
+    std::vector<std::size_t> entry_row; // row in phase_points[entry_phase]
+    std::vector<bool> global_hull_status;
+    PointCloudType global_points_with_energy;
 };
 
 
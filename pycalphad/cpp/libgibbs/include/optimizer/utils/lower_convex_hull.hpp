@@ -0,0 +1,114 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Incremental convex hull for calculating lower convex hulls of energy landscapes
+
+#ifndef INCLUDED_LOWER_CONVEX_HULL
+#define INCLUDED_LOWER_CONVEX_HULL
+
+#include "libgibbs/include/optimizer/utils/point_cloud.hpp"
+#include <map>
+#include <set>
+#include <vector>
+
+namespace Optimizer { namespace details {
+
+/* LowerConvexHull maintains the convex hull of a growing set of points by
+ * Beneath-Beyond insertion: each new point removes the facets it can see
+ * and is connected to their horizon, so adding a batch of points only
+ * touches the facets near those points instead of rebuilding the hull.
+ * The last coordinate of every point is its energy. Some coordinates can
+ * be dropped, like Qhull's "Qbk:0Bk:0", e.g., for dependent site fractions.
+ * Points that are inside the hull (or coplanar with it) when they are
+ * added are never vertices, even if later points would expose them.
+ * With lower_only, a vertex at infinite energy is added as soon as the hull
+ * is full-dimensional: the upper hull is then replaced by vertical facets
+ * over the boundary of the composition space and never built at all.
+ * add_points() throws floating_point_error for a point whose visible facets
+ * are too degenerate to replace; the facets are then left as they were
+ * before that point, without the rest of its batch.
+ */
+class LowerConvexHull {
+public:
+    typedef std::vector<double> PointType;
+    struct Facet {
+        std::vector<std::size_t> vertices; // point ids
+        PointType normal; // outward unit normal, in the reduced coordinates
+        double offset; // normal . x + offset == 0 on the facet
+    };
+
+    LowerConvexHull (
+        const std::size_t point_dimension,
+        const std::set<std::size_t> &dropped_dimensions = std::set<std::size_t>(),
+        const bool lower_only = false );
+
+    // Points are numbered in the order they are added, starting from zero
+    void add_points ( const PointCloud<double> &new_points );
+    std::size_t point_count() const {
+        return points.size();
+    }
+    PointType point ( const std::size_t point_id ) const {
+        return points.point ( point_id );
+    }
+    double energy ( const std::size_t point_id ) const {
+        return points[point_id][full_dimension-1];
+    }
+    // The point without the dropped dimensions
+    PointType reduced_point ( const std::size_t point_id ) const {
+        return reduced_points.point ( point_id );
+    }
+    // Dimension of the reduced points, including the energy
+    std::size_t dimension() const {
+        return reduced_dimension;
+    }
+    // False until the points span the reduced space; there are no facets before that
+    bool full_dimensional() const {
+        return initialized;
+    }
+    // Facets whose normals point down in energy
+    std::vector<Facet> lower_facets() const;
+    double facet_area ( const Facet &facet ) const;
+private:
+    struct HullFacet {
+        std::vector<std::size_t> vertices;
+        std::vector<std::size_t> neighbors; // neighbors[i] is the facet opposite vertices[i]
+        PointType normal;
+        double offset;
+        double interior_distance; // normal . interior_point + offset, always negative
+        bool alive;
+        bool visible; // scratch flag for insert_point()
+    };
+    double const* reduced_coordinates ( const std::size_t point_id ) const {
+        return reduced_points[point_id];
+    }
+    double distance ( const HullFacet &facet, const std::size_t point_id ) const;
+    void try_initialize();
+    void insert_point ( const std::size_t point_id );
+    std::size_t find_visible_facet ( const std::size_t point_id ) const;
+    std::size_t new_facet ( const std::vector<std::size_t> &vertices );
+    void link_facets ( const std::vector<std::size_t> &facet_ids );
+    void calculate_hyperplane ( HullFacet &facet ) const;
+
+    std::size_t full_dimension;
+    std::size_t reduced_dimension;
+    std::vector<std::size_t> kept_dimensions; // reduced coordinate -> original coordinate
+    PointCloud<double> points;
+    PointCloud<double> reduced_points; // without the dropped dimensions
+    std::vector<std::size_t> pending_points; // added before the hull was full-dimensional
+    bool initialized;
+    bool lower_only;
+    PointType interior_point; // strictly inside the hull; fixes the orientation of the normals
+    double epsilon; // points closer than this to a facet are not outside of it
+    double max_coordinate;
+    std::vector<HullFacet> facets;
+    std::vector<std::size_t> free_facets; // ids of dead facets to reuse
+    std::vector<std::size_t> recent_facets; // created by the last insertion; checked first by the next one
+};
+
+} // namespace details
+} // namespace Optimizer
+#endif
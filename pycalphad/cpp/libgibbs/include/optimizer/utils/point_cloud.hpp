@@ -0,0 +1,111 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Contiguous storage for sets of points of the same dimension
+
+#ifndef INCLUDED_POINT_CLOUD
+#define INCLUDED_POINT_CLOUD
+
+#include <boost/assert.hpp>
+#include <vector>
+
+namespace Optimizer { namespace details {
+
+// Read-only view of one point, e.g., a row of a PointCloud
+template <typename CoordinateType = double>
+class PointView {
+public:
+    typedef CoordinateType const* const_iterator;
+    PointView ( CoordinateType const* const first, const std::size_t count ) : first ( first ), count ( count ) {}
+    const_iterator begin() const { return first; }
+    const_iterator end() const { return first + count; }
+    std::size_t size() const { return count; }
+    const CoordinateType& operator[] ( const std::size_t index ) const {
+        BOOST_ASSERT ( index < count );
+        return first[index];
+    }
+private:
+    CoordinateType const* first;
+    std::size_t count;
+};
+
+/* PointCloud stores points row by row in one array: point i starts at
+ * data() + i*dimension(). Sampling writes its points here, the convex hull
+ * reads them in place and ConvexHullMap refers to them by row index, so a
+ * point is no longer a separate heap allocation at every step.
+ * Pointers to rows are invalidated by anything that adds points.
+ */
+template <typename CoordinateType = double>
+class PointCloud {
+public:
+    typedef std::vector<CoordinateType> PointType;
+    PointCloud() : point_dimension ( 0 ), point_count ( 0 ) {}
+    explicit PointCloud ( const std::size_t dimension ) : point_dimension ( dimension ), point_count ( 0 ) {}
+
+    std::size_t dimension() const { return point_dimension; }
+    std::size_t size() const { return point_count; }
+    bool empty() const { return point_count == 0; }
+    std::size_t memory_bytes() const { return coordinates.capacity() * sizeof ( CoordinateType ); } // on the heap
+    void reserve ( const std::size_t points ) { coordinates.reserve ( points * point_dimension ); }
+    void clear() {
+        coordinates.clear();
+        point_count = 0;
+    }
+
+    CoordinateType* operator[] ( const std::size_t index ) {
+        BOOST_ASSERT ( index < point_count );
+        return coordinates.data() + index * point_dimension;
+    }
+    CoordinateType const* operator[] ( const std::size_t index ) const {
+        BOOST_ASSERT ( index < point_count );
+        return coordinates.data() + index * point_dimension;
+    }
+    CoordinateType* data() { return coordinates.data(); }
+    CoordinateType const* data() const { return coordinates.data(); }
+    PointView<CoordinateType> row ( const std::size_t index ) const {
+        return PointView<CoordinateType> ( ( *this ) [index], point_dimension );
+    }
+    // Copy of one point, for interfaces that still take a vector
+    PointType point ( const std::size_t index ) const {
+        CoordinateType const* const row = ( *this ) [index];
+        return PointType ( row, row + point_dimension );
+    }
+
+    // Adds zero points or drops points from the end, leaving exactly points points
+    void resize ( const std::size_t points ) {
+        coordinates.resize ( points * point_dimension, CoordinateType() );
+        point_count = points;
+    }
+    // Adds a zero point and returns it, to be filled in place
+    CoordinateType* push_back() {
+        coordinates.resize ( coordinates.size() + point_dimension, CoordinateType() );
+        ++point_count;
+        return ( *this ) [point_count-1];
+    }
+    void push_back ( CoordinateType const* const point ) {
+        coordinates.insert ( coordinates.end(), point, point + point_dimension );
+        ++point_count;
+    }
+    void push_back ( const PointType &point ) {
+        BOOST_ASSERT ( point.size() == point_dimension );
+        push_back ( point.data() );
+    }
+    void append ( const PointCloud<CoordinateType> &other ) {
+        BOOST_ASSERT ( other.point_dimension == point_dimension );
+        coordinates.insert ( coordinates.end(), other.coordinates.begin(), other.coordinates.end() );
+        point_count += other.point_count;
+    }
+private:
+    std::size_t point_dimension;
+    std::size_t point_count; // kept separately so zero-dimensional points can still be counted
+    std::vector<CoordinateType> coordinates;
+};
+
+} // namespace details
+} // namespace Optimizer
+
+#endif
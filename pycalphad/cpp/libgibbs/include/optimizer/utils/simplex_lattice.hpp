@@ -0,0 +1,144 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// On-demand enumeration of the combinations of subsimplices across sublattices
+
+#ifndef INCLUDED_SIMPLEX_LATTICE
+#define INCLUDED_SIMPLEX_LATTICE
+
+#include "libgibbs/include/optimizer/utils/ndsimplex.hpp"
+#include "libgibbs/include/optimizer/utils/point_cloud.hpp"
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <vector>
+
+/* SimplexLattice is the lazy counterpart of lattice_complex() for simplices:
+ * it holds the subsimplices of each sublattice and produces a combination
+ * (one subsimplex per sublattice) only when it is asked for.
+ * Combinations are numbered in the same order as lattice_complex(), with the
+ * last sublattice varying fastest. The centroid of a combination is the
+ * concatenation of the centroids (with dependent component) of its subsimplices;
+ * those are calculated once per subsimplex, so memory grows with the sum,
+ * not the product, of the subdivisions of each sublattice.
+ */
+class SimplexLattice {
+public:
+    explicit SimplexLattice ( std::vector<SimplexCollection> simplices_in_sublattices ) :
+        sublattice_simplices ( std::move ( simplices_in_sublattices ) ),
+        combination_count ( 1 ),
+        dimension ( 0 )
+    {
+        for ( const SimplexCollection &sublattice : sublattice_simplices ) {
+            BOOST_ASSERT ( !sublattice.empty() );
+            combination_count *= sublattice.size();
+            const std::size_t sublattice_dimension = sublattice.front().centroid_with_dependent_component().size();
+            std::vector<double> centroids;
+            centroids.reserve ( sublattice.size() * sublattice_dimension );
+            for ( const NDSimplex &simp : sublattice ) {
+                const std::vector<double> cent = simp.centroid_with_dependent_component();
+                BOOST_ASSERT ( cent.size() == sublattice_dimension );
+                centroids.insert ( centroids.end(), cent.begin(), cent.end() );
+            }
+            sublattice_centroids.emplace_back ( std::move ( centroids ) );
+            sublattice_dimensions.push_back ( sublattice_dimension );
+            dimension += sublattice_dimension;
+        }
+        if ( sublattice_simplices.empty() ) combination_count = 0;
+    }
+
+    // Number of combinations
+    std::size_t size() const {
+        return combination_count;
+    }
+    // Number of coordinates of a centroid
+    std::size_t point_dimension() const {
+        return dimension;
+    }
+
+    // The subsimplices of combination index, one per sublattice
+    SimplexCollection combination ( std::size_t index ) const {
+        BOOST_ASSERT ( index < combination_count );
+        SimplexCollection result ( sublattice_simplices.size() );
+        for ( std::size_t subl = sublattice_simplices.size(); subl-- > 0; ) {
+            const std::size_t count = sublattice_simplices[subl].size();
+            result[subl] = sublattice_simplices[subl][index % count];
+            index /= count;
+        }
+        return result;
+    }
+
+    // Write the index of the subsimplex of each sublattice in combination index to out
+    void subsimplex_indices ( std::size_t index, std::size_t* const out ) const {
+        BOOST_ASSERT ( index < combination_count );
+        for ( std::size_t subl = sublattice_simplices.size(); subl-- > 0; ) {
+            const std::size_t count = sublattice_simplices[subl].size();
+            out[subl] = index % count;
+            index /= count;
+        }
+    }
+
+    // Write the centroid of combination index to out, which has room for point_dimension() coordinates
+    void centroid ( std::size_t index, double* const out ) const {
+        BOOST_ASSERT ( index < combination_count );
+        std::size_t offset = dimension;
+        for ( std::size_t subl = sublattice_simplices.size(); subl-- > 0; ) {
+            const std::size_t count = sublattice_simplices[subl].size();
+            const std::size_t subl_dim = sublattice_dimensions[subl];
+            double const* const cent = &sublattice_centroids[subl][ ( index % count ) * subl_dim];
+            offset -= subl_dim;
+            std::copy ( cent, cent + subl_dim, out + offset );
+            index /= count;
+        }
+    }
+
+    // Call func ( first_index, chunk ) with the centroids of combinations
+    // [first_index, first_index + chunk.size()) for consecutive chunks of at most chunk_size points
+    // The same PointCloud is reused for every chunk
+    template <typename Func> void for_each_chunk ( const std::size_t chunk_size, Func &&func ) const {
+        BOOST_ASSERT ( chunk_size > 0 );
+        Optimizer::details::PointCloud<double> chunk ( dimension );
+        chunk.reserve ( std::min ( chunk_size, combination_count ) );
+        for ( std::size_t first = 0; first < combination_count; first += chunk_size ) {
+            const std::size_t last = std::min ( first + chunk_size, combination_count );
+            chunk.clear();
+            for ( std::size_t index = first; index < last; ++index ) {
+                centroid ( index, chunk.push_back() );
+            }
+            func ( first, static_cast<const Optimizer::details::PointCloud<double>&> ( chunk ) );
+        }
+    }
+    // As above, for only the combinations for which keep ( index ) is true, e.g., those in the fundamental
+    // domain of a symmetry; func ( indices, chunk ) is also given the index of every centroid in chunk
+    template <typename Keep, typename Func> void for_each_chunk_if ( const std::size_t chunk_size, Keep &&keep, Func &&func ) const {
+        BOOST_ASSERT ( chunk_size > 0 );
+        Optimizer::details::PointCloud<double> chunk ( dimension );
+        chunk.reserve ( std::min ( chunk_size, combination_count ) );
+        std::vector<std::size_t> indices;
+        indices.reserve ( std::min ( chunk_size, combination_count ) );
+        for ( std::size_t index = 0; index < combination_count; ++index ) {
+            if ( !keep ( index ) ) continue;
+            centroid ( index, chunk.push_back() );
+            indices.push_back ( index );
+            if ( indices.size() == chunk_size ) {
+                func ( static_cast<const std::vector<std::size_t>&> ( indices ), static_cast<const Optimizer::details::PointCloud<double>&> ( chunk ) );
+                chunk.clear();
+                indices.clear();
+            }
+        }
+        if ( !indices.empty() ) {
+            func ( static_cast<const std::vector<std::size_t>&> ( indices ), static_cast<const Optimizer::details::PointCloud<double>&> ( chunk ) );
+        }
+    }
+private:
+    std::vector<SimplexCollection> sublattice_simplices;
+    std::vector<std::vector<double>> sublattice_centroids; // centroids of the subsimplices, row by row
+    std::vector<std::size_t> sublattice_dimensions;
+    std::size_t combination_count;
+    std::size_t dimension;
+};
+
+#endif
@@ -0,0 +1,65 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#ifndef PHASE_BOUNDARY_INCLUDED
+#define PHASE_BOUNDARY_INCLUDED
+
+// declaration for following the boundaries of a two-phase region
+
+#include <string>
+#include <vector>
+#include "libgibbs/include/conditions.hpp"
+
+class Database;
+class EquilibriumFactory;
+
+// One tie-line of a two-phase region: the coordinates (step variable, composition variable) of both of its ends
+// A state variable has the same value at both ends
+struct TieLine {
+	double step; // value of the step variable
+	double first[2]; // end in the first phase of PhaseBoundary::phases
+	double second[2];
+};
+
+// The two boundaries of a two-phase region, as the ends of its tie-lines
+struct PhaseBoundary {
+	std::string step_variable;
+	std::string composition_variable;
+	std::vector<std::string> phases; // the two phases followed, sorted
+	std::vector<TieLine> tie_lines; // in the order of the steps
+	// If the region ended before the limit: the two phases above together with those found just past its end,
+	// e.g., the three phases of an invariant reaction; only the two where the region closes, e.g., at a congruent point
+	std::vector<std::string> end_phases;
+	double end_step; // value of the step variable at the end, within the tolerance of trace()
+	bool reached_limit() const { return end_phases.empty(); }
+};
+
+/*
+ * BoundaryTracer follows a two-phase region along a step variable, e.g., T for a binary diagram or a
+ * second X(component) for an isothermal ternary section, instead of searching a grid for its boundaries.
+ * The ends of the tie-line of a two-phase equilibrium are points on both boundaries, with the fraction of
+ * the other phase at zero, so each step is one equilibrium calculation inside the region:
+ *  - predictor: the tie-line ends at the next step are extrapolated from the last two tie-lines, and the
+ *    overall composition is set halfway between them;
+ *  - corrector: the equilibrium there, warm-started from the previous one, gives the actual tie-line.
+ * If the stable phases differ from the two followed, the step is halved until it is below the tolerance;
+ * the phases found there are reported as the end of the region. After a good step the step grows back.
+ * Names of variables are as for Mesh axes: "T", "P" or "X(component)".
+ */
+class BoundaryTracer {
+public:
+	BoundaryTracer(const std::string &step_variable, const std::string &composition_variable);
+	// start must be a two-phase equilibrium; its composition_variable must be a mole fraction
+	// Steps go from the start value of the step variable towards limit
+	PhaseBoundary trace(const Database &DB, EquilibriumFactory &factory, const evalconditions &start,
+		double step, double limit, double tolerance) const;
+private:
+	const std::string step_variable;
+	const std::string composition_variable;
+};
+
+#endif
@@ -0,0 +1,102 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#ifndef PHASE_EVALUATOR_INCLUDED
+#define PHASE_EVALUATOR_INCLUDED
+
+// declaration for evaluating the energy of one phase, or of one serialized expression, over arrays of points, and its C interface
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/bimap.hpp>
+#include "libgibbs/include/compositionset.hpp"
+#include "libgibbs/include/utils/compiled_expr.hpp"
+
+class Database;
+
+/*
+ * PhaseEvaluator compiles the models of one phase once and evaluates its molar Gibbs energy,
+ * and optionally the gradient with respect to the site fractions, over caller-owned arrays, e.g.,
+ * the points of an energy surface. The site fractions of a point are in the order of layout():
+ * sublattice by sublattice, and by species name within each sublattice.
+ * evaluate() may be called by several threads at once.
+ */
+class PhaseEvaluator {
+public:
+	// components as for evalconditions::elements, e.g., including "VA"
+	PhaseEvaluator(const Database &DB, const std::string &phase, const std::vector<std::string> &components);
+	const SublatticeLayout& layout() const { return compset.sublattice_layout(); }
+	std::size_t variable_count() const { return compset.get_variable_map().size(); }
+	// Point i starts at points + i*stride (stride >= variable_count()); energies has npoints entries and
+	// gradients, unless it is null, npoints*variable_count() entries, row-major
+	// The points are split into contiguous blocks over threads (0 for one per core)
+	void evaluate(const std::map<char,double> &statevars, const double *points, std::size_t npoints, std::size_t stride,
+		double *energies, double *gradients = nullptr, std::size_t threads = 1) const;
+private:
+	std::vector<std::string> elements;
+	CompositionSet compset;
+};
+
+/*
+ * ExpressionEvaluator compiles an expression built elsewhere, e.g., the Model of pycalphad, and evaluates
+ * it as PhaseEvaluator does, without a database. data holds, in the format of ASTWriter, a table of
+ * symbols (ASTWriter::write(const ASTSymbolMap&)) followed by the expression; the symbols are inlined
+ * where the expression names them, so subexpressions shared through them are compiled once.
+ * Names of one character are state variables; every other name must be one of variables, which gives
+ * the order of the values of a point. Throws malformed_object_error if data is invalid and
+ * unknown_symbol_error if the expression refers to an unlisted variable.
+ */
+class ExpressionEvaluator {
+public:
+	ExpressionEvaluator(const char *data, std::size_t size, const std::vector<std::string> &variables);
+	std::size_t variable_count() const { return variable_indices.size(); }
+	std::size_t instruction_count() const { return program.size(); }
+	// As PhaseEvaluator::evaluate(); the expression is specialized to statevars once per call
+	void evaluate(const std::map<char,double> &statevars, const double *points, std::size_t npoints, std::size_t stride,
+		double *values, double *gradients = nullptr, std::size_t threads = 1) const;
+private:
+	CompiledSlotTable slots;
+	CompiledExpression program;
+	boost::bimap<std::string, int> variable_indices;
+};
+
+/*
+ * C interface to PhaseEvaluator and ExpressionEvaluator, for loading libgibbs from other languages without a binding
+ * library, e.g., with Python's ctypes (see pycalphad/libgibbs.py). All arrays belong to the caller
+ * and are used in place. Functions that can fail return null or non-zero and write a message to
+ * error (of error_size bytes, which may be 0).
+ */
+extern "C" {
+	struct libgibbs_phase_evaluator;
+	// tdb_path is read with libtdb; components as for PhaseEvaluator
+	libgibbs_phase_evaluator* libgibbs_phase_evaluator_create(const char *tdb_path, const char *phase,
+		const char *const *components, std::size_t component_count, char *error, std::size_t error_size);
+	void libgibbs_phase_evaluator_destroy(libgibbs_phase_evaluator *evaluator);
+	std::size_t libgibbs_phase_evaluator_variable_count(const libgibbs_phase_evaluator *evaluator);
+	// Sublattice index and species of each site fraction, in the order of the points
+	std::size_t libgibbs_phase_evaluator_sublattice(const libgibbs_phase_evaluator *evaluator, std::size_t variable);
+	const char* libgibbs_phase_evaluator_species(const libgibbs_phase_evaluator *evaluator, std::size_t variable);
+	// As PhaseEvaluator::evaluate(); the state variables are T and P
+	int libgibbs_phase_evaluator_evaluate(const libgibbs_phase_evaluator *evaluator, double T, double P,
+		const double *points, std::size_t npoints, std::size_t stride, double *energies, double *gradients,
+		std::size_t threads, char *error, std::size_t error_size);
+
+	struct libgibbs_expression_evaluator;
+	// data and variables as for ExpressionEvaluator
+	libgibbs_expression_evaluator* libgibbs_expression_evaluator_create(const char *data, std::size_t size,
+		const char *const *variables, std::size_t variable_count, char *error, std::size_t error_size);
+	void libgibbs_expression_evaluator_destroy(libgibbs_expression_evaluator *evaluator);
+	std::size_t libgibbs_expression_evaluator_instruction_count(const libgibbs_expression_evaluator *evaluator);
+	// As ExpressionEvaluator::evaluate(); the state variables are T and P
+	int libgibbs_expression_evaluator_evaluate(const libgibbs_expression_evaluator *evaluator, double T, double P,
+		const double *points, std::size_t npoints, std::size_t stride, double *values, double *gradients,
+		std::size_t threads, char *error, std::size_t error_size);
+}
+
+#endif
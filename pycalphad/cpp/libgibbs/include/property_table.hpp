@@ -0,0 +1,107 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#ifndef PROPERTY_TABLE_INCLUDED
+#define PROPERTY_TABLE_INCLUDED
+
+// declaration for tables of equilibrium properties
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Database;
+class EquilibriumFactory;
+class Mesh;
+struct MeshResult;
+
+/*
+ * A PropertyTable holds equilibrium properties on the grid of a Mesh solved by Mesh::solve_adaptive(), for
+ * simulations which need them at far more points than can be calculated. Its columns are the Gibbs energy
+ * "GM", the chemical potential "MU(element)" of every element, and the fraction "NP(phase)" and mole fractions
+ * "X(phase,element)" of every composition set, all as in CompactEquilibriumResult and evaluate_properties().
+ * Each solved point also has a region: its set of stable phases (no_region if it failed).
+ *
+ * Values between the grid points are interpolated within the cell of the adaptive grid containing them. Where
+ * the corners of the cell are all in one region the interpolation uses all of them; where they are not, which
+ * is only in cells one grid interval wide or with failed corners, the point is taken to be in the region of the corner with the
+ * largest multilinear weight, and only the corners in that region are used, with their weights renormalized.
+ * Values are therefore never blended across a phase boundary, but within one grid interval of a boundary the
+ * boundary is only as accurate as the grid. Coordinates are interpolated linearly in their values, also on
+ * logarithmic and inverse axes.
+ *
+ * The table is a single block of memory, laid out as the file written by write(), so that a table read back
+ * is used straight from a read-only memory mapping and the processes of a simulation share it. It is written
+ * in the byte order of the machine. A table is immutable, and copies share their memory, so any number of
+ * threads may interpolate in one at once; interpolate() neither allocates nor locks.
+ */
+class PropertyTable {
+public:
+	enum class Interpolation {
+		MULTILINEAR, // all 2^n corners of the cell
+		SIMPLEX // the n+1 corners of the simplex of the cell containing the point (Kuhn triangulation)
+	};
+	static const std::size_t no_region = std::numeric_limits<std::size_t>::max();
+	static const std::size_t max_axes = 8;
+
+	// Solve mesh with Mesh::solve_adaptive() and tabulate the result; warm starts are as in solve_adaptive()
+	static PropertyTable build(const Mesh &mesh, const Database &DB, EquilibriumFactory &factory,
+		std::size_t coarse_stride = 8, std::size_t threads = 0);
+	// Tabulate a result of Mesh::solve_adaptive() which kept its solutions
+	// Cells are found through blocks of block_size grid intervals on each axis; the coarse_stride of the solve suits best
+	explicit PropertyTable(const MeshResult &result, std::size_t block_size = 8);
+	// Map a table written by write(); throws malformed_object_error if the file is not one
+	explicit PropertyTable(const std::string &path);
+	// Replaces the file atomically, as other processes may be reading it
+	void write(const std::string &path) const;
+
+	const std::vector<std::string>& axis_names() const { return axes; } // as MeshResult::axis_names
+	const std::vector<std::vector<double>>& axis_values() const { return grid_values; }
+	const std::vector<std::string>& column_names() const { return columns; }
+	// Throws unknown_symbol_error if there is no such column
+	std::size_t column(const std::string &name) const;
+	std::size_t region_count() const { return regions.size(); }
+	// The stable phases of a region, sorted, as CompactEquilibriumResult::stable_phases()
+	const std::vector<std::string>& region_phases(std::size_t region) const { return regions.at(region); }
+	std::size_t point_count() const { return points; }
+	std::size_t cell_count() const { return cells; }
+	std::size_t size_in_bytes() const { return image_size; }
+
+	// Interpolate every column at coordinates, one per axis, into values, one per column
+	// Returns the region of the point, or no_region, with values NaN, if it is outside the grid or all the
+	// corners of its cell failed
+	std::size_t interpolate(const double *coordinates, double *values, Interpolation method = Interpolation::MULTILINEAR) const;
+private:
+	struct Storage;
+	void attach(std::shared_ptr<const Storage> backing);
+	// The cell of the grid interval with lower corner interval (an index on each axis)
+	std::uint32_t find_cell(const std::size_t *interval) const;
+
+	std::shared_ptr<const Storage> storage;
+	const char *image;
+	std::size_t image_size;
+	std::vector<std::string> axes;
+	std::vector<std::vector<double>> grid_values;
+	std::vector<std::string> columns;
+	std::vector<std::vector<std::string>> regions;
+	std::size_t block_size;
+	std::vector<std::size_t> block_counts; // on each axis
+	std::size_t points;
+	std::size_t cells;
+	std::size_t cell_words; // region, lower and upper grid index on each axis, then the point of each corner
+	// Pointers into the image
+	const double *point_values; // column_names().size() of each point
+	const std::uint32_t *point_regions;
+	const std::uint32_t *cell_data; // cell_words of each cell
+	const std::uint32_t *block_cells; // of each block: its cell, or block_mixed plus the offset of its cells in interval_cells
+	const std::uint32_t *interval_cells; // of each grid interval of a block of several cells, row-major within the block
+};
+
+#endif
@@ -0,0 +1,69 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#ifndef SCHEIL_INCLUDED
+#define SCHEIL_INCLUDED
+
+// declaration for Scheil-Gulliver solidification
+
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+#include "libgibbs/include/conditions.hpp"
+
+class Database;
+class EquilibriumFactory;
+
+// The state after one temperature step of a Scheil-Gulliver solidification
+struct ScheilStep {
+	double T;
+	double liquid_fraction; // remaining liquid, as a fraction of the moles of the initial liquid
+	double solid_fraction() const { return 1 - liquid_fraction; }
+	std::vector<std::string> phases; // stable at this step, sorted, as CompactEquilibriumResult::stable_phases()
+	std::map<std::string,double> liquid_composition; // mole fraction of each element of the remaining liquid
+	std::map<std::string,double> solid_amounts; // moles of each solid phase formed so far, per mole of initial liquid
+};
+
+// The solidification path, from the start temperature to where it ended
+struct ScheilCurve {
+	std::vector<ScheilStep> steps; // in the order of decreasing temperature
+	// Why the calculation ended: the remaining liquid fell below the limit, the minimum temperature was reached,
+	// or an equilibrium failed below the minimum step
+	enum class Reason { LIQUID_LIMIT, MINIMUM_TEMPERATURE, STEP_FAILED } end_reason;
+	// One tab-separated line per step: T, solid fraction, liquid fraction, then the stable phases
+	// The first line names the columns
+	void write(std::ostream &stream) const;
+};
+
+/*
+ * ScheilSimulator follows a Scheil-Gulliver solidification: at each temperature step the remaining liquid
+ * is brought to equilibrium, the solids formed in the step are set aside, and the liquid composition becomes
+ * the overall composition of the next step. All steps use the same EquilibriumFactory, so the models are built
+ * once, and each equilibrium is warm-started from the previous one.
+ * The temperature step is halved while the stable phases differ from those of the previous step, down to
+ * min_step, so that the temperature at which a phase appears is found to within min_step; it is also halved
+ * while more than max_solidified of the remaining liquid solidifies in one step. After a step without either,
+ * the step grows back to step.
+ * liquid_phase is the name of the liquid in the database (its composition sets are named liquid_phase#n).
+ */
+class ScheilSimulator {
+public:
+	typedef std::function<void(const ScheilStep &)> StepCallback;
+	explicit ScheilSimulator(const std::string &liquid_phase);
+	// Solidify the liquid of composition start.xfrac from start.statevars['T'] down to at most min_T,
+	// until less than liquid_limit of the liquid remains
+	// on_step, if set, receives every accepted step as soon as it is calculated, e.g., to stream the curve
+	ScheilCurve simulate(const Database &DB, EquilibriumFactory &factory, const evalconditions &start,
+		double step, double min_step, double min_T, double liquid_limit = 1e-3, double max_solidified = 0.1,
+		const StepCallback &on_step = StepCallback()) const;
+private:
+	const std::string liquid_phase;
+};
+
+#endif
@@ -12,8 +12,10 @@
 
 #include "libgibbs/include/utils/ast_caching_fwd.hpp"
 #include "libgibbs/include/utils/math_expr.hpp"
+#include "libgibbs/include/utils/memory_footprint.hpp"
 #include <boost/spirit/include/support_utree.hpp>
 #include <map>
+#include <mutex>
 #include <string>
 
 /*
@@ -24,27 +26,48 @@
  * EXCEPT this time we save the result tree to a cache map for each variable
  * Future calls to differentiate "TAU" will hit the cache instead of the expensive call
  * This should be useful for trees that tend to repeat in models
+ * differentiate() may be called from several threads at once; the cache is guarded by a mutex,
+ * which is not held while differentiating, so symbols that refer to each other cannot deadlock
  */
 
 struct CachedAbstractSyntaxTree {
 	CachedAbstractSyntaxTree(boost::spirit::utree const &ut) : ast(ut) { }
+	CachedAbstractSyntaxTree(CachedAbstractSyntaxTree const &other) : ast(other.ast) {
+		std::lock_guard<std::mutex> lock(other.cache_mutex);
+		differentiated_ast_cache = other.differentiated_ast_cache;
+	}
 	boost::spirit::utree const& get() const { return ast; };
-	boost::spirit::utree const& differentiate(std::string const &variable, ASTSymbolMap const &symbols) const {
-		const auto cache_find = differentiated_ast_cache.find(variable);
-		const auto cache_end = differentiated_ast_cache.end();
-		if (cache_find != cache_end) {
-			// cache hit: return the previously calculated AST
-			return cache_find->second;
+	// The AST and the derivatives cached so far (see memory_footprint.hpp)
+	MemoryUsage memory_usage() const {
+		MemoryUsage usage = utree_memory_usage(ast);
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		for (auto i = differentiated_ast_cache.cbegin(); i != differentiated_ast_cache.cend(); ++i) {
+			usage += MemoryUsage(sizeof(*i) + tree_node_overhead + string_heap_bytes(i->first), 0);
+			usage += utree_memory_usage(i->second);
 		}
-		else {
-			// cache miss: perform the differentiation and store the result
-			auto result = differentiated_ast_cache.emplace(variable, differentiate_utree(ast, variable, symbols));
-			return result.first->second; // return const
+		return usage;
+	}
+	boost::spirit::utree const& differentiate(std::string const &variable, ASTSymbolMap const &symbols) const {
+		{
+			std::lock_guard<std::mutex> lock(cache_mutex);
+			const auto cache_find = differentiated_ast_cache.find(variable);
+			if (cache_find != differentiated_ast_cache.end()) {
+				// cache hit: return the previously calculated AST
+				// map entries are never removed, so the reference stays valid after unlocking
+				return cache_find->second;
+			}
 		}
+		// cache miss: perform the differentiation and store the result
+		// if another thread got there first, its (identical) result is kept
+		boost::spirit::utree result_tree = differentiate_utree(ast, variable, symbols);
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		auto result = differentiated_ast_cache.emplace(variable, result_tree);
+		return result.first->second; // return const
 	}
 private:
 	const boost::spirit::utree ast; // the cached AST
 	mutable std::map<std::string,const boost::spirit::utree> differentiated_ast_cache; // cached AST w.r.t variables
+	mutable std::mutex cache_mutex; // guards differentiated_ast_cache
 };
 
 #endif
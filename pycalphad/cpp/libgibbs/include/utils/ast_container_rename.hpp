@@ -49,6 +49,22 @@ inline std::vector<std::string> ast_copy_with_renamed_phase (
     return new_container;
 }
 
+// Rename a container of indexed variable names with a new phase name; the order is kept
+inline std::vector<std::pair<std::string,int>> ast_copy_with_renamed_phase (
+    const std::vector<std::pair<std::string,int>> &old_container,
+    const std::string &old_phase_name,
+    const std::string &new_phase_name
+)
+{
+    std::vector<std::pair<std::string,int>> new_container;
+    for ( const auto &old_record : old_container ) {
+        std::string entry_name (old_record.first);
+        boost::algorithm::ireplace_first ( entry_name, old_phase_name, new_phase_name );
+        new_container.emplace_back ( std::move( entry_name ), old_record.second );
+    }
+    return new_container;
+}
+
 // Rename a map of abstract syntax trees with a new phase name
 template<typename IndexType,typename EntryType>
 std::map<IndexType, EntryType> ast_copy_with_renamed_phase (
@@ -0,0 +1,65 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// ast_serialization.hpp -- compact binary format for utree ASTs and the data built from them
+
+#ifndef INCLUDED_AST_SERIALIZATION
+#define INCLUDED_AST_SERIALIZATION
+
+#include "libgibbs/include/utils/ast_caching_fwd.hpp"
+#include <boost/spirit/include/support_utree.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Values are written back to back without any padding or alignment, in the byte order of the
+ * machine writing them; doubles are stored bit for bit, so a tree read back evaluates exactly
+ * like the original one. Only nil, bool, int, double, string, symbol and list nodes are
+ * supported, which is everything the model builders and differentiate_utree() produce.
+ * ASTReader works on any range of bytes, so a file can be read straight from a memory mapping.
+ */
+
+class ASTWriter {
+public:
+    void write ( boost::spirit::utree const &ut );
+    void write ( std::string const &str );
+    void write ( double const value );
+    void write_integer ( std::int64_t const value );
+    void write_size ( std::size_t const value );
+    void write ( ASTSymbolMap const &symbols );
+    std::string const& data() const {
+        return buffer;
+    }
+    // 64-bit FNV-1a hash of everything written so far
+    std::uint64_t hash() const;
+private:
+    void write_bytes ( void const* const bytes, std::size_t const count );
+    std::string buffer;
+};
+
+class ASTReader {
+public:
+    ASTReader ( char const* const begin, char const* const end ) : position ( begin ), end ( end ) { }
+    // All read functions throw malformed_object_error if the data is truncated or invalid
+    boost::spirit::utree read_utree();
+    std::string read_string();
+    double read_double();
+    std::int64_t read_integer();
+    std::size_t read_size();
+    ASTSymbolMap read_symbols();
+    bool at_end() const {
+        return position == end;
+    }
+private:
+    void read_bytes ( void* const bytes, std::size_t const count );
+    char const* position;
+    char const* const end;
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,76 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Streaming columnar output of result rows, e.g., equilibria of a map or points of an energy surface
+
+#ifndef INCLUDED_COLUMN_WRITER
+#define INCLUDED_COLUMN_WRITER
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* ColumnWriter appends rows to a column store: a directory with one flat file per column, so that a
+ * reader can memory-map any column whole (see pycalphad/io/columns.py) and no writer or reader ever
+ * holds all rows. The directory holds
+ *  - columns.txt: the line "libgibbs columns 1", then "file<TAB>type<TAB>name" for each column;
+ *  - N.f64 for value column N: doubles in native (little-endian on all supported platforms) byte order;
+ *  - N.u32 for label column N: uint32 codes, and N.labels: the label of each code, one per line.
+ * The number of rows is the size of any data file over its item size. Rows are buffered, chunk_rows at
+ * a time, and written by flush(); what has been flushed can be read while more rows are appended.
+ * A ColumnWriter is not thread-safe.
+ */
+class ColumnWriter {
+public:
+    // directory must exist; column files already in it are overwritten
+    // Labels, e.g., phase names, may not contain newlines
+    ColumnWriter (
+        std::string const &directory,
+        std::vector<std::string> const &value_columns,
+        std::vector<std::string> const &label_columns = std::vector<std::string>(),
+        std::size_t const chunk_rows = 65536 );
+    ColumnWriter ( ColumnWriter const & ) = delete;
+    ColumnWriter& operator= ( ColumnWriter const & ) = delete;
+    ~ColumnWriter(); // flushes
+
+    // One row: value_columns.size() values and label_columns.size() labels, in the order of the constructor
+    void append ( double const* const values, std::vector<std::string> const &labels = std::vector<std::string>() );
+    void append ( std::vector<double> const &values, std::vector<std::string> const &labels = std::vector<std::string>() ) {
+        append ( values.data(), labels );
+    }
+    // Write the buffered rows; throws if a file cannot be written
+    void flush();
+    std::size_t rows() const {
+        return row_count;
+    }
+    std::size_t value_column_count() const {
+        return value_buffers.size();
+    }
+    std::size_t label_column_count() const {
+        return label_buffers.size();
+    }
+private:
+    struct LabelColumn {
+        std::unique_ptr<std::ofstream> codes;
+        std::unique_ptr<std::ofstream> labels;
+        std::unordered_map<std::string,std::uint32_t> dictionary;
+    };
+    std::size_t chunk;
+    std::size_t row_count;
+    std::size_t buffered_rows;
+    std::vector<std::unique_ptr<std::ofstream>> value_files;
+    std::vector<std::vector<double>> value_buffers;
+    std::vector<LabelColumn> label_files;
+    std::vector<std::vector<std::uint32_t>> label_buffers;
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
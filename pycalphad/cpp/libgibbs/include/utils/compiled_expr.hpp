@@ -0,0 +1,243 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// compiled_expr.hpp -- flat, register-based programs compiled from utree ASTs
+
+#ifndef INCLUDED_COMPILED_EXPR
+#define INCLUDED_COMPILED_EXPR
+
+#include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/utils/ast_caching_fwd.hpp"
+#include <boost/spirit/include/support_utree.hpp>
+#include <boost/bimap.hpp>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * process_utree() walks the AST on every call, comparing operator strings
+ * and looking up every variable in the index map at every node.
+ * A CompiledExpression does that work once: the AST (with all special symbols
+ * inlined) is flattened into a linear instruction stream operating on numbered
+ * registers. Variables and state variables are referred to by slot numbers.
+ * A CompiledBinding resolves all slots of a CompiledSlotTable against an index
+ * map once per call, so that a family of expressions sharing the same table
+ * (e.g., all the derivatives of a CompositionSet) can be evaluated without
+ * touching any strings or maps.
+ * evaluate_batch() runs each instruction over a whole block of points before moving
+ * on to the next one. Registers are laid out structure-of-arrays, one lane per point,
+ * so the arithmetic kernels are simple fixed-length loops the compiler can vectorize.
+ * While compiling, identical operations are emitted only once (common subexpression
+ * elimination, which turns the inlined symbol trees into a DAG), operations on constants
+ * are folded and unused instructions are removed. Instructions that depend only on
+ * constants and state variables are marked; they are computed once per batch in
+ * evaluate_batch() and skipped when differentiating.
+ * evaluate_jet() computes the value, the gradient and the Hessian in one call by automatic
+ * differentiation of the program, so no separate derivative ASTs need to be compiled.
+ * specialize() partially evaluates a program for the state variables of one binding: every
+ * instruction depending only on constants and state variables becomes a constant, and range
+ * checks on them select their piece once, so only the variable-dependent arithmetic is left.
+ * Thread safety: slot tables, programs and bindings are not modified after they are built,
+ * so any number of threads may evaluate them at once. evaluate() and evaluate_batch() keep
+ * their registers on the caller's stack; evaluate_jet() writes only to the CompiledJet it is
+ * given, which also holds its scratch space. Use one CompiledJet per thread.
+ */
+
+// Variables and state variables referenced by a family of compiled expressions
+struct CompiledSlotTable {
+    std::vector<std::string> variables; // slot -> variable name
+    std::vector<char> statevars; // slot -> state variable (T, P, etc.)
+    std::size_t variable_slot ( std::string const &name );
+    std::size_t statevar_slot ( char const name );
+};
+
+class CompiledExpression;
+
+// Resolution of all slots of a CompiledSlotTable for one set of conditions and one index map
+struct CompiledBinding {
+    CompiledBinding() : slots ( nullptr ) { }
+    CompiledBinding (
+        CompiledSlotTable const &slot_table,
+        evalconditions const &conditions,
+        boost::bimap<std::string, int> const &variable_indices );
+    int variable_index ( std::size_t const slot ) const; // throws if the variable is not in the index map
+    CompiledSlotTable const* slots;
+    std::vector<int> variable_indices; // slot -> index into the variable array (-1 if unbound)
+    std::vector<double> statevar_values; // slot -> current value of the state variable
+    std::vector<bool> statevar_bound; // slot -> was the state variable specified in the conditions?
+    // Programs specialized to statevar_values by whoever made the binding (e.g., CompositionSet::bind()); may be null
+    std::shared_ptr<const std::vector<CompiledExpression>> specialized;
+    // Inputs of kernels that replace some of those programs for statevar_values (e.g., CompositionSet's FixedShapeModel); may be null
+    std::shared_ptr<const std::vector<double>> kernel_constants;
+    // Programs of the inputs of such kernels that depend on the variables (e.g., the Curie temperature of
+    // CompositionSet's MagneticKernel), specialized to statevar_values; may be null
+    std::shared_ptr<const std::vector<CompiledExpression>> kernel_programs;
+};
+
+// Value and derivatives of compiled expressions with respect to all variable slots of a CompiledSlotTable
+struct CompiledJet {
+    CompiledJet() : value ( 0 ) { }
+    CompiledJet ( std::size_t const variable_count, bool const with_hessian ) :
+        value ( 0 ),
+        gradient ( variable_count, 0 ),
+        hessian ( with_hessian ? variable_count * variable_count : 0, 0 ) { }
+    double value;
+    std::vector<double> gradient; // slot -> first derivative
+    std::vector<double> hessian; // dense and symmetric; slot1 * gradient.size() + slot2 -> second derivative
+    // Scratch space of evaluate_jet(), kept so that repeated calls do not allocate
+    std::vector<double> registers;
+    std::vector<double> adjoints;
+    std::vector<double> tangents;
+    std::vector<double> adjoint_tangents;
+    std::vector<std::size_t> trace;
+    // Slot-indexed scratch space of CompositionSet::evaluate_internal_objective_hessian_vector()
+    std::vector<double> direction;
+    std::vector<double> product;
+    // Jets of the variable inputs of kernels, e.g., the parameters of CompositionSet's MagneticKernel
+    std::vector<CompiledJet> nested;
+};
+
+enum class CompiledOpCode : unsigned char {
+    CONSTANT, // reg[dest] = constant
+    VARIABLE, // reg[dest] = x[binding.variable_indices[arg1]]
+    STATEVAR, // reg[dest] = binding.statevar_values[arg1]
+    COPY, // reg[dest] = reg[arg1]
+    ADD, // reg[dest] = reg[arg1] + reg[arg2]
+    SUBTRACT, // reg[dest] = reg[arg1] - reg[arg2]
+    NEGATE, // reg[dest] = -reg[arg1]
+    MULTIPLY, // reg[dest] = reg[arg1] * reg[arg2]
+    DIVIDE, // reg[dest] = reg[arg1] / reg[arg2]
+    POWER, // reg[dest] = reg[arg1] ** reg[arg2]
+    LN, // reg[dest] = ln(reg[arg1])
+    EXP, // reg[dest] = exp(reg[arg1])
+    RANGE_CHECK, // jump to instruction dest unless reg[arg2] <= reg[arg1] < reg[arg3]
+    JUMP // jump to instruction dest
+};
+
+struct CompiledInstruction {
+    CompiledOpCode op;
+    std::size_t dest;
+    std::size_t arg1;
+    std::size_t arg2;
+    std::size_t arg3;
+    double constant;
+    bool variable_dependent; // false if the result depends only on constants and state variables
+    bool hoisted; // not variable_dependent and executed on every path through the program
+};
+
+// Size of a compiled program compared to the AST it was compiled from
+struct CompiledStatistics {
+    CompiledStatistics() : ast_nodes ( 0 ), instructions ( 0 ), shared ( 0 ), folded ( 0 ), hoisted ( 0 ) { }
+    CompiledStatistics& operator+= ( CompiledStatistics const &other );
+    std::size_t ast_nodes; // nodes visited in the AST, counting inlined symbols every time they appear
+    std::size_t instructions; // instructions in the final program
+    std::size_t shared; // operations replaced by an identical earlier operation
+    std::size_t folded; // operations removed by constant folding or algebraic identities, or by specialize()
+    std::size_t hoisted; // instructions depending only on constants and state variables
+};
+
+class CompiledExpression {
+public:
+    CompiledExpression() : register_count ( 0 ), result_register ( 0 ) { }
+    // Compile ast; special symbols are inlined and new variables are added to slots
+    CompiledExpression (
+        boost::spirit::utree const &ast,
+        ASTSymbolMap const &symbols,
+        CompiledSlotTable &slots );
+    double evaluate ( CompiledBinding const &binding, double const* const x ) const;
+    // Evaluate npoints points at once; point i starts at x + i*stride and its value is added to out[i]
+    void evaluate_batch (
+        CompiledBinding const &binding,
+        double const* const x,
+        std::size_t const npoints,
+        std::size_t const stride,
+        double* const out ) const;
+    // Same as above in single precision, with twice as many points per block, e.g., for ranking sampled points
+    // Constants and state variables are rounded to float; each operation then has a relative error of at most
+    // 2^-24, so a value accumulated over k operations from terms of total magnitude S is off by about k * 2^-24 * S.
+    // Programs with constants outside the range of float, and blocks whose range checks diverge, are evaluated in
+    // double precision and rounded
+    void evaluate_batch (
+        CompiledBinding const &binding,
+        float const* const x,
+        std::size_t const npoints,
+        std::size_t const stride,
+        float* const out ) const;
+    // Add the value, gradient and (optionally) Hessian to jet, which must be sized for binding's slot table
+    void evaluate_jet (
+        CompiledBinding const &binding,
+        double const* const x,
+        CompiledJet &jet,
+        bool const with_hessian = true ) const;
+    // Add the product of the Hessian with direction to product (both indexed by variable slot), in one forward
+    // and one reverse sweep, without forming the Hessian; jet only provides the scratch space
+    void evaluate_hessian_vector (
+        CompiledBinding const &binding,
+        double const* const x,
+        double const* const direction,
+        double* const product,
+        CompiledJet &jet ) const;
+    // Copy of this program for the state variables of binding, which it may then be evaluated with;
+    // operations that would raise an error, e.g., on unbound state variables, are left to run time
+    CompiledExpression specialize ( CompiledBinding const &binding ) const;
+    std::size_t size() const {
+        return program.size();
+    }
+    bool empty() const {
+        return program.empty();
+    }
+    // false if the value depends only on constants and state variables, i.e., is the same for every x
+    bool variable_dependent() const;
+    CompiledStatistics const& statistics() const {
+        return stats;
+    }
+    // Heap bytes of the program (see memory_footprint.hpp)
+    std::size_t memory_bytes() const {
+        return program.capacity() * sizeof ( CompiledInstruction );
+    }
+    // The program itself, e.g., for translation to native code (native_kernel.hpp)
+    std::vector<CompiledInstruction> const& instructions() const {
+        return program;
+    }
+    std::size_t registers() const {
+        return register_count;
+    }
+    std::size_t result() const {
+        return result_register; // register holding the value once the program has run
+    }
+private:
+    struct CompileContext;
+    // Run the program once; the positions of all executed non-jump instructions are appended to trace
+    double execute (
+        CompiledBinding const &binding,
+        double const* const x,
+        double* const reg,
+        std::vector<std::size_t>* const trace ) const;
+    // Run the program over one block of points; returns false if a range check
+    // takes different branches for different points in the block
+    // If hoisted_pass is true, only the hoisted instructions are run; otherwise they are skipped
+    template <typename ValueType>
+    bool evaluate_lanes ( CompiledBinding const &binding, ValueType const* const* const lane_points, ValueType* const reg, bool const hoisted_pass ) const;
+    // false if a constant of the program is not a normal float
+    bool single_precision_safe() const;
+    std::size_t compile ( boost::spirit::utree const &ut, CompileContext &context );
+    std::size_t compile_list ( boost::spirit::utree const &ut, CompileContext &context );
+    std::size_t compile_reference ( std::string const &name, CompileContext &context );
+    // emit a pure operation; returns the register holding its result, which may be an existing one
+    std::size_t emit ( CompileContext &context, CompiledOpCode const op, std::size_t const arg1 = 0, std::size_t const arg2 = 0, double const constant = 0 );
+    // emit an instruction with an explicit destination (register or jump target); returns its position
+    std::size_t emit_to ( CompiledOpCode const op, std::size_t const dest, std::size_t const arg1 = 0, std::size_t const arg2 = 0, std::size_t const arg3 = 0 );
+    void finalize();
+    std::vector<CompiledInstruction> program;
+    std::size_t register_count;
+    std::size_t result_register;
+    CompiledStatistics stats;
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -8,21 +8,16 @@
 // Calculation of the determinant of a matrix
 #ifndef INCLUDED_DETERMINANT
 #define INCLUDED_DETERMINANT
+#include "libgibbs/include/utils/small_matrix.hpp"
 #include <boost/numeric/ublas/matrix.hpp>
-#include <boost/numeric/ublas/lu.hpp>
 #include <boost/assert.hpp>
 
+// Returns zero for a singular matrix
 template <typename T>
 T determinant ( const boost::numeric::ublas::matrix<T> &input ) {
-    using namespace boost::numeric::ublas;
-    matrix<T> A ( input ); // copy input matrix to A
-    T det = 1;
-    permutation_matrix<std::size_t,T> pm ( A.size1() );
-    auto error = lu_factorize ( A, pm ); // calculate LU factorization of A; save in A
-    BOOST_ASSERT ( error == 0 );
-    for (auto i = 0; i < A.size1(); ++i) {
-        det *= (pm(i) == i ? 1 : -1) * A ( i,i );
-    }
-    return det;
+    BOOST_ASSERT ( input.size1() == input.size2() );
+    if ( input.size1() == 0 ) return 1;
+    // ublas::matrix<T> is row-major and contiguous
+    return dense_determinant ( &input.data() [0], input.size1() );
 }
 #endif
\ No newline at end of file
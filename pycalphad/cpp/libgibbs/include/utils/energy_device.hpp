@@ -0,0 +1,58 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// energy_device.hpp -- evaluation of compiled energy programs on an accelerator
+
+#ifndef INCLUDED_ENERGY_DEVICE
+#define INCLUDED_ENERGY_DEVICE
+
+#include "libgibbs/include/utils/compiled_expr.hpp"
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+ * EnergyDevice evaluates the objective programs of one phase (see CompiledExpression) for large
+ * batches of points on an accelerator, one point per device thread, so that sampling millions of
+ * points does not keep the CPU busy. Work is asynchronous and double-buffered: submit() copies a
+ * batch into one of two slots and starts it, and wait() blocks until that slot's energies are back,
+ * so the caller can prepare the next batch, or fold the previous one into a hull, meanwhile.
+ * Only energies are copied back. Points at which the interpreter would throw (domain errors, failed
+ * range checks) come back as NaN energies; load() throws for unbound variables as bind() would.
+ * A device serves one phase at a time: callers hold lock() from load() until their last wait().
+ * Devices are built with LIBGIBBS_WITH_CUDA; open() returns null without one.
+ */
+class EnergyDevice : boost::noncopyable {
+public:
+    static constexpr const std::size_t slot_count = 2;
+    virtual ~EnergyDevice() { }
+    // The first CUDA device, or null if libgibbs was built without CUDA or there is no device
+    static std::shared_ptr<EnergyDevice> open();
+    std::unique_lock<std::mutex> lock() {
+        return std::unique_lock<std::mutex> ( device_mutex );
+    }
+    // Upload programs, evaluated with binding; replaces the programs of any earlier load()
+    virtual void load ( std::vector<CompiledExpression> const &programs, CompiledBinding const &binding ) = 0;
+    // Largest batch for which the device's buffers are sized; larger batches are split by the caller
+    virtual std::size_t max_batch_points() const = 0;
+    // Start evaluating npoints points (point i at points + i*stride) in slot; the points are copied before submit() returns
+    virtual void submit ( std::size_t const slot, double const* const points, std::size_t const npoints, std::size_t const stride ) = 0;
+    // Wait for the batch of slot and write its energies (as many as points submitted) to out
+    virtual void wait ( std::size_t const slot, double* const out ) = 0;
+private:
+    std::mutex device_mutex;
+};
+
+#ifdef LIBGIBBS_WITH_CUDA
+// Defined in energy_device_cuda.cu; null if there is no CUDA device
+std::shared_ptr<EnergyDevice> open_cuda_energy_device();
+#endif
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,88 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Sampled counts and timings of the evaluations of one phase
+
+#ifndef INCLUDED_EVALUATION_TRACE
+#define INCLUDED_EVALUATION_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+struct EvaluationStatistics {
+    EvaluationStatistics() : calls ( 0 ), points ( 0 ), timed_calls ( 0 ), timed_points ( 0 ), timed_seconds ( 0 ) { }
+    std::uint64_t calls; // evaluator calls made while tracing was enabled
+    std::uint64_t points; // points evaluated by those calls
+    std::uint64_t timed_calls; // calls that were timed
+    std::uint64_t timed_points; // points evaluated by the timed calls
+    double timed_seconds; // wall time of the timed calls
+    // Wall time of all calls, extrapolated from the timed ones
+    double estimated_seconds() const {
+        return timed_points > 0 ? timed_seconds * points / timed_points : 0;
+    }
+};
+
+/*
+ * EvaluationTrace counts the calls of an evaluator and times a sample of them.
+ * Tracing is off by default, which costs one relaxed atomic load per call.
+ * With a sampling period p, every call is counted and one call in p is timed,
+ * so the clock is rarely read even when tracing is on.
+ * Counters are atomic, so one EvaluationTrace can be shared by many threads.
+ */
+class EvaluationTrace {
+public:
+    // 0 turns tracing off for all evaluators
+    static void set_sampling_period ( std::size_t const period );
+    static std::size_t sampling_period() {
+        return period.load ( std::memory_order_relaxed );
+    }
+
+    EvaluationTrace() : calls ( 0 ), points ( 0 ), timed_calls ( 0 ), timed_points ( 0 ), timed_nanoseconds ( 0 ) { }
+    // copies the counts so far
+    EvaluationTrace ( EvaluationTrace const &other );
+    EvaluationStatistics statistics() const;
+    void reset();
+
+    // Counts one call evaluating point_count points, and times it if it is sampled
+    class Scope {
+    public:
+        Scope ( EvaluationTrace const &trace, std::size_t const point_count ) : trace ( nullptr ), point_count ( point_count ), timed ( false ) {
+            const std::size_t p = sampling_period();
+            if ( p == 0 ) return;
+            this->trace = &trace;
+            timed = ( trace.calls.fetch_add ( 1, std::memory_order_relaxed ) % p == 0 );
+            if ( timed ) start = std::chrono::steady_clock::now();
+        }
+        ~Scope() {
+            if ( !trace ) return;
+            trace->points.fetch_add ( point_count, std::memory_order_relaxed );
+            if ( !timed ) return;
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds> ( std::chrono::steady_clock::now() - start );
+            trace->timed_calls.fetch_add ( 1, std::memory_order_relaxed );
+            trace->timed_points.fetch_add ( point_count, std::memory_order_relaxed );
+            trace->timed_nanoseconds.fetch_add ( elapsed.count(), std::memory_order_relaxed );
+        }
+        Scope ( Scope const& ) = delete;
+        Scope& operator= ( Scope const& ) = delete;
+    private:
+        EvaluationTrace const* trace; // nullptr if tracing was off when the call started
+        std::size_t point_count;
+        bool timed;
+        std::chrono::steady_clock::time_point start;
+    };
+private:
+    static std::atomic<std::size_t> period;
+    mutable std::atomic<std::uint64_t> calls;
+    mutable std::atomic<std::uint64_t> points;
+    mutable std::atomic<std::uint64_t> timed_calls;
+    mutable std::atomic<std::uint64_t> timed_points;
+    mutable std::atomic<std::uint64_t> timed_nanoseconds;
+};
+
+#endif
@@ -0,0 +1,74 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Ideal mixing and Redlich-Kister excess energies evaluated by kernels specialized to the sublattice shape of a phase
+
+#ifndef INCLUDED_FIXED_SHAPE_KERNELS
+#define INCLUDED_FIXED_SHAPE_KERNELS
+
+#include "libgibbs/include/utils/compiled_expr.hpp"
+#include "libgibbs/include/utils/sublattice_layout.hpp"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/* Most phases have one of a few shapes: one substitutional sublattice (LIQUID, FCC_A1), a substitutional
+ * and an interstitial sublattice (BCC_A2 as (A,B)1(VA)3), or a few equivalent sublattices of an ordered
+ * phase. For those, the ideal mixing energy and an excess energy made only of binary interactions have a
+ * fixed form, which a FixedShapeModel evaluates directly. Its kernels are instantiated for each supported
+ * shape (the number of species on every sublattice), so every loop has a trip count known at compile time
+ * and the site fractions live in fixed-size arrays, instead of going through the interpreter of
+ * compiled_expr.cpp instruction by instruction. For phases of any other shape, the ideal mixing energy
+ * alone is evaluated by a kernel that loops over the layout, and the excess energy keeps its program.
+ *
+ * The energies are those of IdealMixingModel and RedlichKisterExcessEnergyModel, per mole of mixing sites:
+ *   R T sum_s a_s sum_i y_si ln y_si (y_si for y_si < 1e-20, as IdealMixingModel::protect_domain())
+ *   + sum over interactions of (product of its site fractions) * sum_k L_k (y_first - y_second)^k
+ * The coefficients L_k depend only on the conditions; they, and T, are passed in as constants, which
+ * CompositionSet::bind() computes once per set of conditions.
+ * Site fractions are read as the programs read them, x[variable_indices[slot]], through the compiled slot
+ * of every coordinate of the layout, and derivatives are added by slot, so that the kernels fill the same
+ * CompiledJet as CompiledExpression::evaluate_jet(). Models have no mutable state; any number of threads
+ * may evaluate one at once.
+ */
+
+// One binary Redlich-Kister interaction: one species on every sublattice, and a second one on one of them
+struct FixedShapeInteraction {
+    std::vector<std::size_t> constituents; // coordinate of the layout of the species on each sublattice
+    std::size_t sublattice; // the one with two species; constituents[sublattice] is the first of them
+    std::size_t second; // coordinate of the second species
+    std::size_t first_coefficient; // index of L_0 among the coefficients of all interactions
+    std::size_t degree_count; // L_0 ... L_{degree_count-1}
+};
+
+class FixedShapeModel {
+public:
+    virtual ~FixedShapeModel() { }
+    // constants: T, then the coefficients of all interactions
+    virtual double energy ( double const* x, int const* variable_indices, double const* constants ) const = 0;
+    // Adds the value, gradient and (if with_hessian) Hessian to jet
+    virtual void add_jet ( double const* x, int const* variable_indices, double const* constants,
+                           CompiledJet &jet, bool with_hessian ) const = 0;
+    // product[slot] += (Hessian times direction)[slot]
+    virtual void add_hessian_vector ( double const* x, int const* variable_indices, double const* constants,
+                                      double const* direction, double* product ) const = 0;
+    // The compiled slot of every coordinate of the layout
+    virtual std::vector<std::size_t> const& coordinate_slots() const = 0;
+    virtual std::size_t memory_bytes() const = 0;
+};
+
+// The model of layout, with coordinate_slots[coordinate] the compiled slot of each coordinate and slot_count
+// slots in all; null if layout has no mixing sites, or if there are interactions and its shape is not one of
+// the supported ones
+std::unique_ptr<const FixedShapeModel> make_fixed_shape_model (
+    SublatticeLayout const &layout,
+    std::vector<std::size_t> const &coordinate_slots,
+    std::size_t slot_count,
+    std::vector<FixedShapeInteraction> const &interactions );
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
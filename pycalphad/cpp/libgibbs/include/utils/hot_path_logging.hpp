@@ -0,0 +1,38 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Logging for code that runs once per evaluation, e.g., AST walks and solver callbacks
+
+#ifndef INCLUDED_HOT_PATH_LOGGING
+#define INCLUDED_HOT_PATH_LOGGING
+
+#include "libtdb/include/logging.hpp"
+
+/*
+ * Named scopes, loggers and debug records in the evaluation hot path cost time
+ * on every call, even when the records are filtered out. They are compiled only
+ * if LIBGIBBS_HOT_PATH_LOGGING is defined; otherwise the macros below expand to
+ * nothing and the streamed arguments are never evaluated.
+ * Use EvaluationTrace (evaluation_trace.hpp) to count and time evaluations instead.
+ */
+#ifdef LIBGIBBS_HOT_PATH_LOGGING
+#define HOT_PATH_NAMED_SCOPE(name) BOOST_LOG_NAMED_SCOPE ( name )
+#define HOT_PATH_LOGGER(name, channel_name) logger name ( journal::keywords::channel = channel_name )
+#define HOT_PATH_LOG_SEV(log, severity) BOOST_LOG_SEV ( log, severity )
+#else
+// Swallows a streamed record; the logger argument need not exist
+struct NullLogStream {
+    template <typename T> NullLogStream const& operator<< ( T const& ) const {
+        return *this;
+    }
+};
+#define HOT_PATH_NAMED_SCOPE(name)
+#define HOT_PATH_LOGGER(name, channel_name)
+#define HOT_PATH_LOG_SEV(log, severity) while ( false ) NullLogStream()
+#endif
+
+#endif
@@ -7,36 +7,27 @@
  
  #ifndef INCLUDED_INVERT_MATRIX
  #define INCLUDED_INVERT_MATRIX
- #define BOOST_UBLAS_NDEBUG 1 // TODO: Ignoring the ill-conditioned matrix doesn't make it go away
- 
- #include <boost/numeric/ublas/vector.hpp>
- #include <boost/numeric/ublas/vector_proxy.hpp>
+ #include "libgibbs/include/utils/small_matrix.hpp"
  #include <boost/numeric/ublas/matrix.hpp>
- #include <boost/numeric/ublas/triangular.hpp>
- #include <boost/numeric/ublas/lu.hpp>
- #include <boost/numeric/ublas/io.hpp>
+ #include <boost/assert.hpp>
 
  /* Matrix inversion routine
-  * Uses lu_factorize and lu_substitute to invert a matrix 
+  * Uses an LU factorization with partial pivoting; see small_matrix.hpp
   * Reference: Numerical Recipies in C, 2nd ed., by Press, Teukolsky, Vetterling & Flannery.
+  * input and inverse may be the same matrix.
   */
  template<class T>
  bool InvertMatrix (const boost::numeric::ublas::matrix<T>& input, 
                     boost::numeric::ublas::matrix<T>& inverse) {
-     using namespace boost::numeric::ublas;
-     typedef permutation_matrix<std::size_t> pmatrix;
-     // create a working copy of the input
-     matrix<T> A(input);
-     // create a permutation matrix for the LU-factorization
-     pmatrix pm(A.size1());
-     // perform LU-factorization
-     int res = lu_factorize(A,pm);
-     if( res != 0 ) return false;
-     // create identity matrix of "inverse"
-     inverse.assign(identity_matrix<T>(A.size1()));
-     // backsubstitute to get the inverse
-     lu_substitute(A, pm, inverse);
-     return true;
+     BOOST_ASSERT ( input.size1() == input.size2() );
+     const std::size_t n = input.size1();
+     if ( n == 0 ) {
+         inverse.resize ( 0, 0, false );
+         return true;
+     }
+     if ( &input != &inverse ) inverse.resize ( n, n, false );
+     // ublas::matrix<T> is row-major and contiguous
+     return dense_invert ( &input.data() [0], &inverse.data() [0], n );
  }
  
  #endif
\ No newline at end of file
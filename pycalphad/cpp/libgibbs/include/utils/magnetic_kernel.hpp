@@ -0,0 +1,56 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// The magnetic energy of the Inden-Hillert-Jarl model evaluated in closed form
+
+#ifndef INCLUDED_MAGNETIC_KERNEL
+#define INCLUDED_MAGNETIC_KERNEL
+
+#include "libgibbs/include/utils/compiled_expr.hpp"
+
+/* IHJMagneticModel builds its energy as a tree: the AFM factors of the Curie temperature TC and of the
+ * mean magnetic moment B, the guarded tau = T/TC, and the piecewise polynomial g(tau) in tau^-1, tau^3,
+ * tau^9, tau^15 (tau < 1) or tau^-5, tau^-15, tau^-25 (tau >= 1), which are then differentiated as a
+ * whole. Only TC and B depend on the database; the rest is the fixed function
+ *   T R ln(1 + B') g(T/TC') / mixing sites
+ * of T, TC' and B' (TC and B with their AFM factors applied). A MagneticKernel evaluates it directly, and
+ * its derivatives with respect to the variables by the chain rule, from the value, gradient and Hessian
+ * (or Hessian-vector product) of TC and B, which the caller evaluates from their compiled programs.
+ * Jets are indexed by variable slot, as those of CompiledExpression::evaluate_jet(). Kernels have no
+ * mutable state; any number of threads may evaluate one at once.
+ */
+class MagneticKernel {
+public:
+    MagneticKernel ( double const afm_factor, double const sro_enthalpy_order_fraction, double const mixing_sites );
+    double energy ( double const T, double const curie_temperature, double const magnetic_moment ) const;
+    // Adds the value, gradient and (if with_hessian) Hessian to jet, from the jets of TC and B
+    void add_jet ( double const T, CompiledJet const &curie_temperature, CompiledJet const &magnetic_moment,
+                   CompiledJet &jet, bool const with_hessian ) const;
+    // product[slot] += (Hessian times direction)[slot], from the gradients of TC and B and the products of their
+    // Hessians with direction (in the product member of their jets)
+    void add_hessian_vector ( double const T, CompiledJet const &curie_temperature, CompiledJet const &magnetic_moment,
+                              double const* direction, double* product ) const;
+private:
+    // The energy, and the coefficients of the derivatives of TC and B in its derivatives
+    struct Terms {
+        double value;
+        double moment; // of the derivatives of B
+        double curie; // of the derivatives of TC
+        double moment_moment; // of the products of the gradient of B with itself
+        double moment_curie; // of the products of the gradients of B and TC
+        double curie_curie; // of the products of the gradient of TC with itself
+    };
+    Terms terms ( double const T, double const curie_temperature, double const magnetic_moment ) const;
+    // g(tau) and its first two derivatives
+    void polynomial ( double const tau, double &g, double &g_tau, double &g_tau_tau ) const;
+    double afm_factor;
+    double inverse_mixing_sites;
+    double A, B, C; // factors of the heat capacity integration, as in magnetic_polynomial()
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
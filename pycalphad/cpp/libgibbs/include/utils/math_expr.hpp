@@ -34,6 +34,8 @@ boost::spirit::utree const process_utree(
 		ASTSymbolMap const&,
 		double* const);
 boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut);
+// same as ut = simplify_utree(ut), without copying ut when it is already simplified
+void simplify_utree_in_place(boost::spirit::utree &ut);
 boost::spirit::utree const differentiate_utree(boost::spirit::utree const&, std::string const&);
 boost::spirit::utree const differentiate_utree(boost::spirit::utree const&, std::string const&, ASTSymbolMap const&);
 template <typename T> bool is_allowed_value(T &);
@@ -0,0 +1,86 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Estimated memory use of the solver's data structures, broken down by component
+
+#ifndef INCLUDED_MEMORY_FOOTPRINT
+#define INCLUDED_MEMORY_FOOTPRINT
+
+#include <boost/spirit/include/support_utree.hpp>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/* The numbers are estimates from the sizes and capacities of the containers, not measurements of
+ * the allocator: a tree node (std::map, std::set, boost::multi_index, utree list) is counted as its
+ * value plus four pointers, and strings as their characters beyond the small string buffer.
+ * They are meant for comparing configurations and sizing worker pools, to within tens of percent.
+ * Structures shared between objects (e.g., the compiled models of the composition sets of one phase)
+ * are counted by the first object asked for its footprint with the same SharedObjects, and skipped by
+ * the others, so footprints taken with one SharedObjects can be added up without double counting.
+ */
+struct MemoryUsage {
+    MemoryUsage() : bytes ( 0 ), nodes ( 0 ) { }
+    MemoryUsage ( const std::size_t bytes, const std::size_t nodes ) : bytes ( bytes ), nodes ( nodes ) { }
+    MemoryUsage& operator+= ( const MemoryUsage &other ) {
+        bytes += other.bytes;
+        nodes += other.nodes;
+        return *this;
+    }
+    std::size_t bytes;
+    std::size_t nodes; // AST nodes, or entries of whatever the component holds
+};
+
+class MemoryFootprint {
+public:
+    void add ( const std::string &component, const MemoryUsage &usage ) {
+        components_usage[component] += usage;
+    }
+    void add ( const std::string &component, const std::size_t bytes, const std::size_t nodes = 0 ) {
+        add ( component, MemoryUsage ( bytes, nodes ) );
+    }
+    MemoryFootprint& operator+= ( const MemoryFootprint &other );
+    const std::map<std::string,MemoryUsage>& components() const {
+        return components_usage;
+    }
+    MemoryUsage total() const;
+    // One line per component: name, bytes, nodes; then the total
+    std::string print() const;
+private:
+    std::map<std::string,MemoryUsage> components_usage;
+};
+
+// A footprint per phase (composition set), and one of everything else, e.g., of an equilibrium
+struct PhaseMemoryFootprint {
+    std::map<std::string,MemoryFootprint> phases;
+    MemoryFootprint common;
+    MemoryFootprint total() const;
+    std::string print() const;
+};
+
+// Addresses of the shared structures counted so far
+typedef std::unordered_set<const void*> SharedObjects;
+
+// Estimates for the building blocks
+// Nodes counts tree itself; bytes are what tree owns on the heap, as tree itself is part of whatever holds it
+MemoryUsage utree_memory_usage ( const boost::spirit::utree &tree );
+std::size_t string_heap_bytes ( const std::string &str );
+const std::size_t tree_node_overhead = 4 * sizeof ( void* ); // links and color of a red-black tree node
+template <typename T> std::size_t vector_heap_bytes ( const std::vector<T> &vec )
+{
+    return vec.capacity() * sizeof ( T );
+}
+// Nodes of a node-based container, without what its values own on the heap
+template <typename Container> std::size_t node_heap_bytes ( const Container &container )
+{
+    return container.size() * ( sizeof ( typename Container::value_type ) + tree_node_overhead );
+}
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,76 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// native_kernel.hpp -- compiled programs translated to C++ and loaded as native code
+
+#ifndef INCLUDED_NATIVE_KERNEL
+#define INCLUDED_NATIVE_KERNEL
+
+#include "libgibbs/include/utils/compiled_expr.hpp"
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * The interpreter of compiled_expr.cpp dispatches on every instruction it runs. For production
+ * runs on a fixed database, NativeKernelSource instead translates the programs into plain C++
+ * functions, one straight-line block per program with gotos for the range checks, and
+ * NativeKernelLibrary compiles that source with the system compiler into a shared object and
+ * loads it with dlopen(). Objects are kept in a cache directory under a hash of their source
+ * and the compiler command, so each set of kernels is only compiled once per machine.
+ * Every kernel has the signature of NativeKernelFunction:
+ *   x: the variables, by slot of the CompiledSlotTable the programs were compiled against
+ *   state: the state variables, by slot (NaN if unbound)
+ *   out: the outputs of the kernel, which are added to
+ * Kernels do not raise errors: a domain error or an unbound state variable yields a non-finite
+ * output, which callers must check for. Kernels have no state, so any number of threads may
+ * call them at once.
+ */
+extern "C" {
+    typedef void ( *NativeKernelFunction ) ( double const* x, double const* state, double* out );
+}
+
+// out[position] += value of program for every position
+struct NativeKernelOutput {
+    NativeKernelOutput ( CompiledExpression const &program, std::vector<std::size_t> positions ) :
+        program ( &program ), positions ( std::move ( positions ) ) { }
+    CompiledExpression const* program;
+    std::vector<std::size_t> positions;
+};
+
+class NativeKernelSource {
+public:
+    NativeKernelSource();
+    // name must be a valid C identifier; the programs must outlive this call only
+    void add_kernel ( std::string const &name, std::vector<NativeKernelOutput> const &outputs );
+    std::string const& str() const {
+        return source;
+    }
+private:
+    std::string source;
+};
+
+class NativeKernelLibrary : boost::noncopyable {
+public:
+    // Load the shared object built from source, compiling it in cache_directory first if it is not there yet
+    // The compiler is $LIBGIBBS_CXX if it is set, otherwise c++
+    // Throws internal_error if the object cannot be compiled or loaded
+    NativeKernelLibrary ( std::string const &source, std::string const &cache_directory );
+    ~NativeKernelLibrary();
+    // Throws unknown_symbol_error if there is no kernel of that name
+    NativeKernelFunction kernel ( std::string const &name ) const;
+    std::string const& path() const {
+        return library_path;
+    }
+private:
+    std::string library_path;
+    void* handle;
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
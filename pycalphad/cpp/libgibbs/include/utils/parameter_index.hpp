@@ -0,0 +1,52 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Hashed index of the parameters of a database, for building energy models
+
+#ifndef INCLUDED_PARAMETER_INDEX
+#define INCLUDED_PARAMETER_INDEX
+
+#include "libtdb/include/database.hpp"
+#include "libtdb/include/parameter.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* EnergyModel::find_parameter_ast() is called for every permutation of the site fractions of a phase,
+ * and only matches parameters whose constituent array equals the permutation, sublattice by sublattice
+ * and in the same order (wildcards never match a single species, and the order of an interacting pair
+ * gives the sign of the odd Redlich-Kister terms, so arrays are not sorted). Searching the parameters of
+ * the phase for each permutation makes model construction from large databases quadratic; a
+ * ParameterIndex finds all degrees of a (phase, type, constituent array) by one hash lookup instead.
+ * It keeps its own copy of the parameters. An index is never modified after it is built, so any number
+ * of threads may use one at once.
+ */
+class ParameterIndex {
+public:
+    explicit ParameterIndex ( parameter_set parameters );
+    // The parameters of phase and type with exactly constituents, in the order of the phase index of the
+    // parameter set (i.e., that of a view of the phase's parameters of that type); empty if there are none
+    std::vector<const Parameter*> const& find (
+        std::string const &phase,
+        std::string const &type,
+        std::vector<std::vector<std::string>> const &constituents ) const;
+    std::size_t size() const {
+        return parameter_count;
+    }
+    // The index of the parameters of DB, built on first use and shared by every caller until none holds it.
+    // Databases are identified as CompiledSystem::matches() does: by address and get_info()
+    static std::shared_ptr<const ParameterIndex> of ( Database const &DB );
+private:
+    static std::string key ( std::string const &phase, std::string const &type, std::vector<std::vector<std::string>> const &constituents );
+    parameter_set storage;
+    std::unordered_map<std::string, std::vector<const Parameter*>> parameters;
+    std::size_t parameter_count;
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
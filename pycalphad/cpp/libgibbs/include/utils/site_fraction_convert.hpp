@@ -10,6 +10,7 @@
 #define INCLUDED_SITE_FRACTION_CONVERT
 
 #include "libgibbs/include/models.hpp"
+#include "libgibbs/include/utils/sublattice_layout.hpp"
 #include <boost/assert.hpp>
 #include <vector>
 #include <map>
@@ -25,11 +26,12 @@ template <typename CoordinateType>
 std::map<std::string,CoordinateType> convert_site_fractions_to_mole_fractions (
     const std::string &phase_name,
     const sublattice_set &sublset,
-    const std::vector<CoordinateType> &internal_coordinates) {
+    CoordinateType const* const internal_coordinates,
+    const std::size_t coordinate_count) {
     
     // map component name to a value
     std::map<std::string,CoordinateType> component_mole_fraction_numerator;
-    CoordinateType component_mole_fraction_denominator;
+    CoordinateType component_mole_fraction_denominator = 0;
     std::map<std::string,CoordinateType> global_coordinates;
     // Get the first sublattice for this phase
     boost::multi_index::index<sublattice_set,phase_subl>::type::iterator subl_start,subl_end;
@@ -43,7 +45,7 @@ std::map<std::string,CoordinateType> convert_site_fractions_to_mole_fractions (
              ++current_component,++internal_coordinate_index ) {
             if ( current_component->species == "VA" ) continue; // vacancies don't contribute here
             
-            BOOST_ASSERT ( internal_coordinate_index < internal_coordinates.size() );
+            BOOST_ASSERT ( internal_coordinate_index < coordinate_count );
             const CoordinateType site_fraction = internal_coordinates[ internal_coordinate_index ];
             
             // if we've already added to this component's numerator, we only increment it
@@ -71,5 +73,29 @@ std::map<std::string,CoordinateType> convert_site_fractions_to_mole_fractions (
     return global_coordinates;
 };
 
+// Same, for a phase described by layout; loops converting many points should call layout.mole_fractions() instead
+template <typename CoordinateType>
+std::map<std::string,CoordinateType> convert_site_fractions_to_mole_fractions (
+    const SublatticeLayout &layout,
+    CoordinateType const* const internal_coordinates,
+    const std::size_t coordinate_count) {
+    BOOST_ASSERT ( coordinate_count >= layout.coordinate_count() );
+    std::vector<CoordinateType> mole_fractions ( layout.components().size() );
+    layout.mole_fractions ( internal_coordinates, mole_fractions.data() );
+    std::map<std::string,CoordinateType> global_coordinates;
+    for ( std::size_t i = 0; i < mole_fractions.size(); ++i ) {
+        global_coordinates [ layout.components()[i] ] = mole_fractions[i];
+    }
+    return global_coordinates;
+};
+
+template <typename CoordinateType>
+std::map<std::string,CoordinateType> convert_site_fractions_to_mole_fractions (
+    const std::string &phase_name,
+    const sublattice_set &sublset,
+    const std::vector<CoordinateType> &internal_coordinates) {
+    return convert_site_fractions_to_mole_fractions ( phase_name, sublset, internal_coordinates.data(), internal_coordinates.size() );
+};
+
 
 #endif
\ No newline at end of file
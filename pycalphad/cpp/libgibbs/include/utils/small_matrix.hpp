@@ -0,0 +1,329 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Factorizations of small, dense, row-major matrices
+// The matrices in the optimizer are tiny (projected Hessians, simplex and facet matrices),
+// so for sizes up to max_fixed_matrix_size the size is a template parameter: scratch space
+// lives on the stack and the loops over a known trip count can be unrolled by the compiler.
+// Larger matrices use the same kernels with heap-allocated scratch space.
+
+#ifndef INCLUDED_SMALL_MATRIX
+#define INCLUDED_SMALL_MATRIX
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+constexpr const std::size_t max_fixed_matrix_size = 8;
+
+namespace small_matrix_kernels {
+// Cholesky factorization of the n x n matrix a, in place; only the lower triangle is read or written
+// It succeeds if and only if a is positive definite
+template <typename T>
+inline bool cholesky_factorize ( T* const a, const std::size_t n ) {
+    for ( std::size_t i = 0; i < n; ++i ) {
+        for ( std::size_t j = 0; j <= i; ++j ) {
+            T elem = a[i*n+j];
+            for ( std::size_t k = 0; k < j; ++k ) elem -= a[i*n+k] * a[j*n+k];
+            if ( i == j ) {
+                // matrix after rounding errors is not positive definite
+                if ( !( elem > 0 ) ) return false;
+                a[i*n+i] = std::sqrt ( elem );
+            }
+            else {
+                a[i*n+j] = elem / a[j*n+j];
+            }
+        }
+    }
+    return true;
+}
+
+// Eigenvalues of the symmetric n x n matrix a by cyclic Jacobi rotations, which are accurate even for tiny
+// eigenvalues of matrices with large ones; a is overwritten, its diagonal holding the eigenvalues on return,
+// and column i of vectors (n x n) is the eigenvector of eigenvalue i. Meant for n up to a few dozen
+template <typename T>
+inline void jacobi_eigen ( T* const a, T* const vectors, const std::size_t n ) {
+    for ( std::size_t i = 0; i < n; ++i ) {
+        for ( std::size_t j = 0; j < n; ++j ) vectors[i*n+j] = i == j ? 1 : 0;
+    }
+    for ( int sweep = 0; sweep < 50; ++sweep ) {
+        T off = 0;
+        T scale = 0;
+        for ( std::size_t i = 0; i < n; ++i ) {
+            scale += a[i*n+i] * a[i*n+i];
+            for ( std::size_t j = i + 1; j < n; ++j ) off += a[i*n+j] * a[i*n+j];
+        }
+        if ( !( off > std::numeric_limits<T>::epsilon() * std::numeric_limits<T>::epsilon() * scale ) ) return;
+        for ( std::size_t p = 0; p < n; ++p ) {
+            for ( std::size_t q = p + 1; q < n; ++q ) {
+                if ( a[p*n+q] == 0 ) continue;
+                // Rotation zeroing a[p][q]
+                const T theta = ( a[q*n+q] - a[p*n+p] ) / ( 2 * a[p*n+q] );
+                const T t = ( theta >= 0 ? 1 : -1 ) / ( std::fabs ( theta ) + std::sqrt ( theta * theta + 1 ) );
+                const T c = 1 / std::sqrt ( t * t + 1 );
+                const T s = t * c;
+                for ( std::size_t k = 0; k < n; ++k ) {
+                    const T akp = a[k*n+p];
+                    const T akq = a[k*n+q];
+                    a[k*n+p] = c * akp - s * akq;
+                    a[k*n+q] = s * akp + c * akq;
+                }
+                for ( std::size_t k = 0; k < n; ++k ) {
+                    const T apk = a[p*n+k];
+                    const T aqk = a[q*n+k];
+                    a[p*n+k] = c * apk - s * aqk;
+                    a[q*n+k] = s * apk + c * aqk;
+                }
+                for ( std::size_t k = 0; k < n; ++k ) {
+                    const T vkp = vectors[k*n+p];
+                    const T vkq = vectors[k*n+q];
+                    vectors[k*n+p] = c * vkp - s * vkq;
+                    vectors[k*n+q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+// LU factorization with partial pivoting of the n x n matrix a, in place
+// Row i of the factors is row perm[i] of the input; sign is the sign of the permutation
+// Like ublas::lu_factorize, it fails only for an exactly zero pivot
+template <typename T>
+inline bool lu_factorize ( T* const a, std::size_t* const perm, int &sign, const std::size_t n ) {
+    sign = 1;
+    for ( std::size_t i = 0; i < n; ++i ) perm[i] = i;
+    for ( std::size_t col = 0; col < n; ++col ) {
+        std::size_t pivot_row = col;
+        for ( std::size_t row = col + 1; row < n; ++row ) {
+            if ( std::fabs ( a[row*n+col] ) > std::fabs ( a[pivot_row*n+col] ) ) pivot_row = row;
+        }
+        if ( a[pivot_row*n+col] == 0 ) return false; // singular
+        if ( pivot_row != col ) {
+            std::swap_ranges ( a + col*n, a + ( col+1 ) *n, a + pivot_row*n );
+            std::swap ( perm[col], perm[pivot_row] );
+            sign = -sign;
+        }
+        const T pivot = a[col*n+col];
+        for ( std::size_t row = col + 1; row < n; ++row ) {
+            const T factor = ( a[row*n+col] /= pivot );
+            for ( std::size_t k = col + 1; k < n; ++k ) a[row*n+k] -= factor * a[col*n+k];
+        }
+    }
+    return true;
+}
+
+template <typename T>
+inline T lu_determinant ( T const* const lu, const int sign, const std::size_t n ) {
+    T det = sign;
+    for ( std::size_t i = 0; i < n; ++i ) det *= lu[i*n+i];
+    return det;
+}
+
+// Write the inverse of the factorized matrix lu to inverse (which must not alias lu)
+template <typename T>
+inline void lu_invert ( T const* const lu, std::size_t const* const perm, T* const inverse, const std::size_t n ) {
+    for ( std::size_t col = 0; col < n; ++col ) {
+        // Solve L*U*x = P*e_col, storing x as column col of inverse
+        for ( std::size_t i = 0; i < n; ++i ) {
+            T elem = ( perm[i] == col ) ? 1 : 0;
+            for ( std::size_t k = 0; k < i; ++k ) elem -= lu[i*n+k] * inverse[k*n+col];
+            inverse[i*n+col] = elem;
+        }
+        for ( std::size_t i = n; i-- > 0; ) {
+            T elem = inverse[i*n+col];
+            for ( std::size_t k = i + 1; k < n; ++k ) elem -= lu[i*n+k] * inverse[k*n+col];
+            inverse[i*n+col] = elem / lu[i*n+i];
+        }
+    }
+}
+
+// Solve lu*x = P*b for the factorized matrix lu, in place in b
+template <typename T>
+inline void lu_substitute ( T const* const lu, std::size_t const* const perm, T* const b, const std::size_t n ) {
+    std::vector<T> permuted ( n );
+    for ( std::size_t i = 0; i < n; ++i ) permuted[i] = b[perm[i]];
+    for ( std::size_t i = 0; i < n; ++i ) {
+        T elem = permuted[i];
+        for ( std::size_t k = 0; k < i; ++k ) elem -= lu[i*n+k] * b[k];
+        b[i] = elem;
+    }
+    for ( std::size_t i = n; i-- > 0; ) {
+        T elem = b[i];
+        for ( std::size_t k = i + 1; k < n; ++k ) elem -= lu[i*n+k] * b[k];
+        b[i] = elem / lu[i*n+i];
+    }
+}
+} // namespace small_matrix_kernels
+
+// Fixed-size versions: N is known at compile time
+
+template <std::size_t N, typename T>
+bool fixed_cholesky_factorize ( T* const a ) {
+    return small_matrix_kernels::cholesky_factorize ( a, N );
+}
+
+// Test whether a is positive definite without modifying it
+template <std::size_t N, typename T>
+bool fixed_cholesky_positive_definite ( T const* const a ) {
+    T factor[N*N];
+    std::copy ( a, a + N*N, factor );
+    return small_matrix_kernels::cholesky_factorize ( factor, N );
+}
+
+template <std::size_t N, typename T>
+T fixed_determinant ( T const* const a ) {
+    T lu[N*N];
+    std::size_t perm[N];
+    int sign;
+    std::copy ( a, a + N*N, lu );
+    if ( !small_matrix_kernels::lu_factorize ( lu, perm, sign, N ) ) return 0;
+    return small_matrix_kernels::lu_determinant ( lu, sign, N );
+}
+
+// inverse may alias a; returns false (leaving inverse unchanged) if a is singular
+template <std::size_t N, typename T>
+bool fixed_invert ( T const* const a, T* const inverse ) {
+    T lu[N*N];
+    std::size_t perm[N];
+    int sign;
+    std::copy ( a, a + N*N, lu );
+    if ( !small_matrix_kernels::lu_factorize ( lu, perm, sign, N ) ) return false;
+    small_matrix_kernels::lu_invert ( lu, perm, inverse, N );
+    return true;
+}
+
+// Solve a*x = b in place in b; returns false (leaving b unchanged) if a is singular
+template <std::size_t N, typename T>
+bool fixed_solve ( T const* const a, T* const b ) {
+    T lu[N*N];
+    std::size_t perm[N];
+    int sign;
+    std::copy ( a, a + N*N, lu );
+    if ( !small_matrix_kernels::lu_factorize ( lu, perm, sign, N ) ) return false;
+    small_matrix_kernels::lu_substitute ( lu, perm, b, N );
+    return true;
+}
+
+template <std::size_t N, typename T>
+void fixed_positive_definite_mask ( T const* const matrices, const std::size_t count, char* const out ) {
+    for ( std::size_t i = 0; i < count; ++i ) {
+        out[i] = fixed_cholesky_positive_definite<N> ( matrices + i*N*N );
+    }
+}
+
+// Run-time size versions: sizes up to max_fixed_matrix_size are dispatched to the fixed-size versions
+
+template <typename T>
+bool dense_cholesky_factorize ( T* const a, const std::size_t n ) {
+    switch ( n ) {
+    case 1: return fixed_cholesky_factorize<1> ( a );
+    case 2: return fixed_cholesky_factorize<2> ( a );
+    case 3: return fixed_cholesky_factorize<3> ( a );
+    case 4: return fixed_cholesky_factorize<4> ( a );
+    case 5: return fixed_cholesky_factorize<5> ( a );
+    case 6: return fixed_cholesky_factorize<6> ( a );
+    case 7: return fixed_cholesky_factorize<7> ( a );
+    case 8: return fixed_cholesky_factorize<8> ( a );
+    default: return small_matrix_kernels::cholesky_factorize ( a, n );
+    }
+}
+
+template <typename T>
+bool cholesky_positive_definite ( T const* const a, const std::size_t n ) {
+    std::vector<T> factor ( a, a + n*n );
+    return dense_cholesky_factorize ( factor.data(), n );
+}
+
+template <typename T>
+T dense_determinant ( T const* const a, const std::size_t n ) {
+    switch ( n ) {
+    case 0: return 1;
+    case 1: return fixed_determinant<1> ( a );
+    case 2: return fixed_determinant<2> ( a );
+    case 3: return fixed_determinant<3> ( a );
+    case 4: return fixed_determinant<4> ( a );
+    case 5: return fixed_determinant<5> ( a );
+    case 6: return fixed_determinant<6> ( a );
+    case 7: return fixed_determinant<7> ( a );
+    case 8: return fixed_determinant<8> ( a );
+    default:
+        std::vector<T> lu ( a, a + n*n );
+        std::vector<std::size_t> perm ( n );
+        int sign;
+        if ( !small_matrix_kernels::lu_factorize ( lu.data(), perm.data(), sign, n ) ) return 0;
+        return small_matrix_kernels::lu_determinant ( lu.data(), sign, n );
+    }
+}
+
+template <typename T>
+bool dense_invert ( T const* const a, T* const inverse, const std::size_t n ) {
+    switch ( n ) {
+    case 0: return true;
+    case 1: return fixed_invert<1> ( a, inverse );
+    case 2: return fixed_invert<2> ( a, inverse );
+    case 3: return fixed_invert<3> ( a, inverse );
+    case 4: return fixed_invert<4> ( a, inverse );
+    case 5: return fixed_invert<5> ( a, inverse );
+    case 6: return fixed_invert<6> ( a, inverse );
+    case 7: return fixed_invert<7> ( a, inverse );
+    case 8: return fixed_invert<8> ( a, inverse );
+    default:
+        std::vector<T> lu ( a, a + n*n );
+        std::vector<std::size_t> perm ( n );
+        int sign;
+        if ( !small_matrix_kernels::lu_factorize ( lu.data(), perm.data(), sign, n ) ) return false;
+        small_matrix_kernels::lu_invert ( lu.data(), perm.data(), inverse, n );
+        return true;
+    }
+}
+
+template <typename T>
+bool dense_solve ( T const* const a, T* const b, const std::size_t n ) {
+    switch ( n ) {
+    case 0: return true;
+    case 1: return fixed_solve<1> ( a, b );
+    case 2: return fixed_solve<2> ( a, b );
+    case 3: return fixed_solve<3> ( a, b );
+    case 4: return fixed_solve<4> ( a, b );
+    case 5: return fixed_solve<5> ( a, b );
+    case 6: return fixed_solve<6> ( a, b );
+    case 7: return fixed_solve<7> ( a, b );
+    case 8: return fixed_solve<8> ( a, b );
+    default:
+        std::vector<T> lu ( a, a + n*n );
+        std::vector<std::size_t> perm ( n );
+        int sign;
+        if ( !small_matrix_kernels::lu_factorize ( lu.data(), perm.data(), sign, n ) ) return false;
+        small_matrix_kernels::lu_substitute ( lu.data(), perm.data(), b, n );
+        return true;
+    }
+}
+
+// Flag which of count packed n x n matrices (matrix i starts at matrices + i*n*n) are positive definite
+// The size is dispatched once for the whole block
+template <typename T>
+void positive_definite_mask ( T const* const matrices, const std::size_t count, const std::size_t n, char* const out ) {
+    switch ( n ) {
+    case 0: // no feasible directions; nothing can decrease the energy
+        for ( std::size_t i = 0; i < count; ++i ) out[i] = true;
+        return;
+    case 1: return fixed_positive_definite_mask<1> ( matrices, count, out );
+    case 2: return fixed_positive_definite_mask<2> ( matrices, count, out );
+    case 3: return fixed_positive_definite_mask<3> ( matrices, count, out );
+    case 4: return fixed_positive_definite_mask<4> ( matrices, count, out );
+    case 5: return fixed_positive_definite_mask<5> ( matrices, count, out );
+    case 6: return fixed_positive_definite_mask<6> ( matrices, count, out );
+    case 7: return fixed_positive_definite_mask<7> ( matrices, count, out );
+    case 8: return fixed_positive_definite_mask<8> ( matrices, count, out );
+    default:
+        for ( std::size_t i = 0; i < count; ++i ) {
+            out[i] = cholesky_positive_definite ( matrices + i*n*n, n );
+        }
+    }
+}
+#endif
@@ -0,0 +1,92 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Call counts and wall time of the stages of an equilibrium calculation
+
+#ifndef INCLUDED_STAGE_PROFILE
+#define INCLUDED_STAGE_PROFILE
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct StageTiming {
+    StageTiming() : calls ( 0 ), seconds ( 0 ) { }
+    std::size_t calls;
+    double seconds; // wall time of all calls
+};
+
+/* StageProfile accumulates the time spent in each named stage, e.g., the
+ * sampling of the phases or an Ipopt callback. Stages are kept in the order
+ * they were first recorded, so a printed profile follows the calculation.
+ * A StageProfile is not thread-safe; workers should time their own share
+ * and add it afterwards.
+ */
+class StageProfile {
+public:
+    typedef std::vector<std::pair<std::string,StageTiming>> StageList;
+
+    void add ( std::string const &stage, double const seconds, std::size_t const calls = 1 ) {
+        StageTiming &timing = find_or_insert ( stage );
+        timing.calls += calls;
+        timing.seconds += seconds;
+    }
+    void merge ( StageProfile const &other ) {
+        for ( auto i = other.timings.cbegin(); i != other.timings.cend(); ++i ) {
+            add ( i->first, i->second.seconds, i->second.calls );
+        }
+    }
+    StageList const& stages() const {
+        return timings;
+    }
+    // Zero if the stage was never recorded
+    StageTiming stage ( std::string const &name ) const {
+        auto stage_find = std::find_if ( timings.cbegin(), timings.cend(),
+                                         [&name] ( StageList::value_type const &entry ) { return entry.first == name; } );
+        return stage_find != timings.cend() ? stage_find->second : StageTiming();
+    }
+    bool empty() const {
+        return timings.empty();
+    }
+    void print ( std::ostream &stream ) const {
+        for ( auto i = timings.cbegin(); i != timings.cend(); ++i ) {
+            stream << "  " << i->first << ": " << i->second.calls << " calls, " << i->second.seconds << " secs" << std::endl;
+        }
+    }
+
+    // Records one call of stage, lasting from construction to destruction
+    class Scope {
+    public:
+        Scope ( StageProfile &profile, char const* const stage ) :
+            profile ( profile ), stage ( stage ), start ( std::chrono::steady_clock::now() ) { }
+        ~Scope() {
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            profile.add ( stage, elapsed.count() );
+        }
+        Scope ( Scope const& ) = delete;
+        Scope& operator= ( Scope const& ) = delete;
+    private:
+        StageProfile &profile;
+        char const* stage;
+        std::chrono::steady_clock::time_point start;
+    };
+private:
+    StageTiming& find_or_insert ( std::string const &stage ) {
+        for ( auto i = timings.begin(); i != timings.end(); ++i ) {
+            if ( i->first == stage ) return i->second;
+        }
+        timings.emplace_back ( stage, StageTiming() );
+        return timings.back().second;
+    }
+    StageList timings;
+};
+
+#endif
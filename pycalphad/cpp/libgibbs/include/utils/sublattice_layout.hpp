@@ -0,0 +1,151 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Flat description of the sublattices of one phase, for loops over its internal coordinates
+
+#ifndef INCLUDED_SUBLATTICE_LAYOUT
+#define INCLUDED_SUBLATTICE_LAYOUT
+
+#include "libgibbs/include/models.hpp"
+#include <boost/assert.hpp>
+#include <cstddef>
+#include <limits>
+#include <set>
+#include <string>
+#include <vector>
+
+/* SublatticeLayout holds what the samplers and converters need to know about the sublattices of a
+ * phase in contiguous arrays, so they do not have to find every sublattice in the sublattice_set
+ * by (phase name, index). The internal coordinates are numbered as in the phase's variable map:
+ * sublattice by sublattice, and by species name within each sublattice.
+ * Components are the species other than vacancies, sorted by name.
+ */
+class SublatticeLayout {
+public:
+    static constexpr std::size_t no_component = std::numeric_limits<std::size_t>::max();
+    SublatticeLayout() : sublattice_offsets ( 1, 0 ) { }
+    // The sublattices of phase_name in sublset
+    SublatticeLayout ( std::string const &phase_name, sublattice_set const &sublset );
+    // The site count and the species of every sublattice, e.g., as read from a file
+    SublatticeLayout ( std::vector<double> const &site_counts, std::vector<std::vector<std::string>> const &species );
+
+    std::size_t sublattice_count() const {
+        return sublattice_sites.size();
+    }
+    std::size_t coordinate_count() const {
+        return coordinate_species.size();
+    }
+    // The coordinates of sublattice are [sublattice_begin(sublattice), sublattice_end(sublattice))
+    std::size_t sublattice_begin ( const std::size_t sublattice ) const {
+        return sublattice_offsets[sublattice];
+    }
+    std::size_t sublattice_end ( const std::size_t sublattice ) const {
+        return sublattice_offsets[sublattice+1];
+    }
+    std::size_t species_count ( const std::size_t sublattice ) const {
+        return sublattice_end ( sublattice ) - sublattice_begin ( sublattice );
+    }
+    double sites ( const std::size_t sublattice ) const {
+        return sublattice_sites[sublattice];
+    }
+    std::string const& species ( const std::size_t coordinate ) const {
+        return coordinate_species[coordinate];
+    }
+    // Index into components() of the species of coordinate, or no_component for a vacancy
+    std::size_t component ( const std::size_t coordinate ) const {
+        return coordinate_components[coordinate];
+    }
+    std::vector<std::string> const& components() const {
+        return component_names;
+    }
+    // The last coordinate of every sublattice, which the others determine
+    std::set<std::size_t> dependent_dimensions() const;
+    // Sites of the sublattices that are not pure vacancy, in whole sites, as EnergyModel::count_mixing_sites()
+    // counts the sites the energy models are normalized by
+    int mixing_sites() const;
+
+    // Mole fractions of components() at the site fractions x (coordinate_count() values) into out (components().size() values)
+    template <typename CoordinateType>
+    void mole_fractions ( CoordinateType const* const x, CoordinateType* const out ) const {
+        CoordinateType denominator = 0;
+        for ( std::size_t i = 0; i < component_names.size(); ++i ) out[i] = 0;
+        for ( std::size_t i = 0; i < coordinate_species.size(); ++i ) {
+            const std::size_t component_id = coordinate_components[i];
+            if ( component_id == no_component ) continue; // vacancies don't contribute here
+            const CoordinateType moles = coordinate_sites[i] * x[i];
+            out[component_id] += moles;
+            denominator += moles;
+        }
+        for ( std::size_t i = 0; i < component_names.size(); ++i ) out[i] /= denominator;
+    }
+private:
+    friend class MoleFractionMatrix;
+    void index_components();
+    std::vector<std::size_t> sublattice_offsets; // sublattice_count()+1 entries
+    std::vector<double> sublattice_sites;
+    std::vector<std::string> coordinate_species;
+    std::vector<double> coordinate_sites; // site count of the sublattice of each coordinate
+    std::vector<std::size_t> coordinate_components;
+    std::vector<std::string> component_names;
+};
+
+/* MoleFractionMatrix is the map from the site fractions of one layout to the mole fractions of a
+ * global list of components, as a sparse matrix with one entry (column, sites) per internal
+ * coordinate that is not a vacancy. Built once per phase, it converts blocks of points straight
+ * into rows of a contiguous array, so that no name lookups are made per point.
+ */
+class MoleFractionMatrix {
+public:
+    MoleFractionMatrix() : column_count ( 0 ) { }
+    // global_components must be sorted and contain every component of layout
+    MoleFractionMatrix ( SublatticeLayout const &layout, std::vector<std::string> const &global_components );
+    std::size_t columns() const {
+        return column_count;
+    }
+    // Row i of out (out + i*out_stride, columns() values) is set to the mole fractions of the
+    // point at points + i*point_stride, for count points; other values of out are not touched
+    // Phases with few coordinates, which are most of them, are converted by loops of a fixed length
+    template <typename CoordinateType>
+    void convert ( CoordinateType const* points, const std::size_t count, const std::size_t point_stride,
+                   CoordinateType* out, const std::size_t out_stride ) const {
+        switch ( entry_coordinates.size() ) {
+        case 1: convert_entries<1> ( points, count, point_stride, out, out_stride ); break;
+        case 2: convert_entries<2> ( points, count, point_stride, out, out_stride ); break;
+        case 3: convert_entries<3> ( points, count, point_stride, out, out_stride ); break;
+        case 4: convert_entries<4> ( points, count, point_stride, out, out_stride ); break;
+        case 5: convert_entries<5> ( points, count, point_stride, out, out_stride ); break;
+        case 6: convert_entries<6> ( points, count, point_stride, out, out_stride ); break;
+        case 7: convert_entries<7> ( points, count, point_stride, out, out_stride ); break;
+        case 8: convert_entries<8> ( points, count, point_stride, out, out_stride ); break;
+        default: convert_entries<0> ( points, count, point_stride, out, out_stride );
+        }
+    }
+private:
+    // As convert(), with Entries entries, or entry_coordinates.size() if Entries == 0
+    template <std::size_t Entries, typename CoordinateType>
+    void convert_entries ( CoordinateType const* points, const std::size_t count, const std::size_t point_stride,
+                           CoordinateType* out, const std::size_t out_stride ) const {
+        const std::size_t entry_count = Entries > 0 ? Entries : entry_coordinates.size();
+        for ( std::size_t point = 0; point < count; ++point, points += point_stride, out += out_stride ) {
+            for ( std::size_t column = 0; column < column_count; ++column ) out[column] = 0;
+            CoordinateType denominator = 0;
+            for ( std::size_t entry = 0; entry < entry_count; ++entry ) {
+                const CoordinateType moles = entry_sites[entry] * points[entry_coordinates[entry]];
+                out[entry_columns[entry]] += moles;
+                denominator += moles;
+            }
+            for ( std::size_t column = 0; column < column_count; ++column ) out[column] /= denominator;
+        }
+    }
+    std::size_t column_count;
+    std::vector<std::size_t> entry_coordinates;
+    std::vector<std::size_t> entry_columns;
+    std::vector<double> entry_sites;
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,109 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Groups of equivalent sublattices of an ordered phase, whose exchange leaves its energy unchanged
+
+#ifndef INCLUDED_SUBLATTICE_SYMMETRY
+#define INCLUDED_SUBLATTICE_SYMMETRY
+
+#include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/utils/sublattice_layout.hpp"
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+class CompositionSet;
+
+/* Ordering models (e.g., L1_2 on four fcc sublattices) describe crystallographically equivalent
+ * sublattices with the same site count, species and parameters, so that any permutation of their site
+ * fractions has the same energy. A SublatticeSymmetry holds such sublattices as groups: every permutation
+ * within each group is a symmetry of the energy, and the points related by them form an orbit of up to
+ * order() points with one energy and one set of mole fractions.
+ * The fundamental domain holds one point of each orbit: those whose blocks of site fractions are in
+ * lexicographically increasing order within each group (canonical()). Sampling only it and folding other
+ * points into it (canonicalize()) evaluates each orbit once; images() expands the orbit of a point where
+ * the other copies are needed. A default constructed SublatticeSymmetry has no groups and changes nothing.
+ */
+class SublatticeSymmetry {
+public:
+    SublatticeSymmetry() : coordinate_count ( 0 ), permutation_count ( 1 ) { }
+    // groups are lists of at least two sublattice indices of layout, which all have the same site count and
+    // species; no sublattice may be in two groups. Throws range_check_error if they are not
+    SublatticeSymmetry ( SublatticeLayout const &layout, std::vector<std::vector<std::size_t>> groups );
+    /* The largest groups of sublattices of phase that the energy is symmetric in under conditions.
+     * Candidates have the same site count and species; a pair of them is taken as equivalent if exchanging
+     * their site fractions changes the energy at a few asymmetric test points by no more than a relative
+     * tolerance. Exchanges of equivalent pairs compose to every permutation of their groups, so pairs are
+     * enough. Parameters that only break the symmetry at other conditions are not seen.
+     */
+    static SublatticeSymmetry detect ( CompositionSet const &phase, evalconditions const &conditions );
+
+    bool empty() const {
+        return sublattice_groups.empty();
+    }
+    std::vector<std::vector<std::size_t>> const& groups() const {
+        return sublattice_groups;
+    }
+    // Number of permutations, the product of the factorials of the group sizes; an upper bound on the size of an orbit
+    std::size_t order() const {
+        return permutation_count;
+    }
+    // Whether the subsimplices with indices subsimplex (one per sublattice) are in the fundamental domain of
+    // a simplex lattice, i.e., their indices are nondecreasing within each group; equivalent sublattices are
+    // subdivided alike, so every combination has exactly one such permutation
+    bool canonical_indices ( std::size_t const* const subsimplex ) const {
+        for ( auto group = sublattice_groups.cbegin(); group != sublattice_groups.cend(); ++group ) {
+            for ( std::size_t i = 1; i < group->size(); ++i ) {
+                if ( subsimplex[ ( *group ) [i]] < subsimplex[ ( *group ) [i-1]] ) return false;
+            }
+        }
+        return true;
+    }
+    // Whether point (laid out as the layout's coordinates) is in the fundamental domain
+    template <typename CoordinateType>
+    bool canonical ( CoordinateType const* const point ) const {
+        for ( auto group = sublattice_groups.cbegin(); group != sublattice_groups.cend(); ++group ) {
+            for ( std::size_t i = 1; i < group->size(); ++i ) {
+                if ( block_less ( point, ( *group ) [i], ( *group ) [i-1] ) ) return false;
+            }
+        }
+        return true;
+    }
+    // Move point to the fundamental domain, e.g., the rounded keys of an EnergyCache
+    template <typename CoordinateType>
+    void canonicalize ( CoordinateType* const point ) const {
+        for ( auto group = sublattice_groups.cbegin(); group != sublattice_groups.cend(); ++group ) {
+            // Insertion sort of the blocks; groups are small
+            for ( std::size_t i = 1; i < group->size(); ++i ) {
+                for ( std::size_t j = i; j > 0 && block_less ( point, ( *group ) [j], ( *group ) [j-1] ); --j ) {
+                    CoordinateType* const block = point + block_begin[ ( *group ) [j]];
+                    std::swap_ranges ( block, block + block_length[ ( *group ) [j]], point + block_begin[ ( *group ) [j-1]] );
+                }
+            }
+        }
+    }
+    // Append the distinct points of the orbit of point, itself first, to out (coordinate_count values each)
+    // and return how many there are
+    std::size_t images ( double const* const point, std::vector<double> &out ) const;
+private:
+    template <typename CoordinateType>
+    bool block_less ( CoordinateType const* const point, const std::size_t first, const std::size_t second ) const {
+        CoordinateType const* const first_block = point + block_begin[first];
+        CoordinateType const* const second_block = point + block_begin[second];
+        return std::lexicographical_compare ( first_block, first_block + block_length[first],
+                                              second_block, second_block + block_length[second] );
+    }
+    std::vector<std::vector<std::size_t>> sublattice_groups; // each sorted
+    std::vector<std::size_t> block_begin; // first coordinate of each sublattice
+    std::vector<std::size_t> block_length; // coordinates of each sublattice, the same within a group
+    std::size_t coordinate_count;
+    std::size_t permutation_count;
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,86 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Placement of worker threads on the CPUs and NUMA nodes of the machine
+
+#ifndef INCLUDED_WORKER_PLACEMENT
+#define INCLUDED_WORKER_PLACEMENT
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// The CPUs this process may run on, grouped by NUMA node
+// On Linux they are read from /sys/devices/system/node and the affinity mask of the process;
+// elsewhere, or if that fails, there is one node with std::thread::hardware_concurrency() CPUs
+class CpuTopology {
+public:
+    static CpuTopology detect();
+    std::size_t node_count() const {
+        return nodes.size();
+    }
+    const std::vector<int>& node_cpus ( const std::size_t node ) const {
+        return nodes[node];
+    }
+    std::size_t cpu_count() const;
+private:
+    std::vector<std::vector<int>> nodes; // never empty, and no node is empty
+};
+
+/* Where each of a number of workers runs. Workers are dealt out to the nodes in turn, each taking the
+ * next unused CPU of its node, so that every node's memory bandwidth is used; with more workers than
+ * CPUs, CPUs are shared. If pinning is enabled, enter() binds the calling thread to the worker's CPU.
+ * Memory is placed on the node of the thread that first writes it (Linux's default policy), and
+ * malloc gives each thread its own arena, so a worker that is pinned before it builds its solver
+ * (Ipopt, compiled systems, global hulls) keeps all of that on its own node.
+ */
+class WorkerPlacement {
+public:
+    WorkerPlacement ( const CpuTopology &topology, const std::size_t workers, const bool pin );
+    std::size_t node_count() const {
+        return nodes;
+    }
+    std::size_t node ( const std::size_t worker ) const {
+        return worker_nodes[worker];
+    }
+    // Workers on each node
+    std::size_t node_workers ( const std::size_t node ) const;
+    // Call first thing in the thread of worker; returns false if it was to be pinned but could not be
+    bool enter ( const std::size_t worker ) const;
+private:
+    std::size_t nodes;
+    std::vector<std::size_t> worker_nodes;
+    std::vector<int> worker_cpus;
+    bool pin;
+};
+
+/* Hands out the indices [0, size) to the workers of a WorkerPlacement. The indices are split into one
+ * contiguous range per node, in proportion to its workers, and rounded to multiples of granularity
+ * (e.g., the rows of a grid, along which neighbouring points warm-start each other). A worker claims
+ * the next index of its own node's range; once that is exhausted, it takes from the other nodes,
+ * nearest (by node number) first, so that work moves between sockets only to balance the load.
+ * claim() may be called from any thread.
+ */
+class NodeLocalClaims {
+public:
+    NodeLocalClaims ( const std::size_t size, const WorkerPlacement &placement, const std::size_t granularity = 1 );
+    // false once every index has been claimed
+    bool claim ( const std::size_t node, std::size_t &index );
+private:
+    // One cache line per range, so that the counters of different nodes do not share one
+    struct Range {
+        std::atomic<std::size_t> next;
+        std::size_t end;
+        char padding[64 - sizeof ( std::atomic<std::size_t> ) - sizeof ( std::size_t )];
+    };
+    std::size_t nodes;
+    std::unique_ptr<Range[]> ranges;
+};
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -7,10 +7,28 @@
 
 #include "libgibbs/include/libgibbs_pch.hpp"
 #include "libgibbs/include/mesh.hpp"
+#include "libgibbs/include/equilibrium.hpp"
+#include "libgibbs/include/optimizer/result_checkpoint.hpp"
+#include "libgibbs/include/utils/ast_serialization.hpp"
+#include "libgibbs/include/utils/worker_placement.hpp"
+#include "libtdb/include/database.hpp"
 #include "libtdb/include/exceptions.hpp"
+#include "libtdb/include/logging.hpp"
+#include <boost/exception/diagnostic_information.hpp>
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 
 
-Mesh::Mesh(const evalconditions &conds) : startpoint(conds) { }; // init Mesh with starting point
+Mesh::Mesh(const evalconditions &conds) : startpoint(conds), checkpoint_interval(64), pin_workers(false) { }; // init Mesh with starting point
 MeshAxis::MeshAxis() { }
 MeshAxis::MeshAxis(const double &argmin, const double &argmax, const double &subint, const MeshAxisType &type) :
 		min(argmin), max(argmax), subinterval(subint), axistype(type) {}
@@ -36,3 +54,503 @@ void Mesh::SetMeshAxis(const std::string &var, const double &min, const double &
 	}
 	SetMeshAxis(var, min, max, interval, MeshAxisType::LINEAR);
 }
+
+void Mesh::SetCheckpoint(const std::string &path, const std::size_t flush_interval) {
+	checkpoint_path = path;
+	checkpoint_interval = flush_interval;
+}
+
+void Mesh::SetWorkerPinning(const bool enabled) {
+	pin_workers = enabled;
+}
+
+std::vector<double> Mesh::ExpandAxis(const MeshAxis &axis) {
+	// partition the transformed range [f(min),f(max)] uniformly, then transform back
+	double (*forward)(double) = nullptr;
+	double (*inverse)(double) = nullptr;
+	switch (axis.axistype) {
+	case MeshAxisType::LINEAR:
+		break;
+	case MeshAxisType::LOGARITHMIC:
+		if (axis.min <= 0) {
+			BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Logarithmic mesh axis must be positive"));
+		}
+		forward = [](double v) { return std::log10(v); };
+		inverse = [](double v) { return std::pow(10.0, v); };
+		break;
+	case MeshAxisType::INVERSE:
+		if (axis.min <= 0) {
+			BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Inverse mesh axis must be positive"));
+		}
+		forward = [](double v) { return 1 / v; };
+		inverse = [](double v) { return 1 / v; };
+		break;
+	default:
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Mesh axis type is not supported"));
+	}
+	if (axis.subinterval <= 0) {
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Mesh point spacing must be positive"));
+	}
+	const double low = forward ? std::min(forward(axis.min), forward(axis.max)) : axis.min;
+	const double high = forward ? std::max(forward(axis.min), forward(axis.max)) : axis.max;
+	// include the end point if it is reached within roundoff
+	const std::size_t intervals = static_cast<std::size_t>(std::floor((high - low) / axis.subinterval + 1e-9));
+	std::vector<double> values;
+	values.reserve(intervals + 1);
+	for (std::size_t i = 0; i <= intervals; ++i) {
+		const double value = low + i * axis.subinterval;
+		values.push_back(inverse ? inverse(value) : value);
+	}
+	std::sort(values.begin(), values.end());
+	return values;
+}
+
+std::vector<evalconditions> Mesh::ExpandPoints(std::vector<std::string> &axis_names, std::vector<std::vector<double>> &axis_values) const {
+	// std::unordered_map has no stable order, so the axes are sorted by name
+	std::map<std::string,MeshAxis> sorted_axes(axes.begin(), axes.end());
+	axis_names.clear();
+	axis_values.clear();
+	std::size_t point_count = 1;
+	for (auto i = sorted_axes.begin(); i != sorted_axes.end(); ++i) {
+		if (!(i->first.size() == 1 || (i->first.size() > 3 && i->first.compare(0, 2, "X(") == 0 && i->first.back() == ')'))) {
+			BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("Mesh axes must be state variables or X(component)") << specific_errinfo(i->first));
+		}
+		axis_names.push_back(i->first);
+		axis_values.push_back(ExpandAxis(i->second));
+		point_count *= axis_values.back().size();
+	}
+
+	std::vector<evalconditions> points;
+	points.reserve(point_count);
+	std::vector<std::size_t> counter(axis_names.size(), 0);
+	for (std::size_t point = 0; point < point_count; ++point) {
+		evalconditions conds = startpoint;
+		for (std::size_t axis = 0; axis < axis_names.size(); ++axis) {
+			const std::string &name = axis_names[axis];
+			const double value = axis_values[axis][counter[axis]];
+			if (name.size() == 1) conds.statevars[name[0]] = value;
+			else conds.xfrac[name.substr(2, name.size() - 3)] = value;
+		}
+		points.push_back(std::move(conds));
+		// advance the mixed-radix counter; the last axis varies fastest
+		for (std::size_t axis = axis_names.size(); axis-- > 0; ) {
+			if (++counter[axis] < axis_values[axis].size()) break;
+			counter[axis] = 0;
+		}
+	}
+	return points;
+}
+
+MeshResult Mesh::solve(const Database &DB, EquilibriumFactory &factory, std::size_t threads, bool keep_equilibria) const {
+	BOOST_LOG_NAMED_SCOPE("Mesh::solve");
+	logger mesh_log(journal::keywords::channel = "optimizer");
+	MeshResult result;
+	const std::vector<evalconditions> points = ExpandPoints(result.axis_names, result.axis_values);
+	const std::size_t axis_count = result.axis_names.size();
+	result.coordinates.reserve(points.size() * axis_count);
+	for (auto i = points.begin(); i != points.end(); ++i) {
+		for (std::size_t axis = 0; axis < axis_count; ++axis) {
+			const std::string &name = result.axis_names[axis];
+			result.coordinates.push_back(name.size() == 1 ? i->statevars.at(name[0]) : i->xfrac.at(name.substr(2, name.size() - 3)));
+		}
+	}
+	result.energies.assign(points.size(), std::numeric_limits<double>::quiet_NaN());
+	if (keep_equilibria) result.equilibria.resize(points.size());
+	std::vector<std::string> errors(points.size());
+
+	// Points of an earlier run on the same grid are taken from the checkpoint
+	std::unique_ptr<ResultCheckpoint> checkpoint;
+	const std::unordered_map<std::size_t,CheckpointedResult> *restored = nullptr;
+	if (!checkpoint_path.empty()) {
+		ASTWriter grid;
+		grid.write_size(axis_count);
+		for (std::size_t axis = 0; axis < axis_count; ++axis) {
+			grid.write(result.axis_names[axis]);
+			grid.write_size(result.axis_values[axis].size());
+			for (auto i = result.axis_values[axis].cbegin(); i != result.axis_values[axis].cend(); ++i) grid.write(*i);
+		}
+		for (auto i = startpoint.statevars.cbegin(); i != startpoint.statevars.cend(); ++i) {
+			grid.write_integer(i->first);
+			grid.write(i->second);
+		}
+		for (auto i = startpoint.xfrac.cbegin(); i != startpoint.xfrac.cend(); ++i) {
+			grid.write(i->first);
+			grid.write(i->second);
+		}
+		for (auto i = startpoint.elements.cbegin(); i != startpoint.elements.cend(); ++i) grid.write(*i);
+		for (auto i = startpoint.phases.cbegin(); i != startpoint.phases.cend(); ++i) {
+			grid.write(i->first);
+			grid.write_integer(static_cast<std::int64_t>(i->second));
+		}
+		checkpoint.reset(new ResultCheckpoint(checkpoint_path, grid.hash(), checkpoint_interval));
+		restored = &checkpoint->restored();
+		for (auto i = restored->cbegin(); i != restored->cend(); ++i) {
+			if (i->first >= points.size()) continue;
+			if (i->second.layout) result.energies[i->first] = i->second.energy;
+			else errors[i->first] = i->second.error;
+		}
+	}
+
+	if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+	threads = std::min(threads, std::max(points.size(), std::size_t(1)));
+	BOOST_LOG_SEV(mesh_log, debug) << "solving " << points.size() << " points using " << threads << " threads";
+
+	// Points are claimed one at a time, so slow points do not hold up the other workers
+	// When a worker claims the point following the one it just solved along the last axis,
+	// that solution is used to warm-start the solver
+	// Each NUMA node has its own block of whole rows; its workers take from the others only once it is done
+	const std::size_t row_length = axis_count > 0 ? result.axis_values.back().size() : 1;
+	const WorkerPlacement placement(CpuTopology::detect(), threads, pin_workers);
+	NodeLocalClaims claims(points.size(), placement, row_length);
+	auto work = [&](EquilibriumFactory &solver, const std::size_t worker) {
+		boost::shared_ptr<Equilibrium> previous;
+		std::size_t previous_point = 0;
+		for (std::size_t point; claims.claim(placement.node(worker), point);) {
+			if (restored && restored->count(point)) continue;
+			// The preceding point along the last axis, if this worker solved it or it was restored
+			const Optimizer::EquilibriumResult<Ipopt::Number> *warm_start = nullptr;
+			Optimizer::EquilibriumResult<Ipopt::Number> restored_start;
+			if (point % row_length != 0) {
+				if (previous && point == previous_point + 1) warm_start = &previous->solution();
+				else if (restored) {
+					const auto before = restored->find(point - 1);
+					if (before != restored->end() && before->second.layout) {
+						restored_start = before->second.expand();
+						warm_start = &restored_start;
+					}
+				}
+			}
+			boost::shared_ptr<Equilibrium> eq;
+			try {
+				if (warm_start) {
+					try {
+						eq = solver.create(DB, points[point], *warm_start);
+					}
+					catch (boost::exception &) {
+						// Retry from the usual starting point below
+					}
+				}
+				if (!eq) eq = solver.create(DB, points[point]);
+				result.energies[point] = eq->GibbsEnergy();
+				if (checkpoint) checkpoint->add(point, eq->solution(), result.energies[point]);
+				if (keep_equilibria) result.equilibria[point] = eq;
+				previous = eq;
+				previous_point = point;
+			}
+			catch (boost::exception &e) {
+				errors[point] = boost::diagnostic_information(e);
+			}
+			catch (std::exception &e) {
+				errors[point] = e.what();
+			}
+			if (checkpoint && !errors[point].empty()) checkpoint->add_failure(point, errors[point]);
+		}
+	};
+	std::vector<std::thread> workers;
+	std::vector<std::exception_ptr> worker_errors(threads);
+	for (std::size_t i = 1; i < threads; ++i) {
+		workers.emplace_back([&, i]() {
+			try {
+				// Pinned before the solver is built, so that its memory is allocated on the worker's node
+				if (!placement.enter(i)) {
+					logger worker_log(journal::keywords::channel = "optimizer");
+					BOOST_LOG_SEV(worker_log, debug) << "worker " << i << " could not be pinned";
+				}
+				EquilibriumFactory solver; // one Ipopt instance per worker
+				solver.SetCacheDirectory(factory.GetCacheDirectory());
+				work(solver, i);
+			}
+			catch (...) {
+				worker_errors[i] = std::current_exception();
+			}
+		});
+	}
+	work(factory, 0);
+	for (auto &worker : workers) worker.join();
+	if (checkpoint) checkpoint->flush(); // before any worker error is rethrown, so that its finished points are kept
+	for (auto i = worker_errors.begin(); i != worker_errors.end(); ++i) {
+		if (*i) std::rethrow_exception(*i);
+	}
+
+	for (std::size_t point = 0; point < points.size(); ++point) {
+		if (!errors[point].empty()) result.failures[point] = errors[point];
+	}
+	if (restored) BOOST_LOG_SEV(mesh_log, debug) << restored->size() << " points were restored from " << checkpoint_path;
+	BOOST_LOG_SEV(mesh_log, debug) << result.failures.size() << " of " << points.size() << " points failed";
+	return result;
+}
+
+namespace {
+// A point solve_adaptive() has still to solve, warm-started from a solved point (or not, if warm_start == none)
+struct AdaptiveTask {
+	std::size_t grid_point;
+	std::size_t slot; // in the solutions
+	std::size_t warm_start;
+};
+}
+
+MeshResult Mesh::solve_adaptive(const Database &DB, EquilibriumFactory &factory, std::size_t coarse_stride, std::size_t threads,
+		bool keep_solutions) const {
+	BOOST_LOG_NAMED_SCOPE("Mesh::solve_adaptive");
+	logger mesh_log(journal::keywords::channel = "optimizer");
+	const std::size_t none = std::numeric_limits<std::size_t>::max();
+	MeshResult result;
+	const std::vector<evalconditions> points = ExpandPoints(result.axis_names, result.axis_values);
+	const std::size_t axis_count = result.axis_names.size();
+	if (coarse_stride == 0) coarse_stride = 1;
+	// Row-major strides of the grid; the last axis varies fastest
+	std::vector<std::size_t> axis_strides(axis_count, 1);
+	for (std::size_t axis = axis_count; axis-- > 1;) {
+		axis_strides[axis-1] = axis_strides[axis] * result.axis_values[axis].size();
+	}
+	auto grid_point = [&](const std::vector<std::size_t> &index) {
+		std::size_t point = 0;
+		for (std::size_t axis = 0; axis < axis_count; ++axis) point += index[axis] * axis_strides[axis];
+		return point;
+	};
+
+	if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+	// The workers keep their factories, and so their compiled systems, from one level of refinement to the next
+	// Each factory is built by its worker the first time it runs, after it is pinned, as in solve()
+	const WorkerPlacement placement(CpuTopology::detect(), threads, pin_workers);
+	std::vector<std::unique_ptr<EquilibriumFactory>> worker_factories(threads > 0 ? threads - 1 : 0);
+	std::vector<Optimizer::CompactEquilibriumResult> solutions;
+	std::vector<std::string> errors;
+	std::unordered_map<std::size_t,std::size_t> solved; // grid point -> slot in solutions
+	// Solve tasks, claimed one at a time and node-local first as in solve()
+	auto solve_tasks = [&](const std::vector<AdaptiveTask> &tasks) {
+		solutions.resize(solutions.size() + tasks.size());
+		errors.resize(solutions.size());
+		NodeLocalClaims claims(tasks.size(), placement);
+		auto work = [&](EquilibriumFactory &solver, const std::size_t worker) {
+			for (std::size_t task_id; claims.claim(placement.node(worker), task_id);) {
+				const AdaptiveTask &task = tasks[task_id];
+				const evalconditions &conds = points[task.grid_point];
+				try {
+					bool warm_started = false;
+					if (task.warm_start != none && solutions[task.warm_start].descriptor) {
+						try {
+							solutions[task.slot] = solver.create_compact(DB, conds, solutions[task.warm_start]);
+							warm_started = true;
+						}
+						catch (boost::exception &) {
+							// Retry from the usual starting point below
+						}
+					}
+					if (!warm_started) solutions[task.slot] = solver.create_compact(DB, conds);
+				}
+				catch (boost::exception &e) {
+					errors[task.slot] = boost::diagnostic_information(e);
+				}
+				catch (std::exception &e) {
+					errors[task.slot] = e.what();
+				}
+			}
+		};
+		const std::size_t level_threads = std::min(threads, std::max(tasks.size(), std::size_t(1)));
+		std::vector<std::thread> workers;
+		std::vector<std::exception_ptr> worker_errors(level_threads);
+		for (std::size_t i = 1; i < level_threads; ++i) {
+			workers.emplace_back([&, i]() {
+				try {
+					// Every level runs in new threads, which go back to the CPU of the first
+					placement.enter(i);
+					if (!worker_factories[i-1]) {
+						worker_factories[i-1].reset(new EquilibriumFactory()); // one Ipopt instance per worker
+						worker_factories[i-1]->SetCacheDirectory(factory.GetCacheDirectory());
+					}
+					work(*worker_factories[i-1], i);
+				}
+				catch (...) {
+					worker_errors[i] = std::current_exception();
+				}
+			});
+		}
+		work(factory, 0);
+		for (auto &worker : workers) worker.join();
+		for (auto i = worker_errors.begin(); i != worker_errors.end(); ++i) {
+			if (*i) std::rethrow_exception(*i);
+		}
+	};
+	// Queue the corners of cell which have not been solved, warm-started from the nearest solved corner of parent
+	auto add_corners = [&](const MeshCell &cell, const MeshCell *parent, std::vector<AdaptiveTask> &tasks) {
+		std::vector<std::size_t> corner(axis_count);
+		for (std::size_t corner_id = 0; corner_id < (std::size_t(1) << axis_count); ++corner_id) {
+			for (std::size_t axis = 0; axis < axis_count; ++axis) {
+				corner[axis] = (corner_id >> axis) & 1 ? cell.upper[axis] : cell.lower[axis];
+			}
+			const std::size_t point = grid_point(corner);
+			if (solved.find(point) != solved.end()) continue;
+			AdaptiveTask task = { point, solved.size(), none };
+			if (parent) {
+				std::size_t nearest_distance = none;
+				for (std::size_t parent_corner = 0; parent_corner < (std::size_t(1) << axis_count); ++parent_corner) {
+					std::size_t distance = 0;
+					std::vector<std::size_t> index(axis_count);
+					for (std::size_t axis = 0; axis < axis_count; ++axis) {
+						index[axis] = (parent_corner >> axis) & 1 ? parent->upper[axis] : parent->lower[axis];
+						distance += index[axis] > corner[axis] ? index[axis] - corner[axis] : corner[axis] - index[axis];
+					}
+					const auto parent_find = solved.find(grid_point(index));
+					if (parent_find != solved.end() && distance < nearest_distance) {
+						nearest_distance = distance;
+						task.warm_start = parent_find->second;
+					}
+				}
+			}
+			solved[point] = task.slot;
+			tasks.push_back(task);
+		}
+	};
+
+	// The coarse grid
+	std::vector<std::vector<std::size_t>> coarse_values(axis_count);
+	for (std::size_t axis = 0; axis < axis_count; ++axis) {
+		const std::size_t value_count = result.axis_values[axis].size();
+		for (std::size_t i = 0; i < value_count; i += coarse_stride) coarse_values[axis].push_back(i);
+		if (coarse_values[axis].back() != value_count - 1) coarse_values[axis].push_back(value_count - 1);
+	}
+	std::vector<MeshCell> cells;
+	std::vector<std::size_t> counter(axis_count, 0);
+	bool more_cells = true;
+	while (more_cells) {
+		MeshCell cell;
+		for (std::size_t axis = 0; axis < axis_count; ++axis) {
+			const std::vector<std::size_t> &values = coarse_values[axis];
+			cell.lower.push_back(values[counter[axis]]);
+			cell.upper.push_back(values[std::min(counter[axis] + 1, values.size() - 1)]);
+		}
+		cells.push_back(std::move(cell));
+		// advance the mixed-radix counter over the cells (a single-valued axis has one cell)
+		more_cells = false;
+		for (std::size_t axis = axis_count; axis-- > 0;) {
+			if (++counter[axis] + 1 < std::max(coarse_values[axis].size(), std::size_t(2))) {
+				more_cells = true;
+				break;
+			}
+			counter[axis] = 0;
+		}
+	}
+	std::vector<AdaptiveTask> tasks;
+	for (auto i = cells.cbegin(); i != cells.cend(); ++i) add_corners(*i, nullptr, tasks);
+
+	std::vector<std::vector<std::string>> stable_phases;
+	std::size_t level = 0;
+	// Cells are examined until none is left to split; the corners of the halves of a cell may all have been
+	// solved already for its neighbours, so a level can have nothing to solve and still have cells to examine
+	while (!cells.empty()) {
+		BOOST_LOG_SEV(mesh_log, debug) << "level " << level << ": solving " << tasks.size() << " points for " << cells.size() << " cells";
+		solve_tasks(tasks);
+		stable_phases.resize(solutions.size());
+		for (auto i = tasks.cbegin(); i != tasks.cend(); ++i) {
+			if (solutions[i->slot].descriptor) stable_phases[i->slot] = solutions[i->slot].stable_phases();
+		}
+		// Split the cells whose solved corners do not agree, along every axis on which they are wider than one interval
+		std::vector<MeshCell> split_cells;
+		tasks.clear();
+		for (auto cell = cells.cbegin(); cell != cells.cend(); ++cell) {
+			bool splittable = false;
+			for (std::size_t axis = 0; axis < axis_count; ++axis) splittable |= cell->upper[axis] - cell->lower[axis] > 1;
+			if (!splittable) {
+				result.cells.push_back(*cell);
+				continue;
+			}
+			const std::vector<std::string> *first_phases = nullptr;
+			bool uniform = true;
+			std::vector<std::size_t> corner(axis_count);
+			for (std::size_t corner_id = 0; corner_id < (std::size_t(1) << axis_count) && uniform; ++corner_id) {
+				for (std::size_t axis = 0; axis < axis_count; ++axis) {
+					corner[axis] = (corner_id >> axis) & 1 ? cell->upper[axis] : cell->lower[axis];
+				}
+				const std::size_t slot = solved.at(grid_point(corner));
+				if (!solutions[slot].descriptor) continue; // failed points say nothing about the phases
+				if (!first_phases) first_phases = &stable_phases[slot];
+				else uniform = *first_phases == stable_phases[slot];
+			}
+			if (uniform) {
+				result.cells.push_back(*cell);
+				continue;
+			}
+			std::vector<std::vector<std::pair<std::size_t,std::size_t>>> halves(axis_count);
+			for (std::size_t axis = 0; axis < axis_count; ++axis) {
+				const std::size_t lower = cell->lower[axis];
+				const std::size_t upper = cell->upper[axis];
+				if (upper - lower > 1) {
+					const std::size_t middle = lower + (upper - lower) / 2;
+					halves[axis].emplace_back(lower, middle);
+					halves[axis].emplace_back(middle, upper);
+				}
+				else halves[axis].emplace_back(lower, upper);
+			}
+			std::vector<std::size_t> half(axis_count, 0);
+			bool more_halves = true;
+			while (more_halves) {
+				MeshCell child;
+				for (std::size_t axis = 0; axis < axis_count; ++axis) {
+					child.lower.push_back(halves[axis][half[axis]].first);
+					child.upper.push_back(halves[axis][half[axis]].second);
+				}
+				add_corners(child, &*cell, tasks);
+				split_cells.push_back(std::move(child));
+				more_halves = false;
+				for (std::size_t axis = 0; axis < axis_count; ++axis) {
+					if (++half[axis] < halves[axis].size()) {
+						more_halves = true;
+						break;
+					}
+					half[axis] = 0;
+				}
+			}
+		}
+		cells = std::move(split_cells);
+		++level;
+	}
+
+	// Gather the solved points in grid order
+	std::vector<std::pair<std::size_t,std::size_t>> order(solved.begin(), solved.end());
+	std::sort(order.begin(), order.end());
+	for (auto i = order.cbegin(); i != order.cend(); ++i) {
+		const evalconditions &conds = points[i->first];
+		const Optimizer::CompactEquilibriumResult &solution = solutions[i->second];
+		for (std::size_t axis = 0; axis < axis_count; ++axis) {
+			const std::string &name = result.axis_names[axis];
+			result.coordinates.push_back(name.size() == 1 ? conds.statevars.at(name[0]) : conds.xfrac.at(name.substr(2, name.size() - 3)));
+		}
+		result.grid_points.push_back(i->first);
+		result.stable_phases.push_back(stable_phases[i->second]);
+		double energy = std::numeric_limits<double>::quiet_NaN();
+		if (solution.descriptor) {
+			try {
+				energy = solution.energy();
+			}
+			catch (boost::exception &e) {
+				errors[i->second] = boost::diagnostic_information(e);
+			}
+		}
+		if (!errors[i->second].empty()) result.failures[result.energies.size()] = errors[i->second];
+		result.energies.push_back(energy);
+		if (keep_solutions) result.solutions.push_back(std::move(solutions[i->second]));
+	}
+	BOOST_LOG_SEV(mesh_log, debug) << "solved " << result.size() << " of " << points.size() << " grid points in " << level << " levels; "
+		<< result.failures.size() << " failed";
+	return result;
+}
+
+void MeshResult::write(std::ostream &stream) const {
+	for (auto i = axis_names.cbegin(); i != axis_names.cend(); ++i) stream << *i << "\t";
+	stream << "GM" << std::endl;
+	stream << std::setprecision(std::numeric_limits<double>::digits10 + 2);
+	const std::size_t axis_count = axis_names.size();
+	for (std::size_t point = 0; point < size(); ++point) {
+		for (std::size_t axis = 0; axis < axis_count; ++axis) stream << coordinates[point * axis_count + axis] << "\t";
+		stream << energies[point] << std::endl;
+	}
+	for (auto i = failures.cbegin(); i != failures.cend(); ++i) {
+		// keep multi-line messages inside their comment
+		std::istringstream message(i->second);
+		std::string line;
+		stream << "# " << i->first << ":";
+		while (std::getline(message, line)) stream << " " << line;
+		stream << std::endl;
+	}
+}
@@ -0,0 +1,199 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// definition for solving a Mesh across the ranks of an MPI communicator
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/mesh_mpi.hpp"
+
+#ifdef LIBGIBBS_WITH_MPI
+
+#include "libgibbs/include/equilibrium.hpp"
+#include "libtdb/include/database.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include "libtdb/include/logging.hpp"
+#include <boost/exception/diagnostic_information.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace {
+enum MessageTag { REQUEST_TAG = 1, WORK_TAG = 2, STOP_TAG = 3 };
+
+/* A worker asks for work by reporting on its last chunk [begin, end), in one MPI_BYTE message:
+ * begin, end, the energies of the chunk, the number of failures, then (point, length, message)
+ * for each failure. The first request reports the empty chunk [0, 0).
+ * Rank 0 answers with WORK_TAG and the next chunk as two std::uint64_t, or with STOP_TAG.
+ */
+template <typename T> void append(std::vector<char> &buffer, const T &value)
+{
+	const std::size_t offset = buffer.size();
+	buffer.resize(offset + sizeof(T));
+	std::memcpy(&buffer[offset], &value, sizeof(T));
+}
+
+template <typename T> T extract(const std::vector<char> &buffer, std::size_t &offset)
+{
+	T value;
+	std::memcpy(&value, &buffer[offset], sizeof(T));
+	offset += sizeof(T);
+	return value;
+}
+
+std::vector<char> encode_report(const std::uint64_t begin, const std::vector<double> &energies,
+		const std::map<std::size_t,std::string> &failures)
+{
+	std::vector<char> buffer;
+	append<std::uint64_t>(buffer, begin);
+	append<std::uint64_t>(buffer, begin + energies.size());
+	for (auto i = energies.cbegin(); i != energies.cend(); ++i) append<double>(buffer, *i);
+	append<std::uint64_t>(buffer, failures.size());
+	for (auto i = failures.cbegin(); i != failures.cend(); ++i) {
+		append<std::uint64_t>(buffer, i->first);
+		append<std::uint64_t>(buffer, i->second.size());
+		buffer.insert(buffer.end(), i->second.begin(), i->second.end());
+	}
+	return buffer;
+}
+
+void decode_report(const std::vector<char> &buffer, MeshResult &result)
+{
+	std::size_t offset = 0;
+	const std::uint64_t begin = extract<std::uint64_t>(buffer, offset);
+	const std::uint64_t end = extract<std::uint64_t>(buffer, offset);
+	for (std::uint64_t point = begin; point < end; ++point) result.energies[point] = extract<double>(buffer, offset);
+	const std::uint64_t failure_count = extract<std::uint64_t>(buffer, offset);
+	for (std::uint64_t i = 0; i < failure_count; ++i) {
+		const std::uint64_t point = extract<std::uint64_t>(buffer, offset);
+		const std::uint64_t length = extract<std::uint64_t>(buffer, offset);
+		result.failures[point] = std::string(&buffer[offset], length);
+		offset += length;
+	}
+}
+
+// Solve points [begin, end) in order, warm-starting each point from the previous one in its row, as Mesh::solve() does
+void solve_chunk(const Database &DB, EquilibriumFactory &factory, const std::vector<evalconditions> &points,
+		const std::size_t row_length, const std::size_t begin, const std::size_t end,
+		std::vector<double> &energies, std::map<std::size_t,std::string> &failures)
+{
+	energies.assign(end - begin, std::numeric_limits<double>::quiet_NaN());
+	failures.clear();
+	boost::shared_ptr<Equilibrium> previous;
+	std::size_t previous_point = 0;
+	for (std::size_t point = begin; point < end; ++point) {
+		const bool neighbour = previous && point == previous_point + 1 && point % row_length != 0;
+		boost::shared_ptr<Equilibrium> eq;
+		try {
+			if (neighbour) {
+				try {
+					eq = factory.create(DB, points[point], *previous);
+				}
+				catch (boost::exception &) {
+					// Retry from the usual starting point below
+				}
+			}
+			if (!eq) eq = factory.create(DB, points[point]);
+			energies[point - begin] = eq->GibbsEnergy();
+			previous = eq;
+			previous_point = point;
+		}
+		catch (boost::exception &e) {
+			failures[point] = boost::diagnostic_information(e);
+		}
+		catch (std::exception &e) {
+			failures[point] = e.what();
+		}
+	}
+}
+}
+
+MeshResult SolveMeshDistributed(const Mesh &mesh, const Database &DB, EquilibriumFactory &factory, MPI_Comm comm,
+		const std::string &result_path) {
+	BOOST_LOG_NAMED_SCOPE("SolveMeshDistributed");
+	logger mesh_log(journal::keywords::channel = "optimizer");
+	int rank, rank_count;
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &rank_count);
+
+	MeshResult result;
+	if (rank_count == 1) {
+		result = mesh.solve(DB, factory);
+	}
+	else if (rank != 0) {
+		std::vector<std::string> axis_names;
+		std::vector<std::vector<double>> axis_values;
+		const std::vector<evalconditions> points = mesh.ExpandPoints(axis_names, axis_values);
+		const std::size_t row_length = axis_names.empty() ? 1 : axis_values.back().size();
+		std::vector<double> energies;
+		std::map<std::size_t,std::string> failures;
+		std::uint64_t begin = 0;
+		for (;;) {
+			std::vector<char> report = encode_report(begin, energies, failures);
+			MPI_Send(&report[0], static_cast<int>(report.size()), MPI_BYTE, 0, REQUEST_TAG, comm);
+			std::uint64_t chunk[2];
+			MPI_Status status;
+			MPI_Recv(chunk, 2, MPI_UINT64_T, 0, MPI_ANY_TAG, comm, &status);
+			if (status.MPI_TAG == STOP_TAG) break;
+			begin = chunk[0];
+			solve_chunk(DB, factory, points, row_length, chunk[0], chunk[1], energies, failures);
+		}
+		return MeshResult();
+	}
+	else {
+		const std::vector<evalconditions> points = mesh.ExpandPoints(result.axis_names, result.axis_values);
+		const std::size_t axis_count = result.axis_names.size();
+		result.coordinates.reserve(points.size() * axis_count);
+		for (auto i = points.begin(); i != points.end(); ++i) {
+			for (std::size_t axis = 0; axis < axis_count; ++axis) {
+				const std::string &name = result.axis_names[axis];
+				result.coordinates.push_back(name.size() == 1 ? i->statevars.at(name[0]) : i->xfrac.at(name.substr(2, name.size() - 3)));
+			}
+		}
+		result.energies.assign(points.size(), std::numeric_limits<double>::quiet_NaN());
+
+		// Guided self-scheduling over whole rows: each chunk is half of an equal share of the rows left
+		const std::size_t row_length = axis_count > 0 ? result.axis_values.back().size() : 1;
+		const std::size_t row_count = points.size() / row_length;
+		const std::size_t worker_count = rank_count - 1;
+		std::size_t next_row = 0;
+		std::size_t active_workers = worker_count;
+		BOOST_LOG_SEV(mesh_log, debug) << "solving " << points.size() << " points on " << worker_count << " ranks";
+		while (active_workers > 0) {
+			MPI_Status status;
+			MPI_Probe(MPI_ANY_SOURCE, REQUEST_TAG, comm, &status);
+			int byte_count;
+			MPI_Get_count(&status, MPI_BYTE, &byte_count);
+			std::vector<char> report(byte_count);
+			MPI_Recv(&report[0], byte_count, MPI_BYTE, status.MPI_SOURCE, REQUEST_TAG, comm, MPI_STATUS_IGNORE);
+			decode_report(report, result);
+			if (next_row < row_count) {
+				const std::size_t rows = std::max(std::size_t(1), (row_count - next_row) / (2 * worker_count));
+				const std::uint64_t chunk[2] = { next_row * row_length, std::min(next_row + rows, row_count) * row_length };
+				next_row += rows;
+				MPI_Send(chunk, 2, MPI_UINT64_T, status.MPI_SOURCE, WORK_TAG, comm);
+			}
+			else {
+				MPI_Send(nullptr, 0, MPI_UINT64_T, status.MPI_SOURCE, STOP_TAG, comm);
+				--active_workers;
+			}
+		}
+		BOOST_LOG_SEV(mesh_log, debug) << result.failures.size() << " of " << points.size() << " points failed";
+	}
+
+	if (!result_path.empty()) {
+		std::ofstream file(result_path.c_str());
+		if (!file) {
+			BOOST_THROW_EXCEPTION(file_read_error() << str_errinfo("Cannot write the mesh result") << specific_errinfo(result_path));
+		}
+		result.write(file);
+	}
+	return result;
+}
+
+#endif
@@ -33,9 +33,11 @@ using namespace boost::multi_index;
 RedlichKisterExcessEnergyModel::RedlichKisterExcessEnergyModel(
 		const std::string &phasename,
 		const sublattice_set &subl_set,
-		const parameter_set &param_set
+		const parameter_set &param_set,
+		const ParameterIndex *index
 		) : EnergyModel(phasename, subl_set, param_set) {
 	BOOST_LOG_NAMED_SCOPE("RedlichKisterExcessEnergyModel::RedlichKisterExcessEnergyModel");
+	parameter_index = index;
 	logger model_log(journal::keywords::channel = "optimizer");
 	BOOST_LOG_SEV(model_log, debug) << "enter";
 	sublattice_set_view ssv;
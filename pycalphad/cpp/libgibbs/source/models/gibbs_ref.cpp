@@ -33,9 +33,11 @@ using namespace boost::multi_index;
 PureCompoundEnergyModel::PureCompoundEnergyModel(
 		const std::string &phasename,
 		const sublattice_set &subl_set,
-		const parameter_set &param_set
+		const parameter_set &param_set,
+		const ParameterIndex *index
 		) : EnergyModel(phasename, subl_set, param_set) {
 	BOOST_LOG_NAMED_SCOPE("PureCompoundEnergyModel::PureCompoundEnergyModel");
+	parameter_index = index;
 	sublattice_set_view ssv;
 	parameter_set_view psv;
 	parameter_set_view psv_subview;
@@ -54,8 +54,10 @@ IHJMagneticModel::IHJMagneticModel(
 		const sublattice_set &subl_set,
 		const parameter_set &param_set,
 		const double &afm_factor,
-		const double &sro_enthalpy_order_fraction
-		) : EnergyModel(phasename, subl_set, param_set) {
+		const double &sro_enthalpy_order_fraction,
+		const ParameterIndex *index
+		) : EnergyModel(phasename, subl_set, param_set), ordering(false), afm(afm_factor), sro_fraction(sro_enthalpy_order_fraction) {
+	parameter_index = index;
 	if (afm_factor == 0 || sro_enthalpy_order_fraction == 0) {
 		// There is no magnetic contribution
 		model_ast = utree(0);
@@ -106,6 +108,7 @@ IHJMagneticModel::IHJMagneticModel(
 		model_ast = utree(0);
 		return;
 	}
+	curie_temperature_ast = Curie_temperature;
 	// Apply AFM factor to TC
 	Curie_temperature = a_o(get_afm_factor(Curie_temperature, afm_factor), Curie_temperature, "*");
         tau = a_o("T", Curie_temperature, "/");
@@ -148,6 +151,8 @@ IHJMagneticModel::IHJMagneticModel(
 		return;
 	}
 
+	mean_magnetic_moment_ast = mean_magnetic_moment;
+	ordering = true;
 	// Apply AFM factor
 	mean_magnetic_moment = a_o(get_afm_factor(mean_magnetic_moment, afm_factor), mean_magnetic_moment, "*");
 
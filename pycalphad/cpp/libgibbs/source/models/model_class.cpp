@@ -11,6 +11,7 @@
 #include <string>
 #include <map>
 #include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/composite_key.hpp>
@@ -64,6 +65,54 @@ utree EnergyModel::add_interaction_factor(const std::string &lhs_varname, const
 	return ret_tree;
 }
 
+// helper function to build a Redlich-Kister series sum_k L_k * (y_i - y_j)**k in Horner form,
+// L_0 + d*(L_1 + d*(L_2 + ...)) with d = y_i - y_j, so that no powers are taken and each order costs
+// one multiplication and one addition; the compiled programs compute d only once
+utree EnergyModel::add_interaction_polynomial(const std::string &lhs_varname, const std::string &rhs_varname, const std::map<double,utree> &coefficients) {
+	utree ret_tree;
+	if (coefficients.empty()) return ret_tree;
+	// Horner's scheme needs nonnegative integer degrees; anything else is summed term by term
+	const bool integral_degrees = std::all_of(coefficients.cbegin(), coefficients.cend(), [] (const std::pair<const double,utree> &term) {
+		return term.first >= 0 && term.first == std::floor(term.first);
+	});
+	if (!integral_degrees) {
+		for (auto term = coefficients.cbegin(); term != coefficients.cend(); ++term) {
+			utree next_term = add_interaction_factor(lhs_varname, rhs_varname, term->first, term->second);
+			if (ret_tree.which() != utree_type::invalid_type) {
+				utree temp_tree;
+				temp_tree.push_back("+");
+				temp_tree.push_back(ret_tree);
+				temp_tree.push_back(next_term);
+				ret_tree.swap(temp_tree);
+			}
+			else ret_tree = std::move(next_term);
+		}
+		return ret_tree;
+	}
+	utree difference_tree;
+	difference_tree.push_back("-");
+	difference_tree.push_back(lhs_varname);
+	difference_tree.push_back(rhs_varname);
+	ret_tree = coefficients.crbegin()->second;
+	for (int degree = int(coefficients.crbegin()->first) - 1; degree >= 0; --degree) {
+		utree product_tree;
+		product_tree.push_back("*");
+		product_tree.push_back(difference_tree);
+		product_tree.push_back(ret_tree);
+		const auto coefficient = coefficients.find(degree);
+		if (coefficient == coefficients.end()) {
+			ret_tree.swap(product_tree); // no parameter of this degree
+			continue;
+		}
+		utree sum_tree;
+		sum_tree.push_back("+");
+		sum_tree.push_back(coefficient->second);
+		sum_tree.push_back(product_tree);
+		ret_tree.swap(sum_tree);
+	}
+	return ret_tree;
+}
+
 utree EnergyModel::Muggianu_normalize_site_fraction(const std::string &sitefrac, std::vector<std::string> &&allfracs) {
 	/*
 	 * When incorporating binary, ternary or n-ary interaction parameters into systems with more than n components,
@@ -161,6 +210,20 @@ utree EnergyModel::find_parameter_ast(const sublattice_set_view &subl_view, cons
 
 	// Now that we have a search configuration, search through the parameters in param_view
 
+	if (parameter_index) {
+		// Look up each parameter type in the view instead of testing every parameter of the phase;
+		// the index only holds exact matches, which are all the loop below accepts
+		if (!param_view.empty()) {
+			const std::string phase = (*param_view.begin())->phasename();
+			const auto &by_type = get<type_index>(param_view);
+			for (auto type_iter = by_type.begin(); type_iter != by_type.end(); type_iter = by_type.upper_bound((*type_iter)->type)) {
+				const auto &found = parameter_index->find(phase, (*type_iter)->type, search_config);
+				matches.insert(matches.end(), found.begin(), found.end());
+			}
+		}
+		param_iter = param_end;
+	}
+
 	while (param_iter != param_end) {
 		if (search_config.size() != (*param_iter)->constituent_array.size()) {
 			// skip if sublattice counts do not match
@@ -244,6 +307,9 @@ utree EnergyModel::find_parameter_ast(const sublattice_set_view &subl_view, cons
 			// it shouldn't be a problem, it should just mean we matched some based on wildcards
 			// (this is just here as a note)
 		}
+		// binary interaction parameters of all degrees are collected into one Redlich-Kister series
+		std::string series_lhs_var, series_rhs_var;
+		std::map<double,utree> series_coefficients;
 		for (auto param = minwilds.begin(); param != minwilds.end(); ++param) {
 			BOOST_LOG_SEV(model_log,  debug) << "looping minwilds " << std::distance(minwilds.begin(),param);
 			const auto array_begin = param->second->constituent_array.begin();
@@ -262,6 +328,14 @@ utree EnergyModel::find_parameter_ast(const sublattice_set_view &subl_view, cons
 					varname2 << param->second->phasename() << "_" << std::distance(array_begin,j) << "_" << (*j)[1];
 					lhs_var = varname1.str();
 					rhs_var = varname2.str();
+					if (series_coefficients.empty() || (lhs_var == series_lhs_var && rhs_var == series_rhs_var)) {
+						// the factor of (y_i - y_j)**k, where k is the degree and i,j are interacting, is added with the whole series
+						series_lhs_var = lhs_var;
+						series_rhs_var = rhs_var;
+						series_coefficients[param->second->degree] = param->second->ast;
+						BOOST_LOG_SEV(model_log, debug) << "Binary series term " << param->second->degree << " = " << param->second->ast;
+						break;
+					}
 					// add to the parameter tree a factor of (y_i - y_j)**k, where k is the degree and i,j are interacting
 					next_term = add_interaction_factor(lhs_var, rhs_var, param->second->degree, param->second->ast);
 					BOOST_LOG_SEV(model_log, debug) << "Binary next_term = " << next_term;
@@ -307,6 +381,19 @@ utree EnergyModel::find_parameter_ast(const sublattice_set_view &subl_view, cons
 			}
 		}
 
+		if (!series_coefficients.empty()) {
+			utree series_tree = add_interaction_polynomial(series_lhs_var, series_rhs_var, series_coefficients);
+			BOOST_LOG_SEV(model_log, debug) << "Binary series = " << series_tree;
+			if (ret_tree.which() != utree_type::invalid_type) {
+				utree temp_tree;
+				temp_tree.push_back("+");
+				temp_tree.push_back(ret_tree);
+				temp_tree.push_back(series_tree);
+				ret_tree.swap(temp_tree);
+			}
+			else ret_tree = std::move(series_tree);
+		}
+
 		if (minwilds.size() == 0) {
 			BOOST_THROW_EXCEPTION(internal_error() << specific_errinfo("Failed to match parameter, but the parameter had already been found"));
 		}
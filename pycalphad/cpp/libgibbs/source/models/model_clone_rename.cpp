@@ -35,3 +35,8 @@ std::unique_ptr<EnergyModel> EnergyModel::clone_with_renamed_phase (
     BOOST_LOG_SEV( opto_log, debug ) << "returning";
     return std::move ( copymodel );
 }
+
+std::unique_ptr<EnergyModel> EnergyModel::clone() const
+{
+    return std::unique_ptr<EnergyModel> ( new EnergyModel ( *this ) );
+}
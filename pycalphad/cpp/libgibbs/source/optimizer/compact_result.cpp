@@ -0,0 +1,283 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Equilibrium results stored as dense vectors against a shared descriptor of the problem
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/compact_result.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <utility>
+
+namespace Optimizer {
+
+namespace {
+std::size_t position_of(const std::vector<std::string> &names, const std::string &name)
+{
+	const auto name_find = std::lower_bound(names.begin(), names.end(), name);
+	if (name_find == names.end() || *name_find != name) {
+		BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("Unknown variable in equilibrium result") << specific_errinfo(name));
+	}
+	return std::distance(names.begin(), name_find);
+}
+
+// The keys of map, in order, against names
+template <typename Map, typename Names> bool same_keys(const Map &map, const Names &names)
+{
+	if (map.size() != names.size()) return false;
+	auto name = names.begin();
+	for (auto i = map.begin(); i != map.end(); ++i, ++name) {
+		if (i->first != *name) return false;
+	}
+	return true;
+}
+
+// The values of map, in order, which has the keys of the descriptor
+template <typename Map> std::vector<double> values_of(const Map &map)
+{
+	std::vector<double> values;
+	values.reserve(map.size());
+	for (auto i = map.begin(); i != map.end(); ++i) values.push_back(i->second);
+	return values;
+}
+}
+
+ResultDescriptor::ResultDescriptor(EquilibriumResult<double> &result)
+{
+	describe(result);
+	auto entry = phase_entries.begin();
+	for (auto i = result.phases.begin(); i != result.phases.end(); ++i, ++entry) {
+		entry->compositionset = std::move(i->second.compositionset);
+	}
+}
+
+ResultDescriptor::ResultDescriptor(const EquilibriumResult<double> &result)
+{
+	describe(result);
+	auto entry = phase_entries.begin();
+	for (auto i = result.phases.cbegin(); i != result.phases.cend(); ++i, ++entry) {
+		entry->compositionset = CompositionSet(i->second.compositionset);
+	}
+}
+
+void ResultDescriptor::describe(const EquilibriumResult<double> &result)
+{
+	typedef boost::bimap<std::string, int>::value_type position;
+	for (auto i = result.variables.cbegin(); i != result.variables.cend(); ++i) {
+		variable_indices.insert(position(i->first, variables.size()));
+		variables.push_back(i->first);
+	}
+	for (auto i = result.constraint_multipliers.cbegin(); i != result.constraint_multipliers.cend(); ++i) {
+		constraints.push_back(i->first);
+	}
+	for (auto i = result.conditions.statevars.cbegin(); i != result.conditions.statevars.cend(); ++i) {
+		statevars.push_back(i->first);
+	}
+	for (auto i = result.conditions.xfrac.cbegin(); i != result.conditions.xfrac.cend(); ++i) {
+		xfracs.push_back(i->first);
+	}
+	system_elements = result.conditions.elements;
+	for (auto i = result.phases.cbegin(); i != result.phases.cend(); ++i) {
+		PhaseEntry entry;
+		entry.name = i->first;
+		entry.status = i->second.status;
+		entry.phase_fraction = position_of(variables, i->first + "_FRAC");
+		const SublatticeLayout &layout = i->second.compositionset.sublattice_layout();
+		const boost::bimap<std::string, int> &phase_variables = i->second.compositionset.get_variable_map();
+		for (std::size_t coordinate = 0; coordinate < layout.coordinate_count(); ++coordinate) {
+			entry.coordinates.push_back(position_of(variables, phase_variables.right.at(coordinate)));
+		}
+		phase_entries.push_back(std::move(entry));
+	}
+}
+
+bool ResultDescriptor::matches(const EquilibriumResult<double> &result) const
+{
+	if (!same_keys(result.variables, variables) || !same_keys(result.constraint_multipliers, constraints)
+			|| !same_keys(result.conditions.statevars, statevars) || !same_keys(result.conditions.xfrac, xfracs)
+			|| result.conditions.elements != system_elements || result.phases.size() != phase_entries.size()) {
+		return false;
+	}
+	auto entry = phase_entries.cbegin();
+	for (auto i = result.phases.cbegin(); i != result.phases.cend(); ++i, ++entry) {
+		if (i->first != entry->name || i->second.status != entry->status) return false;
+	}
+	return true;
+}
+
+const ResultDescriptor::PhaseEntry& ResultDescriptor::phase(const std::string &name) const
+{
+	for (auto i = phase_entries.cbegin(); i != phase_entries.cend(); ++i) {
+		if (i->name == name) return *i;
+	}
+	BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("Unknown phase in equilibrium result") << specific_errinfo(name));
+}
+
+CompactEquilibriumResult::CompactEquilibriumResult(EquilibriumResult<double> &&result, std::shared_ptr<const ResultDescriptor> shared) :
+	walltime(result.walltime),
+	itercount(result.itercount),
+	N(result.N),
+	descriptor(std::move(shared))
+{
+	if (!descriptor || !descriptor->matches(result)) {
+		descriptor = std::make_shared<const ResultDescriptor>(result);
+	}
+	x = values_of(result.variables);
+	lower_multipliers = values_of(result.lower_multipliers);
+	upper_multipliers = values_of(result.upper_multipliers);
+	constraint_multipliers = values_of(result.constraint_multipliers);
+	condition_values = values_of(result.conditions.statevars);
+	const std::vector<double> xfrac_values = values_of(result.conditions.xfrac);
+	condition_values.insert(condition_values.end(), xfrac_values.begin(), xfrac_values.end());
+}
+
+CompactEquilibriumResult::CompactEquilibriumResult(const EquilibriumResult<double> &values, std::shared_ptr<const ResultDescriptor> shared) :
+	walltime(values.walltime),
+	itercount(values.itercount),
+	N(values.N),
+	descriptor(std::move(shared))
+{
+	BOOST_ASSERT(same_keys(values.variables, descriptor->variable_names()));
+	BOOST_ASSERT(same_keys(values.constraint_multipliers, descriptor->constraint_names()));
+	x = values_of(values.variables);
+	lower_multipliers = values_of(values.lower_multipliers);
+	upper_multipliers = values_of(values.upper_multipliers);
+	constraint_multipliers = values_of(values.constraint_multipliers);
+	condition_values = values_of(values.conditions.statevars);
+	const std::vector<double> xfrac_values = values_of(values.conditions.xfrac);
+	condition_values.insert(condition_values.end(), xfrac_values.begin(), xfrac_values.end());
+}
+
+evalconditions CompactEquilibriumResult::conditions() const
+{
+	evalconditions conds;
+	const std::vector<char> &statevars = descriptor->statevar_names();
+	const std::vector<std::string> &xfracs = descriptor->xfrac_names();
+	for (std::size_t i = 0; i < statevars.size(); ++i) {
+		conds.statevars[statevars[i]] = condition_values[i];
+	}
+	for (std::size_t i = 0; i < xfracs.size(); ++i) {
+		conds.xfrac[xfracs[i]] = condition_values[statevars.size() + i];
+	}
+	conds.elements = descriptor->elements();
+	for (auto i = descriptor->phases().cbegin(); i != descriptor->phases().cend(); ++i) {
+		conds.phases[i->name] = i->status;
+	}
+	return conds;
+}
+
+double CompactEquilibriumResult::variable(const std::string &name) const
+{
+	return x[position_of(descriptor->variable_names(), name)];
+}
+
+double CompactEquilibriumResult::phase_fraction(const std::string &phase) const
+{
+	return x[descriptor->phase(phase).phase_fraction];
+}
+
+double CompactEquilibriumResult::mole_fraction(const std::string &species, const std::string &phase) const
+{
+	const ResultDescriptor::PhaseEntry &entry = descriptor->phase(phase);
+	const SublatticeLayout &layout = entry.compositionset.sublattice_layout();
+	const std::vector<std::string> &components = layout.components();
+	const auto component_find = std::lower_bound(components.begin(), components.end(), species);
+	if (component_find == components.end() || *component_find != species) return 0;
+	std::vector<double> site_fractions(entry.coordinates.size());
+	for (std::size_t i = 0; i < entry.coordinates.size(); ++i) {
+		site_fractions[i] = x[entry.coordinates[i]];
+	}
+	std::vector<double> mole_fractions(components.size());
+	layout.mole_fractions(site_fractions.data(), mole_fractions.data());
+	return mole_fractions[std::distance(components.begin(), component_find)];
+}
+
+double CompactEquilibriumResult::mole_fraction(const std::string &species) const
+{
+	double moles = 0;
+	double total = 0;
+	for (auto i = descriptor->phases().cbegin(); i != descriptor->phases().cend(); ++i) {
+		const double phasefrac = x[i->phase_fraction];
+		moles += phasefrac * mole_fraction(species, i->name);
+		total += phasefrac;
+	}
+	return moles / total;
+}
+
+std::vector<std::string> CompactEquilibriumResult::stable_phases(const double minimum_fraction) const
+{
+	std::vector<std::string> names;
+	for (auto i = descriptor->phases().cbegin(); i != descriptor->phases().cend(); ++i) {
+		if (x[i->phase_fraction] <= minimum_fraction) continue;
+		names.push_back(i->name.substr(0, i->name.find('#'))); // composition sets are named PHASE#n
+	}
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+double CompactEquilibriumResult::energy(const std::string &phase) const
+{
+	const CompositionSet &compositionset = descriptor->phase(phase).compositionset;
+	return compositionset.evaluate_objective(compositionset.bind(conditions(), descriptor->variable_map()), x.data());
+}
+
+double CompactEquilibriumResult::energy() const
+{
+	const evalconditions conds = conditions();
+	double retval = 0;
+	for (auto i = descriptor->phases().cbegin(); i != descriptor->phases().cend(); ++i) {
+		const CompiledBinding binding = i->compositionset.bind(conds, descriptor->variable_map());
+		retval += x[i->phase_fraction] * i->compositionset.evaluate_objective(binding, x.data());
+	}
+	return retval;
+}
+
+EquilibriumResult<double> CompactEquilibriumResult::expand() const
+{
+	EquilibriumResult<double> result;
+	result.walltime = walltime;
+	result.itercount = itercount;
+	result.N = N;
+	const std::vector<std::string> &variables = descriptor->variable_names();
+	for (std::size_t i = 0; i < variables.size(); ++i) {
+		result.variables.emplace_hint(result.variables.end(), variables[i], x[i]);
+		result.lower_multipliers.emplace_hint(result.lower_multipliers.end(), variables[i], lower_multipliers[i]);
+		result.upper_multipliers.emplace_hint(result.upper_multipliers.end(), variables[i], upper_multipliers[i]);
+	}
+	const std::vector<std::string> &constraints = descriptor->constraint_names();
+	for (std::size_t i = 0; i < constraints.size(); ++i) {
+		result.constraint_multipliers.emplace_hint(result.constraint_multipliers.end(), constraints[i], constraint_multipliers[i]);
+	}
+	result.conditions = conditions();
+	return result;
+}
+
+EquilibriumResult<double> CompactEquilibriumResult::restore() const
+{
+	EquilibriumResult<double> result = expand();
+	for (auto i = descriptor->phases().cbegin(); i != descriptor->phases().cend(); ++i) {
+		Phase<double> phase;
+		phase.f = x[i->phase_fraction];
+		phase.status = i->status;
+		const SublatticeLayout &layout = i->compositionset.sublattice_layout();
+		for (std::size_t sublindex = 0; sublindex < layout.sublattice_count(); ++sublindex) {
+			Sublattice<double> subl;
+			subl.sitecount = layout.sites(sublindex);
+			for (std::size_t coordinate = layout.sublattice_begin(sublindex); coordinate < layout.sublattice_end(sublindex); ++coordinate) {
+				Component<double> comp;
+				comp.site_fraction = x[i->coordinates[coordinate]];
+				subl.components[layout.species(coordinate)] = comp;
+			}
+			phase.sublattices.push_back(subl);
+		}
+		phase.compositionset = CompositionSet(i->compositionset);
+		result.phases.emplace(i->name, std::move(phase));
+	}
+	return result;
+}
+}
@@ -0,0 +1,188 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// definition for CompiledSystem class
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/compiled_system.hpp"
+#include "libgibbs/include/optimizer/utils/build_variable_map.hpp"
+#include "libtdb/include/logging.hpp"
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+using namespace Optimizer;
+
+namespace {
+// Increment whenever the serialized format or anything the models are built from changes
+const std::string cache_format = "libgibbs compiled system 4";
+}
+
+CompiledSystem::CompiledSystem ( const Database &DB, const evalconditions &conditions ) :
+    CompiledSystem ( DB, conditions, std::string() )
+{
+}
+
+CompiledSystem::CompiledSystem ( const Database &DB, const evalconditions &conditions, const std::string &cache_directory ) :
+    database ( &DB ),
+    sourcename ( DB.get_info() ),
+    system_elements ( conditions.elements ),
+    entered_phase_names ( entered_phases ( conditions ) )
+{
+    BOOST_LOG_NAMED_SCOPE ( "CompiledSystem::CompiledSystem" );
+    logger opto_log ( journal::keywords::channel = "optimizer" );
+    BOOST_LOG_SEV ( opto_log, debug ) << "enter ctor";
+
+    for ( auto i = DB.get_phase_iterator(); i != DB.get_phase_iterator_end(); ++i ) {
+        if ( entered_phase_names.find ( i->first ) != entered_phase_names.end() ) {
+            phase_col[i->first] = i->second;
+        }
+    }
+
+    main_ss = build_variable_map ( phase_col.begin(), phase_col.end(), conditions, main_indices );
+
+    // The key covers the elements, the structure of all entered phases and all of their parameters
+    const parameter_set pset = DB.get_parameter_set();
+    ASTWriter key_data;
+    key_data.write ( cache_format );
+    key_data.write_size ( system_elements.size() );
+    for ( auto i = system_elements.cbegin(); i != system_elements.cend(); ++i ) {
+        key_data.write ( *i );
+    }
+    key_data.write_size ( phase_col.size() );
+    for ( auto i = phase_col.cbegin(); i != phase_col.cend(); ++i ) {
+        key_data.write ( i->first );
+        key_data.write ( i->second.magnetic_afm_factor );
+        key_data.write ( i->second.magnetic_sro_enthalpy_order_fraction );
+        for ( auto j = i->second.get_sublattice_iterator(); j != i->second.get_sublattice_iterator_end(); ++j ) {
+            key_data.write ( j->stoi_coef );
+            key_data.write_size ( std::distance ( j->get_species_iterator(), j->get_species_iterator_end() ) );
+            for ( auto k = j->get_species_iterator(); k != j->get_species_iterator_end(); ++k ) {
+                key_data.write ( *k );
+            }
+        }
+        auto param_range = boost::multi_index::get<phase_index> ( pset ).equal_range ( i->first );
+        key_data.write_size ( std::distance ( param_range.first, param_range.second ) );
+        for ( auto param = param_range.first; param != param_range.second; ++param ) {
+            key_data.write ( param->type );
+            key_data.write_size ( param->constituent_array.size() );
+            for ( auto subl = param->constituent_array.cbegin(); subl != param->constituent_array.cend(); ++subl ) {
+                key_data.write_size ( subl->size() );
+                for ( auto spec = subl->cbegin(); spec != subl->cend(); ++spec ) {
+                    key_data.write ( *spec );
+                }
+            }
+            key_data.write ( param->degree );
+            key_data.write ( param->ast );
+        }
+    }
+    key = key_data.hash();
+
+    std::stringstream cache_path;
+    if ( !cache_directory.empty() ) {
+        cache_path << cache_directory << "/" << std::hex << std::setw ( 16 ) << std::setfill ( '0' ) << key << ".cset";
+        if ( read_cache ( cache_path.str() ) ) {
+            BOOST_LOG_SEV ( opto_log, debug ) << "read " << comp_sets.size() << " composition sets from " << cache_path.str();
+            return;
+        }
+    }
+
+    // This is the expensive part: building the model ASTs and all their derivatives
+    parameter_index = ParameterIndex::of ( DB );
+    for ( auto i = phase_col.begin(); i != phase_col.end(); ++i ) {
+        comp_sets.emplace ( i->first, CompositionSet ( i->second, pset, main_ss, main_indices, parameter_index.get() ) );
+    }
+    BOOST_LOG_SEV ( opto_log, debug ) << "built " << comp_sets.size() << " composition sets with "
+                                      << main_indices.size() << " variables";
+    if ( !cache_directory.empty() ) write_cache ( cache_path.str() );
+}
+
+bool CompiledSystem::read_cache ( const std::string &path )
+{
+    BOOST_LOG_NAMED_SCOPE ( "CompiledSystem::read_cache" );
+    logger opto_log ( journal::keywords::channel = "optimizer" );
+    try {
+        // The file is mapped read-only, so workers starting at the same time share the OS page cache
+        boost::interprocess::file_mapping file ( path.c_str(), boost::interprocess::read_only );
+        boost::interprocess::mapped_region region ( file, boost::interprocess::read_only );
+        const char* const data = static_cast<const char*> ( region.get_address() );
+        ASTReader reader ( data, data + region.get_size() );
+        if ( reader.read_string() != cache_format || static_cast<std::uint64_t> ( reader.read_integer() ) != key ) {
+            BOOST_LOG_SEV ( opto_log, debug ) << path << " was written for different inputs";
+            return false;
+        }
+        std::map<std::string,CompositionSet> cached_comp_sets;
+        for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+            CompositionSet comp_set ( reader );
+            const std::string name = comp_set.name();
+            cached_comp_sets.emplace ( name, std::move ( comp_set ) );
+        }
+        if ( !reader.at_end() || cached_comp_sets.size() != phase_col.size() ) {
+            BOOST_LOG_SEV ( opto_log, debug ) << path << " is corrupt";
+            return false;
+        }
+        comp_sets = std::move ( cached_comp_sets );
+        return true;
+    }
+    catch ( boost::interprocess::interprocess_exception & ) {
+        // Not there yet (or not readable); just build the composition sets
+        return false;
+    }
+    catch ( boost::exception &e ) {
+        BOOST_LOG_SEV ( opto_log, debug ) << path << " could not be read: " << boost::diagnostic_information ( e );
+        return false;
+    }
+}
+
+void CompiledSystem::write_cache ( const std::string &path ) const
+{
+    BOOST_LOG_NAMED_SCOPE ( "CompiledSystem::write_cache" );
+    logger opto_log ( journal::keywords::channel = "optimizer" );
+    ASTWriter writer;
+    writer.write ( cache_format );
+    writer.write_integer ( static_cast<std::int64_t> ( key ) );
+    writer.write_size ( comp_sets.size() );
+    for ( auto i = comp_sets.cbegin(); i != comp_sets.cend(); ++i ) {
+        i->second.serialize ( writer );
+    }
+    // Other processes may be reading or writing the same file, so write to a temporary file
+    // and move it into place, which replaces the old file atomically
+    std::stringstream temp_path;
+    temp_path << path << "." << std::hex << std::random_device()() << ".tmp";
+    std::ofstream out ( temp_path.str().c_str(), std::ios::binary );
+    out.write ( writer.data().data(), writer.data().size() );
+    out.close();
+    if ( !out || std::rename ( temp_path.str().c_str(), path.c_str() ) != 0 ) {
+        // The cache is only an optimization, so this is not an error
+        BOOST_LOG_SEV ( opto_log, debug ) << "could not write " << path;
+        std::remove ( temp_path.str().c_str() );
+        return;
+    }
+    BOOST_LOG_SEV ( opto_log, debug ) << "wrote " << writer.data().size() << " bytes to " << path;
+}
+
+bool CompiledSystem::matches ( const Database &DB, const evalconditions &conditions ) const
+{
+    if ( &DB != database || DB.get_info() != sourcename ) return false;
+    if ( conditions.elements != system_elements ) return false;
+    return entered_phases ( conditions ) == entered_phase_names;
+}
+
+std::set<std::string> CompiledSystem::entered_phases ( const evalconditions &conditions )
+{
+    std::set<std::string> names;
+    for ( auto i = conditions.phases.cbegin(); i != conditions.phases.cend(); ++i ) {
+        if ( i->second == PhaseStatus::ENTERED ) names.insert ( i->first );
+    }
+    return names;
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
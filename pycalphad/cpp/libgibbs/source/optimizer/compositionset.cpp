@@ -10,6 +10,7 @@
 #include "libgibbs/include/libgibbs_pch.hpp"
 #include "libtdb/include/logging.hpp"
 #include "libgibbs/include/compositionset.hpp"
+#include "libgibbs/include/utils/hot_path_logging.hpp"
 #include "libgibbs/include/utils/ast_container_rename.hpp"
 #include "libgibbs/include/utils/ast_multi_index_rename.hpp"
 #include "libgibbs/include/utils/math_expr.hpp"
@@ -22,31 +23,118 @@
 #include <boost/numeric/ublas/operation.hpp>
 #include <boost/numeric/ublas/io.hpp>
 #include <boost/bimap.hpp>
+#include <boost/assert.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
 
 using boost::multi_index_container;
 using namespace boost::multi_index;
 
+namespace {
+// The binary interactions of phase_name and the ASTs of their coefficients, if they are all that
+// RedlichKisterExcessEnergyModel makes of its parameters: every parameter of type G or L other than a pure compound
+// has two different species on one sublattice and one on each other, no wildcards, and a nonnegative integral
+// degree which no other parameter of the same constituents has. Parameters of species the phase does not have
+// are not used by the model either, and are skipped
+bool binary_interactions (
+    std::string const &phase_name,
+    SublatticeLayout const &layout,
+    parameter_set const &pset,
+    std::vector<FixedShapeInteraction> &interactions,
+    std::vector<boost::spirit::utree> &coefficients )
+{
+    const std::size_t sublattice_count = layout.sublattice_count();
+    // coordinates of the constituents, the second species right after the first -> (interacting sublattice, degree -> AST)
+    std::map<std::vector<std::size_t>, std::pair<std::size_t, std::map<int, boost::spirit::utree>>> series;
+    const auto param_range = boost::multi_index::get<phase_index> ( pset ).equal_range ( phase_name );
+    for ( auto param = param_range.first; param != param_range.second; ++param ) {
+        if ( param->type != "G" && param->type != "L" ) continue;
+        const auto &array = param->constituent_array;
+        if ( array.size() != sublattice_count ) return false;
+        std::size_t interacting = sublattice_count;
+        std::vector<std::size_t> constituents;
+        bool in_phase = true;
+        for ( std::size_t sublattice = 0; sublattice < sublattice_count; ++sublattice ) {
+            if ( array[sublattice].empty() || array[sublattice].size() > 2 ) return false;
+            if ( array[sublattice].size() == 2 ) {
+                if ( interacting != sublattice_count ) return false; // a reciprocal interaction
+                interacting = sublattice;
+            }
+            for ( auto species = array[sublattice].cbegin(); species != array[sublattice].cend(); ++species ) {
+                if ( *species == "*" ) return false;
+                std::size_t coordinate = layout.sublattice_begin ( sublattice );
+                while ( coordinate < layout.sublattice_end ( sublattice ) && layout.species ( coordinate ) != *species ) ++coordinate;
+                if ( coordinate == layout.sublattice_end ( sublattice ) ) in_phase = false;
+                constituents.push_back ( coordinate );
+            }
+        }
+        if ( interacting == sublattice_count || !in_phase ) continue; // a pure compound, or not of this phase's species
+        if ( array[interacting][0] == array[interacting][1] ) return false;
+        if ( param->degree < 0 || param->degree != std::floor ( param->degree ) ) return false;
+        auto &terms = series[constituents];
+        terms.first = interacting;
+        if ( !terms.second.insert ( std::make_pair ( int ( param->degree ), param->ast ) ).second ) return false;
+    }
+    for ( auto i = series.cbegin(); i != series.cend(); ++i ) {
+        FixedShapeInteraction interaction;
+        interaction.sublattice = i->second.first;
+        for ( std::size_t position = 0; position < i->first.size(); ++position ) {
+            if ( position == interaction.sublattice + 1 ) interaction.second = i->first[position];
+            else interaction.constituents.push_back ( i->first[position] );
+        }
+        interaction.first_coefficient = coefficients.size();
+        interaction.degree_count = i->second.second.rbegin()->first + 1;
+        for ( int degree = 0; degree < int ( interaction.degree_count ); ++degree ) {
+            const auto coefficient = i->second.second.find ( degree );
+            coefficients.push_back ( coefficient != i->second.second.end() ? coefficient->second : boost::spirit::utree ( 0.0 ) );
+        }
+        interactions.push_back ( std::move ( interaction ) );
+    }
+    return true;
+}
+}
+
 CompositionSet::CompositionSet (
     const Phase &phaseobj,
     const parameter_set &pset,
     const sublattice_set &sublset,
-    boost::bimap<std::string, int> const &main_indices )
+    boost::bimap<std::string, int> const &main_indices,
+    ParameterIndex const *parameter_index )
 {
     typedef boost::bimap<std::string, int>::value_type position;
     BOOST_LOG_NAMED_SCOPE ( "CompositionSet::CompositionSet" );
     logger comp_log ( journal::keywords::channel = "optimizer" );
     cset_name = phaseobj.name();
+    std::shared_ptr<CompiledModel> model ( std::make_shared<CompiledModel>() );
+    model->phase_name = cset_name;
+    auto &models = model->models;
 
     // Now initialize the appropriate models
-    models["PURE_ENERGY"] = std::unique_ptr<EnergyModel> ( new PureCompoundEnergyModel ( phaseobj.name(), sublset, pset ) );
+    models["PURE_ENERGY"] = std::unique_ptr<EnergyModel> ( new PureCompoundEnergyModel ( phaseobj.name(), sublset, pset, parameter_index ) );
     models["IDEAL_MIX"] = std::unique_ptr<EnergyModel> ( new IdealMixingModel ( phaseobj.name(), sublset ) );
-    models["REDLICH_KISTER"] = std::unique_ptr<EnergyModel> ( new RedlichKisterExcessEnergyModel ( phaseobj.name(), sublset, pset ) );
-    models["IHJ_MAGNETIC"] = std::unique_ptr<EnergyModel> ( new IHJMagneticModel ( phaseobj.name(), sublset, pset,
-                             phaseobj.magnetic_afm_factor, phaseobj.magnetic_sro_enthalpy_order_fraction ) );
+    models["REDLICH_KISTER"] = std::unique_ptr<EnergyModel> ( new RedlichKisterExcessEnergyModel ( phaseobj.name(), sublset, pset, parameter_index ) );
+    IHJMagneticModel* const magnetic_model = new IHJMagneticModel ( phaseobj.name(), sublset, pset,
+            phaseobj.magnetic_afm_factor, phaseobj.magnetic_sro_enthalpy_order_fraction, parameter_index );
+    models["IHJ_MAGNETIC"] = std::unique_ptr<EnergyModel> ( magnetic_model );
+    if ( magnetic_model->has_ordering() ) {
+        model->magnetic_parameters.push_back ( magnetic_model->curie_temperature() );
+        model->magnetic_parameters.push_back ( magnetic_model->mean_magnetic_moment() );
+        model->afm_factor = magnetic_model->afm_factor();
+        model->sro_enthalpy_order_fraction = magnetic_model->sro_enthalpy_order_fraction();
+    }
 
     for ( auto i = models.begin(); i != models.end(); ++i ) {
         auto symbol_table = i->second->get_symbol_table();
-        symbols.insert ( symbol_table.begin(), symbol_table.end() ); // copy model symbols into main symbol table
+        model->symbols.insert ( symbol_table.begin(), symbol_table.end() ); // copy model symbols into main symbol table
         // TODO: we don't check for duplicate symbols at all here...models police themselves to avoid collisions
         // One idea: put all symbols into model-specific namespaces
         for ( auto j = symbol_table.begin(); j != symbol_table.end(); ++j ) {
@@ -54,49 +142,25 @@ CompositionSet::CompositionSet (
         }
     }
 
-    // Calculate first derivative ASTs of all variables
-    for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i ) {
-        std::list<std::string> diffvars;
-        diffvars.push_back ( i->first );
-        if ( !boost::algorithm::starts_with ( i->first, cset_name ) ) {
-            // the differentiating variable doesn't come from this composition set
-            // the derivative should be zero, so skip calculation
-            continue;
-        }
-        for ( auto j = models.cbegin(); j != models.cend(); ++j ) {
-            boost::spirit::utree difftree;
-            if ( i->first == ( cset_name + "_FRAC" ) ) {
-                // the derivative w.r.t the phase fraction is just the energy of this phase
-                difftree = j->second->get_ast();
-            } else {
-                difftree = simplify_utree ( differentiate_utree ( j->second->get_ast(), i->first, symbols ) );
-            }
-            if ( !is_zero_tree ( difftree ) ) {
-                tree_data.insert ( ast_entry ( diffvars, j->first, difftree ) );
-            }
-
-            // Calculate second derivative ASTs of all variables (doesn't include constraint contribution)
-            for ( auto k = main_indices.left.begin(); k != main_indices.left.end(); ++k ) {
-                // second derivative of obj function w.r.t i,j
-                if ( i->second > k->second ) {
-                    continue;    // skip upper triangular
-                }
-                std::list<std::string> second_diffvars = diffvars;
-                second_diffvars.push_back ( k->first );
-                if ( k->first == ( cset_name + "_FRAC" ) ) {
-                    // second derivative w.r.t phase fraction is zero
-                } else if ( !boost::algorithm::starts_with ( k->first, cset_name ) ) {
-                    // the differentiating variable doesn't come from this composition set
-                    // the derivative should be zero, so skip calculation
-                } else {
-                    boost::spirit::utree second_difftree = simplify_utree ( differentiate_utree ( difftree, k->first, symbols ) );
-                    if ( !is_zero_tree ( second_difftree ) ) {
-                        tree_data.insert ( ast_entry ( second_diffvars, j->first, second_difftree ) );
-                    }
-                }
+    // Only this phase's own variables (its site fractions and phase fraction) have nonzero derivatives
+    // They are kept in the (name) order of main_indices, so tree_data is always filled in the same order
+    {
+        std::set<std::string> own_variables;
+        own_variables.insert ( cset_name + "_FRAC" );
+        for ( int sublindex = 0; ; ++sublindex ) {
+            auto subl_range = boost::multi_index::get<phase_subl> ( sublset ).equal_range ( boost::make_tuple ( phaseobj.name(), sublindex ) );
+            if ( subl_range.first == subl_range.second ) break;
+            for ( auto subl = subl_range.first; subl != subl_range.second; ++subl ) {
+                own_variables.insert ( subl->name() );
             }
         }
+        for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i ) {
+            if ( own_variables.count ( i->first ) ) derivative_variables.emplace_back ( i->first, i->second );
+        }
     }
+    // The derivative ASTs themselves are built on demand; see get_derivative_trees()
+    tree_data_built = false;
+    layout = SublatticeLayout ( phaseobj.name(), sublset );
 
     // Add the mandatory site fraction balance constraints
     boost::multi_index::index<sublattice_set,phase_subl>::type::iterator ic0,ic1;
@@ -160,11 +224,396 @@ CompositionSet::CompositionSet (
         }
     }
 
-    build_constraint_basis_matrices ( sublset ); // Construct the orthonormal basis in the constraints
+    build_constraint_basis_matrices(); // Construct the orthonormal basis in the constraints
+    compile_expressions ( *model );
+    const bool with_excess = binary_interactions ( phaseobj.name(), layout, pset, model->interactions, model->interaction_coefficients );
+    compile_fixed_shape ( *model, layout, with_excess );
+    compile_magnetic ( *model, layout );
+    share_model ( std::move ( model ) );
+}
+
+ast_set const& CompositionSet::get_derivative_trees() const
+{
+    std::lock_guard<std::mutex> lock ( tree_data_mutex );
+    if ( !tree_data_built ) {
+        build_derivative_trees();
+        tree_data_built = true;
+    }
+    // tree_data is not modified again, so it can be read after unlocking
+    return *tree_data;
+}
+
+void CompositionSet::build_derivative_trees() const
+{
+    BOOST_LOG_NAMED_SCOPE ( "CompositionSet::build_derivative_trees" );
+    logger comp_log ( journal::keywords::channel = "optimizer" );
+    auto const &models = compiled_model->models;
+    auto const &symbols = compiled_model->symbols;
+    const std::string phase_fraction_name = compiled_model->phase_name + "_FRAC";
+    // Each (variable, model) pair is independent: its first derivative and the lower-triangular row of
+    // second derivatives are generated by a worker thread, then inserted into tree_data in task order
+    std::vector<decltype ( models.cbegin() ) > model_list;
+    for ( auto j = models.cbegin(); j != models.cend(); ++j ) model_list.push_back ( j );
+    const std::size_t task_count = derivative_variables.size() * model_list.size();
+    std::vector<std::vector<ast_entry>> task_results ( task_count );
+    std::vector<std::exception_ptr> task_errors ( task_count );
+    auto derivative_task = [&] ( const std::size_t task ) {
+        auto i = derivative_variables.cbegin() + task / model_list.size();
+        auto j = model_list[task % model_list.size()];
+        std::vector<ast_entry> &results = task_results[task];
+        // The trees are swapped into results; utree has no move constructor, so passing them would copy every node
+        auto keep = [&] ( std::list<std::string> vars, boost::spirit::utree &tree ) {
+            results.emplace_back ( std::move ( vars ), j->first, boost::spirit::utree() );
+            results.back().ast.swap ( tree );
+        };
+        std::list<std::string> diffvars;
+        diffvars.push_back ( i->first );
+        boost::spirit::utree difftree;
+        if ( i->first == phase_fraction_name ) {
+            // the derivative w.r.t the phase fraction is just the energy of this phase
+            difftree = j->second->get_ast();
+        } else {
+            boost::spirit::utree derivative = differentiate_utree ( j->second->get_ast(), i->first, symbols );
+            simplify_utree_in_place ( derivative );
+            difftree.swap ( derivative );
+        }
+        const bool first_derivative_kept = !is_zero_tree ( difftree );
+        if ( first_derivative_kept ) {
+            keep ( diffvars, difftree );
+        }
+
+        // Calculate second derivative ASTs of all variables (doesn't include constraint contribution)
+        for ( auto k = derivative_variables.cbegin(); k != derivative_variables.cend(); ++k ) {
+            // second derivative of obj function w.r.t i,j
+            if ( i->second > k->second ) {
+                continue;    // skip upper triangular
+            }
+            if ( k->first == phase_fraction_name ) {
+                continue;    // second derivative w.r.t phase fraction is zero
+            }
+            std::list<std::string> second_diffvars = diffvars;
+            second_diffvars.push_back ( k->first );
+            // the kept first derivative is in results, which may have been reallocated since
+            boost::spirit::utree const &first_derivative = first_derivative_kept ? results.front().ast : difftree;
+            boost::spirit::utree second_difftree = differentiate_utree ( first_derivative, k->first, symbols );
+            simplify_utree_in_place ( second_difftree );
+            if ( !is_zero_tree ( second_difftree ) ) {
+                keep ( std::move ( second_diffvars ), second_difftree );
+            }
+        }
+    };
+    // Calculate first and second derivative ASTs of all variables
+    const std::size_t thread_count = std::min ( std::max ( std::size_t ( std::thread::hardware_concurrency() ), std::size_t ( 1 ) ), std::max ( task_count, std::size_t ( 1 ) ) );
+    std::atomic<std::size_t> next_task ( 0 );
+    auto worker = [&] () {
+        for ( std::size_t task = next_task++; task < task_count; task = next_task++ ) {
+            try {
+                derivative_task ( task );
+            } catch ( ... ) {
+                task_errors[task] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for ( std::size_t t = 1; t < thread_count; ++t ) {
+        workers.emplace_back ( worker );
+    }
+    worker(); // this thread works too
+    for ( auto &thread : workers ) {
+        thread.join();
+    }
+    std::shared_ptr<ast_set> trees ( std::make_shared<ast_set>() );
+    for ( std::size_t task = 0; task < task_count; ++task ) {
+        if ( task_errors[task] ) {
+            std::rethrow_exception ( task_errors[task] );
+        }
+        for ( auto &entry : task_results[task] ) {
+            trees->insert ( std::move ( entry ) );
+        }
+    }
+    if ( compiled_model->phase_name != cset_name ) {
+        // trees of a shared model carry the variable names of the composition set it was built for
+        *trees = ast_copy_with_renamed_phase ( *trees, compiled_model->phase_name, cset_name );
+    }
+    tree_data = std::move ( trees );
+    BOOST_LOG_SEV ( comp_log, debug ) << cset_name << ": generated derivative ASTs of " << derivative_variables.size() << " variables using " << thread_count << " threads";
+}
+
+CompositionSet::CompositionSet ( const CompositionSet &other ) :
+    cset_name ( other.cset_name ),
+    starting_point ( other.starting_point ),
+    first_derivatives ( other.first_derivatives ),
+    phase_indices ( other.phase_indices ),
+    jac_g_trees ( other.jac_g_trees ),
+    hessian_data ( other.hessian_data ),
+    derivative_variables ( other.derivative_variables ),
+    cm ( other.cm ),
+    constraint_null_space_matrix ( other.constraint_null_space_matrix ),
+    layout ( other.layout ),
+    gradient_projector ( other.gradient_projector ),
+    compiled_model ( other.compiled_model ),
+    binding_slots ( other.binding_slots ),
+    native_kernels ( other.native_kernels ),
+    phase_fraction_slot ( other.phase_fraction_slot )
+{
+    std::lock_guard<std::mutex> lock ( other.tree_data_mutex );
+    tree_data = other.tree_data;
+    tree_data_built = other.tree_data_built;
+}
+
+namespace {
+void write_matrix ( ASTWriter &writer, boost::numeric::ublas::matrix<double> const &mat )
+{
+    writer.write_size ( mat.size1() );
+    writer.write_size ( mat.size2() );
+    for ( std::size_t i = 0; i < mat.size1(); ++i ) {
+        for ( std::size_t j = 0; j < mat.size2(); ++j ) {
+            writer.write ( mat ( i,j ) );
+        }
+    }
+}
+boost::numeric::ublas::matrix<double> read_matrix ( ASTReader &reader )
+{
+    const std::size_t rows = reader.read_size();
+    const std::size_t columns = reader.read_size();
+    boost::numeric::ublas::matrix<double> mat ( rows, columns );
+    for ( std::size_t i = 0; i < rows; ++i ) {
+        for ( std::size_t j = 0; j < columns; ++j ) {
+            mat ( i,j ) = reader.read_double();
+        }
+    }
+    return mat;
+}
+}
+
+void CompositionSet::serialize ( ASTWriter &writer ) const
+{
+    writer.write ( cset_name );
+    writer.write_size ( starting_point.size() );
+    for ( auto i = starting_point.cbegin(); i != starting_point.cend(); ++i ) {
+        writer.write ( i->first );
+        writer.write ( i->second );
+    }
+    // A shared model is written with the variable names of this composition set, so the reader can compile it as is
+    const std::string &model_phase_name = compiled_model->phase_name;
+    const bool renamed = ( model_phase_name != cset_name );
+    writer.write_size ( compiled_model->models.size() );
+    for ( auto i = compiled_model->models.cbegin(); i != compiled_model->models.cend(); ++i ) {
+        writer.write ( i->first );
+        boost::spirit::utree model_ast = i->second->get_ast();
+        if ( renamed ) {
+            ast_variable_rename ( model_ast, model_phase_name, cset_name );
+        }
+        writer.write ( model_ast );
+        const auto model_symbols = i->second->get_symbol_table();
+        ASTSymbolMap symbol_table ( model_symbols.begin(), model_symbols.end() );
+        if ( renamed ) {
+            symbol_table = ast_copy_with_renamed_phase ( symbol_table, model_phase_name, cset_name );
+        }
+        writer.write_size ( std::distance ( symbol_table.begin(), symbol_table.end() ) );
+        for ( auto j = symbol_table.begin(); j != symbol_table.end(); ++j ) {
+            writer.write ( j->first );
+            writer.write ( j->second.get() );
+        }
+    }
+    writer.write_size ( first_derivatives.size() );
+    for ( auto i = first_derivatives.cbegin(); i != first_derivatives.cend(); ++i ) {
+        writer.write_integer ( i->first );
+        writer.write ( i->second );
+    }
+    writer.write_size ( phase_indices.size() );
+    for ( auto i = phase_indices.left.begin(); i != phase_indices.left.end(); ++i ) {
+        writer.write ( i->first );
+        writer.write_integer ( i->second );
+    }
+    writer.write_size ( jac_g_trees.size() );
+    for ( auto i = jac_g_trees.cbegin(); i != jac_g_trees.cend(); ++i ) {
+        writer.write_integer ( i->cons_index );
+        writer.write_integer ( i->var_index );
+        writer.write_integer ( i->trivial );
+        writer.write ( i->ast );
+    }
+    writer.write_size ( hessian_data.size() );
+    for ( auto i = hessian_data.begin(); i != hessian_data.end(); ++i ) {
+        writer.write_integer ( i->var_index1 );
+        writer.write_integer ( i->var_index2 );
+        writer.write_size ( i->asts.size() );
+        for ( auto j = i->asts.cbegin(); j != i->asts.cend(); ++j ) {
+            writer.write_integer ( j->first );
+            writer.write ( j->second );
+        }
+    }
+    ast_set const &derivative_trees = get_derivative_trees();
+    writer.write_size ( derivative_trees.size() );
+    for ( auto i = derivative_trees.begin(); i != derivative_trees.end(); ++i ) {
+        writer.write_size ( i->diffvars.size() );
+        for ( auto j = i->diffvars.cbegin(); j != i->diffvars.cend(); ++j ) {
+            writer.write ( *j );
+        }
+        writer.write ( i->model_name );
+        writer.write ( i->ast );
+    }
+    writer.write ( renamed ? ast_copy_with_renamed_phase ( compiled_model->symbols, model_phase_name, cset_name ) : compiled_model->symbols );
+    writer.write_size ( cm.constraints.size() );
+    for ( auto i = cm.constraints.cbegin(); i != cm.constraints.cend(); ++i ) {
+        writer.write ( i->lhs );
+        writer.write ( i->rhs );
+        writer.write_integer ( static_cast<std::int64_t> ( i->op ) );
+        writer.write ( i->name );
+    }
+    write_matrix ( writer, constraint_null_space_matrix );
+    write_matrix ( writer, gradient_projector );
+    writer.write_size ( layout.sublattice_count() );
+    for ( std::size_t sublattice = 0; sublattice < layout.sublattice_count(); ++sublattice ) {
+        writer.write ( layout.sites ( sublattice ) );
+        writer.write_size ( layout.species_count ( sublattice ) );
+        for ( std::size_t i = layout.sublattice_begin ( sublattice ); i < layout.sublattice_end ( sublattice ); ++i ) {
+            writer.write ( layout.species ( i ) );
+        }
+    }
+    writer.write_integer ( compiled_model->fixed_shape_excess );
+    if ( compiled_model->fixed_shape_excess ) {
+        writer.write_size ( compiled_model->interactions.size() );
+        for ( auto i = compiled_model->interactions.cbegin(); i != compiled_model->interactions.cend(); ++i ) {
+            writer.write_size ( i->constituents.size() );
+            for ( auto j = i->constituents.cbegin(); j != i->constituents.cend(); ++j ) writer.write_size ( *j );
+            writer.write_size ( i->sublattice );
+            writer.write_size ( i->second );
+            writer.write_size ( i->degree_count );
+            for ( std::size_t degree = 0; degree < i->degree_count; ++degree ) {
+                boost::spirit::utree coefficient = compiled_model->interaction_coefficients[i->first_coefficient + degree];
+                if ( renamed ) ast_variable_rename ( coefficient, model_phase_name, cset_name );
+                writer.write ( coefficient );
+            }
+        }
+    }
+    writer.write_size ( compiled_model->magnetic_parameters.size() );
+    for ( auto i = compiled_model->magnetic_parameters.cbegin(); i != compiled_model->magnetic_parameters.cend(); ++i ) {
+        boost::spirit::utree parameter = *i;
+        if ( renamed ) ast_variable_rename ( parameter, model_phase_name, cset_name );
+        writer.write ( parameter );
+    }
+    writer.write ( compiled_model->afm_factor );
+    writer.write ( compiled_model->sro_enthalpy_order_fraction );
+}
+
+CompositionSet::CompositionSet ( ASTReader &reader )
+{
+    typedef boost::bimap<std::string, int>::value_type position;
+    BOOST_LOG_NAMED_SCOPE ( "CompositionSet::CompositionSet(ASTReader&)" );
+    logger comp_log ( journal::keywords::channel = "optimizer" );
+    cset_name = reader.read_string();
+    std::shared_ptr<CompiledModel> model ( std::make_shared<CompiledModel>() );
+    model->phase_name = cset_name;
+    for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+        const std::string name = reader.read_string();
+        starting_point[name] = reader.read_double();
+    }
+    for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+        const std::string model_name = reader.read_string();
+        const boost::spirit::utree model_ast = reader.read_utree();
+        const ASTSymbolMap model_symbols = reader.read_symbols();
+        model->models[model_name] = std::unique_ptr<EnergyModel> ( new EnergyModel ( model_ast, model_symbols ) );
+    }
+    for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+        const int index = reader.read_integer();
+        first_derivatives[index] = reader.read_utree();
+    }
+    for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+        const std::string name = reader.read_string();
+        phase_indices.insert ( position ( name, reader.read_integer() ) );
+    }
+    for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+        const int cons_index = reader.read_integer();
+        const int var_index = reader.read_integer();
+        const bool trivial = reader.read_integer() != 0;
+        jac_g_trees.push_back ( jacobian_entry ( cons_index, var_index, trivial, reader.read_utree() ) );
+    }
+    for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+        const int var_index1 = reader.read_integer();
+        const int var_index2 = reader.read_integer();
+        hessian_entry h_entry ( var_index1, var_index2 );
+        for ( std::size_t j = 0, ast_count = reader.read_size(); j < ast_count; ++j ) {
+            const int cons_index = reader.read_integer();
+            h_entry.asts[cons_index] = reader.read_utree();
+        }
+        hessian_data.insert ( h_entry );
+    }
+    std::shared_ptr<ast_set> trees ( std::make_shared<ast_set>() );
+    for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+        std::list<std::string> diffvars;
+        for ( std::size_t j = 0, var_count = reader.read_size(); j < var_count; ++j ) {
+            diffvars.push_back ( reader.read_string() );
+        }
+        const std::string model_name = reader.read_string();
+        trees->insert ( ast_entry ( diffvars, model_name, reader.read_utree() ) );
+    }
+    tree_data = std::move ( trees );
+    tree_data_built = true;
+    model->symbols = reader.read_symbols();
+    for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+        Constraint cons;
+        cons.lhs = reader.read_utree();
+        cons.rhs = reader.read_utree();
+        cons.op = static_cast<ConstraintOperatorType> ( reader.read_integer() );
+        cons.name = reader.read_string();
+        cm.addConstraint ( cons );
+    }
+    constraint_null_space_matrix = read_matrix ( reader );
+    gradient_projector = read_matrix ( reader );
+    {
+        std::vector<double> site_counts;
+        std::vector<std::vector<std::string>> species;
+        for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+            site_counts.push_back ( reader.read_double() );
+            species.emplace_back();
+            for ( std::size_t j = 0, species_count = reader.read_size(); j < species_count; ++j ) {
+                species.back().push_back ( reader.read_string() );
+            }
+        }
+        layout = SublatticeLayout ( site_counts, species );
+    }
+    const bool with_excess = reader.read_integer() != 0;
+    if ( with_excess ) {
+        for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+            FixedShapeInteraction interaction;
+            for ( std::size_t j = 0, constituent_count = reader.read_size(); j < constituent_count; ++j ) {
+                interaction.constituents.push_back ( reader.read_size() );
+            }
+            interaction.sublattice = reader.read_size();
+            interaction.second = reader.read_size();
+            interaction.first_coefficient = model->interaction_coefficients.size();
+            interaction.degree_count = reader.read_size();
+            bool valid = interaction.constituents.size() == layout.sublattice_count()
+                         && interaction.sublattice < layout.sublattice_count() && interaction.second < layout.coordinate_count();
+            for ( auto j = interaction.constituents.cbegin(); j != interaction.constituents.cend(); ++j ) {
+                valid = valid && *j < layout.coordinate_count();
+            }
+            if ( !valid ) {
+                BOOST_THROW_EXCEPTION ( malformed_object_error() << str_errinfo ( "Serialized interaction is not of the sublattices of the phase" ) << specific_errinfo ( cset_name ) );
+            }
+            for ( std::size_t degree = 0; degree < interaction.degree_count; ++degree ) {
+                model->interaction_coefficients.push_back ( reader.read_utree() );
+            }
+            model->interactions.push_back ( std::move ( interaction ) );
+        }
+    }
+    for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+        model->magnetic_parameters.push_back ( reader.read_utree() );
+    }
+    model->afm_factor = reader.read_double();
+    model->sro_enthalpy_order_fraction = reader.read_double();
+    compile_expressions ( *model );
+    compile_fixed_shape ( *model, layout, with_excess );
+    compile_magnetic ( *model, layout );
+    share_model ( std::move ( model ) );
+    BOOST_LOG_SEV ( comp_log, debug ) << "read composition set " << cset_name;
 }
 
 // make CompositionSet from another CompositionSet; used for miscibility gaps
-// this will create a copy
+// The energy models and their programs are shared with other instead of being copied, renamed and
+// recompiled; the new variable names are applied when binding. Setup cost and memory therefore do
+// not grow with the size of the models as more miscibility gaps are found.
 CompositionSet::CompositionSet (
     const CompositionSet &other,
     const std::map<std::string,double> &new_starting_point,
@@ -184,23 +633,22 @@ CompositionSet::CompositionSet (
     BOOST_LOG_SEV( comp_log, debug ) << "new starting_point set";
 
     // Copy everything else from the parent CompositionSet
-    // Deep copy/rename the model map
-    for ( auto energymod = other.models.begin(); energymod != other.models.end(); ++energymod ) {
-        BOOST_LOG_SEV( comp_log, debug ) << "init DCR EnergyModel " << energymod->first;
-        models.emplace ( energymod->first,energymod->second->clone_with_renamed_phase ( old_phase_name, new_phase_name ) );
-        BOOST_LOG_SEV( comp_log, debug ) << "DCR complete EnergyModel " << energymod->first;
-    }
-    BOOST_LOG_SEV( comp_log, debug ) << "DCR EnergyModels complete";
     jac_g_trees = ast_copy_with_renamed_phase ( other.jac_g_trees, old_phase_name, new_phase_name );
     BOOST_LOG_SEV( comp_log, debug ) << "DCR jac_g_trees";
     hessian_data = ast_copy_with_renamed_phase ( other.hessian_data, old_phase_name, new_phase_name );
     BOOST_LOG_SEV( comp_log, debug ) << "DCR hessian_data";
-    tree_data = ast_copy_with_renamed_phase ( other.tree_data, old_phase_name, new_phase_name ) ;
+    derivative_variables = other.derivative_variables; // named after the shared models
+    {
+        // Trees the parent has already built are renamed; otherwise they are built from the shared models when needed
+        std::lock_guard<std::mutex> lock ( other.tree_data_mutex );
+        tree_data_built = other.tree_data_built;
+        if ( tree_data_built ) {
+            tree_data = std::make_shared<ast_set> ( ast_copy_with_renamed_phase ( *other.tree_data, old_phase_name, new_phase_name ) );
+        }
+    }
     BOOST_LOG_SEV( comp_log, debug ) << "DCR tree_data";
     first_derivatives = ast_copy_with_renamed_phase ( other.first_derivatives, old_phase_name, new_phase_name );
     BOOST_LOG_SEV( comp_log, debug ) << "DCR first_derivatives";
-    symbols = ast_copy_with_renamed_phase ( other.symbols, old_phase_name, new_phase_name );
-    BOOST_LOG_SEV( comp_log, debug ) << "DCR symbols";
     cm = ConstraintManager();
     for ( const auto &old_cons : other.cm.constraints ) {
         Constraint new_cons ( old_cons );
@@ -212,6 +660,9 @@ CompositionSet::CompositionSet (
     phase_indices = ast_copy_with_renamed_phase ( other.phase_indices, old_phase_name, new_phase_name );
     BOOST_LOG_SEV( comp_log, debug ) << "DCR phase_indices";
     constraint_null_space_matrix = other.constraint_null_space_matrix;
+    layout = other.layout; // the variable names are not part of it
+    share_model ( other.compiled_model );
+    native_kernels = other.native_kernels; // compiled against the same slots
     BOOST_LOG_SEV( comp_log, debug ) << "exiting";
 }
 double CompositionSet::evaluate_objective (
@@ -219,60 +670,181 @@ double CompositionSet::evaluate_objective (
     boost::bimap<std::string, int> const &main_indices,
     double* const x ) const
 {
-    BOOST_LOG_NAMED_SCOPE ( "CompositionSet::evaluate_objective(evalconditions const& conditions,boost::bimap<std::string, int> const &main_indices,double* const x)" );
-    double objective = 0;
-    const std::string compset_name ( cset_name + "_FRAC" );
-
-    for ( auto i = models.cbegin(); i != models.cend(); ++i ) {
-        objective += process_utree ( i->second->get_ast(), conditions, main_indices, symbols, x ).get<double>();
-    }
-    return objective;
+    HOT_PATH_NAMED_SCOPE ( "CompositionSet::evaluate_objective(evalconditions const& conditions,boost::bimap<std::string, int> const &main_indices,double* const x)" );
+    return evaluate_objective ( bind ( conditions, main_indices ), x );
 }
 double CompositionSet::evaluate_objective (
     evalconditions const &conditions, std::map<std::string,double> const &variables ) const
 {
     // Need to translate this variable map into something process_utree can understand
-    BOOST_LOG_NAMED_SCOPE ( "CompositionSet::evaluate_objective(evalconditions const &conditions, std::map<std::string,double> const &variables)" );
-    logger comp_log ( journal::keywords::channel = "optimizer" );
-    BOOST_LOG_SEV ( comp_log, debug ) << "enter";
+    HOT_PATH_NAMED_SCOPE ( "CompositionSet::evaluate_objective(evalconditions const &conditions, std::map<std::string,double> const &variables)" );
+    HOT_PATH_LOGGER ( comp_log, "optimizer" );
+    HOT_PATH_LOG_SEV ( comp_log, debug ) << "enter";
     double vars[variables.size()]; // Create Ipopt-style double array
     boost::bimap<std::string, int> main_indices;
     typedef boost::bimap<std::string, int>::value_type position;
     for ( auto i = variables.begin(); i != variables.end(); ++i ) {
         vars[std::distance ( variables.begin(),i )] = i->second; // Copy values into array
-        BOOST_LOG_SEV ( comp_log, debug ) << "main_indices.insert(" << i->first << ", " << std::distance ( variables.begin(), i ) << ")";
+        HOT_PATH_LOG_SEV ( comp_log, debug ) << "main_indices.insert(" << i->first << ", " << std::distance ( variables.begin(), i ) << ")";
         main_indices.insert ( position ( i->first, std::distance ( variables.begin(),i ) ) ); // Create fictitious indices
     }
     for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i ) {
-        BOOST_LOG_SEV ( comp_log, debug ) << i->first << " -> " << i->second;
+        HOT_PATH_LOG_SEV ( comp_log, debug ) << i->first << " -> " << i->second;
     }
-    BOOST_LOG_SEV ( comp_log, debug ) << "returning";
+    HOT_PATH_LOG_SEV ( comp_log, debug ) << "returning";
     return evaluate_objective ( conditions, main_indices, vars );
 }
 
+void CompositionSet::evaluate_objective_batch (
+    evalconditions const& conditions,
+    boost::bimap<std::string, int> const &main_indices,
+    double const* const points,
+    std::size_t const npoints,
+    double* const out ) const
+{
+    HOT_PATH_NAMED_SCOPE ( "CompositionSet::evaluate_objective_batch" );
+    const EvaluationTrace::Scope trace ( compiled_model->energy_trace, npoints );
+    const CompiledBinding binding = bind ( conditions, main_indices );
+    const std::size_t stride = main_indices.size();
+
+    std::fill ( out, out + npoints, 0.0 );
+    const std::vector<CompiledExpression> &programs = objective_programs ( binding );
+    for ( auto i = programs.cbegin(); i != programs.cend(); ++i ) {
+        if ( !replaced_program ( binding, i - programs.cbegin() ) ) i->evaluate_batch ( binding, points, npoints, stride, out );
+    }
+    add_kernel_batch ( binding, points, npoints, stride, out );
+}
+void CompositionSet::evaluate_objective_batch (
+    evalconditions const& conditions,
+    double const* const points,
+    std::size_t const npoints,
+    double* const out ) const
+{
+    evaluate_objective_batch ( conditions, phase_indices, points, npoints, out );
+}
+void CompositionSet::evaluate_objective_batch (
+    evalconditions const& conditions,
+    double const* const points,
+    std::size_t const npoints,
+    std::size_t const stride,
+    double* const out ) const
+{
+    HOT_PATH_NAMED_SCOPE ( "CompositionSet::evaluate_objective_batch" );
+    const EvaluationTrace::Scope trace ( compiled_model->energy_trace, npoints );
+    BOOST_ASSERT ( stride >= phase_indices.size() );
+    const CompiledBinding binding = bind ( conditions, phase_indices );
+
+    std::fill ( out, out + npoints, 0.0 );
+    const std::vector<CompiledExpression> &programs = objective_programs ( binding );
+    for ( auto i = programs.cbegin(); i != programs.cend(); ++i ) {
+        if ( !replaced_program ( binding, i - programs.cbegin() ) ) i->evaluate_batch ( binding, points, npoints, stride, out );
+    }
+    add_kernel_batch ( binding, points, npoints, stride, out );
+}
+void CompositionSet::evaluate_objective_batch (
+    evalconditions const& conditions,
+    float const* const points,
+    std::size_t const npoints,
+    std::size_t const stride,
+    float* const out ) const
+{
+    HOT_PATH_NAMED_SCOPE ( "CompositionSet::evaluate_objective_batch" );
+    const EvaluationTrace::Scope trace ( compiled_model->energy_trace, npoints );
+    BOOST_ASSERT ( stride >= phase_indices.size() );
+    const CompiledBinding binding = bind ( conditions, phase_indices );
+
+    std::fill ( out, out + npoints, 0.0f );
+    // All programs, those of the kernels included, as the kernels are of double precision
+    const std::vector<CompiledExpression> &programs = objective_programs ( binding );
+    for ( auto i = programs.cbegin(); i != programs.cend(); ++i ) {
+        i->evaluate_batch ( binding, points, npoints, stride, out );
+    }
+}
+void CompositionSet::add_kernel_batch (
+    CompiledBinding const &binding,
+    double const* const points,
+    std::size_t const npoints,
+    std::size_t const stride,
+    double* const out ) const
+{
+    if ( binding.kernel_constants ) {
+        const FixedShapeModel &kernel = *compiled_model->fixed_shape;
+        double const* const constants = &( *binding.kernel_constants ) [0];
+        for ( std::size_t point = 0; point < npoints; ++point ) {
+            out[point] += kernel.energy ( points + point * stride, &binding.variable_indices[0], constants );
+        }
+    }
+    if ( binding.kernel_programs && npoints > 0 ) {
+        // The parameters are evaluated a block at a time by their programs, and the kernel applied to each point
+        std::vector<double> curie_temperatures ( npoints, 0.0 );
+        std::vector<double> magnetic_moments ( npoints, 0.0 );
+        ( *binding.kernel_programs ) [0].evaluate_batch ( binding, points, npoints, stride, &curie_temperatures[0] );
+        ( *binding.kernel_programs ) [1].evaluate_batch ( binding, points, npoints, stride, &magnetic_moments[0] );
+        const MagneticKernel &kernel = *compiled_model->magnetic;
+        const double T = binding.statevar_values[compiled_model->temperature_slot];
+        for ( std::size_t point = 0; point < npoints; ++point ) {
+            out[point] += kernel.energy ( T, curie_temperatures[point], magnetic_moments[point] );
+        }
+    }
+}
+void CompositionSet::evaluate_magnetic_parameters (
+    CompiledBinding const &binding,
+    double const* const x,
+    bool const with_hessian,
+    bool const direction_product,
+    CompiledJet &workspace ) const
+{
+    const std::size_t n = binding_slots.variables.size();
+    workspace.nested.resize ( 2 );
+    for ( std::size_t parameter = 0; parameter < 2; ++parameter ) {
+        CompiledJet &jet = workspace.nested[parameter];
+        jet.value = 0;
+        jet.gradient.assign ( n, 0.0 );
+        if ( with_hessian ) jet.hessian.assign ( n * n, 0.0 );
+        const CompiledExpression &program = ( *binding.kernel_programs ) [parameter];
+        program.evaluate_jet ( binding, x, jet, with_hessian );
+        if ( direction_product ) {
+            jet.product.assign ( n, 0.0 );
+            program.evaluate_hessian_vector ( binding, x, &workspace.direction[0], &jet.product[0], jet );
+        }
+    }
+}
+void CompositionSet::load_objective ( EnergyDevice &device, evalconditions const& conditions ) const
+{
+    // The device runs all programs, those of the kernels included
+    const CompiledBinding binding = bind ( conditions, phase_indices );
+    device.load ( objective_programs ( binding ), binding );
+}
+std::vector<double> CompositionSet::evaluate_objective_batch (
+    evalconditions const& conditions,
+    std::vector<std::vector<double>> const &points ) const
+{
+    const std::size_t stride = phase_indices.size();
+    std::vector<double> packed_points;
+    std::vector<double> energies ( points.size() );
+    packed_points.reserve ( points.size() * stride );
+    for ( auto i = points.cbegin(); i != points.cend(); ++i ) {
+        // any trailing coordinates (e.g., an energy) are ignored, as in evaluate_objective()
+        BOOST_ASSERT ( i->size() >= stride );
+        packed_points.insert ( packed_points.end(), i->cbegin(), i->cbegin() + stride );
+    }
+    if ( !points.empty() ) {
+        evaluate_objective_batch ( conditions, phase_indices, &packed_points[0], points.size(), &energies[0] );
+    }
+    return energies;
+}
+
 std::map<int,double> CompositionSet::evaluate_objective_gradient (
     evalconditions const& conditions, boost::bimap<std::string, int> const &main_indices, double* const x ) const
 {
     std::map<int,double> retmap;
-    boost::multi_index::index<ast_set,ast_deriv_order_index>::type::const_iterator ast_begin,ast_end;
-    ast_begin = get<ast_deriv_order_index> ( tree_data ).lower_bound ( 1 );
-    ast_end = get<ast_deriv_order_index> ( tree_data ).upper_bound ( 1 );
-    const std::string compset_name ( cset_name + "_FRAC" );
+    const CompiledBinding binding = bind ( conditions, main_indices );
 
     for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i ) {
         retmap[i->second] = 0; // initialize all indices as zero
     }
-    for ( ast_set::const_iterator i = ast_begin; i != ast_end; ++i ) {
-        const double diffvalue = process_utree ( i->ast, conditions, main_indices, symbols, x ).get<double>();
-        const std::string diffvar = * ( i->diffvars.cbegin() ); // get differentiating variable
-        const int varindex = main_indices.left.at ( diffvar );
-        if ( diffvar != compset_name ) {
-            retmap[varindex] += x[main_indices.left.at ( compset_name )] * diffvalue; // multiply derivative by phase fraction
-        } else {
-            // don't multiply derivative by phase fraction because this is the derivative w.r.t phase fraction
-            retmap[varindex] += diffvalue;
-        }
-    }
+    const CompiledJet jet = evaluate_model_jet ( binding, x, false );
+    add_objective_gradient ( binding, jet, x, retmap );
 
     return retmap;
 }
@@ -281,52 +853,124 @@ std::map<int,double> CompositionSet::evaluate_single_phase_objective_gradient (
     evalconditions const& conditions, boost::bimap<std::string, int> const &main_indices, double* const x ) const
     {
         std::map<int,double> retmap;
-        boost::multi_index::index<ast_set,ast_deriv_order_index>::type::const_iterator ast_begin,ast_end;
-        ast_begin = get<ast_deriv_order_index> ( tree_data ).lower_bound ( 1 );
-        ast_end = get<ast_deriv_order_index> ( tree_data ).upper_bound ( 1 );
-        const std::string compset_name ( cset_name + "_FRAC" );
+        const CompiledBinding binding = bind ( conditions, main_indices );
         
         for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i ) {
             retmap[i->second] = 0; // initialize all indices as zero
         }
-        for ( ast_set::const_iterator i = ast_begin; i != ast_end; ++i ) {
-            const double diffvalue = process_utree ( i->ast, conditions, main_indices, symbols, x ).get<double>();
-            const std::string diffvar = * ( i->diffvars.cbegin() ); // get differentiating variable
-            const int varindex = main_indices.left.at ( diffvar );
-            retmap[varindex] += diffvalue;
+        const CompiledJet jet = evaluate_model_jet ( binding, x, false );
+        for ( std::size_t slot = 0; slot < jet.gradient.size(); ++slot ) {
+            const int varindex = binding.variable_indices[slot];
+            if ( varindex < 0 ) continue;
+            // the derivative w.r.t. the phase fraction is just the energy of this phase
+            retmap[varindex] += ( slot == phase_fraction_slot ) ? jet.value : jet.gradient[slot];
         }
         
         return retmap;
     }
 
 std::vector<double> CompositionSet::evaluate_internal_objective_gradient (
-    evalconditions const& conditions, double* const x ) const
+    evalconditions const& conditions, double const* const x ) const
 {
     std::vector<double> gradient ( phase_indices.size() );
-    const double perturbation = 1e-7;
-    double x_copy[phase_indices.size()] ;
-    for ( auto i = 0; i < phase_indices.size(); ++i ) {
-        x_copy[i] = x[i];
+    const CompiledBinding binding = bind ( conditions, phase_indices );
+    CompiledJet workspace = jet_workspace ( false );
+    evaluate_internal_objective_gradient ( binding, x, &gradient[0], workspace );
+    return gradient;
+}
+
+double CompositionSet::evaluate_internal_objective_gradient (
+    CompiledBinding const &binding,
+    double const* const x,
+    double* const gradient,
+    CompiledJet &workspace ) const
+{
+    evaluate_model_jet ( binding, x, false, workspace );
+    std::fill ( gradient, gradient + phase_indices.size(), 0.0 );
+    for ( std::size_t slot = 0; slot < workspace.gradient.size(); ++slot ) {
+        const int varindex = binding.variable_indices[slot];
+        if ( varindex < 0 ) continue; // e.g., the phase fraction
+        gradient[varindex] += workspace.gradient[slot];
     }
-    for ( auto i = 0; i < phase_indices.size(); ++i ) {
-        double lower_obj, upper_obj;
-        x_copy[i] = x[i] - perturbation;
-        lower_obj = evaluate_objective ( conditions, phase_indices, x_copy );
-        x_copy[i] = x[i] + perturbation;
-        upper_obj = evaluate_objective ( conditions, phase_indices, x_copy );
-        gradient[i] = ( upper_obj - lower_obj ) / ( 2.0 * perturbation );
+    return workspace.value;
+}
+
+void CompositionSet::evaluate_internal_objective_hessian (
+    CompiledBinding const &binding,
+    double const* const x,
+    double* const hessian,
+    CompiledJet &workspace ) const
+{
+    evaluate_model_jet ( binding, x, true, workspace );
+    const std::size_t n = workspace.gradient.size();
+    const std::size_t varcount = phase_indices.size();
+    std::fill ( hessian, hessian + varcount * varcount, 0.0 );
+    for ( std::size_t slot1 = 0; slot1 < n; ++slot1 ) {
+        const int varindex1 = binding.variable_indices[slot1];
+        if ( slot1 == phase_fraction_slot || varindex1 < 0 ) continue;
+        for ( std::size_t slot2 = 0; slot2 < n; ++slot2 ) {
+            const int varindex2 = binding.variable_indices[slot2];
+            if ( slot2 == phase_fraction_slot || varindex2 < 0 ) continue;
+            hessian[varindex1 * varcount + varindex2] += workspace.hessian[slot1 * n + slot2];
+        }
     }
+}
 
-    return gradient;
+void CompositionSet::evaluate_internal_objective_hessian_vector (
+    CompiledBinding const &binding,
+    double const* const x,
+    double const* const direction,
+    double* const product,
+    CompiledJet &workspace ) const
+{
+    const std::size_t n = binding_slots.variables.size();
+    const std::size_t varcount = phase_indices.size();
+    std::fill ( product, product + varcount, 0.0 );
+    // The phase fraction is not a coordinate of the phase, so it has no direction and no product
+    workspace.direction.assign ( n, 0.0 );
+    for ( std::size_t slot = 0; slot < n; ++slot ) {
+        const int varindex = binding.variable_indices[slot];
+        if ( slot != phase_fraction_slot && varindex >= 0 ) workspace.direction[slot] = direction[varindex];
+    }
+    workspace.product.assign ( n, 0.0 );
+    if ( native_kernels ) {
+        evaluate_model_jet ( binding, x, true, workspace );
+        for ( std::size_t slot1 = 0; slot1 < n; ++slot1 ) {
+            for ( std::size_t slot2 = 0; slot2 < n; ++slot2 ) {
+                workspace.product[slot1] += workspace.hessian[slot1 * n + slot2] * workspace.direction[slot2];
+            }
+        }
+    }
+    else {
+        const EvaluationTrace::Scope trace ( compiled_model->derivative_trace, 1 );
+        const std::vector<CompiledExpression> &programs = objective_programs ( binding );
+        for ( auto i = programs.cbegin(); i != programs.cend(); ++i ) {
+            if ( replaced_program ( binding, i - programs.cbegin() ) ) continue;
+            i->evaluate_hessian_vector ( binding, x, &workspace.direction[0], &workspace.product[0], workspace );
+        }
+        if ( binding.kernel_constants ) {
+            compiled_model->fixed_shape->add_hessian_vector ( x, &binding.variable_indices[0], &( *binding.kernel_constants ) [0],
+                    &workspace.direction[0], &workspace.product[0] );
+        }
+        if ( binding.kernel_programs ) {
+            evaluate_magnetic_parameters ( binding, x, false, true, workspace );
+            compiled_model->magnetic->add_hessian_vector ( binding.statevar_values[compiled_model->temperature_slot],
+                    workspace.nested[0], workspace.nested[1], &workspace.direction[0], &workspace.product[0] );
+        }
+    }
+    for ( std::size_t slot = 0; slot < n; ++slot ) {
+        const int varindex = binding.variable_indices[slot];
+        if ( slot != phase_fraction_slot && varindex >= 0 ) product[varindex] += workspace.product[slot];
+    }
 }
 
 std::map<int,double> CompositionSet::evaluate_objective_gradient (
     evalconditions const &conditions, std::map<std::string,double> const &variables ) const
 {
     // Need to translate this variable map into something process_utree can understand
-    BOOST_LOG_NAMED_SCOPE ( "CompositionSet::evaluate_objective_gradient" );
-    logger comp_log ( journal::keywords::channel = "optimizer" );
-    BOOST_LOG_SEV ( comp_log, debug ) << "enter";
+    HOT_PATH_NAMED_SCOPE ( "CompositionSet::evaluate_objective_gradient" );
+    HOT_PATH_LOGGER ( comp_log, "optimizer" );
+    HOT_PATH_LOG_SEV ( comp_log, debug ) << "enter";
     double vars[variables.size()]; // Create Ipopt-style double array
     boost::bimap<std::string, int> main_indices;
     typedef boost::bimap<std::string, int>::value_type position;
@@ -335,9 +979,9 @@ std::map<int,double> CompositionSet::evaluate_objective_gradient (
         main_indices.insert ( position ( i->first, std::distance ( variables.begin(),i ) ) ); // Create fictitious indices
     }
     for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i ) {
-        BOOST_LOG_SEV ( comp_log, debug ) << i->first << " -> " << i->second;
+        HOT_PATH_LOG_SEV ( comp_log, debug ) << i->first << " -> " << i->second;
     }
-    BOOST_LOG_SEV ( comp_log, debug ) << "returning";
+    HOT_PATH_LOG_SEV ( comp_log, debug ) << "returning";
     return evaluate_objective_gradient ( conditions, main_indices, vars );
 }
 
@@ -345,9 +989,9 @@ std::map<int,double> CompositionSet::evaluate_single_phase_objective_gradient (
     evalconditions const &conditions, std::map<std::string,double> const &variables ) const
     {
         // Need to translate this variable map into something process_utree can understand
-        BOOST_LOG_NAMED_SCOPE ( "CompositionSet::evaluate_single_phase_objective_gradient" );
-        logger comp_log ( journal::keywords::channel = "optimizer" );
-        BOOST_LOG_SEV ( comp_log, debug ) << "enter";
+        HOT_PATH_NAMED_SCOPE ( "CompositionSet::evaluate_single_phase_objective_gradient" );
+        HOT_PATH_LOGGER ( comp_log, "optimizer" );
+        HOT_PATH_LOG_SEV ( comp_log, debug ) << "enter";
         double vars[variables.size()]; // Create Ipopt-style double array
         boost::bimap<std::string, int> main_indices;
         typedef boost::bimap<std::string, int>::value_type position;
@@ -356,9 +1000,9 @@ std::map<int,double> CompositionSet::evaluate_single_phase_objective_gradient (
             main_indices.insert ( position ( i->first, std::distance ( variables.begin(),i ) ) ); // Create fictitious indices
         }
         for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i ) {
-            BOOST_LOG_SEV ( comp_log, debug ) << i->first << " -> " << i->second;
+            HOT_PATH_LOG_SEV ( comp_log, debug ) << i->first << " -> " << i->second;
         }
-        BOOST_LOG_SEV ( comp_log, debug ) << "returning";
+        HOT_PATH_LOG_SEV ( comp_log, debug ) << "returning";
         return evaluate_single_phase_objective_gradient ( conditions, main_indices, vars );
     }
 
@@ -367,13 +1011,9 @@ std::map<std::list<int>,double> CompositionSet::evaluate_objective_hessian (
     boost::bimap<std::string, int> const &main_indices,
     double* const x ) const
 {
-    BOOST_LOG_NAMED_SCOPE ( "CompositionSet::evaluate_objective_hessian" );
-    logger comp_log ( journal::keywords::channel = "optimizer" );
+    HOT_PATH_NAMED_SCOPE ( "CompositionSet::evaluate_objective_hessian" );
     std::map<std::list<int>,double> retmap;
-    boost::multi_index::index<ast_set,ast_deriv_order_index>::type::const_iterator ast_begin,ast_end;
-    ast_begin = get<ast_deriv_order_index> ( tree_data ).lower_bound ( 2 );
-    ast_end = get<ast_deriv_order_index> ( tree_data ).upper_bound ( 2 );
-    const std::string compset_name ( cset_name + "_FRAC" );
+    const CompiledBinding binding = bind ( conditions, main_indices );
 
     for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i ) {
         for ( auto j = main_indices.left.begin(); j != main_indices.left.end(); ++j ) {
@@ -384,65 +1024,352 @@ std::map<std::list<int>,double> CompositionSet::evaluate_objective_hessian (
             retmap[searchlist] = 0; // initialize all indices as zero
         }
     }
-
-    for ( ast_set::const_iterator i = ast_begin; i != ast_end; ++i ) {
-        const double diffvalue = process_utree ( i->ast, conditions, main_indices, symbols, x ).get<double>();
-        const std::string diffvar1 = * ( i->diffvars.cbegin() );
-        const std::string diffvar2 = * ( ++ ( i->diffvars.cbegin() ) );
-        const int varindex1 = main_indices.left.at ( diffvar1 );
-        const int varindex2 = main_indices.left.at ( diffvar2 );
-        std::list<int> searchlist;
-        if ( varindex1 <= varindex2 ) searchlist = {varindex1,varindex2};
-        else searchlist = {varindex2, varindex1};
-        // multiply derivative by phase fraction
-        if ( diffvar1 == compset_name || diffvar2 == compset_name ) {
-            retmap[searchlist] += diffvalue;
-        } else {
-            retmap[searchlist] += x[main_indices.left.at ( compset_name )] * diffvalue;
-        }
-    }
+    const CompiledJet jet = evaluate_model_jet ( binding, x, true );
+    add_objective_hessian ( binding, jet, x, retmap );
     return retmap;
 }
 
+void CompositionSet::evaluate_objective_derivatives (
+    evalconditions const& conditions,
+    boost::bimap<std::string, int> const &main_indices,
+    double* const x,
+    double &objective,
+    std::map<int,double> &gradient,
+    std::map<std::list<int>,double> &hessian ) const
+{
+    HOT_PATH_NAMED_SCOPE ( "CompositionSet::evaluate_objective_derivatives" );
+    const CompiledBinding binding = bind ( conditions, main_indices );
+    const CompiledJet jet = evaluate_model_jet ( binding, x, true );
+    objective = jet.value;
+    add_objective_gradient ( binding, jet, x, gradient );
+    add_objective_hessian ( binding, jet, x, hessian );
+}
+
 // NOTE: this is explicitly for the single-phase Hessian
 boost::numeric::ublas::symmetric_matrix<double,boost::numeric::ublas::lower> CompositionSet::evaluate_objective_hessian_matrix (
     evalconditions const& conditions,
     boost::bimap<std::string, int> const &main_indices,
     std::vector<double> const &x ) const
 {
-    BOOST_LOG_NAMED_SCOPE ( "CompositionSet::evaluate_objective_hessian_matrix" );
+    HOT_PATH_NAMED_SCOPE ( "CompositionSet::evaluate_objective_hessian_matrix" );
     typedef boost::numeric::ublas::symmetric_matrix<double,boost::numeric::ublas::lower> sym_matrix;
     using boost::numeric::ublas::zero_matrix;
-    logger comp_log ( journal::keywords::channel = "optimizer" );
     sym_matrix retmatrix ( zero_matrix<double> ( x.size(),x.size() ) );
-    boost::multi_index::index<ast_set,ast_deriv_order_index>::type::const_iterator ast_begin,ast_end;
-    ast_begin = get<ast_deriv_order_index> ( tree_data ).lower_bound ( 2 );
-    ast_end = get<ast_deriv_order_index> ( tree_data ).upper_bound ( 2 );
-    const std::string compset_name ( cset_name + "_FRAC" );
-
+    const CompiledBinding binding = bind ( conditions, main_indices );
+    const CompiledJet jet = evaluate_model_jet ( binding, &x[0], true );
+    const std::size_t n = jet.gradient.size();
 
-    for ( ast_set::const_iterator i = ast_begin; i != ast_end; ++i ) {
-        const std::string diffvar1 = * ( i->diffvars.cbegin() );
-        const std::string diffvar2 = * ( ++ ( i->diffvars.cbegin() ) );
-        if ( diffvar1 == compset_name || diffvar2 == compset_name ) {
+    for ( std::size_t slot1 = 0; slot1 < n; ++slot1 ) {
+        const int varindex1 = binding.variable_indices[slot1];
+        if ( slot1 == phase_fraction_slot || varindex1 < 0 ) {
             continue;    // skip phase fraction variable for single-phase calc
         }
-        const int varindex1 = main_indices.left.at ( diffvar1 );
-        const int varindex2 = main_indices.left.at ( diffvar2 );
-        // TODO: const_cast is obviously suboptimal here, but it saves a copy and will do until process_utree is fixed
-        const double diffvalue = process_utree ( i->ast, conditions, main_indices, symbols, const_cast<double*> ( &x[0] ) ).get<double>();
-        retmatrix ( varindex1,varindex2 ) += diffvalue;
+        for ( std::size_t slot2 = 0; slot2 < n; ++slot2 ) {
+            const int varindex2 = binding.variable_indices[slot2];
+            if ( slot2 == phase_fraction_slot || varindex2 < 0 || varindex1 < varindex2 ) {
+                continue;    // symmetric_matrix stores the lower triangle
+            }
+            retmatrix ( varindex1,varindex2 ) += jet.hessian[slot1 * n + slot2];
+        }
     }
     return retmatrix;
 }
 
+CompiledJet CompositionSet::evaluate_model_jet (
+    CompiledBinding const &binding,
+    double const* const x,
+    bool const with_hessian ) const
+{
+    CompiledJet jet ( binding_slots.variables.size(), with_hessian );
+    evaluate_model_jet ( binding, x, with_hessian, jet );
+    return jet;
+}
+
+void CompositionSet::evaluate_model_jet (
+    CompiledBinding const &binding,
+    double const* const x,
+    bool const with_hessian,
+    CompiledJet &jet ) const
+{
+    const EvaluationTrace::Scope trace ( compiled_model->derivative_trace, 1 );
+    BOOST_ASSERT ( jet.gradient.size() == binding_slots.variables.size() );
+    BOOST_ASSERT ( !with_hessian || jet.hessian.size() == jet.gradient.size() * jet.gradient.size() );
+    jet.value = 0;
+    std::fill ( jet.gradient.begin(), jet.gradient.end(), 0.0 );
+    if ( with_hessian ) std::fill ( jet.hessian.begin(), jet.hessian.end(), 0.0 );
+    if ( native_kernels ) {
+        std::vector<double> &arguments = jet.registers; // scratch space, not used by the kernels
+        native_arguments ( binding, x, arguments );
+        double const* const state = &arguments[0] + binding.variable_indices.size();
+        native_kernels->energy ( &arguments[0], state, &jet.value );
+        native_kernels->gradient ( &arguments[0], state, &jet.gradient[0] );
+        if ( with_hessian ) native_kernels->hessian ( &arguments[0], state, &jet.hessian[0] );
+        bool finite = std::isfinite ( jet.value );
+        for ( auto i = jet.gradient.cbegin(); i != jet.gradient.cend(); ++i ) finite = finite && std::isfinite ( *i );
+        for ( auto i = jet.hessian.cbegin(); i != jet.hessian.cend(); ++i ) finite = finite && std::isfinite ( *i );
+        if ( !finite ) {
+            BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Calculated value or derivative is infinite or not a number" ) );
+        }
+        return;
+    }
+    const std::vector<CompiledExpression> &programs = objective_programs ( binding );
+    for ( auto i = programs.cbegin(); i != programs.cend(); ++i ) {
+        if ( !replaced_program ( binding, i - programs.cbegin() ) ) i->evaluate_jet ( binding, x, jet, with_hessian );
+    }
+    if ( binding.kernel_constants ) {
+        compiled_model->fixed_shape->add_jet ( x, &binding.variable_indices[0], &( *binding.kernel_constants ) [0], jet, with_hessian );
+    }
+    if ( binding.kernel_programs ) {
+        evaluate_magnetic_parameters ( binding, x, with_hessian, false, jet );
+        compiled_model->magnetic->add_jet ( binding.statevar_values[compiled_model->temperature_slot],
+                                            jet.nested[0], jet.nested[1], jet, with_hessian );
+    }
+}
+
+CompiledBinding CompositionSet::bind (
+    evalconditions const& conditions, boost::bimap<std::string, int> const &main_indices ) const
+{
+    CompiledBinding binding ( binding_slots, conditions, main_indices );
+    CompiledModel const &model = *compiled_model;
+    std::lock_guard<std::mutex> lock ( model.specialized_objective_mutex );
+    auto cache = model.specialized_objective.begin();
+    while ( cache != model.specialized_objective.end()
+            && ( cache->statevar_values != binding.statevar_values || cache->statevar_bound != binding.statevar_bound ) ) {
+        ++cache;
+    }
+    if ( cache == model.specialized_objective.end() ) {
+        // Temperature-only parameters and their piecewise ranges are evaluated here, once per set of conditions
+        std::shared_ptr<std::vector<CompiledExpression>> programs ( std::make_shared<std::vector<CompiledExpression>>() );
+        programs->reserve ( model.objective.size() );
+        for ( auto i = model.objective.cbegin(); i != model.objective.cend(); ++i ) {
+            programs->push_back ( i->specialize ( binding ) );
+        }
+        CompiledModel::SpecializedObjective entry;
+        entry.statevar_values = binding.statevar_values;
+        entry.statevar_bound = binding.statevar_bound;
+        entry.programs = std::move ( programs );
+        if ( model.fixed_shape && binding.statevar_bound[model.temperature_slot] ) {
+            std::shared_ptr<std::vector<double>> constants ( std::make_shared<std::vector<double>>() );
+            constants->reserve ( 1 + model.coefficient_programs.size() );
+            constants->push_back ( binding.statevar_values[model.temperature_slot] );
+            try {
+                for ( auto i = model.coefficient_programs.cbegin(); i != model.coefficient_programs.cend(); ++i ) {
+                    constants->push_back ( i->evaluate ( binding, nullptr ) );
+                }
+                entry.fixed_shape_constants = std::move ( constants );
+            }
+            catch ( boost::exception & ) {
+                // e.g., a condition the coefficients need is not given; the programs report it as usual
+            }
+        }
+        if ( model.magnetic && binding.statevar_bound[model.temperature_slot] ) {
+            std::shared_ptr<std::vector<CompiledExpression>> magnetic_programs ( std::make_shared<std::vector<CompiledExpression>>() );
+            for ( auto i = model.magnetic_programs.cbegin(); i != model.magnetic_programs.cend(); ++i ) {
+                magnetic_programs->push_back ( i->specialize ( binding ) );
+            }
+            entry.magnetic_programs = std::move ( magnetic_programs );
+        }
+        model.specialized_objective.push_front ( std::move ( entry ) );
+        if ( model.specialized_objective.size() > 4 ) model.specialized_objective.pop_back();
+    }
+    else if ( cache != model.specialized_objective.begin() ) {
+        model.specialized_objective.splice ( model.specialized_objective.begin(), model.specialized_objective, cache );
+    }
+    binding.specialized = model.specialized_objective.front().programs;
+    if ( model.specialized_objective.front().fixed_shape_constants ) {
+        bool coordinates_bound = true;
+        const std::vector<std::size_t> &slots = model.fixed_shape->coordinate_slots();
+        for ( auto i = slots.cbegin(); i != slots.cend(); ++i ) coordinates_bound = coordinates_bound && binding.variable_indices[*i] >= 0;
+        if ( coordinates_bound ) binding.kernel_constants = model.specialized_objective.front().fixed_shape_constants;
+    }
+    binding.kernel_programs = model.specialized_objective.front().magnetic_programs;
+    return binding;
+}
+
+CompiledJet CompositionSet::jet_workspace ( bool const with_hessian ) const
+{
+    return CompiledJet ( binding_slots.variables.size(), with_hessian );
+}
+
+double CompositionSet::evaluate_objective ( CompiledBinding const &binding, double const* const x ) const
+{
+    const EvaluationTrace::Scope trace ( compiled_model->energy_trace, 1 );
+    double objective = 0;
+    if ( native_kernels ) {
+        std::vector<double> arguments;
+        native_arguments ( binding, x, arguments );
+        native_kernels->energy ( &arguments[0], &arguments[0] + binding.variable_indices.size(), &objective );
+        if ( !is_allowed_value<double> ( objective ) ) {
+            BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Calculated value is infinite, subnormal, or not a number" ) );
+        }
+        return objective;
+    }
+    const std::vector<CompiledExpression> &programs = objective_programs ( binding );
+    for ( auto i = programs.cbegin(); i != programs.cend(); ++i ) {
+        if ( !replaced_program ( binding, i - programs.cbegin() ) ) objective += i->evaluate ( binding, x );
+    }
+    if ( binding.kernel_constants ) {
+        objective += compiled_model->fixed_shape->energy ( x, &binding.variable_indices[0], &( *binding.kernel_constants ) [0] );
+    }
+    if ( binding.kernel_programs ) {
+        objective += compiled_model->magnetic->energy ( binding.statevar_values[compiled_model->temperature_slot],
+                     ( *binding.kernel_programs ) [0].evaluate ( binding, x ), ( *binding.kernel_programs ) [1].evaluate ( binding, x ) );
+    }
+    if ( ( binding.kernel_constants || binding.kernel_programs ) && !is_allowed_value<double> ( objective ) ) {
+        BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Calculated value is infinite, subnormal, or not a number" ) );
+    }
+    return objective;
+}
+
+void CompositionSet::add_objective_gradient (
+    CompiledBinding const &binding,
+    double const* const x,
+    double* const gradient,
+    CompiledJet &workspace ) const
+{
+    evaluate_model_jet ( binding, x, false, workspace );
+    add_objective_gradient ( binding, workspace, x, gradient );
+}
+
+void CompositionSet::add_objective_gradient (
+    CompiledBinding const &binding,
+    CompiledJet const &jet,
+    double const* const x,
+    double* const gradient ) const
+{
+    const double phase_fraction = x[binding.variable_index ( phase_fraction_slot )];
+    for ( std::size_t slot = 0; slot < jet.gradient.size(); ++slot ) {
+        const int varindex = binding.variable_indices[slot];
+        if ( varindex < 0 ) continue;
+        // the derivative w.r.t the phase fraction is just the energy of this phase
+        gradient[varindex] += ( slot == phase_fraction_slot ) ? jet.value : phase_fraction * jet.gradient[slot];
+    }
+}
+
+CompositionSet::HessianScatter CompositionSet::hessian_positions (
+    CompiledBinding const &binding, std::set<std::list<int>> const &sparsity_structure ) const
+{
+    // Number the entries once; std::distance over the set would be linear for every entry
+    std::map<std::list<int>,int> sparse_positions;
+    int position = 0;
+    for ( auto i = sparsity_structure.cbegin(); i != sparsity_structure.cend(); ++i, ++position ) {
+        sparse_positions.emplace_hint ( sparse_positions.end(), *i, position );
+    }
+    const std::size_t n = binding_slots.variables.size();
+    HessianScatter scatter;
+    for ( std::size_t slot1 = 0; slot1 < n; ++slot1 ) {
+        const int varindex1 = binding.variable_indices[slot1];
+        if ( varindex1 < 0 ) continue;
+        for ( std::size_t slot2 = 0; slot2 < n; ++slot2 ) {
+            const int varindex2 = binding.variable_indices[slot2];
+            if ( varindex2 < 0 || varindex1 > varindex2 ) {
+                continue;    // skip upper triangular
+            }
+            if ( slot1 == phase_fraction_slot && slot2 == phase_fraction_slot ) {
+                continue;    // second derivative w.r.t phase fraction is zero
+            }
+            const auto sparse_find = sparse_positions.find ( std::list<int> {varindex1,varindex2} );
+            if ( sparse_find == sparse_positions.end() ) continue;
+            if ( slot1 == phase_fraction_slot ) {
+                scatter.fraction_entries.emplace_back ( slot2, sparse_find->second );
+            } else if ( slot2 == phase_fraction_slot ) {
+                scatter.fraction_entries.emplace_back ( slot1, sparse_find->second );
+            } else {
+                scatter.model_entries.emplace_back ( slot1 * n + slot2, sparse_find->second );
+            }
+        }
+    }
+    return scatter;
+}
+
+void CompositionSet::add_objective_hessian (
+    CompiledBinding const &binding,
+    double const* const x,
+    double const scale,
+    HessianScatter const &scatter,
+    double* const values,
+    CompiledJet &workspace ) const
+{
+    evaluate_model_jet ( binding, x, true, workspace );
+    add_objective_hessian ( binding, workspace, x, scale, scatter, values );
+}
+
+void CompositionSet::add_objective_hessian (
+    CompiledBinding const &binding,
+    CompiledJet const &jet,
+    double const* const x,
+    double const scale,
+    HessianScatter const &scatter,
+    double* const values ) const
+{
+    // multiply the model derivatives by the phase fraction
+    const double model_scale = scale * x[binding.variable_index ( phase_fraction_slot )];
+    for ( auto i = scatter.model_entries.cbegin(); i != scatter.model_entries.cend(); ++i ) {
+        values[i->second] += model_scale * jet.hessian[i->first];
+    }
+    // the derivative w.r.t the phase fraction and a site fraction is the first derivative of the energy
+    for ( auto i = scatter.fraction_entries.cbegin(); i != scatter.fraction_entries.cend(); ++i ) {
+        values[i->second] += scale * jet.gradient[i->first];
+    }
+}
+
+void CompositionSet::add_objective_gradient (
+    CompiledBinding const &binding,
+    CompiledJet const &jet,
+    double const* const x,
+    std::map<int,double> &gradient ) const
+{
+    const double phase_fraction = x[binding.variable_index ( phase_fraction_slot )];
+    for ( std::size_t slot = 0; slot < jet.gradient.size(); ++slot ) {
+        const int varindex = binding.variable_indices[slot];
+        if ( varindex < 0 ) continue;
+        if ( slot == phase_fraction_slot ) {
+            // the derivative w.r.t the phase fraction is just the energy of this phase
+            gradient[varindex] += jet.value;
+        } else {
+            gradient[varindex] += phase_fraction * jet.gradient[slot]; // multiply derivative by phase fraction
+        }
+    }
+}
+
+void CompositionSet::add_objective_hessian (
+    CompiledBinding const &binding,
+    CompiledJet const &jet,
+    double const* const x,
+    std::map<std::list<int>,double> &hessian ) const
+{
+    const std::size_t n = jet.gradient.size();
+    const double phase_fraction = x[binding.variable_index ( phase_fraction_slot )];
+    for ( std::size_t slot1 = 0; slot1 < n; ++slot1 ) {
+        const int varindex1 = binding.variable_indices[slot1];
+        if ( varindex1 < 0 ) continue;
+        for ( std::size_t slot2 = 0; slot2 < n; ++slot2 ) {
+            const int varindex2 = binding.variable_indices[slot2];
+            if ( varindex2 < 0 || varindex1 > varindex2 ) {
+                continue;    // skip upper triangular
+            }
+            const std::list<int> searchlist {varindex1,varindex2};
+            if ( slot1 == phase_fraction_slot && slot2 == phase_fraction_slot ) {
+                // second derivative w.r.t phase fraction is zero
+            } else if ( slot1 == phase_fraction_slot ) {
+                hessian[searchlist] += jet.gradient[slot2];
+            } else if ( slot2 == phase_fraction_slot ) {
+                hessian[searchlist] += jet.gradient[slot1];
+            } else {
+                hessian[searchlist] += phase_fraction * jet.hessian[slot1 * n + slot2]; // multiply derivative by phase fraction
+            }
+        }
+    }
+}
+
 std::set<std::list<int>> CompositionSet::hessian_sparsity_structure (
                           boost::bimap<std::string, int> const &main_indices ) const
 {
     std::set<std::list<int>> retset;
     boost::multi_index::index<ast_set,ast_deriv_order_index>::type::const_iterator ast_begin,ast_end;
-    ast_begin = get<ast_deriv_order_index> ( tree_data ).lower_bound ( 2 );
-    ast_end = get<ast_deriv_order_index> ( tree_data ).upper_bound ( 2 );
+    ast_set const &derivative_trees = get_derivative_trees();
+    ast_begin = get<ast_deriv_order_index> ( derivative_trees ).lower_bound ( 2 );
+    ast_end = get<ast_deriv_order_index> ( derivative_trees ).upper_bound ( 2 );
     for ( ast_set::const_iterator i = ast_begin; i != ast_end; ++i ) {
         const std::string diffvar1 = * ( i->diffvars.cbegin() );
         const std::string diffvar2 = * ( ++ ( i->diffvars.cbegin() ) );
@@ -456,9 +1383,232 @@ std::set<std::list<int>> CompositionSet::hessian_sparsity_structure (
     return retset;
 }
 
+// Flatten the model ASTs into programs sharing one slot table
+// Evaluation then resolves the variable names once per call instead of once per AST node
+// Gradients and Hessians are obtained from the same programs by automatic differentiation
+void CompositionSet::compile_expressions ( CompiledModel &model )
+{
+    BOOST_LOG_NAMED_SCOPE ( "CompositionSet::compile_expressions" );
+    logger comp_log ( journal::keywords::channel = "optimizer" );
+    model.slots = CompiledSlotTable();
+    model.objective.clear();
+    model.slots.variable_slot ( model.phase_name + "_FRAC" ); // always slot 0
+
+    for ( auto i = model.models.cbegin(); i != model.models.cend(); ++i ) {
+        model.objective.emplace_back ( i->second->get_ast(), model.symbols, model.slots );
+        const CompiledStatistics &stats = model.objective.back().statistics();
+        BOOST_LOG_SEV ( comp_log, debug ) << model.phase_name << " " << i->first << ": " << stats.ast_nodes << " AST nodes -> "
+                                          << stats.instructions << " instructions (" << stats.shared << " shared, "
+                                          << stats.folded << " folded, " << stats.hoisted << " depending only on the conditions)";
+    }
+    CompiledStatistics stats;
+    for ( auto i = model.objective.cbegin(); i != model.objective.cend(); ++i ) {
+        stats += i->statistics();
+    }
+    model.temperature_slot = std::distance ( model.slots.statevars.cbegin(),
+                             std::find ( model.slots.statevars.cbegin(), model.slots.statevars.cend(), 'T' ) );
+    BOOST_LOG_SEV ( comp_log, debug ) << model.phase_name << ": compiled " << model.objective.size() << " model programs ("
+                                      << stats.ast_nodes << " AST nodes, " << stats.instructions << " instructions, "
+                                      << model.slots.variables.size() << " variables)";
+}
+
+void CompositionSet::compile_fixed_shape ( CompiledModel &model, SublatticeLayout const &layout, bool const with_excess )
+{
+    BOOST_LOG_NAMED_SCOPE ( "CompositionSet::compile_fixed_shape" );
+    logger comp_log ( journal::keywords::channel = "optimizer" );
+    model.fixed_shape.reset();
+    model.fixed_shape_excess = false;
+    model.coefficient_programs.clear();
+    model.fixed_shape_programs.assign ( model.objective.size(), false );
+    if ( !with_excess ) {
+        model.interactions.clear();
+        model.interaction_coefficients.clear();
+    }
+    // Every coordinate must have been compiled to a slot, as it is for every phase with mixing
+    std::vector<std::size_t> coordinate_slots;
+    for ( std::size_t sublattice = 0; sublattice < layout.sublattice_count(); ++sublattice ) {
+        for ( std::size_t i = layout.sublattice_begin ( sublattice ); i < layout.sublattice_end ( sublattice ); ++i ) {
+            std::stringstream name;
+            name << model.phase_name << "_" << sublattice << "_" << layout.species ( i );
+            const auto slot = std::find ( model.slots.variables.cbegin(), model.slots.variables.cend(), name.str() );
+            if ( slot == model.slots.variables.cend() ) return;
+            coordinate_slots.push_back ( std::distance ( model.slots.variables.cbegin(), slot ) );
+        }
+    }
+    if ( model.temperature_slot == model.slots.statevars.size() ) return;
+    // The coefficients may only depend on the conditions, so they must not add slots of their own
+    CompiledSlotTable slots = model.slots;
+    for ( auto i = model.interaction_coefficients.cbegin(); i != model.interaction_coefficients.cend(); ++i ) {
+        model.coefficient_programs.emplace_back ( *i, model.symbols, slots );
+    }
+    if ( slots.variables.size() != model.slots.variables.size() || slots.statevars.size() != model.slots.statevars.size() ) {
+        model.coefficient_programs.clear();
+        return;
+    }
+    model.fixed_shape = make_fixed_shape_model ( layout, coordinate_slots, model.slots.variables.size(),
+                        with_excess ? model.interactions : std::vector<FixedShapeInteraction>() );
+    bool excess = with_excess;
+    if ( !model.fixed_shape && excess ) {
+        // Not a supported shape; its ideal mixing energy still has a kernel, and the excess energy keeps its program
+        excess = false;
+        model.interactions.clear();
+        model.interaction_coefficients.clear();
+        model.coefficient_programs.clear();
+        model.fixed_shape = make_fixed_shape_model ( layout, coordinate_slots, model.slots.variables.size(), model.interactions );
+    }
+    if ( !model.fixed_shape ) {
+        model.coefficient_programs.clear();
+        return;
+    }
+    model.fixed_shape_excess = excess;
+    std::size_t program = 0;
+    for ( auto i = model.models.cbegin(); i != model.models.cend(); ++i, ++program ) {
+        if ( i->first == "IDEAL_MIX" || ( excess && i->first == "REDLICH_KISTER" ) ) model.fixed_shape_programs[program] = true;
+    }
+    BOOST_LOG_SEV ( comp_log, debug ) << model.phase_name << ": ideal mixing" << ( excess ? " and excess energy" : "" )
+                                      << " evaluated by a kernel of its sublattice shape (" << model.interactions.size() << " binary interactions)";
+}
+
+void CompositionSet::compile_magnetic ( CompiledModel &model, SublatticeLayout const &layout )
+{
+    BOOST_LOG_NAMED_SCOPE ( "CompositionSet::compile_magnetic" );
+    logger comp_log ( journal::keywords::channel = "optimizer" );
+    model.magnetic.reset();
+    model.magnetic_programs.clear();
+    const auto program = model.models.find ( "IHJ_MAGNETIC" );
+    const int mixing_sites = layout.mixing_sites();
+    if ( model.magnetic_parameters.size() != 2 || program == model.models.end() || mixing_sites == 0
+            || model.temperature_slot == model.slots.statevars.size() ) {
+        return;
+    }
+    // The parameters depend on the site fractions the other programs use, so they must not add slots of their own
+    CompiledSlotTable slots = model.slots;
+    for ( auto i = model.magnetic_parameters.cbegin(); i != model.magnetic_parameters.cend(); ++i ) {
+        model.magnetic_programs.emplace_back ( *i, model.symbols, slots );
+    }
+    if ( slots.variables.size() != model.slots.variables.size() || slots.statevars.size() != model.slots.statevars.size() ) {
+        model.magnetic_programs.clear();
+        return;
+    }
+    model.magnetic.reset ( new MagneticKernel ( model.afm_factor, model.sro_enthalpy_order_fraction, mixing_sites ) );
+    model.magnetic_program = std::distance ( model.models.begin(), program );
+    BOOST_LOG_SEV ( comp_log, debug ) << model.phase_name << ": magnetic energy evaluated in closed form ("
+                                      << model.magnetic_programs[0].statistics().instructions + model.magnetic_programs[1].statistics().instructions
+                                      << " instructions for its parameters)";
+}
+
+void CompositionSet::share_model ( std::shared_ptr<const CompiledModel> model )
+{
+    compiled_model = std::move ( model );
+    binding_slots = compiled_model->slots;
+    if ( compiled_model->phase_name != cset_name ) {
+        binding_slots.variables = ast_copy_with_renamed_phase ( binding_slots.variables, compiled_model->phase_name, cset_name );
+    }
+    phase_fraction_slot = 0; // reserved by compile_expressions()
+}
+
+void CompositionSet::native_arguments ( CompiledBinding const &binding, double const* const x, std::vector<double> &arguments ) const
+{
+    const std::size_t variable_count = binding.variable_indices.size();
+    arguments.resize ( variable_count + binding.statevar_values.size() );
+    for ( std::size_t slot = 0; slot < variable_count; ++slot ) {
+        const int index = binding.variable_indices[slot];
+        arguments[slot] = index >= 0 ? x[index] : std::numeric_limits<double>::quiet_NaN();
+    }
+    for ( std::size_t slot = 0; slot < binding.statevar_values.size(); ++slot ) {
+        arguments[variable_count + slot] = binding.statevar_bound[slot] ? binding.statevar_values[slot] : std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+// The energy kernel runs the objective programs; the gradient and Hessian kernels run programs compiled from
+// the derivative trees, which are usually shorter than one reverse sweep over the objective
+bool CompositionSet::use_native_kernels ( std::string const &cache_directory )
+{
+    BOOST_LOG_NAMED_SCOPE ( "CompositionSet::use_native_kernels" );
+    logger comp_log ( journal::keywords::channel = "optimizer" );
+    CompiledModel const &model = *compiled_model;
+    const std::string phase_fraction_name = model.phase_name + "_FRAC";
+    CompiledSlotTable slots = model.slots;
+    const std::size_t n = slots.variables.size();
+
+    // The derivative trees carry the variable names of this composition set (see build_derivative_trees()), but
+    // are compiled against the slots of the model, so those of a set sharing the model are renamed back to it
+    // Model jets do not include the phase fraction, so neither do the kernels
+    ast_set model_named_trees;
+    if ( model.phase_name != cset_name ) {
+        model_named_trees = ast_copy_with_renamed_phase ( get_derivative_trees(), cset_name, model.phase_name );
+    }
+    const ast_set &trees = ( model.phase_name != cset_name ) ? model_named_trees : get_derivative_trees();
+    std::vector<CompiledExpression> derivative_programs;
+    std::vector<std::vector<std::size_t>> derivative_positions;
+    std::vector<bool> second_derivative;
+    derivative_programs.reserve ( trees.size() );
+    for ( auto tree = trees.begin(); tree != trees.end(); ++tree ) {
+        if ( std::find ( tree->diffvars.cbegin(), tree->diffvars.cend(), phase_fraction_name ) != tree->diffvars.cend() ) {
+            continue;
+        }
+        std::vector<std::size_t> diffslots;
+        for ( auto var = tree->diffvars.cbegin(); var != tree->diffvars.cend(); ++var ) {
+            diffslots.push_back ( slots.variable_slot ( *var ) );
+        }
+        std::vector<std::size_t> positions;
+        if ( diffslots.size() == 1 ) {
+            positions.push_back ( diffslots[0] );
+        }
+        else if ( diffslots.size() == 2 ) {
+            positions.push_back ( diffslots[0] * n + diffslots[1] );
+            if ( diffslots[0] != diffslots[1] ) positions.push_back ( diffslots[1] * n + diffslots[0] );
+        }
+        else continue;
+        derivative_programs.emplace_back ( tree->ast, model.symbols, slots );
+        derivative_positions.push_back ( std::move ( positions ) );
+        second_derivative.push_back ( diffslots.size() == 2 );
+    }
+    if ( slots.variables.size() != n || slots.statevars.size() != model.slots.statevars.size() ) {
+        // the kernels could not share the arguments of the interpreted programs
+        BOOST_LOG_SEV ( comp_log, debug ) << cset_name << ": derivative trees reference variables the models do not";
+        return false;
+    }
+
+    std::vector<NativeKernelOutput> energy_outputs, gradient_outputs, hessian_outputs;
+    for ( auto i = model.objective.cbegin(); i != model.objective.cend(); ++i ) {
+        energy_outputs.emplace_back ( *i, std::vector<std::size_t> ( 1, 0 ) );
+    }
+    for ( std::size_t i = 0; i < derivative_programs.size(); ++i ) {
+        ( second_derivative[i] ? hessian_outputs : gradient_outputs ).emplace_back ( derivative_programs[i], derivative_positions[i] );
+    }
+    NativeKernelSource source;
+    source.add_kernel ( "libgibbs_energy", energy_outputs );
+    source.add_kernel ( "libgibbs_gradient", gradient_outputs );
+    source.add_kernel ( "libgibbs_hessian", hessian_outputs );
+    try {
+        std::shared_ptr<NativeModel> native ( std::make_shared<NativeModel>() );
+        native->library.reset ( new NativeKernelLibrary ( source.str(), cache_directory ) );
+        native->energy = native->library->kernel ( "libgibbs_energy" );
+        native->gradient = native->library->kernel ( "libgibbs_gradient" );
+        native->hessian = native->library->kernel ( "libgibbs_hessian" );
+        BOOST_LOG_SEV ( comp_log, debug ) << cset_name << ": using native kernels from " << native->library->path();
+        native_kernels = std::move ( native );
+    }
+    catch ( boost::exception &e ) {
+        BOOST_LOG_SEV ( comp_log, debug ) << cset_name << ": " << boost::diagnostic_information ( e );
+        return false;
+    }
+    return true;
+}
+
+CompiledStatistics CompositionSet::get_compiled_statistics() const
+{
+    CompiledStatistics stats;
+    for ( auto i = compiled_model->objective.cbegin(); i != compiled_model->objective.cend(); ++i ) {
+        stats += i->statistics();
+    }
+    return stats;
+}
+
 // Constructs an orthonormal basis using the linear constraints to generate feasible points
 // Reference: Nocedal and Wright, 2006, ch. 15.2, p. 429
-void CompositionSet::build_constraint_basis_matrices ( sublattice_set const &sublset )
+void CompositionSet::build_constraint_basis_matrices()
 {
     BOOST_LOG_NAMED_SCOPE ( "CompositionSet::build_constraint_basis_matrices" );
     logger comp_log ( journal::keywords::channel = "optimizer" );
@@ -466,35 +1616,21 @@ void CompositionSet::build_constraint_basis_matrices ( sublattice_set const &sub
     using namespace boost::numeric::ublas;
     typedef boost::numeric::ublas::matrix<double> ublas_matrix;
     typedef boost::numeric::ublas::vector<double> ublas_vector;
-    typedef boost::multi_index::index<sublattice_set,phase_subl>::type::iterator subl_iterator;
     // A is the active linear constraint matrix; satisfies Ax=b
     ublas_matrix Atrans ( zero_matrix<double> ( phase_indices.size(), cm.constraints.size() ) );
     ublas_vector b ( zero_vector<double> ( cm.constraints.size() ) );
 
-    subl_iterator subl_iter = boost::multi_index::get<phase_subl> ( sublset ).lower_bound ( boost::make_tuple ( cset_name,0 ) );
-    subl_iterator subl_iter_end = boost::multi_index::get<phase_subl> ( sublset ).upper_bound ( boost::make_tuple ( cset_name,0 ) );
-    int sublindex = 0;
     int constraintindex = 0;
     // This is code for handling the sublattice balance constraint
     // TODO: Handle charge balance constraints (relatively straightforward extension once sublattice_entry has charge attribute)
     // This planned extension is why we keep track of the constraint count separately
-    while ( subl_iter != subl_iter_end ) {
-        // Current sublattice
-        std::vector<std::string> subl_list;
-        for ( ; subl_iter != subl_iter_end ; ++subl_iter ) {
-            const auto variablefind = phase_indices.left.find ( subl_iter->name() );
-            if ( variablefind == phase_indices.left.end() ) {
-                BOOST_LOG_SEV ( comp_log, critical ) << "Can't find " << subl_iter->name() << "!";
-                continue;    // this is bad
-            }
-            const int variableindex = variablefind->second;
+    // The coordinates of the layout are the indices of phase_indices
+    for ( std::size_t sublindex = 0; sublindex < layout.sublattice_count(); ++sublindex ) {
+        for ( std::size_t variableindex = layout.sublattice_begin ( sublindex ); variableindex < layout.sublattice_end ( sublindex ); ++variableindex ) {
             Atrans ( variableindex,constraintindex ) = 1;
         }
         b ( sublindex ) = 1; // sublattice site fractions must sum to 1
-        ++sublindex;
         ++constraintindex;
-        subl_iter = boost::multi_index::get<phase_subl> ( sublset ).lower_bound ( boost::make_tuple ( cset_name,sublindex ) );
-        subl_iter_end = boost::multi_index::get<phase_subl> ( sublset ).upper_bound ( boost::make_tuple ( cset_name,sublindex ) );
     }
 
     BOOST_LOG_SEV ( comp_log, debug ) << "Atrans: " << Atrans;
@@ -523,3 +1659,120 @@ void CompositionSet::build_constraint_basis_matrices ( sublattice_set const &sub
 
     BOOST_LOG_SEV ( comp_log, debug ) << "exit";
 }
+
+namespace {
+std::size_t bimap_heap_bytes ( boost::bimap<std::string, int> const &map )
+{
+    std::size_t bytes = 0;
+    for ( auto i = map.left.begin(); i != map.left.end(); ++i ) {
+        bytes += sizeof ( *i ) + 2 * tree_node_overhead + string_heap_bytes ( i->first ); // one node, indexed both ways
+    }
+    return bytes;
+}
+
+std::size_t slot_table_heap_bytes ( CompiledSlotTable const &slots )
+{
+    std::size_t bytes = vector_heap_bytes ( slots.variables ) + vector_heap_bytes ( slots.statevars );
+    for ( auto i = slots.variables.cbegin(); i != slots.variables.cend(); ++i ) bytes += string_heap_bytes ( *i );
+    return bytes;
+}
+
+MemoryUsage programs_usage ( std::vector<CompiledExpression> const &programs )
+{
+    MemoryUsage usage ( vector_heap_bytes ( programs ), 0 );
+    for ( auto i = programs.cbegin(); i != programs.cend(); ++i ) {
+        usage += MemoryUsage ( i->memory_bytes(), i->instructions().size() );
+    }
+    return usage;
+}
+}
+
+MemoryFootprint CompositionSet::memory_footprint ( SharedObjects &counted ) const
+{
+    MemoryFootprint footprint;
+    if ( counted.insert ( compiled_model.get() ).second ) {
+        for ( auto i = compiled_model->models.cbegin(); i != compiled_model->models.cend(); ++i ) {
+            footprint.add ( "model ASTs", sizeof ( *i ) + tree_node_overhead + string_heap_bytes ( i->first ) + sizeof ( EnergyModel ) );
+            footprint.add ( "model ASTs", utree_memory_usage ( i->second->get_ast() ) );
+            for ( auto const &symbol : i->second->get_symbol_table() ) {
+                footprint.add ( "model symbols", sizeof ( symbol ) + tree_node_overhead + string_heap_bytes ( symbol.first ) );
+                footprint.add ( "model symbols", symbol.second.memory_usage() );
+            }
+        }
+        for ( auto i = compiled_model->symbols.cbegin(); i != compiled_model->symbols.cend(); ++i ) {
+            footprint.add ( "symbol table", sizeof ( *i ) + tree_node_overhead + string_heap_bytes ( i->first ) );
+            footprint.add ( "symbol table", i->second.memory_usage() );
+        }
+        footprint.add ( "compiled programs", programs_usage ( compiled_model->objective ) );
+        footprint.add ( "compiled programs", slot_table_heap_bytes ( compiled_model->slots ) );
+        if ( compiled_model->fixed_shape ) {
+            footprint.add ( "fixed-shape kernels", compiled_model->fixed_shape->memory_bytes() );
+            footprint.add ( "fixed-shape kernels", programs_usage ( compiled_model->coefficient_programs ) );
+        }
+        if ( compiled_model->magnetic ) {
+            footprint.add ( "magnetic kernel", sizeof ( MagneticKernel ) );
+            footprint.add ( "magnetic kernel", programs_usage ( compiled_model->magnetic_programs ) );
+            for ( auto i = compiled_model->magnetic_parameters.cbegin(); i != compiled_model->magnetic_parameters.cend(); ++i ) {
+                footprint.add ( "magnetic kernel", utree_memory_usage ( *i ) );
+            }
+        }
+        std::lock_guard<std::mutex> lock ( compiled_model->specialized_objective_mutex );
+        for ( auto i = compiled_model->specialized_objective.cbegin(); i != compiled_model->specialized_objective.cend(); ++i ) {
+            footprint.add ( "specialized programs", sizeof ( *i ) + 2 * sizeof ( void* ) + vector_heap_bytes ( i->statevar_values )
+                            + vector_heap_bytes ( i->statevar_bound ) );
+            if ( i->fixed_shape_constants && counted.insert ( i->fixed_shape_constants.get() ).second ) {
+                footprint.add ( "fixed-shape kernels", sizeof ( *i->fixed_shape_constants ) + vector_heap_bytes ( *i->fixed_shape_constants ) );
+            }
+            if ( i->magnetic_programs && counted.insert ( i->magnetic_programs.get() ).second ) {
+                footprint.add ( "magnetic kernel", programs_usage ( *i->magnetic_programs ) );
+            }
+            if ( i->programs && counted.insert ( i->programs.get() ).second ) {
+                footprint.add ( "specialized programs", programs_usage ( *i->programs ) );
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock ( tree_data_mutex );
+        if ( tree_data_built && tree_data && counted.insert ( tree_data.get() ).second ) {
+            for ( auto i = tree_data->cbegin(); i != tree_data->cend(); ++i ) {
+                // An entry of a multi_index_container with three ordered indices
+                std::size_t bytes = sizeof ( *i ) + 3 * tree_node_overhead + string_heap_bytes ( i->model_name );
+                for ( auto j = i->diffvars.cbegin(); j != i->diffvars.cend(); ++j ) {
+                    bytes += sizeof ( *j ) + 2 * sizeof ( void* ) + string_heap_bytes ( *j );
+                }
+                footprint.add ( "tree_data", bytes );
+                footprint.add ( "tree_data", utree_memory_usage ( i->ast ) );
+            }
+        }
+    }
+    for ( auto i = first_derivatives.cbegin(); i != first_derivatives.cend(); ++i ) {
+        footprint.add ( "first derivatives", sizeof ( *i ) + tree_node_overhead );
+        footprint.add ( "first derivatives", utree_memory_usage ( i->second ) );
+    }
+    for ( auto i = hessian_data.cbegin(); i != hessian_data.cend(); ++i ) {
+        footprint.add ( "hessian_data", sizeof ( *i ) + tree_node_overhead );
+        for ( auto j = i->asts.cbegin(); j != i->asts.cend(); ++j ) {
+            footprint.add ( "hessian_data", sizeof ( *j ) + tree_node_overhead );
+            footprint.add ( "hessian_data", utree_memory_usage ( j->second ) );
+        }
+    }
+    footprint.add ( "jac_g_trees", vector_heap_bytes ( jac_g_trees ) );
+    for ( auto i = jac_g_trees.cbegin(); i != jac_g_trees.cend(); ++i ) {
+        footprint.add ( "jac_g_trees", utree_memory_usage ( i->ast ) );
+    }
+    footprint.add ( "constraints", vector_heap_bytes ( cm.constraints ) );
+    for ( auto i = cm.constraints.cbegin(); i != cm.constraints.cend(); ++i ) {
+        footprint.add ( "constraints", string_heap_bytes ( i->name ) );
+        footprint.add ( "constraints", utree_memory_usage ( i->lhs ) );
+        footprint.add ( "constraints", utree_memory_usage ( i->rhs ) );
+    }
+    footprint.add ( "basis matrices", ( constraint_null_space_matrix.size1() * constraint_null_space_matrix.size2()
+                                        + gradient_projector.size1() * gradient_projector.size2() ) * sizeof ( double ) );
+    std::size_t index_bytes = bimap_heap_bytes ( phase_indices ) + node_heap_bytes ( starting_point )
+                              + vector_heap_bytes ( derivative_variables ) + slot_table_heap_bytes ( binding_slots );
+    for ( auto i = starting_point.cbegin(); i != starting_point.cend(); ++i ) index_bytes += string_heap_bytes ( i->first );
+    for ( auto i = derivative_variables.cbegin(); i != derivative_variables.cend(); ++i ) index_bytes += string_heap_bytes ( i->first );
+    footprint.add ( "variable maps", index_bytes, phase_indices.size() );
+    footprint.add ( "object", sizeof ( *this ) + string_heap_bytes ( cset_name ) );
+    return footprint;
+}
@@ -19,7 +19,9 @@ SublatticeBalanceConstraint::SublatticeBalanceConstraint(const std::string &phas
 		const std::vector<std::string>::const_iterator spec_begin,
 		const std::vector<std::string>::const_iterator spec_end) {
 	op = ConstraintOperatorType::EQUALITY_CONSTRAINT;
-	name = "Sublattice Site Fraction Balance";
+	std::stringstream constraint_name;
+	constraint_name << phase_name << "_" << sublindex << " Sublattice Site Fraction Balance";
+	name = constraint_name.str(); // unique, so that multipliers can be looked up by name
 	rhs = utree(1); // sublattice site fractions must sum to 1
 	if (std::distance(spec_begin,spec_end) == 0) {
 		// no-phase case
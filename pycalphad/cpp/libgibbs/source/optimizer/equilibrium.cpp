@@ -10,7 +10,9 @@
 #include "libgibbs/include/libgibbs_pch.hpp"
 #include "libgibbs/include/equilibrium.hpp"
 #include "libgibbs/include/conditions.hpp"
+#include "libgibbs/include/optimizer/newton_solver.hpp"
 #include "libgibbs/include/optimizer/opt_Gibbs.hpp"
+#include "libgibbs/include/optimizer/reduced_gibbs_opt.hpp"
 #include "libgibbs/include/utils/enum_handling.hpp"
 #include "libtdb/include/database.hpp"
 #include "libtdb/include/structure.hpp"
@@ -21,50 +23,160 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <chrono>
 #include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 #include <boost/io/ios_state.hpp>
 
 using namespace Ipopt;
 using namespace Optimizer;
 
+namespace {
+// Enables Ipopt's warm start options for the lifetime of the object and restores the previous values afterwards,
+// since the IpoptApplication is shared by all equilibria created by the same factory
+class WarmStartOptions {
+public:
+	WarmStartOptions(const SmartPtr<OptionsList> &opts) : options(opts) {
+		options->GetStringValue("warm_start_init_point", init_point, "");
+		options->SetStringValue("warm_start_init_point", "yes");
+		// The neighbouring solution is already close to optimal, so don't push it away from the bounds
+		// or restart the barrier parameter from its (large) default value
+		set_numeric("warm_start_bound_push", 1e-9);
+		set_numeric("warm_start_bound_frac", 1e-9);
+		set_numeric("warm_start_mult_bound_push", 1e-9);
+		set_numeric("mu_init", 1e-6);
+	}
+	~WarmStartOptions() {
+		options->SetStringValue("warm_start_init_point", init_point);
+		for (auto i = saved.cbegin(); i != saved.cend(); ++i) {
+			options->SetNumericValue(i->first, i->second);
+		}
+	}
+	WarmStartOptions(const WarmStartOptions &) = delete;
+	WarmStartOptions & operator=(const WarmStartOptions &) = delete;
+private:
+	void set_numeric(const std::string &tag, const Number value) {
+		Number old_value;
+		options->GetNumericValue(tag, old_value, ""); // returns the default if the option was never set
+		saved.emplace_back(tag, old_value);
+		options->SetNumericValue(tag, value);
+	}
+	SmartPtr<OptionsList> options;
+	std::string init_point;
+	std::vector<std::pair<std::string,Number> > saved;
+};
+
+// Tells Ipopt that the constraint Jacobian is constant, so that it is evaluated only once, if every
+// constraint of the problem is linear; restores the previous value afterwards, like WarmStartOptions
+class LinearConstraintOptions {
+public:
+	LinearConstraintOptions(const SmartPtr<OptionsList> &opts, const bool constraints_linear) : options(opts), enabled(constraints_linear) {
+		if (!enabled) return;
+		options->GetStringValue("jac_c_constant", jac_c_constant, "");
+		options->SetStringValue("jac_c_constant", "yes");
+	}
+	~LinearConstraintOptions() {
+		if (enabled) options->SetStringValue("jac_c_constant", jac_c_constant);
+	}
+	LinearConstraintOptions(const LinearConstraintOptions &) = delete;
+	LinearConstraintOptions & operator=(const LinearConstraintOptions &) = delete;
+private:
+	SmartPtr<OptionsList> options;
+	const bool enabled;
+	std::string jac_c_constant;
+};
+}
+
 Equilibrium::Equilibrium(const Database &DB, const evalconditions &conds, const SmartPtr<IpoptApplication> &solver)
-: sourcename(DB.get_info()), conditions(conds) {
+: Equilibrium(CompiledSystem(DB, conds), conds, solver, nullptr, nullptr) {
+}
+
+Equilibrium::Equilibrium(const Database &DB, const evalconditions &conds, const SmartPtr<IpoptApplication> &solver,
+		const Equilibrium &previous)
+: Equilibrium(CompiledSystem(DB, conds), conds, solver, &previous.result, nullptr) {
+}
+
+Equilibrium::Equilibrium(const CompiledSystem &system, const evalconditions &conds, const SmartPtr<IpoptApplication> &solver)
+: Equilibrium(system, conds, solver, nullptr, nullptr) {
+}
+
+Equilibrium::Equilibrium(const CompiledSystem &system, const evalconditions &conds, const SmartPtr<IpoptApplication> &solver,
+		const Equilibrium &previous)
+: Equilibrium(system, conds, solver, &previous.result, nullptr) {
+}
+
+Equilibrium::Equilibrium(const std::string &source_name, const evalconditions &conds, EquilibriumResult<Number> &&stored)
+: sourcename(source_name), conditions(conds), result(std::move(stored)) {
+}
+
+Equilibrium::Equilibrium(const CompiledSystem &system, const evalconditions &conds, const SmartPtr<IpoptApplication> &solver,
+		const EquilibriumResult<Number> *warm_start, GlobalHullCache *hull_cache, const SolveControl *control,
+		const EquilibriumSolverOptions &options)
+: sourcename(system.source_name()), conditions(conds) {
 	BOOST_LOG_NAMED_SCOPE("Equilibrium::Equilibrium");
 	logger opt_log(journal::keywords::channel = "optimizer");
 	BOOST_LOG_SEV(opt_log, debug) << "enter ctor";
-	Phase_Collection phase_col;
 	boost::timer::cpu_timer timer; // tracking wall clock time for the solve
-	for (auto i = DB.get_phase_iterator(); i != DB.get_phase_iterator_end(); ++i) {
-		if (conditions.phases.find(i->first) != conditions.phases.end()) {
-			if (conditions.phases.at(i->first) == PhaseStatus::ENTERED) phase_col[i->first] = i->second;
-		}
-	}
-
-	const Phase_Collection::const_iterator phase_iter = phase_col.cbegin();
-	const Phase_Collection::const_iterator phase_end = phase_col.cend();
 
 	// TODO: check validity of conditions
-	if (phase_iter == phase_end) {
+	if (system.phases().empty()) {
 		// No phases are entered
 		BOOST_THROW_EXCEPTION(equilibrium_error() << str_errinfo("No phases are entered"));
 	}
 
 	timer.start();
 	// Create NLP
-	SmartPtr<TNLP> mynlp = new GibbsOpt(DB, conditions);
+	GibbsOpt* const gibbs_nlp = new GibbsOpt(system, conditions, warm_start, hull_cache);
+	SmartPtr<TNLP> full_nlp = gibbs_nlp;
 	BOOST_LOG_SEV(opt_log, debug) << "return from GibbsOpt ctor";
-	ApplicationReturnStatus status;
-	status = solver->OptimizeTNLP(mynlp);
-	BOOST_LOG_SEV(opt_log, debug) << "return from GibbsOpt::OptimizeTNLP";
+	gibbs_nlp->set_control(control);
+	gibbs_nlp->set_telemetry(options.trace, options.stopping_rules);
+	// The reduced problem forwards every callback, including finalize_solution(), to gibbs_nlp
+	SmartPtr<TNLP> mynlp = options.reduced_space ? SmartPtr<TNLP>(new ReducedGibbsOpt(gibbs_nlp)) : full_nlp;
+	if (control && control->stop_requested()) {
+		BOOST_THROW_EXCEPTION(equilibrium_error() << str_errinfo(control->is_cancelled() ? "Calculation was cancelled" : "Calculation timed out"));
+	}
+	// All constraints are equalities, so there is no jac_d_constant to set
+	LinearConstraintOptions linear_constraint_options(solver->Options(), gibbs_nlp->constraints_linear());
+	ApplicationReturnStatus status = Internal_Error;
+	const auto solve_start = std::chrono::steady_clock::now();
+	// Small problems skip Ipopt unless the Newton iteration fails, which leaves gibbs_nlp as it was
+	Index newton_iterations = -1;
+	NewtonGibbsSolver newton(*gibbs_nlp);
+	if (newton.variable_count() <= static_cast<Index>(options.newton_max_variables)) {
+		if (newton.solve(control)) {
+			BOOST_LOG_SEV(opt_log, debug) << "Newton iteration converged";
+			status = Solve_Succeeded;
+			newton_iterations = newton.iterations();
+		}
+		else BOOST_LOG_SEV(opt_log, debug) << "Newton iteration failed; falling back to Ipopt";
+	}
+	if (newton_iterations < 0) {
+		if (warm_start) {
+			BOOST_LOG_SEV(opt_log, debug) << "Warm start from previous solution";
+			WarmStartOptions warm_start_options(solver->Options());
+			status = solver->OptimizeTNLP(mynlp);
+		}
+		else status = solver->OptimizeTNLP(mynlp);
+		BOOST_LOG_SEV(opt_log, debug) << "return from GibbsOpt::OptimizeTNLP";
+	}
+	const std::chrono::duration<double> solve_time = std::chrono::steady_clock::now() - solve_start;
 	timer.stop();
 
+	if (status == User_Requested_Stop && gibbs_nlp->stopped_early() && !(control && control->stop_requested())) {
+		// A stopping rule found the iterate good enough
+		BOOST_LOG_SEV(opt_log, debug) << "Solve stopped by a stopping rule";
+		status = Solve_Succeeded;
+	}
 	if (status == Solve_Succeeded || status == Solved_To_Acceptable_Level) {
-		BOOST_LOG_SEV(opt_log, debug) << "Ipopt returned successfully";
+		BOOST_LOG_SEV(opt_log, debug) << "Solver returned successfully";
 		Number final_obj;
 		/* The dynamic_cast allows us to use the get_result() function.
 		 * It is not exposed by the TNLP base class.
 		 */
-		GibbsOpt* opt_ptr = dynamic_cast<GibbsOpt*> (Ipopt::GetRawPtr(mynlp));
+		GibbsOpt* opt_ptr = dynamic_cast<GibbsOpt*> (Ipopt::GetRawPtr(full_nlp));
 		if (!opt_ptr)
 		{
 			BOOST_LOG_SEV(opt_log, critical) << "Internal memory error from dynamic_cast<GibbsOpt*>";
@@ -72,8 +184,17 @@ Equilibrium::Equilibrium(const Database &DB, const evalconditions &conds, const
 		}
 		BOOST_LOG_SEV(opt_log, debug) << "Attempting get_result()";
 		result = opt_ptr->get_result();
+		result.profile.add("solve (including callbacks)", solve_time.count());
+		if (options.memory_accounting) {
+			// The composition sets have moved to result; see memory_footprint()
+			solver_memory = opt_ptr->memory_footprint();
+			BOOST_LOG_SEV(opt_log, debug) << "solver memory footprint:" << std::endl << solver_memory.print();
+		}
 
-		if (IsValid(solver->Statistics())) {
+		if (newton_iterations >= 0) {
+			result.itercount = newton_iterations;
+		}
+		else if (IsValid(solver->Statistics())) {
 			result.itercount = solver->Statistics()->IterationCount();
 		}
 		else {
@@ -84,6 +205,10 @@ Equilibrium::Equilibrium(const Database &DB, const evalconditions &conds, const
 		result.walltime = timer.elapsed().wall * 1e-9; // timer.elapsed().wall is in nanoseconds
 		result.N = conditions.statevars.find('N')->second; // TODO: this needs to be done in a more general way for unknown N
 	}
+	else if (status == User_Requested_Stop && control) {
+		BOOST_LOG_SEV(opt_log, debug) << "Solve stopped by its SolveControl";
+		BOOST_THROW_EXCEPTION(equilibrium_error() << str_errinfo(control->is_cancelled() ? "Calculation was cancelled" : "Calculation timed out"));
+	}
 	else {
 		BOOST_LOG_SEV(opt_log, critical) << "Failed to construct Equilibrium object";
 		BOOST_THROW_EXCEPTION(equilibrium_error() << str_errinfo("Solver failed to find equilibrium"));
@@ -91,6 +216,32 @@ Equilibrium::Equilibrium(const Database &DB, const evalconditions &conds, const
 	BOOST_LOG_SEV(opt_log, debug) << "exit ctor";
 }
 
+PhaseMemoryFootprint Equilibrium::memory_footprint() const {
+	PhaseMemoryFootprint footprint;
+	SharedObjects counted; // the composition sets of a miscibility gap share their models
+	for (auto i = result.phases.cbegin(); i != result.phases.cend(); ++i) {
+		MemoryFootprint &phase_footprint = footprint.phases[i->first];
+		phase_footprint = i->second.compositionset.memory_footprint(counted);
+		std::size_t sublattice_bytes = vector_heap_bytes(i->second.sublattices);
+		std::size_t components = 0;
+		for (auto subl = i->second.sublattices.cbegin(); subl != i->second.sublattices.cend(); ++subl) {
+			sublattice_bytes += node_heap_bytes(subl->components);
+			for (auto j = subl->components.cbegin(); j != subl->components.cend(); ++j) sublattice_bytes += string_heap_bytes(j->first);
+			components += subl->components.size();
+		}
+		phase_footprint.add("result sublattices", sublattice_bytes, components);
+	}
+	footprint.common.add("result phases", node_heap_bytes(result.phases), result.phases.size());
+	const Optimizer::EquilibriumResult<Ipopt::Number>::VariableMap* const maps[] =
+		{ &result.variables, &result.lower_multipliers, &result.upper_multipliers, &result.constraint_multipliers };
+	for (auto map : maps) {
+		std::size_t bytes = node_heap_bytes(*map);
+		for (auto j = map->cbegin(); j != map->cend(); ++j) bytes += string_heap_bytes(j->first);
+		footprint.common.add("result values", bytes, map->size());
+	}
+	return footprint;
+}
+
 std::string Equilibrium::print() const {
 	BOOST_LOG_NAMED_SCOPE("Equilibrium::print");
 	logger opt_log(journal::keywords::channel = "optimizer");
@@ -100,6 +251,10 @@ std::string Equilibrium::print() const {
 	stream << "Output from LIBGIBBS, equilibrium number = ??" << std::endl;
 	//std::string walltime = boost::timer::format(result.walltime, 3, "%w");
 	stream << "Solved in " << result.itercount << " iterations (" << result.walltime << "secs)" << std::endl;
+	if (!result.profile.empty()) {
+		stream << "Time by stage:" << std::endl;
+		result.profile.print(stream);
+	}
 	stream << "Conditions:" << std::endl;
 
 	// We want the individual phase information to appear AFTER
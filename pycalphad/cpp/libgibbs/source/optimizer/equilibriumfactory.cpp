@@ -9,18 +9,189 @@
 
 #include "libgibbs/include/libgibbs_pch.hpp"
 #include "libgibbs/include/equilibrium.hpp"
+#include "libgibbs/include/utils/worker_placement.hpp"
+#include "libtdb/include/exceptions.hpp"
 #include <coin/IpIpoptApplication.hpp>
 #include <coin/IpSolveStatistics.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <set>
+#include <thread>
 
 using namespace Ipopt;
 
+struct EquilibriumJob::State {
+	enum { QUEUED, RUNNING, ENDED };
+	State(const Database &DB, const evalconditions &conds, const double timeout_seconds) :
+		database(&DB), conditions(conds), timeout(timeout_seconds), stage(QUEUED), future(promise.get_future().share()) { }
+	const Database *database;
+	const evalconditions conditions;
+	const double timeout;
+	Optimizer::SolveControl control;
+	std::atomic<int> stage; // QUEUED -> RUNNING -> ENDED, or QUEUED -> ENDED if cancelled before it started
+	std::promise<boost::shared_ptr<Equilibrium>> promise;
+	std::shared_future<boost::shared_ptr<Equilibrium>> future;
+	// Ends a job which has not started; false if a worker has already taken it
+	bool cancel_queued() {
+		int queued = QUEUED;
+		if (!stage.compare_exchange_strong(queued, ENDED)) return false;
+		promise.set_exception(std::make_exception_ptr(equilibrium_error() << str_errinfo("Calculation was cancelled")));
+		return true;
+	}
+};
+
+/* The workers behind EquilibriumFactory::submit(). Each worker thread owns an EquilibriumFactory,
+ * and so its own Ipopt instance, compiled systems and global hulls, as the workers of Mesh::solve() do.
+ * Jobs wait in a bounded queue and are claimed one at a time, so a slow job holds up only its worker.
+ * The workers are spread over the NUMA nodes (see WorkerPlacement), and the queue is split into one per node;
+ * jobs are dealt to the nodes in turn, and a worker whose node has none takes one from the nearest other node.
+ */
+class EquilibriumWorkerPool {
+public:
+	EquilibriumWorkerPool(std::size_t threads, const std::size_t queue_capacity, const bool pin_workers,
+		const std::string &cache_directory, const EquilibriumSolverOptions &solver_options) :
+		placement(CpuTopology::detect(), threads == 0 ? std::max(std::thread::hardware_concurrency(), 1u) : threads, pin_workers),
+		capacity(queue_capacity), stopping(false), queued(0), next_queue(0) {
+		if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+		if (capacity == 0) capacity = 16 * threads;
+		queues.resize(placement.node_count());
+		for (std::size_t i = 0; i < threads; ++i) {
+			workers.emplace_back([this, i, cache_directory, solver_options]() { work(i, cache_directory, solver_options); });
+		}
+	}
+	// Cancels the queued and running jobs, and waits for the workers to notice
+	~EquilibriumWorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			for (auto queue = queues.begin(); queue != queues.end(); ++queue) {
+				for (auto i = queue->begin(); i != queue->end(); ++i) (*i)->cancel_queued();
+				queue->clear();
+			}
+			queued = 0;
+			for (auto i = running.begin(); i != running.end(); ++i) (*i)->control.cancel();
+		}
+		not_empty.notify_all();
+		not_full.notify_all();
+		for (auto &worker : workers) worker.join();
+	}
+	EquilibriumWorkerPool(const EquilibriumWorkerPool &) = delete;
+	EquilibriumWorkerPool & operator=(const EquilibriumWorkerPool &) = delete;
+
+	void push(const std::shared_ptr<EquilibriumJob::State> &job) {
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this]() { return stopping || queued < capacity; });
+		if (stopping) {
+			job->cancel_queued();
+			return;
+		}
+		queues[next_queue].push_back(job);
+		next_queue = (next_queue + 1) % queues.size();
+		++queued;
+		lock.unlock();
+		not_empty.notify_one(); // any worker may take it, if not from its own node then by stealing
+
+	}
+private:
+	// The next job, from the queue of node or else the nearest other nonempty queue; queued > 0
+	std::shared_ptr<EquilibriumJob::State> pop(const std::size_t node) {
+		const std::size_t nodes = queues.size();
+		for (std::size_t distance = 0; distance < nodes; ++distance) {
+			// Own node first, then alternately above and below it, as NodeLocalClaims
+			const std::size_t offset = (distance + 1) / 2;
+			std::deque<std::shared_ptr<EquilibriumJob::State>> &queue = queues[distance % 2 == 1 ? (node + offset) % nodes : (node + nodes - offset) % nodes];
+			if (queue.empty()) continue;
+			std::shared_ptr<EquilibriumJob::State> job = queue.front();
+			queue.pop_front();
+			--queued;
+			return job;
+		}
+		return nullptr;
+	}
+	void work(const std::size_t worker, const std::string &cache_directory, const EquilibriumSolverOptions &solver_options) {
+		std::unique_ptr<EquilibriumFactory> solver;
+		std::exception_ptr solver_error; // e.g., Ipopt failed to initialize; every job of this worker fails with it
+		try {
+			placement.enter(worker); // before the solver is built, so that its memory is allocated on the worker's node
+			solver.reset(new EquilibriumFactory());
+			solver->SetCacheDirectory(cache_directory);
+			solver->SetReducedSpace(solver_options.reduced_space);
+			solver->SetNewtonMaxVariables(solver_options.newton_max_variables);
+			solver->SetMemoryAccounting(solver_options.memory_accounting);
+			solver->SetSolverTrace(solver_options.trace);
+			for (auto rule = solver_options.stopping_rules.cbegin(); rule != solver_options.stopping_rules.cend(); ++rule) {
+				solver->AddStoppingRule(*rule);
+			}
+			solver->SetSolverPrintLevel(solver_options.print_level);
+		}
+		catch (...) {
+			solver_error = std::current_exception();
+		}
+		for (;;) {
+			std::shared_ptr<EquilibriumJob::State> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				not_empty.wait(lock, [this]() { return stopping || queued > 0; });
+				if (queued == 0) return; // stopping
+				job = pop(placement.node(worker));
+				int queued = EquilibriumJob::State::QUEUED;
+				if (!job->stage.compare_exchange_strong(queued, EquilibriumJob::State::RUNNING)) job.reset(); // cancelled
+				else running.insert(job);
+			}
+			not_full.notify_one();
+			if (!job) continue;
+			try {
+				if (solver_error) std::rethrow_exception(solver_error);
+				job->control.set_timeout(job->timeout);
+				job->promise.set_value(solver->create(*job->database, job->conditions, job->control));
+			}
+			catch (...) {
+				job->promise.set_exception(std::current_exception());
+			}
+			job->stage = EquilibriumJob::State::ENDED;
+			std::lock_guard<std::mutex> lock(mutex);
+			running.erase(job);
+		}
+	}
+	const WorkerPlacement placement;
+	std::size_t capacity; // of all queues together
+	bool stopping;
+	std::mutex mutex; // guards everything below and stopping
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+	std::vector<std::deque<std::shared_ptr<EquilibriumJob::State>>> queues; // one per node of placement
+	std::size_t queued; // jobs in all queues
+	std::size_t next_queue; // of the next push()
+	std::set<std::shared_ptr<EquilibriumJob::State>> running;
+	std::vector<std::thread> workers;
+};
+
+boost::shared_ptr<Equilibrium> EquilibriumJob::get() const {
+	return state->future.get();
+}
+
+bool EquilibriumJob::ready() const {
+	return wait_for(0);
+}
+
+bool EquilibriumJob::wait_for(const double seconds) const {
+	return state->future.wait_for(std::chrono::duration<double>(seconds)) == std::future_status::ready;
+}
 
-EquilibriumFactory::EquilibriumFactory() : app(SmartPtr<IpoptApplication>(new IpoptApplication())) {
+void EquilibriumJob::cancel() {
+	if (!state->cancel_queued()) state->control.cancel();
+}
+
+
+EquilibriumFactory::EquilibriumFactory() : app(SmartPtr<IpoptApplication>(new IpoptApplication())), pin_workers(false) {
 	// set Ipopt options
 	//app->Options()->SetStringValue("derivative_test","second-order");
 	//app->Options()->SetNumericValue("derivative_test_perturbation",1e-6);
 	//app->Options()->SetStringValue("hessian_approximation","limited-memory");
-	app->Options()->SetIntegerValue("print_level",6);
+	app->Options()->SetIntegerValue("print_level",solver_options.print_level);
 	//app->Options()->SetStringValue("derivative_test_print_all","yes");
 	app->Options()->SetStringValue("sb","yes"); // we handle copyright printing for Ipopt
 	app->RethrowNonIpoptException(true); // push our exceptions back up through the call stack
@@ -33,11 +204,130 @@ EquilibriumFactory::EquilibriumFactory() : app(SmartPtr<IpoptApplication>(new Ip
 	}
 }
 
+EquilibriumFactory::~EquilibriumFactory() {
+}
+
+const CompiledSystem& EquilibriumFactory::get_system(const Database &DB, const evalconditions &conds) {
+	for (auto i = systems.begin(); i != systems.end(); ++i) {
+		if (i->matches(DB, conds)) return *i;
+	}
+	systems.emplace_back(DB, conds, cache_directory);
+	return systems.back();
+}
+
+std::shared_ptr<const Optimizer::ResultDescriptor> EquilibriumFactory::find_descriptor
+(const CompiledSystem &system, const Optimizer::EquilibriumResult<Number> &result) {
+	for (auto i = descriptors.cbegin(); i != descriptors.cend(); ++i) {
+		if (i->first == &system && i->second->matches(result)) return i->second;
+	}
+	return nullptr;
+}
+
+boost::shared_ptr<Equilibrium> EquilibriumFactory::solve
+(const CompiledSystem &system, const evalconditions &conds, const Optimizer::EquilibriumResult<Number> *warm_start,
+		const Optimizer::SolveControl *control) {
+	if (!results) {
+		return boost::shared_ptr<Equilibrium>(new Equilibrium(system, conds, app, warm_start, &hulls, control, solver_options));
+	}
+	Optimizer::CompactEquilibriumResult stored;
+	if (results->find(system, conds, stored)) {
+		return boost::shared_ptr<Equilibrium>(new Equilibrium(system.source_name(), conds, stored.restore()));
+	}
+	Optimizer::EquilibriumResult<Number> seed;
+	if (!warm_start && results->nearest(system, conds, seed)) warm_start = &seed;
+	boost::shared_ptr<Equilibrium> equilibrium(new Equilibrium(system, conds, app, warm_start, &hulls, control, solver_options));
+	std::shared_ptr<const Optimizer::ResultDescriptor> descriptor = find_descriptor(system, equilibrium->result);
+	if (!descriptor) {
+		// The equilibrium keeps its composition sets, so the descriptor gets copies
+		descriptor = std::make_shared<const Optimizer::ResultDescriptor>(equilibrium->result);
+		descriptors.emplace_back(&system, descriptor);
+	}
+	results->insert(system, conds, Optimizer::CompactEquilibriumResult(equilibrium->result, descriptor));
+	return equilibrium;
+}
+
 boost::shared_ptr<Equilibrium> EquilibriumFactory::create
 (const Database &DB, const evalconditions &conds) {
-	return boost::shared_ptr<Equilibrium>(new Equilibrium(DB, conds, app));
+	return solve(get_system(DB, conds), conds, nullptr, nullptr);
+}
+
+boost::shared_ptr<Equilibrium> EquilibriumFactory::create
+(const Database &DB, const evalconditions &conds, const Equilibrium &previous) {
+	return solve(get_system(DB, conds), conds, &previous.result, nullptr);
+}
+
+boost::shared_ptr<Equilibrium> EquilibriumFactory::create
+(const Database &DB, const evalconditions &conds, const Optimizer::EquilibriumResult<Number> &previous) {
+	return solve(get_system(DB, conds), conds, &previous, nullptr);
+}
+
+boost::shared_ptr<Equilibrium> EquilibriumFactory::create
+(const Database &DB, const evalconditions &conds, const Optimizer::SolveControl &control) {
+	return solve(get_system(DB, conds), conds, nullptr, &control);
+}
+
+Optimizer::CompactEquilibriumResult EquilibriumFactory::create_compact
+(const Database &DB, const evalconditions &conds, const Optimizer::EquilibriumResult<Number> *warm_start) {
+	const CompiledSystem &system = get_system(DB, conds);
+	Optimizer::CompactEquilibriumResult result;
+	if (results && results->find(system, conds, result)) return result;
+	Optimizer::EquilibriumResult<Number> seed;
+	if (!warm_start && results && results->nearest(system, conds, seed)) warm_start = &seed;
+	Equilibrium equilibrium(system, conds, app, warm_start, &hulls, nullptr, solver_options);
+	const std::shared_ptr<const Optimizer::ResultDescriptor> descriptor = find_descriptor(system, equilibrium.result);
+	result = Optimizer::CompactEquilibriumResult(std::move(equilibrium.result), descriptor);
+	if (result.descriptor != descriptor) descriptors.emplace_back(&system, result.descriptor);
+	if (results) results->insert(system, conds, result);
+	return result;
+}
+
+Optimizer::CompactEquilibriumResult EquilibriumFactory::create_compact
+(const Database &DB, const evalconditions &conds) {
+	return create_compact(DB, conds, nullptr);
+}
+
+Optimizer::CompactEquilibriumResult EquilibriumFactory::create_compact
+(const Database &DB, const evalconditions &conds, const Optimizer::CompactEquilibriumResult &previous) {
+	const Optimizer::EquilibriumResult<Number> warm_start = previous.expand();
+	return create_compact(DB, conds, &warm_start);
+}
+
+void EquilibriumFactory::StartWorkers(const std::size_t threads, const std::size_t queue_capacity) {
+	std::shared_ptr<EquilibriumWorkerPool> previous;
+	{
+		std::lock_guard<std::mutex> lock(workers_mutex);
+		previous = std::move(workers);
+		workers = std::make_shared<EquilibriumWorkerPool>(threads, queue_capacity, pin_workers, cache_directory, solver_options);
+	}
+	// previous is stopped when the last submit() to it has returned, without holding up the new workers
+}
+
+EquilibriumJob EquilibriumFactory::submit(const Database &DB, const evalconditions &conds, const double timeout) {
+	const std::shared_ptr<EquilibriumJob::State> job(std::make_shared<EquilibriumJob::State>(DB, conds, timeout));
+	std::shared_ptr<EquilibriumWorkerPool> pool;
+	{
+		std::lock_guard<std::mutex> lock(workers_mutex);
+		if (!workers) workers = std::make_shared<EquilibriumWorkerPool>(0, 0, pin_workers, cache_directory, solver_options);
+		pool = workers;
+	}
+	pool->push(job); // may block, so outside the lock
+	return EquilibriumJob(job);
+}
+
+std::vector<EquilibriumJob> EquilibriumFactory::submit(const Database &DB, const std::vector<evalconditions> &conds, const double timeout) {
+	std::vector<EquilibriumJob> jobs;
+	jobs.reserve(conds.size());
+	for (auto i = conds.cbegin(); i != conds.cend(); ++i) {
+		jobs.push_back(submit(DB, *i, timeout));
+	}
+	return jobs;
 }
 
 SmartPtr<IpoptApplication> EquilibriumFactory::GetIpopt() {
 	return app;
 }
+
+void EquilibriumFactory::SetSolverPrintLevel(int level) {
+	solver_options.print_level = level;
+	app->Options()->SetIntegerValue("print_level", level);
+}
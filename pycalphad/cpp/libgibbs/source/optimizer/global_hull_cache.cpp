@@ -0,0 +1,62 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Global hulls kept between equilibrium calculations at the same temperature and pressure
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/global_hull_cache.hpp"
+#include "libtdb/include/logging.hpp"
+#include <algorithm>
+#include <chrono>
+
+GlobalHullCache::GlobalHullCache ( const std::size_t capacity ) :
+    capacity ( std::max ( capacity, std::size_t ( 1 ) ) ), hit_count ( 0 ), miss_count ( 0 )
+{
+}
+
+GlobalHullCache::MinimizerType& GlobalHullCache::hull ( const CompiledSystem &system, const evalconditions &conditions, StageProfile &profile )
+{
+    BOOST_LOG_NAMED_SCOPE ( "GlobalHullCache::hull" );
+    logger opto_log ( journal::keywords::channel = "optimizer" );
+    std::map<char,double> statevars ( conditions.statevars );
+    statevars.erase ( 'N' );
+    std::set<std::string> entered_phases;
+    for ( auto i = conditions.phases.cbegin(); i != conditions.phases.cend(); ++i ) {
+        if ( i->second == Optimizer::PhaseStatus::ENTERED ) entered_phases.insert ( i->first );
+    }
+
+    for ( auto i = entries.begin(); i != entries.end(); ++i ) {
+        if ( i->system == &system && i->statevars == statevars && i->entered_phases == entered_phases ) {
+            entries.splice ( entries.begin(), entries, i ); // now the most recently used
+            ++hit_count;
+            return *entries.front().minimizer;
+        }
+    }
+
+    ++miss_count;
+    Entry entry;
+    entry.system = &system;
+    entry.statevars = std::move ( statevars );
+    entry.entered_phases = std::move ( entered_phases );
+    entry.minimizer.reset ( new MinimizerType() );
+    entry.minimizer->run ( system.composition_sets(), system.sublattices(), conditions );
+    profile.merge ( entry.minimizer->get_profile() );
+    entries.push_front ( std::move ( entry ) );
+    while ( entries.size() > capacity ) entries.pop_back();
+    BOOST_LOG_SEV ( opto_log, debug ) << "built global hull " << miss_count << "; " << hit_count << " reused, " << entries.size() << " kept";
+    return *entries.front().minimizer;
+}
+
+std::vector<GlobalHullCache::HullEntryType> GlobalHullCache::find_tie_points (
+    const CompiledSystem &system, const evalconditions &conditions, StageProfile &profile )
+{
+    MinimizerType &minimizer = hull ( system, conditions, profile );
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<HullEntryType> tie_points = minimizer.find_tie_points ( conditions );
+    profile.add ( "global minimization: tie points", std::chrono::duration<double> ( std::chrono::steady_clock::now() - start ).count() );
+    return tie_points;
+}
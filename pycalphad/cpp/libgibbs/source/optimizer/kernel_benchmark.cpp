@@ -0,0 +1,214 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Repeatable timings of the kernels of an equilibrium calculation
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/kernel_benchmark.hpp"
+#include "libgibbs/include/equilibrium.hpp"
+#include "libgibbs/include/compositionset.hpp"
+#include "libgibbs/include/optimizer/compiled_system.hpp"
+#include "libgibbs/include/optimizer/lower_hull_minimization.hpp"
+#include "libgibbs/include/optimizer/utils/convex_hull.hpp"
+#include "libgibbs/include/optimizer/utils/ezd_minimization.hpp"
+#include "libgibbs/include/optimizer/utils/simplicial_facet.hpp"
+#include "libgibbs/include/utils/math_expr.hpp"
+#include "libgibbs/include/utils/parameter_index.hpp"
+#include "libgibbs/include/utils/stage_profile.hpp"
+#include <boost/bimap.hpp>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Optimizer {
+
+namespace {
+typedef LowerHullGlobalMinimizer<details::SimplicialFacet<double>,double,double> BenchmarkMinimizer;
+
+// Repeats kernel until the options are satisfied and records the mean time of one call
+template <typename Kernel>
+KernelBenchmarkRecord time_kernel ( std::string const &name, KernelBenchmarkOptions const &options,
+                                    std::size_t const items_per_iteration, Kernel &&kernel )
+{
+    KernelBenchmarkRecord record;
+    record.name = name;
+    record.items_per_iteration = items_per_iteration;
+    const auto start = std::chrono::steady_clock::now();
+    const std::clock_t cpu_start = std::clock();
+    double elapsed = 0;
+    while ( record.iterations < options.min_iterations || elapsed < options.min_seconds ) {
+        kernel();
+        ++record.iterations;
+        elapsed = std::chrono::duration<double> ( std::chrono::steady_clock::now() - start ).count();
+    }
+    const double cpu_elapsed = double ( std::clock() - cpu_start ) / CLOCKS_PER_SEC;
+    record.real_time = elapsed * 1e9 / record.iterations;
+    record.cpu_time = cpu_elapsed * 1e9 / record.iterations;
+    return record;
+}
+
+// Each sublattice at equal site fractions, and all phases with the same phase fraction
+std::vector<double> central_point ( sublattice_set const &sublset, boost::bimap<std::string, int> const &main_indices,
+                                    std::size_t const phase_count )
+{
+    int max_index = -1;
+    for ( auto i = main_indices.right.begin(); i != main_indices.right.end(); ++i ) {
+        max_index = std::max ( max_index, i->first );
+    }
+    std::vector<double> x ( max_index+1, 0 );
+    for ( auto i = sublset.begin(); i != sublset.end(); ++i ) {
+        if ( i->index < 0 ) {
+            x[i->opt_index] = 1.0 / phase_count;
+            continue;
+        }
+        const auto species = boost::multi_index::get<phase_subl> ( sublset ).equal_range ( boost::make_tuple ( i->phase, i->index ) );
+        x[i->opt_index] = 1.0 / std::distance ( species.first, species.second );
+    }
+    return x;
+}
+
+std::string json_string ( std::string const &value )
+{
+    std::string quoted ( "\"" );
+    for ( auto c : value ) {
+        if ( c == '"' || c == '\\' ) quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+}
+
+std::vector<KernelBenchmarkRecord> benchmark_kernels (
+    std::string const &label,
+    Database const &DB,
+    evalconditions const &conditions,
+    KernelBenchmarkOptions const &options )
+{
+    BOOST_LOG_NAMED_SCOPE ( "benchmark_kernels" );
+    logger opto_log ( journal::keywords::channel = "optimizer" );
+    std::vector<KernelBenchmarkRecord> records;
+
+    records.push_back ( time_kernel ( "CompiledSystem/" + label, options, 0, [&] () {
+        CompiledSystem system ( DB, conditions );
+    } ) );
+    const CompiledSystem system ( DB, conditions );
+    const parameter_set pset = DB.get_parameter_set();
+    records.push_back ( time_kernel ( "ParameterIndex/" + label, options, 0, [&] () {
+        ParameterIndex index ( pset );
+    } ) );
+    const std::shared_ptr<const ParameterIndex> parameter_index = ParameterIndex::of ( DB );
+    const sublattice_set &sublset = system.sublattices();
+    const boost::bimap<std::string, int> &main_indices = system.variable_map();
+    std::vector<double> x = central_point ( sublset, main_indices, system.phases().size() );
+
+    for ( auto phase = system.phases().cbegin(); phase != system.phases().cend(); ++phase ) {
+        const std::string suffix = "/" + label + "/" + phase->first;
+        records.push_back ( time_kernel ( "CompositionSet" + suffix, options, 0, [&] () {
+            CompositionSet compset ( phase->second, pset, sublset, main_indices, parameter_index.get() );
+            compset.get_derivative_trees();
+        } ) );
+
+        const CompositionSet &compset = system.composition_sets().at ( phase->first );
+        const ast_set &trees = compset.get_derivative_trees();
+        records.push_back ( time_kernel ( "process_utree" + suffix, options, trees.size(), [&] () {
+            for ( auto tree = trees.begin(); tree != trees.end(); ++tree ) {
+                process_utree ( tree->ast, conditions, main_indices, compset.get_symbols(), &x[0] );
+            }
+        } ) );
+        records.push_back ( time_kernel ( "evaluate_objective_gradient" + suffix, options, 0, [&] () {
+            compset.evaluate_objective_gradient ( conditions, main_indices, &x[0] );
+        } ) );
+        records.push_back ( time_kernel ( "evaluate_objective_hessian" + suffix, options, 0, [&] () {
+            compset.evaluate_objective_hessian ( conditions, main_indices, &x[0] );
+        } ) );
+
+        // Same settings as a default GlobalMinimizer
+        details::PointCloud<double> points;
+        KernelBenchmarkRecord sampling = time_kernel ( "AdaptiveSimplexSample" + suffix, options, 0, [&] () {
+            points = details::AdaptiveSimplexSample ( compset, sublset, conditions, 20, 2, true );
+        } );
+        sampling.items_per_iteration = points.size();
+        records.push_back ( sampling );
+        if ( points.size() == 0 ) continue;
+        const std::set<std::size_t> dependent = compset.sublattice_layout().dependent_dimensions();
+        const std::function<double(const std::vector<double>&)> energy = [&] ( const std::vector<double> &point ) {
+            return compset.evaluate_objective ( conditions, compset.get_variable_map(), const_cast<double*> ( &point[0] ) );
+        };
+        records.push_back ( time_kernel ( "internal_lower_convex_hull" + suffix, options, points.size(), [&] () {
+            details::internal_lower_convex_hull ( points, dependent, 0.05, energy );
+        } ) );
+    }
+
+    // The global hull needs the merged internal hulls of all phases, so it is timed within complete runs
+    BenchmarkMinimizer minimizer;
+    StageProfile minimizer_profile; // summed over all runs; run() resets the minimizer's own
+    records.push_back ( time_kernel ( "GlobalMinimizer/" + label, options, 0, [&] () {
+        minimizer.run ( system.composition_sets(), sublset, conditions );
+        minimizer_profile.merge ( minimizer.get_profile() );
+    } ) );
+    const StageTiming global_hull = minimizer_profile.stage ( "global minimization: global hull" );
+    if ( global_hull.calls > 0 ) {
+        KernelBenchmarkRecord record;
+        record.name = "global_lower_convex_hull/" + label;
+        record.iterations = global_hull.calls;
+        record.real_time = record.cpu_time = global_hull.seconds * 1e9 / global_hull.calls;
+        records.push_back ( record );
+    }
+
+    if ( options.equilibrium ) {
+        EquilibriumFactory factory;
+        factory.create ( DB, conditions ); // builds the compiled system once, as in a step calculation
+        records.push_back ( time_kernel ( "Equilibrium/" + label, options, 0, [&] () {
+            factory.create ( DB, conditions );
+        } ) );
+    }
+    BOOST_LOG_SEV ( opto_log, debug ) << "timed " << records.size() << " kernels for " << label;
+    return records;
+}
+
+void write_benchmark_json ( std::ostream &stream, std::vector<KernelBenchmarkRecord> const &records )
+{
+    char date[64];
+    const std::time_t now = std::time ( nullptr );
+    std::strftime ( date, sizeof ( date ), "%Y-%m-%dT%H:%M:%S", std::localtime ( &now ) );
+#ifdef NDEBUG
+    const char* const build_type = "release";
+#else
+    const char* const build_type = "debug";
+#endif
+    stream << "{" << std::endl;
+    stream << "  \"context\": {" << std::endl;
+    stream << "    \"date\": " << json_string ( date ) << "," << std::endl;
+    stream << "    \"num_cpus\": " << std::thread::hardware_concurrency() << "," << std::endl;
+    stream << "    \"library\": \"libgibbs\"," << std::endl;
+    stream << "    \"library_build_type\": " << json_string ( build_type ) << std::endl;
+    stream << "  }," << std::endl;
+    stream << "  \"benchmarks\": [" << std::endl;
+    for ( auto i = records.cbegin(); i != records.cend(); ++i ) {
+        stream << "    {" << std::endl;
+        stream << "      \"name\": " << json_string ( i->name ) << "," << std::endl;
+        stream << "      \"run_name\": " << json_string ( i->name ) << "," << std::endl;
+        stream << "      \"run_type\": \"iteration\"," << std::endl;
+        stream << "      \"iterations\": " << i->iterations << "," << std::endl;
+        stream << "      \"real_time\": " << i->real_time << "," << std::endl;
+        stream << "      \"cpu_time\": " << i->cpu_time << "," << std::endl;
+        stream << "      \"time_unit\": \"ns\"";
+        if ( i->items_per_iteration > 0 && i->real_time > 0 ) {
+            stream << "," << std::endl << "      \"items_per_second\": " << i->items_per_iteration * 1e9 / i->real_time;
+        }
+        stream << std::endl << "    }" << ( i+1 != records.cend() ? "," : "" ) << std::endl;
+    }
+    stream << "  ]" << std::endl;
+    stream << "}" << std::endl;
+}
+
+}
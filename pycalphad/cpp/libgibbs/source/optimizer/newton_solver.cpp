@@ -0,0 +1,285 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// newton_solver.cpp -- definition for the dense Newton solver of small equilibria
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/newton_solver.hpp"
+#include "libgibbs/include/utils/small_matrix.hpp"
+#include "libtdb/include/logging.hpp"
+#include <coin/IpTNLP.hpp>
+#include <algorithm>
+#include <cmath>
+
+using namespace Ipopt;
+
+NewtonGibbsSolver::NewtonGibbsSolver ( TNLP &problem ) :
+    max_iterations ( 50 ), tolerance ( 1e-9 ), opto_log ( journal::keywords::channel = "optimizer" ), nlp ( problem ), iteration_count ( 0 )
+    {
+    TNLP::IndexStyleEnum index_style;
+    nlp.get_nlp_info ( n, m, nnz_jac, nnz_h, index_style );
+    }
+
+double NewtonGibbsSolver::evaluate_residual ( const std::vector<double> &x, const std::vector<double> &lambda, const bool new_x )
+    {
+    if ( !nlp.eval_f ( n, x.data(), new_x, objective ) ) return -1;
+    if ( !nlp.eval_grad_f ( n, x.data(), false, gradient.data() ) ) return -1;
+    if ( m > 0 )
+        {
+        if ( !nlp.eval_g ( n, x.data(), false, m, constraints.data() ) ) return -1;
+        if ( nnz_jac > 0 && !nlp.eval_jac_g ( n, x.data(), false, m, nnz_jac, nullptr, nullptr, jacobian.data() ) ) return -1;
+        }
+    std::copy ( gradient.cbegin(), gradient.cend(), residual.begin() );
+    for ( Index entry = 0; entry < nnz_jac; ++entry )
+        {
+        residual[jac_cols[entry]] += jacobian[entry] * lambda[jac_rows[entry]];
+        }
+    gradient_norm = 0;
+    double norm = 0;
+    for ( const Index variable : free_variables )
+        {
+        gradient_norm = std::max ( gradient_norm, std::fabs ( gradient[variable] ) );
+        norm += residual[variable] * residual[variable];
+        }
+    for ( Index row = 0; row < m; ++row )
+        {
+        residual[n + row] = constraints[row] - g_l[row];
+        norm += residual[n + row] * residual[n + row];
+        }
+    norm = std::sqrt ( norm );
+    return std::isfinite ( norm ) ? norm : -1;
+    }
+
+bool NewtonGibbsSolver::reduced_hessian_positive_definite ( const std::vector<double> &x, const std::vector<double> &lambda )
+    {
+    const std::size_t free_count = free_variables.size();
+    std::vector<long> free_index ( n, -1 );
+    for ( std::size_t i = 0; i < free_count; ++i ) free_index[free_variables[i]] = i;
+    std::vector<double> hessian ( nnz_h ), dense_hessian ( free_count * free_count, 0.0 );
+    if ( nnz_h > 0 && !nlp.eval_h ( n, x.data(), false, 1, m, lambda.data(), true, nnz_h, nullptr, nullptr, hessian.data() ) ) return false;
+    for ( Index entry = 0; entry < nnz_h; ++entry )
+        {
+        const long row = free_index[hess_rows[entry]], col = free_index[hess_cols[entry]];
+        if ( row < 0 || col < 0 ) continue;
+        dense_hessian[row * free_count + col] += hessian[entry];
+        if ( row != col ) dense_hessian[col * free_count + row] += hessian[entry];
+        }
+
+    // Orthonormal basis of the row space of J (Gram-Schmidt, dropping dependent rows),
+    // extended by the unit vectors to an orthonormal basis of the whole space
+    const double dependence_tolerance = 1e-8;
+    std::vector<std::vector<double>> basis;
+    auto add_to_basis = [&basis, free_count, dependence_tolerance] ( std::vector<double> vector )
+        {
+        double initial_norm = 0;
+        for ( const double coord : vector ) initial_norm += coord * coord;
+        initial_norm = std::sqrt ( initial_norm );
+        for ( const std::vector<double> &axis : basis )
+            {
+            double projection = 0;
+            for ( std::size_t i = 0; i < free_count; ++i ) projection += vector[i] * axis[i];
+            for ( std::size_t i = 0; i < free_count; ++i ) vector[i] -= projection * axis[i];
+            }
+        double norm = 0;
+        for ( const double coord : vector ) norm += coord * coord;
+        norm = std::sqrt ( norm );
+        if ( !( norm > dependence_tolerance * initial_norm ) ) return;
+        for ( double &coord : vector ) coord /= norm;
+        basis.emplace_back ( std::move ( vector ) );
+        };
+    std::vector<std::vector<double>> jacobian_rows ( m, std::vector<double> ( free_count, 0.0 ) );
+    for ( Index entry = 0; entry < nnz_jac; ++entry )
+        {
+        const long col = free_index[jac_cols[entry]];
+        if ( col >= 0 ) jacobian_rows[jac_rows[entry]][col] += jacobian[entry];
+        }
+    for ( std::vector<double> &row : jacobian_rows ) add_to_basis ( std::move ( row ) );
+    const std::size_t row_rank = basis.size();
+    for ( std::size_t i = 0; i < free_count && basis.size() < free_count; ++i )
+        {
+        std::vector<double> unit ( free_count, 0.0 );
+        unit[i] = 1;
+        add_to_basis ( std::move ( unit ) );
+        }
+
+    // Z^T H Z, where the columns of Z are the basis vectors orthogonal to the rows of J
+    const std::size_t null_count = basis.size() - row_rank;
+    std::vector<double> reduced_hessian ( null_count * null_count, 0.0 ), product ( free_count );
+    for ( std::size_t col = 0; col < null_count; ++col )
+        {
+        const std::vector<double> &z_col = basis[row_rank + col];
+        for ( std::size_t i = 0; i < free_count; ++i )
+            {
+            product[i] = 0;
+            for ( std::size_t j = 0; j < free_count; ++j ) product[i] += dense_hessian[i * free_count + j] * z_col[j];
+            }
+        for ( std::size_t row = 0; row < null_count; ++row )
+            {
+            const std::vector<double> &z_row = basis[row_rank + row];
+            double sum = 0;
+            for ( std::size_t i = 0; i < free_count; ++i ) sum += z_row[i] * product[i];
+            reduced_hessian[row * null_count + col] = sum;
+            }
+        }
+    char positive_definite = false;
+    positive_definite_mask ( reduced_hessian.data(), 1, null_count, &positive_definite );
+    return positive_definite;
+    }
+
+bool NewtonGibbsSolver::solve ( const Optimizer::SolveControl *control )
+    {
+    BOOST_LOG_NAMED_SCOPE ( "NewtonGibbsSolver::solve" );
+    const double fraction_to_boundary = 0.995;
+    const double sufficient_decrease = 1e-4;
+    const int max_backtracks = 30;
+    iteration_count = 0;
+
+    x_l.resize ( n );
+    x_u.resize ( n );
+    g_l.resize ( m );
+    std::vector<double> g_u ( m );
+    nlp.get_bounds_info ( n, x_l.data(), x_u.data(), m, g_l.data(), g_u.data() );
+    for ( Index row = 0; row < m; ++row )
+        {
+        if ( g_l[row] != g_u[row] )
+            {
+            BOOST_LOG_SEV ( opto_log, debug ) << "Constraint " << row << " is an inequality; not solved by Newton iteration";
+            return false;
+            }
+        }
+    std::vector<double> x ( n ), lambda ( m ), z_L ( n ), z_U ( n );
+    nlp.get_starting_point ( n, true, x.data(), false, z_L.data(), z_U.data(), m, true, lambda.data() );
+    free_variables.clear();
+    for ( Index i = 0; i < n; ++i )
+        {
+        if ( x_l[i] == x_u[i] )
+            {
+            x[i] = x_l[i];
+            continue;
+            }
+        if ( !( x[i] > x_l[i] && x[i] < x_u[i] ) )
+            {
+            BOOST_LOG_SEV ( opto_log, debug ) << "Starting point x[" << i << "] = " << x[i] << " is not strictly within its bounds";
+            return false;
+            }
+        free_variables.push_back ( i );
+        }
+    jac_rows.resize ( nnz_jac );
+    jac_cols.resize ( nnz_jac );
+    hess_rows.resize ( nnz_h );
+    hess_cols.resize ( nnz_h );
+    if ( nnz_jac > 0 ) nlp.eval_jac_g ( n, nullptr, false, m, nnz_jac, jac_rows.data(), jac_cols.data(), nullptr );
+    if ( nnz_h > 0 ) nlp.eval_h ( n, nullptr, false, 1, m, nullptr, false, nnz_h, hess_rows.data(), hess_cols.data(), nullptr );
+    gradient.resize ( n );
+    constraints.resize ( m );
+    jacobian.resize ( nnz_jac );
+    residual.resize ( n + m );
+    std::vector<double> hessian ( nnz_h );
+    // Position of each variable in the KKT system, or -1 for fixed variables
+    std::vector<long> kkt_index ( n, -1 );
+    for ( std::size_t i = 0; i < free_variables.size(); ++i ) kkt_index[free_variables[i]] = i;
+    const std::size_t free_count = free_variables.size();
+    const std::size_t kkt_size = free_count + m;
+    std::vector<double> kkt ( kkt_size * kkt_size ), step ( kkt_size );
+    std::vector<double> trial_x ( n ), trial_lambda ( m );
+
+    double norm = evaluate_residual ( x, lambda, true );
+    while ( norm >= 0 )
+        {
+        // Converged?
+        double dual_residual = 0, primal_residual = 0;
+        for ( const Index variable : free_variables ) dual_residual = std::max ( dual_residual, std::fabs ( residual[variable] ) );
+        for ( Index row = 0; row < m; ++row ) primal_residual = std::max ( primal_residual, std::fabs ( residual[n + row] ) );
+        BOOST_LOG_SEV ( opto_log, debug ) << "iteration " << iteration_count << ": objective " << objective
+                                          << ", dual residual " << dual_residual << ", primal residual " << primal_residual;
+        if ( dual_residual <= tolerance * std::max ( 1.0, gradient_norm ) && primal_residual <= tolerance ) break;
+        if ( iteration_count >= max_iterations )
+            {
+            BOOST_LOG_SEV ( opto_log, debug ) << "No convergence after " << iteration_count << " iterations";
+            return false;
+            }
+        if ( control && control->stop_requested() ) return false;
+        ++iteration_count;
+
+        // Assemble and solve the KKT system
+        if ( nnz_h > 0 && !nlp.eval_h ( n, x.data(), false, 1, m, lambda.data(), true, nnz_h, nullptr, nullptr, hessian.data() ) ) return false;
+        std::fill ( kkt.begin(), kkt.end(), 0.0 );
+        for ( Index entry = 0; entry < nnz_h; ++entry )
+            {
+            const long row = kkt_index[hess_rows[entry]], col = kkt_index[hess_cols[entry]];
+            if ( row < 0 || col < 0 ) continue;
+            kkt[row * kkt_size + col] += hessian[entry];
+            if ( row != col ) kkt[col * kkt_size + row] += hessian[entry]; // the lower triangle stands for both
+            }
+        for ( Index entry = 0; entry < nnz_jac; ++entry )
+            {
+            const long col = kkt_index[jac_cols[entry]];
+            if ( col < 0 ) continue;
+            const std::size_t row = free_count + jac_rows[entry];
+            kkt[row * kkt_size + col] += jacobian[entry];
+            kkt[col * kkt_size + row] += jacobian[entry];
+            }
+        for ( std::size_t i = 0; i < free_count; ++i ) step[i] = -residual[free_variables[i]];
+        for ( Index row = 0; row < m; ++row ) step[free_count + row] = -residual[n + row];
+        if ( !dense_solve ( kkt.data(), step.data(), kkt_size ) )
+            {
+            BOOST_LOG_SEV ( opto_log, debug ) << "KKT matrix is singular";
+            return false;
+            }
+
+        // Longest step that keeps the free variables strictly within their bounds
+        double alpha = 1;
+        for ( std::size_t i = 0; i < free_count; ++i )
+            {
+            const Index variable = free_variables[i];
+            if ( step[i] < 0 ) alpha = std::min ( alpha, fraction_to_boundary * ( x[variable] - x_l[variable] ) / -step[i] );
+            if ( step[i] > 0 ) alpha = std::min ( alpha, fraction_to_boundary * ( x_u[variable] - x[variable] ) / step[i] );
+            }
+        // Backtrack until the residual decreases
+        bool accepted = false;
+        for ( int backtrack = 0; backtrack < max_backtracks && !accepted; ++backtrack, alpha /= 2 )
+            {
+            trial_x = x;
+            for ( std::size_t i = 0; i < free_count; ++i ) trial_x[free_variables[i]] += alpha * step[i];
+            for ( Index row = 0; row < m; ++row ) trial_lambda[row] = lambda[row] + alpha * step[free_count + row];
+            // The evaluations of an accepted trial point are those of the next iteration
+            const double trial_norm = evaluate_residual ( trial_x, trial_lambda, true );
+            if ( trial_norm < 0 ) continue; // e.g., a model could not be evaluated there
+            if ( trial_norm <= ( 1 - sufficient_decrease * alpha ) * norm )
+                {
+                x.swap ( trial_x );
+                lambda.swap ( trial_lambda );
+                norm = trial_norm;
+                accepted = true;
+                }
+            }
+        if ( !accepted )
+            {
+            BOOST_LOG_SEV ( opto_log, debug ) << "Line search failed at iteration " << iteration_count;
+            return false;
+            }
+        }
+    if ( norm < 0 ) return false;
+    if ( !reduced_hessian_positive_definite ( x, lambda ) )
+        {
+        BOOST_LOG_SEV ( opto_log, debug ) << "Hessian is not positive definite on the constraint null space; not a minimum";
+        return false;
+        }
+
+    // Only the fixed variables are at a bound; their multipliers balance the Lagrangian gradient
+    for ( Index i = 0; i < n; ++i )
+        {
+        z_L[i] = z_U[i] = 0;
+        if ( kkt_index[i] >= 0 ) continue;
+        z_L[i] = std::max ( residual[i], 0.0 );
+        z_U[i] = std::max ( -residual[i], 0.0 );
+        }
+    BOOST_LOG_SEV ( opto_log, debug ) << "Converged after " << iteration_count << " iterations";
+    nlp.finalize_solution ( SUCCESS, n, x.data(), z_L.data(), z_U.data(), m, constraints.data(), lambda.data(), objective, nullptr, nullptr );
+    return true;
+    }
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
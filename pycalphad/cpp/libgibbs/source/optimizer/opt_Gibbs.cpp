@@ -13,11 +13,16 @@
 #include "libgibbs/include/optimizer/halton.hpp"
 #include "libgibbs/include/optimizer/equilibriumresult.hpp"
 #include "libgibbs/include/optimizer/utils/startingpoint_naive.hpp"
+#include "libgibbs/include/utils/hot_path_logging.hpp"
 #include "libtdb/include/logging.hpp"
 #include <coin/IpTNLP.hpp>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <exception>
+#include <thread>
 
 using namespace Ipopt;
 using boost::multi_index_container;
@@ -117,25 +122,83 @@ bool GibbsOpt::get_starting_point ( Index n, bool init_x, Number* x,
             BOOST_LOG_SEV ( opto_log, debug ) << "x[" << record->first << "] = " << record->second;
         }
     }
+    if ( warm_start )
+    {
+        // Overwrite the starting point with the neighbouring solution wherever the variables match
+        // Variables of composition sets which were not present in that solution keep their values from above
+        for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i )
+        {
+            const auto varfind = warm_start->variables.find ( i->first );
+            if ( varfind == warm_start->variables.end() ) continue;
+            x[i->second] = varfind->second;
+            BOOST_LOG_SEV ( opto_log, debug ) << "warm start x[" << i->first << "] = " << varfind->second;
+        }
+    }
+    // Ipopt only asks for multipliers when warm_start_init_point is enabled
+    if ( init_z )
+    {
+        for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i )
+        {
+            // Ipopt's default initial bound multiplier is 1
+            z_L[i->second] = 1;
+            z_U[i->second] = 1;
+            if ( !warm_start ) continue;
+            const auto lowerfind = warm_start->lower_multipliers.find ( i->first );
+            const auto upperfind = warm_start->upper_multipliers.find ( i->first );
+            if ( lowerfind != warm_start->lower_multipliers.end() ) z_L[i->second] = lowerfind->second;
+            if ( upperfind != warm_start->upper_multipliers.end() ) z_U[i->second] = upperfind->second;
+        }
+    }
+    if ( init_lambda )
+    {
+        for ( auto i = cm.constraints.begin(); i != cm.constraints.end(); ++i )
+        {
+            const Index constraint_index = std::distance ( cm.constraints.begin(),i );
+            lambda[constraint_index] = 0;
+            if ( !warm_start ) continue;
+            const auto lambdafind = warm_start->constraint_multipliers.find ( i->name );
+            if ( lambdafind != warm_start->constraint_multipliers.end() ) lambda[constraint_index] = lambdafind->second;
+        }
+    }
     BOOST_LOG_SEV ( opto_log, debug ) << "exiting get_starting_point";
     return true;
     }
 
 bool GibbsOpt::eval_f ( Index n, const Number* x, bool new_x, Number& obj_value )
     {
-    BOOST_LOG_NAMED_SCOPE ( "GibbsOpt::eval_f" );
-    BOOST_LOG_SEV ( opto_log, debug ) << "entering eval_f";
+    HOT_PATH_NAMED_SCOPE ( "GibbsOpt::eval_f" );
+    const StageProfile::Scope stage_timer ( profile, "eval_f" );
+    new_iterate ( new_x );
+    HOT_PATH_LOG_SEV ( opto_log, debug ) << "entering eval_f";
     // return the value of the objective function
     try
         {
-        BOOST_LOG_SEV ( opto_log, debug ) << "trying to evaluate master tree";
+        HOT_PATH_LOG_SEV ( opto_log, debug ) << "trying to evaluate master tree";
+        for_each_composition_set ( "eval_f", [this,x] ( DenseEvaluation &evaluation )
+            {
+            if ( !evaluation.energy_current )
+                {
+                evaluation.energy = evaluation.comp_set->evaluate_objective ( evaluation.binding, x );
+                evaluation.energy_current = true;
+                }
+            phase_energies[&evaluation - &dense_evaluation[0]] = x[evaluation.phase_fraction_index] // multiply by phase fraction
+                    * evaluation.energy;
+            } );
+        // Summed in phase order, however the terms were evaluated
         double objective = 0;
-        for ( auto i = comp_sets.cbegin(); i != comp_sets.cend(); ++i )
+        for ( auto i = phase_energies.cbegin(); i != phase_energies.cend(); ++i )
             {
-            objective += x[main_indices.left.at ( i->first + "_FRAC" )] // multiply by phase fraction
-                         * i->second.evaluate_objective ( conditions, main_indices, ( double* ) x );
+            objective += *i;
             }
         obj_value = objective;
+        if ( trace )
+            {
+            for ( std::size_t i = 0; i < dense_evaluation.size(); ++i )
+                {
+                trace_fractions[i] = x[dense_evaluation[i].phase_fraction_index];
+                trace_energies[i] = dense_evaluation[i].energy;
+                }
+            }
         }
     catch ( boost::exception &e )
         {
@@ -158,14 +221,16 @@ bool GibbsOpt::eval_f ( Index n, const Number* x, bool new_x, Number& obj_value
         BOOST_LOG_SEV ( opto_log, critical ) << "Exception: " << e.what();
         throw;
         }
-    BOOST_LOG_SEV ( opto_log, debug ) << "exiting eval_f";
+    HOT_PATH_LOG_SEV ( opto_log, debug ) << "exiting eval_f";
     return true;
     }
 
 bool GibbsOpt::eval_grad_f ( Index n, const Number* x, bool new_x, Number* grad_f )
     {
-    BOOST_LOG_NAMED_SCOPE ( "GibbsOpt::eval_grad_f" );
-    BOOST_LOG_SEV ( opto_log, debug ) << "entering eval_grad_f";
+    HOT_PATH_NAMED_SCOPE ( "GibbsOpt::eval_grad_f" );
+    const StageProfile::Scope stage_timer ( profile, "eval_grad_f" );
+    new_iterate ( new_x );
+    HOT_PATH_LOG_SEV ( opto_log, debug ) << "entering eval_grad_f";
     // initialize gradient to zero
     for ( auto i = 0; i < n; ++i )
         {
@@ -173,15 +238,20 @@ bool GibbsOpt::eval_grad_f ( Index n, const Number* x, bool new_x, Number* grad_
         }
     try
         {
-        // For all composition sets, evaluate the gradient
-        for ( auto i = comp_sets.cbegin(); i != comp_sets.cend(); ++i )
+        // For all composition sets, evaluate the gradient; each one adds to its own variables only
+        // Once Ipopt has asked for a Hessian, it will ask for one at this point too, so both are evaluated in one pass
+        const bool with_hessian = hessian_requested;
+        for_each_composition_set ( "eval_grad_f", [x,grad_f,with_hessian] ( DenseEvaluation &evaluation )
             {
-            const std::map<int,double> gradmap = i->second.evaluate_objective_gradient ( conditions, main_indices, ( double* ) x );
-            for ( auto j = gradmap.cbegin(); j != gradmap.cend(); ++j )
+            if ( !evaluation.gradient_current )
                 {
-                grad_f[j->first] += j->second;
+                evaluation.comp_set->evaluate_model_jet ( evaluation.binding, x, with_hessian, evaluation.workspace );
+                evaluation.energy = evaluation.workspace.value;
+                evaluation.energy_current = evaluation.gradient_current = true;
+                evaluation.hessian_current = with_hessian;
                 }
-            }
+            evaluation.comp_set->add_objective_gradient ( evaluation.binding, evaluation.workspace, x, grad_f );
+            } );
         }
     catch ( boost::exception &e )
         {
@@ -199,39 +269,41 @@ bool GibbsOpt::eval_grad_f ( Index n, const Number* x, bool new_x, Number* grad_
         BOOST_LOG_SEV ( opto_log, critical ) << boost::diagnostic_information ( e );
         throw;
         }
-    BOOST_LOG_SEV ( opto_log, debug ) << "exiting eval_grad_f";
+    HOT_PATH_LOG_SEV ( opto_log, debug ) << "exiting eval_grad_f";
     return true;
     }
 
 bool GibbsOpt::eval_g ( Index n, const Number* x, bool new_x, Index m_num, Number* g )
     {
-    BOOST_LOG_NAMED_SCOPE ( "GibbsOpt::eval_g" );
-    BOOST_LOG_SEV ( opto_log, debug ) << "entering eval_g";
+    HOT_PATH_NAMED_SCOPE ( "GibbsOpt::eval_g" );
+    const StageProfile::Scope stage_timer ( profile, "eval_g" );
+    new_iterate ( new_x );
+    HOT_PATH_LOG_SEV ( opto_log, debug ) << "entering eval_g";
     if ( m_num == 0 )
         {
-        BOOST_LOG_SEV ( opto_log, debug ) << "No constraints";
+        HOT_PATH_LOG_SEV ( opto_log, debug ) << "No constraints";
         return true;
         }
     // return the value of the constraints: g(x)
-    const auto cons_begin = cm.constraints.begin();
-    const auto cons_end = cm.constraints.end();
     try
         {
         for ( auto i = 0; i < m_num; ++i )
             {
             g[i] = 0;
             }
-        for ( auto i = cons_begin; i != cons_end; ++i )
+        for ( auto i = linear_constraints.cbegin(); i != linear_constraints.cend(); ++i )
             {
-            // Calculate left-hand side and right-hand side of all constraints
-            //BOOST_LOG_SEV(opto_log, debug) << "Constraint " << std::distance(cons_begin,i) << std::endl;
-            //BOOST_LOG_SEV(opto_log, debug) << i->name << " LHS: " << i->lhs << std::endl;
-            //BOOST_LOG_SEV(opto_log, debug) << i->name << " RHS: " << i->rhs << std::endl;
-            double lhs = process_utree ( i->lhs, conditions, main_indices, ( double* ) x ).get<double>();
-            //BOOST_LOG_SEV(opto_log, debug) << i->name << " LHS: " << lhs << std::endl;
-            double rhs = process_utree ( i->rhs, conditions, main_indices, ( double* ) x ).get<double>();
-            //BOOST_LOG_SEV(opto_log, debug) << i->name << " RHS: " << rhs << std::endl;
-            g[std::distance ( cons_begin,i )] = lhs - rhs;
+            Number value = i->offset;
+            for ( auto j = i->coefficients.cbegin(); j != i->coefficients.cend(); ++j )
+                {
+                value += j->second * x[j->first];
+                }
+            g[i->cons_index] = value;
+            }
+        for ( auto i = nonlinear_constraints.cbegin(); i != nonlinear_constraints.cend(); ++i )
+            {
+            // lhs - rhs of the constraint
+            g[*i] = constraint_programs[*i].evaluate ( constraint_binding, x );
             }
         }
     catch ( boost::exception &e )
@@ -251,7 +323,7 @@ bool GibbsOpt::eval_g ( Index n, const Number* x, bool new_x, Index m_num, Numbe
         throw;
         }
 
-    BOOST_LOG_SEV ( opto_log, debug ) << "exiting eval_g";
+    HOT_PATH_LOG_SEV ( opto_log, debug ) << "exiting eval_g";
     return true;
     }
 
@@ -260,22 +332,24 @@ bool GibbsOpt::eval_jac_g ( Index n, const Number* x, bool new_x,
                             Number* values )
     {
     Index jac_index = 0;
-    BOOST_LOG_NAMED_SCOPE ( "GibbsOpt::eval_jac_g" );
+    HOT_PATH_NAMED_SCOPE ( "GibbsOpt::eval_jac_g" );
+    const StageProfile::Scope stage_timer ( profile, "eval_jac_g" );
+    new_iterate ( new_x );
     if ( m_num == 0 )
         {
-        BOOST_LOG_SEV ( opto_log, debug ) << "No constraints";
+        HOT_PATH_LOG_SEV ( opto_log, debug ) << "No constraints";
         return true;
         }
     if ( values == NULL )
         {
-        BOOST_LOG_SEV ( opto_log, debug ) << "entering eval_jac_g values == NULL";
+        HOT_PATH_LOG_SEV ( opto_log, debug ) << "entering eval_jac_g values == NULL";
         for ( auto i = jac_g_trees.cbegin(); i != jac_g_trees.cend(); ++i )
             {
             iRow[jac_index] = i->cons_index;
             jCol[jac_index] = i->var_index;
             ++jac_index;
             }
-        BOOST_LOG_SEV ( opto_log, debug ) << "exit eval_jac_g without values";
+        HOT_PATH_LOG_SEV ( opto_log, debug ) << "exit eval_jac_g without values";
         }
     else
         {
@@ -287,7 +361,8 @@ bool GibbsOpt::eval_jac_g ( Index n, const Number* x, bool new_x,
                 }
             for ( auto i = jac_g_trees.cbegin(); i != jac_g_trees.cend(); ++i )
                 {
-                values[std::distance ( jac_g_trees.cbegin(),i )] = process_utree ( i->ast, conditions, main_indices, ( double* ) x ).get<double>();
+                const auto jac_index = std::distance ( jac_g_trees.cbegin(),i );
+                values[jac_index] = jacobian_programs[jac_index].evaluate ( constraint_binding, x ); // copies the constant entries
                 }
             }
         catch ( boost::exception &e )
@@ -306,7 +381,7 @@ bool GibbsOpt::eval_jac_g ( Index n, const Number* x, bool new_x,
             BOOST_LOG_SEV ( opto_log, critical ) << boost::diagnostic_information ( e );
             throw;
             }
-        BOOST_LOG_SEV ( opto_log, debug ) << "exit eval_jac_g with values";
+        HOT_PATH_LOG_SEV ( opto_log, debug ) << "exit eval_jac_g with values";
         }
     return true;
     }
@@ -317,11 +392,13 @@ bool GibbsOpt::eval_h ( Index n, const Number* x, bool new_x,
                         Index* jCol, Number* values )
     {
     Index h_idx = 0;
-    BOOST_LOG_NAMED_SCOPE ( "GibbsOpt::eval_h" );
+    HOT_PATH_NAMED_SCOPE ( "GibbsOpt::eval_h" );
+    const StageProfile::Scope stage_timer ( profile, "eval_h" );
+    new_iterate ( new_x );
 
     if ( values == NULL )
         {
-        BOOST_LOG_SEV ( opto_log, debug ) << "enter eval_h without values";
+        HOT_PATH_LOG_SEV ( opto_log, debug ) << "enter eval_h without values";
         for ( auto i = hess_sparsity_structure.cbegin(); i != hess_sparsity_structure.cend(); ++i )
             {
             const int varindex1 = * ( i->cbegin() );
@@ -330,54 +407,38 @@ bool GibbsOpt::eval_h ( Index n, const Number* x, bool new_x,
             jCol[h_idx] = varindex2;
             ++h_idx;
             }
-        BOOST_LOG_SEV ( opto_log, debug ) << "exit eval_h without values";
+        HOT_PATH_LOG_SEV ( opto_log, debug ) << "exit eval_h without values";
         }
     else
         {
-        BOOST_LOG_SEV ( opto_log, debug ) << "enter eval_h with values";
-        for ( auto i = hess_sparsity_structure.cbegin(); i != hess_sparsity_structure.cend(); ++i )
-            {
-            values[std::distance ( hess_sparsity_structure.cbegin(),i )] = 0; // initialize
-            }
+        HOT_PATH_LOG_SEV ( opto_log, debug ) << "enter eval_h with values";
+        std::fill ( values, values + nele_hess, 0.0 ); // initialize
         try
             {
-            // objective portion
-            for ( auto i = comp_sets.cbegin(); i != comp_sets.cend(); ++i )
+            // objective portion: one block per composition set, each writing its own entries of values
+            hessian_requested = true;
+            for_each_composition_set ( "eval_h", [x,obj_factor,values] ( DenseEvaluation &evaluation )
                 {
-                auto hessian = i->second.evaluate_objective_hessian ( conditions, main_indices, ( double* ) x );
-                for ( auto j = hessian.cbegin(); j != hessian.cend(); ++j )
+                if ( !evaluation.hessian_current )
                     {
-                    const int varindex1 = * ( j->first.cbegin() );
-                    const int varindex2 = * ( ++j->first.cbegin() );
-                    const std::list<int> searchlist {varindex1,varindex2};
-                    const int sparse_index =
-                        std::distance (
-                            hess_sparsity_structure.begin(),
-                            hess_sparsity_structure.find ( searchlist )
-                        );
-                    values[sparse_index] += obj_factor * j->second; // objective portion
+                    evaluation.comp_set->evaluate_model_jet ( evaluation.binding, x, true, evaluation.workspace );
+                    evaluation.energy = evaluation.workspace.value;
+                    evaluation.energy_current = evaluation.gradient_current = evaluation.hessian_current = true;
                     }
-                }
+                evaluation.comp_set->add_objective_hessian ( evaluation.binding, evaluation.workspace, x, obj_factor,
+                        evaluation.hessian_positions, values );
+                } );
 
             // constraint portion
-            for ( auto i = constraint_hessian_data.cbegin(); i != constraint_hessian_data.cend(); ++i )
+            auto sparse_index_iter = constraint_hessian_positions.cbegin();
+            for ( auto i = constraint_hessian_programs.cbegin(); i != constraint_hessian_programs.cend(); ++i, ++sparse_index_iter )
                 {
-                const int varindex1 = i->var_index1;
-                const int varindex2 = i->var_index2;
-                std::list<int> searchlist;
-                if ( varindex1 <= varindex2 ) searchlist = {varindex1,varindex2};
-                else searchlist = {varindex2, varindex1};
-                const int sparse_index =
-                    std::distance (
-                        hess_sparsity_structure.begin(),
-                        hess_sparsity_structure.find ( searchlist )
-                    );
-                for ( auto j = i->asts.cbegin(); j != i->asts.cend(); ++j )
+                const Index sparse_index = *sparse_index_iter;
+                for ( auto j = i->cbegin(); j != i->cend(); ++j )
                     {
-                    BOOST_LOG_SEV ( opto_log, debug ) << "Hessian evaluation for constraint " << j->first << " (" << varindex1 << "," << varindex2 << ")";
-                    boost::spirit::utree hess_tree = process_utree ( j->second, conditions, main_indices, ( double* ) x ).get<double>();
+                    HOT_PATH_LOG_SEV ( opto_log, debug ) << "Hessian evaluation for constraint " << j->first << " at " << sparse_index;
                     // constraint portion
-                    values[sparse_index] += lambda[j->first] * hess_tree.get<double>();
+                    values[sparse_index] += lambda[j->first] * j->second.evaluate ( constraint_binding, x );
                     }
                 }
             }
@@ -397,11 +458,247 @@ bool GibbsOpt::eval_h ( Index n, const Number* x, bool new_x,
             BOOST_LOG_SEV ( opto_log, critical ) << boost::diagnostic_information ( e );
             throw;
             }
-        BOOST_LOG_SEV ( opto_log, debug ) << "exit eval_h with values";
+        HOT_PATH_LOG_SEV ( opto_log, debug ) << "exit eval_h with values";
         }
     return true;
     }
 
+void GibbsOpt::new_iterate ( bool new_x )
+    {
+    if ( !new_x ) return;
+    for ( auto i = dense_evaluation.begin(); i != dense_evaluation.end(); ++i )
+        {
+        i->energy_current = i->gradient_current = i->hessian_current = false;
+        }
+    }
+
+void GibbsOpt::for_each_composition_set ( char const* const stage, std::function<void(DenseEvaluation&)> const &task )
+    {
+    const StageTiming timing = profile.stage ( stage ); // previous calls only
+    const std::size_t thread_count = std::min ( std::max ( worker_threads, std::size_t ( 1 ) ), dense_evaluation.size() );
+    if ( thread_count < 2 || timing.calls == 0 || timing.seconds < parallel_callback_seconds * timing.calls )
+        {
+        for ( auto i = dense_evaluation.begin(); i != dense_evaluation.end(); ++i )
+            {
+            task ( *i );
+            }
+        return;
+        }
+    // Every composition set has its own binding and workspace, so each can go to any thread
+    std::vector<std::exception_ptr> errors ( dense_evaluation.size() );
+    std::atomic<std::size_t> next_set ( 0 );
+    auto worker = [&] ()
+        {
+        for ( std::size_t set_id = next_set++; set_id < dense_evaluation.size(); set_id = next_set++ )
+            {
+            try
+                {
+                task ( dense_evaluation[set_id] );
+                }
+            catch ( ... )
+                {
+                errors[set_id] = std::current_exception();
+                }
+            }
+        };
+    std::vector<std::thread> workers;
+    for ( std::size_t i = 1; i < thread_count; ++i )
+        {
+        workers.emplace_back ( worker );
+        }
+    worker(); // this thread works too
+    for ( auto &thread : workers )
+        {
+        thread.join();
+        }
+    // Report the error of the first composition set that failed, as the serial loop would
+    for ( auto i = errors.cbegin(); i != errors.cend(); ++i )
+        {
+        if ( *i ) std::rethrow_exception ( *i );
+        }
+    }
+
+std::vector<GibbsOpt::PhaseVariables> GibbsOpt::phase_variables() const
+    {
+    std::vector<PhaseVariables> phases;
+    phases.reserve ( dense_evaluation.size() );
+    for ( auto evaluation = dense_evaluation.cbegin(); evaluation != dense_evaluation.cend(); ++evaluation )
+        {
+        PhaseVariables phase;
+        phase.comp_set = evaluation->comp_set;
+        phase.phase_fraction_index = evaluation->phase_fraction_index;
+        const SublatticeLayout &layout = phase.comp_set->sublattice_layout();
+        const boost::bimap<std::string, int> &variables = phase.comp_set->get_variable_map();
+        phase.site_fraction_indices.reserve ( layout.coordinate_count() );
+        for ( std::size_t coordinate = 0; coordinate < layout.coordinate_count(); ++coordinate )
+            {
+            phase.site_fraction_indices.push_back ( main_indices.left.at ( variables.right.at ( coordinate ) ) );
+            }
+        phases.push_back ( std::move ( phase ) );
+        }
+    return phases;
+    }
+
+PhaseMemoryFootprint GibbsOpt::memory_footprint() const
+    {
+    PhaseMemoryFootprint footprint;
+    SharedObjects counted; // the composition sets of a miscibility gap share their models
+    for ( auto i = comp_sets.cbegin(); i != comp_sets.cend(); ++i )
+        {
+        footprint.phases[i->first] = i->second.memory_footprint ( counted );
+        }
+    for ( auto evaluation = dense_evaluation.cbegin(); evaluation != dense_evaluation.cend(); ++evaluation )
+        {
+        const CompiledBinding &binding = evaluation->binding;
+        const CompiledJet &jet = evaluation->workspace;
+        std::size_t bytes = vector_heap_bytes ( binding.variable_indices ) + vector_heap_bytes ( binding.statevar_values )
+                            + binding.statevar_bound.capacity() / 8
+                            + vector_heap_bytes ( evaluation->hessian_positions.model_entries )
+                            + vector_heap_bytes ( evaluation->hessian_positions.fraction_entries )
+                            + vector_heap_bytes ( jet.gradient ) + vector_heap_bytes ( jet.hessian ) + vector_heap_bytes ( jet.registers )
+                            + vector_heap_bytes ( jet.adjoints ) + vector_heap_bytes ( jet.tangents )
+                            + vector_heap_bytes ( jet.adjoint_tangents ) + vector_heap_bytes ( jet.trace )
+                            + vector_heap_bytes ( jet.direction ) + vector_heap_bytes ( jet.product );
+        // Without composition sets (after finalize_solution()) this is all that is left of the phase
+        footprint.phases[evaluation->comp_set ? evaluation->comp_set->name() : std::string()].add ( "evaluation workspace", bytes );
+        }
+    std::size_t index_bytes = 0;
+    for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i )
+        {
+        index_bytes += sizeof ( *i ) + 2 * tree_node_overhead + string_heap_bytes ( i->first );
+        }
+    footprint.common.add ( "variable maps", index_bytes, main_indices.size() );
+    footprint.common.add ( "jac_g_trees", vector_heap_bytes ( jac_g_trees ) );
+    for ( auto i = jac_g_trees.cbegin(); i != jac_g_trees.cend(); ++i ) footprint.common.add ( "jac_g_trees", utree_memory_usage ( i->ast ) );
+    for ( auto i = constraint_hessian_data.cbegin(); i != constraint_hessian_data.cend(); ++i )
+        {
+        footprint.common.add ( "hessian_data", sizeof ( *i ) + tree_node_overhead );
+        for ( auto j = i->asts.cbegin(); j != i->asts.cend(); ++j )
+            {
+            footprint.common.add ( "hessian_data", sizeof ( *j ) + tree_node_overhead );
+            footprint.common.add ( "hessian_data", utree_memory_usage ( j->second ) );
+            }
+        }
+    footprint.common.add ( "constraints", vector_heap_bytes ( cm.constraints ) );
+    for ( auto i = cm.constraints.cbegin(); i != cm.constraints.cend(); ++i )
+        {
+        footprint.common.add ( "constraints", string_heap_bytes ( i->name ) );
+        footprint.common.add ( "constraints", utree_memory_usage ( i->lhs ) );
+        footprint.common.add ( "constraints", utree_memory_usage ( i->rhs ) );
+        }
+    std::size_t sparsity_bytes = node_heap_bytes ( hess_sparsity_structure );
+    for ( auto i = hess_sparsity_structure.cbegin(); i != hess_sparsity_structure.cend(); ++i )
+        {
+        sparsity_bytes += i->size() * ( sizeof ( Index ) + 2 * sizeof ( void* ) );
+        }
+    footprint.common.add ( "hessian sparsity", sparsity_bytes, hess_sparsity_structure.size() );
+    MemoryUsage programs ( vector_heap_bytes ( constraint_programs ) + vector_heap_bytes ( jacobian_programs )
+                           + vector_heap_bytes ( constraint_hessian_programs ), 0 );
+    for ( auto i = constraint_programs.cbegin(); i != constraint_programs.cend(); ++i )
+        {
+        programs += MemoryUsage ( i->memory_bytes(), i->instructions().size() );
+        }
+    for ( auto i = jacobian_programs.cbegin(); i != jacobian_programs.cend(); ++i )
+        {
+        programs += MemoryUsage ( i->program.memory_bytes(), i->program.instructions().size() );
+        }
+    for ( auto i = constraint_hessian_programs.cbegin(); i != constraint_hessian_programs.cend(); ++i )
+        {
+        programs.bytes += vector_heap_bytes ( *i );
+        for ( auto j = i->cbegin(); j != i->cend(); ++j )
+            {
+            programs += MemoryUsage ( j->second.program.memory_bytes(), j->second.program.instructions().size() );
+            }
+        }
+    footprint.common.add ( "compiled programs", programs );
+    std::size_t linear_bytes = vector_heap_bytes ( linear_constraints ) + vector_heap_bytes ( nonlinear_constraints );
+    for ( auto i = linear_constraints.cbegin(); i != linear_constraints.cend(); ++i ) linear_bytes += vector_heap_bytes ( i->coefficients );
+    footprint.common.add ( "linear constraints", linear_bytes, linear_constraints.size() );
+    footprint.common += minimizer_footprint;
+    return footprint;
+    }
+
+namespace
+{
+// Time spent in the evaluation callbacks so far
+double evaluation_seconds ( StageProfile const &profile )
+    {
+    double seconds = 0;
+    for ( auto stage : { "eval_f", "eval_grad_f", "eval_g", "eval_jac_g", "eval_h" } )
+        {
+        seconds += profile.stage ( stage ).seconds;
+        }
+    return seconds;
+    }
+}
+
+bool GibbsOpt::intermediate_callback ( AlgorithmMode mode,
+                                       Index iter, Number obj_value,
+                                       Number inf_pr, Number inf_du,
+                                       Number mu, Number d_norm,
+                                       Number regularization_size,
+                                       Number alpha_du, Number alpha_pr,
+                                       Index ls_trials,
+                                       const IpoptData* ip_data,
+                                       IpoptCalculatedQuantities* ip_cq )
+    {
+    if ( control && control->stop_requested() )
+        {
+        BOOST_LOG_SEV ( opto_log, debug ) << "stop requested at iteration " << iter;
+        return false;
+        }
+    if ( !trace ) return true;
+    Optimizer::SolverIteration values;
+    values.iteration = iter;
+    values.restoration = mode == RestorationPhaseMode;
+    values.objective = obj_value;
+    values.primal_infeasibility = inf_pr;
+    values.dual_infeasibility = inf_du;
+    values.barrier = mu;
+    values.step_norm = d_norm;
+    values.primal_step = alpha_pr;
+    values.dual_step = alpha_du;
+    values.line_search_trials = ls_trials;
+    const double callback_seconds = evaluation_seconds ( profile );
+    values.callback_seconds = callback_seconds - traced_callback_seconds;
+    traced_callback_seconds = callback_seconds;
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - trace_start;
+    values.elapsed_seconds = elapsed.count();
+    trace->add ( values, trace_fractions, trace_energies );
+    if ( stopping_rules )
+        {
+        for ( auto rule = stopping_rules->cbegin(); rule != stopping_rules->cend(); ++rule )
+            {
+            if ( ( *rule ) ( *trace ) )
+                {
+                BOOST_LOG_SEV ( opto_log, debug ) << "stopping rule met at iteration " << iter;
+                stopped_by_rule = true;
+                return false;
+                }
+            }
+        }
+    return true;
+    }
+
+void GibbsOpt::set_telemetry ( const bool record_trace, const std::vector<Optimizer::StoppingRule> &rules )
+    {
+    keep_trace = record_trace;
+    stopping_rules = rules.empty() ? nullptr : &rules;
+    stopped_by_rule = false;
+    if ( !record_trace && rules.empty() )
+        {
+        trace.reset();
+        return;
+        }
+    std::vector<std::string> phase_names;
+    for ( auto i = comp_sets.cbegin(); i != comp_sets.cend(); ++i ) phase_names.push_back ( i->first );
+    trace.reset ( new Optimizer::SolverTrace ( std::move ( phase_names ) ) );
+    trace_fractions.assign ( dense_evaluation.size(), 0 );
+    trace_energies.assign ( dense_evaluation.size(), 0 );
+    traced_callback_seconds = evaluation_seconds ( profile );
+    trace_start = std::chrono::steady_clock::now();
+    }
+
 void GibbsOpt::finalize_solution ( SolverReturn status,
                                    Index n, const Number* x, const Number* z_L, const Number* z_U,
                                    Index m_num, const Number* g, const Number* lambda,
@@ -410,54 +707,47 @@ void GibbsOpt::finalize_solution ( SolverReturn status,
                                    IpoptCalculatedQuantities* ip_cq )
     {
     BOOST_LOG_NAMED_SCOPE ( "GibbsOpt::finalize_solution" );
+    const StageProfile::Scope stage_timer ( profile, "finalize_solution" );
     BOOST_LOG_SEV ( opto_log, debug ) << "enter finalize_solution";
 
     result.conditions = conditions;
+    if ( trace && keep_trace )
+        {
+        result.trace.reset ( trace.release() );
+        }
 
-    // Iterate over all phases
-    for ( auto i = comp_sets.begin(); i != comp_sets.end(); ++i )
+    // Iterate over all phases; dense_evaluation is in the same order
+    auto evaluation = dense_evaluation.cbegin();
+    for ( auto i = comp_sets.begin(); i != comp_sets.end(); ++i, ++evaluation )
         {
-        sublattice_set_view phase_view; // Subview to current phase
         const std::string phasename = i->first;
         Optimizer::Phase<Ipopt::Number> result_phase; // The phase result object we're constructing
         result_phase.status = conditions.phases[phasename];
-        int sublindex = -1; // Current sublattice index (-1 is the phase fraction)
-        boost::multi_index::index<sublattice_set,phase_subl>::type::const_iterator iter,end;
+        const SublatticeLayout &layout = i->second.sublattice_layout();
+        const boost::bimap<std::string, int> &phase_variables = i->second.get_variable_map();
 
-        iter = get<phase_subl> ( main_ss ).lower_bound ( boost::make_tuple ( phasename, sublindex ) );
-        end = get<phase_subl> ( main_ss ).upper_bound ( boost::make_tuple ( phasename, sublindex ) );
-
-        while ( iter != end )
+        // The phase fraction
+        const Index phase_fraction_index = evaluation->phase_fraction_index; // Index of variable in optimizer
+        result_phase.f = x[phase_fraction_index];
+        result.variables[phasename + "_FRAC"] = x[phase_fraction_index];
+        BOOST_LOG_SEV ( opto_log, debug ) << "result.variables[" << phasename << "_FRAC] = x[" << phase_fraction_index << "]";
+        for ( std::size_t sublindex = 0; sublindex < layout.sublattice_count(); ++sublindex )
             {
-            if ( sublindex == -1 )
+            // This is a normal sublattice with multiple species
+            Optimizer::Sublattice<Ipopt::Number> subl;
+            subl.sitecount = layout.sites ( sublindex );
+            for ( std::size_t coordinate = layout.sublattice_begin ( sublindex ); coordinate < layout.sublattice_end ( sublindex ); ++coordinate )
                 {
-                // This is the phase fraction (should only be one element here)
-                int variable_index = ( iter )->opt_index; // Index of variable in optimizer
-                result_phase.f = x[variable_index];
-                result.variables[iter->phase + "_FRAC"] = x[variable_index];
-                BOOST_LOG_SEV ( opto_log, debug ) << "result.variables[" << iter->phase << "_FRAC] = x[" << variable_index << "]";
+                // The coordinates of the layout are the indices of the phase's variable map
+                const std::string &variable_name = phase_variables.right.at ( coordinate );
+                const Index variable_index = main_indices.left.at ( variable_name );
+                Optimizer::Component<Ipopt::Number> comp;
+                comp.site_fraction = x[variable_index];
+                result.variables[variable_name] = x[variable_index];
+                BOOST_LOG_SEV ( opto_log, debug ) << "result.variables[" << variable_name << "] = x[" << variable_index << "]";
+                subl.components[layout.species ( coordinate )] = comp; // Add component to sublattice
                 }
-            else
-                {
-                // This is a normal sublattice with multiple species
-                Optimizer::Sublattice<Ipopt::Number> subl;
-                subl.sitecount = ( iter )->num_sites;
-                for ( ; iter != end; ++iter )
-                    {
-                    const int variable_index = ( iter )->opt_index;
-                    const std::string component_name = ( iter )->species;
-                    Optimizer::Component<Ipopt::Number> comp;
-                    comp.site_fraction = x[variable_index];
-                    result.variables[iter->name()] = x[variable_index];
-                    BOOST_LOG_SEV ( opto_log, debug ) << "result.variables[" << iter->name() << "] = x[" << variable_index << "]";
-                    subl.components[component_name] = comp; // Add component to sublattice
-                    }
-                result_phase.sublattices.push_back ( subl ); // Add sublattice to phase
-                }
-            // Go to next sublattice
-            ++sublindex;
-            iter = get<phase_subl> ( main_ss ).lower_bound ( boost::make_tuple ( phasename, sublindex ) );
-            end = get<phase_subl> ( main_ss ).upper_bound ( boost::make_tuple ( phasename, sublindex ) );
+            result_phase.sublattices.push_back ( subl ); // Add sublattice to phase
             }
         result_phase.compositionset = std::move ( comp_sets.at ( phasename ) ); // CompositionSet control to EquilibriumResult
         result.phases.emplace ( phasename, std::move ( result_phase ) ); // add phase to equilibrium
@@ -472,9 +762,16 @@ void GibbsOpt::finalize_solution ( SolverReturn status,
         BOOST_THROW_EXCEPTION ( equilibrium_error() << str_errinfo ( "Energy calculated by EquilibriumResult differs from Ipopt" ) );
         }
 
+    // Keep the multipliers so that this result can warm-start a neighbouring calculation
+    for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i )
+        {
+        result.lower_multipliers[i->first] = z_L[i->second];
+        result.upper_multipliers[i->first] = z_U[i->second];
+        }
     for ( auto i = cm.constraints.begin(); i != cm.constraints.end(); ++i )
         {
         BOOST_LOG_SEV ( opto_log, debug ) << i->name << " MU = " << lambda[std::distance ( cm.constraints.begin(),i )];
+        result.constraint_multipliers[i->name] = lambda[std::distance ( cm.constraints.begin(),i )];
         }
 
     BOOST_LOG_SEV ( opto_log, debug ) << "exit finalize_solution";
@@ -15,12 +15,14 @@
 #include "libgibbs/include/optimizer/utils/build_variable_map.hpp"
 #include "libgibbs/include/optimizer/utils/convex_hull.hpp"
 #include "libtdb/include/logging.hpp"
-#include "libgibbs/include/optimizer/global_minimization.hpp"
+#include "libgibbs/include/optimizer/lower_hull_minimization.hpp"
 
 // These headers are implementation details for the default global minimization
 #include "libgibbs/include/optimizer/utils/ezd_minimization.hpp"
 #include "libgibbs/include/optimizer/utils/simplicial_facet.hpp"
 
+#include <chrono>
+#include <thread>
 #include <sstream>
 
 using namespace Optimizer;
@@ -37,24 +39,33 @@ void add_trees ( boost::spirit::utree &root_tree, const boost::spirit::utree &ne
 
 GibbsOpt::GibbsOpt (
     const Database &DB,
-    const evalconditions &sysstate ) :
-    conditions ( sysstate )
+    const evalconditions &sysstate,
+    const Optimizer::EquilibriumResult<Ipopt::Number> *previous_result ) :
+    GibbsOpt ( CompiledSystem ( DB, sysstate ), sysstate, previous_result )
 {
-    typedef GlobalMinimizer<typename details::SimplicialFacet<double>,double,double> GlobalMinimizerType;
+}
+
+GibbsOpt::GibbsOpt (
+    const CompiledSystem &system,
+    const evalconditions &sysstate,
+    const Optimizer::EquilibriumResult<Ipopt::Number> *previous_result,
+    GlobalHullCache *hull_cache ) :
+    conditions ( sysstate ),
+    warm_start ( previous_result ),
+    control ( nullptr ),
+    stopping_rules ( nullptr ),
+    keep_trace ( false ),
+    stopped_by_rule ( false ),
+    traced_callback_seconds ( 0 )
+{
+    typedef LowerHullGlobalMinimizer<typename details::SimplicialFacet<double>,double,double> GlobalMinimizerType;
     BOOST_LOG_NAMED_SCOPE ( "GibbsOpt::GibbsOpt" );
     BOOST_LOG_CHANNEL_SEV ( opto_log, "optimizer", debug ) << "enter ctor";
-    auto varcount = 0;
+    const auto setup_start = std::chrono::steady_clock::now();
     auto activephases = 0;
-    parameter_set pset;
-    Phase_Collection phase_col;
-
-    for ( auto i = DB.get_phase_iterator(); i != DB.get_phase_iterator_end(); ++i ) {
-        if ( conditions.phases.find ( i->first ) != conditions.phases.end() ) {
-            if ( conditions.phases.at ( i->first ) == PhaseStatus::ENTERED ) {
-                phase_col[i->first] = i->second;
-            }
-        }
-    }
+    // The models and their derivatives come from system; only the parts depending on the conditions are built here
+    Phase_Collection phase_col = system.phases(); // We modify phase_col, so we should be careful here
+    const std::map<std::string, CompositionSet> &system_comp_sets = system.composition_sets();
 
     if ( conditions.elements.cbegin() == conditions.elements.cend() ) {
         BOOST_LOG_SEV ( opto_log, critical ) << "No components entered!";
@@ -63,35 +74,27 @@ GibbsOpt::GibbsOpt (
         BOOST_LOG_SEV ( opto_log, critical ) << "No phases found!";
     }
 
-    // build_variable_map() will fill main_indices by reference
-    // main_indices is used during the optimization as a simplified variable map
-    main_ss = build_variable_map ( phase_col.begin(), phase_col.end(), conditions, main_indices );
-
-    for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i ) {
-        BOOST_LOG_SEV ( opto_log, debug ) << "Variable " << i->second << ": " << i->first;
+    BOOST_LOG_SEV ( opto_log, debug ) << "Starting global minimization";
+    std::vector<typename GlobalMinimizerType::HullMapType::HullEntryType> tie_points;
+    if ( hull_cache ) {
+        // The hull does not depend on the overall composition, so it may be left from an earlier calculation
+        tie_points = hull_cache->find_tie_points ( system, conditions, profile );
     }
+    else {
+        // GlobalMinimizer only reads the composition sets, so it can work on the shared ones directly
+        GlobalMinimizerType grid;
+        grid.run ( system_comp_sets, system.sublattices(), conditions );
 
-    // load the parameters from the database
-    pset = DB.get_parameter_set();
-
-    // this is the part where we look up the models enabled for each phase and call their AST builders
-    // then we build a master Gibbs AST for the objective function
-    auto temp_phase_col = phase_col; // We modify phase_col, so we should be careful here
-    for ( auto i = temp_phase_col.begin(); i != temp_phase_col.end(); ++i ) {
-        comp_sets.emplace ( i->first, CompositionSet ( i->second, pset, main_ss, main_indices ) );
+        BOOST_LOG_SEV ( opto_log, debug ) << "Locating tie hyperplane";
+        // Get the points on the equilibrium tie hyperplane
+        tie_points = grid.find_tie_points ( conditions );
+        profile.merge ( grid.get_profile() );
+        minimizer_footprint = grid.memory_footprint();
     }
-    BOOST_LOG_SEV ( opto_log, debug ) << "Starting global minimization";
-    // GlobalMinimizer will modify comp_sets and set the starting points automatically
-    GlobalMinimizerType grid;
-    grid.run ( comp_sets, main_ss, conditions );
-    
-    BOOST_LOG_SEV ( opto_log, debug ) << "Locating tie hyperplane";
-    // Get the points on the equilibrium tie hyperplane
-    auto tie_points = grid.find_tie_points ( conditions );
     BOOST_LOG_SEV ( opto_log, critical ) << "Global minimization found " << tie_points.size() << " energy minima";
 
-    std::map<std::string, CompositionSet> new_comp_sets_to_add;
-    for ( auto comp_set = comp_sets.begin(); comp_set != comp_sets.end(); ) {
+    // Copy the composition sets on the hull from system and set their starting points
+    for ( auto comp_set = system_comp_sets.cbegin(); comp_set != system_comp_sets.cend(); ++comp_set ) {
         BOOST_LOG_SEV ( opto_log, debug ) << "Checking if " << comp_set->first << " needs to be modified";
         // Search tie points for this phase
         std::vector<typename GlobalMinimizerType::HullMapType::HullEntryType> phase_tie_points;
@@ -103,7 +106,6 @@ GibbsOpt::GibbsOpt (
         std::size_t number_of_composition_sets = phase_tie_points.size();
         if ( number_of_composition_sets == 0 ) { 
             BOOST_LOG_SEV ( opto_log, debug ) << comp_set->first << " is not on the convex hull. Removing.";
-            comp_sets.erase ( comp_set++ ); 
             continue; 
         }
         
@@ -112,7 +114,7 @@ GibbsOpt::GibbsOpt (
         for ( auto tie_point : phase_tie_points ) {
             // We want to map the indices we used back to variable names for the optimizer
             std::map<std::string,double> minimum;
-            boost::bimap<std::string,int> indexmap = comp_set->second.get_variable_map();
+            const boost::bimap<std::string,int> &indexmap = comp_set->second.get_variable_map();
             for ( auto it = tie_point.internal_coordinates.begin(); it != tie_point.internal_coordinates.end(); ++it ) {
                 const int index = std::distance ( tie_point.internal_coordinates.begin(),it );
                 BOOST_LOG_SEV ( opto_log, debug ) << "Looking up index " << index << " for indexmap";
@@ -135,12 +137,13 @@ GibbsOpt::GibbsOpt (
                 // Copy from PHASENAME to PHASENAME#N
                 phase_col[compsetname.str()] = phase_col[comp_set->first];
                 conditions.phases[compsetname.str()] = conditions.phases[comp_set->first];
-                new_comp_sets_to_add.emplace ( compsetname.str(), CompositionSet ( comp_set->second, new_starting_point, compsetname.str() ) );
+                comp_sets.emplace ( compsetname.str(), CompositionSet ( comp_set->second, new_starting_point, compsetname.str() ) );
             }
             else {
                 BOOST_LOG_SEV ( opto_log, debug ) << "Setting starting point for " << comp_set->first;
                 // No miscibility gaps; set the starting point
-                comp_set->second.set_starting_point ( minimum );
+                auto new_comp_set = comp_sets.emplace ( comp_set->first, comp_set->second ).first;
+                new_comp_set->second.set_starting_point ( minimum );
             }
         }
         if ( number_of_composition_sets > 1) {
@@ -155,19 +158,16 @@ GibbsOpt::GibbsOpt (
             if ( remove_conds_phase_iter != conditions.phases.end() ) {
                 conditions.phases.erase ( remove_conds_phase_iter );
             }
-            // Erase original phase (now renamed)
-            comp_sets.erase ( comp_set++);
         }
-        else comp_set++;
     }
-    if ( new_comp_sets_to_add.size() > 0) {
-        BOOST_LOG_SEV ( opto_log, debug ) << "Adding new composition sets to the optimizer";
-        std::move( new_comp_sets_to_add.begin(), new_comp_sets_to_add.end(), std::inserter( comp_sets, comp_sets.begin() ));
-    }
-    // Rebuild the index map now that phases have been renamed and removed
-    BOOST_LOG_SEV ( opto_log, debug ) << "Rebuilding variable map";
-    main_indices.left.clear();
+    // build_variable_map() will fill main_indices by reference
+    // main_indices is used during the optimization as a simplified variable map
+    BOOST_LOG_SEV ( opto_log, debug ) << "Building variable map";
     main_ss = build_variable_map ( phase_col.begin(), phase_col.end(), conditions, main_indices );
+
+    for ( auto i = main_indices.left.begin(); i != main_indices.left.end(); ++i ) {
+        BOOST_LOG_SEV ( opto_log, debug ) << "Variable " << i->second << ": " << i->first;
+    }
     
     activephases = comp_sets.size();
 
@@ -203,6 +203,7 @@ GibbsOpt::GibbsOpt (
                 fixed_indices.push_back ( main_indices.left.at ( ss.str() ) );
             }
             if ( subl_list.size() > 1 ) {
+                sublattice_balance_indices.push_back ( cm.constraints.size() );
                 cm.addConstraint (
                     SublatticeBalanceConstraint (
                         i->first,
@@ -297,6 +298,96 @@ GibbsOpt::GibbsOpt (
         }
     }
 
+    // Resolve variable names and sparsity positions now, so the callbacks only do array lookups
+    for ( auto i = comp_sets.cbegin(); i != comp_sets.cend(); ++i ) {
+        DenseEvaluation evaluation;
+        evaluation.comp_set = &i->second;
+        evaluation.binding = i->second.bind ( conditions, main_indices );
+        evaluation.phase_fraction_index = main_indices.left.at ( i->first + "_FRAC" );
+        evaluation.hessian_positions = i->second.hessian_positions ( evaluation.binding, hess_sparsity_structure );
+        evaluation.workspace = i->second.jet_workspace ( true );
+        evaluation.energy = 0;
+        evaluation.energy_current = evaluation.gradient_current = evaluation.hessian_current = false;
+        dense_evaluation.push_back ( std::move ( evaluation ) );
+    }
+    phase_energies.resize ( dense_evaluation.size() );
+    hessian_requested = false;
+    worker_threads = std::thread::hardware_concurrency();
+    parallel_callback_seconds = 1e-4;
+    for ( auto i = constraint_hessian_data.cbegin(); i != constraint_hessian_data.cend(); ++i ) {
+        const std::list<int> searchlist {std::min ( i->var_index1, i->var_index2 ), std::max ( i->var_index1, i->var_index2 ) };
+        constraint_hessian_positions.push_back (
+            std::distance ( hess_sparsity_structure.cbegin(), hess_sparsity_structure.find ( searchlist ) ) );
+    }
+
+    // Compile the constraint trees; they contain no special symbols
+    const ASTSymbolMap no_symbols;
+    for ( auto i = cm.constraints.cbegin(); i != cm.constraints.cend(); ++i ) {
+        boost::spirit::utree residual_tree;
+        residual_tree.push_back ( "-" );
+        residual_tree.push_back ( i->lhs );
+        residual_tree.push_back ( i->rhs );
+        constraint_programs.emplace_back ( residual_tree, no_symbols, constraint_slots );
+    }
+    for ( auto i = jac_g_trees.cbegin(); i != jac_g_trees.cend(); ++i ) {
+        jacobian_programs.emplace_back ( CompiledExpression ( i->ast, no_symbols, constraint_slots ) );
+    }
+    for ( auto i = constraint_hessian_data.cbegin(); i != constraint_hessian_data.cend(); ++i ) {
+        std::vector<std::pair<Ipopt::Index,ConstraintProgram>> programs;
+        for ( auto j = i->asts.cbegin(); j != i->asts.cend(); ++j ) {
+            programs.emplace_back ( j->first, ConstraintProgram ( CompiledExpression ( j->second, no_symbols, constraint_slots ) ) );
+        }
+        constraint_hessian_programs.push_back ( std::move ( programs ) );
+    }
+    constraint_binding = CompiledBinding ( constraint_slots, conditions, main_indices );
+    BOOST_LOG_SEV ( opto_log, debug ) << "compiled constraints referencing " << constraint_slots.variables.size() << " variables";
+
+    // Evaluate the programs that do not read x, and classify the constraints by them
+    const std::vector<Number> origin ( main_indices.size(), 0 );
+    constraint_linearity.assign ( constraint_programs.size(), ConstraintLinearity::LINEAR );
+    std::size_t constant_jacobian_entries = 0;
+    for ( auto i = jacobian_programs.begin(); i != jacobian_programs.end(); ++i ) {
+        const Index cons_index = jac_g_trees[std::distance ( jacobian_programs.begin(), i )].cons_index;
+        i->constant = !i->program.variable_dependent();
+        if ( i->constant ) {
+            i->value = i->program.evaluate ( constraint_binding, origin.data() );
+            ++constant_jacobian_entries;
+        }
+        else constraint_linearity[cons_index] = ConstraintLinearity::BILINEAR;
+    }
+    for ( auto i = constraint_hessian_programs.begin(); i != constraint_hessian_programs.end(); ++i ) {
+        for ( auto j = i->begin(); j != i->end(); ++j ) {
+            j->second.constant = !j->second.program.variable_dependent();
+            if ( j->second.constant ) j->second.value = j->second.program.evaluate ( constraint_binding, origin.data() );
+            else constraint_linearity[j->first] = ConstraintLinearity::NONLINEAR;
+        }
+    }
+    std::size_t bilinear_constraints = 0;
+    for ( std::size_t cons_index = 0; cons_index < constraint_linearity.size(); ++cons_index ) {
+        if ( constraint_linearity[cons_index] == ConstraintLinearity::LINEAR ) {
+            LinearConstraint constraint;
+            constraint.cons_index = cons_index;
+            constraint.offset = constraint_programs[cons_index].evaluate ( constraint_binding, origin.data() );
+            linear_constraints.push_back ( std::move ( constraint ) );
+        }
+        else {
+            if ( constraint_linearity[cons_index] == ConstraintLinearity::BILINEAR ) ++bilinear_constraints;
+            nonlinear_constraints.push_back ( cons_index );
+        }
+    }
+    for ( auto i = linear_constraints.begin(); i != linear_constraints.end(); ++i ) {
+        for ( auto j = jac_g_trees.cbegin(); j != jac_g_trees.cend(); ++j ) {
+            if ( j->cons_index == i->cons_index ) {
+                i->coefficients.emplace_back ( j->var_index, jacobian_programs[std::distance ( jac_g_trees.cbegin(), j )].value );
+            }
+        }
+    }
+    BOOST_LOG_SEV ( opto_log, debug ) << linear_constraints.size() << " linear, " << bilinear_constraints << " bilinear and "
+                                      << ( nonlinear_constraints.size() - bilinear_constraints ) << " nonlinear constraints; "
+                                      << constant_jacobian_entries << " of " << jacobian_programs.size() << " Jacobian entries are constant";
+
+    // The whole constructor, so this includes the global minimization stages above
+    profile.add ( "setup", std::chrono::duration<double> ( std::chrono::steady_clock::now() - setup_start ).count() );
     BOOST_LOG_SEV ( opto_log, debug ) << "function exit";
 }
 
@@ -0,0 +1,379 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// reduced_gibbs_opt.cpp -- definition for the reduced-space Gibbs energy optimizer
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/reduced_gibbs_opt.hpp"
+#include "libgibbs/include/utils/hot_path_logging.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include "libtdb/include/logging.hpp"
+#include <coin/IpTNLP.hpp>
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <map>
+#include <utility>
+
+using namespace Ipopt;
+
+ReducedGibbsOpt::ReducedGibbsOpt ( GibbsOpt *full_problem ) :
+    opto_log ( journal::keywords::channel = "optimizer" ), full ( full_problem )
+    {
+    BOOST_LOG_NAMED_SCOPE ( "ReducedGibbsOpt::ReducedGibbsOpt" );
+    IndexStyleEnum index_style;
+    full->get_nlp_info ( full_n, full_m, full_nnz_jac, full_nnz_h, index_style );
+    offset.assign ( full_n, 0 );
+    full_columns.resize ( full_n );
+    std::vector<bool> covered ( full_n, false );
+
+    // Reduced variables: the phase fraction, then the null space coordinates, of each composition set
+    Index column = 0;
+    const std::vector<GibbsOpt::PhaseVariables> phases = full->phase_variables();
+    for ( auto phase = phases.cbegin(); phase != phases.cend(); ++phase )
+        {
+        full_columns[phase->phase_fraction_index].emplace_back ( column, 1.0 );
+        covered[phase->phase_fraction_index] = true;
+        phase_fractions.emplace_back ( column, phase->phase_fraction_index );
+        ++column;
+        const SublatticeLayout &layout = phase->comp_set->sublattice_layout();
+        const boost::numeric::ublas::matrix<double> &Z = phase->comp_set->get_constraint_null_space_matrix();
+        BOOST_ASSERT ( Z.size1() == layout.coordinate_count() );
+        for ( std::size_t sublindex = 0; sublindex < layout.sublattice_count(); ++sublindex )
+            {
+            const std::size_t species_count = layout.species_count ( sublindex );
+            for ( std::size_t coordinate = layout.sublattice_begin ( sublindex ); coordinate < layout.sublattice_end ( sublindex ); ++coordinate )
+                {
+                const Index variable = phase->site_fraction_indices[coordinate];
+                offset[variable] = 1.0 / species_count;
+                covered[variable] = true;
+                if ( species_count < 2 ) continue; // fixed at unity, so neither a column nor a bound row
+                for ( std::size_t j = 0; j < Z.size2(); ++j )
+                    {
+                    if ( Z ( coordinate, j ) != 0 ) full_columns[variable].emplace_back ( column + j, Z ( coordinate, j ) );
+                    }
+                bound_rows.push_back ( variable );
+                }
+            }
+        column += Z.size2();
+        }
+    if ( std::find ( covered.cbegin(), covered.cend(), false ) != covered.cend() )
+        {
+        BOOST_THROW_EXCEPTION ( internal_error() << str_errinfo ( "Variable of the Gibbs energy problem belongs to no composition set" ) );
+        }
+    reduced_n = column;
+
+    eliminated.assign ( full_m, false );
+    for ( const Index constraint : full->sublattice_balance_constraints() ) eliminated[constraint] = true;
+    std::vector<Index> reduced_rows ( full_m, -1 );
+    for ( Index constraint = 0; constraint < full_m; ++constraint )
+        {
+        if ( eliminated[constraint] ) continue;
+        reduced_rows[constraint] = kept_constraints.size();
+        kept_constraints.push_back ( constraint );
+        }
+    reduced_m = kept_constraints.size() + bound_rows.size();
+
+    // Reduced Jacobian: the kept rows of the full Jacobian times Z, then the rows of Z of the bounded site fractions
+    full_jac_rows.resize ( full_nnz_jac );
+    full_jac_cols.resize ( full_nnz_jac );
+    if ( full_nnz_jac > 0 ) full->eval_jac_g ( full_n, nullptr, false, full_m, full_nnz_jac, &full_jac_rows[0], &full_jac_cols[0], nullptr );
+    std::map<std::pair<Index,Index>,Index> jac_positions;
+    auto jac_position = [this,&jac_positions] ( const Index row, const Index col )
+        {
+        const auto inserted = jac_positions.emplace ( std::make_pair ( row, col ), jac_rows.size() );
+        if ( inserted.second )
+            {
+            jac_rows.push_back ( row );
+            jac_cols.push_back ( col );
+            }
+        return inserted.first->second;
+        };
+    for ( Index entry = 0; entry < full_nnz_jac; ++entry )
+        {
+        if ( eliminated[full_jac_rows[entry]] ) continue;
+        const Index row = reduced_rows[full_jac_rows[entry]];
+        for ( const auto &term : full_columns[full_jac_cols[entry]] )
+            {
+            jac_scatter.push_back ( Scatter { entry, jac_position ( row, term.first ), term.second } );
+            }
+        }
+    std::vector<std::pair<Index,double>> bound_entries;
+    for ( std::size_t bound = 0; bound < bound_rows.size(); ++bound )
+        {
+        const Index row = kept_constraints.size() + bound;
+        for ( const auto &term : full_columns[bound_rows[bound]] )
+            {
+            bound_entries.emplace_back ( jac_position ( row, term.first ), term.second );
+            }
+        }
+    jac_constant.assign ( jac_rows.size(), 0 );
+    for ( const auto &entry : bound_entries ) jac_constant[entry.first] += entry.second;
+
+    // Reduced Hessian: Z^T H Z, where the full Hessian H is given by its lower triangle
+    std::vector<Index> full_hess_rows ( full_nnz_h ), full_hess_cols ( full_nnz_h );
+    if ( full_nnz_h > 0 ) full->eval_h ( full_n, nullptr, false, 1, full_m, nullptr, false, full_nnz_h, &full_hess_rows[0], &full_hess_cols[0], nullptr );
+    std::map<std::pair<Index,Index>,Index> hess_positions;
+    auto hess_position = [this,&hess_positions] ( const Index col1, const Index col2 )
+        {
+        const Index row = std::max ( col1, col2 ), col = std::min ( col1, col2 );
+        const auto inserted = hess_positions.emplace ( std::make_pair ( row, col ), hess_rows.size() );
+        if ( inserted.second )
+            {
+            hess_rows.push_back ( row );
+            hess_cols.push_back ( col );
+            }
+        return inserted.first->second;
+        };
+    for ( Index entry = 0; entry < full_nnz_h; ++entry )
+        {
+        const Index var1 = full_hess_rows[entry], var2 = full_hess_cols[entry];
+        for ( const auto &term1 : full_columns[var1] )
+            {
+            for ( const auto &term2 : full_columns[var2] )
+                {
+                // A diagonal entry of H contributes to each pair of columns once; an off-diagonal one,
+                // standing for H(var1,var2) and H(var2,var1), twice on the diagonal of the reduced Hessian
+                if ( var1 == var2 && term1.first < term2.first ) continue;
+                const double factor = ( var1 != var2 && term1.first == term2.first ) ? 2 : 1;
+                hess_scatter.push_back ( Scatter { entry, hess_position ( term1.first, term2.first ), factor * term1.second * term2.second } );
+                }
+            }
+        }
+
+    full_x.resize ( full_n );
+    full_grad.resize ( full_n );
+    full_g.resize ( full_m );
+    full_lambda.resize ( full_m );
+    full_jac.resize ( full_nnz_jac );
+    full_hess.resize ( full_nnz_h );
+    BOOST_LOG_SEV ( opto_log, debug ) << "Reduced " << full_n << " variables and " << full_m << " constraints to "
+                                      << reduced_n << " variables and " << reduced_m << " constraints ("
+                                      << bound_rows.size() << " bounded site fractions)";
+    }
+
+void ReducedGibbsOpt::expand ( const Number* x )
+    {
+    for ( Index i = 0; i < full_n; ++i )
+        {
+        double value = offset[i];
+        for ( const auto &term : full_columns[i] ) value += term.second * x[term.first];
+        full_x[i] = value;
+        }
+    }
+
+bool ReducedGibbsOpt::get_nlp_info ( Index& n, Index& m, Index& nnz_jac_g,
+                                     Index& nnz_h_lag, IndexStyleEnum& index_style )
+    {
+    n = reduced_n;
+    m = reduced_m;
+    nnz_jac_g = jac_rows.size();
+    nnz_h_lag = hess_rows.size();
+    index_style = C_STYLE;
+    return true;
+    }
+
+bool ReducedGibbsOpt::get_bounds_info ( Index n, Number* x_l, Number* x_u,
+                                        Index m, Number* g_l, Number* g_u )
+    {
+    std::vector<Number> full_x_l ( full_n ), full_x_u ( full_n ), full_g_l ( full_m ), full_g_u ( full_m );
+    full->get_bounds_info ( full_n, &full_x_l[0], &full_x_u[0], full_m, full_g_l.data(), full_g_u.data() );
+    // The null space coordinates are free; above nlp_upper_bound_inf, Ipopt drops a bound
+    std::fill ( x_l, x_l + n, -2e19 );
+    std::fill ( x_u, x_u + n, 2e19 );
+    for ( const auto &phase_fraction : phase_fractions )
+        {
+        x_l[phase_fraction.first] = full_x_l[phase_fraction.second];
+        x_u[phase_fraction.first] = full_x_u[phase_fraction.second];
+        }
+    for ( std::size_t row = 0; row < kept_constraints.size(); ++row )
+        {
+        g_l[row] = full_g_l[kept_constraints[row]];
+        g_u[row] = full_g_u[kept_constraints[row]];
+        }
+    for ( std::size_t bound = 0; bound < bound_rows.size(); ++bound )
+        {
+        g_l[kept_constraints.size() + bound] = full_x_l[bound_rows[bound]];
+        g_u[kept_constraints.size() + bound] = full_x_u[bound_rows[bound]];
+        }
+    return true;
+    }
+
+bool ReducedGibbsOpt::get_starting_point ( Index n, bool init_x, Number* x,
+                                           bool init_z, Number* z_L, Number* z_U,
+                                           Index m, bool init_lambda,
+                                           Number* lambda )
+    {
+    std::vector<Number> full_z_L ( full_n ), full_z_U ( full_n );
+    full->get_starting_point ( full_n, true, &full_x[0], true, &full_z_L[0], &full_z_U[0], full_m, true, full_lambda.data() );
+    // Z has orthonormal columns, so z = Z^T (x - x0); a start off the sublattice balances is projected onto them
+    std::fill ( x, x + n, 0.0 );
+    for ( Index i = 0; i < full_n; ++i )
+        {
+        for ( const auto &term : full_columns[i] ) x[term.first] += term.second * ( full_x[i] - offset[i] );
+        }
+    if ( init_z )
+        {
+        std::fill ( z_L, z_L + n, 0.0 );
+        std::fill ( z_U, z_U + n, 0.0 );
+        for ( const auto &phase_fraction : phase_fractions )
+            {
+            z_L[phase_fraction.first] = full_z_L[phase_fraction.second];
+            z_U[phase_fraction.first] = full_z_U[phase_fraction.second];
+            }
+        }
+    if ( init_lambda )
+        {
+        for ( std::size_t row = 0; row < kept_constraints.size(); ++row ) lambda[row] = full_lambda[kept_constraints[row]];
+        // The multiplier of a bound row plays the part of z_U - z_L of its site fraction
+        for ( std::size_t bound = 0; bound < bound_rows.size(); ++bound )
+            {
+            lambda[kept_constraints.size() + bound] = full_z_U[bound_rows[bound]] - full_z_L[bound_rows[bound]];
+            }
+        }
+    return true;
+    }
+
+bool ReducedGibbsOpt::eval_f ( Index n, const Number* x, bool new_x, Number& obj_value )
+    {
+    HOT_PATH_NAMED_SCOPE ( "ReducedGibbsOpt::eval_f" );
+    expand ( x );
+    return full->eval_f ( full_n, &full_x[0], new_x, obj_value );
+    }
+
+bool ReducedGibbsOpt::eval_grad_f ( Index n, const Number* x, bool new_x, Number* grad_f )
+    {
+    HOT_PATH_NAMED_SCOPE ( "ReducedGibbsOpt::eval_grad_f" );
+    expand ( x );
+    if ( !full->eval_grad_f ( full_n, &full_x[0], new_x, &full_grad[0] ) ) return false;
+    // Z^T times the full gradient
+    std::fill ( grad_f, grad_f + n, 0.0 );
+    for ( Index i = 0; i < full_n; ++i )
+        {
+        for ( const auto &term : full_columns[i] ) grad_f[term.first] += term.second * full_grad[i];
+        }
+    return true;
+    }
+
+bool ReducedGibbsOpt::eval_g ( Index n, const Number* x, bool new_x, Index m, Number* g )
+    {
+    HOT_PATH_NAMED_SCOPE ( "ReducedGibbsOpt::eval_g" );
+    expand ( x );
+    if ( !full->eval_g ( full_n, &full_x[0], new_x, full_m, full_g.data() ) ) return false;
+    for ( std::size_t row = 0; row < kept_constraints.size(); ++row ) g[row] = full_g[kept_constraints[row]];
+    for ( std::size_t bound = 0; bound < bound_rows.size(); ++bound ) g[kept_constraints.size() + bound] = full_x[bound_rows[bound]];
+    return true;
+    }
+
+bool ReducedGibbsOpt::eval_jac_g ( Index n, const Number* x, bool new_x,
+                                   Index m, Index nele_jac, Index* iRow, Index *jCol,
+                                   Number* values )
+    {
+    HOT_PATH_NAMED_SCOPE ( "ReducedGibbsOpt::eval_jac_g" );
+    if ( values == NULL )
+        {
+        std::copy ( jac_rows.cbegin(), jac_rows.cend(), iRow );
+        std::copy ( jac_cols.cbegin(), jac_cols.cend(), jCol );
+        return true;
+        }
+    std::copy ( jac_constant.cbegin(), jac_constant.cend(), values );
+    if ( full_nnz_jac == 0 ) return true;
+    expand ( x );
+    if ( !full->eval_jac_g ( full_n, &full_x[0], new_x, full_m, full_nnz_jac, nullptr, nullptr, &full_jac[0] ) ) return false;
+    for ( const Scatter &entry : jac_scatter ) values[entry.position] += entry.coefficient * full_jac[entry.source];
+    return true;
+    }
+
+bool ReducedGibbsOpt::eval_h ( Index n, const Number* x, bool new_x,
+                               Number obj_factor, Index m, const Number* lambda,
+                               bool new_lambda, Index nele_hess, Index* iRow,
+                               Index* jCol, Number* values )
+    {
+    HOT_PATH_NAMED_SCOPE ( "ReducedGibbsOpt::eval_h" );
+    if ( values == NULL )
+        {
+        std::copy ( hess_rows.cbegin(), hess_rows.cend(), iRow );
+        std::copy ( hess_cols.cbegin(), hess_cols.cend(), jCol );
+        return true;
+        }
+    std::fill ( values, values + nele_hess, 0.0 );
+    if ( full_nnz_h == 0 ) return true;
+    expand ( x );
+    // The eliminated constraints and the bound rows are linear, so they do not contribute
+    std::fill ( full_lambda.begin(), full_lambda.end(), 0.0 );
+    for ( std::size_t row = 0; row < kept_constraints.size(); ++row ) full_lambda[kept_constraints[row]] = lambda[row];
+    if ( !full->eval_h ( full_n, &full_x[0], new_x, obj_factor, full_m, full_lambda.data(), new_lambda,
+                         full_nnz_h, nullptr, nullptr, &full_hess[0] ) ) return false;
+    for ( const Scatter &entry : hess_scatter ) values[entry.position] += entry.coefficient * full_hess[entry.source];
+    return true;
+    }
+
+bool ReducedGibbsOpt::intermediate_callback ( AlgorithmMode mode,
+                                              Index iter, Number obj_value,
+                                              Number inf_pr, Number inf_du,
+                                              Number mu, Number d_norm,
+                                              Number regularization_size,
+                                              Number alpha_du, Number alpha_pr,
+                                              Index ls_trials,
+                                              const IpoptData* ip_data,
+                                              IpoptCalculatedQuantities* ip_cq )
+    {
+    return full->intermediate_callback ( mode, iter, obj_value, inf_pr, inf_du, mu, d_norm, regularization_size,
+                                         alpha_du, alpha_pr, ls_trials, ip_data, ip_cq );
+    }
+
+void ReducedGibbsOpt::finalize_solution ( SolverReturn status,
+                                          Index n, const Number* x, const Number* z_L, const Number* z_U,
+                                          Index m, const Number* g, const Number* lambda,
+                                          Number obj_value,
+                                          const IpoptData* ip_data,
+                                          IpoptCalculatedQuantities* ip_cq )
+    {
+    BOOST_LOG_NAMED_SCOPE ( "ReducedGibbsOpt::finalize_solution" );
+    expand ( x );
+    std::vector<Number> full_z_L ( full_n, 0.0 ), full_z_U ( full_n, 0.0 );
+    for ( const auto &phase_fraction : phase_fractions )
+        {
+        full_z_L[phase_fraction.second] = z_L[phase_fraction.first];
+        full_z_U[phase_fraction.second] = z_U[phase_fraction.first];
+        }
+    for ( std::size_t bound = 0; bound < bound_rows.size(); ++bound )
+        {
+        const Number multiplier = lambda[kept_constraints.size() + bound];
+        full_z_L[bound_rows[bound]] = std::max ( -multiplier, 0.0 );
+        full_z_U[bound_rows[bound]] = std::max ( multiplier, 0.0 );
+        }
+    std::fill ( full_lambda.begin(), full_lambda.end(), 0.0 );
+    for ( std::size_t row = 0; row < kept_constraints.size(); ++row ) full_lambda[kept_constraints[row]] = lambda[row];
+
+    // Multipliers of the eliminated constraints, from stationarity of the full Lagrangian:
+    // grad f + J^T lambda - z_L + z_U = 0, where every site fraction of a sublattice has coefficient 1
+    // in its balance constraint; the mean over the sublattice is taken
+    full->eval_grad_f ( full_n, &full_x[0], true, &full_grad[0] );
+    if ( full_nnz_jac > 0 ) full->eval_jac_g ( full_n, &full_x[0], false, full_m, full_nnz_jac, nullptr, nullptr, &full_jac[0] );
+    std::vector<double> residual ( full_n );
+    for ( Index i = 0; i < full_n; ++i ) residual[i] = full_grad[i] - full_z_L[i] + full_z_U[i];
+    for ( Index entry = 0; entry < full_nnz_jac; ++entry )
+        {
+        residual[full_jac_cols[entry]] += full_jac[entry] * full_lambda[full_jac_rows[entry]];
+        }
+    std::vector<std::size_t> balance_terms ( full_m, 0 );
+    for ( Index entry = 0; entry < full_nnz_jac; ++entry )
+        {
+        const Index constraint = full_jac_rows[entry];
+        if ( !eliminated[constraint] ) continue;
+        full_lambda[constraint] -= residual[full_jac_cols[entry]];
+        ++balance_terms[constraint];
+        }
+    for ( Index constraint = 0; constraint < full_m; ++constraint )
+        {
+        if ( balance_terms[constraint] > 0 ) full_lambda[constraint] /= balance_terms[constraint];
+        }
+    full->eval_g ( full_n, &full_x[0], false, full_m, full_g.data() );
+    full->finalize_solution ( status, full_n, &full_x[0], &full_z_L[0], &full_z_U[0], full_m, full_g.data(), full_lambda.data(),
+                              obj_value, ip_data, ip_cq );
+    }
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,293 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Results of recent equilibrium calculations, looked up by their conditions
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/result_cache.hpp"
+#include "libgibbs/include/utils/ast_serialization.hpp"
+#include "libtdb/include/logging.hpp"
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <utility>
+
+using namespace Optimizer;
+
+namespace {
+// Increment whenever the format of save() changes
+const std::string result_cache_format = "libgibbs result cache 1";
+
+// Estimated heap size of a map of names
+template <typename Map> std::size_t map_bytes ( const Map &map )
+{
+    const std::size_t node_overhead = 4 * sizeof ( void* ); // links and color of a tree node
+    std::size_t bytes = 0;
+    for ( auto i = map.cbegin(); i != map.cend(); ++i ) {
+        bytes += node_overhead + sizeof ( *i ) + i->first.size();
+    }
+    return bytes;
+}
+
+// The values of result, without the profile and the phases
+void copy_values ( const EquilibriumResult<double> &from, EquilibriumResult<double> &to )
+{
+    to.walltime = from.walltime;
+    to.itercount = from.itercount;
+    to.N = from.N;
+    to.variables = from.variables;
+    to.lower_multipliers = from.lower_multipliers;
+    to.upper_multipliers = from.upper_multipliers;
+    to.constraint_multipliers = from.constraint_multipliers;
+    to.conditions = from.conditions;
+}
+
+void write_values ( ASTWriter &writer, const EquilibriumResult<double>::VariableMap &values )
+{
+    writer.write_size ( values.size() );
+    for ( auto i = values.cbegin(); i != values.cend(); ++i ) {
+        writer.write ( i->first );
+        writer.write ( i->second );
+    }
+}
+
+EquilibriumResult<double>::VariableMap read_values ( ASTReader &reader )
+{
+    EquilibriumResult<double>::VariableMap values;
+    for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+        const std::string name = reader.read_string();
+        values.emplace_hint ( values.end(), name, reader.read_double() );
+    }
+    return values;
+}
+}
+
+EquilibriumResultCache::EquilibriumResultCache ( const std::size_t max_bytes ) :
+    max_bytes ( max_bytes ), total_bytes ( 0 ), statevar_quantum ( 1e-6 ), xfrac_quantum ( 1e-9 ), near_distance ( 0.05 ),
+    hit_count ( 0 ), near_hit_count ( 0 ), miss_count ( 0 )
+{
+}
+
+std::string EquilibriumResultCache::key_of ( const std::uint64_t system, const evalconditions &conditions, const bool quantised ) const
+{
+    ASTWriter key;
+    key.write_integer ( static_cast<std::int64_t> ( system ) );
+    key.write_size ( conditions.phases.size() );
+    for ( auto i = conditions.phases.cbegin(); i != conditions.phases.cend(); ++i ) {
+        key.write ( i->first );
+        key.write_integer ( static_cast<std::int64_t> ( i->second ) );
+    }
+    key.write_size ( conditions.statevars.size() );
+    for ( auto i = conditions.statevars.cbegin(); i != conditions.statevars.cend(); ++i ) {
+        key.write_integer ( i->first );
+        if ( quantised ) key.write_integer ( std::llround ( i->second / statevar_quantum ) );
+    }
+    key.write_size ( conditions.xfrac.size() );
+    for ( auto i = conditions.xfrac.cbegin(); i != conditions.xfrac.cend(); ++i ) {
+        key.write ( i->first );
+        if ( quantised ) key.write_integer ( std::llround ( i->second / xfrac_quantum ) );
+    }
+    return key.data();
+}
+
+bool EquilibriumResultCache::find ( const CompiledSystem &system, const evalconditions &conditions, CompactEquilibriumResult &result )
+{
+    const auto found = index.find ( key_of ( system.cache_key(), conditions, true ) );
+    if ( found == index.end() || !found->second->descriptor ) {
+        ++miss_count;
+        return false;
+    }
+    entries.splice ( entries.begin(), entries, found->second ); // now the most recently used
+    ++hit_count;
+    result = CompactEquilibriumResult ( entries.front().values, entries.front().descriptor );
+    return true;
+}
+
+bool EquilibriumResultCache::nearest ( const CompiledSystem &system, const evalconditions &conditions, EquilibriumResult<double> &seed )
+{
+    const std::string group = key_of ( system.cache_key(), conditions, false );
+    auto best = entries.end();
+    double best_distance = near_distance;
+    for ( auto i = entries.begin(); i != entries.end(); ++i ) {
+        if ( i->group != group ) continue;
+        // The names are part of the group, so the conditions can be compared in order
+        double distance = 0;
+        auto stored = i->values.conditions.statevars.cbegin();
+        for ( auto j = conditions.statevars.cbegin(); j != conditions.statevars.cend(); ++j, ++stored ) {
+            distance = std::max ( distance, std::fabs ( j->second - stored->second ) / std::max ( 1.0, std::fabs ( j->second ) ) );
+        }
+        auto stored_xfrac = i->values.conditions.xfrac.cbegin();
+        for ( auto j = conditions.xfrac.cbegin(); j != conditions.xfrac.cend(); ++j, ++stored_xfrac ) {
+            distance = std::max ( distance, std::fabs ( j->second - stored_xfrac->second ) );
+        }
+        if ( distance <= best_distance ) {
+            best = i;
+            best_distance = distance;
+        }
+    }
+    if ( best == entries.end() ) return false;
+    entries.splice ( entries.begin(), entries, best );
+    ++near_hit_count;
+    copy_values ( entries.front().values, seed );
+    return true;
+}
+
+void EquilibriumResultCache::insert ( const CompiledSystem &system, const evalconditions &conditions, const CompactEquilibriumResult &result )
+{
+    EquilibriumResult<double> values = result.expand();
+    values.conditions = conditions; // the conditions as they were asked for, which include every phase
+    insert ( system.cache_key(), std::move ( values ), result.descriptor );
+}
+
+void EquilibriumResultCache::insert ( const std::uint64_t system, EquilibriumResult<double> &&values,
+                                      std::shared_ptr<const ResultDescriptor> descriptor )
+{
+    Entry entry;
+    entry.key = key_of ( system, values.conditions, true );
+    entry.group = key_of ( system, values.conditions, false );
+    entry.system = system;
+    entry.descriptor = std::move ( descriptor );
+    entry.bytes = sizeof ( Entry ) + 2 * entry.key.size() + entry.group.size() + map_bytes ( values.variables )
+                  + map_bytes ( values.lower_multipliers ) + map_bytes ( values.upper_multipliers )
+                  + map_bytes ( values.constraint_multipliers ) + map_bytes ( values.conditions.xfrac )
+                  + map_bytes ( values.conditions.phases ); // the descriptor is shared with other results
+    entry.values = std::move ( values );
+
+    const auto found = index.find ( entry.key );
+    if ( found != index.end() ) {
+        total_bytes -= found->second->bytes;
+        entries.erase ( found->second );
+        index.erase ( found );
+    }
+    total_bytes += entry.bytes;
+    entries.push_front ( std::move ( entry ) );
+    index.emplace ( entries.front().key, entries.begin() );
+    while ( total_bytes > max_bytes && !entries.empty() ) {
+        total_bytes -= entries.back().bytes;
+        index.erase ( entries.back().key );
+        entries.pop_back();
+    }
+}
+
+bool EquilibriumResultCache::save ( const std::string &path ) const
+{
+    BOOST_LOG_NAMED_SCOPE ( "EquilibriumResultCache::save" );
+    logger opto_log ( journal::keywords::channel = "optimizer" );
+    ASTWriter writer;
+    writer.write ( result_cache_format );
+    writer.write_size ( entries.size() );
+    // Least recently used first, so that load() ends up with the same order
+    for ( auto i = entries.crbegin(); i != entries.crend(); ++i ) {
+        const EquilibriumResult<double> &values = i->values;
+        writer.write_integer ( static_cast<std::int64_t> ( i->system ) );
+        writer.write_size ( values.conditions.statevars.size() );
+        for ( auto j = values.conditions.statevars.cbegin(); j != values.conditions.statevars.cend(); ++j ) {
+            writer.write_integer ( j->first );
+            writer.write ( j->second );
+        }
+        write_values ( writer, values.conditions.xfrac );
+        writer.write_size ( values.conditions.elements.size() );
+        for ( auto j = values.conditions.elements.cbegin(); j != values.conditions.elements.cend(); ++j ) {
+            writer.write ( *j );
+        }
+        writer.write_size ( values.conditions.phases.size() );
+        for ( auto j = values.conditions.phases.cbegin(); j != values.conditions.phases.cend(); ++j ) {
+            writer.write ( j->first );
+            writer.write_integer ( static_cast<std::int64_t> ( j->second ) );
+        }
+        writer.write ( values.walltime );
+        writer.write_integer ( values.itercount );
+        writer.write ( values.N );
+        write_values ( writer, values.variables );
+        write_values ( writer, values.lower_multipliers );
+        write_values ( writer, values.upper_multipliers );
+        write_values ( writer, values.constraint_multipliers );
+    }
+    // As CompiledSystem does with its cache files: write to a temporary file and move it into place
+    std::stringstream temp_path;
+    temp_path << path << "." << std::hex << std::random_device()() << ".tmp";
+    std::ofstream out ( temp_path.str().c_str(), std::ios::binary );
+    out.write ( writer.data().data(), writer.data().size() );
+    out.close();
+    if ( !out || std::rename ( temp_path.str().c_str(), path.c_str() ) != 0 ) {
+        BOOST_LOG_SEV ( opto_log, debug ) << "could not write " << path;
+        std::remove ( temp_path.str().c_str() );
+        return false;
+    }
+    BOOST_LOG_SEV ( opto_log, debug ) << "wrote " << entries.size() << " results to " << path;
+    return true;
+}
+
+bool EquilibriumResultCache::load ( const std::string &path )
+{
+    BOOST_LOG_NAMED_SCOPE ( "EquilibriumResultCache::load" );
+    logger opto_log ( journal::keywords::channel = "optimizer" );
+    try {
+        boost::interprocess::file_mapping file ( path.c_str(), boost::interprocess::read_only );
+        boost::interprocess::mapped_region region ( file, boost::interprocess::read_only );
+        const char* const data = static_cast<const char*> ( region.get_address() );
+        ASTReader reader ( data, data + region.get_size() );
+        if ( reader.read_string() != result_cache_format ) {
+            BOOST_LOG_SEV ( opto_log, debug ) << path << " was written in a different format";
+            return false;
+        }
+        // Read everything before storing anything, so that a corrupt file adds nothing
+        std::vector<std::pair<std::uint64_t,EquilibriumResult<double>>> stored;
+        for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+            const std::uint64_t system = static_cast<std::uint64_t> ( reader.read_integer() );
+            EquilibriumResult<double> values;
+            for ( std::size_t j = 0, statevar_count = reader.read_size(); j < statevar_count; ++j ) {
+                const char name = static_cast<char> ( reader.read_integer() );
+                values.conditions.statevars[name] = reader.read_double();
+            }
+            values.conditions.xfrac = read_values ( reader );
+            for ( std::size_t j = 0, element_count = reader.read_size(); j < element_count; ++j ) {
+                values.conditions.elements.push_back ( reader.read_string() );
+            }
+            for ( std::size_t j = 0, phase_count = reader.read_size(); j < phase_count; ++j ) {
+                const std::string name = reader.read_string();
+                values.conditions.phases[name] = static_cast<PhaseStatus> ( reader.read_integer() );
+            }
+            values.walltime = reader.read_double();
+            values.itercount = static_cast<int> ( reader.read_integer() );
+            values.N = reader.read_double();
+            values.variables = read_values ( reader );
+            values.lower_multipliers = read_values ( reader );
+            values.upper_multipliers = read_values ( reader );
+            values.constraint_multipliers = read_values ( reader );
+            stored.emplace_back ( system, std::move ( values ) );
+        }
+        if ( !reader.at_end() ) {
+            BOOST_LOG_SEV ( opto_log, debug ) << path << " is corrupt";
+            return false;
+        }
+        for ( auto i = stored.begin(); i != stored.end(); ++i ) {
+            // A result calculated in this process, with its descriptor, is worth more than one from the file
+            const auto found = index.find ( key_of ( i->first, i->second.conditions, true ) );
+            if ( found != index.end() && found->second->descriptor ) continue;
+            insert ( i->first, std::move ( i->second ), nullptr );
+        }
+        BOOST_LOG_SEV ( opto_log, debug ) << "read " << stored.size() << " results from " << path;
+        return true;
+    }
+    catch ( boost::interprocess::interprocess_exception & ) {
+        return false;
+    }
+    catch ( boost::exception &e ) {
+        BOOST_LOG_SEV ( opto_log, debug ) << path << " could not be read: " << boost::diagnostic_information ( e );
+        return false;
+    }
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,402 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Solved points of a long calculation, appended to a file so that it can be resumed
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/result_checkpoint.hpp"
+#include "libgibbs/include/utils/ast_serialization.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include "libtdb/include/logging.hpp"
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <utility>
+
+using namespace Optimizer;
+
+namespace {
+// Increment whenever the format of a chunk changes
+const std::string checkpoint_format = "libgibbs result checkpoint 1";
+
+enum : std::int64_t { SOLVED_POINT = 0, FAILED_POINT = 1 };
+
+template <typename Map> std::vector<typename Map::key_type> keys_of ( const Map &map )
+{
+    std::vector<typename Map::key_type> keys;
+    keys.reserve ( map.size() );
+    for ( auto i = map.cbegin(); i != map.cend(); ++i ) keys.push_back ( i->first );
+    return keys;
+}
+
+template <typename Map> void append_values ( const Map &map, std::vector<double> &values )
+{
+    for ( auto i = map.cbegin(); i != map.cend(); ++i ) values.push_back ( i->second );
+}
+
+void write_names ( ASTWriter &writer, const std::vector<std::string> &names )
+{
+    writer.write_size ( names.size() );
+    for ( auto i = names.cbegin(); i != names.cend(); ++i ) writer.write ( *i );
+}
+
+std::vector<std::string> read_names ( ASTReader &reader )
+{
+    std::vector<std::string> names ( reader.read_size() );
+    for ( auto i = names.begin(); i != names.end(); ++i ) *i = reader.read_string();
+    return names;
+}
+
+// The lengths are those of the layout, so they are not written
+void write_values ( ASTWriter &writer, const std::vector<double> &values )
+{
+    for ( auto i = values.cbegin(); i != values.cend(); ++i ) writer.write ( *i );
+}
+
+std::vector<double> read_values ( ASTReader &reader, const std::size_t count )
+{
+    std::vector<double> values ( count );
+    for ( auto i = values.begin(); i != values.end(); ++i ) *i = reader.read_double();
+    return values;
+}
+
+// A chunk as it is written to the file: the payload, and a hash to tell a complete chunk from a torn one
+std::string frame ( const std::string &payload )
+{
+    ASTWriter framed;
+    framed.write ( payload );
+    const std::uint64_t hash = framed.hash();
+    framed.write_integer ( static_cast<std::int64_t> ( hash ) );
+    return framed.data();
+}
+
+// Adds the points and layouts of a chunk to points and layouts
+void read_chunk ( const std::string &payload, std::unordered_map<std::size_t,CheckpointedResult> &points,
+                  std::list<std::shared_ptr<const CheckpointLayout>> &layouts )
+{
+    ASTReader reader ( payload.data(), payload.data() + payload.size() );
+    std::vector<std::shared_ptr<const CheckpointLayout>> chunk_layouts ( reader.read_size() );
+    for ( auto i = chunk_layouts.begin(); i != chunk_layouts.end(); ++i ) {
+        std::shared_ptr<CheckpointLayout> layout = std::make_shared<CheckpointLayout>();
+        layout->variable_names = read_names ( reader );
+        layout->constraint_names = read_names ( reader );
+        layout->statevar_names.resize ( reader.read_size() );
+        for ( auto j = layout->statevar_names.begin(); j != layout->statevar_names.end(); ++j ) {
+            *j = static_cast<char> ( reader.read_integer() );
+        }
+        layout->xfrac_names = read_names ( reader );
+        layout->elements = read_names ( reader );
+        layout->phase_names = read_names ( reader );
+        for ( auto j = layout->phase_names.cbegin(); j != layout->phase_names.cend(); ++j ) {
+            layout->phase_statuses.push_back ( static_cast<PhaseStatus> ( reader.read_integer() ) );
+            const auto fraction = std::lower_bound ( layout->variable_names.cbegin(), layout->variable_names.cend(), *j + "_FRAC" );
+            if ( fraction == layout->variable_names.cend() || *fraction != *j + "_FRAC" ) {
+                BOOST_THROW_EXCEPTION ( malformed_object_error() << str_errinfo ( "Checkpointed phase has no phase fraction" ) << specific_errinfo ( *j ) );
+            }
+            layout->phase_fractions.push_back ( fraction - layout->variable_names.cbegin() );
+        }
+        *i = layout;
+        layouts.push_back ( *i );
+    }
+    for ( std::size_t i = 0, count = reader.read_size(); i < count; ++i ) {
+        CheckpointedResult point;
+        point.point = reader.read_size();
+        if ( reader.read_integer() == FAILED_POINT ) {
+            point.error = reader.read_string();
+        }
+        else {
+            const std::size_t layout_index = reader.read_size();
+            if ( layout_index >= chunk_layouts.size() ) {
+                BOOST_THROW_EXCEPTION ( malformed_object_error() << str_errinfo ( "Checkpointed point has an invalid layout" ) );
+            }
+            point.layout = chunk_layouts[layout_index];
+            point.walltime = reader.read_double();
+            point.itercount = static_cast<int> ( reader.read_integer() );
+            point.N = reader.read_double();
+            point.energy = reader.read_double();
+            const std::size_t variable_count = point.layout->variable_names.size();
+            point.x = read_values ( reader, variable_count );
+            point.lower_multipliers = read_values ( reader, variable_count );
+            point.upper_multipliers = read_values ( reader, variable_count );
+            point.constraint_multipliers = read_values ( reader, point.layout->constraint_names.size() );
+            point.condition_values = read_values ( reader, point.layout->statevar_names.size() + point.layout->xfrac_names.size() );
+        }
+        points[point.point] = std::move ( point );
+    }
+    if ( !reader.at_end() ) {
+        BOOST_THROW_EXCEPTION ( malformed_object_error() << str_errinfo ( "Checkpoint chunk has trailing data" ) );
+    }
+}
+}
+
+std::vector<std::string> CheckpointedResult::stable_phases ( const double minimum_fraction ) const
+{
+    std::vector<std::string> names;
+    if ( !layout ) return names;
+    for ( std::size_t phase = 0; phase < layout->phase_names.size(); ++phase ) {
+        if ( x[layout->phase_fractions[phase]] <= minimum_fraction ) continue;
+        const std::string &name = layout->phase_names[phase];
+        names.push_back ( name.substr ( 0, name.find ( '#' ) ) ); // composition sets are named PHASE#n
+    }
+    std::sort ( names.begin(), names.end() );
+    return names;
+}
+
+EquilibriumResult<double> CheckpointedResult::expand() const
+{
+    EquilibriumResult<double> result;
+    result.walltime = walltime;
+    result.itercount = itercount;
+    result.N = N;
+    if ( !layout ) return result;
+    for ( std::size_t i = 0; i < layout->variable_names.size(); ++i ) {
+        const std::string &name = layout->variable_names[i];
+        result.variables.emplace_hint ( result.variables.end(), name, x[i] );
+        result.lower_multipliers.emplace_hint ( result.lower_multipliers.end(), name, lower_multipliers[i] );
+        result.upper_multipliers.emplace_hint ( result.upper_multipliers.end(), name, upper_multipliers[i] );
+    }
+    for ( std::size_t i = 0; i < layout->constraint_names.size(); ++i ) {
+        result.constraint_multipliers.emplace ( layout->constraint_names[i], constraint_multipliers[i] );
+    }
+    const std::size_t statevar_count = layout->statevar_names.size();
+    for ( std::size_t i = 0; i < statevar_count; ++i ) {
+        result.conditions.statevars[layout->statevar_names[i]] = condition_values[i];
+    }
+    for ( std::size_t i = 0; i < layout->xfrac_names.size(); ++i ) {
+        result.conditions.xfrac[layout->xfrac_names[i]] = condition_values[statevar_count + i];
+    }
+    result.conditions.elements = layout->elements;
+    for ( std::size_t i = 0; i < layout->phase_names.size(); ++i ) {
+        result.conditions.phases[layout->phase_names[i]] = layout->phase_statuses[i];
+    }
+    return result;
+}
+
+ResultCheckpoint::ResultCheckpoint ( const std::string &path, const std::uint64_t key, const std::size_t flush_interval ) :
+    path ( path ), key ( key ), flush_interval ( std::max ( flush_interval, std::size_t ( 1 ) ) ), started ( false )
+{
+    BOOST_LOG_NAMED_SCOPE ( "ResultCheckpoint::ResultCheckpoint" );
+    logger opto_log ( journal::keywords::channel = "optimizer" );
+    std::vector<std::string> chunks; // the complete chunks, in case the file has to be rewritten
+    bool torn = false;
+    try {
+        boost::interprocess::file_mapping file ( path.c_str(), boost::interprocess::read_only );
+        boost::interprocess::mapped_region region ( file, boost::interprocess::read_only );
+        const char* const data = static_cast<const char*> ( region.get_address() );
+        ASTReader reader ( data, data + region.get_size() );
+        if ( reader.read_string() != checkpoint_format || static_cast<std::uint64_t> ( reader.read_integer() ) != key ) {
+            BOOST_LOG_SEV ( opto_log, debug ) << path << " belongs to another calculation; starting over";
+        }
+        else {
+            started = true;
+            while ( !reader.at_end() ) {
+                try {
+                    std::string payload = reader.read_string();
+                    const std::uint64_t hash = static_cast<std::uint64_t> ( reader.read_integer() );
+                    ASTWriter check;
+                    check.write ( payload );
+                    if ( check.hash() != hash ) {
+                        BOOST_THROW_EXCEPTION ( malformed_object_error() << str_errinfo ( "Checkpoint chunk does not match its hash" ) );
+                    }
+                    std::unordered_map<std::size_t,CheckpointedResult> chunk_points;
+                    read_chunk ( payload, chunk_points, layouts );
+                    for ( auto i = chunk_points.begin(); i != chunk_points.end(); ++i ) {
+                        restored_points[i->first] = std::move ( i->second ); // a later chunk has the later result of a point
+                    }
+                    chunks.push_back ( std::move ( payload ) );
+                }
+                catch ( boost::exception &e ) {
+                    // Most likely the process writing it died; everything from here on is dropped
+                    BOOST_LOG_SEV ( opto_log, debug ) << path << " ends in an incomplete chunk: " << boost::diagnostic_information ( e );
+                    torn = true;
+                    break;
+                }
+            }
+        }
+    }
+    catch ( boost::interprocess::interprocess_exception & ) {
+        // No checkpoint yet
+    }
+    catch ( boost::exception &e ) {
+        BOOST_LOG_SEV ( opto_log, debug ) << path << " could not be read: " << boost::diagnostic_information ( e );
+    }
+    // Appending after an incomplete chunk would hide everything appended, so the file is rewritten without it
+    if ( !started || torn ) started = start_file ( chunks );
+    BOOST_LOG_SEV ( opto_log, debug ) << "restored " << restored_points.size() << " points from " << path;
+}
+
+ResultCheckpoint::~ResultCheckpoint()
+{
+    try {
+        flush();
+    }
+    catch ( ... ) {
+        // Nothing can be done about it here; the points are calculated again on the next run
+    }
+}
+
+bool ResultCheckpoint::start_file ( const std::vector<std::string> &chunks )
+{
+    ASTWriter header;
+    header.write ( checkpoint_format );
+    header.write_integer ( static_cast<std::int64_t> ( key ) );
+    // As CompiledSystem does with its cache files: write to a temporary file and move it into place
+    std::stringstream temp_path;
+    temp_path << path << "." << std::hex << std::random_device()() << ".tmp";
+    std::ofstream out ( temp_path.str().c_str(), std::ios::binary );
+    out.write ( header.data().data(), header.data().size() );
+    for ( auto i = chunks.cbegin(); i != chunks.cend(); ++i ) {
+        const std::string framed = frame ( *i );
+        out.write ( framed.data(), framed.size() );
+    }
+    out.close();
+    if ( !out || std::rename ( temp_path.str().c_str(), path.c_str() ) != 0 ) {
+        std::remove ( temp_path.str().c_str() );
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const CheckpointLayout> ResultCheckpoint::layout_of ( const EquilibriumResult<double> &result )
+{
+    CheckpointLayout layout;
+    layout.variable_names = keys_of ( result.variables );
+    layout.constraint_names = keys_of ( result.constraint_multipliers );
+    layout.statevar_names = keys_of ( result.conditions.statevars );
+    layout.xfrac_names = keys_of ( result.conditions.xfrac );
+    layout.elements = result.conditions.elements;
+    for ( auto i = result.phases.cbegin(); i != result.phases.cend(); ++i ) {
+        layout.phase_names.push_back ( i->first );
+        layout.phase_statuses.push_back ( i->second.status );
+        layout.phase_fractions.push_back ( std::distance ( result.variables.cbegin(), result.variables.find ( i->first + "_FRAC" ) ) );
+    }
+    for ( auto i = layouts.begin(); i != layouts.end(); ++i ) {
+        const CheckpointLayout &known = **i;
+        if ( known.variable_names == layout.variable_names && known.constraint_names == layout.constraint_names
+                && known.statevar_names == layout.statevar_names && known.xfrac_names == layout.xfrac_names
+                && known.elements == layout.elements && known.phase_names == layout.phase_names
+                && known.phase_statuses == layout.phase_statuses ) {
+            layouts.splice ( layouts.begin(), layouts, i );
+            return layouts.front();
+        }
+    }
+    layouts.push_front ( std::make_shared<const CheckpointLayout> ( std::move ( layout ) ) );
+    return layouts.front();
+}
+
+void ResultCheckpoint::add ( const std::size_t point, const EquilibriumResult<double> &result, const double energy )
+{
+    CheckpointedResult solved;
+    solved.point = point;
+    solved.walltime = result.walltime;
+    solved.itercount = result.itercount;
+    solved.N = result.N;
+    solved.energy = energy;
+    append_values ( result.variables, solved.x );
+    append_values ( result.lower_multipliers, solved.lower_multipliers );
+    append_values ( result.upper_multipliers, solved.upper_multipliers );
+    append_values ( result.constraint_multipliers, solved.constraint_multipliers );
+    append_values ( result.conditions.statevars, solved.condition_values );
+    append_values ( result.conditions.xfrac, solved.condition_values );
+    // Without a warm start, Ipopt leaves no bound multipliers
+    solved.lower_multipliers.resize ( solved.x.size(), 0.0 );
+    solved.upper_multipliers.resize ( solved.x.size(), 0.0 );
+    std::lock_guard<std::mutex> lock ( mutex );
+    solved.layout = layout_of ( result );
+    pending.push_back ( std::move ( solved ) );
+    if ( pending.size() >= flush_interval ) flush_pending();
+}
+
+void ResultCheckpoint::add_failure ( const std::size_t point, const std::string &message )
+{
+    CheckpointedResult failed;
+    failed.point = point;
+    failed.error = message;
+    std::lock_guard<std::mutex> lock ( mutex );
+    pending.push_back ( std::move ( failed ) );
+    if ( pending.size() >= flush_interval ) flush_pending();
+}
+
+bool ResultCheckpoint::flush()
+{
+    std::lock_guard<std::mutex> lock ( mutex );
+    return flush_pending();
+}
+
+bool ResultCheckpoint::flush_pending()
+{
+    BOOST_LOG_NAMED_SCOPE ( "ResultCheckpoint::flush" );
+    logger opto_log ( journal::keywords::channel = "optimizer" );
+    if ( pending.empty() ) return true;
+    if ( !started && !( started = start_file ( std::vector<std::string>() ) ) ) {
+        BOOST_LOG_SEV ( opto_log, debug ) << "could not write " << path;
+        return false;
+    }
+    // The layouts of this chunk, numbered in order of first use
+    std::vector<const CheckpointLayout*> chunk_layouts;
+    std::unordered_map<const CheckpointLayout*,std::size_t> layout_indices;
+    for ( auto i = pending.cbegin(); i != pending.cend(); ++i ) {
+        if ( i->layout && layout_indices.emplace ( i->layout.get(), chunk_layouts.size() ).second ) {
+            chunk_layouts.push_back ( i->layout.get() );
+        }
+    }
+    ASTWriter chunk;
+    chunk.write_size ( chunk_layouts.size() );
+    for ( auto i = chunk_layouts.cbegin(); i != chunk_layouts.cend(); ++i ) {
+        const CheckpointLayout &layout = **i;
+        write_names ( chunk, layout.variable_names );
+        write_names ( chunk, layout.constraint_names );
+        chunk.write_size ( layout.statevar_names.size() );
+        for ( auto j = layout.statevar_names.cbegin(); j != layout.statevar_names.cend(); ++j ) chunk.write_integer ( *j );
+        write_names ( chunk, layout.xfrac_names );
+        write_names ( chunk, layout.elements );
+        write_names ( chunk, layout.phase_names );
+        for ( auto j = layout.phase_statuses.cbegin(); j != layout.phase_statuses.cend(); ++j ) {
+            chunk.write_integer ( static_cast<std::int64_t> ( *j ) );
+        }
+    }
+    chunk.write_size ( pending.size() );
+    for ( auto i = pending.cbegin(); i != pending.cend(); ++i ) {
+        chunk.write_size ( i->point );
+        if ( !i->layout ) {
+            chunk.write_integer ( FAILED_POINT );
+            chunk.write ( i->error );
+            continue;
+        }
+        chunk.write_integer ( SOLVED_POINT );
+        chunk.write_size ( layout_indices.at ( i->layout.get() ) );
+        chunk.write ( i->walltime );
+        chunk.write_integer ( i->itercount );
+        chunk.write ( i->N );
+        chunk.write ( i->energy );
+        write_values ( chunk, i->x );
+        write_values ( chunk, i->lower_multipliers );
+        write_values ( chunk, i->upper_multipliers );
+        write_values ( chunk, i->constraint_multipliers );
+        write_values ( chunk, i->condition_values );
+    }
+    const std::string framed = frame ( chunk.data() );
+    std::ofstream out ( path.c_str(), std::ios::binary | std::ios::app );
+    out.write ( framed.data(), framed.size() );
+    out.close();
+    if ( !out ) {
+        // The points stay pending for the next flush. If part of the chunk was written, the file is read
+        // up to that point, and the points after it are calculated again
+        BOOST_LOG_SEV ( opto_log, debug ) << "could not append to " << path;
+        return false;
+    }
+    BOOST_LOG_SEV ( opto_log, debug ) << "wrote " << pending.size() << " points to " << path;
+    pending.clear();
+    return true;
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,215 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Chemical potentials and thermal properties of compact equilibrium results, in batches
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/result_properties.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace Optimizer {
+
+namespace {
+const double temperature_step = 1e-4; // of the central differences in T, relative to T
+const double minimum_phase_fraction = 1e-6; // for the chemical potentials of the system
+
+bool vacancy_only(const SublatticeLayout &layout, const std::size_t sublattice)
+{
+	return layout.species_count(sublattice) == 1 && layout.species(layout.sublattice_begin(sublattice)) == "VA";
+}
+
+// Coordinate of species in sublattice, or sublattice_end(sublattice) if it is not there
+std::size_t coordinate_of(const SublatticeLayout &layout, const std::size_t sublattice, const std::string &species)
+{
+	std::size_t coordinate = layout.sublattice_begin(sublattice);
+	while (coordinate != layout.sublattice_end(sublattice) && layout.species(coordinate) != species) ++coordinate;
+	return coordinate;
+}
+
+// Is species in every sublattice, except those with only vacancies?
+bool occupies_all_sublattices(const SublatticeLayout &layout, const std::string &species)
+{
+	for (std::size_t sublattice = 0; sublattice < layout.sublattice_count(); ++sublattice) {
+		if (vacancy_only(layout, sublattice)) continue;
+		if (coordinate_of(layout, sublattice, species) == layout.sublattice_end(sublattice)) return false;
+	}
+	return true;
+}
+
+// Chemical potential of a species which occupies all sublattices, from the energy and gradient at x
+double direct_chemical_potential(const SublatticeLayout &layout, const double energy, const double *x,
+		const double *gradient, const std::string &species)
+{
+	double mu = energy;
+	for (std::size_t coordinate = 0; coordinate < layout.coordinate_count(); ++coordinate) {
+		if (layout.species(coordinate) == "VA") continue;
+		mu -= x[coordinate] * gradient[coordinate];
+		if (layout.species(coordinate) == species) mu += gradient[coordinate];
+	}
+	return mu;
+}
+
+// As Phase::chemical_potential(), for all elements at once
+void chemical_potentials(const SublatticeLayout &layout, const std::vector<std::string> &elements, const double energy,
+		const double *x, const double *gradient, std::vector<double> &out)
+{
+	out.assign(elements.size(), std::numeric_limits<double>::quiet_NaN());
+	double total_sites = 0;
+	for (std::size_t sublattice = 0; sublattice < layout.sublattice_count(); ++sublattice) {
+		if (!vacancy_only(layout, sublattice)) total_sites += layout.sites(sublattice);
+	}
+	// Species which are not in every sublattice are measured against the first element which is
+	const auto reference = std::find_if(elements.begin(), elements.end(),
+			[&layout](const std::string &element) { return occupies_all_sublattices(layout, element); });
+	double reference_mu = std::numeric_limits<double>::quiet_NaN();
+	if (reference != elements.end()) {
+		reference_mu = (*reference == "VA") ? 0 : direct_chemical_potential(layout, energy, x, gradient, *reference);
+	}
+	for (std::size_t i = 0; i < elements.size(); ++i) {
+		const std::string &element = elements[i];
+		if (element == "VA") {
+			out[i] = 0; // chemical potential of vacancy is defined to be zero
+		}
+		else if (occupies_all_sublattices(layout, element)) {
+			out[i] = direct_chemical_potential(layout, energy, x, gradient, element);
+		}
+		else if (reference != elements.end()) {
+			for (std::size_t sublattice = 0; sublattice < layout.sublattice_count(); ++sublattice) {
+				const std::size_t coordinate = coordinate_of(layout, sublattice, element);
+				if (coordinate == layout.sublattice_end(sublattice)) continue;
+				const std::size_t reference_coordinate = coordinate_of(layout, sublattice, *reference);
+				if (reference_coordinate != layout.sublattice_end(sublattice)) {
+					out[i] = (total_sites / layout.sites(sublattice)) * (gradient[coordinate] - gradient[reference_coordinate])
+						+ reference_mu;
+				}
+				break;
+			}
+		}
+	}
+}
+
+// Bindings and scratch space for the phases of one descriptor, reused while the state variables stay the same
+class PropertyEvaluator {
+public:
+	explicit PropertyEvaluator(const ResultDescriptor &descriptor) : descriptor(descriptor), T(0), dT(0), bound(false) {
+		phases.resize(descriptor.phases().size());
+		for (std::size_t i = 0; i < phases.size(); ++i) {
+			const CompositionSet &compositionset = descriptor.phases()[i].compositionset;
+			phases[i].workspace = compositionset.jet_workspace(false);
+			phases[i].x.resize(compositionset.get_variable_map().size());
+			phases[i].gradient.resize(compositionset.get_variable_map().size());
+		}
+	}
+	ResultProperties evaluate(const CompactEquilibriumResult &result) {
+		const evalconditions conds = result.conditions();
+		if (!bound || conds.statevars != statevars) bind(conds);
+		ResultProperties properties;
+		properties.energy = properties.enthalpy = properties.entropy = properties.heat_capacity = 0;
+		properties.chemical_potentials.assign(descriptor.elements().size(), std::numeric_limits<double>::quiet_NaN());
+		properties.phases.resize(phases.size());
+		for (std::size_t i = 0; i < phases.size(); ++i) {
+			const ResultDescriptor::PhaseEntry &entry = descriptor.phases()[i];
+			const SublatticeLayout &layout = entry.compositionset.sublattice_layout();
+			PhaseScratch &scratch = phases[i];
+			PhaseProperties &phase = properties.phases[i];
+			for (std::size_t coordinate = 0; coordinate < entry.coordinates.size(); ++coordinate) {
+				scratch.x[coordinate] = result.x[entry.coordinates[coordinate]];
+			}
+			phase.energy = entry.compositionset.evaluate_internal_objective_gradient(scratch.binding, scratch.x.data(),
+					scratch.gradient.data(), scratch.workspace);
+			const double lower = entry.compositionset.evaluate_objective(scratch.lower, scratch.x.data());
+			const double upper = entry.compositionset.evaluate_objective(scratch.upper, scratch.x.data());
+			phase.entropy = -(upper - lower) / (2 * dT);
+			phase.enthalpy = phase.energy + T * phase.entropy;
+			phase.heat_capacity = -T * (upper - 2 * phase.energy + lower) / (dT * dT);
+			chemical_potentials(layout, descriptor.elements(), phase.energy, scratch.x.data(), scratch.gradient.data(),
+					phase.chemical_potentials);
+
+			const double phasefrac = result.x[entry.phase_fraction];
+			properties.energy += phasefrac * phase.energy;
+			properties.enthalpy += phasefrac * phase.enthalpy;
+			properties.entropy += phasefrac * phase.entropy;
+			properties.heat_capacity += phasefrac * phase.heat_capacity;
+			if (phasefrac <= minimum_phase_fraction) continue;
+			for (std::size_t j = 0; j < phase.chemical_potentials.size(); ++j) {
+				if (!std::isnan(phase.chemical_potentials[j])) properties.chemical_potentials[j] = phase.chemical_potentials[j];
+			}
+		}
+		return properties;
+	}
+private:
+	struct PhaseScratch {
+		CompiledBinding lower, binding, upper; // at T-dT, T and T+dT
+		CompiledJet workspace;
+		std::vector<double> x; // site fractions, by the phase's variable map
+		std::vector<double> gradient;
+	};
+	void bind(const evalconditions &conds) {
+		const auto T_find = conds.statevars.find('T');
+		if (T_find == conds.statevars.end()) {
+			BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("Temperature is not a condition of the equilibrium result") << specific_errinfo("T"));
+		}
+		T = T_find->second;
+		dT = temperature_step * T;
+		evalconditions shifted = conds;
+		for (std::size_t i = 0; i < phases.size(); ++i) {
+			const CompositionSet &compositionset = descriptor.phases()[i].compositionset;
+			const boost::bimap<std::string, int> &phase_variables = compositionset.get_variable_map();
+			shifted.statevars['T'] = T - dT;
+			phases[i].lower = compositionset.bind(shifted, phase_variables);
+			shifted.statevars['T'] = T + dT;
+			phases[i].upper = compositionset.bind(shifted, phase_variables);
+			phases[i].binding = compositionset.bind(conds, phase_variables);
+		}
+		statevars = conds.statevars;
+		bound = true;
+	}
+	const ResultDescriptor &descriptor;
+	std::vector<PhaseScratch> phases;
+	std::map<char,double> statevars; // of the current bindings
+	double T, dT;
+	bool bound;
+};
+}
+
+ResultProperties evaluate_properties(const CompactEquilibriumResult &result)
+{
+	PropertyEvaluator evaluator(*result.descriptor);
+	return evaluator.evaluate(result);
+}
+
+std::vector<ResultProperties> evaluate_properties(const std::vector<CompactEquilibriumResult> &results)
+{
+	// Visit the results grouped by descriptor, then by state variables, so that bindings are reused
+	std::vector<std::size_t> order(results.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&results](const std::size_t a, const std::size_t b) {
+		const CompactEquilibriumResult &left = results[a];
+		const CompactEquilibriumResult &right = results[b];
+		if (left.descriptor != right.descriptor) return left.descriptor < right.descriptor;
+		const std::size_t statevar_count = left.descriptor->statevar_names().size();
+		return std::lexicographical_compare(left.condition_values.begin(), left.condition_values.begin() + statevar_count,
+				right.condition_values.begin(), right.condition_values.begin() + statevar_count);
+	});
+	std::vector<ResultProperties> properties(results.size());
+	std::unique_ptr<PropertyEvaluator> evaluator;
+	const ResultDescriptor *current = nullptr;
+	for (auto i = order.cbegin(); i != order.cend(); ++i) {
+		const CompactEquilibriumResult &result = results[*i];
+		if (result.descriptor.get() != current) {
+			current = result.descriptor.get();
+			evaluator.reset(new PropertyEvaluator(*current));
+		}
+		properties[*i] = evaluator->evaluate(result);
+	}
+	return properties;
+}
+}
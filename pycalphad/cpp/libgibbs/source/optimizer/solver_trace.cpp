@@ -0,0 +1,64 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Per-iteration telemetry of an equilibrium solve, and rules to stop it early
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/solver_trace.hpp"
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace Optimizer {
+
+void SolverTrace::add ( const SolverIteration &values, const std::vector<double> &fractions, const std::vector<double> &energies )
+{
+    iteration_values.push_back ( values );
+    for ( std::size_t phase = 0; phase < phase_names.size(); ++phase ) {
+        phase_values.push_back ( fractions[phase] );
+        phase_values.push_back ( energies[phase] );
+    }
+}
+
+std::string SolverTrace::print() const
+{
+    std::stringstream output;
+    output << "iter    objective    inf_pr   inf_du lg(mu)  ||d||  alpha_du alpha_pr  ls  eval secs  total secs" << std::endl;
+    for ( auto i = iteration_values.cbegin(); i != iteration_values.cend(); ++i ) {
+        output << std::setw ( 4 ) << i->iteration << ( i->restoration ? "r" : " " )
+               << std::scientific << std::setprecision ( 7 ) << std::setw ( 14 ) << i->objective
+               << std::setprecision ( 2 ) << std::setw ( 9 ) << i->primal_infeasibility << std::setw ( 9 ) << i->dual_infeasibility
+               << std::fixed << std::setprecision ( 1 ) << std::setw ( 6 ) << ( i->barrier > 0 ? std::log10 ( i->barrier ) : 0 )
+               << std::scientific << std::setprecision ( 2 ) << std::setw ( 9 ) << i->step_norm
+               << std::setw ( 9 ) << i->dual_step << std::setw ( 9 ) << i->primal_step
+               << std::setw ( 4 ) << i->line_search_trials
+               << std::setw ( 11 ) << i->callback_seconds << std::setw ( 12 ) << i->elapsed_seconds << std::endl;
+    }
+    return output.str();
+}
+
+StoppingRule stop_when_stable ( const double energy_tolerance, const std::size_t iterations,
+                                const double max_infeasibility, const double minimum_fraction )
+{
+    return [=] ( const SolverTrace &trace ) {
+        if ( trace.size() <= iterations ) return false;
+        const std::size_t last = trace.size() - 1;
+        for ( std::size_t iter = last - iterations; iter <= last; ++iter ) {
+            if ( trace.iterations() [iter].primal_infeasibility > max_infeasibility ) return false;
+        }
+        for ( std::size_t phase = 0; phase < trace.phases().size(); ++phase ) {
+            const bool stable = trace.phase_fraction ( last, phase ) > minimum_fraction;
+            for ( std::size_t iter = last - iterations; iter < last; ++iter ) {
+                if ( ( trace.phase_fraction ( iter, phase ) > minimum_fraction ) != stable ) return false;
+                if ( stable && std::fabs ( trace.phase_energy ( iter, phase ) - trace.phase_energy ( last, phase ) ) >= energy_tolerance ) return false;
+            }
+        }
+        return true;
+    };
+}
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
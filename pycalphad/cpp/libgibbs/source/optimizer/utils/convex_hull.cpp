@@ -5,163 +5,232 @@
  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
  =============================================================================*/
 
-// Calculate convex hull using Qhull / libqhullcpp
+// Calculate the internal lower convex hull of a phase
 
 #include "libgibbs/include/libgibbs_pch.hpp"
 #include "libgibbs/include/optimizer/utils/convex_hull.hpp"
-#include <libqhullcpp/RboxPoints.h>
-#include <libqhullcpp/QhullError.h>
-#include <libqhullcpp/QhullQh.h>
-#include <libqhullcpp/QhullFacet.h>
-#include <libqhullcpp/QhullFacetList.h>
-#include <libqhullcpp/QhullHyperplane.h>
-#include <libqhullcpp/QhullLinkedList.h>
-#include <libqhullcpp/QhullPoint.h>
-#include <libqhullcpp/QhullVertex.h>
-#include <libqhullcpp/QhullVertexSet.h>
-#include <libqhullcpp/Qhull.h>
+#include "libgibbs/include/optimizer/utils/lower_convex_hull.hpp"
 #include <boost/assert.hpp>
 #include <string>
 #include <sstream>
 #include <algorithm>
 #include <functional>
 #include <cmath>
-
-using orgQhull::RboxPoints;
-using orgQhull::Qhull;
-using orgQhull::QhullError;
-using orgQhull::QhullFacet;
-using orgQhull::QhullFacetList;
-using orgQhull::QhullPoint;
-using orgQhull::QhullQh;
-using orgQhull::RboxPoints;
-using orgQhull::QhullVertex;
-using orgQhull::QhullVertexSet;
+#include <limits>
+#include <map>
 
 namespace Optimizer { namespace details {
+    // Reference hulls are only built when the composition domain has at most this many vertices
+    constexpr const std::size_t max_reference_vertices = 4096;
+
+    std::vector<std::size_t> cull_above_reference_hull (
+                             const PointCloud<double> &points,
+                             const std::set<std::size_t> &dependent_dimensions,
+                             const double tolerance
+                           ) {
+        const double vertex_tolerance = 1e-9; // end-members are sampled a little inside the domain
+        std::vector<std::size_t> kept ( points.size() );
+        for ( std::size_t point_id = 0; point_id < points.size(); ++point_id ) kept[point_id] = point_id;
+        const std::size_t point_dimension = points.dimension();
+        if ( points.empty() || point_dimension < 2 ) return kept;
+        const std::size_t coordinate_count = point_dimension-1; // the last coordinate is the energy
+        // Each dependent dimension closes a group of coordinates that sum to 1; a vertex of the
+        // composition domain has one coordinate at 1 in every group
+        std::vector<std::pair<std::size_t,std::size_t>> groups; // [first, last]
+        std::size_t domain_vertices = 1;
+        std::size_t group_begin = 0;
+        for ( auto dim = dependent_dimensions.cbegin(); dim != dependent_dimensions.cend(); ++dim ) {
+            if ( *dim >= coordinate_count || *dim < group_begin ) return kept;
+            groups.emplace_back ( group_begin, *dim );
+            domain_vertices *= *dim - group_begin + 1;
+            if ( domain_vertices > max_reference_vertices ) return kept;
+            group_begin = *dim + 1;
+        }
+        if ( group_begin != coordinate_count ) return kept;
+
+        // The lowest point at every vertex of the domain
+        std::map<std::vector<std::size_t>,std::size_t> vertex_minima;
+        std::vector<std::size_t> key ( groups.size() );
+        for ( std::size_t point_id = 0; point_id < points.size(); ++point_id ) {
+            double const* const pt = points[point_id];
+            bool is_vertex = true;
+            for ( std::size_t group = 0; group < groups.size() && is_vertex; ++group ) {
+                is_vertex = false;
+                for ( std::size_t coord = groups[group].first; coord <= groups[group].second; ++coord ) {
+                    if ( pt[coord] >= 1 - vertex_tolerance ) {
+                        key[group] = coord;
+                        is_vertex = true;
+                        break;
+                    }
+                }
+            }
+            if ( !is_vertex ) continue;
+            auto minimum = vertex_minima.find ( key );
+            if ( minimum == vertex_minima.end() ) {
+                vertex_minima.emplace ( key, point_id );
+            }
+            else if ( pt[coordinate_count] < points[minimum->second][coordinate_count] ) {
+                minimum->second = point_id;
+            }
+        }
+        if ( vertex_minima.size() < domain_vertices ) return kept; // the reference would not cover the domain
+
+        // Every composition is a convex combination of the vertices, so a point above their lower hull
+        // is above a point of the full hull and is never one of its vertices
+        PointCloud<double> vertex_points ( point_dimension );
+        for ( auto minimum = vertex_minima.cbegin(); minimum != vertex_minima.cend(); ++minimum ) {
+            vertex_points.push_back ( points[minimum->second] );
+        }
+        LowerConvexHull reference ( point_dimension, dependent_dimensions );
+        reference.add_points ( vertex_points );
+        if ( !reference.full_dimensional() ) return kept;
+        const std::vector<LowerConvexHull::Facet> facets = reference.lower_facets();
+        if ( facets.empty() ) return kept;
+        std::vector<std::size_t> kept_coordinates; // the reduced coordinates of the hull, without the energy
+        for ( std::size_t coord = 0; coord < coordinate_count; ++coord ) {
+            if ( dependent_dimensions.find ( coord ) == dependent_dimensions.end() ) kept_coordinates.push_back ( coord );
+        }
+
+        std::vector<std::size_t> culled;
+        culled.reserve ( points.size() );
+        for ( std::size_t point_id = 0; point_id < points.size(); ++point_id ) {
+            double const* const pt = points[point_id];
+            // The lower hull is convex, so its height is the largest of its facet planes
+            double height = -std::numeric_limits<double>::infinity();
+            for ( const auto &facet : facets ) {
+                double plane = facet.offset;
+                for ( std::size_t dim = 0; dim < kept_coordinates.size(); ++dim ) {
+                    plane += facet.normal[dim] * pt[kept_coordinates[dim]];
+                }
+                height = std::max ( height, -plane / facet.normal.back() );
+            }
+            if ( pt[coordinate_count] - height <= tolerance * std::max ( 1.0, std::fabs ( height ) ) ) {
+                culled.push_back ( point_id );
+            }
+        }
+        // Fall back to every point if too few remain to span the space
+        if ( culled.size() <= kept_coordinates.size() ) return kept;
+        return culled;
+    }
+
+    PointCloud<double> internal_lower_convex_hull (
+                             const PointCloud<double> &points,
+                             const std::set<std::size_t> &dependent_dimensions,
+                             const double critical_edge_length,
+                             std::function<double(const std::vector<double>&)> calculate_objective
+                           ) {
+        BOOST_ASSERT(points.size() > 0);
+        LowerConvexHull hull ( points.dimension(), dependent_dimensions );
+        const std::vector<std::size_t> kept = cull_above_reference_hull ( points, dependent_dimensions, reference_hull_tolerance );
+        if ( kept.size() == points.size() ) {
+            return internal_lower_convex_hull ( hull, points, dependent_dimensions, critical_edge_length, calculate_objective );
+        }
+        PointCloud<double> kept_points ( points.dimension() );
+        kept_points.reserve ( kept.size() );
+        for ( const std::size_t point_id : kept ) kept_points.push_back ( points[point_id] );
+        return internal_lower_convex_hull ( hull, kept_points, dependent_dimensions, critical_edge_length, calculate_objective );
+    }
+
     // Modified QuickHull algorithm using d-dimensional Beneath-Beyond
     // Reference: N. Perevoshchikova, et al., 2012, Computational Materials Science.
     // "A convex hull algorithm for a grid minimization of Gibbs energy as initial step 
     //    in equilibrium calculations in two-phase multicomponent alloys"
-    std::vector<std::vector<double>> internal_lower_convex_hull (
-                             const std::vector<std::vector<double>> &points,
+    PointCloud<double> internal_lower_convex_hull (
+                             LowerConvexHull &hull,
+                             const PointCloud<double> &new_points,
                              const std::set<std::size_t> &dependent_dimensions,
                              const double critical_edge_length,
                              std::function<double(const std::vector<double>&)> calculate_objective
                            ) {
-        BOOST_ASSERT(points.size() > 0);
         BOOST_ASSERT(critical_edge_length > 0);
+        BOOST_ASSERT(new_points.dimension() == hull.dimension() + dependent_dimensions.size());
         const double coplanarity_allowance = 0.001; // max energy difference (%/100) to still be on tie plane
-        const std::size_t point_dimension = points.begin()->size();
-        const std::size_t point_count = points.size();
-        std::vector<std::vector<double>> candidate_points, final_points; // vertices of tie hyperplanes
-        RboxPoints point_buffer;
-        //std::cout << "point_dimension: " << point_dimension << std::endl;
-        //std::cout << "point_count: " << point_count << std::endl;
-        point_buffer.setDimension ( point_dimension );
-        point_buffer.reserveCoordinates ( point_count );
-        std::string Qhullcommand = "Qt ";
+        // Only the facets affected by the new points are recalculated
+        hull.add_points ( new_points );
+        const std::size_t point_dimension = hull.dimension() + dependent_dimensions.size();
+        const std::size_t point_count = hull.point_count();
+        BOOST_ASSERT(point_count > 0);
+        std::vector<std::vector<double>> candidate_points; // vertices of tie hyperplanes
+        PointCloud<double> final_points ( point_dimension-1 );
         if (point_count == 1) { // Special case: No composition dependence
-            auto return_point = restore_dependent_dimensions ( points.front(), dependent_dimensions );
-            final_points.emplace_back ( std::move ( return_point ) );
+            final_points.push_back ( restore_dependent_dimensions ( hull.point ( 0 ), dependent_dimensions ) );
             return final_points;
         }
-        if (point_count <= point_dimension) { // Degenerate case: too few points to construct hull
+        if (point_count <= point_dimension || !hull.full_dimensional()) { // Degenerate case: too few points to construct hull
             // Return all points
-            for (auto pt : points) {
-                final_points.emplace_back ( restore_dependent_dimensions (pt, dependent_dimensions ) );
+            final_points.reserve ( point_count );
+            for (std::size_t point_id = 0; point_id < point_count; ++point_id) {
+                final_points.push_back ( restore_dependent_dimensions ( hull.point ( point_id ), dependent_dimensions ) );
             }
             return final_points;
         }
-        // Copy all of the points into a buffer compatible with Qhull
-        for (auto pt : points) {
-            point_buffer.append ( QhullPoint ( point_dimension, &pt[0] ) );
-        }
-        //std::cout << "point_buffer.size() = " << point_buffer.size() << std::endl;
-        
-        // Mark dependent dimensions for Qhull so they can be discarded
-        for (auto dim : dependent_dimensions) {
-            std::stringstream stream;
-            // Qhull command "Qbk:0Bk:0" drops dimension k from consideration
-            stream << " " << "Qb" << dim << ":0B" << dim << ":0";
-            Qhullcommand += stream.str();
-        }
-        //std::cout << "DEBUG: Qhullcommand: " << Qhullcommand.c_str() << std::endl;
-        // Make the call to Qhull
-        Qhull qhull ( point_buffer, Qhullcommand.c_str() );
-        // Get all of the facets
-        QhullFacetList facets = qhull.facetList();
+        // Get all of the facets of the lower convex hull
+        // Vertex coordinates are reduced: the dependent dimensions are dropped
+        const std::vector<LowerConvexHull::Facet> facets = hull.lower_facets();
         for (auto facet : facets) {
-            if (facet.isDefined() && facet.isGood() /*&& facet.isSimplicial()*/) {
-                double orientation = *(facet.hyperplane().constEnd()-1); // last coordinate (energy)
-                if (orientation > 0) continue; // consider only the facets of the lower convex hull
-                // skip facets with no normal defined (these are duplicates for some reason)
-                if ( std::distance( facet.hyperplane().begin(),facet.hyperplane().end() ) == 0 ) continue;
-                QhullVertexSet vertices = facet.vertices();
-                const std::size_t vertex_count = vertices.size();
-                
-                for ( auto vertex : facet.vertices() ) {
-                    candidate_points.push_back(restore_dependent_dimensions (vertex.point().toStdVector(), dependent_dimensions ));
-                }
-                
-                continue;
+            const std::size_t vertex_count = facet.vertices.size();
+            
+            for ( auto vertex : facet.vertices ) {
+                candidate_points.push_back(restore_dependent_dimensions (hull.reduced_point ( vertex ), dependent_dimensions ));
+            }
+            
+            continue;
 
-                // Only facets with edges beyond the critical length are candidate tie hyperplanes
-                // Check the length of all edges (dimension 1) in the facet
-                for (auto vertex1 = 0; vertex1 < vertex_count; ++vertex1) {
-                    std::vector<double> pt_vert1 = vertices[vertex1].point().toStdVector();
-                    const double vertex1_energy = pt_vert1.back();
-                    pt_vert1.pop_back(); // Remove the last coordinate (energy) for this check
-                    for (auto vertex2 = 0; vertex2 < vertex1; ++vertex2) {
-                        std::vector<double> pt_vert2 = vertices[vertex2].point().toStdVector();
-                        const double vertex2_energy = pt_vert2.back();
-                        pt_vert2.pop_back(); // Remove the last coordinate (energy) for this check
-                        std::vector<double> difference ( pt_vert2.size() );
-                        std::vector<double> midpoint ( pt_vert2.size() ); // midpoint of the edge
-                        std::transform (pt_vert2.begin(), pt_vert2.end(), 
-                                        pt_vert1.begin(), midpoint.begin(), std::plus<double>() );
-                        for (auto &coord : midpoint) coord /= 2;
-                        const double lever_rule_energy = (vertex1_energy + vertex2_energy)/2;
-                        midpoint.pop_back(); // remove energy coordinate
-                        midpoint = restore_dependent_dimensions ( midpoint, dependent_dimensions );
-                        const double true_energy = calculate_objective ( midpoint );
-                        // If the true energy is "much" greater, it's a true tie line
-                        /*DEBUG std::cout << "pt_vert1(" << vertices[vertex1].point().id() << "): ";
-                        for (auto &coord : pt_vert1) std::cout << coord << ",";
-                        std::cout << ":: ";
-                        std::cout << "pt_vert2(" << vertices[vertex2].point().id() << "): ";
-                        for (auto &coord : pt_vert2) std::cout << coord << ",";
-                        std::cout << ":: ";
-                        std::cout << "midpoint: ";
-                        for (auto &coord : midpoint) std::cout << coord << ",";
-                        std::cout << std::endl;
-                        std::cout << "true_energy: " << true_energy << " lever_rule_energy: " << lever_rule_energy << std::endl;*/
-                        // We use fabs() here so we don't accidentally flip the sign of the comparison
-                        if ( (true_energy-lever_rule_energy)/fabs(lever_rule_energy) < coplanarity_allowance ) {
-                            continue; // not a true tie line, skip it
-                        }
-                        
-                        double distance = 0;
-                        // Subtract vertex1 from vertex2 to get the distance
-                        std::transform (pt_vert2.begin(), pt_vert2.end(), 
-                                        pt_vert1.begin(), difference.begin(), std::minus<double>() );
-                        // Sum the square of all elements of vertex2-vertex1
-                        for (auto coord : difference) distance += std::pow(coord,2);
-                        // Square root the result
-                        distance = sqrt(distance);
-                        // if the edge length is large enough, this is a candidate tie hyperplane
-                        if (distance > critical_edge_length) {
-                          /*DEBUG std::cout << "Edge length: " << distance << std::endl;
-                          std::cout << "Vertex1: ";
-                          for (auto coord : pt_vert1) std::cout << coord << ",";
-                          std::cout << std::endl;
-                          std::cout << "Vertex2: ";
-                          for (auto coord : pt_vert2) std::cout << coord << ",";
-                          std::cout << std::endl;*/
-                          candidate_points.push_back(restore_dependent_dimensions (pt_vert1, dependent_dimensions ));
-                          candidate_points.push_back(restore_dependent_dimensions (pt_vert2, dependent_dimensions ));
-                          /*std::cout << facet;*/
-                        }
+            // Only facets with edges beyond the critical length are candidate tie hyperplanes
+            // Check the length of all edges (dimension 1) in the facet
+            for (auto vertex1 = 0; vertex1 < vertex_count; ++vertex1) {
+                std::vector<double> pt_vert1 = hull.reduced_point ( facet.vertices[vertex1] );
+                const double vertex1_energy = pt_vert1.back();
+                pt_vert1.pop_back(); // Remove the last coordinate (energy) for this check
+                for (auto vertex2 = 0; vertex2 < vertex1; ++vertex2) {
+                    std::vector<double> pt_vert2 = hull.reduced_point ( facet.vertices[vertex2] );
+                    const double vertex2_energy = pt_vert2.back();
+                    pt_vert2.pop_back(); // Remove the last coordinate (energy) for this check
+                    std::vector<double> difference ( pt_vert2.size() );
+                    std::vector<double> midpoint ( pt_vert2.size() ); // midpoint of the edge
+                    std::transform (pt_vert2.begin(), pt_vert2.end(), 
+                                    pt_vert1.begin(), midpoint.begin(), std::plus<double>() );
+                    for (auto &coord : midpoint) coord /= 2;
+                    const double lever_rule_energy = (vertex1_energy + vertex2_energy)/2;
+                    midpoint.pop_back(); // remove energy coordinate
+                    midpoint = restore_dependent_dimensions ( midpoint, dependent_dimensions );
+                    const double true_energy = calculate_objective ( midpoint );
+                    // If the true energy is "much" greater, it's a true tie line
+                    /*DEBUG std::cout << "pt_vert1(" << vertices[vertex1].point().id() << "): ";
+                    for (auto &coord : pt_vert1) std::cout << coord << ",";
+                    std::cout << ":: ";
+                    std::cout << "pt_vert2(" << vertices[vertex2].point().id() << "): ";
+                    for (auto &coord : pt_vert2) std::cout << coord << ",";
+                    std::cout << ":: ";
+                    std::cout << "midpoint: ";
+                    for (auto &coord : midpoint) std::cout << coord << ",";
+                    std::cout << std::endl;
+                    std::cout << "true_energy: " << true_energy << " lever_rule_energy: " << lever_rule_energy << std::endl;*/
+                    // We use fabs() here so we don't accidentally flip the sign of the comparison
+                    if ( (true_energy-lever_rule_energy)/fabs(lever_rule_energy) < coplanarity_allowance ) {
+                        continue; // not a true tie line, skip it
+                    }
+                    
+                    double distance = 0;
+                    // Subtract vertex1 from vertex2 to get the distance
+                    std::transform (pt_vert2.begin(), pt_vert2.end(), 
+                                    pt_vert1.begin(), difference.begin(), std::minus<double>() );
+                    // Sum the square of all elements of vertex2-vertex1
+                    for (auto coord : difference) distance += std::pow(coord,2);
+                    // Square root the result
+                    distance = sqrt(distance);
+                    // if the edge length is large enough, this is a candidate tie hyperplane
+                    if (distance > critical_edge_length) {
+                      /*DEBUG std::cout << "Edge length: " << distance << std::endl;
+                      std::cout << "Vertex1: ";
+                      for (auto coord : pt_vert1) std::cout << coord << ",";
+                      std::cout << std::endl;
+                      std::cout << "Vertex2: ";
+                      for (auto coord : pt_vert2) std::cout << coord << ",";
+                      std::cout << std::endl;*/
+                      candidate_points.push_back(restore_dependent_dimensions (pt_vert1, dependent_dimensions ));
+                      candidate_points.push_back(restore_dependent_dimensions (pt_vert2, dependent_dimensions ));
+                      /*std::cout << facet;*/
                     }
                 }
             }
@@ -194,24 +263,24 @@ namespace Optimizer { namespace details {
             }
             std::cout << "candidate_points.size() = " << candidate_points.size() << std::endl;*/
             // Second, restore the dependent variables to the correct coordinate placement
-            for (const auto pt : candidate_points) {
-                final_points.emplace_back ( restore_dependent_dimensions ( pt, dependent_dimensions ) );
+            final_points.reserve ( candidate_points.size() );
+            for (const auto &pt : candidate_points) {
+                final_points.push_back ( restore_dependent_dimensions ( pt, dependent_dimensions ) );
             }
         }
         else {
             // No tie hyperplanes have been found
             // Return the point with the lowest energy (last coordinate)
-            auto minimum_point_iterator = points.cbegin();
-            for (auto pt = points.cbegin(); pt != points.cend(); ++pt) {
+            std::size_t minimum_point_id = 0;
+            for (std::size_t point_id = 0; point_id < point_count; ++point_id) {
                 // Check the energy values
-                if (*(minimum_point_iterator->cend()-1) > *(pt->cend()-1)) {
+                if (hull.energy ( minimum_point_id ) > hull.energy ( point_id )) {
                     // This point is lower in energy
-                    minimum_point_iterator = pt;
+                    minimum_point_id = point_id;
                 }
             }
-            std::vector<double> return_point ( *minimum_point_iterator );
-            return_point.pop_back(); // Remove energy coordinate
-            final_points.emplace_back ( std::move ( return_point ) );
+            // Copy all but the energy coordinate
+            final_points.push_back ( hull.point ( minimum_point_id ).data() );
         }
         /*DEBUGstd::cout << "FINAL TIE POINTS" << std::endl;
         for (auto pt : final_points) {
@@ -5,23 +5,14 @@
  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
  =============================================================================*/
 
-// Calculate global convex hull using Qhull / libqhullcpp
+// Calculate the global lower convex hull of a system
 
 #include "libgibbs/include/libgibbs_pch.hpp"
 #include "libgibbs/include/optimizer/utils/convex_hull.hpp"
+#include "libgibbs/include/optimizer/utils/lower_convex_hull.hpp"
 #include "libgibbs/include/optimizer/utils/simplicial_facet.hpp"
 #include "libgibbs/include/utils/invert_matrix.hpp"
-#include <libqhullcpp/RboxPoints.h>
-#include <libqhullcpp/QhullError.h>
-#include <libqhullcpp/QhullQh.h>
-#include <libqhullcpp/QhullFacet.h>
-#include <libqhullcpp/QhullFacetList.h>
-#include <libqhullcpp/QhullHyperplane.h>
-#include <libqhullcpp/QhullLinkedList.h>
-#include <libqhullcpp/QhullPoint.h>
-#include <libqhullcpp/QhullVertex.h>
-#include <libqhullcpp/QhullVertexSet.h>
-#include <libqhullcpp/Qhull.h>
+#include "libtdb/include/exceptions.hpp"
 #include <boost/assert.hpp>
 #include <map>
 #include <set>
@@ -31,38 +22,61 @@
 #include <functional>
 #include <cmath>
 
-using orgQhull::RboxPoints;
-using orgQhull::Qhull;
-using orgQhull::QhullError;
-using orgQhull::QhullFacet;
-using orgQhull::QhullFacetList;
-using orgQhull::QhullPoint;
-using orgQhull::QhullQh;
-using orgQhull::RboxPoints;
-using orgQhull::QhullVertex;
-using orgQhull::QhullVertexSet;
-
 namespace Optimizer { namespace details {
+std::vector<SimplicialFacet<double>> global_lower_convex_hull (
+    const PointCloud<double> &points,
+    const double critical_edge_length,
+    const MidpointEnergyBatch calculate_midpoint_energies,
+    const bool filter_tie_facets
+) {
+    BOOST_ASSERT(points.size() > 0);
+    const std::size_t point_dimension = points.dimension();
+    BOOST_ASSERT(point_dimension >= 2);
+    // Remove dependent coordinate (second to last, energy should be last coordinate)
+    const std::set<std::size_t> dependent_dimensions { point_dimension-2 };
+    LowerConvexHull hull ( point_dimension, dependent_dimensions );
+    // Points above the plane through the lowest pure-component points are left out of the hull;
+    // the facets refer to point ids of the hull, which are mapped back to ids in points
+    const std::vector<std::size_t> kept = cull_above_reference_hull ( points, dependent_dimensions, reference_hull_tolerance );
+    if ( kept.size() == points.size() ) {
+        return global_lower_convex_hull ( hull, points, critical_edge_length, calculate_midpoint_energies, filter_tie_facets );
+    }
+    PointCloud<double> kept_points ( point_dimension );
+    kept_points.reserve ( kept.size() );
+    for ( const std::size_t point_id : kept ) kept_points.push_back ( points[point_id] );
+    auto kept_midpoint_energies = [&kept,&calculate_midpoint_energies] (
+        const std::vector<std::pair<std::size_t,std::size_t>> &edges, std::vector<double> &energies ) {
+        std::vector<std::pair<std::size_t,std::size_t>> point_edges;
+        point_edges.reserve ( edges.size() );
+        for ( const auto &edge : edges ) point_edges.emplace_back ( kept[edge.first], kept[edge.second] );
+        calculate_midpoint_energies ( point_edges, energies );
+    };
+    std::vector<SimplicialFacet<double>> facets = global_lower_convex_hull ( hull, kept_points, critical_edge_length,
+            kept_midpoint_energies, filter_tie_facets );
+    for ( auto &facet : facets ) {
+        for ( auto &vertex : facet.vertices ) vertex = kept[vertex];
+    }
+    return facets;
+}
+
 // Modified QuickHull algorithm using d-dimensional Beneath-Beyond
 // Reference: N. Perevoshchikova, et al., 2012, Computational Materials Science.
 // "A convex hull algorithm for a grid minimization of Gibbs energy as initial step 
 //    in equilibrium calculations in two-phase multicomponent alloys"
 std::vector<SimplicialFacet<double>> global_lower_convex_hull (
-    const std::vector<std::vector<double>> &points,
+    LowerConvexHull &hull,
+    const PointCloud<double> &new_points,
     const double critical_edge_length,
-    const std::function<double(const std::size_t, const std::size_t)> calculate_midpoint_energy
+    const MidpointEnergyBatch calculate_midpoint_energies,
+    const bool filter_tie_facets
 ) {
-    BOOST_ASSERT(points.size() > 0);
     BOOST_ASSERT(critical_edge_length > 0);
     const double coplanarity_allowance = 0.001; // max energy difference (%/100) to still be on tie plane
     std::vector<SimplicialFacet<double>> candidates;
-    const std::size_t point_dimension = points.begin()->size();
-    const std::size_t point_count = points.size();
-    std::set<std::size_t> candidate_point_ids; // vertices of tie hyperplanes
-    RboxPoints point_buffer;
-    point_buffer.setDimension ( point_dimension );
-    point_buffer.reserveCoordinates ( point_count );
-    std::string Qhullcommand = "Qt ";
+    // Only the facets affected by the new points are recalculated
+    hull.add_points ( new_points );
+    const std::size_t point_count = hull.point_count();
+    BOOST_ASSERT(point_count > 0);
     
     if (point_count == 1) { // Special case: No composition dependence
         SimplicialFacet<double> new_facet;
@@ -74,137 +88,81 @@ std::vector<SimplicialFacet<double>> global_lower_convex_hull (
         candidates.push_back ( new_facet );
         return candidates;
     }
-    // TODO: Handle degenerate case when point_count <= point_dimension
-    
-    // Copy all of the points into a buffer compatible with Qhull
-    for (auto pt : points) {
-        point_buffer.append ( QhullPoint ( point_dimension, &pt[0] ) );
+    // TODO: Handle degenerate case when the points do not span the composition space
+    if ( !hull.full_dimensional() ) {
+        BOOST_THROW_EXCEPTION ( internal_error() << str_errinfo ( "Global convex hull is degenerate" ) );
     }
     
-    // Mark last dimension as dependent for Qhull so it can be discarded
-    std::stringstream stream;
-    // Qhull command "Qbk:0Bk:0" drops dimension k from consideration
-    // Remove dependent coordinate (second to last, energy should be last coordinate)
-    stream << " " << "Qb" << point_dimension-2 << ":0B" << point_dimension-2 << ":0";
-    //  Degenerate simplex: delete energy coordinate to calculate hull
-    Qhullcommand += stream.str();
-
-    //DEBUG std::cout << "DEBUG: Qhullcommand: " << Qhullcommand.c_str() << std::endl;
-    // Make the call to Qhull
-    Qhull qhull ( point_buffer, Qhullcommand.c_str() );
-    // Get all of the facets
-    QhullFacetList facets = qhull.facetList();
+    // Get all of the facets of the lower convex hull
+    // Vertex coordinates are reduced: the dependent mole fraction is dropped
+    const std::vector<LowerConvexHull::Facet> facets = hull.lower_facets();
   
     for (auto facet : facets) {
-        bool already_added = false;
-        if (facet.isDefined() && facet.isGood() && facet.isSimplicial() ) {
-            double orientation = *(facet.hyperplane().constEnd()-1); // last coordinate (energy)
-            if (orientation > 0) continue; // consider only the facets of the lower convex hull.
-            // skip facets with no normal defined (these are duplicates for some reason)
-            if ( std::distance( facet.hyperplane().begin(),facet.hyperplane().end() ) == 0 ) continue;
-            QhullVertexSet vertices = facet.vertices();
-            const std::size_t vertex_count = vertices.size();
-            
-            SimplicialFacet<double> new_facet;
-            // fill basis matrix
-            new_facet.basis_matrix = SimplicialFacet<double>::MatrixType ( vertex_count, vertex_count );
-            for ( auto vertex = vertices.begin(); vertex != vertices.end(); ++vertex ) {
-                const std::size_t column_index = std::distance ( vertices.begin(), vertex );
-                new_facet.vertices.push_back ( vertex->point().id() );
-                auto end_coordinate = vertex->point().end()-1; // don't add energy coordinate
-                for ( auto coord = vertex->point().begin(); coord != end_coordinate; ++coord ) {
-                    const std::size_t row_index = std::distance ( vertex->point().begin(), coord );
-                    std::cout << "new_facet.basis_matrix(" << row_index << "," << column_index << ") = " << *coord << std::endl;
-                    new_facet.basis_matrix ( row_index, column_index ) = *coord;
-                }
-                std::cout << "new_facet.basis_matrix(" << vertex_count-1 << "," << column_index << ") = 1" << std::endl;
-                new_facet.basis_matrix ( vertex_count-1, column_index ) = 1; // last row is all 1's
-            }
-            //TODO: bool success = InvertMatrix ( new_facet.basis_matrix, new_facet.basis_matrix );
-            //if ( !success ) std::cout << "MATRIX INVERSION FAILED" << std::endl;
-            for ( const auto coord : facet.hyperplane() ) {
-                new_facet.normal.push_back ( coord );
+        const std::size_t vertex_count = facet.vertices.size();
+        
+        SimplicialFacet<double> new_facet;
+        // fill basis matrix
+        new_facet.basis_matrix = SimplicialFacet<double>::MatrixType ( vertex_count, vertex_count );
+        for ( auto vertex = facet.vertices.begin(); vertex != facet.vertices.end(); ++vertex ) {
+            const std::size_t column_index = std::distance ( facet.vertices.begin(), vertex );
+            new_facet.vertices.push_back ( *vertex );
+            const std::vector<double> vertex_point = hull.reduced_point ( *vertex );
+            auto end_coordinate = vertex_point.end()-1; // don't add energy coordinate
+            for ( auto coord = vertex_point.begin(); coord != end_coordinate; ++coord ) {
+                const std::size_t row_index = std::distance ( vertex_point.begin(), coord );
+                new_facet.basis_matrix ( row_index, column_index ) = *coord;
             }
-            new_facet.area = facet.facetArea( qhull.runId() );
-            candidates.push_back ( new_facet );
-            already_added = true;
-            //DEBUG std::cout << facet;
-            
+            new_facet.basis_matrix ( vertex_count-1, column_index ) = 1; // last row is all 1's
+        }
+        if ( !InvertMatrix ( new_facet.basis_matrix, new_facet.basis_matrix ) ) {
+            // The vertices of a facet of a full-dimensional hull are affinely independent,
+            // so only numerically degenerate facets end up here
             continue;
-            
-            // Only facets with edges beyond the critical length are candidate tie hyperplanes
-            // Check the length of all edges (dimension 1) in the facet
-            for (auto vertex1 = 0; vertex1 < vertex_count && !already_added; ++vertex1) {
-                const std::size_t vertex1_point_id = vertices[vertex1].point().id();
-                const double vertex1_energy = calculate_midpoint_energy ( vertex1_point_id, vertex1_point_id );
-                //std::cout << "vertex1_energy = " << vertex1_energy << std::endl;
-                std::vector<double> pt_vert1 = vertices[vertex1].point().toStdVector();
-                //pt_vert1.pop_back(); // Remove the last coordinate (energy) for this check
-                for (auto vertex2 = 0; vertex2 < vertex1 && !already_added; ++vertex2) {
-                    const std::size_t vertex2_point_id = vertices[vertex2].point().id();
-                    const double vertex2_energy = calculate_midpoint_energy ( vertex2_point_id, vertex2_point_id );
-                    //std::cout << "vertex2_energy = " << vertex2_energy << std::endl;
-                    std::vector<double> pt_vert2 = vertices[vertex2].point().toStdVector();
-                    //pt_vert2.pop_back(); // Remove the last coordinate (energy) for this check
-                    std::vector<double> difference ( pt_vert2.size() );
-                    std::vector<double> midpoint ( pt_vert2.size() ); // midpoint of the edge
-                    std::transform (pt_vert2.begin(), pt_vert2.end(), 
-                                    pt_vert1.begin(), midpoint.begin(), std::plus<double>() );
-                    for (auto &coord : midpoint) coord /= 2;
-                    const double lever_rule_energy = (vertex1_energy + vertex2_energy)/2;
-                    // This will return a type's max() if the phases are different (always true tie line)
-                    const double true_energy = calculate_midpoint_energy
-                                               ( 
-                                                     vertex1_point_id, 
-                                                     vertex2_point_id 
-                                               );
-                    // If the true energy is "much" greater, it's a true tie line
-                    /*std::cout << "pt_vert1(" << vertex1_point_id << "): ";
-                    for (auto &coord : pt_vert1) std::cout << coord << ",";
-                    std::cout << ":: ";
-                    std::cout << "pt_vert2(" << vertex2_point_id << "): ";
-                    for (auto &coord : pt_vert2) std::cout << coord << ",";
-                    std::cout << ":: ";
-                    std::cout << "midpoint: ";
-                    for (auto &coord : midpoint) std::cout << coord << ",";
-                    std::cout << std::endl;
-                    std::cout << "true_energy: " << true_energy << " lever_rule_energy: " << lever_rule_energy << std::endl;*/
-                    // We use fabs() here so we don't accidentally flip the sign of the comparison
-                    if ( (true_energy-lever_rule_energy)/fabs(lever_rule_energy) < coplanarity_allowance ) {
-                        continue; // not a true tie line, skip it
-                    }
-                    
-                    double distance = 0;
-                    // Subtract vertex1 from vertex2 to get the distance
-                    std::transform (pt_vert2.begin(), pt_vert2.end()-1, 
-                                    pt_vert1.begin(), difference.begin(), std::minus<double>() );
-                    // Sum the square of all elements of vertex2-vertex1
-                    for (auto coord : difference) distance += std::pow(coord,2);
-                    // Square root the result
-                    distance = sqrt(distance);
-                    /*DEBUG std::cout << "Edge length: " << distance << std::endl;
-                    std::cout << "Vertex1: ";
-                    for (auto coord : pt_vert1) std::cout << coord << ",";
-                    std::cout << std::endl;
-                    std::cout << "Vertex2: ";
-                    for (auto coord : pt_vert2) std::cout << coord << ",";
-                    std::cout << std::endl;*/
-                    SimplicialFacet<double> new_facet;
-                    for ( auto vertex = vertices.begin(); vertex != vertices.end(); ++vertex ) {
-                        new_facet.vertices.push_back ( vertex->point().id() );
-                    }
-                    for ( auto coord : facet.hyperplane() ) {
-                        new_facet.normal.push_back ( coord );
-                    }
-                    new_facet.area = facet.facetArea( qhull.runId() );
-                    candidates.push_back ( new_facet );
-                    already_added = true;
-                    //DEBUG std::cout << facet;
-                }
+        }
+        for ( const auto coord : facet.normal ) {
+            new_facet.normal.push_back ( coord );
+        }
+        new_facet.area = hull.facet_area ( facet );
+        candidates.push_back ( new_facet );
+    }
+    if ( !filter_tie_facets ) return candidates;
+
+    // Only facets with at least one true tie line edge are candidate tie hyperplanes
+    // Edges are shared by neighbouring facets, so each one is checked once; all the midpoint
+    // energies are calculated in one call, which can group them by phase
+    std::vector<std::pair<std::size_t,std::size_t>> edges;
+    std::map<std::pair<std::size_t,std::size_t>,std::size_t> edge_ids;
+    for ( const auto &facet : candidates ) {
+        for ( std::size_t vertex1 = 0; vertex1 < facet.vertices.size(); ++vertex1 ) {
+            for ( std::size_t vertex2 = 0; vertex2 < vertex1; ++vertex2 ) {
+                const std::pair<std::size_t,std::size_t> edge ( std::min ( facet.vertices[vertex1], facet.vertices[vertex2] ),
+                                                               std::max ( facet.vertices[vertex1], facet.vertices[vertex2] ) );
+                if ( edge_ids.emplace ( edge, edges.size() ).second ) edges.push_back ( edge );
+            }
+        }
+    }
+    std::vector<double> true_energies ( edges.size() );
+    if ( !edges.empty() ) calculate_midpoint_energies ( edges, true_energies );
+    std::vector<bool> tie_line ( edges.size() );
+    for ( std::size_t edge = 0; edge < edges.size(); ++edge ) {
+        const double lever_rule_energy = ( hull.energy ( edges[edge].first ) + hull.energy ( edges[edge].second ) ) / 2;
+        // If the true energy is "much" greater, it's a true tie line
+        // We use fabs() here so we don't accidentally flip the sign of the comparison
+        tie_line[edge] = ( true_energies[edge]-lever_rule_energy ) / fabs ( lever_rule_energy ) >= coplanarity_allowance;
+    }
+    std::vector<SimplicialFacet<double>> tie_facets;
+    for ( const auto &facet : candidates ) {
+        bool has_tie_line = false;
+        for ( std::size_t vertex1 = 0; vertex1 < facet.vertices.size() && !has_tie_line; ++vertex1 ) {
+            for ( std::size_t vertex2 = 0; vertex2 < vertex1 && !has_tie_line; ++vertex2 ) {
+                const std::pair<std::size_t,std::size_t> edge ( std::min ( facet.vertices[vertex1], facet.vertices[vertex2] ),
+                                                               std::max ( facet.vertices[vertex1], facet.vertices[vertex2] ) );
+                has_tie_line = tie_line[edge_ids.find ( edge )->second];
             }
         }
+        if ( has_tie_line ) tie_facets.push_back ( facet );
     }
-    return candidates;
+    return tie_facets;
 }
 } // namespace details
-} // namespace Optimizer
\ No newline at end of file
+} // namespace Optimizer
@@ -0,0 +1,158 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Memoized energies of the points of one phase under fixed conditions
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/utils/energy_cache.hpp"
+#include <boost/assert.hpp>
+#include <boost/functional/hash.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace Optimizer { namespace details {
+
+EnergyCache::EnergyCache ( CompositionSet const &phase, evalconditions const &conditions, const double resolution,
+                           const bool single_precision, SublatticeSymmetry symmetry ) :
+    phase ( &phase ),
+    conditions ( conditions ),
+    binding ( phase.bind ( conditions, phase.get_variable_map() ) ),
+    dimension ( phase.get_variable_map().size() ),
+    resolution ( resolution ),
+    single ( single_precision ),
+    phase_symmetry ( std::move ( symmetry ) ),
+    hit_count ( 0 ),
+    miss_count ( 0 ),
+    max_rounding_error ( 0 )
+{
+    BOOST_ASSERT ( resolution > 0 );
+}
+
+std::size_t EnergyCache::KeyHash::operator() ( const KeyType &key ) const
+{
+    return boost::hash_range ( key.begin(), key.end() );
+}
+
+EnergyCache::KeyType EnergyCache::make_key ( double const* const point ) const
+{
+    KeyType key ( dimension );
+    for ( std::size_t i = 0; i < dimension; ++i ) {
+        key[i] = std::llround ( point[i] / resolution );
+    }
+    if ( !phase_symmetry.empty() ) phase_symmetry.canonicalize ( &key[0] );
+    return key;
+}
+
+double EnergyCache::energy ( double const* const point )
+{
+    const Entry missing = { 0.0, false };
+    auto entry = values.emplace ( make_key ( point ), missing );
+    if ( !entry.second ) {
+        ++hit_count;
+        return entry.first->second.energy;
+    }
+    ++miss_count;
+    entry.first->second.energy = phase->evaluate_objective ( binding, point );
+    return entry.first->second.energy;
+}
+
+void EnergyCache::energies ( double const* const points, const std::size_t npoints, const std::size_t stride, double* const out )
+{
+    BOOST_ASSERT ( stride >= dimension );
+    // Each point refers to its entry; new entries are filled below, after one batch evaluation
+    // References to the elements of an unordered_map stay valid when it grows
+    const Entry missing = { 0.0, false };
+    std::vector<Entry*> entries ( npoints );
+    std::vector<Entry*> new_entries;
+    std::vector<double> new_points;
+    for ( std::size_t i = 0; i < npoints; ++i ) {
+        double const* const point = points + i * stride;
+        auto entry = values.emplace ( make_key ( point ), missing );
+        entries[i] = &entry.first->second;
+        if ( !entry.second ) {
+            ++hit_count;
+            continue;
+        }
+        ++miss_count;
+        new_entries.push_back ( entries[i] );
+        new_points.insert ( new_points.end(), point, point + dimension );
+    }
+    if ( !new_entries.empty() ) {
+        bool approximate = false;
+        std::vector<double> new_energies ( new_entries.size() );
+        if ( single ) {
+            const std::vector<float> narrow_points ( new_points.begin(), new_points.end() );
+            std::vector<float> narrow_energies ( new_entries.size() );
+            try {
+                phase->evaluate_objective_batch ( conditions, &narrow_points[0], new_entries.size(), dimension, &narrow_energies[0] );
+                std::copy ( narrow_energies.begin(), narrow_energies.end(), new_energies.begin() );
+                approximate = true;
+            }
+            catch ( boost::exception & ) {
+                // e.g., an intermediate value out of the range of float; use double precision below
+            }
+        }
+        if ( !approximate ) {
+            phase->evaluate_objective_batch ( conditions, &new_points[0], new_entries.size(), dimension, &new_energies[0] );
+        }
+        for ( std::size_t i = 0; i < new_entries.size(); ++i ) {
+            new_entries[i]->energy = new_energies[i];
+            new_entries[i]->approximate = approximate;
+        }
+    }
+    for ( std::size_t i = 0; i < npoints; ++i ) {
+        out[i] = entries[i]->energy;
+    }
+}
+
+void EnergyCache::exact_energies ( double const* const points, const std::size_t npoints, const std::size_t stride, double* const out )
+{
+    BOOST_ASSERT ( stride >= dimension );
+    const Entry missing = { 0.0, false };
+    std::vector<Entry*> entries ( npoints );
+    std::vector<Entry*> new_entries;
+    std::vector<bool> new_was_approximate; // false for points that were missing
+    std::vector<double> new_points;
+    for ( std::size_t i = 0; i < npoints; ++i ) {
+        double const* const point = points + i * stride;
+        auto entry = values.emplace ( make_key ( point ), missing );
+        entries[i] = &entry.first->second;
+        if ( !entry.second ) {
+            ++hit_count;
+            if ( !entries[i]->approximate ) continue;
+        }
+        else {
+            ++miss_count;
+        }
+        new_entries.push_back ( entries[i] );
+        new_was_approximate.push_back ( entries[i]->approximate );
+        new_points.insert ( new_points.end(), point, point + dimension );
+        entries[i]->approximate = false; // so that a point repeated in points is only evaluated once
+    }
+    if ( !new_entries.empty() ) {
+        std::vector<double> new_energies ( new_entries.size() );
+        phase->evaluate_objective_batch ( conditions, &new_points[0], new_entries.size(), dimension, &new_energies[0] );
+        for ( std::size_t i = 0; i < new_entries.size(); ++i ) {
+            if ( new_was_approximate[i] ) {
+                max_rounding_error = std::max ( max_rounding_error, std::abs ( new_entries[i]->energy - new_energies[i] ) );
+            }
+            new_entries[i]->energy = new_energies[i];
+        }
+    }
+    for ( std::size_t i = 0; i < npoints; ++i ) {
+        out[i] = entries[i]->energy;
+    }
+}
+
+void EnergyCache::insert ( double const* const point, const double energy )
+{
+    const Entry exact = { energy, false };
+    values[make_key ( point )] = exact;
+}
+
+} // namespace details
+} // namespace Optimizer
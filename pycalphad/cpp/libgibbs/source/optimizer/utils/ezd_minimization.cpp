@@ -17,39 +17,75 @@
 #include "libgibbs/include/optimizer/halton.hpp"
 #include "libgibbs/include/optimizer/utils/hull_mapping.hpp"
 #include "libgibbs/include/optimizer/utils/ndsimplex.hpp"
+#include "libgibbs/include/optimizer/utils/simplex_lattice.hpp"
 #include "libgibbs/include/optimizer/utils/convex_hull.hpp"
-#include "libgibbs/include/utils/cholesky.hpp"
+#include "libgibbs/include/optimizer/utils/energy_cache.hpp"
+#include "libgibbs/include/optimizer/utils/lower_convex_hull.hpp"
+#include "libgibbs/include/utils/energy_device.hpp"
+#include "libgibbs/include/utils/hot_path_logging.hpp"
+#include "libgibbs/include/utils/primes.hpp"
+#include "libgibbs/include/utils/small_matrix.hpp"
 #include "libgibbs/include/utils/site_fraction_convert.hpp"
+#include "libgibbs/include/utils/sublattice_symmetry.hpp"
 #include "libtdb/include/exceptions.hpp"
 #include <libqhullcpp/QhullFacet.h>
 #include <libqhullcpp/QhullFacetList.h>
 #include <boost/bimap.hpp>
-#include <boost/numeric/ublas/symmetric.hpp>
 #include <boost/numeric/ublas/vector.hpp>
 #include <boost/numeric/ublas/io.hpp>
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
 #include <string>
 #include <map>
 #include <limits>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <thread>
 
 namespace Optimizer { namespace details {
 
-std::vector<std::vector<double>> AdaptiveSearchND (
+void AdaptiveSearchND (
                                   CompositionSet const &phase,
                                   evalconditions const& conditions,
                                   const SimplexCollection &search_region,
                                   const std::size_t refinement_subdivisions_per_axis,
                                   const std::size_t depth,
+                                  PointCloud<double> &minima,
                                   const double old_gradient_mag = 1e12 );
 
-std::vector<double> generate_point ( const SimplexCollection &simpcol );
+void AppendPureEndMembers (
+    CompositionSet const &phase,
+    sublattice_set const &sublset,
+    PointCloud<double> &points,
+    SublatticeSymmetry const &symmetry = SublatticeSymmetry() );
+
+// Sampled points are generated and screened this many at a time, so memory stays bounded for fine grids
+constexpr const std::size_t sample_chunk_size = 1024;
+
+namespace {
+// "(x,y,...)", for debug records
+inline std::string point_string ( double const* const point, const std::size_t dimension )
+{
+    std::stringstream result;
+    result << "(";
+    for ( std::size_t coord = 0; coord < dimension; ++coord ) {
+        if ( coord > 0 ) result << ",";
+        result << point[coord];
+    }
+    result << ")";
+    return result.str();
+}
+}
 
 
 // TODO: Should this be a member function of GibbsOpt?
 // The function calling LocateMinima definitely should be at least (needs access to all CompositionSets)
 // LocateMinima finds all of the minima for a given phase's Gibbs energy
 // In addition to allowing us to choose a better starting point, this will allow for automatic miscibility gap detection
-std::vector<std::vector<double>>  AdaptiveSimplexSample (
+PointCloud<double> AdaptiveSimplexSample (
         CompositionSet const &phase,
         sublattice_set const &sublset,
         evalconditions const& conditions,
@@ -57,184 +93,162 @@ std::vector<std::vector<double>>  AdaptiveSimplexSample (
         const std::size_t refinement_subdivisions_per_axis,
         const bool discard_unstable
         )
+{
+    EnergyCache energy_cache ( phase, conditions );
+    return AdaptiveSimplexSample ( phase, sublset, conditions, initial_subdivisions_per_axis, 
+                                   refinement_subdivisions_per_axis, discard_unstable, energy_cache, 1 );
+}
+
+PointCloud<double> AdaptiveSimplexSample (
+        CompositionSet const &phase,
+        sublattice_set const &sublset,
+        evalconditions const& conditions,
+        const std::size_t initial_subdivisions_per_axis,
+        const std::size_t refinement_subdivisions_per_axis,
+        const bool discard_unstable,
+        EnergyCache &energy_cache,
+        std::size_t worker_threads
+        )
 {
     using namespace boost::numeric::ublas;
+    HOT_PATH_LOGGER ( opt_log, "optimizer" );
 
     // EZD Global Minimization (Emelianenko et al., 2006)
     // First: FIND CONCAVITY REGIONS
-    std::vector<std::vector<double>> points;
-    std::vector<std::vector<double>> unmapped_minima;
-    std::vector<SimplexCollection> start_simplices;
-    std::vector<SimplexCollection> positive_definite_regions;
+    const std::size_t point_dimension = phase.get_variable_map().size();
+    PointCloud<double> unmapped_minima ( point_dimension+1 ); // last coordinate is energy
+    std::vector<std::size_t> positive_definite_regions; // indices into start_lattice
     std::vector<SimplexCollection> components_in_sublattice;
-    std::vector<std::vector<std::vector<double>>> pure_end_members, all_permutations;
     
-    // Simplified lambda for energy calculation
-    auto calculate_energy = [&phase,&conditions] (const std::vector<double>& point) {
-        return phase.evaluate_objective(conditions,phase.get_variable_map(),const_cast<double*>(&point[0]));
-    };
-
-    // Get the first sublattice for this phase
-    boost::multi_index::index<sublattice_set,phase_subl>::type::iterator ic0,ic1;
-    int sublindex = 0;
-    ic0 = boost::multi_index::get<phase_subl> ( sublset ).lower_bound ( boost::make_tuple ( phase.name(), sublindex ) );
-    ic1 = boost::multi_index::get<phase_subl> ( sublset ).upper_bound ( boost::make_tuple ( phase.name(), sublindex ) );
+    const SublatticeLayout &layout = phase.sublattice_layout();
+    const SublatticeSymmetry &symmetry = energy_cache.symmetry();
 
     // (1) Sample some points on the domain using NDSimplex
     // Because the grid is uniform, we can assume that each point is the center of an N-simplex
     // Determine number of components in each sublattice
-    while ( ic0 != ic1 ) {
-        const std::size_t number_of_species = std::distance ( ic0,ic1 );
+    for ( std::size_t sublindex = 0; sublindex < layout.sublattice_count(); ++sublindex ) {
+        const std::size_t number_of_species = layout.species_count ( sublindex );
         BOOST_ASSERT ( number_of_species > 0 );
         NDSimplex base ( number_of_species-1 ); // construct the unit (q-1)-simplex
         components_in_sublattice.emplace_back ( base.simplex_subdivide ( initial_subdivisions_per_axis ) );
-        // Next sublattice
-        ++sublindex;
-        ic0 = boost::multi_index::get<phase_subl> ( sublset ).lower_bound ( boost::make_tuple ( phase.name(), sublindex ) );
-        ic1 = boost::multi_index::get<phase_subl> ( sublset ).upper_bound ( boost::make_tuple ( phase.name(), sublindex ) );
     }
 
-    // Take all combinations of generated points in each sublattice
-    start_simplices = lattice_complex ( components_in_sublattice );
-
+    // All combinations of generated points in each sublattice; they are generated on demand
+    const SimplexLattice start_lattice ( std::move ( components_in_sublattice ) );
+    BOOST_ASSERT ( start_lattice.point_dimension() == point_dimension );
+    // Of the combinations related by the symmetry, only the one in its fundamental domain is sampled and refined
+    std::vector<std::size_t> subsimplex ( layout.sublattice_count() );
+    auto in_fundamental_domain = [&] ( const std::size_t index ) {
+        if ( symmetry.empty() ) return true;
+        start_lattice.subsimplex_indices ( index, &subsimplex[0] );
+        return symmetry.canonical_indices ( &subsimplex[0] );
+    };
+    std::size_t domain_size = 0;
 
-    for ( SimplexCollection& simpcol : start_simplices ) {
-        std::cout << "(";
-        std::vector<double> pt = generate_point ( simpcol );
-        for ( auto i = pt.begin(); i != pt.end(); ++i ) {
-            std::cout << *i;
-            if ( std::distance ( i,pt.end() ) > 1 ) {
-                std::cout << ",";
-            }
+    start_lattice.for_each_chunk_if ( sample_chunk_size, in_fundamental_domain,
+                                      [&] ( const std::vector<std::size_t> &indices, const PointCloud<double> &start_points ) {
+        domain_size += start_points.size();
+        for ( std::size_t i = 0; i < start_points.size(); ++i ) {
+            HOT_PATH_LOG_SEV ( opt_log, debug ) << "sampled " << point_string ( start_points[i], point_dimension );
         }
-        std::cout << ")" << std::endl;
-        points.emplace_back ( std::move ( pt ) );
-    }
-
-    if (discard_unstable) {
-        // (2) Calculate the Lagrangian Hessian for all sampled points
-        for ( SimplexCollection& simpcol : start_simplices ) {
-            std::vector<double> pt = generate_point ( simpcol );
-            if ( pt.size() == 0 ) {
-                continue;    // skip empty (invalid) points
-            }
-            symmetric_matrix<double, lower> Hessian ( zero_matrix<double> ( pt.size(),pt.size() ) );
-            try {
-                Hessian = phase.evaluate_objective_hessian_matrix ( conditions, phase.get_variable_map(), pt );
-            } catch ( boost::exception &e ) {
-                std::cout << boost::diagnostic_information ( e );
-                throw;
-            } catch ( std::exception &e ) {
-                std::cout << e.what();
-                throw;
-            }
-            //std::cout << "Hessian: " << Hessian << std::endl;
-            // NOTE: For this calculation we consider only the linear constraints for an isolated phase (e.g., site fraction balances)
+        if (discard_unstable) {
+            // (2) Calculate the Lagrangian Hessian for all sampled points
             // (3) Save all points for which the Lagrangian Hessian is positive definite in the null space of the constraint gradient matrix
-            //        NOTE: This is the projected Hessian method (Nocedal and Wright, 2006, ch. 12.4, p.349)
-            //        But how do I choose the Lagrange multipliers for all the constraints? Can I calculate them?
-            //        The answer is that, because the constraints are linear, there is no constraint contribution to the Hessian.
-            //        That means that the Hessian of the Lagrangian is just the Hessian of the objective function.
-            const std::size_t Zcolumns = pt.size() - phase.get_constraints().size();
-            // Z is the constraint null space matrix = phase.get_constraint_null_space_matrix()
-            //    (a) Set Hproj = transpose(Z)*(L'')*Z
-            matrix<double> Hproj ( pt.size(), Zcolumns );
-            Hproj = prod ( trans ( phase.get_constraint_null_space_matrix() ),
-                        matrix<double> ( prod ( Hessian,phase.get_constraint_null_space_matrix() ) ) );
-            //std::cout << "Hproj: " << Hproj << std::endl;
-            //    (b) Verify that all diagonal elements of Hproj are strictly positive; if not, remove this point from consideration
-            //        NOTE: This is a necessary but not sufficient condition that a matrix be positive definite, and it's easy to check
-            //        Reference: Carlen and Carvalho, 2007, p. 148, Eq. 5.12
-            //        TODO: Currently not bothering to do this; should perform a test to figure out if there would be a performance increase
-            //    (c) Attempt a Cholesky factorization of Hproj; will only succeed if matrix is positive definite
-            const bool is_positive_definite = cholesky_factorize ( Hproj );
-            //    (d) If it succeeds, save this point; else, discard it
-            if ( is_positive_definite ) {
-                positive_definite_regions.emplace_back ( simpcol );
-                /*DEBUG for ( double i : pt ) {
-                    std::cout << i << ",";
+            const std::vector<bool> stable = StabilityMask ( phase, conditions, start_points );
+            for ( std::size_t i = 0; i < start_points.size(); ++i ) {
+                if ( stable[i] ) {
+                    positive_definite_regions.push_back ( indices[i] );
                 }
-                std::cout << ":" <<  std::endl;*/
             }
         }
-    }
-    else {
-        // Save all points (do not discard unstable regions)
-        positive_definite_regions = start_simplices;
-    }
+        else {
+            // Save all points (do not discard unstable regions)
+            positive_definite_regions.insert ( positive_definite_regions.end(), indices.begin(), indices.end() );
+        }
+    });
     
+    // Points are written straight into unmapped_minima and their energies
+    // are filled in afterwards, for all the points of one block at once
+    auto fill_energies = [&] ( const std::size_t first_point ) {
+        const std::size_t npoints = unmapped_minima.size() - first_point;
+        if ( npoints == 0 ) return;
+        std::vector<double> energies ( npoints );
+        energy_cache.energies ( unmapped_minima[first_point], npoints, unmapped_minima.dimension(), &energies[0] );
+        for ( std::size_t i = 0; i < npoints; ++i ) {
+            unmapped_minima[first_point + i][point_dimension] = energies[i];
+        }
+    };
     // The pure end-members are always considered in the calculation, so add them
     // This will handle the case of complete immiscibility: energy function is nonconvex
-    sublindex = 0;
-    ic0 = boost::multi_index::get<phase_subl> ( sublset ).lower_bound ( boost::make_tuple ( phase.name(), sublindex ) );
-    ic1 = boost::multi_index::get<phase_subl> ( sublset ).upper_bound ( boost::make_tuple ( phase.name(), sublindex ) );
-    while ( ic0 != ic1 ) {
-        const std::size_t number_of_species = std::distance ( ic0,ic1 );
-        BOOST_ASSERT ( number_of_species > 0 );
-        std::vector<std::vector<double>> sublattice_permutations;
-        const double epsilon_composition = 1e-12;
-        std::vector<double> sub_pt ( number_of_species, epsilon_composition );
-        sub_pt[number_of_species-1] = 1-(number_of_species-1)*epsilon_composition;
-        sublattice_permutations.push_back ( sub_pt );
-        // Here we take advantage of the fact that sub_pt is sorted by construction
-        // We will iterate from (0,0,...,1) to (1,0,...,0)
-        while ( std::next_permutation ( sub_pt.begin(), sub_pt.end() ) ) {
-            sublattice_permutations.push_back ( sub_pt );
-        }
-        all_permutations.emplace_back ( sublattice_permutations );
-        // Next sublattice
-        ++sublindex;
-        ic0 = boost::multi_index::get<phase_subl> ( sublset ).lower_bound ( boost::make_tuple ( phase.name(), sublindex ) );
-        ic1 = boost::multi_index::get<phase_subl> ( sublset ).upper_bound ( boost::make_tuple ( phase.name(), sublindex ) );
-    }
-    // Take all combinations of generated points in each sublattice
-    pure_end_members = lattice_complex ( all_permutations );
-    if ( pure_end_members.size() == 1 ) pure_end_members.clear(); // Unary case: already handled by above
-    for ( auto &pure_points : pure_end_members ) {
-        // We need to concatenate all the sublattice coordinates in pure_points
-        std::vector<double> pt;
-        for ( auto &coords : pure_points ) {
-            if (coords.size() == 0) continue;
-            pt.reserve ( pt.size() + coords.size() );
-            pt.insert ( pt.end(), std::make_move_iterator ( coords.begin() ),  std::make_move_iterator ( coords.end() ) );
-        }
-        std::cout << "checking ";
-        for ( auto i = pt.begin(); i != pt.end(); ++i ) {
-            std::cout << *i;
-            if ( std::distance ( i,pt.end() ) > 1 ) {
-                std::cout << ",";
-            }
-        }
-        std::cout << std::endl;
-        // Before convex_hull, unmapped_minima has an energy coordinate
-        pt.push_back ( calculate_energy ( pt ) );
-        std::cout << "ENDMEMBER ";
-        for ( auto & coord : pt ) {
-            std::cout << coord << ",";
-        }
-        std::cout << std::endl;
-        unmapped_minima.emplace_back ( std::move ( pt ) );
+    AppendPureEndMembers ( phase, sublset, unmapped_minima, symmetry );
+    // Before convex_hull, unmapped_minima has an energy coordinate
+    fill_energies ( 0 );
+    for ( std::size_t i = 0; i < unmapped_minima.size(); ++i ) {
+        HOT_PATH_LOG_SEV ( opt_log, debug ) << "end-member " << point_string ( unmapped_minima[i], unmapped_minima.dimension() );
     }
     // If no unstable regions were found, there's no point in continuing the search
-    if ( start_simplices.size() == positive_definite_regions.size() ) {
+    if ( domain_size == positive_definite_regions.size() ) {
         // copy the unrefined grid into the return value
-        for ( auto simp_iter = start_simplices.begin(); simp_iter != start_simplices.end(); ++simp_iter ) {
-            auto gridpoint = generate_point ( *simp_iter );
-            gridpoint.push_back ( calculate_energy ( gridpoint ) );
-            unmapped_minima.emplace_back ( gridpoint );
-        }
+        unmapped_minima.reserve ( unmapped_minima.size() + domain_size );
+        start_lattice.for_each_chunk_if ( sample_chunk_size, in_fundamental_domain,
+                                          [&] ( const std::vector<std::size_t>&, const PointCloud<double> &start_points ) {
+            const std::size_t first_gridpoint = unmapped_minima.size();
+            for ( std::size_t i = 0; i < start_points.size(); ++i ) {
+                std::copy ( start_points[i], start_points[i] + point_dimension, unmapped_minima.push_back() );
+            }
+            fill_energies ( first_gridpoint );
+        });
     }
     else if ( positive_definite_regions.size() > 0 ) {
         // positive_definite_regions is now filled
         // At least one unstable region was found
         // Perform recursive search for minima on each of the identified regions
-        for ( const SimplexCollection &simpcol : positive_definite_regions ) {
-            //std::cout << "checking simplexcollection of size " << simpcol.size() << std::endl;
-            std::vector<std::vector<double>> region_minima = AdaptiveSearchND ( phase, conditions, simpcol, refinement_subdivisions_per_axis, 1 );
-
-            // Append this region's minima to the list of minima
-            unmapped_minima.reserve ( unmapped_minima.size() +region_minima.size() );
-            unmapped_minima.insert ( unmapped_minima.end(), std::make_move_iterator ( region_minima.begin() ),  std::make_move_iterator ( region_minima.end() ) );
+        // The regions are independent, so each is one task with its own point buffer; idle workers take
+        // the next region, which balances regions whose searches stop at different depths.
+        // The buffers are appended in region order, so the result does not depend on the thread count.
+        const std::size_t region_count = positive_definite_regions.size();
+        std::vector<PointCloud<double>> region_minima ( region_count, PointCloud<double> ( point_dimension+1 ) );
+        std::atomic<std::size_t> next_region ( 0 );
+        auto refine_regions = [&] () {
+            for ( std::size_t task = next_region++; task < region_count; task = next_region++ ) {
+                AdaptiveSearchND ( phase, conditions, start_lattice.combination ( positive_definite_regions[task] ),
+                                   refinement_subdivisions_per_axis, 1, region_minima[task] );
+            }
+        };
+        if ( worker_threads == 0 ) worker_threads = std::max ( std::thread::hardware_concurrency(), 1u );
+        worker_threads = std::min ( worker_threads, region_count );
+        std::vector<std::thread> workers;
+        std::vector<std::exception_ptr> worker_errors ( worker_threads );
+        for ( std::size_t i = 1; i < worker_threads; ++i ) {
+            workers.emplace_back ( [&, i] () {
+                try {
+                    refine_regions();
+                }
+                catch ( ... ) {
+                    worker_errors[i] = std::current_exception();
+                    next_region = region_count; // stop the other workers early
+                }
+            } );
+        }
+        try {
+            refine_regions(); // this thread works too
+        }
+        catch ( ... ) {
+            worker_errors[0] = std::current_exception();
+            next_region = region_count;
+        }
+        for ( auto &worker : workers ) {
+            worker.join();
+        }
+        for ( auto error = worker_errors.begin(); error != worker_errors.end(); ++error ) {
+            if ( *error ) std::rethrow_exception ( *error );
+        }
+        // Append each region's minima to the list of minima; the cache is not thread-safe, so it is filled here
+        for ( auto minima = region_minima.cbegin(); minima != region_minima.cend(); ++minima ) {
+            for ( std::size_t i = 0; i < minima->size(); ++i ) {
+                energy_cache.insert ( ( *minima ) [i], ( *minima ) [i][point_dimension] );
+            }
+            unmapped_minima.append ( *minima );
         }
         /*DEBUG std::cout << "CANDIDATE MINIMA" << std::endl;
         for (auto min : unmapped_minima) {
@@ -310,58 +324,506 @@ std::vector<std::vector<double>>  AdaptiveSimplexSample (
     }*/
 }
 
+// Number of species in each sublattice; each species is one dimension of the Halton sequence
+std::vector<std::size_t> HaltonSublatticeSizes ( CompositionSet const &phase )
+{
+    std::vector<std::size_t> sublattice_sizes;
+    const SublatticeLayout &layout = phase.sublattice_layout();
+    for ( std::size_t sublindex = 0; sublindex < layout.sublattice_count(); ++sublindex ) {
+        sublattice_sizes.push_back ( layout.species_count ( sublindex ) );
+    }
+    BOOST_ASSERT ( std::accumulate ( sublattice_sizes.begin(), sublattice_sizes.end(), std::size_t ( 0 ) ) == phase.get_variable_map().size() );
+    if ( phase.get_variable_map().size() > primes_size() ) {
+        BOOST_THROW_EXCEPTION ( range_check_error() << str_errinfo ( "Too many internal degrees of freedom for quasirandom sampling" ) << specific_errinfo ( phase.name() ) );
+    }
+    return sublattice_sizes;
+}
+
+// Write points first_index+1 to first_index+count of the Halton sequence mapped to the product of
+// the sublattice simplices; point i is written to out + i*stride
+// Within each sublattice, the coordinates are drawn from an exponential distribution and normalized to 1.
+// If X is uniformly distributed, then -LN(X) is exponentially distributed, and N such samples, when
+// normalized to 1, are distributed uniformly on the (N-1)-simplex. Substituting the Halton sequence for the
+// uniform distribution makes this deterministic and gives low-discrepancy coverage of the product of simplices.
+// Every point is independent of the others, so the rows are filled by several threads.
+void FillHaltonRows (
+    std::vector<std::size_t> const &sublattice_sizes,
+    const std::size_t first_index,
+    const std::size_t count,
+    double* const out,
+    const std::size_t stride,
+    const std::size_t worker_threads )
+{
+    auto fill_rows = [&] ( const std::size_t begin, const std::size_t end ) {
+        for ( std::size_t i = begin; i < end; ++i ) {
+            double* const pt = out + i * stride;
+            std::size_t coord_index = 0;
+            for ( const std::size_t number_of_species : sublattice_sizes ) {
+                double sublattice_sum = 0;
+                for ( std::size_t species = 0; species < number_of_species; ++species ) {
+                    const double value = ( number_of_species == 1 ) ? 1 : -std::log ( halton ( first_index+i+1, primes[coord_index + species] ) );
+                    pt[coord_index + species] = value;
+                    sublattice_sum += value;
+                }
+                for ( std::size_t species = 0; species < number_of_species; ++species ) {
+                    pt[coord_index + species] /= sublattice_sum;
+                }
+                coord_index += number_of_species;
+            }
+        }
+    };
+    const std::size_t thread_count = std::min ( std::max ( worker_threads, std::size_t ( 1 ) ), std::max ( count / sample_chunk_size, std::size_t ( 1 ) ) );
+    std::vector<std::thread> workers;
+    for ( std::size_t thread_id = 1; thread_id < thread_count; ++thread_id ) {
+        workers.emplace_back ( fill_rows, count * thread_id / thread_count, count * ( thread_id+1 ) / thread_count );
+    }
+    fill_rows ( 0, count / thread_count ); // this thread works too
+    for ( auto &thread : workers ) {
+        thread.join();
+    }
+}
+
+PointCloud<double> QuasirandomSimplexSample (
+    CompositionSet const &phase,
+    sublattice_set const &sublset,
+    evalconditions const& conditions,
+    const std::size_t point_budget,
+    const std::size_t worker_threads )
+{
+    EnergyCache energy_cache ( phase, conditions );
+    return QuasirandomSimplexSample ( phase, sublset, conditions, point_budget, worker_threads, energy_cache );
+}
+
+// Reference for Halton sequence: Hess and Polak, 2003.
+// Reference for uniformly sampling the simplex: Any text on the Dirichlet distribution
+PointCloud<double> QuasirandomSimplexSample (
+    CompositionSet const &phase,
+    sublattice_set const &sublset,
+    evalconditions const& conditions,
+    const std::size_t point_budget,
+    const std::size_t worker_threads,
+    EnergyCache &energy_cache )
+{
+    const std::size_t point_dimension = phase.get_variable_map().size();
+    PointCloud<double> points ( point_dimension+1 ); // last coordinate is energy
+    const std::vector<std::size_t> sublattice_sizes = HaltonSublatticeSizes ( phase );
+
+    const SublatticeSymmetry &symmetry = energy_cache.symmetry();
+
+    // The pure end-members are always considered in the calculation, so add them
+    AppendPureEndMembers ( phase, sublset, points, symmetry );
+    const std::size_t first_sample = points.size();
+    points.reserve ( first_sample + point_budget );
+    for ( std::size_t i = 0; i < point_budget; ++i ) points.push_back();
+    if ( point_budget > 0 ) {
+        FillHaltonRows ( sublattice_sizes, 0, point_budget, points[first_sample], points.dimension(), worker_threads );
+    }
+    if ( !symmetry.empty() ) {
+        // The whole budget is spent in the fundamental domain
+        for ( std::size_t i = first_sample; i < points.size(); ++i ) symmetry.canonicalize ( points[i] );
+    }
+
+    // Energies go through the cache, which is not thread-safe, so they are calculated afterwards in one batch
+    if ( !points.empty() ) {
+        std::vector<double> energies ( points.size() );
+        energy_cache.energies ( points.data(), points.size(), points.dimension(), &energies[0] );
+        for ( std::size_t i = 0; i < points.size(); ++i ) {
+            points[i][point_dimension] = energies[i];
+        }
+    }
+    return points;
+}
+
+// The batches are evaluated on device while the previous batch is added to an incremental lower hull on
+// this thread. A point that falls inside the hull of the points before it stays inside the hull of any
+// superset, so only the hull vertices can be vertices of the internal hull computed later: culling the
+// rest here is exact, and only the vertices are returned and go through energy_cache.
+PointCloud<double> QuasirandomSimplexSample (
+    CompositionSet const &phase,
+    sublattice_set const &sublset,
+    evalconditions const& conditions,
+    const std::size_t point_budget,
+    const std::size_t worker_threads,
+    EnergyCache &energy_cache,
+    EnergyDevice &device )
+{
+    const std::size_t point_dimension = phase.get_variable_map().size();
+    const std::vector<std::size_t> sublattice_sizes = HaltonSublatticeSizes ( phase );
+    LowerConvexHull hull ( point_dimension+1, phase.sublattice_layout().dependent_dimensions(), true );
+    const SublatticeSymmetry &symmetry = energy_cache.symmetry();
+
+    // The pure end-members are always considered in the calculation, so add them
+    PointCloud<double> end_members ( point_dimension+1 );
+    AppendPureEndMembers ( phase, sublset, end_members, symmetry );
+    if ( !end_members.empty() ) {
+        std::vector<double> energies ( end_members.size() );
+        energy_cache.energies ( end_members.data(), end_members.size(), end_members.dimension(), &energies[0] );
+        for ( std::size_t i = 0; i < end_members.size(); ++i ) {
+            end_members[i][point_dimension] = energies[i];
+        }
+        hull.add_points ( end_members );
+    }
+
+    const auto lock = device.lock();
+    phase.load_objective ( device, conditions );
+    const std::size_t batch_size = std::max ( device.max_batch_points(), std::size_t ( 1 ) );
+    // One batch of points per device slot; batch k is in slot k % slot_count
+    std::vector<PointCloud<double>> batches ( EnergyDevice::slot_count, PointCloud<double> ( point_dimension+1 ) );
+    std::vector<double> energies;
+    // Fold the energies of the batch in slot into the hull
+    auto collect = [&] ( const std::size_t slot ) {
+        PointCloud<double> &batch = batches[slot];
+        energies.resize ( batch.size() );
+        device.wait ( slot, energies.data() );
+        for ( std::size_t i = 0; i < batch.size(); ++i ) {
+            if ( std::isnan ( energies[i] ) ) {
+                // The device could not evaluate this point; the interpreter will say why, or calculate it
+                energies[i] = energy_cache.energy ( batch[i] );
+            }
+            batch[i][point_dimension] = energies[i];
+        }
+        hull.add_points ( batch );
+    };
+    std::size_t batch_count = 0;
+    for ( std::size_t first = 0; first < point_budget; first += batch_size, ++batch_count ) {
+        const std::size_t slot = batch_count % EnergyDevice::slot_count;
+        PointCloud<double> &batch = batches[slot];
+        batch.resize ( std::min ( batch_size, point_budget - first ) );
+        FillHaltonRows ( sublattice_sizes, first, batch.size(), batch.data(), batch.dimension(), worker_threads );
+        if ( !symmetry.empty() ) {
+            for ( std::size_t i = 0; i < batch.size(); ++i ) symmetry.canonicalize ( batch[i] );
+        }
+        device.submit ( slot, batch.data(), batch.size(), batch.dimension() );
+        if ( batch_count > 0 ) {
+            collect ( ( batch_count-1 ) % EnergyDevice::slot_count );
+        }
+    }
+    if ( batch_count > 0 ) {
+        collect ( ( batch_count-1 ) % EnergyDevice::slot_count );
+    }
+
+    PointCloud<double> points ( point_dimension+1 ); // last coordinate is energy
+    points.append ( end_members );
+    if ( !hull.full_dimensional() ) {
+        // Degenerate: there are no facets to choose vertices from, so every point is kept
+        for ( std::size_t point_id = end_members.size(); point_id < hull.point_count(); ++point_id ) {
+            points.push_back ( hull.point ( point_id ) );
+        }
+    }
+    else {
+        std::set<std::size_t> vertices;
+        const std::vector<LowerConvexHull::Facet> facets = hull.lower_facets();
+        for ( auto facet = facets.cbegin(); facet != facets.cend(); ++facet ) {
+            vertices.insert ( facet->vertices.begin(), facet->vertices.end() );
+        }
+        for ( auto vertex = vertices.cbegin(); vertex != vertices.cend(); ++vertex ) {
+            if ( *vertex >= end_members.size() && *vertex < hull.point_count() ) {
+                points.push_back ( hull.point ( *vertex ) );
+            }
+        }
+    }
+    // Later queries, e.g., by the internal hull, find these energies in the cache
+    for ( std::size_t i = end_members.size(); i < points.size(); ++i ) {
+        energy_cache.insert ( points[i], points[i][point_dimension] );
+    }
+    return points;
+}
+
+// Append the pure end-members of phase to points; their last (energy) coordinate is left at zero
+// Of the end-members related by symmetry, only the one in its fundamental domain is appended
+void AppendPureEndMembers (
+    CompositionSet const &phase,
+    sublattice_set const &sublset,
+    PointCloud<double> &points,
+    SublatticeSymmetry const &symmetry )
+{
+    HOT_PATH_LOGGER ( opt_log, "optimizer" );
+    std::vector<std::vector<std::vector<double>>> pure_end_members, all_permutations;
+    const SublatticeLayout &layout = phase.sublattice_layout();
+    for ( std::size_t sublindex = 0; sublindex < layout.sublattice_count(); ++sublindex ) {
+        const std::size_t number_of_species = layout.species_count ( sublindex );
+        BOOST_ASSERT ( number_of_species > 0 );
+        std::vector<std::vector<double>> sublattice_permutations;
+        const double epsilon_composition = 1e-12;
+        std::vector<double> sub_pt ( number_of_species, epsilon_composition );
+        sub_pt[number_of_species-1] = 1-(number_of_species-1)*epsilon_composition;
+        sublattice_permutations.push_back ( sub_pt );
+        // Here we take advantage of the fact that sub_pt is sorted by construction
+        // We will iterate from (0,0,...,1) to (1,0,...,0)
+        while ( std::next_permutation ( sub_pt.begin(), sub_pt.end() ) ) {
+            sublattice_permutations.push_back ( sub_pt );
+        }
+        all_permutations.emplace_back ( sublattice_permutations );
+    }
+    // Take all combinations of generated points in each sublattice
+    pure_end_members = lattice_complex ( all_permutations );
+    if ( pure_end_members.size() == 1 ) pure_end_members.clear(); // Unary case: already handled by above
+    points.reserve ( points.size() + pure_end_members.size() );
+    std::vector<double> end_member ( points.dimension() );
+    for ( auto &pure_points : pure_end_members ) {
+        // We need to concatenate all the sublattice coordinates in pure_points
+        std::size_t coord_index = 0;
+        for ( auto &coords : pure_points ) {
+            BOOST_ASSERT ( coord_index + coords.size() <= points.dimension() );
+            std::copy ( coords.begin(), coords.end(), end_member.begin() + coord_index );
+            coord_index += coords.size();
+        }
+        if ( !symmetry.canonical ( &end_member[0] ) ) continue;
+        double* const pt = points.push_back();
+        std::copy ( end_member.begin(), end_member.begin() + coord_index, pt );
+        HOT_PATH_LOG_SEV ( opt_log, debug ) << "checking " << point_string ( pt, coord_index );
+    }
+}
+
+namespace {
+// Above this many feasible directions, StabilityMask estimates the smallest eigenvalue of the projected Hessian
+// iteratively; at or below it, Lanczos would need as many Hessian-vector products as there are directions,
+// which costs about as much as the dense Hessian
+constexpr const std::size_t iterative_stability_threshold = 24;
+constexpr const std::size_t max_lanczos_steps = 24;
+constexpr const std::size_t min_lanczos_steps = 8; // before a point is taken as stable
+
+enum class Definiteness { POSITIVE_DEFINITE, INDEFINITE, UNDECIDED };
+
+/* Lanczos iteration on A = transpose(Z)*H*Z, applied as products with Z, the Hessian and transpose(Z),
+ * without forming H or A. After step j the smallest eigenvalue theta of the tridiagonal T_j is an upper
+ * bound on the smallest eigenvalue of A, so theta <= 0 proves that A is not positive definite.
+ * The other way is an estimate: A is taken as positive definite once theta exceeds its residual bound
+ * by a margin relative to the largest eigenvalue of T_j. Anything in between is left UNDECIDED,
+ * for the caller to settle with a Cholesky factorization.
+ */
+Definiteness lanczos_definiteness (
+    CompositionSet const &phase,
+    CompiledBinding const &binding,
+    double const* const x,
+    std::vector<double> const &null_space, // Z, n x m, row-major
+    const std::size_t n,
+    const std::size_t m,
+    CompiledJet &workspace )
+{
+    const std::size_t steps = std::min ( m, max_lanczos_steps );
+    const double margin = 1e-6;
+    std::vector<double> basis ( ( steps + 1 ) * m ); // the Lanczos vectors, one after the other
+    std::vector<double> alpha ( steps ), beta ( steps );
+    std::vector<double> direction ( n ), product ( n ), w ( m );
+    std::vector<double> tridiagonal, vectors;
+    // A fixed start with a component in every direction, so that results do not depend on the thread
+    double norm = 0;
+    for ( std::size_t k = 0; k < m; ++k ) {
+        basis[k] = 1 + 0.5 * std::sin ( 1.0 + k );
+        norm += basis[k] * basis[k];
+    }
+    norm = std::sqrt ( norm );
+    for ( std::size_t k = 0; k < m; ++k ) basis[k] /= norm;
+    for ( std::size_t j = 0; j < steps; ++j ) {
+        double const* const q = &basis[j*m];
+        // w = transpose(Z) * H * Z * q
+        for ( std::size_t i = 0; i < n; ++i ) {
+            double sum = 0;
+            for ( std::size_t k = 0; k < m; ++k ) sum += null_space[i*m+k] * q[k];
+            direction[i] = sum;
+        }
+        phase.evaluate_internal_objective_hessian_vector ( binding, x, &direction[0], &product[0], workspace );
+        std::fill ( w.begin(), w.end(), 0.0 );
+        for ( std::size_t i = 0; i < n; ++i ) {
+            for ( std::size_t k = 0; k < m; ++k ) w[k] += null_space[i*m+k] * product[i];
+        }
+        double a = 0;
+        for ( std::size_t k = 0; k < m; ++k ) a += w[k] * q[k];
+        alpha[j] = a;
+        // Full reorthogonalization against all previous vectors; the basis is small
+        for ( std::size_t l = 0; l <= j; ++l ) {
+            double const* const ql = &basis[l*m];
+            double dot = 0;
+            for ( std::size_t k = 0; k < m; ++k ) dot += w[k] * ql[k];
+            for ( std::size_t k = 0; k < m; ++k ) w[k] -= dot * ql[k];
+        }
+        double b = 0;
+        for ( std::size_t k = 0; k < m; ++k ) b += w[k] * w[k];
+        b = std::sqrt ( b );
+        beta[j] = b;
+
+        // Ritz values of T_j
+        const std::size_t size = j + 1;
+        tridiagonal.assign ( size * size, 0.0 );
+        vectors.resize ( size * size );
+        for ( std::size_t k = 0; k < size; ++k ) {
+            tridiagonal[k*size+k] = alpha[k];
+            if ( k + 1 < size ) tridiagonal[k*size+k+1] = tridiagonal[ ( k+1 ) *size+k] = beta[k];
+        }
+        small_matrix_kernels::jacobi_eigen ( &tridiagonal[0], &vectors[0], size );
+        std::size_t smallest = 0;
+        double largest = 0;
+        for ( std::size_t k = 0; k < size; ++k ) {
+            if ( tridiagonal[k*size+k] < tridiagonal[smallest*size+smallest] ) smallest = k;
+            largest = std::max ( largest, std::fabs ( tridiagonal[k*size+k] ) );
+        }
+        const double theta = tridiagonal[smallest*size+smallest];
+        if ( !( theta > 0 ) ) return Definiteness::INDEFINITE;
+        // The smallest Ritz value is within residual of an eigenvalue of A; once it has settled that far above
+        // zero, it is taken for the smallest one
+        const double residual = b * std::fabs ( vectors[j*size+smallest] );
+        if ( size >= std::min ( m, min_lanczos_steps ) && theta - residual > margin * largest ) {
+            return Definiteness::POSITIVE_DEFINITE;
+        }
+        if ( !( b > std::numeric_limits<double>::epsilon() * largest ) ) {
+            // The Krylov space is invariant: T_j has all the eigenvalues of A on it, but not necessarily the smallest one
+            return size == m ? Definiteness::POSITIVE_DEFINITE : Definiteness::UNDECIDED;
+        }
+        double* const next = &basis[ ( j+1 ) *m];
+        for ( std::size_t k = 0; k < m; ++k ) next[k] = w[k] / b;
+    }
+    return Definiteness::UNDECIDED;
+}
+}
+
+std::vector<bool> StabilityMask (
+    CompositionSet const &phase,
+    evalconditions const& conditions,
+    PointCloud<double> const &points )
+{
+    // Points per block; the Hessians of one block stay in cache while they are projected and factorized
+    constexpr const std::size_t block_size = 64;
+    const std::size_t n = points.dimension();
+    std::vector<bool> stable ( points.size(), false );
+    if ( n == 0 ) {
+        return stable; // skip empty (invalid) points
+    }
+    // NOTE: For this calculation we consider only the linear constraints for an isolated phase (e.g., site fraction balances)
+    //        NOTE: This is the projected Hessian method (Nocedal and Wright, 2006, ch. 12.4, p.349)
+    //        Because the constraints are linear, there is no constraint contribution to the Hessian.
+    //        That means that the Hessian of the Lagrangian is just the Hessian of the objective function.
+    // Z is the constraint null space matrix; it is the same for every point, so it is copied to a dense array once
+    const boost::numeric::ublas::matrix<double> &Z = phase.get_constraint_null_space_matrix();
+    BOOST_ASSERT ( Z.size1() == n );
+    const std::size_t m = Z.size2();
+    std::vector<double> null_space ( n * m );
+    for ( std::size_t i = 0; i < n; ++i ) {
+        for ( std::size_t k = 0; k < m; ++k ) null_space[i*m+k] = Z ( i,k );
+    }
+
+    const CompiledBinding binding = phase.bind ( conditions, phase.get_variable_map() );
+    CompiledJet workspace = phase.jet_workspace ( true );
+    std::vector<double> hessian_times_z ( n * m );
+    // Set Hproj = transpose(Z)*(L'')*Z
+    auto project = [&] ( double const* const H, double* const Hproj ) {
+        std::fill ( hessian_times_z.begin(), hessian_times_z.end(), 0.0 );
+        for ( std::size_t i = 0; i < n; ++i ) {
+            for ( std::size_t j = 0; j < n; ++j ) {
+                const double h = H[i*n+j];
+                for ( std::size_t k = 0; k < m; ++k ) hessian_times_z[i*m+k] += h * null_space[j*m+k];
+            }
+        }
+        std::fill ( Hproj, Hproj + m*m, 0.0 );
+        for ( std::size_t i = 0; i < n; ++i ) {
+            for ( std::size_t k = 0; k < m; ++k ) {
+                const double z = null_space[i*m+k];
+                for ( std::size_t l = 0; l < m; ++l ) Hproj[k*m+l] += z * hessian_times_z[i*m+l];
+            }
+        }
+    };
+
+    if ( m > iterative_stability_threshold && !phase.has_native_kernels() ) {
+        // Large phases (e.g., sigma or Laves with many species): forming Hproj costs n Hessian-vector products
+        // and O(n^2 m + m^3) arithmetic per point, Lanczos a few dozen products; most points are decided by it
+        std::vector<double> hessian, projected;
+        for ( std::size_t p = 0; p < points.size(); ++p ) {
+            const Definiteness definiteness = lanczos_definiteness ( phase, binding, points[p], null_space, n, m, workspace );
+            if ( definiteness != Definiteness::UNDECIDED ) {
+                stable[p] = definiteness == Definiteness::POSITIVE_DEFINITE;
+                continue;
+            }
+            // Too close to the limit of stability to tell
+            hessian.resize ( n * n );
+            projected.resize ( m * m );
+            phase.evaluate_internal_objective_hessian ( binding, points[p], &hessian[0], workspace );
+            project ( &hessian[0], &projected[0] );
+            stable[p] = cholesky_positive_definite ( &projected[0], m );
+        }
+        return stable;
+    }
+
+    std::vector<double> hessians ( block_size * n * n );
+    std::vector<double> projected ( block_size * m * m );
+    std::vector<char> positive_definite ( block_size );
+    for ( std::size_t first = 0; first < points.size(); first += block_size ) {
+        const std::size_t count = std::min ( block_size, points.size() - first );
+        for ( std::size_t p = 0; p < count; ++p ) {
+            phase.evaluate_internal_objective_hessian ( binding, points[first + p], &hessians[p*n*n], workspace );
+        }
+        for ( std::size_t p = 0; p < count; ++p ) {
+            project ( &hessians[p*n*n], &projected[p*m*m] );
+        }
+        // A Cholesky factorization of Hproj will only succeed if the matrix is positive definite
+        positive_definite_mask ( &projected[0], count, m, &positive_definite[0] );
+        for ( std::size_t p = 0; p < count; ++p ) {
+            stable[first + p] = positive_definite[p];
+        }
+    }
+    return stable;
+}
+
 // Recursive function for searching composition space for minima
 // Input: Simplex that bounds a positive definite search region (SimplexCollection is used for multiple sublattices)
 // Input: Recursion depth
-// Output: Vector of minimum points
-std::vector<std::vector<double>> AdaptiveSearchND (
+// Output: Minimum points (with energy coordinate) are appended to minima
+// Only reads phase, so searches of different regions can run concurrently
+void AdaptiveSearchND (
     CompositionSet const &phase,
     evalconditions const& conditions,
     const SimplexCollection &search_region,
     const std::size_t refinement_subdivisions_per_axis,
     const std::size_t depth,
+    PointCloud<double> &minima,
     const double old_gradient_mag )
 {
     using namespace boost::numeric::ublas;
-    typedef boost::numeric::ublas::vector<double> ublas_vector;
     typedef boost::numeric::ublas::matrix<double> ublas_matrix;
     BOOST_ASSERT ( depth > 0 );
     constexpr const double gradient_magnitude_threshold = 1000;
     constexpr const std::size_t max_depth = 5;
-    std::vector<std::vector<double>> minima;
     double mag = std::numeric_limits<double>::max();
 
-    std::vector<SimplexCollection> simplex_combinations, new_simplices;
-    auto chosen_simplex = new_simplices.cend(); // iterator to the current smallest-gradient simplex
+    std::vector<SimplexCollection> simplex_combinations;
 
     // simplex_subdivide() the simplices in all the active sublattices
     for ( const NDSimplex &simp : search_region ) {
         simplex_combinations.emplace_back ( simp.simplex_subdivide ( refinement_subdivisions_per_axis ) );
     }
-    // lattice_complex() the result to generate all the combinations in the sublattices
-    new_simplices = lattice_complex ( simplex_combinations );
+    // Enumerate all the combinations in the sublattices, without storing them
+    const SimplexLattice new_simplices ( std::move ( simplex_combinations ) );
+    std::size_t chosen_simplex = 0; // index of the current smallest-gradient simplex
 
-    // new_simplices now contains a vector of SimplexCollections
-    // It's a SimplexCollection instead of an NDSimplex because there is one NDSimplex per sublattice
+    // Each combination of new_simplices is a SimplexCollection instead of an NDSimplex because there is one NDSimplex per sublattice
     // The centroids of each NDSimplex are concatenated (with the dependent component) to get the active point
+    // The energy and its gradient come out of the same pass over the models
+    const CompiledBinding binding = phase.bind ( conditions, phase.get_variable_map() );
+    CompiledJet workspace = phase.jet_workspace ( false );
+    std::vector<double> raw_gradient ( phase.get_variable_map().size() );
+    std::vector<double> pt ( raw_gradient.size() );
+    BOOST_ASSERT ( new_simplices.point_dimension() == pt.size() );
+    // The gradient projector is the same for every point, so it is copied to a dense array once
+    const ublas_matrix &projector = phase.get_gradient_projector();
+    BOOST_ASSERT ( projector.size1() == raw_gradient.size() && projector.size2() == raw_gradient.size() );
+    const std::vector<double> dense_projector ( &projector.data() [0], &projector.data() [0] + projector.size1() * projector.size2() );
+    BOOST_ASSERT ( minima.dimension() == raw_gradient.size() + 1 );
+    minima.reserve ( minima.size() + new_simplices.size() );
     // Calculate the gradient for each newly-created simplex
-    for ( auto sc = new_simplices.cbegin(); sc != new_simplices.cend(); ++sc ) {
-        std::vector<double> pt = generate_point ( *sc );
-        std::vector<double> raw_gradient;
+    for ( std::size_t sc = 0; sc < new_simplices.size(); ++sc ) {
+        new_simplices.centroid ( sc, &pt[0] );
         double temp_magnitude = 0;
-        double objective = phase.evaluate_objective ( conditions, phase.get_variable_map(), &pt[0] );
-        // Calculate the objective gradient (L') for the centroid of the active simplex
-        raw_gradient = phase.evaluate_internal_objective_gradient ( conditions, &pt[0] );
+        // Calculate the objective and its gradient (L') for the centroid of the active simplex
+        const double objective = phase.evaluate_internal_objective_gradient ( binding, &pt[0], &raw_gradient[0], workspace );
         // Project the raw gradient into the null space of constraints
         // This will leave only the gradient in the feasible directions
-        ublas_vector projected_gradient ( raw_gradient.size() );
-        std::move ( raw_gradient.begin(), raw_gradient.end(), projected_gradient.begin() );
-        //std::cout << "phase.get_gradient_projector.size1() = " << phase.get_gradient_projector().size1() << std::endl;
-        projected_gradient = prod ( phase.get_gradient_projector(), projected_gradient );
-        //std::cout << "projected_gradient.size() = " << projected_gradient.size() << std::endl;
-
         // Calculate magnitude of projected gradient
-        temp_magnitude = norm_2 ( projected_gradient );
+        const std::size_t n = raw_gradient.size();
+        for ( std::size_t i = 0; i < n; ++i ) {
+            double projected_coord = 0;
+            for ( std::size_t j = 0; j < n; ++j ) projected_coord += dense_projector[i*n+j] * raw_gradient[j];
+            temp_magnitude += projected_coord * projected_coord;
+        }
+        temp_magnitude = std::sqrt ( temp_magnitude );
         //std::cout << temp_magnitude << std::endl;
         // If this is smaller than the known point, switch to this point
         if ( temp_magnitude < mag ) {
@@ -370,8 +832,9 @@ std::vector<std::vector<double>> AdaptiveSearchND (
             mag = temp_magnitude;
         }
         // Add every point to mesh, with energy coordinate
-        pt.emplace_back ( objective );
-        minima.emplace_back( std::move( pt ) );
+        double* const mesh_point = minima.push_back();
+        std::copy ( pt.begin(), pt.end(), mesh_point );
+        mesh_point[pt.size()] = objective;
     }
     
     const bool poor_progress = ( mag > 5000 ) && ( old_gradient_mag > 5000 ) && ( depth > 4 );
@@ -379,27 +842,13 @@ std::vector<std::vector<double>> AdaptiveSearchND (
     if ( mag < gradient_magnitude_threshold || depth >= max_depth || poor_progress ) {
         // We've hit our terminating condition
         // It may or may not be a minimum, but it's the best we can find here
-        return minima;
+        return;
     } else {
         // Keep searching for a minimum by subdividing our chosen_simplex
         // We save a lot of time by only subdividing chosen_simplex!
-        std::vector<std::vector<double>> recursive_minima = AdaptiveSearchND ( phase, conditions, *chosen_simplex, depth+1, mag );
-        // Add the found minima to the list of known minima
-        minima.reserve ( minima.size() +recursive_minima.size() );
-        minima.insert ( minima.end(), std::make_move_iterator ( recursive_minima.begin() ),  std::make_move_iterator ( recursive_minima.end() ) );
-        return minima;
-    }
-}
-
-// Generate the full coordinates (with dependent dimensions) from the SimplexCollection of a region
-std::vector<double> generate_point ( const SimplexCollection &simpcol ) {
-    std::vector<double> pt;
-    for ( const NDSimplex& simp : simpcol ) {
-        // Generate the current point (pt) from all the simplices in each sublattice
-        std::vector<double> sub_pt = simp.centroid_with_dependent_component();
-        pt.insert ( pt.end(),std::make_move_iterator ( sub_pt.begin() ),std::make_move_iterator ( sub_pt.end() ) );
+        // The found minima are added to the list of known minima
+        AdaptiveSearchND ( phase, conditions, new_simplices.combination ( chosen_simplex ), refinement_subdivisions_per_axis, depth+1, minima, mag );
     }
-    return pt;
 }
 
 } // namespace details
@@ -0,0 +1,455 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Incremental (Beneath-Beyond) convex hull
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/optimizer/utils/lower_convex_hull.hpp"
+#include "libgibbs/include/utils/small_matrix.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace Optimizer { namespace details {
+
+namespace {
+const std::size_t no_facet = std::numeric_limits<std::size_t>::max();
+// Vertex id of the point at infinite energy in lower_only mode
+const std::size_t point_at_infinity = std::numeric_limits<std::size_t>::max() - 1;
+// Distances below this (relative to the largest coordinate) are treated as zero
+const double relative_distance_tolerance = 1e-11;
+// Facets whose normal has a smaller energy component are vertical, not part of the lower hull
+const double vertical_normal_tolerance = 1e-12;
+}
+
+LowerConvexHull::LowerConvexHull (
+    const std::size_t point_dimension,
+    const std::set<std::size_t> &dropped_dimensions,
+    const bool lower_only ) :
+    full_dimension ( point_dimension ),
+    points ( point_dimension ),
+    initialized ( false ),
+    lower_only ( lower_only ),
+    epsilon ( 0 ),
+    max_coordinate ( 0 )
+{
+    for ( std::size_t dim = 0; dim < full_dimension; ++dim ) {
+        if ( dropped_dimensions.find ( dim ) == dropped_dimensions.end() ) kept_dimensions.push_back ( dim );
+    }
+    reduced_dimension = kept_dimensions.size();
+    BOOST_ASSERT ( reduced_dimension > 0 );
+    reduced_points = PointCloud<double> ( reduced_dimension );
+}
+
+void LowerConvexHull::add_points ( const PointCloud<double> &new_points )
+{
+    BOOST_ASSERT ( new_points.dimension() == full_dimension );
+    const std::size_t first_id = points.size();
+    points.append ( new_points );
+    reduced_points.reserve ( points.size() );
+    for ( std::size_t point_id = first_id; point_id < points.size(); ++point_id ) {
+        double const* const pt = points[point_id];
+        double* const reduced_pt = reduced_points.push_back();
+        for ( std::size_t dim = 0; dim < reduced_dimension; ++dim ) {
+            reduced_pt[dim] = pt[kept_dimensions[dim]];
+            max_coordinate = std::max ( max_coordinate, std::fabs ( reduced_pt[dim] ) );
+        }
+    }
+    // The tolerance only grows, so earlier decisions stay valid
+    epsilon = relative_distance_tolerance * std::max ( 1.0, max_coordinate ) * reduced_dimension;
+
+    // Inserting in sorted order keeps consecutive points close together,
+    // so the facets created by one insertion usually contain the next visible facet
+    std::vector<std::size_t> insertion_order;
+    for ( std::size_t point_id = first_id; point_id < points.size(); ++point_id ) insertion_order.push_back ( point_id );
+    std::sort ( insertion_order.begin(), insertion_order.end(), [this] ( const std::size_t a, const std::size_t b ) {
+        return std::lexicographical_compare (
+                   reduced_coordinates ( a ), reduced_coordinates ( a ) + reduced_dimension,
+                   reduced_coordinates ( b ), reduced_coordinates ( b ) + reduced_dimension );
+    } );
+    for ( const std::size_t point_id : insertion_order ) {
+        if ( initialized ) insert_point ( point_id );
+        else pending_points.push_back ( point_id );
+    }
+    if ( !initialized ) try_initialize();
+}
+
+double LowerConvexHull::distance ( const HullFacet &facet, const std::size_t point_id ) const
+{
+    if ( point_id == point_at_infinity ) {
+        // Only facets facing up can see a point at infinite energy
+        return facet.normal.back() > vertical_normal_tolerance ? std::numeric_limits<double>::infinity() : 0;
+    }
+    double const* const coords = reduced_coordinates ( point_id );
+    double result = facet.offset;
+    for ( std::size_t dim = 0; dim < reduced_dimension; ++dim ) {
+        result += facet.normal[dim] * coords[dim];
+    }
+    return result;
+}
+
+void LowerConvexHull::try_initialize()
+{
+    // Build the initial simplex from the pending points, each time choosing the point
+    // farthest from the affine span of the points chosen so far
+    if ( pending_points.size() <= reduced_dimension ) return;
+    const std::size_t base_id = pending_points.front();
+    double const* const base = reduced_coordinates ( base_id );
+    std::vector<std::size_t> simplex { base_id };
+    std::vector<PointType> basis; // orthonormal basis of the span
+    PointType residual ( reduced_dimension );
+    while ( simplex.size() <= reduced_dimension ) {
+        std::size_t best_id = no_facet;
+        double best_norm = 100 * epsilon;
+        PointType best_residual;
+        for ( const std::size_t point_id : pending_points ) {
+            double const* const coords = reduced_coordinates ( point_id );
+            for ( std::size_t dim = 0; dim < reduced_dimension; ++dim ) residual[dim] = coords[dim] - base[dim];
+            for ( const PointType &axis : basis ) {
+                double projection = 0;
+                for ( std::size_t dim = 0; dim < reduced_dimension; ++dim ) projection += residual[dim] * axis[dim];
+                for ( std::size_t dim = 0; dim < reduced_dimension; ++dim ) residual[dim] -= projection * axis[dim];
+            }
+            double norm = 0;
+            for ( const double coord : residual ) norm += coord * coord;
+            norm = std::sqrt ( norm );
+            if ( norm > best_norm ) {
+                best_norm = norm;
+                best_id = point_id;
+                best_residual = residual;
+            }
+        }
+        if ( best_id == no_facet ) return; // the points do not span the space (yet)
+        for ( double &coord : best_residual ) coord /= best_norm;
+        basis.emplace_back ( std::move ( best_residual ) );
+        simplex.push_back ( best_id );
+    }
+
+    interior_point.assign ( reduced_dimension, 0 );
+    for ( const std::size_t point_id : simplex ) {
+        double const* const coords = reduced_coordinates ( point_id );
+        for ( std::size_t dim = 0; dim < reduced_dimension; ++dim ) interior_point[dim] += coords[dim] / simplex.size();
+    }
+    std::vector<std::size_t> simplex_facets;
+    for ( std::size_t omitted = 0; omitted < simplex.size(); ++omitted ) {
+        std::vector<std::size_t> vertices;
+        for ( std::size_t vertex = 0; vertex < simplex.size(); ++vertex ) {
+            if ( vertex != omitted ) vertices.push_back ( simplex[vertex] );
+        }
+        simplex_facets.push_back ( new_facet ( vertices ) );
+    }
+    link_facets ( simplex_facets );
+    recent_facets = simplex_facets;
+    initialized = true;
+    if ( lower_only ) insert_point ( point_at_infinity );
+
+    const std::set<std::size_t> simplex_ids ( simplex.begin(), simplex.end() );
+    std::vector<std::size_t> remaining_points;
+    remaining_points.swap ( pending_points );
+    for ( const std::size_t point_id : remaining_points ) {
+        if ( simplex_ids.find ( point_id ) == simplex_ids.end() ) insert_point ( point_id );
+    }
+}
+
+void LowerConvexHull::insert_point ( const std::size_t point_id )
+{
+    // Find one facet that can see the point; the set of visible facets is connected
+    const std::size_t start_facet = find_visible_facet ( point_id );
+    if ( start_facet == no_facet ) return; // inside the hull
+
+    std::vector<std::size_t> visible_facets { start_facet };
+    facets[start_facet].visible = true;
+    for ( std::size_t i = 0; i < visible_facets.size(); ++i ) {
+        for ( const std::size_t neighbor : facets[visible_facets[i]].neighbors ) {
+            if ( !facets[neighbor].visible && distance ( facets[neighbor], point_id ) > epsilon ) {
+                facets[neighbor].visible = true;
+                visible_facets.push_back ( neighbor );
+            }
+        }
+    }
+
+    // Each ridge of a horizon ridge must be shared with exactly one other horizon ridge, or the new facets
+    // would not close up; rounding can make the visible facets touch at a single vertex, for example
+    std::map<std::vector<std::size_t>, std::size_t> horizon_boundary;
+    for ( const std::size_t facet_id : visible_facets ) {
+        for ( std::size_t vertex = 0; vertex < reduced_dimension; ++vertex ) {
+            if ( facets[facets[facet_id].neighbors[vertex]].visible ) continue;
+            for ( std::size_t omitted = 0; omitted < reduced_dimension; ++omitted ) {
+                if ( omitted == vertex ) continue;
+                std::vector<std::size_t> boundary;
+                for ( std::size_t other = 0; other < reduced_dimension; ++other ) {
+                    if ( other != vertex && other != omitted ) boundary.push_back ( facets[facet_id].vertices[other] );
+                }
+                std::sort ( boundary.begin(), boundary.end() );
+                ++horizon_boundary[boundary];
+            }
+        }
+    }
+    for ( const auto &boundary : horizon_boundary ) {
+        if ( boundary.second == 2 ) continue;
+        for ( const std::size_t facet_id : visible_facets ) facets[facet_id].visible = false;
+        BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Convex hull is too degenerate to add the point; the hull is unchanged" ) );
+    }
+
+    // Connect the point to every ridge on the horizon
+    std::vector<std::size_t> cone_facets;
+    for ( const std::size_t facet_id : visible_facets ) {
+        for ( std::size_t vertex = 0; vertex < reduced_dimension; ++vertex ) {
+            const std::size_t neighbor = facets[facet_id].neighbors[vertex];
+            if ( facets[neighbor].visible ) continue;
+            std::vector<std::size_t> vertices = facets[facet_id].vertices;
+            vertices[vertex] = point_id; // the new facet is opposite the neighbor at the same position
+            const std::size_t cone_facet = new_facet ( vertices );
+            facets[cone_facet].neighbors[vertex] = neighbor;
+            std::replace ( facets[neighbor].neighbors.begin(), facets[neighbor].neighbors.end(), facet_id, cone_facet );
+            cone_facets.push_back ( cone_facet );
+        }
+    }
+    for ( const std::size_t facet_id : visible_facets ) {
+        facets[facet_id].alive = false;
+        facets[facet_id].visible = false;
+        free_facets.push_back ( facet_id );
+    }
+    link_facets ( cone_facets );
+    recent_facets = std::move ( cone_facets );
+}
+
+std::size_t LowerConvexHull::find_visible_facet ( const std::size_t point_id ) const
+{
+    for ( const std::size_t facet_id : recent_facets ) {
+        if ( facets[facet_id].alive && distance ( facets[facet_id], point_id ) > epsilon ) return facet_id;
+    }
+    if ( point_id == point_at_infinity || reduced_dimension < 2 || recent_facets.empty() || !facets[recent_facets.front()].alive ) {
+        for ( std::size_t facet_id = 0; facet_id < facets.size(); ++facet_id ) {
+            if ( facets[facet_id].alive && distance ( facets[facet_id], point_id ) > epsilon ) return facet_id;
+        }
+        return no_facet;
+    }
+
+    // Walk from a recent facet to the facet where the ray from the interior point through the point
+    // leaves the hull. The ray leaves facet f's half-space at parameter 1/rate(f), where
+    // rate(f) = normal . (point - interior_point) / -interior_distance; rate(f) is linear in the vertex
+    // of the polar polytope that f corresponds to, so, like the simplex method, climbing to neighbors
+    // with a larger rate reaches the largest rate, which is the exit facet, without visiting every facet
+    double const* const coords = reduced_coordinates ( point_id );
+    PointType direction ( reduced_dimension );
+    for ( std::size_t dim = 0; dim < reduced_dimension; ++dim ) direction[dim] = coords[dim] - interior_point[dim];
+    const auto rate = [this, &direction] ( const std::size_t facet_id ) {
+        double slope = 0;
+        for ( std::size_t dim = 0; dim < reduced_dimension; ++dim ) slope += facets[facet_id].normal[dim] * direction[dim];
+        return slope / -facets[facet_id].interior_distance;
+    };
+    // Facets in one plane have the same rate up to rounding; the walk crosses such a plateau breadth first
+    std::vector<std::size_t> plateau { recent_facets.front() };
+    double exit_rate = rate ( plateau.front() );
+    for ( std::size_t i = 0; i < plateau.size(); ) {
+        const double tolerance = relative_distance_tolerance * std::max ( 1.0, std::fabs ( exit_rate ) );
+        std::size_t climb_facet = no_facet;
+        for ( const std::size_t neighbor : facets[plateau[i]].neighbors ) {
+            const double neighbor_rate = rate ( neighbor );
+            if ( neighbor_rate > exit_rate + tolerance ) {
+                climb_facet = neighbor;
+                exit_rate = neighbor_rate;
+                break;
+            }
+            if ( neighbor_rate >= exit_rate - tolerance && std::find ( plateau.begin(), plateau.end(), neighbor ) == plateau.end() ) {
+                plateau.push_back ( neighbor );
+            }
+        }
+        if ( climb_facet == no_facet ) {
+            ++i;
+        } else {
+            plateau.assign ( 1, climb_facet );
+            i = 0;
+        }
+    }
+    // A point within epsilon of a ridge may be farther from the neighbor than from the exit facet
+    for ( const std::size_t facet_id : plateau ) {
+        if ( distance ( facets[facet_id], point_id ) > epsilon ) return facet_id;
+    }
+    for ( const std::size_t facet_id : plateau ) {
+        for ( const std::size_t neighbor : facets[facet_id].neighbors ) {
+            if ( distance ( facets[neighbor], point_id ) > epsilon ) return neighbor;
+        }
+    }
+    return no_facet;
+}
+
+std::size_t LowerConvexHull::new_facet ( const std::vector<std::size_t> &vertices )
+{
+    std::size_t facet_id;
+    if ( !free_facets.empty() ) {
+        facet_id = free_facets.back();
+        free_facets.pop_back();
+    } else {
+        facet_id = facets.size();
+        facets.emplace_back();
+    }
+    HullFacet &facet = facets[facet_id];
+    facet.vertices = vertices;
+    facet.neighbors.assign ( reduced_dimension, no_facet );
+    facet.alive = true;
+    facet.visible = false;
+    calculate_hyperplane ( facet );
+    return facet_id;
+}
+
+void LowerConvexHull::link_facets ( const std::vector<std::size_t> &facet_ids )
+{
+    // Facets sharing all but one vertex are neighbors
+    std::map<std::vector<std::size_t>, std::pair<std::size_t, std::size_t>> open_ridges;
+    for ( const std::size_t facet_id : facet_ids ) {
+        for ( std::size_t vertex = 0; vertex < reduced_dimension; ++vertex ) {
+            if ( facets[facet_id].neighbors[vertex] != no_facet ) continue;
+            std::vector<std::size_t> ridge;
+            for ( std::size_t other = 0; other < reduced_dimension; ++other ) {
+                if ( other != vertex ) ridge.push_back ( facets[facet_id].vertices[other] );
+            }
+            std::sort ( ridge.begin(), ridge.end() );
+            auto ridge_find = open_ridges.find ( ridge );
+            if ( ridge_find == open_ridges.end() ) {
+                open_ridges.emplace ( std::move ( ridge ), std::make_pair ( facet_id, vertex ) );
+            } else {
+                facets[facet_id].neighbors[vertex] = ridge_find->second.first;
+                facets[ridge_find->second.first].neighbors[ridge_find->second.second] = facet_id;
+                open_ridges.erase ( ridge_find );
+            }
+        }
+    }
+    if ( !open_ridges.empty() ) {
+        BOOST_THROW_EXCEPTION ( internal_error() << str_errinfo ( "Convex hull facets do not close" ) );
+    }
+}
+
+void LowerConvexHull::calculate_hyperplane ( HullFacet &facet ) const
+{
+    // The normal is the null vector of the edge vectors from the first finite vertex,
+    // found by Gaussian elimination with full pivoting
+    // The edge to the point at infinity is the energy axis, which makes the facet vertical
+    const std::size_t rows = reduced_dimension - 1;
+    const std::size_t cols = reduced_dimension;
+    const std::size_t origin_vertex = std::distance ( facet.vertices.begin(),
+                                      std::find_if ( facet.vertices.begin(), facet.vertices.end(),
+                                              [] ( const std::size_t vertex ) { return vertex != point_at_infinity; } ) );
+    if ( origin_vertex == facet.vertices.size() ) {
+        // Only possible in one dimension: the "facet" is the point at infinity itself
+        facet.normal.assign ( cols, 1 );
+        facet.offset = -std::numeric_limits<double>::infinity();
+        facet.interior_distance = facet.offset;
+        return;
+    }
+    double const* const origin = reduced_coordinates ( facet.vertices[origin_vertex] );
+    std::vector<double> edges ( rows * cols );
+    for ( std::size_t row = 0, vertex = 0; vertex < facet.vertices.size(); ++vertex ) {
+        if ( vertex == origin_vertex ) continue;
+        if ( facet.vertices[vertex] == point_at_infinity ) {
+            for ( std::size_t col = 0; col < cols; ++col ) edges[row * cols + col] = ( col == cols - 1 ) ? 1 : 0;
+        } else {
+            double const* const coords = reduced_coordinates ( facet.vertices[vertex] );
+            for ( std::size_t col = 0; col < cols; ++col ) edges[row * cols + col] = coords[col] - origin[col];
+        }
+        ++row;
+    }
+    std::vector<std::size_t> pivot_columns;
+    std::vector<bool> column_used ( cols, false );
+    for ( std::size_t step = 0; step < rows; ++step ) {
+        std::size_t pivot_row = step, pivot_col = 0;
+        double pivot_value = -1;
+        for ( std::size_t row = step; row < rows; ++row ) {
+            for ( std::size_t col = 0; col < cols; ++col ) {
+                if ( !column_used[col] && std::fabs ( edges[row * cols + col] ) > pivot_value ) {
+                    pivot_value = std::fabs ( edges[row * cols + col] );
+                    pivot_row = row;
+                    pivot_col = col;
+                }
+            }
+        }
+        for ( std::size_t col = 0; col < cols; ++col ) std::swap ( edges[step * cols + col], edges[pivot_row * cols + col] );
+        column_used[pivot_col] = true;
+        pivot_columns.push_back ( pivot_col );
+        const double pivot = edges[step * cols + pivot_col];
+        if ( pivot == 0 ) continue; // degenerate facet; its normal is arbitrary in this direction
+        for ( std::size_t col = 0; col < cols; ++col ) edges[step * cols + col] /= pivot;
+        for ( std::size_t row = 0; row < rows; ++row ) {
+            if ( row == step ) continue;
+            const double factor = edges[row * cols + pivot_col];
+            if ( factor == 0 ) continue;
+            for ( std::size_t col = 0; col < cols; ++col ) edges[row * cols + col] -= factor * edges[step * cols + col];
+        }
+    }
+    const std::size_t free_col = std::distance ( column_used.begin(), std::find ( column_used.begin(), column_used.end(), false ) );
+    facet.normal.assign ( cols, 0 );
+    facet.normal[free_col] = 1;
+    for ( std::size_t row = 0; row < rows; ++row ) {
+        facet.normal[pivot_columns[row]] = -edges[row * cols + free_col];
+    }
+    double norm = 0;
+    for ( const double coord : facet.normal ) norm += coord * coord;
+    norm = std::sqrt ( norm );
+    for ( double &coord : facet.normal ) coord /= norm;
+    facet.offset = 0;
+    for ( std::size_t col = 0; col < cols; ++col ) facet.offset -= facet.normal[col] * origin[col];
+
+    // Orient the normal away from the interior
+    facet.interior_distance = facet.offset;
+    for ( std::size_t col = 0; col < cols; ++col ) facet.interior_distance += facet.normal[col] * interior_point[col];
+    if ( facet.interior_distance > 0 ) {
+        for ( double &coord : facet.normal ) coord = -coord;
+        facet.offset = -facet.offset;
+        facet.interior_distance = -facet.interior_distance;
+    }
+}
+
+std::vector<LowerConvexHull::Facet> LowerConvexHull::lower_facets() const
+{
+    std::vector<Facet> result;
+    for ( const HullFacet &facet : facets ) {
+        // This also skips every facet containing the point at infinity, which are vertical
+        if ( !facet.alive || facet.normal.back() > -vertical_normal_tolerance ) continue;
+        BOOST_ASSERT ( std::find ( facet.vertices.begin(), facet.vertices.end(), point_at_infinity ) == facet.vertices.end() );
+        Facet lower_facet;
+        lower_facet.vertices = facet.vertices;
+        lower_facet.normal = facet.normal;
+        lower_facet.offset = facet.offset;
+        result.emplace_back ( std::move ( lower_facet ) );
+    }
+    return result;
+}
+
+double LowerConvexHull::facet_area ( const Facet &facet ) const
+{
+    // Volume of the (d-1)-simplex: sqrt(det(Gram matrix of the edges)) / (d-1)!
+    const std::size_t edge_count = facet.vertices.size() - 1;
+    double const* const origin = reduced_coordinates ( facet.vertices[0] );
+    std::vector<PointType> edges;
+    for ( std::size_t edge = 0; edge < edge_count; ++edge ) {
+        double const* const coords = reduced_coordinates ( facet.vertices[edge + 1] );
+        PointType edge_vector ( reduced_dimension );
+        for ( std::size_t dim = 0; dim < reduced_dimension; ++dim ) edge_vector[dim] = coords[dim] - origin[dim];
+        edges.emplace_back ( std::move ( edge_vector ) );
+    }
+    std::vector<double> gram ( edge_count * edge_count );
+    for ( std::size_t i = 0; i < edge_count; ++i ) {
+        for ( std::size_t j = 0; j < edge_count; ++j ) {
+            double dot = 0;
+            for ( std::size_t dim = 0; dim < reduced_dimension; ++dim ) dot += edges[i][dim] * edges[j][dim];
+            gram[i * edge_count + j] = dot;
+        }
+    }
+    // The Gram matrix is symmetric positive semidefinite; rounding may leave a tiny negative determinant
+    const double determinant = dense_determinant ( gram.data(), edge_count );
+    if ( !( determinant > 0 ) ) return 0;
+    double factorial = 1;
+    for ( std::size_t i = 2; i <= edge_count; ++i ) factorial *= i;
+    return std::sqrt ( determinant ) / factorial;
+}
+
+} // namespace details
+} // namespace Optimizer
@@ -0,0 +1,168 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// definition for following the boundaries of a two-phase region
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/phase_boundary.hpp"
+#include "libgibbs/include/equilibrium.hpp"
+#include "libtdb/include/database.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include "libtdb/include/logging.hpp"
+#include <boost/exception/diagnostic_information.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <utility>
+
+using Optimizer::CompactEquilibriumResult;
+
+namespace {
+const double minimum_phase_fraction = 1e-6; // as CompactEquilibriumResult::stable_phases()
+
+bool is_state_variable(const std::string &name) {
+	return name.size() == 1;
+}
+
+// The component of a variable named X(component)
+std::string component_of(const std::string &name) {
+	return name.substr(2, name.size() - 3);
+}
+
+void check_variable(const std::string &name) {
+	if (!(is_state_variable(name) || (name.size() > 3 && name.compare(0, 2, "X(") == 0 && name.back() == ')'))) {
+		BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("Boundary variables must be state variables or X(component)") << specific_errinfo(name));
+	}
+}
+
+void set_condition(evalconditions &conds, const std::string &name, const double value) {
+	if (is_state_variable(name)) conds.statevars[name[0]] = value;
+	else conds.xfrac[component_of(name)] = value;
+}
+
+// The composition sets above the minimum phase fraction
+std::vector<std::string> stable_sets(const CompactEquilibriumResult &result) {
+	std::vector<std::string> names;
+	for (auto i = result.descriptor->phases().cbegin(); i != result.descriptor->phases().cend(); ++i) {
+		if (result.x[i->phase_fraction] > minimum_phase_fraction) names.push_back(i->name);
+	}
+	return names;
+}
+}
+
+BoundaryTracer::BoundaryTracer(const std::string &step_var, const std::string &composition_var) :
+	step_variable(step_var), composition_variable(composition_var) {
+	check_variable(step_variable);
+	check_variable(composition_variable);
+	if (is_state_variable(composition_variable)) {
+		BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("The composition variable of a boundary must be X(component)") << specific_errinfo(composition_variable));
+	}
+	if (step_variable == composition_variable) {
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("The step and composition variables of a boundary must differ") << specific_errinfo(step_variable));
+	}
+}
+
+PhaseBoundary BoundaryTracer::trace(const Database &DB, EquilibriumFactory &factory, const evalconditions &start,
+		const double step, const double limit, const double tolerance) const {
+	BOOST_LOG_NAMED_SCOPE("BoundaryTracer::trace");
+	logger boundary_log(journal::keywords::channel = "optimizer");
+	if (!(step > 0) || !(tolerance > 0)) {
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Boundary step and tolerance must be positive"));
+	}
+	PhaseBoundary boundary;
+	boundary.step_variable = step_variable;
+	boundary.composition_variable = composition_variable;
+
+	// The tie-line of a result, with its ends in the order of boundary.phases; false if it has other phases
+	auto tie_line = [&](const CompactEquilibriumResult &result, const double step_value, TieLine &line) {
+		if (result.stable_phases(minimum_phase_fraction) != boundary.phases) return false;
+		struct End {
+			std::string phase;
+			double composition;
+			double step_coordinate;
+			bool operator<(const End &other) const {
+				return phase != other.phase ? phase < other.phase : composition < other.composition;
+			}
+		};
+		const std::vector<std::string> sets = stable_sets(result);
+		std::vector<End> ends;
+		for (auto i = sets.cbegin(); i != sets.cend(); ++i) {
+			End end;
+			end.phase = i->substr(0, i->find('#')); // composition sets are named PHASE#n
+			end.composition = result.mole_fraction(component_of(composition_variable), *i);
+			end.step_coordinate = is_state_variable(step_variable) ? step_value : result.mole_fraction(component_of(step_variable), *i);
+			ends.push_back(end);
+		}
+		std::sort(ends.begin(), ends.end()); // both sides of a miscibility gap are ordered by composition
+		line.step = step_value;
+		line.first[0] = ends[0].step_coordinate;
+		line.first[1] = ends[0].composition;
+		line.second[0] = ends[1].step_coordinate;
+		line.second[1] = ends[1].composition;
+		return true;
+	};
+
+	double step_value = is_state_variable(step_variable) ? start.statevars.at(step_variable[0]) : start.xfrac.at(component_of(step_variable));
+	CompactEquilibriumResult previous = factory.create_compact(DB, start);
+	boundary.phases = previous.stable_phases(minimum_phase_fraction);
+	TieLine line;
+	if (boundary.phases.size() != 2 || !tie_line(previous, step_value, line)) {
+		BOOST_THROW_EXCEPTION(equilibrium_error() << str_errinfo("The start of a boundary must be a two-phase equilibrium"));
+	}
+	boundary.tie_lines.push_back(line);
+	boundary.end_step = step_value;
+
+	const double direction = limit >= step_value ? 1 : -1;
+	double current_step = step;
+	evalconditions conds = start;
+	while (direction * (limit - step_value) > 0) {
+		const double next_value = direction > 0 ? std::min(step_value + current_step, limit) : std::max(step_value - current_step, limit);
+		// Predictor: extrapolate the composition ends linearly in the step variable
+		const TieLine &last = boundary.tie_lines.back();
+		double first_end = last.first[1];
+		double second_end = last.second[1];
+		if (boundary.tie_lines.size() > 1) {
+			const TieLine &before = boundary.tie_lines[boundary.tie_lines.size() - 2];
+			const double ratio = (next_value - last.step) / (last.step - before.step);
+			first_end += ratio * (last.first[1] - before.first[1]);
+			second_end += ratio * (last.second[1] - before.second[1]);
+		}
+		const double overall = std::min(std::max(0.5 * (first_end + second_end), tolerance), 1 - tolerance);
+		set_condition(conds, step_variable, next_value);
+		set_condition(conds, composition_variable, overall);
+		// Corrector
+		bool accepted = false;
+		std::vector<std::string> found_phases;
+		try {
+			CompactEquilibriumResult result = factory.create_compact(DB, conds, previous);
+			accepted = tie_line(result, next_value, line);
+			found_phases = result.stable_phases(minimum_phase_fraction);
+			if (accepted) previous = std::move(result);
+		}
+		catch (boost::exception &e) {
+			BOOST_LOG_SEV(boundary_log, debug) << "step to " << next_value << " failed: " << boost::diagnostic_information(e);
+		}
+		if (accepted) {
+			boundary.tie_lines.push_back(line);
+			boundary.end_step = step_value = next_value;
+			current_step = std::min(2 * current_step, step);
+			continue;
+		}
+		BOOST_LOG_SEV(boundary_log, debug) << "no two-phase equilibrium at " << next_value << "; step " << current_step;
+		if (current_step <= tolerance) {
+			// The region ends between step_value and next_value
+			// Both lists are sorted, and a phase may appear once per composition set
+			std::set_union(boundary.phases.begin(), boundary.phases.end(), found_phases.begin(), found_phases.end(),
+				std::back_inserter(boundary.end_phases));
+			boundary.end_step = 0.5 * (step_value + next_value);
+			break;
+		}
+		current_step *= 0.5;
+	}
+	BOOST_LOG_SEV(boundary_log, debug) << boundary.tie_lines.size() << " tie-lines up to " << boundary.end_step;
+	return boundary;
+}
@@ -0,0 +1,258 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// definition for evaluating the energy of one phase over arrays of points, and its C interface
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/phase_evaluator.hpp"
+#include "libgibbs/include/optimizer/compiled_system.hpp"
+#include "libgibbs/include/utils/ast_caching.hpp"
+#include "libgibbs/include/utils/ast_serialization.hpp"
+#include "libtdb/include/database.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include "libtdb/include/logging.hpp"
+#include <boost/exception/diagnostic_information.hpp>
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <thread>
+
+namespace {
+// Run work(begin, end) over contiguous blocks of [0, npoints) on threads (0 for one per core), this one included
+template <typename Function> void split_points(const std::size_t npoints, std::size_t threads, Function work) {
+	if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+	threads = std::max(std::min(threads, npoints), std::size_t(1));
+	const std::size_t block = (npoints + threads - 1) / threads;
+	std::vector<std::thread> workers;
+	std::vector<std::exception_ptr> worker_errors(threads);
+	for (std::size_t i = 1; i < threads; ++i) {
+		workers.emplace_back([&, i]() {
+			try {
+				work(std::min(i * block, npoints), std::min((i + 1) * block, npoints));
+			}
+			catch (...) {
+				worker_errors[i] = std::current_exception();
+			}
+		});
+	}
+	try {
+		work(0, std::min(block, npoints));
+	}
+	catch (...) {
+		worker_errors[0] = std::current_exception();
+	}
+	for (auto &worker : workers) worker.join();
+	for (auto i = worker_errors.begin(); i != worker_errors.end(); ++i) {
+		if (*i) std::rethrow_exception(*i);
+	}
+}
+}
+
+PhaseEvaluator::PhaseEvaluator(const Database &DB, const std::string &phase, const std::vector<std::string> &components) :
+	elements(components) {
+	BOOST_LOG_NAMED_SCOPE("PhaseEvaluator::PhaseEvaluator");
+	logger opto_log(journal::keywords::channel = "optimizer");
+	evalconditions conditions;
+	conditions.elements = elements;
+	conditions.phases[phase] = Optimizer::PhaseStatus::ENTERED;
+	const CompiledSystem system(DB, conditions);
+	auto compset_find = system.composition_sets().find(phase);
+	if (compset_find == system.composition_sets().end()) {
+		BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("Phase not in database") << specific_errinfo(phase));
+	}
+	compset = compset_find->second; // shares the compiled models
+	BOOST_LOG_SEV(opto_log, debug) << phase << ": " << variable_count() << " site fractions";
+}
+
+void PhaseEvaluator::evaluate(const std::map<char,double> &statevars, const double *points, const std::size_t npoints,
+		const std::size_t stride, double *energies, double *gradients, std::size_t threads) const {
+	if (stride < variable_count()) {
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Point stride is shorter than the number of site fractions"));
+	}
+	evalconditions conditions;
+	conditions.statevars = statevars;
+	conditions.elements = elements;
+	const std::size_t variables = variable_count();
+	auto work = [&](const std::size_t begin, const std::size_t end) {
+		if (begin == end) return;
+		if (!gradients) {
+			compset.evaluate_objective_batch(conditions, points + begin * stride, end - begin, stride, energies + begin);
+			return;
+		}
+		const CompiledBinding binding = compset.bind(conditions, compset.get_variable_map());
+		CompiledJet workspace = compset.jet_workspace(false);
+		for (std::size_t point = begin; point < end; ++point) {
+			energies[point] = compset.evaluate_internal_objective_gradient(binding, points + point * stride,
+				gradients + point * variables, workspace);
+		}
+	};
+	split_points(npoints, threads, work);
+}
+
+ExpressionEvaluator::ExpressionEvaluator(const char *data, const std::size_t size, const std::vector<std::string> &variables) {
+	BOOST_LOG_NAMED_SCOPE("ExpressionEvaluator::ExpressionEvaluator");
+	logger opto_log(journal::keywords::channel = "optimizer");
+	ASTReader reader(data, data + size);
+	const ASTSymbolMap symbols = reader.read_symbols();
+	const boost::spirit::utree ast = reader.read_utree();
+	if (!reader.at_end()) {
+		BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Trailing data after the serialized expression"));
+	}
+	program = CompiledExpression(ast, symbols, slots);
+	for (std::size_t i = 0; i < variables.size(); ++i) {
+		if (!variable_indices.insert(boost::bimap<std::string, int>::value_type(variables[i], static_cast<int>(i))).second) {
+			BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Variable listed twice") << specific_errinfo(variables[i]));
+		}
+	}
+	for (auto i = slots.variables.cbegin(); i != slots.variables.cend(); ++i) {
+		if (variable_indices.left.find(*i) == variable_indices.left.end()) {
+			BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("Expression refers to a variable that is not listed") << specific_errinfo(*i));
+		}
+	}
+	const CompiledStatistics &stats = program.statistics();
+	BOOST_LOG_SEV(opto_log, debug) << stats.ast_nodes << " AST nodes compiled to " << stats.instructions << " instructions ("
+		<< stats.shared << " shared, " << stats.folded << " folded)";
+}
+
+void ExpressionEvaluator::evaluate(const std::map<char,double> &statevars, const double *points, const std::size_t npoints,
+		const std::size_t stride, double *values, double *gradients, std::size_t threads) const {
+	if (stride < variable_count()) {
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Point stride is shorter than the number of variables"));
+	}
+	evalconditions conditions;
+	conditions.statevars = statevars;
+	const CompiledBinding binding(slots, conditions, variable_indices);
+	// Partially evaluated once for the state variables, as CompositionSet::bind() does
+	const CompiledExpression specialized = program.specialize(binding);
+	const std::size_t variables = variable_count();
+	auto work = [&](const std::size_t begin, const std::size_t end) {
+		if (begin == end) return;
+		std::fill(values + begin, values + end, 0.0);
+		if (!gradients) {
+			specialized.evaluate_batch(binding, points + begin * stride, end - begin, stride, values + begin);
+			return;
+		}
+		CompiledJet jet(slots.variables.size(), false);
+		for (std::size_t point = begin; point < end; ++point) {
+			jet.value = 0;
+			std::fill(jet.gradient.begin(), jet.gradient.end(), 0.0);
+			specialized.evaluate_jet(binding, points + point * stride, jet, false);
+			values[point] = jet.value;
+			double *gradient = gradients + point * variables;
+			std::fill(gradient, gradient + variables, 0.0);
+			for (std::size_t slot = 0; slot < jet.gradient.size(); ++slot) {
+				gradient[binding.variable_index(slot)] = jet.gradient[slot];
+			}
+		}
+	};
+	split_points(npoints, threads, work);
+}
+
+struct libgibbs_phase_evaluator {
+	PhaseEvaluator evaluator;
+};
+
+namespace {
+void report_error(const std::string &message, char *error, const std::size_t error_size) {
+	if (error_size == 0) return;
+	const std::size_t length = std::min(message.size(), error_size - 1);
+	std::memcpy(error, message.data(), length);
+	error[length] = '\0';
+}
+
+// Run f, turning any exception into a message; returns 0 on success
+template <typename Function> int call_reporting_errors(Function f, char *error, const std::size_t error_size) {
+	try {
+		f();
+		return 0;
+	}
+	catch (boost::exception &e) {
+		report_error(boost::diagnostic_information(e), error, error_size);
+	}
+	catch (std::exception &e) {
+		report_error(e.what(), error, error_size);
+	}
+	catch (...) {
+		report_error("Unknown error", error, error_size);
+	}
+	return 1;
+}
+}
+
+libgibbs_phase_evaluator* libgibbs_phase_evaluator_create(const char *tdb_path, const char *phase,
+		const char *const *components, const std::size_t component_count, char *error, const std::size_t error_size) {
+	libgibbs_phase_evaluator *evaluator = nullptr;
+	call_reporting_errors([&]() {
+		const Database DB(tdb_path);
+		const std::vector<std::string> component_names(components, components + component_count);
+		evaluator = new libgibbs_phase_evaluator { PhaseEvaluator(DB, phase, component_names) };
+	}, error, error_size);
+	return evaluator;
+}
+
+void libgibbs_phase_evaluator_destroy(libgibbs_phase_evaluator *evaluator) {
+	delete evaluator;
+}
+
+std::size_t libgibbs_phase_evaluator_variable_count(const libgibbs_phase_evaluator *evaluator) {
+	return evaluator->evaluator.variable_count();
+}
+
+std::size_t libgibbs_phase_evaluator_sublattice(const libgibbs_phase_evaluator *evaluator, const std::size_t variable) {
+	const SublatticeLayout &layout = evaluator->evaluator.layout();
+	std::size_t sublattice = 0;
+	while (layout.sublattice_end(sublattice) <= variable) ++sublattice;
+	return sublattice;
+}
+
+const char* libgibbs_phase_evaluator_species(const libgibbs_phase_evaluator *evaluator, const std::size_t variable) {
+	return evaluator->evaluator.layout().species(variable).c_str();
+}
+
+int libgibbs_phase_evaluator_evaluate(const libgibbs_phase_evaluator *evaluator, const double T, const double P,
+		const double *points, const std::size_t npoints, const std::size_t stride, double *energies, double *gradients,
+		const std::size_t threads, char *error, const std::size_t error_size) {
+	std::map<char,double> statevars;
+	statevars['T'] = T;
+	statevars['P'] = P;
+	return call_reporting_errors([&]() {
+		evaluator->evaluator.evaluate(statevars, points, npoints, stride, energies, gradients, threads);
+	}, error, error_size);
+}
+
+struct libgibbs_expression_evaluator {
+	ExpressionEvaluator evaluator;
+};
+
+libgibbs_expression_evaluator* libgibbs_expression_evaluator_create(const char *data, const std::size_t size,
+		const char *const *variables, const std::size_t variable_count, char *error, const std::size_t error_size) {
+	libgibbs_expression_evaluator *evaluator = nullptr;
+	call_reporting_errors([&]() {
+		const std::vector<std::string> variable_names(variables, variables + variable_count);
+		evaluator = new libgibbs_expression_evaluator { ExpressionEvaluator(data, size, variable_names) };
+	}, error, error_size);
+	return evaluator;
+}
+
+void libgibbs_expression_evaluator_destroy(libgibbs_expression_evaluator *evaluator) {
+	delete evaluator;
+}
+
+std::size_t libgibbs_expression_evaluator_instruction_count(const libgibbs_expression_evaluator *evaluator) {
+	return evaluator->evaluator.instruction_count();
+}
+
+int libgibbs_expression_evaluator_evaluate(const libgibbs_expression_evaluator *evaluator, const double T, const double P,
+		const double *points, const std::size_t npoints, const std::size_t stride, double *values, double *gradients,
+		const std::size_t threads, char *error, const std::size_t error_size) {
+	std::map<char,double> statevars;
+	statevars['T'] = T;
+	statevars['P'] = P;
+	return call_reporting_errors([&]() {
+		evaluator->evaluator.evaluate(statevars, points, npoints, stride, values, gradients, threads);
+	}, error, error_size);
+}
@@ -0,0 +1,568 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// definition for tables of equilibrium properties
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/property_table.hpp"
+#include "libgibbs/include/equilibrium.hpp"
+#include "libgibbs/include/mesh.hpp"
+#include "libgibbs/include/optimizer/result_properties.hpp"
+#include "libgibbs/include/utils/ast_serialization.hpp"
+#include "libtdb/include/database.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include "libtdb/include/logging.hpp"
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+using Optimizer::CompactEquilibriumResult;
+using Optimizer::ResultProperties;
+
+const std::size_t PropertyTable::no_region;
+const std::size_t PropertyTable::max_axes;
+
+/*
+ * The image is the length of the header, as a 64-bit integer; the header, written by ASTWriter; padding to
+ * a multiple of 8 bytes; then the arrays the pointers of PropertyTable point to, in the order they are declared.
+ */
+struct PropertyTable::Storage {
+	std::vector<std::uint64_t> built; // the image of a table built in memory,
+	boost::interprocess::file_mapping file; // or the file the image is mapped from
+	boost::interprocess::mapped_region region;
+	const char* data() const {
+		return built.empty() ? static_cast<const char*>(region.get_address()) : reinterpret_cast<const char*>(built.data());
+	}
+	std::size_t size() const {
+		return built.empty() ? region.get_size() : built.size() * sizeof(std::uint64_t);
+	}
+};
+
+namespace {
+const std::string table_format = "libgibbs property table 1";
+const std::uint32_t failed_region = std::numeric_limits<std::uint32_t>::max(); // of failed points, and cells of only failed points
+const std::uint32_t mixed_region = failed_region - 1; // of cells whose solved corners are not all in the same region
+const std::uint32_t block_mixed = 0x80000000u;
+
+std::size_t aligned(const std::size_t bytes) {
+	return (bytes + 7) / 8 * 8;
+}
+
+void append(std::string &image, const void *data, const std::size_t bytes) {
+	image.append(static_cast<const char*>(data), bytes);
+}
+
+// Grid intervals on an axis with value_count values; an axis with a single value has one, of zero width
+std::size_t interval_count(const std::size_t value_count) {
+	return std::max(value_count, std::size_t(2)) - 1;
+}
+}
+
+PropertyTable PropertyTable::build(const Mesh &mesh, const Database &DB, EquilibriumFactory &factory,
+		const std::size_t coarse_stride, const std::size_t threads) {
+	return PropertyTable(mesh.solve_adaptive(DB, factory, coarse_stride, threads, true), coarse_stride);
+}
+
+PropertyTable::PropertyTable(const MeshResult &result, std::size_t block_size_) {
+	BOOST_LOG_NAMED_SCOPE("PropertyTable::PropertyTable");
+	logger table_log(journal::keywords::channel = "optimizer");
+	const std::size_t axis_count = result.axis_names.size();
+	const std::size_t point_total = result.size();
+	if (result.solutions.size() != point_total || result.cells.empty()) {
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Property tables are made from Mesh::solve_adaptive() results with their solutions"));
+	}
+	if (axis_count == 0 || axis_count > max_axes) {
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Property tables have between one and eight axes"));
+	}
+	if (block_size_ == 0) block_size_ = 1;
+	const std::size_t corner_count = std::size_t(1) << axis_count;
+
+	// The columns cover every element and composition set of any solution
+	std::set<std::string> element_set, phase_set;
+	std::vector<std::size_t> solved_points;
+	std::vector<CompactEquilibriumResult> solved;
+	for (std::size_t point = 0; point < point_total; ++point) {
+		const CompactEquilibriumResult &solution = result.solutions[point];
+		if (!solution.descriptor) continue;
+		for (auto i = solution.descriptor->elements().cbegin(); i != solution.descriptor->elements().cend(); ++i) {
+			if (*i != "VA") element_set.insert(*i);
+		}
+		for (auto i = solution.descriptor->phases().cbegin(); i != solution.descriptor->phases().cend(); ++i) phase_set.insert(i->name);
+		solved_points.push_back(point);
+		solved.push_back(solution);
+	}
+	const std::vector<std::string> elements(element_set.begin(), element_set.end());
+	const std::vector<std::string> phases(phase_set.begin(), phase_set.end());
+	std::vector<std::string> column_list;
+	column_list.push_back("GM");
+	for (auto i = elements.cbegin(); i != elements.cend(); ++i) column_list.push_back("MU(" + *i + ")");
+	for (auto phase = phases.cbegin(); phase != phases.cend(); ++phase) {
+		column_list.push_back("NP(" + *phase + ")");
+		for (auto i = elements.cbegin(); i != elements.cend(); ++i) column_list.push_back("X(" + *phase + "," + *i + ")");
+	}
+	const std::size_t column_total = column_list.size();
+	const std::size_t phase_columns = 1 + elements.size();
+
+	std::vector<ResultProperties> properties;
+	std::vector<bool> evaluated(solved.size(), true);
+	try {
+		properties = Optimizer::evaluate_properties(solved);
+	}
+	catch (boost::exception &) {
+		// Find the points at fault, and tabulate the others
+		properties.resize(solved.size());
+		for (std::size_t i = 0; i < solved.size(); ++i) {
+			try {
+				properties[i] = Optimizer::evaluate_properties(solved[i]);
+			}
+			catch (boost::exception &e) {
+				BOOST_LOG_SEV(table_log, debug) << "point " << solved_points[i] << " failed: " << boost::diagnostic_information(e);
+				evaluated[i] = false;
+			}
+		}
+	}
+
+	std::vector<double> table_values(point_total * column_total, std::numeric_limits<double>::quiet_NaN());
+	std::vector<std::uint32_t> table_regions(point_total, failed_region);
+	std::map<std::vector<std::string>,std::uint32_t> region_ids;
+	for (std::size_t i = 0; i < solved.size(); ++i) {
+		if (!evaluated[i]) continue;
+		const std::size_t point = solved_points[i];
+		const CompactEquilibriumResult &solution = solved[i];
+		double *row = &table_values[point * column_total];
+		row[0] = properties[i].energy;
+		const std::vector<std::string> &solution_elements = solution.descriptor->elements();
+		for (std::size_t j = 0; j < solution_elements.size(); ++j) {
+			if (solution_elements[j] == "VA") continue;
+			const std::size_t element = std::lower_bound(elements.begin(), elements.end(), solution_elements[j]) - elements.begin();
+			row[1 + element] = properties[i].chemical_potentials[j];
+		}
+		for (auto entry = solution.descriptor->phases().cbegin(); entry != solution.descriptor->phases().cend(); ++entry) {
+			const std::size_t phase = std::lower_bound(phases.begin(), phases.end(), entry->name) - phases.begin();
+			double *phase_row = row + phase_columns * (1 + phase);
+			phase_row[0] = solution.x[entry->phase_fraction];
+			for (std::size_t element = 0; element < elements.size(); ++element) {
+				phase_row[1 + element] = solution.mole_fraction(elements[element], entry->name);
+			}
+		}
+		const auto region_find = region_ids.emplace(result.stable_phases[point], static_cast<std::uint32_t>(region_ids.size())).first;
+		table_regions[point] = region_find->second;
+	}
+	std::vector<std::vector<std::string>> region_list(region_ids.size());
+	for (auto i = region_ids.cbegin(); i != region_ids.cend(); ++i) region_list[i->second] = i->first;
+
+	// The cells, with the points of their corners
+	std::vector<std::size_t> axis_strides(axis_count, 1);
+	for (std::size_t axis = axis_count; axis-- > 1;) {
+		axis_strides[axis-1] = axis_strides[axis] * result.axis_values[axis].size();
+	}
+	std::unordered_map<std::size_t,std::uint32_t> point_of_grid_point;
+	for (std::size_t point = 0; point < point_total; ++point) {
+		point_of_grid_point[result.grid_points[point]] = static_cast<std::uint32_t>(point);
+	}
+	const std::size_t words = 1 + 2 * axis_count + corner_count;
+	const std::size_t cell_total = result.cells.size();
+	if (cell_total >= block_mixed || point_total >= block_mixed) {
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Property table has too many points"));
+	}
+	std::vector<std::uint32_t> table_cells(cell_total * words);
+	for (std::size_t cell = 0; cell < cell_total; ++cell) {
+		const MeshCell &bounds = result.cells[cell];
+		std::uint32_t *cell_row = &table_cells[cell * words];
+		std::set<std::uint32_t> corner_regions;
+		for (std::size_t axis = 0; axis < axis_count; ++axis) {
+			cell_row[1 + axis] = static_cast<std::uint32_t>(bounds.lower[axis]);
+			cell_row[1 + axis_count + axis] = static_cast<std::uint32_t>(bounds.upper[axis]);
+		}
+		for (std::size_t corner = 0; corner < corner_count; ++corner) {
+			std::size_t grid_point = 0;
+			for (std::size_t axis = 0; axis < axis_count; ++axis) {
+				grid_point += ((corner >> axis) & 1 ? bounds.upper[axis] : bounds.lower[axis]) * axis_strides[axis];
+			}
+			const auto point_find = point_of_grid_point.find(grid_point);
+			if (point_find == point_of_grid_point.end()) {
+				BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Corner of a mesh cell was not solved"));
+			}
+			cell_row[1 + 2 * axis_count + corner] = point_find->second;
+			corner_regions.insert(table_regions[point_find->second]);
+		}
+		// Failed corners are left out in the same way as those of other regions
+		cell_row[0] = corner_regions.size() == 1 ? *corner_regions.begin() : mixed_region;
+	}
+
+	// The cell of every grid interval, then of every block of them
+	std::vector<std::size_t> intervals(axis_count), blocks(axis_count);
+	std::size_t interval_total = 1, block_total = 1;
+	for (std::size_t axis = 0; axis < axis_count; ++axis) {
+		intervals[axis] = interval_count(result.axis_values[axis].size());
+		blocks[axis] = (intervals[axis] + block_size_ - 1) / block_size_;
+		interval_total *= intervals[axis];
+		block_total *= blocks[axis];
+	}
+	std::vector<std::uint32_t> interval_owner(interval_total, failed_region);
+	for (std::size_t cell = 0; cell < cell_total; ++cell) {
+		const MeshCell &bounds = result.cells[cell];
+		std::vector<std::size_t> first(axis_count), last(axis_count), index(axis_count);
+		for (std::size_t axis = 0; axis < axis_count; ++axis) {
+			first[axis] = bounds.lower[axis];
+			last[axis] = std::min(std::max(bounds.upper[axis], bounds.lower[axis] + 1), intervals[axis]);
+			if (first[axis] >= last[axis]) {
+				BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Mesh cell lies outside the grid"));
+			}
+		}
+		index = first;
+		bool more = true;
+		while (more) {
+			std::size_t interval = 0;
+			for (std::size_t axis = 0; axis < axis_count; ++axis) interval = interval * intervals[axis] + index[axis];
+			interval_owner[interval] = static_cast<std::uint32_t>(cell);
+			more = false;
+			for (std::size_t axis = axis_count; axis-- > 0;) {
+				if (++index[axis] < last[axis]) {
+					more = true;
+					break;
+				}
+				index[axis] = first[axis];
+			}
+		}
+	}
+	if (std::find(interval_owner.begin(), interval_owner.end(), failed_region) != interval_owner.end()) {
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Mesh cells do not cover the grid"));
+	}
+	std::size_t block_intervals = 1;
+	for (std::size_t axis = 0; axis < axis_count; ++axis) block_intervals *= block_size_;
+	std::vector<std::uint32_t> table_blocks(block_total);
+	std::vector<std::uint32_t> table_intervals;
+	std::vector<std::size_t> block(axis_count, 0), offset(axis_count);
+	for (std::size_t block_id = 0; block_id < block_total; ++block_id) {
+		// The intervals of the block, row-major over block_size intervals on each axis; those past the grid are 0
+		std::vector<std::uint32_t> owners(block_intervals, 0);
+		std::set<std::uint32_t> block_owners;
+		for (std::size_t local = 0; local < block_intervals; ++local) {
+			bool inside = true;
+			std::size_t interval = 0;
+			std::size_t rest = local;
+			for (std::size_t axis = axis_count; axis-- > 0;) {
+				offset[axis] = rest % block_size_;
+				rest /= block_size_;
+			}
+			for (std::size_t axis = 0; axis < axis_count; ++axis) {
+				const std::size_t index = block[axis] * block_size_ + offset[axis];
+				inside &= index < intervals[axis];
+				interval = interval * intervals[axis] + index;
+			}
+			if (!inside) continue;
+			owners[local] = interval_owner[interval];
+			block_owners.insert(owners[local]);
+		}
+		if (block_owners.size() == 1) table_blocks[block_id] = *block_owners.begin();
+		else {
+			if (table_intervals.size() >= block_mixed) {
+				BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Property table has too many points"));
+			}
+			table_blocks[block_id] = block_mixed | static_cast<std::uint32_t>(table_intervals.size());
+			table_intervals.insert(table_intervals.end(), owners.begin(), owners.end());
+		}
+		for (std::size_t axis = axis_count; axis-- > 0;) {
+			if (++block[axis] < blocks[axis]) break;
+			block[axis] = 0;
+		}
+	}
+
+	ASTWriter header;
+	header.write(table_format);
+	header.write_size(axis_count);
+	for (std::size_t axis = 0; axis < axis_count; ++axis) {
+		header.write(result.axis_names[axis]);
+		header.write_size(result.axis_values[axis].size());
+		for (auto i = result.axis_values[axis].cbegin(); i != result.axis_values[axis].cend(); ++i) header.write(*i);
+	}
+	header.write_size(block_size_);
+	header.write_size(column_total);
+	for (auto i = column_list.cbegin(); i != column_list.cend(); ++i) header.write(*i);
+	header.write_size(region_list.size());
+	for (auto i = region_list.cbegin(); i != region_list.cend(); ++i) {
+		header.write_size(i->size());
+		for (auto j = i->cbegin(); j != i->cend(); ++j) header.write(*j);
+	}
+	header.write_size(point_total);
+	header.write_size(cell_total);
+	header.write_size(table_intervals.size());
+	std::string image;
+	const std::uint64_t header_size = header.data().size();
+	append(image, &header_size, sizeof(header_size));
+	image += header.data();
+	image.resize(aligned(image.size()), '\0');
+	append(image, table_values.data(), table_values.size() * sizeof(double));
+	append(image, table_regions.data(), table_regions.size() * sizeof(std::uint32_t));
+	append(image, table_cells.data(), table_cells.size() * sizeof(std::uint32_t));
+	append(image, table_blocks.data(), table_blocks.size() * sizeof(std::uint32_t));
+	append(image, table_intervals.data(), table_intervals.size() * sizeof(std::uint32_t));
+	image.resize(aligned(image.size()), '\0');
+
+	std::shared_ptr<Storage> built(std::make_shared<Storage>());
+	built->built.resize(image.size() / sizeof(std::uint64_t));
+	std::memcpy(built->built.data(), image.data(), image.size());
+	attach(built);
+	BOOST_LOG_SEV(table_log, debug) << "tabulated " << point_total << " points in " << cell_total << " cells and "
+		<< regions.size() << " regions; " << image_size << " bytes";
+}
+
+PropertyTable::PropertyTable(const std::string &path) {
+	std::shared_ptr<Storage> mapped(std::make_shared<Storage>());
+	try {
+		mapped->file = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+		mapped->region = boost::interprocess::mapped_region(mapped->file, boost::interprocess::read_only);
+	}
+	catch (boost::interprocess::interprocess_exception &e) {
+		BOOST_THROW_EXCEPTION(file_read_error() << str_errinfo(e.what()) << specific_errinfo(path));
+	}
+	attach(mapped);
+}
+
+void PropertyTable::attach(std::shared_ptr<const Storage> backing) {
+	storage = std::move(backing);
+	image = storage->data();
+	image_size = storage->size();
+	std::uint64_t header_size = 0;
+	if (image_size < sizeof(header_size)) {
+		BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Property table is truncated"));
+	}
+	std::memcpy(&header_size, image, sizeof(header_size));
+	if (header_size > image_size - sizeof(header_size)) {
+		BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Property table is truncated"));
+	}
+	ASTReader header(image + sizeof(header_size), image + sizeof(header_size) + header_size);
+	if (header.read_string() != table_format) {
+		BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Not a property table of this version"));
+	}
+	const std::size_t axis_count = header.read_size();
+	if (axis_count == 0 || axis_count > max_axes) {
+		BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Property table has an invalid number of axes"));
+	}
+	axes.resize(axis_count);
+	grid_values.resize(axis_count);
+	for (std::size_t axis = 0; axis < axis_count; ++axis) {
+		axes[axis] = header.read_string();
+		grid_values[axis].resize(header.read_size());
+		for (auto i = grid_values[axis].begin(); i != grid_values[axis].end(); ++i) *i = header.read_double();
+		if (grid_values[axis].empty() || !std::is_sorted(grid_values[axis].begin(), grid_values[axis].end())) {
+			BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Property table has an invalid axis") << specific_errinfo(axes[axis]));
+		}
+	}
+	block_size = header.read_size();
+	columns.resize(header.read_size());
+	for (auto i = columns.begin(); i != columns.end(); ++i) *i = header.read_string();
+	regions.resize(header.read_size());
+	for (auto i = regions.begin(); i != regions.end(); ++i) {
+		i->resize(header.read_size());
+		for (auto j = i->begin(); j != i->end(); ++j) *j = header.read_string();
+	}
+	points = header.read_size();
+	cells = header.read_size();
+	const std::size_t interval_entries = header.read_size();
+	if (!header.at_end() || block_size == 0 || regions.size() >= mixed_region || cells >= block_mixed) {
+		BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Property table has an invalid header"));
+	}
+	const std::size_t corner_count = std::size_t(1) << axis_count;
+	cell_words = 1 + 2 * axis_count + corner_count;
+	block_counts.resize(axis_count);
+	std::size_t block_total = 1, block_intervals = 1;
+	for (std::size_t axis = 0; axis < axis_count; ++axis) {
+		block_counts[axis] = (interval_count(grid_values[axis].size()) + block_size - 1) / block_size;
+		block_total *= block_counts[axis];
+		block_intervals *= block_size;
+	}
+
+	// The arrays must fill the rest of the image exactly
+	const std::size_t values_begin = aligned(sizeof(header_size) + header_size);
+	const std::size_t regions_begin = values_begin + points * columns.size() * sizeof(double);
+	const std::size_t cells_begin = regions_begin + points * sizeof(std::uint32_t);
+	const std::size_t blocks_begin = cells_begin + cells * cell_words * sizeof(std::uint32_t);
+	const std::size_t intervals_begin = blocks_begin + block_total * sizeof(std::uint32_t);
+	const std::size_t end = intervals_begin + interval_entries * sizeof(std::uint32_t);
+	if (aligned(end) != image_size) {
+		BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Property table is truncated"));
+	}
+	point_values = reinterpret_cast<const double*>(image + values_begin);
+	point_regions = reinterpret_cast<const std::uint32_t*>(image + regions_begin);
+	cell_data = reinterpret_cast<const std::uint32_t*>(image + cells_begin);
+	block_cells = reinterpret_cast<const std::uint32_t*>(image + blocks_begin);
+	interval_cells = reinterpret_cast<const std::uint32_t*>(image + intervals_begin);
+
+	// Check every index once here, so that interpolate() can trust them
+	for (std::size_t point = 0; point < points; ++point) {
+		if (point_regions[point] != failed_region && point_regions[point] >= regions.size()) {
+			BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Property table has an invalid region"));
+		}
+	}
+	for (std::size_t cell = 0; cell < cells; ++cell) {
+		const std::uint32_t *cell_row = cell_data + cell * cell_words;
+		bool valid = cell_row[0] == failed_region || cell_row[0] == mixed_region || cell_row[0] < regions.size();
+		for (std::size_t axis = 0; axis < axis_count; ++axis) {
+			valid &= cell_row[1 + axis] <= cell_row[1 + axis_count + axis] && cell_row[1 + axis_count + axis] < grid_values[axis].size();
+		}
+		for (std::size_t corner = 0; corner < corner_count; ++corner) valid &= cell_row[1 + 2 * axis_count + corner] < points;
+		if (!valid) BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Property table has an invalid cell"));
+	}
+	for (std::size_t block = 0; block < block_total; ++block) {
+		const std::uint32_t entry = block_cells[block];
+		if (entry & block_mixed ? (entry & ~block_mixed) + block_intervals > interval_entries : entry >= cells) {
+			BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Property table has an invalid block"));
+		}
+	}
+	for (std::size_t i = 0; i < interval_entries; ++i) {
+		if (interval_cells[i] >= cells) BOOST_THROW_EXCEPTION(malformed_object_error() << str_errinfo("Property table has an invalid block"));
+	}
+}
+
+void PropertyTable::write(const std::string &path) const {
+	// Other processes may be reading the table, so write to a temporary file and move it into place
+	std::stringstream temp_path;
+	temp_path << path << "." << std::hex << std::random_device()() << ".tmp";
+	std::ofstream out(temp_path.str().c_str(), std::ios::binary);
+	out.write(image, image_size);
+	out.close();
+	if (!out || std::rename(temp_path.str().c_str(), path.c_str()) != 0) {
+		std::remove(temp_path.str().c_str());
+		BOOST_THROW_EXCEPTION(file_read_error() << str_errinfo("Cannot write property table") << specific_errinfo(path));
+	}
+}
+
+std::size_t PropertyTable::column(const std::string &name) const {
+	const auto column_find = std::find(columns.begin(), columns.end(), name);
+	if (column_find == columns.end()) {
+		BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("Property table has no such column") << specific_errinfo(name));
+	}
+	return column_find - columns.begin();
+}
+
+std::uint32_t PropertyTable::find_cell(const std::size_t *interval) const {
+	const std::size_t axis_count = axes.size();
+	std::size_t block = 0, local = 0;
+	for (std::size_t axis = 0; axis < axis_count; ++axis) {
+		block = block * block_counts[axis] + interval[axis] / block_size;
+		local = local * block_size + interval[axis] % block_size;
+	}
+	const std::uint32_t entry = block_cells[block];
+	return entry & block_mixed ? interval_cells[(entry & ~block_mixed) + local] : entry;
+}
+
+std::size_t PropertyTable::interpolate(const double *coordinates, double *values, const Interpolation method) const {
+	const std::size_t axis_count = axes.size();
+	const std::size_t column_count = columns.size();
+	const std::size_t corner_count = std::size_t(1) << axis_count;
+	std::fill(values, values + column_count, std::numeric_limits<double>::quiet_NaN());
+
+	// The grid interval of the point on every axis
+	std::size_t interval[max_axes];
+	for (std::size_t axis = 0; axis < axis_count; ++axis) {
+		const std::vector<double> &axis_values = grid_values[axis];
+		const double coordinate = coordinates[axis];
+		if (!(coordinate >= axis_values.front() && coordinate <= axis_values.back())) return no_region;
+		const std::size_t upper = std::upper_bound(axis_values.begin(), axis_values.end(), coordinate) - axis_values.begin();
+		interval[axis] = std::min(upper, interval_count(axis_values.size())) - 1;
+	}
+	const std::uint32_t *cell_row = cell_data + find_cell(interval) * cell_words;
+	const std::uint32_t *corner_points = cell_row + 1 + 2 * axis_count;
+	if (cell_row[0] == failed_region) return no_region;
+
+	// The position of the point within the cell, from 0 at its lower to 1 at its upper corner on each axis
+	double t[max_axes];
+	for (std::size_t axis = 0; axis < axis_count; ++axis) {
+		const double lower = grid_values[axis][cell_row[1 + axis]];
+		const double upper = grid_values[axis][cell_row[1 + axis_count + axis]];
+		t[axis] = upper > lower ? (coordinates[axis] - lower) / (upper - lower) : 0;
+	}
+	auto multilinear_weight = [&](const std::size_t corner) {
+		double weight = 1;
+		for (std::size_t axis = 0; axis < axis_count; ++axis) weight *= (corner >> axis) & 1 ? t[axis] : 1 - t[axis];
+		return weight;
+	};
+
+	// The region of the point; in a cell of several, that of the solved corner with the largest weight
+	std::uint32_t region = cell_row[0];
+	if (region == mixed_region) {
+		double best_weight = -1;
+		for (std::size_t corner = 0; corner < corner_count; ++corner) {
+			const std::uint32_t corner_region = point_regions[corner_points[corner]];
+			if (corner_region == failed_region) continue;
+			const double weight = multilinear_weight(corner);
+			if (weight > best_weight) {
+				best_weight = weight;
+				region = corner_region;
+			}
+		}
+		if (region == mixed_region) return no_region;
+	}
+
+	// The corners to use and their weights
+	std::size_t used_corners[std::size_t(1) << max_axes];
+	double weights[std::size_t(1) << max_axes];
+	std::size_t used_count = 0;
+	if (method == Interpolation::SIMPLEX) {
+		// Walk from the lower corner to the upper one, along the axes in the order of decreasing t
+		std::size_t order[max_axes];
+		for (std::size_t axis = 0; axis < axis_count; ++axis) order[axis] = axis;
+		std::sort(order, order + axis_count, [&t](const std::size_t a, const std::size_t b) { return t[a] > t[b]; });
+		std::size_t corner = 0;
+		double previous = 1;
+		for (std::size_t step = 0; step <= axis_count; ++step) {
+			const double next = step < axis_count ? t[order[step]] : 0;
+			used_corners[used_count] = corner;
+			weights[used_count++] = previous - next;
+			if (step < axis_count) corner |= std::size_t(1) << order[step];
+			previous = next;
+		}
+	}
+	else {
+		for (std::size_t corner = 0; corner < corner_count; ++corner) {
+			used_corners[used_count] = corner;
+			weights[used_count++] = multilinear_weight(corner);
+		}
+	}
+	double total_weight = 0;
+	for (std::size_t i = 0; i < used_count; ++i) {
+		if (point_regions[corner_points[used_corners[i]]] != region) weights[i] = 0;
+		total_weight += weights[i];
+	}
+	if (!(total_weight > 0)) {
+		// Only possible for SIMPLEX in a cell of several regions: the simplex has no corner in the region of
+		// the point, so take the nearest corner which is
+		double best_weight = -1;
+		for (std::size_t corner = 0; corner < corner_count; ++corner) {
+			if (point_regions[corner_points[corner]] != region) continue;
+			const double weight = multilinear_weight(corner);
+			if (weight > best_weight) {
+				best_weight = weight;
+				used_corners[0] = corner;
+			}
+		}
+		used_count = 1;
+		weights[0] = total_weight = 1;
+	}
+
+	std::fill(values, values + column_count, 0.0);
+	for (std::size_t i = 0; i < used_count; ++i) {
+		if (weights[i] == 0) continue;
+		const double weight = weights[i] / total_weight;
+		const double *row = point_values + corner_points[used_corners[i]] * column_count;
+		for (std::size_t column = 0; column < column_count; ++column) values[column] += weight * row[column];
+	}
+	return region;
+}
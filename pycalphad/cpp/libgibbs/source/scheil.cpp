@@ -0,0 +1,160 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// definition for Scheil-Gulliver solidification
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/scheil.hpp"
+#include "libgibbs/include/equilibrium.hpp"
+#include "libtdb/include/database.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include "libtdb/include/logging.hpp"
+#include <boost/exception/diagnostic_information.hpp>
+#include <algorithm>
+#include <ostream>
+#include <utility>
+
+using Optimizer::CompactEquilibriumResult;
+
+namespace {
+const double minimum_phase_fraction = 1e-6; // as CompactEquilibriumResult::stable_phases()
+const double minimum_mole_fraction = 1e-10; // a liquid depleted in an element keeps a trace of it, as the models need it
+
+// The phase of a composition set named PHASE#n
+std::string phase_of(const std::string &name) {
+	return name.substr(0, name.find('#'));
+}
+}
+
+void ScheilCurve::write(std::ostream &stream) const {
+	stream << "T\tsolid_fraction\tliquid_fraction\tphases" << std::endl;
+	for (auto i = steps.cbegin(); i != steps.cend(); ++i) {
+		stream << i->T << '\t' << i->solid_fraction() << '\t' << i->liquid_fraction << '\t';
+		for (auto phase = i->phases.cbegin(); phase != i->phases.cend(); ++phase) {
+			if (phase != i->phases.cbegin()) stream << '+';
+			stream << *phase;
+		}
+		stream << std::endl;
+	}
+}
+
+ScheilSimulator::ScheilSimulator(const std::string &liquid) : liquid_phase(liquid) {
+}
+
+ScheilCurve ScheilSimulator::simulate(const Database &DB, EquilibriumFactory &factory, const evalconditions &start,
+		const double step, const double min_step, const double min_T, const double liquid_limit, const double max_solidified,
+		const StepCallback &on_step) const {
+	BOOST_LOG_NAMED_SCOPE("ScheilSimulator::simulate");
+	logger scheil_log(journal::keywords::channel = "optimizer");
+	if (!(step > 0) || !(min_step > 0) || min_step > step) {
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Scheil steps must be positive, and the minimum step no larger than the step"));
+	}
+	if (!(max_solidified > 0) || !(liquid_limit > 0) || liquid_limit >= 1) {
+		BOOST_THROW_EXCEPTION(range_check_error() << str_errinfo("Scheil liquid limit must be in (0, 1) and the solidified fraction per step positive"));
+	}
+	const auto liquid_find = start.phases.find(liquid_phase);
+	if (liquid_find == start.phases.end() || liquid_find->second != Optimizer::PhaseStatus::ENTERED) {
+		BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("The liquid of a Scheil calculation must be entered") << specific_errinfo(liquid_phase));
+	}
+	const auto T_find = start.statevars.find('T');
+	if (T_find == start.statevars.end()) {
+		BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("A Scheil calculation starts from a temperature") << specific_errinfo("T"));
+	}
+	ScheilCurve curve;
+	curve.end_reason = ScheilCurve::Reason::MINIMUM_TEMPERATURE;
+	evalconditions conds = start;
+	ScheilStep state;
+	state.T = T_find->second;
+	state.liquid_fraction = 1;
+
+	// Fraction of the moles of result in liquid_phase, and the composition of that liquid
+	auto split = [&](const CompactEquilibriumResult &result, std::map<std::string,double> &composition) {
+		double liquid = 0;
+		double total = 0;
+		std::map<std::string,double> moles;
+		for (auto i = result.descriptor->phases().cbegin(); i != result.descriptor->phases().cend(); ++i) {
+			const double phasefrac = result.x[i->phase_fraction];
+			total += phasefrac;
+			if (phase_of(i->name) != liquid_phase || phasefrac <= minimum_phase_fraction) continue;
+			liquid += phasefrac;
+			for (auto element = conds.elements.cbegin(); element != conds.elements.cend(); ++element) {
+				if (*element == "VA") continue;
+				moles[*element] += phasefrac * result.mole_fraction(*element, i->name);
+			}
+		}
+		composition.clear();
+		if (liquid > 0) {
+			for (auto i = moles.cbegin(); i != moles.cend(); ++i) composition[i->first] = i->second / liquid;
+		}
+		return total > 0 ? liquid / total : 0;
+	};
+
+	CompactEquilibriumResult previous = factory.create_compact(DB, conds);
+	std::map<std::string,double> composition;
+	double liquid = split(previous, composition);
+	if (liquid < 1 - max_solidified) {
+		BOOST_THROW_EXCEPTION(equilibrium_error() << str_errinfo("A Scheil calculation must start in the liquid"));
+	}
+	state.phases = previous.stable_phases(minimum_phase_fraction);
+	state.liquid_composition = composition;
+	curve.steps.push_back(state);
+	if (on_step) on_step(state);
+
+	double current_step = step;
+	while (state.T > min_T) {
+		const double next_T = std::max(state.T - current_step, min_T);
+		conds.statevars['T'] = next_T;
+		bool accepted = false;
+		CompactEquilibriumResult result;
+		try {
+			result = factory.create_compact(DB, conds, previous);
+			liquid = split(result, composition);
+			accepted = true;
+		}
+		catch (boost::exception &e) {
+			BOOST_LOG_SEV(scheil_log, debug) << "step to " << next_T << " failed: " << boost::diagnostic_information(e);
+		}
+		const std::vector<std::string> phases = accepted ? result.stable_phases(minimum_phase_fraction) : std::vector<std::string>();
+		// Refine around phase appearance and disappearance, and where much of the liquid solidifies at once
+		if ((!accepted || phases != state.phases || 1 - liquid > max_solidified) && current_step > min_step) {
+			current_step = std::max(0.5 * current_step, min_step);
+			continue;
+		}
+		if (!accepted) {
+			curve.end_reason = ScheilCurve::Reason::STEP_FAILED;
+			break;
+		}
+		// The solids of this step are set aside; the liquid goes on with its own composition
+		double total = 0;
+		for (auto i = result.descriptor->phases().cbegin(); i != result.descriptor->phases().cend(); ++i) total += result.x[i->phase_fraction];
+		for (auto i = result.descriptor->phases().cbegin(); i != result.descriptor->phases().cend(); ++i) {
+			const double phasefrac = result.x[i->phase_fraction];
+			const std::string phase = phase_of(i->name);
+			if (phase == liquid_phase || phasefrac <= minimum_phase_fraction) continue;
+			state.solid_amounts[phase] += state.liquid_fraction * phasefrac / total;
+		}
+		state.T = next_T;
+		state.liquid_fraction *= liquid;
+		state.phases = phases;
+		if (!composition.empty()) state.liquid_composition = composition;
+		curve.steps.push_back(state);
+		if (on_step) on_step(state);
+		if (state.liquid_fraction < liquid_limit || composition.empty()) {
+			curve.end_reason = ScheilCurve::Reason::LIQUID_LIMIT;
+			break;
+		}
+		// The overall composition of the next step is that of the liquid
+		for (auto i = conds.xfrac.begin(); i != conds.xfrac.end(); ++i) {
+			const auto element_find = composition.find(i->first);
+			i->second = std::max(element_find != composition.end() ? element_find->second : 0, minimum_mole_fraction);
+		}
+		previous = std::move(result);
+		current_step = std::min(2 * current_step, step);
+	}
+	BOOST_LOG_SEV(scheil_log, debug) << curve.steps.size() << " steps down to " << state.T << "; liquid fraction " << state.liquid_fraction;
+	return curve;
+}
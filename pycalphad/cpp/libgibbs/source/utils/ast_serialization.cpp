@@ -0,0 +1,211 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// ast_serialization.cpp -- reader and writer for serialized utree ASTs
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/ast_serialization.hpp"
+#include "libgibbs/include/utils/ast_caching.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include <boost/spirit/include/support_utree.hpp>
+#include <cstring>
+
+using boost::spirit::utree;
+using boost::spirit::utree_type;
+
+namespace {
+// Node tags of the serialized format
+enum class ASTNodeTag : unsigned char {
+    NIL, BOOL, INT, DOUBLE, STRING, SYMBOL, LIST
+};
+}
+
+void ASTWriter::write_bytes ( void const* const bytes, std::size_t const count )
+{
+    buffer.append ( static_cast<char const*> ( bytes ), count );
+}
+
+void ASTWriter::write_integer ( std::int64_t const value )
+{
+    write_bytes ( &value, sizeof ( value ) );
+}
+
+void ASTWriter::write_size ( std::size_t const value )
+{
+    const std::uint64_t size = value;
+    write_bytes ( &size, sizeof ( size ) );
+}
+
+void ASTWriter::write ( double const value )
+{
+    write_bytes ( &value, sizeof ( value ) );
+}
+
+void ASTWriter::write ( std::string const &str )
+{
+    write_size ( str.size() );
+    write_bytes ( str.data(), str.size() );
+}
+
+void ASTWriter::write ( utree const &ut )
+{
+    ASTNodeTag tag;
+    switch ( ut.which() ) {
+    case utree_type::invalid_type:
+    case utree_type::nil_type:
+        tag = ASTNodeTag::NIL;
+        write_bytes ( &tag, 1 );
+        break;
+    case utree_type::bool_type: {
+        tag = ASTNodeTag::BOOL;
+        const unsigned char value = ut.get<bool>() ? 1 : 0;
+        write_bytes ( &tag, 1 );
+        write_bytes ( &value, 1 );
+        break;
+    }
+    case utree_type::int_type:
+        tag = ASTNodeTag::INT;
+        write_bytes ( &tag, 1 );
+        write_integer ( ut.get<int>() );
+        break;
+    case utree_type::double_type:
+        tag = ASTNodeTag::DOUBLE;
+        write_bytes ( &tag, 1 );
+        write ( ut.get<double>() );
+        break;
+    case utree_type::string_type: {
+        tag = ASTNodeTag::STRING;
+        boost::spirit::utf8_string_range_type rt = ut.get<boost::spirit::utf8_string_range_type>();
+        write_bytes ( &tag, 1 );
+        write ( std::string ( rt.begin(), rt.end() ) );
+        break;
+    }
+    case utree_type::symbol_type: {
+        tag = ASTNodeTag::SYMBOL;
+        boost::spirit::utf8_symbol_range_type rt = ut.get<boost::spirit::utf8_symbol_range_type>();
+        write_bytes ( &tag, 1 );
+        write ( std::string ( rt.begin(), rt.end() ) );
+        break;
+    }
+    case utree_type::list_type:
+        tag = ASTNodeTag::LIST;
+        write_bytes ( &tag, 1 );
+        write_size ( ut.size() );
+        for ( auto it = ut.begin(); it != ut.end(); ++it ) {
+            write ( *it );
+        }
+        break;
+    default:
+        BOOST_THROW_EXCEPTION ( malformed_object_error() << str_errinfo ( "AST node type cannot be serialized" ) << ast_errinfo ( ut ) );
+    }
+}
+
+void ASTWriter::write ( ASTSymbolMap const &symbols )
+{
+    // Cached derivatives are not written; they are recomputed on demand
+    write_size ( symbols.size() );
+    for ( auto i = symbols.cbegin(); i != symbols.cend(); ++i ) {
+        write ( i->first );
+        write ( i->second.get() );
+    }
+}
+
+std::uint64_t ASTWriter::hash() const
+{
+    std::uint64_t result = 14695981039346656037ULL; // FNV offset basis
+    for ( auto i = buffer.cbegin(); i != buffer.cend(); ++i ) {
+        result ^= static_cast<unsigned char> ( *i );
+        result *= 1099511628211ULL; // FNV prime
+    }
+    return result;
+}
+
+void ASTReader::read_bytes ( void* const bytes, std::size_t const count )
+{
+    if ( static_cast<std::size_t> ( end - position ) < count ) {
+        BOOST_THROW_EXCEPTION ( malformed_object_error() << str_errinfo ( "Serialized data is truncated" ) );
+    }
+    std::memcpy ( bytes, position, count );
+    position += count;
+}
+
+std::int64_t ASTReader::read_integer()
+{
+    std::int64_t value;
+    read_bytes ( &value, sizeof ( value ) );
+    return value;
+}
+
+std::size_t ASTReader::read_size()
+{
+    std::uint64_t size;
+    read_bytes ( &size, sizeof ( size ) );
+    // No size can be larger than the remaining data; this catches garbage before anything is allocated
+    if ( size > static_cast<std::uint64_t> ( end - position ) ) {
+        BOOST_THROW_EXCEPTION ( malformed_object_error() << str_errinfo ( "Serialized data is corrupt" ) );
+    }
+    return static_cast<std::size_t> ( size );
+}
+
+double ASTReader::read_double()
+{
+    double value;
+    read_bytes ( &value, sizeof ( value ) );
+    return value;
+}
+
+std::string ASTReader::read_string()
+{
+    const std::size_t size = read_size();
+    std::string str ( position, size );
+    position += size;
+    return str;
+}
+
+utree ASTReader::read_utree()
+{
+    ASTNodeTag tag;
+    read_bytes ( &tag, 1 );
+    switch ( tag ) {
+    case ASTNodeTag::NIL:
+        return utree ( boost::spirit::nil );
+    case ASTNodeTag::BOOL: {
+        unsigned char value;
+        read_bytes ( &value, 1 );
+        return utree ( value != 0 );
+    }
+    case ASTNodeTag::INT:
+        return utree ( static_cast<int> ( read_integer() ) );
+    case ASTNodeTag::DOUBLE:
+        return utree ( read_double() );
+    case ASTNodeTag::STRING:
+        return utree ( read_string() );
+    case ASTNodeTag::SYMBOL:
+        return utree ( boost::spirit::utf8_symbol_type ( read_string() ) );
+    case ASTNodeTag::LIST: {
+        const std::size_t size = read_size();
+        utree ut ( boost::spirit::empty_list );
+        for ( std::size_t i = 0; i < size; ++i ) {
+            ut.push_back ( read_utree() );
+        }
+        return ut;
+    }
+    }
+    BOOST_THROW_EXCEPTION ( malformed_object_error() << str_errinfo ( "Unknown AST node in serialized data" ) );
+}
+
+ASTSymbolMap ASTReader::read_symbols()
+{
+    ASTSymbolMap symbols;
+    const std::size_t size = read_size();
+    for ( std::size_t i = 0; i < size; ++i ) {
+        std::string name = read_string();
+        symbols.emplace ( name, CachedAbstractSyntaxTree ( read_utree() ) );
+    }
+    return symbols;
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,130 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Streaming columnar output of result rows
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/column_writer.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include <sstream>
+
+namespace {
+const std::string column_format = "libgibbs columns 1";
+
+std::unique_ptr<std::ofstream> open_column_file ( std::string const &path )
+{
+    std::unique_ptr<std::ofstream> file ( new std::ofstream ( path.c_str(), std::ios::binary | std::ios::trunc ) );
+    if ( !*file ) {
+        BOOST_THROW_EXCEPTION ( file_read_error() << str_errinfo ( "Cannot create column file" ) << specific_errinfo ( path ) );
+    }
+    return file;
+}
+
+void check_name ( std::string const &name )
+{
+    if ( name.find_first_of ( "\t\n" ) != std::string::npos ) {
+        BOOST_THROW_EXCEPTION ( range_check_error() << str_errinfo ( "Column names and labels may not contain tabs or newlines" ) << specific_errinfo ( name ) );
+    }
+}
+}
+
+ColumnWriter::ColumnWriter (
+    std::string const &directory,
+    std::vector<std::string> const &value_columns,
+    std::vector<std::string> const &label_columns,
+    std::size_t const chunk_rows ) :
+    chunk ( chunk_rows > 0 ? chunk_rows : 1 ),
+    row_count ( 0 ),
+    buffered_rows ( 0 ),
+    value_buffers ( value_columns.size() ),
+    label_files ( label_columns.size() ),
+    label_buffers ( label_columns.size() )
+{
+    const std::string prefix = directory.empty() ? std::string() : directory + "/";
+    std::ostringstream manifest;
+    manifest << column_format << "\n";
+    std::size_t file_id = 0;
+    for ( auto i = value_columns.cbegin(); i != value_columns.cend(); ++i, ++file_id ) {
+        check_name ( *i );
+        std::ostringstream file_name;
+        file_name << file_id << ".f64";
+        value_files.push_back ( open_column_file ( prefix + file_name.str() ) );
+        manifest << file_name.str() << "\tfloat64\t" << *i << "\n";
+    }
+    for ( std::size_t i = 0; i < label_columns.size(); ++i, ++file_id ) {
+        check_name ( label_columns[i] );
+        std::ostringstream file_name;
+        file_name << file_id << ".u32";
+        label_files[i].codes = open_column_file ( prefix + file_name.str() );
+        std::ostringstream labels_name;
+        labels_name << file_id << ".labels";
+        label_files[i].labels = open_column_file ( prefix + labels_name.str() );
+        manifest << file_name.str() << "\tlabel\t" << label_columns[i] << "\n";
+    }
+    for ( auto i = value_buffers.begin(); i != value_buffers.end(); ++i ) i->reserve ( chunk );
+    for ( auto i = label_buffers.begin(); i != label_buffers.end(); ++i ) i->reserve ( chunk );
+    // The manifest is written last, so that a reader never finds one without its files
+    std::unique_ptr<std::ofstream> manifest_file = open_column_file ( prefix + "columns.txt" );
+    *manifest_file << manifest.str();
+    manifest_file->flush();
+}
+
+ColumnWriter::~ColumnWriter()
+{
+    try {
+        flush();
+    }
+    catch ( ... ) {
+        // Destructors must not throw; call flush() first to see write errors
+    }
+}
+
+void ColumnWriter::append ( double const* const values, std::vector<std::string> const &labels )
+{
+    if ( labels.size() != label_buffers.size() ) {
+        BOOST_THROW_EXCEPTION ( range_check_error() << str_errinfo ( "Wrong number of labels in column row" ) );
+    }
+    for ( std::size_t i = 0; i < value_buffers.size(); ++i ) value_buffers[i].push_back ( values[i] );
+    for ( std::size_t i = 0; i < label_buffers.size(); ++i ) {
+        LabelColumn &column = label_files[i];
+        auto label_find = column.dictionary.find ( labels[i] );
+        if ( label_find == column.dictionary.end() ) {
+            check_name ( labels[i] );
+            label_find = column.dictionary.emplace ( labels[i], static_cast<std::uint32_t> ( column.dictionary.size() ) ).first;
+            *column.labels << labels[i] << "\n";
+        }
+        label_buffers[i].push_back ( label_find->second );
+    }
+    ++row_count;
+    if ( ++buffered_rows >= chunk ) flush();
+}
+
+void ColumnWriter::flush()
+{
+    // Labels go out before the codes that refer to them
+    for ( auto i = label_files.begin(); i != label_files.end(); ++i ) i->labels->flush();
+    for ( std::size_t i = 0; i < value_buffers.size(); ++i ) {
+        std::vector<double> &buffer = value_buffers[i];
+        value_files[i]->write ( reinterpret_cast<char const*> ( buffer.data() ), buffer.size() * sizeof ( double ) );
+        value_files[i]->flush();
+        buffer.clear();
+    }
+    for ( std::size_t i = 0; i < label_buffers.size(); ++i ) {
+        std::vector<std::uint32_t> &buffer = label_buffers[i];
+        label_files[i].codes->write ( reinterpret_cast<char const*> ( buffer.data() ), buffer.size() * sizeof ( std::uint32_t ) );
+        label_files[i].codes->flush();
+        buffer.clear();
+    }
+    buffered_rows = 0;
+    for ( auto i = value_files.cbegin(); i != value_files.cend(); ++i ) {
+        if ( !**i ) BOOST_THROW_EXCEPTION ( file_read_error() << str_errinfo ( "Cannot write column file" ) );
+    }
+    for ( auto i = label_files.cbegin(); i != label_files.cend(); ++i ) {
+        if ( !*i->codes || !*i->labels ) BOOST_THROW_EXCEPTION ( file_read_error() << str_errinfo ( "Cannot write column file" ) );
+    }
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,1264 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// compiled_expr.cpp -- compiler and interpreter for flat utree programs
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/compiled_expr.hpp"
+#include "libgibbs/include/utils/ast_caching.hpp"
+#include "libgibbs/include/utils/math_expr.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include <boost/spirit/include/support_utree.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <math.h>
+
+using boost::spirit::utree;
+using boost::spirit::utree_type;
+
+namespace {
+// Number of points evaluated together by evaluate_batch()
+// 8 doubles fill one AVX-512 register or two AVX2 registers
+constexpr const std::size_t batch_lanes = 8;
+// Lanes per block for ValueType: the same number of bytes, so twice as many floats
+template <typename ValueType> struct BatchLanes {
+    static constexpr const std::size_t value = batch_lanes * sizeof ( double ) / sizeof ( ValueType );
+};
+
+// Branch-free natural logarithm of one block of positive, normal numbers
+// libm's log() is an opaque call that prevents vectorization of the lane loop
+// Decompose x = m * 2^e with m in [sqrt(1/2),sqrt(2)), then ln(m) = 2*atanh(s) with s = (m-1)/(m+1)
+// |s| < 0.172, so the odd series below is accurate to about one unit in the last place
+inline void lane_log ( double const* const in, double* const out )
+{
+    constexpr const double ln2 = 0.693147180559945309417232121458;
+    for ( std::size_t lane = 0; lane < batch_lanes; ++lane ) {
+        std::uint64_t bits;
+        std::memcpy ( &bits, &in[lane], sizeof ( bits ) );
+        // Shift the mantissa so that it falls in [sqrt(1/2),sqrt(2))
+        bits += 0x00095f619980c433ULL; // 0x3ff0000000000000 - bits of sqrt(1/2)
+        const double exponent = double ( std::int64_t ( bits >> 52 ) - 1023 );
+        bits = ( bits & 0x000fffffffffffffULL ) + 0x3fe6a09e667f3bcdULL;
+        double mantissa;
+        std::memcpy ( &mantissa, &bits, sizeof ( mantissa ) );
+        const double s = ( mantissa - 1.0 ) / ( mantissa + 1.0 );
+        const double s2 = s * s;
+        const double series = 1.0 + s2 * ( 1.0/3 + s2 * ( 1.0/5 + s2 * ( 1.0/7 + s2 * ( 1.0/9 + s2 * ( 1.0/11
+                              + s2 * ( 1.0/13 + s2 * ( 1.0/15 + s2 * ( 1.0/17 + s2 * ( 1.0/19 ) ) ) ) ) ) ) ) );
+        out[lane] = exponent * ln2 + 2.0 * s * series;
+    }
+    for ( std::size_t lane = 0; lane < batch_lanes; ++lane ) {
+        // subnormal input: the bit manipulation above is invalid
+        if ( in[lane] < std::numeric_limits<double>::min() ) out[lane] = log ( in[lane] );
+    }
+}
+// The same for a block of floats, in double precision, half a block at a time
+inline void lane_log ( float const* const in, float* const out )
+{
+    double wide_in[batch_lanes];
+    double wide_out[batch_lanes];
+    for ( std::size_t half = 0; half < BatchLanes<float>::value; half += batch_lanes ) {
+        for ( std::size_t lane = 0; lane < batch_lanes; ++lane ) wide_in[lane] = in[half + lane];
+        lane_log ( wide_in, wide_out );
+        for ( std::size_t lane = 0; lane < batch_lanes; ++lane ) out[half + lane] = static_cast<float> ( wide_out[lane] );
+    }
+}
+}
+
+std::size_t CompiledSlotTable::variable_slot ( std::string const &name )
+{
+    const auto slot_find = std::find ( variables.begin(), variables.end(), name );
+    if ( slot_find != variables.end() ) {
+        return std::distance ( variables.begin(), slot_find );
+    }
+    variables.push_back ( name );
+    return variables.size() - 1;
+}
+
+std::size_t CompiledSlotTable::statevar_slot ( char const name )
+{
+    const auto slot_find = std::find ( statevars.begin(), statevars.end(), name );
+    if ( slot_find != statevars.end() ) {
+        return std::distance ( statevars.begin(), slot_find );
+    }
+    statevars.push_back ( name );
+    return statevars.size() - 1;
+}
+
+CompiledBinding::CompiledBinding (
+    CompiledSlotTable const &slot_table,
+    evalconditions const &conditions,
+    boost::bimap<std::string, int> const &indices ) :
+    slots ( &slot_table ),
+    variable_indices ( slot_table.variables.size(), -1 ),
+    statevar_values ( slot_table.statevars.size(), 0 ),
+    statevar_bound ( slot_table.statevars.size(), false )
+{
+    for ( auto i = slot_table.variables.cbegin(); i != slot_table.variables.cend(); ++i ) {
+        const auto index_find = indices.left.find ( *i );
+        if ( index_find != indices.left.end() ) {
+            variable_indices[std::distance ( slot_table.variables.cbegin(), i )] = index_find->second;
+        }
+    }
+    for ( auto i = slot_table.statevars.cbegin(); i != slot_table.statevars.cend(); ++i ) {
+        const auto statevar_find = conditions.statevars.find ( *i );
+        if ( statevar_find != conditions.statevars.end() ) {
+            const std::size_t slot = std::distance ( slot_table.statevars.cbegin(), i );
+            statevar_values[slot] = statevar_find->second;
+            statevar_bound[slot] = true;
+        }
+    }
+}
+
+int CompiledBinding::variable_index ( std::size_t const slot ) const
+{
+    BOOST_ASSERT ( slot < variable_indices.size() );
+    const int index = variable_indices[slot];
+    if ( index < 0 ) {
+        BOOST_THROW_EXCEPTION ( unknown_symbol_error() << str_errinfo ( "Variable is not in the index map" ) << specific_errinfo ( slots->variables[slot] ) );
+    }
+    return index;
+}
+
+// Compile-time state: the value-numbering table used for common subexpression elimination,
+// and the known values of registers holding constants
+struct CompiledExpression::CompileContext {
+    typedef std::tuple<CompiledOpCode, std::size_t, std::size_t, std::uint64_t> ValueKey;
+    CompileContext ( ASTSymbolMap const &symbols, CompiledSlotTable &slots ) : symbols ( symbols ), slots ( slots ) { }
+    ASTSymbolMap const &symbols;
+    CompiledSlotTable &slots;
+    std::map<ValueKey, std::size_t> values; // operation -> register already holding its result
+    // Keys added inside each enclosing piecewise branch; their registers are not
+    // computed on every path, so they are forgotten when the branch is left
+    std::vector<std::vector<ValueKey>> scopes;
+    std::map<std::size_t, double> constants; // register -> constant value
+    CompiledStatistics statistics;
+    void begin_scope() {
+        scopes.emplace_back();
+    }
+    void end_scope() {
+        for ( auto key = scopes.back().cbegin(); key != scopes.back().cend(); ++key ) {
+            values.erase ( *key );
+        }
+        scopes.pop_back();
+    }
+    bool is_constant ( std::size_t const reg, double const value ) const {
+        const auto constant_find = constants.find ( reg );
+        return constant_find != constants.end() && constant_find->second == value;
+    }
+};
+
+CompiledExpression::CompiledExpression (
+    boost::spirit::utree const &ast,
+    ASTSymbolMap const &symbols,
+    CompiledSlotTable &slots ) :
+    register_count ( 0 ),
+    result_register ( 0 )
+{
+    CompileContext context ( symbols, slots );
+    result_register = compile ( ast, context );
+    stats = context.statistics;
+    finalize();
+}
+
+CompiledStatistics& CompiledStatistics::operator+= ( CompiledStatistics const &other )
+{
+    ast_nodes += other.ast_nodes;
+    instructions += other.instructions;
+    shared += other.shared;
+    folded += other.folded;
+    hoisted += other.hoisted;
+    return *this;
+}
+
+namespace {
+bool is_arithmetic ( CompiledOpCode const op )
+{
+    return op == CompiledOpCode::ADD || op == CompiledOpCode::SUBTRACT || op == CompiledOpCode::NEGATE
+           || op == CompiledOpCode::MULTIPLY || op == CompiledOpCode::DIVIDE || op == CompiledOpCode::POWER
+           || op == CompiledOpCode::LN || op == CompiledOpCode::EXP;
+}
+bool is_unary ( CompiledOpCode const op )
+{
+    return op == CompiledOpCode::NEGATE || op == CompiledOpCode::LN || op == CompiledOpCode::EXP || op == CompiledOpCode::COPY;
+}
+// Evaluate op on constant operands; returns false if it would raise an error at run time
+bool fold_constant ( CompiledOpCode const op, double const a, double const b, double &result )
+{
+    switch ( op ) {
+    case CompiledOpCode::ADD:
+        result = a + b;
+        break;
+    case CompiledOpCode::SUBTRACT:
+        result = a - b;
+        break;
+    case CompiledOpCode::NEGATE:
+        result = -a;
+        break;
+    case CompiledOpCode::MULTIPLY:
+        result = a * b;
+        break;
+    case CompiledOpCode::DIVIDE:
+        if ( b == 0 ) return false;
+        result = a / b;
+        break;
+    case CompiledOpCode::POWER:
+        if ( a < 0 && ( fabs ( b ) < 1 && fabs ( b ) > 0 ) ) return false;
+        result = pow ( a, b );
+        break;
+    case CompiledOpCode::LN:
+        if ( a <= 0 ) return false;
+        result = log ( a );
+        break;
+    case CompiledOpCode::EXP:
+        result = exp ( a );
+        break;
+    default:
+        return false;
+    }
+    return is_allowed_value<double> ( result );
+}
+}
+
+// Emit a pure operation, after trying constant folding, algebraic identities
+// and reuse of an identical operation that has already been emitted
+std::size_t CompiledExpression::emit ( CompileContext &context, CompiledOpCode const op, std::size_t const arg1, std::size_t const arg2, double const constant )
+{
+    if ( is_arithmetic ( op ) ) {
+        const auto constant1 = context.constants.find ( arg1 );
+        const auto constant2 = context.constants.find ( arg2 );
+        double folded_value;
+        if ( constant1 != context.constants.end() && ( is_unary ( op ) || constant2 != context.constants.end() )
+                && fold_constant ( op, constant1->second, is_unary ( op ) ? 0 : constant2->second, folded_value ) ) {
+            ++context.statistics.folded;
+            return emit ( context, CompiledOpCode::CONSTANT, 0, 0, folded_value );
+        }
+        // x+0, 0+x, x-0, x*1, 1*x, x/1, x**1
+        std::size_t identity = std::numeric_limits<std::size_t>::max();
+        if ( op == CompiledOpCode::ADD && context.is_constant ( arg1, 0 ) ) identity = arg2;
+        else if ( ( op == CompiledOpCode::ADD || op == CompiledOpCode::SUBTRACT ) && context.is_constant ( arg2, 0 ) ) identity = arg1;
+        else if ( op == CompiledOpCode::MULTIPLY && context.is_constant ( arg1, 1 ) ) identity = arg2;
+        else if ( ( op == CompiledOpCode::MULTIPLY || op == CompiledOpCode::DIVIDE || op == CompiledOpCode::POWER ) && context.is_constant ( arg2, 1 ) ) identity = arg1;
+        if ( identity != std::numeric_limits<std::size_t>::max() ) {
+            ++context.statistics.folded;
+            return identity;
+        }
+    }
+
+    std::uint64_t constant_bits;
+    std::memcpy ( &constant_bits, &constant, sizeof ( constant_bits ) );
+    std::size_t key_arg1 = arg1, key_arg2 = arg2;
+    if ( ( op == CompiledOpCode::ADD || op == CompiledOpCode::MULTIPLY ) && key_arg2 < key_arg1 ) {
+        std::swap ( key_arg1, key_arg2 ); // commutative
+    }
+    const CompileContext::ValueKey key ( op, key_arg1, key_arg2, constant_bits );
+    const auto value_find = context.values.find ( key );
+    if ( value_find != context.values.end() ) {
+        ++context.statistics.shared;
+        return value_find->second;
+    }
+
+    CompiledInstruction instruction;
+    instruction.op = op;
+    instruction.dest = register_count++;
+    instruction.arg1 = arg1;
+    instruction.arg2 = arg2;
+    instruction.arg3 = 0;
+    instruction.constant = constant;
+    instruction.variable_dependent = true;
+    instruction.hoisted = context.scopes.empty(); // unconditional; finalize() keeps it only if also condition-only
+    program.push_back ( instruction );
+    context.values.emplace ( key, instruction.dest );
+    if ( !context.scopes.empty() ) {
+        context.scopes.back().push_back ( key );
+    }
+    if ( op == CompiledOpCode::CONSTANT ) {
+        context.constants.emplace ( instruction.dest, constant );
+    }
+    return instruction.dest;
+}
+
+std::size_t CompiledExpression::emit_to ( CompiledOpCode const op, std::size_t const dest, std::size_t const arg1, std::size_t const arg2, std::size_t const arg3 )
+{
+    CompiledInstruction instruction;
+    instruction.op = op;
+    instruction.dest = dest;
+    instruction.arg1 = arg1;
+    instruction.arg2 = arg2;
+    instruction.arg3 = arg3;
+    instruction.constant = 0;
+    instruction.variable_dependent = true;
+    instruction.hoisted = false;
+    program.push_back ( instruction );
+    return program.size() - 1;
+}
+
+// Remove instructions whose results are never used, renumber the registers densely,
+// and determine which instructions depend on the variables
+void CompiledExpression::finalize()
+{
+    const std::size_t no_register = std::numeric_limits<std::size_t>::max();
+    const std::size_t program_size = program.size();
+    std::vector<bool> needed ( register_count, false );
+    std::vector<bool> keep ( program_size, false );
+    needed[result_register] = true;
+
+    // All jumps are forward and every register is written before it is read,
+    // so one backward pass finds all the live instructions
+    for ( std::size_t pos = program_size; pos-- > 0; ) {
+        const CompiledInstruction &ins = program[pos];
+        if ( ins.op == CompiledOpCode::RANGE_CHECK ) {
+            needed[ins.arg1] = needed[ins.arg2] = needed[ins.arg3] = true;
+            keep[pos] = true;
+        } else if ( ins.op == CompiledOpCode::JUMP ) {
+            keep[pos] = true;
+        } else if ( needed[ins.dest] ) {
+            keep[pos] = true;
+            if ( is_arithmetic ( ins.op ) || ins.op == CompiledOpCode::COPY ) {
+                needed[ins.arg1] = true;
+                if ( !is_unary ( ins.op ) ) needed[ins.arg2] = true;
+            }
+        }
+    }
+
+    std::vector<std::size_t> new_position ( program_size + 1 );
+    std::vector<std::size_t> new_register ( register_count, no_register );
+    std::vector<bool> register_dependent;
+    std::vector<CompiledInstruction> new_program;
+    std::size_t new_register_count = 0;
+    auto rename = [&] ( std::size_t const reg ) {
+        if ( new_register[reg] == no_register ) {
+            new_register[reg] = new_register_count++;
+            register_dependent.push_back ( false );
+        }
+        return new_register[reg];
+    };
+    for ( std::size_t pos = 0; pos < program_size; ++pos ) {
+        new_position[pos] = new_program.size();
+        if ( !keep[pos] ) {
+            continue;
+        }
+        CompiledInstruction ins = program[pos];
+        if ( ins.op == CompiledOpCode::RANGE_CHECK ) {
+            ins.arg1 = rename ( ins.arg1 );
+            ins.arg2 = rename ( ins.arg2 );
+            ins.arg3 = rename ( ins.arg3 );
+            ins.variable_dependent = register_dependent[ins.arg1] || register_dependent[ins.arg2] || register_dependent[ins.arg3];
+        } else if ( ins.op != CompiledOpCode::JUMP ) {
+            if ( ins.op == CompiledOpCode::VARIABLE ) {
+                ins.variable_dependent = true;
+            } else if ( ins.op == CompiledOpCode::CONSTANT || ins.op == CompiledOpCode::STATEVAR ) {
+                ins.variable_dependent = false;
+            } else {
+                ins.arg1 = rename ( ins.arg1 );
+                ins.variable_dependent = register_dependent[ins.arg1];
+                if ( !is_unary ( ins.op ) ) {
+                    ins.arg2 = rename ( ins.arg2 );
+                    ins.variable_dependent = ins.variable_dependent || register_dependent[ins.arg2];
+                }
+            }
+            ins.dest = rename ( ins.dest );
+            // a register written in several branches depends on the variables if any of its values do
+            register_dependent[ins.dest] = register_dependent[ins.dest] || ins.variable_dependent;
+        }
+        ins.hoisted = ins.hoisted && !ins.variable_dependent;
+        if ( ins.hoisted ) ++stats.hoisted;
+        new_program.push_back ( ins );
+    }
+    new_position[program_size] = new_program.size();
+    for ( auto ins = new_program.begin(); ins != new_program.end(); ++ins ) {
+        if ( ins->op == CompiledOpCode::RANGE_CHECK || ins->op == CompiledOpCode::JUMP ) {
+            ins->dest = new_position[ins->dest];
+        }
+    }
+    result_register = rename ( result_register );
+    register_count = new_register_count;
+    program = std::move ( new_program );
+    stats.instructions = program.size();
+}
+
+// Partial evaluation: one forward pass over the reachable instructions, tracking the registers
+// whose values are known for binding's state variables. Range checks on known registers are resolved,
+// which leaves the pieces they skip unreachable; known results become constants, and finalize()
+// removes the instructions that no longer contribute to the result.
+CompiledExpression CompiledExpression::specialize ( CompiledBinding const &binding ) const
+{
+    BOOST_ASSERT ( binding.statevar_values.size() == binding.slots->statevars.size() );
+    CompiledExpression specialized;
+    if ( program.empty() ) {
+        return specialized;
+    }
+    const std::size_t program_size = program.size();
+    std::vector<bool> reachable ( program_size + 1, false );
+    std::vector<bool> keep ( program_size, false );
+    std::vector<bool> known ( register_count, false );
+    std::vector<std::size_t> writes ( register_count, 0 ); // reachable writes so far; only piecewise results have several
+    std::vector<double> known_values ( register_count, 0 );
+    std::vector<CompiledInstruction> new_program ( program );
+    std::size_t folded = 0;
+    reachable[0] = true;
+
+    for ( std::size_t pos = 0; pos < program_size; ++pos ) {
+        if ( !reachable[pos] ) {
+            continue;
+        }
+        CompiledInstruction &ins = new_program[pos];
+        if ( ins.op == CompiledOpCode::RANGE_CHECK ) {
+            double value = known_values[ins.arg1];
+            double low_limit = known_values[ins.arg2];
+            double high_limit = known_values[ins.arg3];
+            if ( known[ins.arg1] && known[ins.arg2] && known[ins.arg3] && is_allowed_value<double> ( value )
+                    && is_allowed_value<double> ( low_limit ) && is_allowed_value<double> ( high_limit ) && low_limit < high_limit ) {
+                const bool satisfied = ( value >= low_limit ) && ( value < high_limit );
+                reachable[satisfied ? pos + 1 : ins.dest] = true;
+                ++folded;
+            }
+            else {
+                keep[pos] = true;
+                reachable[pos + 1] = reachable[ins.dest] = true;
+            }
+            continue;
+        }
+        keep[pos] = true;
+        if ( ins.op == CompiledOpCode::JUMP ) {
+            reachable[ins.dest] = true;
+            continue;
+        }
+        reachable[pos + 1] = true;
+        bool is_known = false;
+        double result = 0;
+        if ( ins.op == CompiledOpCode::CONSTANT ) {
+            is_known = true;
+            result = ins.constant;
+        } else if ( ins.op == CompiledOpCode::STATEVAR ) {
+            is_known = binding.statevar_bound[ins.arg1];
+            result = binding.statevar_values[ins.arg1];
+        } else if ( ins.op == CompiledOpCode::COPY ) {
+            is_known = known[ins.arg1];
+            result = known_values[ins.arg1];
+        } else if ( is_arithmetic ( ins.op ) && known[ins.arg1] && ( is_unary ( ins.op ) || known[ins.arg2] ) ) {
+            is_known = fold_constant ( ins.op, known_values[ins.arg1], is_unary ( ins.op ) ? 0 : known_values[ins.arg2], result );
+        }
+        // A register written on several paths is known only if just one of them is left
+        ++writes[ins.dest];
+        known[ins.dest] = is_known && writes[ins.dest] == 1;
+        known_values[ins.dest] = result;
+        if ( is_known && ins.op != CompiledOpCode::CONSTANT ) {
+            ins.op = CompiledOpCode::CONSTANT;
+            ins.constant = result;
+            ++folded;
+        }
+    }
+
+    // Jumps over nothing but removed instructions are removed too; inner jumps are visited first
+    std::size_t next_kept = program_size;
+    for ( std::size_t pos = program_size; pos-- > 0; ) {
+        if ( !keep[pos] ) {
+            continue;
+        }
+        if ( new_program[pos].op == CompiledOpCode::JUMP && next_kept >= new_program[pos].dest ) {
+            keep[pos] = false;
+            continue;
+        }
+        next_kept = pos;
+    }
+
+    std::vector<std::size_t> new_position ( program_size + 1 );
+    for ( std::size_t pos = 0; pos < program_size; ++pos ) {
+        new_position[pos] = specialized.program.size();
+        if ( keep[pos] ) {
+            specialized.program.push_back ( new_program[pos] );
+        }
+    }
+    new_position[program_size] = specialized.program.size();
+    for ( auto ins = specialized.program.begin(); ins != specialized.program.end(); ++ins ) {
+        if ( ins->op == CompiledOpCode::RANGE_CHECK || ins->op == CompiledOpCode::JUMP ) {
+            ins->dest = new_position[ins->dest];
+        }
+    }
+    specialized.register_count = register_count;
+    specialized.result_register = result_register;
+    specialized.stats = stats;
+    specialized.stats.folded += folded;
+    specialized.stats.hoisted = 0;
+    specialized.finalize();
+    return specialized;
+}
+
+// Resolve a name the same way process_utree() does: special symbols are inlined,
+// single characters are state variables and everything else is a model variable
+std::size_t CompiledExpression::compile_reference ( std::string const &name, CompileContext &context )
+{
+    const auto symbol_find = context.symbols.find ( name );
+    if ( symbol_find != context.symbols.end() ) {
+        return compile ( symbol_find->second.get(), context );
+    }
+    if ( name.size() == 1 ) {
+        return emit ( context, CompiledOpCode::STATEVAR, context.slots.statevar_slot ( name[0] ) );
+    }
+    return emit ( context, CompiledOpCode::VARIABLE, context.slots.variable_slot ( name ) );
+}
+
+std::size_t CompiledExpression::compile ( boost::spirit::utree const &ut, CompileContext &context )
+{
+    ++context.statistics.ast_nodes;
+    switch ( ut.which() ) {
+    case utree_type::list_type:
+        return compile_list ( ut, context );
+    case utree_type::double_type:
+    case utree_type::int_type: {
+        double value = ut.get<double>();
+        if ( !is_allowed_value<double> ( value ) ) {
+            BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Calculated value is infinite, subnormal, or not a number" ) << ast_errinfo ( ut ) );
+        }
+        return emit ( context, CompiledOpCode::CONSTANT, 0, 0, value );
+    }
+    case utree_type::string_type: {
+        boost::spirit::utf8_string_range_type rt = ut.get<boost::spirit::utf8_string_range_type>();
+        return compile_reference ( std::string ( rt.begin(), rt.end() ), context );
+    }
+    default:
+        break;
+    }
+    BOOST_THROW_EXCEPTION ( unknown_symbol_error() << str_errinfo ( "Unknown operator or state variable" ) << ast_errinfo ( ut ) );
+    return 0;
+}
+
+// Mirrors the list handling of process_utree(): the list is scanned for operators,
+// the results of all operations are summed, and a variable, symbol, trailing number
+// or satisfied range check returns its value for the whole list
+std::size_t CompiledExpression::compile_list ( boost::spirit::utree const &ut, CompileContext &context )
+{
+    const std::size_t no_register = std::numeric_limits<std::size_t>::max();
+    std::vector<std::size_t> terms; // results of each operation in the list
+    std::vector<std::size_t> exits; // jumps taken when a range check is satisfied
+    std::size_t range_register = no_register; // holds the value of a satisfied range check
+    std::size_t value_register = no_register;
+    auto it = ut.begin();
+    auto end = ut.end();
+
+    while ( it != end && value_register == no_register ) {
+        if ( ( it->which() == utree_type::double_type || it->which() == utree_type::int_type ) && std::distance ( it,end ) == 1 ) {
+            value_register = compile ( *it, context );
+            break;
+        }
+        if ( it->which() != utree_type::string_type ) {
+            ++it;
+            continue;
+        }
+        boost::spirit::utf8_string_range_type rt = it->get<boost::spirit::utf8_string_range_type>();
+        std::string op ( rt.begin(), rt.end() );
+        boost::algorithm::to_upper ( op );
+
+        if ( op == "@" ) {
+            // range check: @ variable low_limit high_limit tree
+            if ( std::distance ( it,end ) < 5 ) {
+                BOOST_THROW_EXCEPTION ( bad_symbol_error() << str_errinfo ( "Range check requires a variable, two limits and an expression" ) << ast_errinfo ( ut ) );
+            }
+            if ( range_register == no_register ) {
+                range_register = register_count++;
+            }
+            const std::size_t variable = compile ( *++it, context );
+            const std::size_t low_limit = compile ( *++it, context );
+            const std::size_t high_limit = compile ( *++it, context );
+            const std::size_t check = emit_to ( CompiledOpCode::RANGE_CHECK, 0, variable, low_limit, high_limit );
+            if ( exits.empty() ) {
+                context.begin_scope(); // everything after the first range check is conditional
+            }
+            context.begin_scope();
+            const std::size_t piece = compile ( *++it, context );
+            emit_to ( CompiledOpCode::COPY, range_register, piece );
+            exits.push_back ( emit_to ( CompiledOpCode::JUMP, 0 ) );
+            context.end_scope();
+            program[check].dest = program.size(); // range check failed: continue from here
+            ++it;
+            if ( it == end ) {
+                // failed all range checks
+                value_register = emit ( context, CompiledOpCode::CONSTANT, 0, 0, 0 );
+            }
+            continue;
+        }
+        if ( op != "+" && op != "-" && op != "*" && op != "/" && op != "**" && op != "LN" && op != "EXP" ) {
+            value_register = compile_reference ( op, context );
+            break;
+        }
+
+        ++it; // left-hand side
+        std::size_t lhs = no_register;
+        std::size_t rhs = no_register;
+        if ( it != end ) {
+            lhs = compile ( *it, context );
+            ++it; // right-hand side
+        }
+        if ( it != end ) {
+            rhs = compile ( *it, context );
+            ++it;
+        }
+        if ( lhs == no_register ) {
+            lhs = emit ( context, CompiledOpCode::CONSTANT, 0, 0, 0 );
+        }
+        if ( rhs == no_register && op != "LN" && op != "EXP" && !( op == "-" && ut.size() == 2 ) ) {
+            rhs = emit ( context, CompiledOpCode::CONSTANT, 0, 0, 0 );
+        }
+
+        if ( op == "+" ) terms.push_back ( emit ( context, CompiledOpCode::ADD, lhs, rhs ) );
+        else if ( op == "-" ) {
+            if ( ut.size() == 2 ) terms.push_back ( emit ( context, CompiledOpCode::NEGATE, lhs ) ); // case of negation (unary operator)
+            else terms.push_back ( emit ( context, CompiledOpCode::SUBTRACT, lhs, rhs ) );
+        }
+        else if ( op == "*" ) terms.push_back ( emit ( context, CompiledOpCode::MULTIPLY, lhs, rhs ) );
+        else if ( op == "/" ) terms.push_back ( emit ( context, CompiledOpCode::DIVIDE, lhs, rhs ) );
+        else if ( op == "**" ) terms.push_back ( emit ( context, CompiledOpCode::POWER, lhs, rhs ) );
+        else if ( op == "LN" ) terms.push_back ( emit ( context, CompiledOpCode::LN, lhs ) );
+        else terms.push_back ( emit ( context, CompiledOpCode::EXP, lhs ) );
+    }
+
+    if ( value_register == no_register ) {
+        if ( terms.empty() ) {
+            value_register = emit ( context, CompiledOpCode::CONSTANT, 0, 0, 0 );
+        }
+        else {
+            value_register = terms.front();
+            for ( auto term = terms.cbegin() + 1; term != terms.cend(); ++term ) {
+                value_register = emit ( context, CompiledOpCode::ADD, value_register, *term );
+            }
+        }
+    }
+    if ( exits.empty() ) {
+        return value_register;
+    }
+    emit_to ( CompiledOpCode::COPY, range_register, value_register );
+    for ( auto exit : exits ) {
+        program[exit].dest = program.size();
+    }
+    context.end_scope();
+    return range_register;
+}
+
+bool CompiledExpression::variable_dependent() const
+{
+    for ( auto ins = program.cbegin(); ins != program.cend(); ++ins ) {
+        // jumps carry no value; they only follow the range checks, which are flagged themselves
+        if ( ins->op != CompiledOpCode::JUMP && ins->variable_dependent ) return true;
+    }
+    return false;
+}
+
+double CompiledExpression::evaluate ( CompiledBinding const &binding, double const* const x ) const
+{
+    if ( program.empty() ) {
+        return 0;
+    }
+    std::vector<double> reg ( register_count );
+    return execute ( binding, x, &reg[0], nullptr );
+}
+
+double CompiledExpression::execute (
+    CompiledBinding const &binding,
+    double const* const x,
+    double* const reg,
+    std::vector<std::size_t>* const trace ) const
+{
+    BOOST_ASSERT ( binding.variable_indices.size() == binding.slots->variables.size() );
+    const std::size_t program_size = program.size();
+    std::size_t pc = 0;
+
+    while ( pc < program_size ) {
+        const CompiledInstruction &ins = program[pc++];
+        if ( trace && ins.op != CompiledOpCode::RANGE_CHECK && ins.op != CompiledOpCode::JUMP ) {
+            trace->push_back ( pc - 1 );
+        }
+        switch ( ins.op ) {
+        case CompiledOpCode::CONSTANT:
+            reg[ins.dest] = ins.constant;
+            break;
+        case CompiledOpCode::VARIABLE:
+            reg[ins.dest] = x[binding.variable_index ( ins.arg1 )];
+            break;
+        case CompiledOpCode::STATEVAR:
+            if ( !binding.statevar_bound[ins.arg1] ) {
+                BOOST_THROW_EXCEPTION ( unknown_symbol_error() << str_errinfo ( "Unknown operator or state variable" ) << specific_errinfo ( std::string ( 1, binding.slots->statevars[ins.arg1] ) ) );
+            }
+            reg[ins.dest] = binding.statevar_values[ins.arg1];
+            break;
+        case CompiledOpCode::COPY:
+            reg[ins.dest] = reg[ins.arg1];
+            break;
+        case CompiledOpCode::ADD:
+            reg[ins.dest] = reg[ins.arg1] + reg[ins.arg2];
+            break;
+        case CompiledOpCode::SUBTRACT:
+            reg[ins.dest] = reg[ins.arg1] - reg[ins.arg2];
+            break;
+        case CompiledOpCode::NEGATE:
+            reg[ins.dest] = -reg[ins.arg1];
+            break;
+        case CompiledOpCode::MULTIPLY:
+            reg[ins.dest] = reg[ins.arg1] * reg[ins.arg2];
+            break;
+        case CompiledOpCode::DIVIDE:
+            if ( reg[ins.arg2] == 0 ) {
+                BOOST_THROW_EXCEPTION ( divide_by_zero_error() );
+            }
+            reg[ins.dest] = reg[ins.arg1] / reg[ins.arg2];
+            break;
+        case CompiledOpCode::POWER:
+            if ( reg[ins.arg1] < 0 && ( fabs ( reg[ins.arg2] ) < 1 && fabs ( reg[ins.arg2] ) > 0 ) ) {
+                // the result is complex
+                // we do not support this (for now)
+                BOOST_THROW_EXCEPTION ( domain_error() << str_errinfo ( "Calculated values are not real" ) );
+            }
+            reg[ins.dest] = pow ( reg[ins.arg1], reg[ins.arg2] );
+            break;
+        case CompiledOpCode::LN:
+            if ( reg[ins.arg1] <= 0 ) {
+                // outside the domain of ln
+                BOOST_THROW_EXCEPTION ( domain_error() << str_errinfo ( "Logarithm of nonpositive number is not defined" ) );
+            }
+            reg[ins.dest] = log ( reg[ins.arg1] );
+            break;
+        case CompiledOpCode::EXP:
+            reg[ins.dest] = exp ( reg[ins.arg1] );
+            break;
+        case CompiledOpCode::RANGE_CHECK: {
+            double value = reg[ins.arg1];
+            double low_limit = reg[ins.arg2];
+            double high_limit = reg[ins.arg3];
+            if ( !is_allowed_value<double> ( value ) ) {
+                BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Variable is infinite, subnormal, or not a number" ) );
+            }
+            if ( !is_allowed_value<double> ( low_limit ) || !is_allowed_value<double> ( high_limit ) ) {
+                BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Variable limits are infinite, subnormal, or not a number" ) );
+            }
+            if ( high_limit <= low_limit ) {
+                BOOST_THROW_EXCEPTION ( bounds_error() << str_errinfo ( "Inconsistent bounds on variable specified. The upper limit <= the lower limit." ) );
+            }
+            if ( !( ( value >= low_limit ) && ( value < high_limit ) ) ) {
+                pc = ins.dest; // range check not satisfied
+            }
+            break;
+        }
+        case CompiledOpCode::JUMP:
+            pc = ins.dest;
+            break;
+        }
+    }
+
+    // Non-finite intermediate values propagate, so the result only needs to be checked once
+    double result = reg[result_register];
+    if ( !is_allowed_value<double> ( result ) ) {
+        BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Calculated value is infinite, subnormal, or not a number" ) );
+    }
+    return result;
+}
+
+void CompiledExpression::evaluate_batch (
+    CompiledBinding const &binding,
+    double const* const x,
+    std::size_t const npoints,
+    std::size_t const stride,
+    double* const out ) const
+{
+    if ( program.empty() || npoints == 0 ) {
+        return;
+    }
+    BOOST_ASSERT ( binding.variable_indices.size() == binding.slots->variables.size() );
+    std::vector<double> reg ( register_count * batch_lanes );
+    double const* lane_points[batch_lanes];
+    for ( std::size_t lane = 0; lane < batch_lanes; ++lane ) {
+        lane_points[lane] = x;
+    }
+    // Instructions depending only on the conditions are the same for every point
+    evaluate_lanes ( binding, lane_points, &reg[0], true );
+
+    for ( std::size_t block = 0; block < npoints; block += batch_lanes ) {
+        const std::size_t block_size = std::min ( batch_lanes, npoints - block );
+        for ( std::size_t lane = 0; lane < batch_lanes; ++lane ) {
+            // pad a partial block with copies of its last point; those results are discarded
+            lane_points[lane] = x + ( block + std::min ( lane, block_size - 1 ) ) * stride;
+        }
+        if ( evaluate_lanes ( binding, lane_points, &reg[0], false ) ) {
+            double const* const result = &reg[result_register * batch_lanes];
+            for ( std::size_t lane = 0; lane < block_size; ++lane ) {
+                double value = result[lane];
+                if ( !is_allowed_value<double> ( value ) ) {
+                    BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Calculated value is infinite, subnormal, or not a number" ) );
+                }
+                out[block + lane] += value;
+            }
+        }
+        else {
+            // The points of this block fall in different ranges of a piecewise expression
+            for ( std::size_t lane = 0; lane < block_size; ++lane ) {
+                out[block + lane] += evaluate ( binding, lane_points[lane] );
+            }
+        }
+    }
+}
+
+void CompiledExpression::evaluate_batch (
+    CompiledBinding const &binding,
+    float const* const x,
+    std::size_t const npoints,
+    std::size_t const stride,
+    float* const out ) const
+{
+    constexpr const std::size_t lanes = BatchLanes<float>::value;
+    if ( program.empty() || npoints == 0 ) {
+        return;
+    }
+    BOOST_ASSERT ( binding.variable_indices.size() == binding.slots->variables.size() );
+    if ( !single_precision_safe() ) {
+        // Some constant would be rounded to zero or infinity in single precision
+        std::vector<double> wide_x ( npoints * stride );
+        std::vector<double> wide_out ( npoints, 0.0 );
+        std::copy ( x, x + npoints * stride, wide_x.begin() );
+        evaluate_batch ( binding, &wide_x[0], npoints, stride, &wide_out[0] );
+        for ( std::size_t i = 0; i < npoints; ++i ) out[i] += static_cast<float> ( wide_out[i] );
+        return;
+    }
+    std::vector<float> reg ( register_count * lanes );
+    float const* lane_points[lanes];
+    for ( std::size_t lane = 0; lane < lanes; ++lane ) {
+        lane_points[lane] = x;
+    }
+    evaluate_lanes ( binding, lane_points, &reg[0], true );
+
+    std::vector<double> wide_point ( stride );
+    for ( std::size_t block = 0; block < npoints; block += lanes ) {
+        const std::size_t block_size = std::min ( lanes, npoints - block );
+        for ( std::size_t lane = 0; lane < lanes; ++lane ) {
+            lane_points[lane] = x + ( block + std::min ( lane, block_size - 1 ) ) * stride;
+        }
+        if ( evaluate_lanes ( binding, lane_points, &reg[0], false ) ) {
+            float const* const result = &reg[result_register * lanes];
+            for ( std::size_t lane = 0; lane < block_size; ++lane ) {
+                float value = result[lane];
+                if ( !is_allowed_value<float> ( value ) ) {
+                    BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Calculated value is infinite, subnormal, or not a number" ) );
+                }
+                out[block + lane] += value;
+            }
+        }
+        else {
+            // Divergent range checks: evaluate these points one by one, in double precision
+            for ( std::size_t lane = 0; lane < block_size; ++lane ) {
+                std::copy ( lane_points[lane], lane_points[lane] + stride, wide_point.begin() );
+                out[block + lane] += static_cast<float> ( evaluate ( binding, &wide_point[0] ) );
+            }
+        }
+    }
+}
+
+bool CompiledExpression::single_precision_safe() const
+{
+    for ( auto ins = program.cbegin(); ins != program.cend(); ++ins ) {
+        if ( ins->op != CompiledOpCode::CONSTANT || ins->constant == 0 ) continue;
+        const double magnitude = std::abs ( ins->constant );
+        if ( magnitude < std::numeric_limits<float>::min() || magnitude > std::numeric_limits<float>::max() ) return false;
+    }
+    return true;
+}
+
+template <typename ValueType>
+bool CompiledExpression::evaluate_lanes ( CompiledBinding const &binding, ValueType const* const* const lane_points, ValueType* const reg, bool const hoisted_pass ) const
+{
+    constexpr const std::size_t lanes = BatchLanes<ValueType>::value;
+    const std::size_t program_size = program.size();
+    std::size_t pc = 0;
+
+    while ( pc < program_size ) {
+        const CompiledInstruction &ins = program[pc++];
+        if ( ins.hoisted != hoisted_pass ) {
+            continue; // hoisted instructions are never jumped over, so the hoisted pass is linear
+        }
+        switch ( ins.op ) {
+        case CompiledOpCode::CONSTANT: {
+            ValueType* const d = reg + ins.dest * lanes;
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) d[lane] = static_cast<ValueType> ( ins.constant );
+            break;
+        }
+        case CompiledOpCode::VARIABLE: {
+            ValueType* const d = reg + ins.dest * lanes;
+            const int index = binding.variable_index ( ins.arg1 );
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) d[lane] = lane_points[lane][index];
+            break;
+        }
+        case CompiledOpCode::STATEVAR: {
+            if ( !binding.statevar_bound[ins.arg1] ) {
+                BOOST_THROW_EXCEPTION ( unknown_symbol_error() << str_errinfo ( "Unknown operator or state variable" ) << specific_errinfo ( std::string ( 1, binding.slots->statevars[ins.arg1] ) ) );
+            }
+            ValueType* const d = reg + ins.dest * lanes;
+            const ValueType value = static_cast<ValueType> ( binding.statevar_values[ins.arg1] );
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) d[lane] = value;
+            break;
+        }
+        case CompiledOpCode::COPY: {
+            ValueType* const d = reg + ins.dest * lanes;
+            ValueType const* const a = reg + ins.arg1 * lanes;
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) d[lane] = a[lane];
+            break;
+        }
+        case CompiledOpCode::ADD: {
+            ValueType* const d = reg + ins.dest * lanes;
+            ValueType const* const a = reg + ins.arg1 * lanes;
+            ValueType const* const b = reg + ins.arg2 * lanes;
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) d[lane] = a[lane] + b[lane];
+            break;
+        }
+        case CompiledOpCode::SUBTRACT: {
+            ValueType* const d = reg + ins.dest * lanes;
+            ValueType const* const a = reg + ins.arg1 * lanes;
+            ValueType const* const b = reg + ins.arg2 * lanes;
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) d[lane] = a[lane] - b[lane];
+            break;
+        }
+        case CompiledOpCode::NEGATE: {
+            ValueType* const d = reg + ins.dest * lanes;
+            ValueType const* const a = reg + ins.arg1 * lanes;
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) d[lane] = -a[lane];
+            break;
+        }
+        case CompiledOpCode::MULTIPLY: {
+            ValueType* const d = reg + ins.dest * lanes;
+            ValueType const* const a = reg + ins.arg1 * lanes;
+            ValueType const* const b = reg + ins.arg2 * lanes;
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) d[lane] = a[lane] * b[lane];
+            break;
+        }
+        case CompiledOpCode::DIVIDE: {
+            ValueType* const d = reg + ins.dest * lanes;
+            ValueType const* const a = reg + ins.arg1 * lanes;
+            ValueType const* const b = reg + ins.arg2 * lanes;
+            bool zero_divisor = false;
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) zero_divisor |= ( b[lane] == 0 );
+            if ( zero_divisor ) {
+                BOOST_THROW_EXCEPTION ( divide_by_zero_error() );
+            }
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) d[lane] = a[lane] / b[lane];
+            break;
+        }
+        case CompiledOpCode::POWER: {
+            ValueType* const d = reg + ins.dest * lanes;
+            ValueType const* const a = reg + ins.arg1 * lanes;
+            ValueType const* const b = reg + ins.arg2 * lanes;
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) {
+                if ( a[lane] < 0 && ( std::abs ( b[lane] ) < 1 && std::abs ( b[lane] ) > 0 ) ) {
+                    // the result is complex
+                    // we do not support this (for now)
+                    BOOST_THROW_EXCEPTION ( domain_error() << str_errinfo ( "Calculated values are not real" ) );
+                }
+                d[lane] = std::pow ( a[lane], b[lane] );
+            }
+            break;
+        }
+        case CompiledOpCode::LN: {
+            ValueType* const d = reg + ins.dest * lanes;
+            ValueType const* const a = reg + ins.arg1 * lanes;
+            bool nonpositive = false;
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) nonpositive |= ( a[lane] <= 0 );
+            if ( nonpositive ) {
+                // outside the domain of ln
+                BOOST_THROW_EXCEPTION ( domain_error() << str_errinfo ( "Logarithm of nonpositive number is not defined" ) );
+            }
+            lane_log ( a, d );
+            break;
+        }
+        case CompiledOpCode::EXP: {
+            ValueType* const d = reg + ins.dest * lanes;
+            ValueType const* const a = reg + ins.arg1 * lanes;
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) d[lane] = std::exp ( a[lane] );
+            break;
+        }
+        case CompiledOpCode::RANGE_CHECK: {
+            ValueType const* const values = reg + ins.arg1 * lanes;
+            ValueType const* const low_limits = reg + ins.arg2 * lanes;
+            ValueType const* const high_limits = reg + ins.arg3 * lanes;
+            std::size_t satisfied_count = 0;
+            for ( std::size_t lane = 0; lane < lanes; ++lane ) {
+                ValueType value = values[lane];
+                ValueType low_limit = low_limits[lane];
+                ValueType high_limit = high_limits[lane];
+                if ( !is_allowed_value<ValueType> ( value ) ) {
+                    BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Variable is infinite, subnormal, or not a number" ) );
+                }
+                if ( !is_allowed_value<ValueType> ( low_limit ) || !is_allowed_value<ValueType> ( high_limit ) ) {
+                    BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Variable limits are infinite, subnormal, or not a number" ) );
+                }
+                if ( high_limit <= low_limit ) {
+                    BOOST_THROW_EXCEPTION ( bounds_error() << str_errinfo ( "Inconsistent bounds on variable specified. The upper limit <= the lower limit." ) );
+                }
+                if ( ( value >= low_limit ) && ( value < high_limit ) ) ++satisfied_count;
+            }
+            if ( satisfied_count == 0 ) {
+                pc = ins.dest; // range check not satisfied
+            }
+            else if ( satisfied_count != lanes ) {
+                return false; // divergent branches; caller falls back to evaluate()
+            }
+            break;
+        }
+        case CompiledOpCode::JUMP:
+            pc = ins.dest;
+            break;
+        }
+    }
+    return true;
+}
+// Gradient and Hessian by forward-over-reverse automatic differentiation
+// The forward sweep computes the values and the tangents in the direction of every variable slot at once
+// (one column of dot per slot); the reverse sweep then propagates the adjoints (bar) and their
+// tangents (bardot) back along the executed instructions. For every operation reg[dest] = f(a,b):
+//   bar[a] += bar[dest] * f_a
+//   bardot[a] += bardot[dest] * f_a + bar[dest] * ( f_aa * dot[a] + f_ab * dot[b] )
+// Reference: Griewank and Walther, 2008, "Evaluating Derivatives", ch. 5.4
+namespace {
+// Local first and second partial derivatives of one operation, whose operands are in reg
+struct Partials {
+    double a, b, aa, ab, bb;
+};
+Partials partials ( CompiledInstruction const &ins, std::vector<double> const &reg )
+{
+    Partials p = { 0, 0, 0, 0, 0 };
+    const double a = reg[ins.arg1];
+    const double b = reg[ins.arg2];
+    switch ( ins.op ) {
+    case CompiledOpCode::COPY:
+        p.a = 1;
+        break;
+    case CompiledOpCode::ADD:
+        p.a = 1;
+        p.b = 1;
+        break;
+    case CompiledOpCode::SUBTRACT:
+        p.a = 1;
+        p.b = -1;
+        break;
+    case CompiledOpCode::NEGATE:
+        p.a = -1;
+        break;
+    case CompiledOpCode::MULTIPLY:
+        p.a = b;
+        p.b = a;
+        p.ab = 1;
+        break;
+    case CompiledOpCode::DIVIDE:
+        p.a = 1 / b;
+        p.b = -a / ( b * b );
+        p.ab = -1 / ( b * b );
+        p.bb = 2 * a / ( b * b * b );
+        break;
+    case CompiledOpCode::POWER:
+        // constant exponents are by far the most common; avoid 0 * inf for small integer powers
+        if ( b != 0 ) p.a = b * pow ( a, b - 1 );
+        if ( b != 0 && b != 1 ) p.aa = b * ( b - 1 ) * pow ( a, b - 2 );
+        if ( a > 0 ) {
+            // the exponent may depend on the variables
+            const double lna = log ( a );
+            p.b = reg[ins.dest] * lna;
+            p.ab = pow ( a, b - 1 ) * ( 1 + b * lna );
+            p.bb = reg[ins.dest] * lna * lna;
+        }
+        break;
+    case CompiledOpCode::LN:
+        p.a = 1 / a;
+        p.aa = -1 / ( a * a );
+        break;
+    case CompiledOpCode::EXP:
+        p.a = reg[ins.dest];
+        p.aa = reg[ins.dest];
+        break;
+    default:
+        break;
+    }
+    return p;
+}
+bool is_binary ( CompiledOpCode const op )
+{
+    return op == CompiledOpCode::ADD || op == CompiledOpCode::SUBTRACT || op == CompiledOpCode::MULTIPLY
+           || op == CompiledOpCode::DIVIDE || op == CompiledOpCode::POWER;
+}
+}
+
+void CompiledExpression::evaluate_jet (
+    CompiledBinding const &binding,
+    double const* const x,
+    CompiledJet &jet,
+    bool const with_hessian ) const
+{
+    const std::size_t n = binding.slots->variables.size();
+    BOOST_ASSERT ( jet.gradient.size() == n );
+    BOOST_ASSERT ( !with_hessian || jet.hessian.size() == n * n );
+    if ( program.empty() ) {
+        return;
+    }
+    // The scratch vectors of jet only grow, so a reused workspace stops allocating after the first call
+    std::vector<double> &reg = jet.registers;
+    std::vector<std::size_t> &trace = jet.trace;
+    reg.assign ( register_count, 0 );
+    trace.clear();
+    trace.reserve ( program.size() );
+    jet.value += execute ( binding, x, &reg[0], &trace );
+
+    std::vector<double> &bar = jet.adjoints;
+    bar.assign ( register_count, 0 );
+    // Only filled if second derivatives are requested
+    const std::size_t dn = with_hessian ? n : 0;
+    std::vector<double> &dot = jet.tangents;
+    std::vector<double> &bardot = jet.adjoint_tangents;
+    dot.assign ( register_count * dn, 0 );
+    bardot.assign ( register_count * dn, 0 );
+
+    if ( with_hessian ) {
+        // Forward sweep: tangents in all directions
+        for ( auto pos = trace.cbegin(); pos != trace.cend(); ++pos ) {
+            const CompiledInstruction &ins = program[*pos];
+            double* const d = &dot[ins.dest * n];
+            if ( !ins.variable_dependent ) {
+                continue; // tangents are already zero
+            } else if ( ins.op == CompiledOpCode::VARIABLE ) {
+                d[ins.arg1] = 1;
+            } else {
+                const Partials p = partials ( ins, reg );
+                double const* const da = &dot[ins.arg1 * n];
+                if ( is_binary ( ins.op ) ) {
+                    double const* const db = &dot[ins.arg2 * n];
+                    for ( std::size_t k = 0; k < n; ++k ) d[k] = p.a * da[k] + p.b * db[k];
+                } else {
+                    for ( std::size_t k = 0; k < n; ++k ) d[k] = p.a * da[k];
+                }
+            }
+        }
+    }
+
+    // Reverse sweep: adjoints, and in the Hessian case their tangents
+    bar[result_register] = 1;
+    for ( auto pos = trace.crbegin(); pos != trace.crend(); ++pos ) {
+        const CompiledInstruction &ins = program[*pos];
+        const double bar_d = bar[ins.dest];
+        if ( !ins.variable_dependent ) {
+            continue;
+        }
+        if ( ins.op == CompiledOpCode::VARIABLE ) {
+            jet.gradient[ins.arg1] += bar_d;
+            if ( with_hessian ) {
+                double const* const bd = &bardot[ins.dest * n];
+                double* const row = &jet.hessian[ins.arg1 * n];
+                for ( std::size_t k = 0; k < n; ++k ) row[k] += bd[k];
+            }
+            continue;
+        }
+        const Partials p = partials ( ins, reg );
+        const bool binary = is_binary ( ins.op );
+        bar[ins.arg1] += bar_d * p.a;
+        if ( binary ) bar[ins.arg2] += bar_d * p.b;
+        if ( with_hessian ) {
+            double const* const bd = &bardot[ins.dest * n];
+            double const* const da = &dot[ins.arg1 * n];
+            double* const bda = &bardot[ins.arg1 * n];
+            if ( binary ) {
+                double const* const db = &dot[ins.arg2 * n];
+                double* const bdb = &bardot[ins.arg2 * n];
+                for ( std::size_t k = 0; k < n; ++k ) {
+                    bda[k] += bd[k] * p.a + bar_d * ( p.aa * da[k] + p.ab * db[k] );
+                    bdb[k] += bd[k] * p.b + bar_d * ( p.ab * da[k] + p.bb * db[k] );
+                }
+            } else {
+                for ( std::size_t k = 0; k < n; ++k ) {
+                    bda[k] += bd[k] * p.a + bar_d * p.aa * da[k];
+                }
+            }
+        }
+    }
+
+    for ( auto i = jet.gradient.cbegin(); i != jet.gradient.cend(); ++i ) {
+        if ( !std::isfinite ( *i ) ) {
+            BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Calculated derivative is infinite or not a number" ) );
+        }
+    }
+    for ( auto i = jet.hessian.cbegin(); i != jet.hessian.cend(); ++i ) {
+        if ( !std::isfinite ( *i ) ) {
+            BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Calculated derivative is infinite or not a number" ) );
+        }
+    }
+}
+
+void CompiledExpression::evaluate_hessian_vector (
+    CompiledBinding const &binding,
+    double const* const x,
+    double const* const direction,
+    double* const product,
+    CompiledJet &jet ) const
+{
+    if ( program.empty() ) {
+        return;
+    }
+    std::vector<double> &reg = jet.registers;
+    std::vector<std::size_t> &trace = jet.trace;
+    reg.assign ( register_count, 0 );
+    trace.clear();
+    trace.reserve ( program.size() );
+    execute ( binding, x, &reg[0], &trace );
+
+    // As evaluate_jet(), with a single tangent: the directional derivative of each register along direction
+    std::vector<double> &dot = jet.tangents;
+    std::vector<double> &bar = jet.adjoints;
+    std::vector<double> &bardot = jet.adjoint_tangents;
+    dot.assign ( register_count, 0 );
+    bar.assign ( register_count, 0 );
+    bardot.assign ( register_count, 0 );
+    for ( auto pos = trace.cbegin(); pos != trace.cend(); ++pos ) {
+        const CompiledInstruction &ins = program[*pos];
+        if ( !ins.variable_dependent ) {
+            continue;
+        } else if ( ins.op == CompiledOpCode::VARIABLE ) {
+            dot[ins.dest] = direction[ins.arg1];
+        } else {
+            const Partials p = partials ( ins, reg );
+            dot[ins.dest] = p.a * dot[ins.arg1] + ( is_binary ( ins.op ) ? p.b * dot[ins.arg2] : 0 );
+        }
+    }
+    bar[result_register] = 1;
+    for ( auto pos = trace.crbegin(); pos != trace.crend(); ++pos ) {
+        const CompiledInstruction &ins = program[*pos];
+        if ( !ins.variable_dependent ) {
+            continue;
+        }
+        const double bar_d = bar[ins.dest];
+        const double bd = bardot[ins.dest];
+        if ( ins.op == CompiledOpCode::VARIABLE ) {
+            product[ins.arg1] += bd;
+            continue;
+        }
+        const Partials p = partials ( ins, reg );
+        const double da = dot[ins.arg1];
+        if ( is_binary ( ins.op ) ) {
+            const double db = dot[ins.arg2];
+            bar[ins.arg1] += bar_d * p.a;
+            bar[ins.arg2] += bar_d * p.b;
+            bardot[ins.arg1] += bd * p.a + bar_d * ( p.aa * da + p.ab * db );
+            bardot[ins.arg2] += bd * p.b + bar_d * ( p.ab * da + p.bb * db );
+        } else {
+            bar[ins.arg1] += bar_d * p.a;
+            bardot[ins.arg1] += bd * p.a + bar_d * p.aa * da;
+        }
+    }
+    const std::size_t n = binding.slots->variables.size();
+    for ( std::size_t i = 0; i < n; ++i ) {
+        if ( !std::isfinite ( product[i] ) ) {
+            BOOST_THROW_EXCEPTION ( floating_point_error() << str_errinfo ( "Calculated derivative is infinite or not a number" ) );
+        }
+    }
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
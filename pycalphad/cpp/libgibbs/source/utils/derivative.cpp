@@ -18,14 +18,38 @@
 #include <string>
 
 
-// differentiate the utree without variable evaluation
-boost::spirit::utree const differentiate_utree(
-		boost::spirit::utree const& ut,
+namespace {
+typedef boost::spirit::utree utree;
+typedef boost::spirit::utree_type utree_type;
+
+// utree has no move constructor, so derivatives are built in place and handed up with swap();
+// otherwise every level of a derivative would copy all of the levels below it.
+
+// Appends value to the list tree and leaves value empty
+void push_back_swapped(utree &tree, utree &value) {
+	tree.push_back(utree());
+	tree.back().swap(value);
+}
+
+void differentiate_utree(utree const& ut, std::string const& diffvar, ASTSymbolMap const& symbols, utree &result);
+
+// Derivatives of subtrees are taken without the special symbols, as they always have been
+void differentiate_subtree(utree const& ut, std::string const& diffvar, utree &result) {
+	differentiate_utree(ut, diffvar, ASTSymbolMap(), result);
+}
+
+void differentiate_simplified(utree const& ut, std::string const& diffvar, utree &result) {
+	differentiate_subtree(ut, diffvar, result);
+	simplify_utree_in_place(result);
+}
+
+// differentiate the utree without variable evaluation; result must be empty
+void differentiate_utree(
+		utree const& ut,
 		std::string const& diffvar,
-		ASTSymbolMap const& symbols
+		ASTSymbolMap const& symbols,
+		utree &result
 		) {
-	typedef boost::spirit::utree utree;
-	typedef boost::spirit::utree_type utree_type;
 	switch ( ut.which() ) {
 		case utree_type::invalid_type: {
 			break;
@@ -44,11 +68,13 @@ boost::spirit::utree const differentiate_utree(
 			while (it != end) {
 				if ((*it).which() == utree_type::double_type && std::distance(it,end) == 1) {
 					// only one element in utree list, and it's a double
-					return utree(0);
+					result = utree(0);
+					return;
 				}
 				if ((*it).which() == utree_type::int_type && std::distance(it,end) == 1) {
 					// only one element in utree list, and it's an int
-					return utree(0);
+					result = utree(0);
+					return;
 				}
 				if ((*it).which() == utree_type::string_type) {
 					// operator/function
@@ -64,16 +90,18 @@ boost::spirit::utree const differentiate_utree(
 						if (it != end) ++it;
 						auto highlimit = it; // highlimit
 						if (it != end) ++it;
-						utree push_tree = simplify_utree(differentiate_utree(*it, diffvar));
+						utree push_tree;
+						differentiate_simplified(*it, diffvar, push_tree);
 						if (it != end) ++it;
 						if (is_zero_tree(push_tree)) {
 							// this tree is trivial and this range check operation can be removed
 							if (it == end) {
 								if (ret_tree.which() == utree_type::invalid_type) {
 									// all range checks are trivial; simplify to clean zero
-									return utree(0);
+									result = utree(0);
 								}
-								else return ret_tree;
+								else result.swap(ret_tree);
+								return;
 							}
 							else {
 								// this tree is trivial but we have more range checks to evaluate
@@ -87,9 +115,10 @@ boost::spirit::utree const differentiate_utree(
 							ret_tree.push_back(*curT);
 							ret_tree.push_back(*lowlimit);
 							ret_tree.push_back(*highlimit);
-							ret_tree.push_back(push_tree);
+							push_back_swapped(ret_tree, push_tree);
 							if (it == end) {
-								return ret_tree;
+								result.swap(ret_tree);
+								return;
 							}
 							else {
 								continue;
@@ -105,100 +134,137 @@ boost::spirit::utree const differentiate_utree(
 
 					if (op == "+") {
 						// derivative of sum is sum of derivatives
-						bool lhszero, rhszero = false;
-						if (lhsiter != end) lhs = simplify_utree(differentiate_utree(*lhsiter, diffvar));
-						if (rhsiter != end) rhs = simplify_utree(differentiate_utree(*rhsiter, diffvar));
-						if (is_zero_tree(lhs)) return simplify_utree(rhs);
-						if (is_zero_tree(rhs)) return simplify_utree(lhs);
+						if (lhsiter != end) differentiate_simplified(*lhsiter, diffvar, lhs);
+						if (rhsiter != end) differentiate_simplified(*rhsiter, diffvar, rhs);
+						if (is_zero_tree(lhs)) {
+							simplify_utree_in_place(rhs);
+							result.swap(rhs);
+							return;
+						}
+						if (is_zero_tree(rhs)) {
+							simplify_utree_in_place(lhs);
+							result.swap(lhs);
+							return;
+						}
 						ret_tree.push_back("+");
-						ret_tree.push_back(lhs);
-						ret_tree.push_back(rhs);
-						return ret_tree;
+						push_back_swapped(ret_tree, lhs);
+						push_back_swapped(ret_tree, rhs);
+						result.swap(ret_tree);
+						return;
 					}
 					else if (op == "-") {
 						// derivative of difference is difference of derivatives
-						if (lhsiter != end) lhs = simplify_utree(differentiate_utree(*lhsiter, diffvar));
-						if (rhsiter != end) rhs = simplify_utree(differentiate_utree(*rhsiter, diffvar));
-						if (is_zero_tree(lhs) && is_zero_tree(rhs)) return utree(0);
+						if (lhsiter != end) differentiate_simplified(*lhsiter, diffvar, lhs);
+						if (rhsiter != end) differentiate_simplified(*rhsiter, diffvar, rhs);
+						if (is_zero_tree(lhs) && is_zero_tree(rhs)) {
+							result = utree(0);
+							return;
+						}
 						if (ut.size() == 2) {
-							if (is_zero_tree(lhs)) return utree(0);
+							if (is_zero_tree(lhs)) {
+								result = utree(0);
+								return;
+							}
 							// case of negation (unary operator)
 							ret_tree.push_back("-");
-							ret_tree.push_back(lhs);
-							return ret_tree;
+							push_back_swapped(ret_tree, lhs);
+							result.swap(ret_tree);
+							return;
+						}
+						if (is_zero_tree(rhs)) {
+							simplify_utree_in_place(lhs);
+							result.swap(lhs);
+							return;
 						}
-						if (is_zero_tree(rhs)) return simplify_utree(lhs);
 						ret_tree.push_back("-");
-						ret_tree.push_back(lhs);
-						ret_tree.push_back(rhs);
-						return ret_tree;
+						push_back_swapped(ret_tree, lhs);
+						push_back_swapped(ret_tree, rhs);
+						result.swap(ret_tree);
+						return;
 					}
 					else if (op == "*") {
 						// derivative of product is lhs'rhs + rhs'lhs (product rule)
 						// TODO: optimizations for multiplication by 1 and 0
-						utree lhs_deriv = simplify_utree(differentiate_utree(*lhsiter, diffvar));
-						utree rhs_deriv = simplify_utree(differentiate_utree(*rhsiter, diffvar));
+						utree lhs_deriv, rhs_deriv;
+						differentiate_simplified(*lhsiter, diffvar, lhs_deriv);
+						differentiate_simplified(*rhsiter, diffvar, rhs_deriv);
 						utree lhs_prod_tree, rhs_prod_tree;
 						lhs_prod_tree.push_back("*");
-						lhs_prod_tree.push_back(lhs_deriv);
+						push_back_swapped(lhs_prod_tree, lhs_deriv);
 						lhs_prod_tree.push_back(*rhsiter);
-						lhs_prod_tree = simplify_utree(lhs_prod_tree);
+						simplify_utree_in_place(lhs_prod_tree);
 
 						rhs_prod_tree.push_back("*");
-						rhs_prod_tree.push_back(rhs_deriv);
+						push_back_swapped(rhs_prod_tree, rhs_deriv);
 						rhs_prod_tree.push_back(*lhsiter);
-						rhs_prod_tree = simplify_utree(rhs_prod_tree);
+						simplify_utree_in_place(rhs_prod_tree);
 
 						ret_tree.push_back("+");
-						ret_tree.push_back(lhs_prod_tree);
-						ret_tree.push_back(rhs_prod_tree);
-						return ret_tree;
+						push_back_swapped(ret_tree, lhs_prod_tree);
+						push_back_swapped(ret_tree, rhs_prod_tree);
+						result.swap(ret_tree);
+						return;
 					}
 					else if (op == "/") {
 						// derivative of quotient is (lhs'rhs - rhs'lhs)/(rhs^2) (quotient rule)
 						// TODO: optimization for identity and 0 operations
-						utree lhs_deriv = simplify_utree(differentiate_utree(*lhsiter, diffvar));
-						utree rhs_deriv = simplify_utree(differentiate_utree(*rhsiter, diffvar));
+						utree lhs_deriv, rhs_deriv;
+						differentiate_simplified(*lhsiter, diffvar, lhs_deriv);
+						differentiate_simplified(*rhsiter, diffvar, rhs_deriv);
 						utree lhs_prod_tree, rhs_prod_tree, numerator_tree, power_tree;
 						lhs_prod_tree.push_back("*");
-						lhs_prod_tree.push_back(lhs_deriv);
+						push_back_swapped(lhs_prod_tree, lhs_deriv);
 						lhs_prod_tree.push_back(*rhsiter);
 
-						lhs_prod_tree = simplify_utree(lhs_prod_tree);
+						simplify_utree_in_place(lhs_prod_tree);
 
 						rhs_prod_tree.push_back("*");
-						rhs_prod_tree.push_back(rhs_deriv);
+						push_back_swapped(rhs_prod_tree, rhs_deriv);
 						rhs_prod_tree.push_back(*lhsiter);
 
-						rhs_prod_tree = simplify_utree(rhs_prod_tree);
+						simplify_utree_in_place(rhs_prod_tree);
 
 						numerator_tree.push_back("-");
-						numerator_tree.push_back(lhs_prod_tree);
-						numerator_tree.push_back(rhs_prod_tree);
+						push_back_swapped(numerator_tree, lhs_prod_tree);
+						push_back_swapped(numerator_tree, rhs_prod_tree);
 
-						numerator_tree = simplify_utree(numerator_tree);
+						simplify_utree_in_place(numerator_tree);
 						// Optimization for zero in numerator
-						if (is_zero_tree(numerator_tree)) return numerator_tree;
+						if (is_zero_tree(numerator_tree)) {
+							result.swap(numerator_tree);
+							return;
+						}
 
 						power_tree.push_back("**");
 						power_tree.push_back(*rhsiter);
 						power_tree.push_back(2);
 
 						ret_tree.push_back("/");
-						ret_tree.push_back(numerator_tree);
-						ret_tree.push_back(power_tree);
+						push_back_swapped(ret_tree, numerator_tree);
+						push_back_swapped(ret_tree, power_tree);
 
-						return ret_tree;
+						result.swap(ret_tree);
+						return;
 					}
 					else if (op == "**") {
 						if ((*rhsiter).which() == utree_type::int_type || (*rhsiter).which() == utree_type::double_type) {
 							// exponent is a constant: power rule
 							// power rule + chain rule
 							// res += rhs * pow(lhs,rhs-1) * lhs_deriv;
-							if (is_zero_tree(*rhsiter)) return utree(0);
-							utree lhs_deriv = simplify_utree(differentiate_utree(*lhsiter, diffvar));
-							if (rhsiter->get<double>() == 1) return lhs_deriv;
-							if (is_zero_tree(lhs_deriv)) return utree(0);
+							if (is_zero_tree(*rhsiter)) {
+								result = utree(0);
+								return;
+							}
+							utree lhs_deriv;
+							differentiate_simplified(*lhsiter, diffvar, lhs_deriv);
+							if (rhsiter->get<double>() == 1) {
+								result.swap(lhs_deriv);
+								return;
+							}
+							if (is_zero_tree(lhs_deriv)) {
+								result = utree(0);
+								return;
+							}
 							utree prod_tree, power_tree;
 							double exponent = (*rhsiter).get<double>() - 1;
 
@@ -208,22 +274,28 @@ boost::spirit::utree const differentiate_utree(
 
 							prod_tree.push_back("*");
 							prod_tree.push_back(*rhsiter);
-							prod_tree.push_back(power_tree);
+							push_back_swapped(prod_tree, power_tree);
 
 							ret_tree.push_back("*");
-							ret_tree.push_back(prod_tree);
-							ret_tree.push_back(lhs_deriv);
+							push_back_swapped(ret_tree, prod_tree);
+							push_back_swapped(ret_tree, lhs_deriv);
 
-							return ret_tree;
+							result.swap(ret_tree);
+							return;
 						}
 						else {
 							// generalized power rule
 							// lhs^rhs * (lhs' * (rhs/lhs) + rhs' * ln(lhs))
-							if (is_zero_tree(*lhsiter)) return utree(0);
-							utree lhs_deriv = simplify_utree(differentiate_utree(*lhsiter, diffvar));
-							utree rhs_deriv = simplify_utree(differentiate_utree(*rhsiter, diffvar));
+							if (is_zero_tree(*lhsiter)) {
+								result = utree(0);
+								return;
+							}
+							utree lhs_deriv, rhs_deriv;
+							differentiate_simplified(*lhsiter, diffvar, lhs_deriv);
+							differentiate_simplified(*rhsiter, diffvar, rhs_deriv);
 							utree power_tree, prod_tree1, prod_tree2, div_tree, log_tree, add_tree;
-
+							const bool lhs_deriv_zero = is_zero_tree(lhs_deriv);
+							const bool rhs_deriv_zero = is_zero_tree(rhs_deriv);
 
 							power_tree.push_back("**");
 							power_tree.push_back(*lhsiter);
@@ -237,55 +309,74 @@ boost::spirit::utree const differentiate_utree(
 							log_tree.push_back(*lhsiter);
 
 							prod_tree1.push_back("*");
-							prod_tree1.push_back(lhs_deriv);
-							prod_tree1.push_back(div_tree);
+							push_back_swapped(prod_tree1, lhs_deriv);
+							push_back_swapped(prod_tree1, div_tree);
 
-							prod_tree2.push_back("*");
-							prod_tree2.push_back(rhs_deriv);
-							prod_tree2.push_back(log_tree);
-							if (is_zero_tree(rhs_deriv)) prod_tree2 = utree(0);
+							if (rhs_deriv_zero) prod_tree2 = utree(0);
+							else {
+								prod_tree2.push_back("*");
+								push_back_swapped(prod_tree2, rhs_deriv);
+								push_back_swapped(prod_tree2, log_tree);
+							}
 
-							add_tree.push_back("+");
-							add_tree.push_back(prod_tree1);
-							add_tree.push_back(prod_tree2);
-							if (is_zero_tree(lhs_deriv)) add_tree = prod_tree2;
+							if (lhs_deriv_zero) add_tree.swap(prod_tree2);
+							else {
+								add_tree.push_back("+");
+								push_back_swapped(add_tree, prod_tree1);
+								push_back_swapped(add_tree, prod_tree2);
+							}
 
 							ret_tree.push_back("*");
-							ret_tree.push_back(power_tree);
-							ret_tree.push_back(add_tree);
+							push_back_swapped(ret_tree, power_tree);
+							push_back_swapped(ret_tree, add_tree);
 
-							return ret_tree;
+							result.swap(ret_tree);
+							return;
 						}
 					}
 					else if (op == "LN") {
 						// res += lhs_deriv / lhs;
-						utree lhs_deriv = differentiate_utree(*lhsiter, diffvar);
-						if (is_zero_tree(lhs_deriv)) return utree(0);
+						utree lhs_deriv;
+						differentiate_subtree(*lhsiter, diffvar, lhs_deriv);
+						if (is_zero_tree(lhs_deriv)) {
+							result = utree(0);
+							return;
+						}
 						ret_tree.push_back("/");
-						ret_tree.push_back(lhs_deriv);
+						push_back_swapped(ret_tree, lhs_deriv);
 						ret_tree.push_back(*lhsiter);
 
-						return ret_tree;
+						result.swap(ret_tree);
+						return;
 					}
 					else if (op == "EXP") {
 						// res += exp(lhs) * lhs_deriv;
-						if (is_zero_tree(*lhsiter)) return utree(0);
-						utree lhs_deriv = differentiate_utree(*lhsiter, diffvar);
-						if (is_zero_tree(lhs_deriv)) return utree(0);
+						if (is_zero_tree(*lhsiter)) {
+							result = utree(0);
+							return;
+						}
+						utree lhs_deriv;
+						differentiate_subtree(*lhsiter, diffvar, lhs_deriv);
+						if (is_zero_tree(lhs_deriv)) {
+							result = utree(0);
+							return;
+						}
 						utree exp_tree;
 						exp_tree.push_back("EXP");
 						exp_tree.push_back(*lhsiter);
 
 						ret_tree.push_back("*");
-						ret_tree.push_back(exp_tree);
-						ret_tree.push_back(lhs_deriv);
+						push_back_swapped(ret_tree, exp_tree);
+						push_back_swapped(ret_tree, lhs_deriv);
 
-						return ret_tree;
+						result.swap(ret_tree);
+						return;
 					}
 
 					// not an operator, must be a symbol
-					if (op == diffvar) return utree(1);
-					else return utree(0);
+					if (op == diffvar) result = utree(1);
+					else result = utree(0);
+					return;
 				}
 				++it;
 			}
@@ -295,10 +386,12 @@ boost::spirit::utree const differentiate_utree(
 			break;
 		}
 		case utree_type::double_type: {
-			return utree(0);
+			result = utree(0);
+			return;
 		}
 		case utree_type::int_type: {
-			return utree(0);
+			result = utree(0);
+			return;
 		}
 		case utree_type::string_type: {
 			boost::spirit::utf8_string_range_type rt = ut.get<boost::spirit::utf8_string_range_type>();
@@ -308,15 +401,29 @@ boost::spirit::utree const differentiate_utree(
 			const auto symbol_end = symbols.end();
 			if (symbol_find != symbol_end) {
 				// this is a special symbol, use its differentiation function
-				return symbol_find->second.differentiate(diffvar, symbols);
+				utree symbol_derivative = symbol_find->second.differentiate(diffvar, symbols);
+				result.swap(symbol_derivative);
+				return;
 			}
 
-			if (diffvar == varname) return utree(1);
-			else return utree(0);
+			if (diffvar == varname) result = utree(1);
+			else result = utree(0);
+			return;
 		}
 	}
 	BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("Unable to differentiate abstract syntax tree") << ast_errinfo(ut));
-	return utree();
+}
+}
+
+// differentiate the utree without variable evaluation
+boost::spirit::utree const differentiate_utree(
+		boost::spirit::utree const& ut,
+		std::string const& diffvar,
+		ASTSymbolMap const& symbols
+		) {
+	boost::spirit::utree result;
+	differentiate_utree(ut, diffvar, symbols, result);
+	return result;
 }
 
 boost::spirit::utree const differentiate_utree(boost::spirit::utree const& ut, std::string const& diffvar) {
@@ -0,0 +1,21 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// energy_device.cpp -- selection of an accelerator for compiled energy programs
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/energy_device.hpp"
+
+std::shared_ptr<EnergyDevice> EnergyDevice::open()
+{
+#ifdef LIBGIBBS_WITH_CUDA
+    return open_cuda_energy_device();
+#else
+    return std::shared_ptr<EnergyDevice>();
+#endif
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
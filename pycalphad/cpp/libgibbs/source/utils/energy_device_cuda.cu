@@ -0,0 +1,323 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// energy_device_cuda.cu -- CUDA interpreter for compiled energy programs
+
+#ifdef LIBGIBBS_WITH_CUDA
+
+#include "libgibbs/include/utils/energy_device.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include <boost/assert.hpp>
+#include <cuda_runtime.h>
+#include <math_constants.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+// One instruction of CompiledExpression in a layout the device can read: variables are resolved
+// to indices into the point and state variables to constants, jump targets are relative to the
+// start of their program
+struct DeviceInstruction {
+    unsigned char op; // CompiledOpCode
+    std::uint32_t dest;
+    std::uint32_t arg1;
+    std::uint32_t arg2;
+    std::uint32_t arg3;
+    double constant;
+};
+
+// Points per device block of threads
+constexpr const unsigned threads_per_block = 128;
+// Points per batch; the registers of every point of a batch are kept in device memory
+constexpr const std::size_t batch_points = 1 << 16;
+
+void check ( cudaError_t const status )
+{
+    if ( status != cudaSuccess ) {
+        BOOST_THROW_EXCEPTION ( internal_error() << str_errinfo ( cudaGetErrorString ( status ) ) );
+    }
+}
+
+// One thread per point; the sum of all programs goes to out[point]
+// Registers are laid out reg[register * npoints + point], so neighbouring threads access neighbouring addresses
+__global__ void evaluate_programs (
+    DeviceInstruction const* const instructions,
+    std::uint32_t const* const program_offsets, // program p is [program_offsets[p], program_offsets[p+1])
+    std::uint32_t const* const result_registers,
+    std::uint32_t const program_count,
+    double const* const points,
+    std::uint32_t const npoints,
+    std::uint32_t const dimension,
+    double* const reg,
+    double* const out )
+{
+    const std::uint32_t point = blockIdx.x * blockDim.x + threadIdx.x;
+    if ( point >= npoints ) return;
+    double const* const x = points + static_cast<std::size_t> ( point ) * dimension;
+    const double nan = CUDART_NAN;
+    double total = 0;
+    for ( std::uint32_t p = 0; p < program_count; ++p ) {
+        const std::uint32_t begin = program_offsets[p];
+        const std::uint32_t end = program_offsets[p+1];
+        std::uint32_t pc = begin;
+        bool failed = false;
+        while ( pc < end && !failed ) {
+            const DeviceInstruction ins = instructions[pc++];
+#define LIBGIBBS_REG(r) reg[static_cast<std::size_t> ( r ) * npoints + point]
+            switch ( ins.op ) {
+            case static_cast<unsigned char> ( CompiledOpCode::CONSTANT ):
+            case static_cast<unsigned char> ( CompiledOpCode::STATEVAR ):
+                LIBGIBBS_REG ( ins.dest ) = ins.constant;
+                break;
+            case static_cast<unsigned char> ( CompiledOpCode::VARIABLE ):
+                LIBGIBBS_REG ( ins.dest ) = x[ins.arg1];
+                break;
+            case static_cast<unsigned char> ( CompiledOpCode::COPY ):
+                LIBGIBBS_REG ( ins.dest ) = LIBGIBBS_REG ( ins.arg1 );
+                break;
+            case static_cast<unsigned char> ( CompiledOpCode::ADD ):
+                LIBGIBBS_REG ( ins.dest ) = LIBGIBBS_REG ( ins.arg1 ) + LIBGIBBS_REG ( ins.arg2 );
+                break;
+            case static_cast<unsigned char> ( CompiledOpCode::SUBTRACT ):
+                LIBGIBBS_REG ( ins.dest ) = LIBGIBBS_REG ( ins.arg1 ) - LIBGIBBS_REG ( ins.arg2 );
+                break;
+            case static_cast<unsigned char> ( CompiledOpCode::NEGATE ):
+                LIBGIBBS_REG ( ins.dest ) = -LIBGIBBS_REG ( ins.arg1 );
+                break;
+            case static_cast<unsigned char> ( CompiledOpCode::MULTIPLY ):
+                LIBGIBBS_REG ( ins.dest ) = LIBGIBBS_REG ( ins.arg1 ) * LIBGIBBS_REG ( ins.arg2 );
+                break;
+            case static_cast<unsigned char> ( CompiledOpCode::DIVIDE ): {
+                const double divisor = LIBGIBBS_REG ( ins.arg2 );
+                failed = ( divisor == 0 );
+                LIBGIBBS_REG ( ins.dest ) = LIBGIBBS_REG ( ins.arg1 ) / divisor;
+                break;
+            }
+            case static_cast<unsigned char> ( CompiledOpCode::POWER ): {
+                const double base = LIBGIBBS_REG ( ins.arg1 );
+                const double exponent = LIBGIBBS_REG ( ins.arg2 );
+                failed = ( base < 0 && fabs ( exponent ) < 1 && fabs ( exponent ) > 0 ); // complex result
+                LIBGIBBS_REG ( ins.dest ) = pow ( base, exponent );
+                break;
+            }
+            case static_cast<unsigned char> ( CompiledOpCode::LN ): {
+                const double value = LIBGIBBS_REG ( ins.arg1 );
+                failed = ( value <= 0 );
+                LIBGIBBS_REG ( ins.dest ) = log ( value );
+                break;
+            }
+            case static_cast<unsigned char> ( CompiledOpCode::EXP ):
+                LIBGIBBS_REG ( ins.dest ) = exp ( LIBGIBBS_REG ( ins.arg1 ) );
+                break;
+            case static_cast<unsigned char> ( CompiledOpCode::RANGE_CHECK ): {
+                // dest is the jump target, not a register
+                const double value = LIBGIBBS_REG ( ins.arg1 );
+                const double low_limit = LIBGIBBS_REG ( ins.arg2 );
+                const double high_limit = LIBGIBBS_REG ( ins.arg3 );
+                if ( !isfinite ( value ) || !isfinite ( low_limit ) || !isfinite ( high_limit ) || high_limit <= low_limit ) {
+                    failed = true;
+                }
+                else if ( !( value >= low_limit && value < high_limit ) ) {
+                    pc = begin + ins.dest;
+                }
+                break;
+            }
+            case static_cast<unsigned char> ( CompiledOpCode::JUMP ):
+                pc = begin + ins.dest;
+                break;
+            }
+#undef LIBGIBBS_REG
+        }
+        total = failed ? nan : total + reg[static_cast<std::size_t> ( result_registers[p] ) * npoints + point];
+    }
+    out[point] = isfinite ( total ) ? total : nan;
+}
+
+template <typename T> T* device_alloc ( std::size_t const count )
+{
+    void* memory = nullptr;
+    check ( cudaMalloc ( &memory, count * sizeof ( T ) ) );
+    return static_cast<T*> ( memory );
+}
+
+template <typename T> T* pinned_alloc ( std::size_t const count )
+{
+    void* memory = nullptr;
+    check ( cudaMallocHost ( &memory, count * sizeof ( T ) ) );
+    return static_cast<T*> ( memory );
+}
+
+class CudaEnergyDevice : public EnergyDevice {
+public:
+    CudaEnergyDevice() : instructions ( nullptr ), program_offsets ( nullptr ), result_registers ( nullptr ),
+        program_count ( 0 ), register_count ( 0 ), dimension ( 0 ) {
+        for ( std::size_t i = 0; i < slot_count; ++i ) {
+            Slot &slot = slots[i];
+            slot.host_points = nullptr;
+            slot.host_energies = nullptr;
+            slot.points = nullptr;
+            slot.energies = nullptr;
+            slot.registers = nullptr;
+            slot.capacity_dimension = 0;
+            slot.capacity_registers = 0;
+            slot.npoints = 0;
+            check ( cudaStreamCreate ( &slot.stream ) );
+        }
+    }
+    ~CudaEnergyDevice() {
+        for ( std::size_t i = 0; i < slot_count; ++i ) {
+            Slot &slot = slots[i];
+            cudaStreamSynchronize ( slot.stream );
+            cudaFreeHost ( slot.host_points );
+            cudaFreeHost ( slot.host_energies );
+            cudaFree ( slot.points );
+            cudaFree ( slot.energies );
+            cudaFree ( slot.registers );
+            cudaStreamDestroy ( slot.stream );
+        }
+        free_programs();
+    }
+    void load ( std::vector<CompiledExpression> const &programs, CompiledBinding const &binding ) {
+        for ( std::size_t i = 0; i < slot_count; ++i ) check ( cudaStreamSynchronize ( slots[i].stream ) );
+        free_programs();
+        std::vector<DeviceInstruction> host_instructions;
+        std::vector<std::uint32_t> host_offsets ( 1, 0 );
+        std::vector<std::uint32_t> host_results;
+        register_count = 0;
+        dimension = 0;
+        for ( auto program = programs.cbegin(); program != programs.cend(); ++program ) {
+            if ( program->empty() ) continue;
+            for ( auto i = program->instructions().cbegin(); i != program->instructions().cend(); ++i ) {
+                DeviceInstruction ins;
+                ins.op = static_cast<unsigned char> ( i->op );
+                ins.dest = static_cast<std::uint32_t> ( i->dest );
+                ins.arg1 = static_cast<std::uint32_t> ( i->arg1 );
+                ins.arg2 = static_cast<std::uint32_t> ( i->arg2 );
+                ins.arg3 = static_cast<std::uint32_t> ( i->arg3 );
+                ins.constant = i->constant;
+                if ( i->op == CompiledOpCode::VARIABLE ) {
+                    ins.arg1 = static_cast<std::uint32_t> ( binding.variable_index ( i->arg1 ) ); // throws if unbound
+                    dimension = std::max ( dimension, static_cast<std::size_t> ( ins.arg1 ) + 1 );
+                }
+                else if ( i->op == CompiledOpCode::STATEVAR ) {
+                    if ( !binding.statevar_bound[i->arg1] ) {
+                        BOOST_THROW_EXCEPTION ( unknown_symbol_error() << str_errinfo ( "Unknown operator or state variable" )
+                                                << specific_errinfo ( std::string ( 1, binding.slots->statevars[i->arg1] ) ) );
+                    }
+                    ins.constant = binding.statevar_values[i->arg1];
+                }
+                host_instructions.push_back ( ins );
+            }
+            host_offsets.push_back ( static_cast<std::uint32_t> ( host_instructions.size() ) );
+            host_results.push_back ( static_cast<std::uint32_t> ( program->result() ) );
+            register_count = std::max ( register_count, program->registers() );
+        }
+        program_count = host_results.size();
+        if ( program_count == 0 ) return;
+        instructions = device_alloc<DeviceInstruction> ( host_instructions.size() );
+        program_offsets = device_alloc<std::uint32_t> ( host_offsets.size() );
+        result_registers = device_alloc<std::uint32_t> ( host_results.size() );
+        check ( cudaMemcpy ( instructions, &host_instructions[0], host_instructions.size() * sizeof ( DeviceInstruction ), cudaMemcpyHostToDevice ) );
+        check ( cudaMemcpy ( program_offsets, &host_offsets[0], host_offsets.size() * sizeof ( std::uint32_t ), cudaMemcpyHostToDevice ) );
+        check ( cudaMemcpy ( result_registers, &host_results[0], host_results.size() * sizeof ( std::uint32_t ), cudaMemcpyHostToDevice ) );
+    }
+    std::size_t max_batch_points() const {
+        return batch_points;
+    }
+    void submit ( std::size_t const slot_id, double const* const points, std::size_t const npoints, std::size_t const stride ) {
+        BOOST_ASSERT ( slot_id < slot_count && npoints <= batch_points && stride >= dimension );
+        Slot &slot = slots[slot_id];
+        check ( cudaStreamSynchronize ( slot.stream ) ); // the slot's buffers may still be in use
+        reserve ( slot );
+        slot.npoints = npoints;
+        if ( npoints == 0 || program_count == 0 ) return;
+        const std::size_t packed_dimension = std::max ( dimension, std::size_t ( 1 ) );
+        for ( std::size_t i = 0; i < npoints; ++i ) {
+            std::copy ( points + i * stride, points + i * stride + dimension, slot.host_points + i * packed_dimension );
+        }
+        check ( cudaMemcpyAsync ( slot.points, slot.host_points, npoints * packed_dimension * sizeof ( double ),
+                                  cudaMemcpyHostToDevice, slot.stream ) );
+        const unsigned blocks = static_cast<unsigned> ( ( npoints + threads_per_block - 1 ) / threads_per_block );
+        evaluate_programs<<<blocks, threads_per_block, 0, slot.stream>>> ( instructions, program_offsets, result_registers,
+                static_cast<std::uint32_t> ( program_count ), slot.points, static_cast<std::uint32_t> ( npoints ),
+                static_cast<std::uint32_t> ( packed_dimension ), slot.registers, slot.energies );
+        check ( cudaGetLastError() );
+        check ( cudaMemcpyAsync ( slot.host_energies, slot.energies, npoints * sizeof ( double ), cudaMemcpyDeviceToHost, slot.stream ) );
+    }
+    void wait ( std::size_t const slot_id, double* const out ) {
+        BOOST_ASSERT ( slot_id < slot_count );
+        Slot &slot = slots[slot_id];
+        if ( program_count == 0 ) {
+            std::fill ( out, out + slot.npoints, 0.0 );
+            return;
+        }
+        check ( cudaStreamSynchronize ( slot.stream ) );
+        std::copy ( slot.host_energies, slot.host_energies + slot.npoints, out );
+    }
+private:
+    struct Slot {
+        cudaStream_t stream;
+        double* host_points; // pinned, so that copies are asynchronous
+        double* host_energies;
+        double* points;
+        double* energies;
+        double* registers;
+        std::size_t capacity_dimension;
+        std::size_t capacity_registers;
+        std::size_t npoints;
+    };
+    // Size the buffers of slot for a full batch of the loaded programs
+    void reserve ( Slot &slot ) {
+        const std::size_t packed_dimension = std::max ( dimension, std::size_t ( 1 ) );
+        if ( !slot.host_energies ) {
+            slot.host_energies = pinned_alloc<double> ( batch_points );
+            slot.energies = device_alloc<double> ( batch_points );
+        }
+        if ( slot.capacity_dimension < packed_dimension ) {
+            cudaFreeHost ( slot.host_points );
+            cudaFree ( slot.points );
+            slot.host_points = pinned_alloc<double> ( batch_points * packed_dimension );
+            slot.points = device_alloc<double> ( batch_points * packed_dimension );
+            slot.capacity_dimension = packed_dimension;
+        }
+        if ( slot.capacity_registers < register_count ) {
+            cudaFree ( slot.registers );
+            slot.registers = device_alloc<double> ( batch_points * register_count );
+            slot.capacity_registers = register_count;
+        }
+    }
+    void free_programs() {
+        cudaFree ( instructions );
+        cudaFree ( program_offsets );
+        cudaFree ( result_registers );
+        instructions = nullptr;
+        program_offsets = nullptr;
+        result_registers = nullptr;
+        program_count = 0;
+    }
+    DeviceInstruction* instructions;
+    std::uint32_t* program_offsets;
+    std::uint32_t* result_registers;
+    std::size_t program_count;
+    std::size_t register_count;
+    std::size_t dimension; // coordinates of a packed point
+    Slot slots[slot_count];
+};
+}
+
+std::shared_ptr<EnergyDevice> open_cuda_energy_device()
+{
+    int device_count = 0;
+    if ( cudaGetDeviceCount ( &device_count ) != cudaSuccess || device_count == 0 ) {
+        return std::shared_ptr<EnergyDevice>();
+    }
+    return std::make_shared<CudaEnergyDevice>();
+}
+
+#endif
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
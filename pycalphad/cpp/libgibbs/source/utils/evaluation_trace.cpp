@@ -0,0 +1,47 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Sampled counts and timings of the evaluations of one phase
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/evaluation_trace.hpp"
+
+std::atomic<std::size_t> EvaluationTrace::period ( 0 );
+
+void EvaluationTrace::set_sampling_period ( std::size_t const new_period )
+{
+    period.store ( new_period, std::memory_order_relaxed );
+}
+
+EvaluationTrace::EvaluationTrace ( EvaluationTrace const &other ) :
+    calls ( other.calls.load ( std::memory_order_relaxed ) ),
+    points ( other.points.load ( std::memory_order_relaxed ) ),
+    timed_calls ( other.timed_calls.load ( std::memory_order_relaxed ) ),
+    timed_points ( other.timed_points.load ( std::memory_order_relaxed ) ),
+    timed_nanoseconds ( other.timed_nanoseconds.load ( std::memory_order_relaxed ) )
+{
+}
+
+EvaluationStatistics EvaluationTrace::statistics() const
+{
+    EvaluationStatistics stats;
+    stats.calls = calls.load ( std::memory_order_relaxed );
+    stats.points = points.load ( std::memory_order_relaxed );
+    stats.timed_calls = timed_calls.load ( std::memory_order_relaxed );
+    stats.timed_points = timed_points.load ( std::memory_order_relaxed );
+    stats.timed_seconds = timed_nanoseconds.load ( std::memory_order_relaxed ) * 1e-9;
+    return stats;
+}
+
+void EvaluationTrace::reset()
+{
+    calls.store ( 0, std::memory_order_relaxed );
+    points.store ( 0, std::memory_order_relaxed );
+    timed_calls.store ( 0, std::memory_order_relaxed );
+    timed_points.store ( 0, std::memory_order_relaxed );
+    timed_nanoseconds.store ( 0, std::memory_order_relaxed );
+}
@@ -0,0 +1,316 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Ideal mixing and Redlich-Kister excess energies evaluated by kernels specialized to the sublattice shape of a phase
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/fixed_shape_kernels.hpp"
+#include "libgibbs/include/conditions.hpp"
+#include <boost/assert.hpp>
+#include <cmath>
+
+namespace {
+// Arguments of the constructors of all ShapeModels
+struct ShapeArguments {
+    SublatticeLayout const &layout;
+    std::vector<std::size_t> const &coordinate_slots;
+    std::size_t slot_count;
+    std::vector<FixedShapeInteraction> const &interactions;
+    double mixing_sites;
+};
+
+template <std::size_t... Species> struct CoordinateCount;
+template <> struct CoordinateCount<> {
+    static constexpr std::size_t value = 0;
+};
+template <std::size_t First, std::size_t... Rest> struct CoordinateCount<First, Rest...> {
+    static constexpr std::size_t value = First + CoordinateCount<Rest...>::value;
+};
+
+// The energies of a phase with Species[s] species on sublattice s
+template <std::size_t... Species>
+class ShapeModel : public FixedShapeModel {
+    static constexpr std::size_t sublattices = sizeof... ( Species );
+    static constexpr std::size_t coordinates = CoordinateCount<Species...>::value;
+    static constexpr std::size_t factors = sublattices + 1; // site fractions in the product of an interaction
+    struct Interaction {
+        std::size_t coordinates[factors]; // one per sublattice, then the second species of the interacting sublattice
+        std::size_t first; // position of the first species of the interacting sublattice, i.e., its sublattice
+        std::size_t first_coefficient;
+        std::size_t degree_count;
+    };
+public:
+    static bool matches ( SublatticeLayout const &layout ) {
+        const std::size_t species[] = { Species... };
+        if ( layout.sublattice_count() != sublattices ) return false;
+        for ( std::size_t s = 0; s < sublattices; ++s ) {
+            if ( layout.species_count ( s ) != species[s] ) return false;
+        }
+        return true;
+    }
+    explicit ShapeModel ( ShapeArguments const &arguments ) :
+        slots ( arguments.coordinate_slots ), slot_count ( arguments.slot_count ), inverse_mixing_sites ( 1 / arguments.mixing_sites )
+    {
+        for ( std::size_t c = 0; c < coordinates; ++c ) {
+            sites[c] = arguments.layout.sites ( sublattice_of ( c ) );
+        }
+        for ( auto i = arguments.interactions.cbegin(); i != arguments.interactions.cend(); ++i ) {
+            BOOST_ASSERT ( i->constituents.size() == sublattices && i->degree_count > 0 );
+            Interaction interaction;
+            for ( std::size_t s = 0; s < sublattices; ++s ) interaction.coordinates[s] = i->constituents[s];
+            interaction.coordinates[sublattices] = i->second;
+            interaction.first = i->sublattice;
+            interaction.first_coefficient = i->first_coefficient;
+            interaction.degree_count = i->degree_count;
+            interactions.push_back ( interaction );
+        }
+    }
+    double energy ( double const* x, int const* variable_indices, double const* constants ) const {
+        double y[coordinates];
+        gather ( x, variable_indices, y );
+        double mixing = 0;
+        for ( std::size_t c = 0; c < coordinates; ++c ) {
+            mixing += sites[c] * ( y[c] < minimum_fraction ? y[c] : y[c] * std::log ( y[c] ) );
+        }
+        double excess = 0;
+        double const* const coefficients = constants + 1;
+        for ( auto i = interactions.cbegin(); i != interactions.cend(); ++i ) {
+            double product = 1;
+            for ( std::size_t a = 0; a < factors; ++a ) product *= y[i->coordinates[a]];
+            const double difference = y[i->coordinates[i->first]] - y[i->coordinates[sublattices]];
+            double const* const L = coefficients + i->first_coefficient;
+            double series = L[i->degree_count - 1];
+            for ( std::size_t k = i->degree_count - 1; k-- > 0; ) series = series * difference + L[k];
+            excess += product * series;
+        }
+        return ( constants[0] * SI_GAS_CONSTANT * mixing + excess ) * inverse_mixing_sites;
+    }
+    void add_jet ( double const* x, int const* variable_indices, double const* constants, CompiledJet &jet, bool with_hessian ) const {
+        double y[coordinates];
+        double gradient[coordinates];
+        double hessian[coordinates * coordinates];
+        gather ( x, variable_indices, y );
+        jet.value += derivatives ( y, constants, gradient, with_hessian ? hessian : nullptr );
+        for ( std::size_t c = 0; c < coordinates; ++c ) jet.gradient[slots[c]] += gradient[c];
+        if ( !with_hessian ) return;
+        for ( std::size_t c1 = 0; c1 < coordinates; ++c1 ) {
+            for ( std::size_t c2 = 0; c2 < coordinates; ++c2 ) {
+                jet.hessian[slots[c1] * slot_count + slots[c2]] += hessian[c1 * coordinates + c2];
+            }
+        }
+    }
+    void add_hessian_vector ( double const* x, int const* variable_indices, double const* constants,
+                              double const* direction, double* product ) const {
+        double y[coordinates];
+        double gradient[coordinates];
+        double hessian[coordinates * coordinates];
+        gather ( x, variable_indices, y );
+        derivatives ( y, constants, gradient, hessian );
+        for ( std::size_t c1 = 0; c1 < coordinates; ++c1 ) {
+            double sum = 0;
+            for ( std::size_t c2 = 0; c2 < coordinates; ++c2 ) sum += hessian[c1 * coordinates + c2] * direction[slots[c2]];
+            product[slots[c1]] += sum;
+        }
+    }
+    std::vector<std::size_t> const& coordinate_slots() const {
+        return slots;
+    }
+    std::size_t memory_bytes() const {
+        return sizeof ( *this ) + slots.capacity() * sizeof ( std::size_t ) + interactions.capacity() * sizeof ( Interaction );
+    }
+private:
+    static constexpr double minimum_fraction = 1e-20; // as IdealMixingModel::protect_domain()
+    static std::size_t sublattice_of ( std::size_t coordinate ) {
+        const std::size_t species[] = { Species... };
+        std::size_t s = 0;
+        while ( coordinate >= species[s] ) coordinate -= species[s++];
+        return s;
+    }
+    void gather ( double const* x, int const* variable_indices, double* y ) const {
+        for ( std::size_t c = 0; c < coordinates; ++c ) y[c] = x[variable_indices[slots[c]]];
+    }
+    // The energy, with its gradient and (unless hessian is null) its dense Hessian by coordinate
+    double derivatives ( double const* y, double const* constants, double* gradient, double* hessian ) const {
+        const double RT = constants[0] * SI_GAS_CONSTANT;
+        double value = 0;
+        if ( hessian ) {
+            for ( std::size_t c = 0; c < coordinates * coordinates; ++c ) hessian[c] = 0;
+        }
+        for ( std::size_t c = 0; c < coordinates; ++c ) {
+            if ( y[c] < minimum_fraction ) {
+                value += RT * sites[c] * y[c];
+                gradient[c] = RT * sites[c];
+            }
+            else {
+                const double log_y = std::log ( y[c] );
+                value += RT * sites[c] * y[c] * log_y;
+                gradient[c] = RT * sites[c] * ( log_y + 1 );
+                if ( hessian ) hessian[c * coordinates + c] = RT * sites[c] / y[c];
+            }
+        }
+        double const* const coefficients = constants + 1;
+        for ( auto i = interactions.cbegin(); i != interactions.cend(); ++i ) {
+            double f[factors];
+            for ( std::size_t a = 0; a < factors; ++a ) f[a] = y[i->coordinates[a]];
+            // The product of the site fractions, and its partial derivatives (the products of all but one or two of them)
+            double product = 1;
+            double partial[factors];
+            for ( std::size_t a = 0; a < factors; ++a ) {
+                product *= f[a];
+                partial[a] = 1;
+                for ( std::size_t b = 0; b < factors; ++b ) {
+                    if ( b != a ) partial[a] *= f[b];
+                }
+            }
+            // The series in d = y_first - y_second and its first two derivatives, by Horner's scheme
+            const double difference = f[i->first] - f[sublattices];
+            double const* const L = coefficients + i->first_coefficient;
+            double series = L[i->degree_count - 1];
+            double series_d = 0;
+            double series_dd = 0;
+            for ( std::size_t k = i->degree_count - 1; k-- > 0; ) {
+                series_dd = series_dd * difference + 2 * series_d;
+                series_d = series_d * difference + series;
+                series = series * difference + L[k];
+            }
+            double sign[factors]; // derivative of d by each site fraction
+            for ( std::size_t a = 0; a < factors; ++a ) sign[a] = 0;
+            sign[i->first] = 1;
+            sign[sublattices] = -1;
+            value += product * series;
+            for ( std::size_t a = 0; a < factors; ++a ) {
+                gradient[i->coordinates[a]] += partial[a] * series + product * series_d * sign[a];
+            }
+            if ( !hessian ) continue;
+            for ( std::size_t a = 0; a < factors; ++a ) {
+                for ( std::size_t b = 0; b < factors; ++b ) {
+                    double second = partial[a] * series_d * sign[b] + partial[b] * series_d * sign[a] + product * series_dd * sign[a] * sign[b];
+                    if ( b != a ) {
+                        double partial_ab = 1;
+                        for ( std::size_t c = 0; c < factors; ++c ) {
+                            if ( c != a && c != b ) partial_ab *= f[c];
+                        }
+                        second += partial_ab * series;
+                    }
+                    hessian[i->coordinates[a] * coordinates + i->coordinates[b]] += second;
+                }
+            }
+        }
+        value *= inverse_mixing_sites;
+        for ( std::size_t c = 0; c < coordinates; ++c ) gradient[c] *= inverse_mixing_sites;
+        if ( hessian ) {
+            for ( std::size_t c = 0; c < coordinates * coordinates; ++c ) hessian[c] *= inverse_mixing_sites;
+        }
+        return value;
+    }
+    double sites[coordinates]; // of the sublattice of each coordinate
+    std::vector<std::size_t> slots;
+    std::size_t slot_count;
+    double inverse_mixing_sites;
+    std::vector<Interaction> interactions;
+};
+
+template <std::size_t... Species> constexpr double ShapeModel<Species...>::minimum_fraction;
+
+// The ideal mixing energy alone of a phase of any shape, by loops over its layout
+class IdealMixingShapeModel : public FixedShapeModel {
+public:
+    explicit IdealMixingShapeModel ( ShapeArguments const &arguments ) :
+        slots ( arguments.coordinate_slots ), slot_count ( arguments.slot_count ), inverse_mixing_sites ( 1 / arguments.mixing_sites )
+    {
+        BOOST_ASSERT ( arguments.interactions.empty() );
+        for ( std::size_t s = 0; s < arguments.layout.sublattice_count(); ++s ) {
+            sites.insert ( sites.end(), arguments.layout.species_count ( s ), arguments.layout.sites ( s ) );
+        }
+    }
+    double energy ( double const* x, int const* variable_indices, double const* constants ) const {
+        double mixing = 0;
+        for ( std::size_t c = 0; c < slots.size(); ++c ) {
+            const double y = x[variable_indices[slots[c]]];
+            mixing += sites[c] * ( y < minimum_fraction ? y : y * std::log ( y ) );
+        }
+        return constants[0] * SI_GAS_CONSTANT * mixing * inverse_mixing_sites;
+    }
+    void add_jet ( double const* x, int const* variable_indices, double const* constants, CompiledJet &jet, bool with_hessian ) const {
+        const double scale = constants[0] * SI_GAS_CONSTANT * inverse_mixing_sites;
+        for ( std::size_t c = 0; c < slots.size(); ++c ) {
+            const double y = x[variable_indices[slots[c]]];
+            if ( y < minimum_fraction ) {
+                jet.value += scale * sites[c] * y;
+                jet.gradient[slots[c]] += scale * sites[c];
+                continue;
+            }
+            const double log_y = std::log ( y );
+            jet.value += scale * sites[c] * y * log_y;
+            jet.gradient[slots[c]] += scale * sites[c] * ( log_y + 1 );
+            if ( with_hessian ) jet.hessian[slots[c] * slot_count + slots[c]] += scale * sites[c] / y;
+        }
+    }
+    void add_hessian_vector ( double const* x, int const* variable_indices, double const* constants,
+                              double const* direction, double* product ) const {
+        const double scale = constants[0] * SI_GAS_CONSTANT * inverse_mixing_sites;
+        for ( std::size_t c = 0; c < slots.size(); ++c ) {
+            const double y = x[variable_indices[slots[c]]];
+            if ( y >= minimum_fraction ) product[slots[c]] += scale * sites[c] / y * direction[slots[c]];
+        }
+    }
+    std::vector<std::size_t> const& coordinate_slots() const {
+        return slots;
+    }
+    std::size_t memory_bytes() const {
+        return sizeof ( *this ) + slots.capacity() * sizeof ( std::size_t ) + sites.capacity() * sizeof ( double );
+    }
+private:
+    static constexpr double minimum_fraction = 1e-20; // as IdealMixingModel::protect_domain()
+    std::vector<std::size_t> slots;
+    std::size_t slot_count;
+    double inverse_mixing_sites;
+    std::vector<double> sites; // of the sublattice of each coordinate
+};
+
+constexpr double IdealMixingShapeModel::minimum_fraction;
+
+template <typename... Shapes> struct ShapeList { };
+
+// The supported shapes: one substitutional sublattice, two sublattices (substitutional and interstitial, or
+// a simple ordering), and ordered phases of two to four equivalent sublattices, with or without interstitials
+typedef ShapeList<
+    ShapeModel<2>, ShapeModel<3>, ShapeModel<4>, ShapeModel<5>, ShapeModel<6>,
+    ShapeModel<1, 2>, ShapeModel<1, 3>, ShapeModel<2, 1>, ShapeModel<2, 2>, ShapeModel<2, 3>, ShapeModel<2, 4>,
+    ShapeModel<3, 1>, ShapeModel<3, 2>, ShapeModel<3, 3>, ShapeModel<4, 1>, ShapeModel<4, 2>, ShapeModel<4, 4>,
+    ShapeModel<2, 2, 1>, ShapeModel<2, 2, 2>, ShapeModel<3, 3, 1>, ShapeModel<3, 3, 3>,
+    ShapeModel<2, 2, 2, 2>, ShapeModel<3, 3, 3, 3>, ShapeModel<2, 2, 2, 2, 1>, ShapeModel<3, 3, 3, 3, 1>
+    > SupportedShapes;
+
+std::unique_ptr<const FixedShapeModel> make_shape_model ( ShapeList<>, ShapeArguments const & )
+{
+    return nullptr;
+}
+
+template <typename First, typename... Rest>
+std::unique_ptr<const FixedShapeModel> make_shape_model ( ShapeList<First, Rest...>, ShapeArguments const &arguments )
+{
+    if ( First::matches ( arguments.layout ) ) return std::unique_ptr<const FixedShapeModel> ( new First ( arguments ) );
+    return make_shape_model ( ShapeList<Rest...>(), arguments );
+}
+}
+
+std::unique_ptr<const FixedShapeModel> make_fixed_shape_model (
+    SublatticeLayout const &layout,
+    std::vector<std::size_t> const &coordinate_slots,
+    std::size_t slot_count,
+    std::vector<FixedShapeInteraction> const &interactions )
+{
+    BOOST_ASSERT ( coordinate_slots.size() == layout.coordinate_count() );
+    const int mixing_sites = layout.mixing_sites();
+    if ( mixing_sites == 0 ) return nullptr;
+    const ShapeArguments arguments = { layout, coordinate_slots, slot_count, interactions, double ( mixing_sites ) };
+    std::unique_ptr<const FixedShapeModel> model = make_shape_model ( SupportedShapes(), arguments );
+    if ( !model && interactions.empty() ) model.reset ( new IdealMixingShapeModel ( arguments ) );
+    return model;
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,134 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// The magnetic energy of the Inden-Hillert-Jarl model evaluated in closed form
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/magnetic_kernel.hpp"
+#include "libgibbs/include/conditions.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include <cmath>
+
+namespace {
+const double minimum_curie_temperature = 1e-20; // below which IHJMagneticModel takes tau to be very large
+const double large_tau = 1e15;
+}
+
+MagneticKernel::MagneticKernel ( double const afm_factor, double const sro_enthalpy_order_fraction, double const mixing_sites ) :
+    afm_factor ( afm_factor ), inverse_mixing_sites ( 1 / mixing_sites )
+{
+    const double p = sro_enthalpy_order_fraction;
+    A = ( 518.0 / 1125.0 ) + ( ( 11692.0 / 15975.0 ) * ( ( 1.0 / p ) - 1.0 ) );
+    B = 79.0 / ( 140 * p );
+    C = ( 474.0 / 497.0 ) * ( ( 1.0 / p ) - 1.0 );
+}
+
+void MagneticKernel::polynomial ( double const tau, double &g, double &g_tau, double &g_tau_tau ) const
+{
+    if ( tau < 1 ) {
+        const double tau2 = tau * tau;
+        const double tau3 = tau2 * tau;
+        const double tau6 = tau3 * tau3;
+        const double tau12 = tau6 * tau6;
+        g = 1 - ( B / tau + C * ( tau3 / 6 + tau6 * tau3 / 135 + tau12 * tau3 / 600 ) ) / A;
+        g_tau = - ( -B / tau2 + C * ( tau2 / 2 + tau6 * tau2 / 15 + tau12 * tau2 / 40 ) ) / A;
+        g_tau_tau = - ( 2 * B / ( tau2 * tau ) + C * ( tau + 8 * tau6 * tau / 15 + 7 * tau12 * tau / 20 ) ) / A;
+    }
+    else {
+        const double inverse = 1 / tau;
+        const double inverse5 = std::pow ( inverse, 5 );
+        const double inverse15 = inverse5 * inverse5 * inverse5;
+        const double inverse25 = inverse15 * inverse5 * inverse5;
+        g = - ( inverse5 / 10 + inverse15 / 315 + inverse25 / 1500 ) / A;
+        g_tau = ( inverse5 / 2 + inverse15 / 21 + inverse25 / 60 ) * inverse / A;
+        g_tau_tau = - ( 3 * inverse5 + 16 * inverse15 / 21 + 13 * inverse25 / 30 ) * inverse * inverse / A;
+    }
+}
+
+MagneticKernel::Terms MagneticKernel::terms ( double const T, double const curie_temperature, double const magnetic_moment ) const
+{
+    // The AFM factor divides negative parameters, as get_afm_factor()
+    const double curie_scale = curie_temperature < 0 ? 1 / afm_factor : 1;
+    const double moment_scale = magnetic_moment < 0 ? 1 / afm_factor : 1;
+    const double curie = curie_scale * curie_temperature;
+    const double moment = moment_scale * magnetic_moment;
+    if ( 1 + moment <= 0 ) {
+        BOOST_THROW_EXCEPTION ( domain_error() << str_errinfo ( "Logarithm of nonpositive number is not defined" ) );
+    }
+    double tau = large_tau;
+    double tau_curie = 0; // derivatives of tau by the Curie temperature before the AFM factor
+    double tau_curie_curie = 0;
+    if ( curie < -minimum_curie_temperature || curie >= minimum_curie_temperature ) {
+        tau = T / curie;
+        tau_curie = -tau * curie_scale / curie;
+        tau_curie_curie = 2 * tau * curie_scale * curie_scale / ( curie * curie );
+    }
+    double g, g_tau, g_tau_tau;
+    polynomial ( tau, g, g_tau, g_tau_tau );
+    const double scale = T * SI_GAS_CONSTANT * inverse_mixing_sites;
+    const double entropy = std::log ( 1 + moment );
+    const double entropy_moment = moment_scale / ( 1 + moment );
+    Terms result;
+    result.value = scale * entropy * g;
+    result.moment = scale * entropy_moment * g;
+    result.curie = scale * entropy * g_tau * tau_curie;
+    result.moment_moment = -scale * entropy_moment * entropy_moment * g;
+    result.moment_curie = scale * entropy_moment * g_tau * tau_curie;
+    result.curie_curie = scale * entropy * ( g_tau_tau * tau_curie * tau_curie + g_tau * tau_curie_curie );
+    return result;
+}
+
+double MagneticKernel::energy ( double const T, double const curie_temperature, double const magnetic_moment ) const
+{
+    return terms ( T, curie_temperature, magnetic_moment ).value;
+}
+
+void MagneticKernel::add_jet ( double const T, CompiledJet const &curie_temperature, CompiledJet const &magnetic_moment,
+                               CompiledJet &jet, bool const with_hessian ) const
+{
+    const Terms t = terms ( T, curie_temperature.value, magnetic_moment.value );
+    const std::size_t n = jet.gradient.size();
+    double const* const curie = &curie_temperature.gradient[0];
+    double const* const moment = &magnetic_moment.gradient[0];
+    jet.value += t.value;
+    for ( std::size_t slot = 0; slot < n; ++slot ) {
+        jet.gradient[slot] += t.moment * moment[slot] + t.curie * curie[slot];
+    }
+    if ( !with_hessian ) return;
+    for ( std::size_t slot1 = 0; slot1 < n; ++slot1 ) {
+        const double moment1 = t.moment_moment * moment[slot1] + t.moment_curie * curie[slot1];
+        const double curie1 = t.moment_curie * moment[slot1] + t.curie_curie * curie[slot1];
+        double* const row = &jet.hessian[slot1 * n];
+        double const* const curie_row = &curie_temperature.hessian[slot1 * n];
+        double const* const moment_row = &magnetic_moment.hessian[slot1 * n];
+        for ( std::size_t slot2 = 0; slot2 < n; ++slot2 ) {
+            row[slot2] += moment1 * moment[slot2] + curie1 * curie[slot2] + t.moment * moment_row[slot2] + t.curie * curie_row[slot2];
+        }
+    }
+}
+
+void MagneticKernel::add_hessian_vector ( double const T, CompiledJet const &curie_temperature, CompiledJet const &magnetic_moment,
+        double const* direction, double* product ) const
+{
+    const Terms t = terms ( T, curie_temperature.value, magnetic_moment.value );
+    const std::size_t n = curie_temperature.gradient.size();
+    double const* const curie = &curie_temperature.gradient[0];
+    double const* const moment = &magnetic_moment.gradient[0];
+    double curie_direction = 0;
+    double moment_direction = 0;
+    for ( std::size_t slot = 0; slot < n; ++slot ) {
+        curie_direction += curie[slot] * direction[slot];
+        moment_direction += moment[slot] * direction[slot];
+    }
+    const double moment_factor = t.moment_moment * moment_direction + t.moment_curie * curie_direction;
+    const double curie_factor = t.moment_curie * moment_direction + t.curie_curie * curie_direction;
+    for ( std::size_t slot = 0; slot < n; ++slot ) {
+        product[slot] += moment_factor * moment[slot] + curie_factor * curie[slot]
+                         + t.moment * magnetic_moment.product[slot] + t.curie * curie_temperature.product[slot];
+    }
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
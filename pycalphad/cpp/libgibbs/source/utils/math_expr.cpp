@@ -12,6 +12,7 @@
 #include "libgibbs/include/utils/ast_caching.hpp"
 #include "libgibbs/include/utils/math_expr.hpp"
 #include "libtdb/include/exceptions.hpp"
+#include "libgibbs/include/utils/hot_path_logging.hpp"
 #include "libtdb/include/logging.hpp"
 #include <boost/spirit/include/support_utree.hpp>
 #include <boost/math/special_functions/fpclassify.hpp>
@@ -38,6 +39,7 @@ bool is_allowed_value(T &val) {
 	}
 }
 template bool is_allowed_value(double&); // explicit instantiation
+template bool is_allowed_value(float&);
 
 bool is_zero_tree(const utree &ut) {
 	bool condition = ((ut.which() == utree_type::double_type || ut.which() == utree_type::int_type) && ut.get<double>() == 0.0);
@@ -58,7 +60,7 @@ boost::spirit::utree const process_utree(
 		boost::bimap<std::string, int> const &modelvar_indices,
 		ASTSymbolMap const& symbols,
 		double* const modelvars) {
-	BOOST_LOG_NAMED_SCOPE("process_utree");
+	HOT_PATH_NAMED_SCOPE("process_utree");
 	typedef boost::spirit::utree utree;
 	typedef boost::spirit::utree_type utree_type;
 	//std::cout << "processing " << ut.which() << " tree: " << ut << std::endl;
@@ -298,7 +300,10 @@ boost::spirit::utree const process_utree(
 	return utree();
 }
 
-boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
+namespace {
+// Simplification of ut into result. Returns false, and leaves result alone, if ut is its own
+// simplification, so that unchanged subtrees are never copied while walking the tree.
+bool simplify_utree(boost::spirit::utree const& ut, boost::spirit::utree &result) {
 	typedef boost::spirit::utree utree;
 	typedef boost::spirit::utree_type utree_type;
 	//std::cout << "processing " << ut.which() << " tree: " << ut << std::endl;
@@ -326,7 +331,8 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 					if (!is_allowed_value<double>(retval)) {
 						BOOST_THROW_EXCEPTION(floating_point_error() << str_errinfo("Calculated value is infinite, subnormal, or not a number") << ast_errinfo(ut));
 					}
-					return retval;
+					result = retval;
+					return true;
 				}
 				if ((*it).which() == utree_type::int_type && std::distance(it,end) == 1) {
 					// only one element in utree list, and it's an int
@@ -335,7 +341,8 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 					if (!is_allowed_value<double>(retval)) {
 						BOOST_THROW_EXCEPTION(floating_point_error() << str_errinfo("Calculated value is infinite, subnormal, or not a number") << ast_errinfo(ut));
 					}
-					return retval;
+					result = retval;
+					return true;
 				}
 				if ((*it).which() == utree_type::string_type) {
 					// operator/function
@@ -346,7 +353,7 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 					//std::cout << "OPERATOR: " << op << std::endl;
 					if (op == "@") {
 						utree::const_iterator curT, lowlimit, highlimit;
-						utree tree;
+						utree simplified_tree;
 						if (it != end) ++it;
 						curT = it; // curT
 						if (it != end) ++it;
@@ -354,16 +361,20 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 						if (it != end) ++it;
 						highlimit = it; // highlimit
 						if (it != end) ++it;
-						tree = simplify_utree(*it); // tree
+						utree const& tree = simplify_utree(*it, simplified_tree) ? simplified_tree : *it; // tree
 						if (it != end) ++it;
 						if (is_zero_tree(tree)) {
 							// this tree is trivial and this range check operation can be removed
 							if (it == end) {
 								if (ret_tree.which() == utree_type::invalid_type) {
 									// all range checks are trivial; simplify to clean zero
-									return utree(0);
+									result = utree(0);
+									return true;
+								}
+								else {
+									result.swap(ret_tree);
+									return true;
 								}
-								else return ret_tree;
 							}
 							else {
 								// this tree is trivial but we have more range checks to evaluate
@@ -380,7 +391,8 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 							ret_tree.push_back(*highlimit);
 							ret_tree.push_back(tree);
 							if (it == end) {
-								return ret_tree;
+								result.swap(ret_tree);
+								return true;
 							}
 							else {
 								continue;
@@ -389,9 +401,11 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 					}
 					++it; // get left-hand side
 					// TODO: exception handling
-					if (it != end) lhs = simplify_utree(*it);
+					// lhs and rhs are only kept if they simplify to something else, i.e., a constant;
+					// otherwise they stay invalid, which is never a constant
+					if (it != end) simplify_utree(*it, lhs);
 					++it; // get right-hand side
-					if (it != end) rhs = simplify_utree(*it);
+					if (it != end) simplify_utree(*it, rhs);
 
 					if (op == "+") {
 						if ((lhs.which() == utree_type::double_type || lhs.which() == utree_type::int_type)
@@ -400,14 +414,14 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 						) {
 							res += (lhs.get<double>() + rhs.get<double>());  // accumulate the result
 						}
-						else return ut;
+						else return false;
 					}
 					else if (op == "-") {
 						if (ut.size() == 2) {
 							if (lhs.which() == utree_type::double_type || lhs.which() == utree_type::int_type) {
 								res += -lhs.get<double>(); // case of negation (unary operator)
 							}
-							else return ut;
+							else return false;
 						}
 						else {
 							if ((lhs.which() == utree_type::double_type || lhs.which() == utree_type::int_type)
@@ -416,7 +430,7 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 							) {
 								res += (lhs.get<double>() - rhs.get<double>());
 							}
-							else return ut;
+							else return false;
 						}
 					}
 					else if (op == "*") {
@@ -430,14 +444,14 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 						) {
 							res += (lhs.get<double>() * rhs.get<double>());
 						}
-						else return ut;
+						else return false;
 					}
 					else if (op == "/") {
 						if (!(lhs.which() == utree_type::double_type || lhs.which() == utree_type::int_type)
 								||
 								!(rhs.which() == utree_type::double_type || rhs.which() == utree_type::int_type)
 						) {
-								return ut;
+								return false;
 						}
 						if (is_zero_tree(rhs)) {
 							BOOST_THROW_EXCEPTION(divide_by_zero_error() << ast_errinfo(ut));
@@ -452,7 +466,7 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 									||
 									!((rhs.which() == utree_type::double_type || rhs.which() == utree_type::int_type)
 							))
-								return ut;
+								return false;
 							if (lhs.get<double>() < 0 && (fabs(rhs.get<double>()) < 1 && fabs(rhs.get<double>()) > 0)) {
 								// the result is complex
 								// we do not support this (for now)
@@ -462,7 +476,7 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 						}
 					}
 					else if (op == "LN") {
-						if (!((lhs.which() == utree_type::double_type) || lhs.which() == utree_type::int_type)) return ut;
+						if (!((lhs.which() == utree_type::double_type) || lhs.which() == utree_type::int_type)) return false;
 						if (lhs.get<double>() > 0) {
 							res += log(lhs.get<double>());
 						}
@@ -472,7 +486,7 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 						}
 					}
 					else if (op == "EXP") {
-						if (!((lhs.which() == utree_type::double_type) || lhs.which() == utree_type::int_type)) return ut;
+						if (!((lhs.which() == utree_type::double_type) || lhs.which() == utree_type::int_type)) return false;
 						res += exp(lhs.get<double>());
 					}
 					else BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("Unknown operator or state variable") << specific_errinfo(op) << ast_errinfo(ut));;
@@ -481,7 +495,8 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 				++it;
 			}
 			if (!is_allowed_value<double>(res)) BOOST_THROW_EXCEPTION(floating_point_error() << str_errinfo("Calculated value is infinite, subnormal, or not a number") << ast_errinfo(ut));
-			return utree(res);
+			result = utree(res);
+			return true;
 			//std::cout << ") ";
 			break;
 		}
@@ -490,27 +505,41 @@ boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
 			break;
 		}
 		case utree_type::string_type: {
-			return ut;
+			return false;
 		}
 		case utree_type::double_type: {
 			double retval = ut.get<double>();
 			if (!is_allowed_value<double>(retval)) {
 				BOOST_THROW_EXCEPTION(floating_point_error() << str_errinfo("Calculated value is infinite, subnormal, or not a number") << ast_errinfo(ut));
 			}
-			return utree(retval);
+			result = utree(retval);
+			return true;
 		}
 		case utree_type::int_type: {
 			double retval = ut.get<double>();
 			if (!is_allowed_value<double>(retval)) {
 				BOOST_THROW_EXCEPTION(floating_point_error() << str_errinfo("Calculated value is infinite, subnormal, or not a number") << ast_errinfo(ut));
 			}
-			return utree(retval);
+			result = utree(retval);
+			return true;
 		}
 	}
 	BOOST_THROW_EXCEPTION(unknown_symbol_error() << str_errinfo("Unable to simplify abstract syntax tree") << ast_errinfo(ut));
+	return false;
+}
+}
+
+boost::spirit::utree const simplify_utree(boost::spirit::utree const& ut) {
+	boost::spirit::utree result;
+	if (simplify_utree(ut, result)) return result;
 	return ut;
 }
 
+void simplify_utree_in_place(boost::spirit::utree &ut) {
+	boost::spirit::utree result;
+	if (simplify_utree(ut, result)) ut.swap(result);
+}
+
 // TODO: transitional code for backwards compatibility
 boost::spirit::utree const process_utree(
 		boost::spirit::utree const& ut,
@@ -0,0 +1,98 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Estimated memory use of the solver's data structures, broken down by component
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/memory_footprint.hpp"
+#include <iomanip>
+#include <sstream>
+
+using boost::spirit::utree;
+using boost::spirit::utree_type;
+
+MemoryFootprint& MemoryFootprint::operator+= ( const MemoryFootprint &other )
+{
+    for ( auto i = other.components_usage.cbegin(); i != other.components_usage.cend(); ++i ) {
+        components_usage[i->first] += i->second;
+    }
+    return *this;
+}
+
+MemoryUsage MemoryFootprint::total() const
+{
+    MemoryUsage sum;
+    for ( auto i = components_usage.cbegin(); i != components_usage.cend(); ++i ) sum += i->second;
+    return sum;
+}
+
+std::string MemoryFootprint::print() const
+{
+    std::stringstream output;
+    for ( auto i = components_usage.cbegin(); i != components_usage.cend(); ++i ) {
+        output << std::left << std::setw ( 24 ) << i->first << std::right << std::setw ( 14 ) << i->second.bytes
+               << " bytes" << std::setw ( 12 ) << i->second.nodes << " nodes" << std::endl;
+    }
+    const MemoryUsage sum = total();
+    output << std::left << std::setw ( 24 ) << "total" << std::right << std::setw ( 14 ) << sum.bytes
+           << " bytes" << std::setw ( 12 ) << sum.nodes << " nodes" << std::endl;
+    return output.str();
+}
+
+MemoryFootprint PhaseMemoryFootprint::total() const
+{
+    MemoryFootprint sum = common;
+    for ( auto i = phases.cbegin(); i != phases.cend(); ++i ) sum += i->second;
+    return sum;
+}
+
+std::string PhaseMemoryFootprint::print() const
+{
+    std::stringstream output;
+    for ( auto i = phases.cbegin(); i != phases.cend(); ++i ) {
+        output << i->first << ":" << std::endl << i->second.print();
+    }
+    output << "not in any phase:" << std::endl << common.print();
+    output << "all:" << std::endl << total().print();
+    return output.str();
+}
+
+std::size_t string_heap_bytes ( const std::string &str )
+{
+    // Strings that fit in the object itself (the small string optimization) allocate nothing
+    return str.capacity() < sizeof ( std::string ) ? 0 : str.capacity() + 1;
+}
+
+MemoryUsage utree_memory_usage ( const utree &tree )
+{
+    MemoryUsage usage ( 0, 1 );
+    switch ( tree.which() ) {
+    case utree_type::string_type: {
+        const boost::spirit::utf8_string_range_type range = tree.get<boost::spirit::utf8_string_range_type>();
+        const std::size_t length = range.end() - range.begin();
+        if ( length >= sizeof ( utree ) - 2 ) usage.bytes += length + 1; // short strings are stored in the node
+        break;
+    }
+    case utree_type::symbol_type: {
+        const boost::spirit::utf8_symbol_range_type range = tree.get<boost::spirit::utf8_symbol_range_type>();
+        const std::size_t length = range.end() - range.begin();
+        if ( length >= sizeof ( utree ) - 2 ) usage.bytes += length + 1;
+        break;
+    }
+    case utree_type::list_type:
+        for ( auto i = tree.begin(); i != tree.end(); ++i ) {
+            // Each element lives in a list node with two links
+            usage.bytes += sizeof ( utree ) + 2 * sizeof ( void* );
+            usage += utree_memory_usage ( *i );
+        }
+        break;
+    default:
+        break;
+    }
+    return usage;
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
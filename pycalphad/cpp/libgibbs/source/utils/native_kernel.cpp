@@ -0,0 +1,188 @@
+/*=============================================================================
+	Copyright (c) 2012-2014 Richard Otis
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// native_kernel.cpp -- C++ code generation for compiled programs, and loading of the compiled kernels
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/native_kernel.hpp"
+#include "libgibbs/include/utils/ast_serialization.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include "libtdb/include/logging.hpp"
+#include <boost/assert.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <set>
+#include <sstream>
+#include <dlfcn.h>
+
+namespace {
+// Increment whenever the generated code changes meaning
+const std::string native_format = "libgibbs native kernels 1";
+// IEEE semantics are kept so that domain errors show up as non-finite outputs
+const std::string compiler_flags = "-O2 -fPIC -shared -fno-math-errno";
+
+std::string shell_quote ( std::string const &argument )
+{
+    std::string quoted ( "'" );
+    for ( auto c : argument ) {
+        if ( c == '\'' ) quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted + "'";
+}
+
+// One program as a block of the kernel body; labels are made unique by prefix
+void write_program ( std::ostream &out, CompiledExpression const &program, std::string const &prefix, std::vector<std::size_t> const &positions )
+{
+    std::vector<CompiledInstruction> const &instructions = program.instructions();
+    std::set<std::size_t> labels;
+    for ( auto ins = instructions.cbegin(); ins != instructions.cend(); ++ins ) {
+        if ( ins->op == CompiledOpCode::RANGE_CHECK || ins->op == CompiledOpCode::JUMP ) labels.insert ( ins->dest );
+    }
+    out << "    {\n";
+    out << "        double r[" << std::max ( program.registers(), std::size_t ( 1 ) ) << "];\n";
+    for ( std::size_t pos = 0; pos <= instructions.size(); ++pos ) {
+        if ( labels.count ( pos ) ) out << prefix << pos << ": ;\n";
+        if ( pos == instructions.size() ) break;
+        CompiledInstruction const &ins = instructions[pos];
+        out << "        ";
+        switch ( ins.op ) {
+        case CompiledOpCode::CONSTANT:
+            out << "r[" << ins.dest << "] = " << ins.constant << ";\n";
+            break;
+        case CompiledOpCode::VARIABLE:
+            out << "r[" << ins.dest << "] = x[" << ins.arg1 << "];\n";
+            break;
+        case CompiledOpCode::STATEVAR:
+            out << "r[" << ins.dest << "] = state[" << ins.arg1 << "];\n";
+            break;
+        case CompiledOpCode::COPY:
+            out << "r[" << ins.dest << "] = r[" << ins.arg1 << "];\n";
+            break;
+        case CompiledOpCode::ADD:
+            out << "r[" << ins.dest << "] = r[" << ins.arg1 << "] + r[" << ins.arg2 << "];\n";
+            break;
+        case CompiledOpCode::SUBTRACT:
+            out << "r[" << ins.dest << "] = r[" << ins.arg1 << "] - r[" << ins.arg2 << "];\n";
+            break;
+        case CompiledOpCode::NEGATE:
+            out << "r[" << ins.dest << "] = -r[" << ins.arg1 << "];\n";
+            break;
+        case CompiledOpCode::MULTIPLY:
+            out << "r[" << ins.dest << "] = r[" << ins.arg1 << "] * r[" << ins.arg2 << "];\n";
+            break;
+        case CompiledOpCode::DIVIDE:
+            out << "r[" << ins.dest << "] = r[" << ins.arg1 << "] / r[" << ins.arg2 << "];\n";
+            break;
+        case CompiledOpCode::POWER:
+            out << "r[" << ins.dest << "] = pow ( r[" << ins.arg1 << "], r[" << ins.arg2 << "] );\n";
+            break;
+        case CompiledOpCode::LN:
+            out << "r[" << ins.dest << "] = log ( r[" << ins.arg1 << "] );\n";
+            break;
+        case CompiledOpCode::EXP:
+            out << "r[" << ins.dest << "] = exp ( r[" << ins.arg1 << "] );\n";
+            break;
+        case CompiledOpCode::RANGE_CHECK:
+            out << "if ( !( r[" << ins.arg1 << "] >= r[" << ins.arg2 << "] && r[" << ins.arg1 << "] < r[" << ins.arg3 << "] ) ) goto "
+                << prefix << ins.dest << ";\n";
+            break;
+        case CompiledOpCode::JUMP:
+            out << "goto " << prefix << ins.dest << ";\n";
+            break;
+        }
+    }
+    for ( auto position : positions ) {
+        out << "        out[" << position << "] += " << ( instructions.empty() ? std::string ( "0" ) : "r[" + std::to_string ( program.result() ) + "]" ) << ";\n";
+    }
+    out << "    }\n";
+}
+}
+
+NativeKernelSource::NativeKernelSource()
+{
+    source = "// " + native_format + "\n#include <math.h>\n";
+}
+
+void NativeKernelSource::add_kernel ( std::string const &name, std::vector<NativeKernelOutput> const &outputs )
+{
+    std::ostringstream out;
+    out.precision ( 17 ); // constants round-trip exactly
+    out << "extern \"C\" void " << name << " ( double const* x, double const* state, double* out )\n{\n";
+    out << "    (void) x;\n    (void) state;\n";
+    for ( auto output = outputs.cbegin(); output != outputs.cend(); ++output ) {
+        std::ostringstream prefix;
+        prefix << "L" << std::distance ( outputs.cbegin(), output ) << "_";
+        write_program ( out, *output->program, prefix.str(), output->positions );
+    }
+    out << "}\n";
+    source += out.str();
+}
+
+NativeKernelLibrary::NativeKernelLibrary ( std::string const &source, std::string const &cache_directory ) :
+    handle ( nullptr )
+{
+    BOOST_LOG_NAMED_SCOPE ( "NativeKernelLibrary::NativeKernelLibrary" );
+    logger opto_log ( journal::keywords::channel = "optimizer" );
+    char const* const compiler_variable = std::getenv ( "LIBGIBBS_CXX" );
+    const std::string compiler = compiler_variable && *compiler_variable ? compiler_variable : "c++";
+
+    ASTWriter key_data;
+    key_data.write ( native_format );
+    key_data.write ( compiler + " " + compiler_flags );
+    key_data.write ( source );
+    std::stringstream stem;
+    stem << ( cache_directory.empty() ? std::string ( "." ) : cache_directory ) << "/" << std::hex
+         << std::setw ( 16 ) << std::setfill ( '0' ) << key_data.hash();
+    library_path = stem.str() + ".so";
+
+    handle = dlopen ( library_path.c_str(), RTLD_NOW | RTLD_LOCAL );
+    if ( !handle ) {
+        // Other processes may be compiling the same kernels, so build under temporary names
+        // and move the object into place, as CompiledSystem does with its cache files
+        std::stringstream temp_stem;
+        temp_stem << stem.str() << "." << std::hex << std::random_device()();
+        const std::string source_path = temp_stem.str() + ".cpp";
+        const std::string object_path = temp_stem.str() + ".so.tmp";
+        std::ofstream source_file ( source_path.c_str() );
+        source_file << source;
+        source_file.close();
+        const std::string command = shell_quote ( compiler ) + " " + compiler_flags + " -o " + shell_quote ( object_path ) + " -x c++ " + shell_quote ( source_path );
+        BOOST_LOG_SEV ( opto_log, debug ) << command;
+        const int status = source_file ? std::system ( command.c_str() ) : -1;
+        std::remove ( source_path.c_str() );
+        if ( status != 0 || std::rename ( object_path.c_str(), library_path.c_str() ) != 0 ) {
+            std::remove ( object_path.c_str() );
+            BOOST_THROW_EXCEPTION ( internal_error() << str_errinfo ( "Native kernels could not be compiled" ) << specific_errinfo ( command ) );
+        }
+        BOOST_LOG_SEV ( opto_log, debug ) << "compiled " << source.size() << " bytes of kernel source to " << library_path;
+        handle = dlopen ( library_path.c_str(), RTLD_NOW | RTLD_LOCAL );
+    }
+    if ( !handle ) {
+        char const* const error = dlerror();
+        BOOST_THROW_EXCEPTION ( internal_error() << str_errinfo ( "Native kernels could not be loaded" ) << specific_errinfo ( error ? error : library_path ) );
+    }
+}
+
+NativeKernelLibrary::~NativeKernelLibrary()
+{
+    if ( handle ) dlclose ( handle );
+}
+
+NativeKernelFunction NativeKernelLibrary::kernel ( std::string const &name ) const
+{
+    BOOST_ASSERT ( handle );
+    void* const symbol = dlsym ( handle, name.c_str() );
+    if ( !symbol ) {
+        BOOST_THROW_EXCEPTION ( unknown_symbol_error() << str_errinfo ( "Native kernel not found" ) << specific_errinfo ( name ) );
+    }
+    return reinterpret_cast<NativeKernelFunction> ( symbol );
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
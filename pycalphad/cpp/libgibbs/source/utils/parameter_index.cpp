@@ -0,0 +1,79 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Hashed index of the parameters of a database, for building energy models
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/parameter_index.hpp"
+#include "libtdb/include/logging.hpp"
+#include <list>
+#include <mutex>
+#include <tuple>
+
+ParameterIndex::ParameterIndex ( parameter_set parameters_ ) :
+    storage ( std::move ( parameters_ ) ), parameter_count ( 0 )
+{
+    BOOST_LOG_NAMED_SCOPE ( "ParameterIndex::ParameterIndex" );
+    logger model_log ( journal::keywords::channel = "optimizer" );
+    auto &by_phase = boost::multi_index::get<phase_index> ( storage );
+    for ( auto param = by_phase.begin(); param != by_phase.end(); ++param ) {
+        parameters[key ( param->phasename(), param->type, param->constituent_array )].push_back ( &*param );
+        ++parameter_count;
+    }
+    BOOST_LOG_SEV ( model_log, debug ) << "indexed " << parameter_count << " parameters under " << parameters.size() << " keys";
+}
+
+std::string ParameterIndex::key (
+    std::string const &phase,
+    std::string const &type,
+    std::vector<std::vector<std::string>> const &constituents )
+{
+    // Names of phases, types and species contain none of the separators
+    std::string result = phase;
+    result += ' ';
+    result += type;
+    for ( auto sublattice = constituents.cbegin(); sublattice != constituents.cend(); ++sublattice ) {
+        result += ':';
+        for ( auto species = sublattice->cbegin(); species != sublattice->cend(); ++species ) {
+            if ( species != sublattice->cbegin() ) result += ',';
+            result += *species;
+        }
+    }
+    return result;
+}
+
+std::vector<const Parameter*> const& ParameterIndex::find (
+    std::string const &phase,
+    std::string const &type,
+    std::vector<std::vector<std::string>> const &constituents ) const
+{
+    static const std::vector<const Parameter*> none;
+    const auto found = parameters.find ( key ( phase, type, constituents ) );
+    return found != parameters.end() ? found->second : none;
+}
+
+std::shared_ptr<const ParameterIndex> ParameterIndex::of ( Database const &DB )
+{
+    typedef std::tuple<const Database*, std::string, std::weak_ptr<const ParameterIndex>> Entry;
+    static std::mutex registry_mutex;
+    static std::list<Entry> registry;
+    std::lock_guard<std::mutex> lock ( registry_mutex );
+    for ( auto i = registry.begin(); i != registry.end(); ) {
+        std::shared_ptr<const ParameterIndex> index = std::get<2> ( *i ).lock();
+        if ( !index ) {
+            i = registry.erase ( i );
+            continue;
+        }
+        if ( std::get<0> ( *i ) == &DB && std::get<1> ( *i ) == DB.get_info() ) return index;
+        ++i;
+    }
+    // Built under the lock, so that threads starting on the same database build it once
+    std::shared_ptr<const ParameterIndex> index = std::make_shared<ParameterIndex> ( DB.get_parameter_set() );
+    registry.emplace_back ( &DB, DB.get_info(), index );
+    return index;
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
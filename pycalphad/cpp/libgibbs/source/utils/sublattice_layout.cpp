@@ -0,0 +1,98 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// sublattice_layout.cpp -- flat sublattice descriptions built from a sublattice_set
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/sublattice_layout.hpp"
+#include <algorithm>
+
+constexpr std::size_t SublatticeLayout::no_component;
+
+SublatticeLayout::SublatticeLayout ( std::string const &phase_name, sublattice_set const &sublset ) :
+    sublattice_offsets ( 1, 0 )
+{
+    for ( int sublindex = 0; ; ++sublindex ) {
+        const auto subl_range = boost::multi_index::get<phase_subl> ( sublset ).equal_range ( boost::make_tuple ( phase_name, sublindex ) );
+        if ( subl_range.first == subl_range.second ) break;
+        sublattice_sites.push_back ( subl_range.first->num_sites );
+        for ( auto subl = subl_range.first; subl != subl_range.second; ++subl ) {
+            coordinate_species.push_back ( subl->species );
+            coordinate_sites.push_back ( subl->num_sites );
+        }
+        sublattice_offsets.push_back ( coordinate_species.size() );
+    }
+    index_components();
+}
+
+SublatticeLayout::SublatticeLayout ( std::vector<double> const &site_counts, std::vector<std::vector<std::string>> const &species ) :
+    sublattice_offsets ( 1, 0 ),
+    sublattice_sites ( site_counts )
+{
+    BOOST_ASSERT ( site_counts.size() == species.size() );
+    for ( std::size_t sublattice = 0; sublattice < species.size(); ++sublattice ) {
+        coordinate_species.insert ( coordinate_species.end(), species[sublattice].begin(), species[sublattice].end() );
+        coordinate_sites.insert ( coordinate_sites.end(), species[sublattice].size(), site_counts[sublattice] );
+        sublattice_offsets.push_back ( coordinate_species.size() );
+    }
+    index_components();
+}
+
+void SublatticeLayout::index_components()
+{
+    const std::set<std::string> names ( coordinate_species.begin(), coordinate_species.end() );
+    for ( auto name = names.begin(); name != names.end(); ++name ) {
+        if ( *name != "VA" ) component_names.push_back ( *name );
+    }
+    coordinate_components.clear();
+    for ( auto species_name = coordinate_species.cbegin(); species_name != coordinate_species.cend(); ++species_name ) {
+        const auto component_find = std::lower_bound ( component_names.begin(), component_names.end(), *species_name );
+        if ( component_find != component_names.end() && *component_find == *species_name ) {
+            coordinate_components.push_back ( std::distance ( component_names.begin(), component_find ) );
+        }
+        else coordinate_components.push_back ( no_component );
+    }
+}
+
+int SublatticeLayout::mixing_sites() const
+{
+    int sites = 0;
+    for ( std::size_t sublattice = 0; sublattice < sublattice_count(); ++sublattice ) {
+        if ( !( species_count ( sublattice ) == 1 && species ( sublattice_begin ( sublattice ) ) == "VA" ) ) {
+            sites += sublattice_sites[sublattice];
+        }
+    }
+    return sites;
+}
+
+std::set<std::size_t> SublatticeLayout::dependent_dimensions() const
+{
+    std::set<std::size_t> dimensions;
+    for ( std::size_t sublattice = 0; sublattice < sublattice_count(); ++sublattice ) {
+        if ( species_count ( sublattice ) > 0 ) dimensions.insert ( sublattice_end ( sublattice ) - 1 );
+    }
+    return dimensions;
+}
+
+MoleFractionMatrix::MoleFractionMatrix ( SublatticeLayout const &layout, std::vector<std::string> const &global_components ) :
+    column_count ( global_components.size() )
+{
+    std::vector<std::size_t> component_columns;
+    for ( auto name = layout.component_names.cbegin(); name != layout.component_names.cend(); ++name ) {
+        const auto column = std::lower_bound ( global_components.begin(), global_components.end(), *name );
+        BOOST_ASSERT ( column != global_components.end() && *column == *name );
+        component_columns.push_back ( std::distance ( global_components.begin(), column ) );
+    }
+    for ( std::size_t coordinate = 0; coordinate < layout.coordinate_count(); ++coordinate ) {
+        const std::size_t component_id = layout.coordinate_components[coordinate];
+        if ( component_id == SublatticeLayout::no_component ) continue; // vacancies don't contribute here
+        entry_coordinates.push_back ( coordinate );
+        entry_columns.push_back ( component_columns[component_id] );
+        entry_sites.push_back ( layout.coordinate_sites[coordinate] );
+    }
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
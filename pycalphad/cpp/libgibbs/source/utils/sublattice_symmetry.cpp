@@ -0,0 +1,179 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Groups of equivalent sublattices of an ordered phase, whose exchange leaves its energy unchanged
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/sublattice_symmetry.hpp"
+#include "libgibbs/include/compositionset.hpp"
+#include "libtdb/include/exceptions.hpp"
+#include "libtdb/include/logging.hpp"
+#include <cmath>
+#include <numeric>
+
+namespace {
+// Whether sublattices first and second of layout can be exchanged at all
+bool interchangeable ( SublatticeLayout const &layout, const std::size_t first, const std::size_t second )
+{
+    if ( layout.sites ( first ) != layout.sites ( second ) ) return false;
+    if ( layout.species_count ( first ) != layout.species_count ( second ) ) return false;
+    for ( std::size_t i = 0; i < layout.species_count ( first ); ++i ) {
+        if ( layout.species ( layout.sublattice_begin ( first ) + i ) != layout.species ( layout.sublattice_begin ( second ) + i ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+SublatticeSymmetry::SublatticeSymmetry ( SublatticeLayout const &layout, std::vector<std::vector<std::size_t>> groups ) :
+    sublattice_groups ( std::move ( groups ) ),
+    coordinate_count ( layout.coordinate_count() ),
+    permutation_count ( 1 )
+{
+    std::vector<bool> grouped ( layout.sublattice_count(), false );
+    for ( auto group = sublattice_groups.begin(); group != sublattice_groups.end(); ++group ) {
+        if ( group->size() < 2 ) {
+            BOOST_THROW_EXCEPTION ( range_check_error() << str_errinfo ( "A group of equivalent sublattices needs at least two of them" ) );
+        }
+        std::sort ( group->begin(), group->end() );
+        for ( std::size_t i = 0; i < group->size(); ++i ) {
+            const std::size_t sublattice = ( *group ) [i];
+            if ( sublattice >= layout.sublattice_count() ) {
+                BOOST_THROW_EXCEPTION ( range_check_error() << str_errinfo ( "Sublattice index out of range" ) );
+            }
+            if ( grouped[sublattice] ) {
+                BOOST_THROW_EXCEPTION ( range_check_error() << str_errinfo ( "Sublattice is in more than one group of equivalent sublattices" ) );
+            }
+            grouped[sublattice] = true;
+            if ( !interchangeable ( layout, group->front(), sublattice ) ) {
+                BOOST_THROW_EXCEPTION ( range_check_error() << str_errinfo ( "Equivalent sublattices must have the same site count and species" ) );
+            }
+            permutation_count *= i + 1;
+        }
+    }
+    std::sort ( sublattice_groups.begin(), sublattice_groups.end() );
+    for ( std::size_t sublattice = 0; sublattice < layout.sublattice_count(); ++sublattice ) {
+        block_begin.push_back ( layout.sublattice_begin ( sublattice ) );
+        block_length.push_back ( layout.species_count ( sublattice ) );
+    }
+}
+
+SublatticeSymmetry SublatticeSymmetry::detect ( CompositionSet const &phase, evalconditions const &conditions )
+{
+    BOOST_LOG_NAMED_SCOPE ( "SublatticeSymmetry::detect" );
+    logger opt_log ( journal::keywords::channel = "optimizer" );
+    constexpr const std::size_t test_points = 3;
+    constexpr const double tolerance = 1e-9; // relative to the energy
+    const SublatticeLayout &layout = phase.sublattice_layout();
+    const std::size_t dimension = layout.coordinate_count();
+    const std::size_t sublattice_count = layout.sublattice_count();
+
+    std::vector<std::pair<std::size_t,std::size_t>> candidates;
+    for ( std::size_t first = 0; first < sublattice_count; ++first ) {
+        if ( layout.species_count ( first ) < 2 ) continue; // nothing to exchange
+        for ( std::size_t second = first+1; second < sublattice_count; ++second ) {
+            if ( interchangeable ( layout, first, second ) ) candidates.emplace_back ( first, second );
+        }
+    }
+    if ( candidates.empty() ) return SublatticeSymmetry();
+
+    // Interior points with different site fractions in every sublattice, fixed so that results are reproducible;
+    // then the same points with each candidate pair exchanged
+    std::vector<double> points ( test_points * ( 1 + candidates.size() ) * dimension );
+    for ( std::size_t point = 0; point < test_points; ++point ) {
+        double* const x = &points[point * dimension];
+        for ( std::size_t sublattice = 0; sublattice < sublattice_count; ++sublattice ) {
+            double sum = 0;
+            for ( std::size_t i = layout.sublattice_begin ( sublattice ); i < layout.sublattice_end ( sublattice ); ++i ) {
+                x[i] = 1 + 0.5 * std::sin ( 1.0 + i + 0.7 * point * dimension );
+                sum += x[i];
+            }
+            for ( std::size_t i = layout.sublattice_begin ( sublattice ); i < layout.sublattice_end ( sublattice ); ++i ) {
+                x[i] /= sum;
+            }
+        }
+    }
+    for ( std::size_t pair = 0; pair < candidates.size(); ++pair ) {
+        const std::size_t first = candidates[pair].first, second = candidates[pair].second;
+        for ( std::size_t point = 0; point < test_points; ++point ) {
+            double* const x = &points[ ( ( pair+1 ) * test_points + point ) * dimension];
+            std::copy ( &points[point * dimension], &points[ ( point+1 ) * dimension], x );
+            std::swap_ranges ( x + layout.sublattice_begin ( first ), x + layout.sublattice_end ( first ), x + layout.sublattice_begin ( second ) );
+        }
+    }
+    std::vector<double> energies ( points.size() / dimension );
+    phase.evaluate_objective_batch ( conditions, &points[0], energies.size(), &energies[0] );
+
+    // Equivalent pairs joined into groups
+    std::vector<std::size_t> root ( sublattice_count );
+    std::iota ( root.begin(), root.end(), std::size_t ( 0 ) );
+    auto find_root = [&root] ( std::size_t sublattice ) {
+        while ( root[sublattice] != sublattice ) sublattice = root[sublattice];
+        return sublattice;
+    };
+    for ( std::size_t pair = 0; pair < candidates.size(); ++pair ) {
+        bool symmetric = true;
+        for ( std::size_t point = 0; point < test_points && symmetric; ++point ) {
+            const double energy = energies[point], exchanged = energies[ ( pair+1 ) * test_points + point];
+            symmetric = std::fabs ( energy - exchanged ) <= tolerance * std::max ( 1.0, std::fabs ( energy ) );
+        }
+        if ( !symmetric ) continue;
+        const std::size_t first = find_root ( candidates[pair].first ), second = find_root ( candidates[pair].second );
+        root[std::max ( first, second )] = std::min ( first, second );
+    }
+    std::vector<std::vector<std::size_t>> groups;
+    std::vector<std::size_t> group_of_root ( sublattice_count, sublattice_count );
+    for ( std::size_t sublattice = 0; sublattice < sublattice_count; ++sublattice ) {
+        const std::size_t group_root = find_root ( sublattice );
+        if ( group_root == sublattice ) continue;
+        if ( group_of_root[group_root] == sublattice_count ) {
+            group_of_root[group_root] = groups.size();
+            groups.emplace_back ( 1, group_root );
+        }
+        groups[group_of_root[group_root]].push_back ( sublattice );
+    }
+    SublatticeSymmetry symmetry ( layout, std::move ( groups ) );
+    BOOST_LOG_SEV ( opt_log, debug ) << phase.name() << ": " << symmetry.groups().size() << " groups of equivalent sublattices, "
+                                     << symmetry.order() << " permutations";
+    return symmetry;
+}
+
+std::size_t SublatticeSymmetry::images ( double const* const point, std::vector<double> &out ) const
+{
+    const std::size_t first_image = out.size();
+    std::vector<std::vector<std::size_t>> permutations ( sublattice_groups.size() ); // position in each group -> source position
+    for ( std::size_t group = 0; group < sublattice_groups.size(); ++group ) {
+        permutations[group].resize ( sublattice_groups[group].size() );
+        std::iota ( permutations[group].begin(), permutations[group].end(), std::size_t ( 0 ) );
+    }
+    std::vector<double> image ( point, point + coordinate_count );
+    std::size_t count = 0;
+    while ( true ) {
+        for ( std::size_t group = 0; group < sublattice_groups.size(); ++group ) {
+            const std::vector<std::size_t> &members = sublattice_groups[group];
+            for ( std::size_t i = 0; i < members.size(); ++i ) {
+                const std::size_t source = members[permutations[group][i]];
+                std::copy ( point + block_begin[source], point + block_begin[source] + block_length[source], &image[block_begin[members[i]]] );
+            }
+        }
+        bool seen = false;
+        for ( std::size_t i = 0; i < count && !seen; ++i ) {
+            seen = std::equal ( image.begin(), image.end(), out.begin() + first_image + i * coordinate_count );
+        }
+        if ( !seen ) {
+            out.insert ( out.end(), image.begin(), image.end() );
+            ++count;
+        }
+        // The next combination of permutations, the last group fastest
+        std::size_t group = sublattice_groups.size();
+        while ( group > 0 && !std::next_permutation ( permutations[group-1].begin(), permutations[group-1].end() ) ) --group;
+        if ( group == 0 ) break;
+    }
+    return count;
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,166 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Placement of worker threads on the CPUs and NUMA nodes of the machine
+
+#include "libgibbs/include/libgibbs_pch.hpp"
+#include "libgibbs/include/utils/worker_placement.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+#ifdef __linux__
+// CPUs of a list such as "0-15,32-47"
+std::vector<int> parse_cpu_list ( const std::string &list )
+{
+    std::vector<int> cpus;
+    std::stringstream stream ( list );
+    std::string item;
+    while ( std::getline ( stream, item, ',' ) ) {
+        if ( item.empty() || item == "\n" ) continue;
+        const std::size_t dash = item.find ( '-' );
+        const int first = std::stoi ( item.substr ( 0, dash ) );
+        const int last = dash == std::string::npos ? first : std::stoi ( item.substr ( dash + 1 ) );
+        for ( int cpu = first; cpu <= last; ++cpu ) cpus.push_back ( cpu );
+    }
+    return cpus;
+}
+#endif
+}
+
+CpuTopology CpuTopology::detect()
+{
+    CpuTopology topology;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO ( &allowed );
+    const bool have_mask = sched_getaffinity ( 0, sizeof ( allowed ), &allowed ) == 0;
+    for ( int node = 0; ; ++node ) {
+        std::ifstream file ( "/sys/devices/system/node/node" + std::to_string ( node ) + "/cpulist" );
+        if ( !file ) break; // nodes are numbered without gaps
+        std::string list;
+        std::getline ( file, list );
+        std::vector<int> cpus;
+        try {
+            cpus = parse_cpu_list ( list );
+        }
+        catch ( std::exception & ) {
+            cpus.clear(); // malformed; treated as if the node had no CPUs for us
+        }
+        std::vector<int> usable;
+        for ( auto cpu = cpus.cbegin(); cpu != cpus.cend(); ++cpu ) {
+            if ( !have_mask || ( *cpu < CPU_SETSIZE && CPU_ISSET ( *cpu, &allowed ) ) ) usable.push_back ( *cpu );
+        }
+        if ( !usable.empty() ) topology.nodes.push_back ( std::move ( usable ) );
+    }
+    if ( topology.nodes.empty() && have_mask ) {
+        std::vector<int> cpus;
+        for ( int cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+            if ( CPU_ISSET ( cpu, &allowed ) ) cpus.push_back ( cpu );
+        }
+        if ( !cpus.empty() ) topology.nodes.push_back ( std::move ( cpus ) );
+    }
+#endif
+    if ( topology.nodes.empty() ) {
+        std::vector<int> cpus ( std::max ( std::thread::hardware_concurrency(), 1u ) );
+        for ( std::size_t cpu = 0; cpu < cpus.size(); ++cpu ) cpus[cpu] = static_cast<int> ( cpu );
+        topology.nodes.push_back ( std::move ( cpus ) );
+    }
+    return topology;
+}
+
+std::size_t CpuTopology::cpu_count() const
+{
+    std::size_t count = 0;
+    for ( auto i = nodes.cbegin(); i != nodes.cend(); ++i ) count += i->size();
+    return count;
+}
+
+WorkerPlacement::WorkerPlacement ( const CpuTopology &topology, const std::size_t workers, const bool pin_workers ) :
+    nodes ( topology.node_count() ), worker_nodes ( workers ), worker_cpus ( workers ), pin ( pin_workers )
+{
+    std::vector<std::size_t> used ( nodes, 0 );
+    std::size_t node = 0;
+    for ( std::size_t worker = 0; worker < workers; ++worker ) {
+        // The next node with a free CPU; once all are taken, CPUs are reused in the same order
+        std::size_t tries = 0;
+        while ( used[node] >= topology.node_cpus ( node ).size() && tries < nodes ) {
+            node = ( node + 1 ) % nodes;
+            ++tries;
+        }
+        if ( tries == nodes ) std::fill ( used.begin(), used.end(), 0 );
+        const std::vector<int> &cpus = topology.node_cpus ( node );
+        worker_nodes[worker] = node;
+        worker_cpus[worker] = cpus[used[node] % cpus.size()];
+        ++used[node];
+        node = ( node + 1 ) % nodes;
+    }
+}
+
+std::size_t WorkerPlacement::node_workers ( const std::size_t node ) const
+{
+    return std::count ( worker_nodes.begin(), worker_nodes.end(), node );
+}
+
+bool WorkerPlacement::enter ( const std::size_t worker ) const
+{
+    if ( !pin ) return true;
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO ( &cpus );
+    CPU_SET ( worker_cpus[worker], &cpus );
+    return pthread_setaffinity_np ( pthread_self(), sizeof ( cpus ), &cpus ) == 0;
+#else
+    return false;
+#endif
+}
+
+NodeLocalClaims::NodeLocalClaims ( const std::size_t size, const WorkerPlacement &placement, const std::size_t granularity ) :
+    nodes ( placement.node_count() ), ranges ( new Range[placement.node_count()] )
+{
+    const std::size_t step = std::max ( granularity, std::size_t ( 1 ) );
+    std::size_t workers = 0;
+    for ( std::size_t node = 0; node < nodes; ++node ) workers += placement.node_workers ( node );
+    std::size_t begin = 0;
+    std::size_t workers_before = 0;
+    for ( std::size_t node = 0; node < nodes; ++node ) {
+        workers_before += placement.node_workers ( node );
+        // Split at the share of the workers up to this node, rounded to whole rows
+        std::size_t end = workers > 0 ? size * workers_before / workers : ( node + 1 == nodes ? size : 0 );
+        end = std::min ( ( end + step / 2 ) / step * step, size );
+        if ( node + 1 == nodes ) end = size;
+        end = std::max ( end, begin );
+        ranges[node].next = begin;
+        ranges[node].end = end;
+        begin = end;
+    }
+}
+
+bool NodeLocalClaims::claim ( const std::size_t node, std::size_t &index )
+{
+    for ( std::size_t distance = 0; distance < nodes; ++distance ) {
+        // Own node first, then alternately above and below it
+        const std::size_t offset = ( distance + 1 ) / 2;
+        const std::size_t other = distance % 2 == 1 ? ( node + offset ) % nodes : ( node + nodes - offset ) % nodes;
+        Range &range = ranges[other];
+        if ( range.next.load() >= range.end ) continue;
+        const std::size_t claimed = range.next++;
+        if ( claimed < range.end ) {
+            index = claimed;
+            return true;
+        }
+    }
+    return false;
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs on;
@@ -0,0 +1,180 @@
+/*=============================================================================
+ Copyright (c) 2012-2014 Richard Otis
+
+ Distributed under the Boost Software License, Version 1.0. (See accompanying
+ file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ =============================================================================*/
+
+// Checks of LowerConvexHull against hulls known in advance
+
+#define BOOST_TEST_MODULE LowerConvexHull
+#include "libgibbs/include/optimizer/utils/lower_convex_hull.hpp"
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+using Optimizer::details::LowerConvexHull;
+using Optimizer::details::PointCloud;
+
+namespace {
+PointCloud<double> make_points ( const std::vector<std::vector<double>> &coordinates )
+{
+    PointCloud<double> result ( coordinates.front().size() );
+    for ( const std::vector<double> &point : coordinates ) result.push_back ( point );
+    return result;
+}
+
+std::set<std::size_t> lower_vertices ( const LowerConvexHull &hull )
+{
+    std::set<std::size_t> result;
+    for ( const LowerConvexHull::Facet &facet : hull.lower_facets() ) {
+        result.insert ( facet.vertices.begin(), facet.vertices.end() );
+    }
+    return result;
+}
+
+// Area of the lower facets projected onto the composition space
+double projected_area ( const LowerConvexHull &hull )
+{
+    double result = 0;
+    for ( const LowerConvexHull::Facet &facet : hull.lower_facets() ) {
+        result += hull.facet_area ( facet ) * std::fabs ( facet.normal.back() );
+    }
+    return result;
+}
+
+// No point may be below the plane of a lower facet
+void check_points_above_facets ( const LowerConvexHull &hull )
+{
+    for ( const LowerConvexHull::Facet &facet : hull.lower_facets() ) {
+        for ( std::size_t point_id = 0; point_id < hull.point_count(); ++point_id ) {
+            const LowerConvexHull::PointType point = hull.reduced_point ( point_id );
+            double distance = facet.offset;
+            for ( std::size_t dim = 0; dim < point.size(); ++dim ) distance += facet.normal[dim] * point[dim];
+            BOOST_CHECK_LE ( distance, 1e-9 );
+        }
+    }
+}
+}
+
+BOOST_AUTO_TEST_CASE ( square_with_interior_point )
+{
+    LowerConvexHull hull ( 2 );
+    hull.add_points ( make_points ( { { 0, 0 }, { 1, 0 }, { 0.5, 0.5 }, { 0, 1 }, { 1, 1 } } ) );
+    BOOST_REQUIRE ( hull.full_dimensional() );
+    const std::vector<LowerConvexHull::Facet> facets = hull.lower_facets();
+    BOOST_REQUIRE_EQUAL ( facets.size(), 1u );
+    BOOST_CHECK ( lower_vertices ( hull ) == ( std::set<std::size_t> { 0, 1 } ) );
+    BOOST_CHECK_CLOSE ( facets.front().normal.back(), -1.0, 1e-9 );
+    BOOST_CHECK_SMALL ( facets.front().offset, 1e-12 );
+}
+
+BOOST_AUTO_TEST_CASE ( cube_with_interior_point )
+{
+    LowerConvexHull hull ( 3 );
+    std::vector<std::vector<double>> coordinates { { 0.5, 0.5, 0.5 } };
+    for ( int corner = 0; corner < 8; ++corner ) {
+        coordinates.push_back ( { double ( corner & 1 ), double ( ( corner >> 1 ) & 1 ), double ( ( corner >> 2 ) & 1 ) } );
+    }
+    hull.add_points ( make_points ( coordinates ) );
+    BOOST_CHECK_EQUAL ( hull.lower_facets().size(), 2u );
+    BOOST_CHECK ( lower_vertices ( hull ) == ( std::set<std::size_t> { 1, 2, 3, 4 } ) );
+    BOOST_CHECK_CLOSE ( projected_area ( hull ), 1.0, 1e-9 );
+}
+
+BOOST_AUTO_TEST_CASE ( duplicate_and_coplanar_points )
+{
+    // A flat 5x5 grid with every point twice, and the corners once more in a second batch
+    std::vector<std::vector<double>> coordinates;
+    for ( int copy = 0; copy < 2; ++copy ) {
+        for ( int i = 0; i <= 4; ++i ) {
+            for ( int j = 0; j <= 4; ++j ) coordinates.push_back ( { i / 4.0, j / 4.0, 0 } );
+        }
+    }
+    coordinates.push_back ( { 0.5, 0.5, 1 } );
+    LowerConvexHull hull ( 3 );
+    hull.add_points ( make_points ( coordinates ) );
+    hull.add_points ( make_points ( { { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 }, { 0.5, 0.5, 0 } } ) );
+    BOOST_REQUIRE ( hull.full_dimensional() );
+    for ( const LowerConvexHull::Facet &facet : hull.lower_facets() ) {
+        BOOST_CHECK_CLOSE ( facet.normal.back(), -1.0, 1e-9 );
+        BOOST_CHECK_GT ( hull.facet_area ( facet ), 0 );
+    }
+    BOOST_CHECK_CLOSE ( projected_area ( hull ), 1.0, 1e-9 );
+    check_points_above_facets ( hull );
+}
+
+BOOST_AUTO_TEST_CASE ( coplanar_points_only )
+{
+    // Points that do not span the space give no facets until one that does is added
+    LowerConvexHull hull ( 3 );
+    hull.add_points ( make_points ( { { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 }, { 0.5, 0.5, 0 } } ) );
+    BOOST_CHECK ( !hull.full_dimensional() );
+    BOOST_CHECK ( hull.lower_facets().empty() );
+    hull.add_points ( make_points ( { { 0.5, 0.5, 1 } } ) );
+    BOOST_REQUIRE ( hull.full_dimensional() );
+    BOOST_CHECK_CLOSE ( projected_area ( hull ), 1.0, 1e-9 );
+}
+
+BOOST_AUTO_TEST_CASE ( lower_only_binary )
+{
+    // A double well: the point between the wells and the one above it are not on the lower hull
+    LowerConvexHull hull ( 2, std::set<std::size_t>(), true );
+    hull.add_points ( make_points ( { { 0, 0 }, { 0.25, -1 }, { 0.5, 0.5 }, { 0.75, -1 }, { 1, 0 }, { 0.5, 10 } } ) );
+    BOOST_CHECK_EQUAL ( hull.lower_facets().size(), 3u );
+    BOOST_CHECK ( lower_vertices ( hull ) == ( std::set<std::size_t> { 0, 1, 3, 4 } ) );
+    BOOST_CHECK_CLOSE ( projected_area ( hull ), 1.0, 1e-9 );
+    check_points_above_facets ( hull );
+}
+
+BOOST_AUTO_TEST_CASE ( lower_only_binary_dependent_fraction )
+{
+    // Site fractions (y_A, y_B, energy), with y_B dropped as dependent
+    LowerConvexHull hull ( 3, std::set<std::size_t> { 1 }, true );
+    hull.add_points ( make_points ( { { 1, 0, 0 }, { 0.75, 0.25, -1 }, { 0.5, 0.5, 0.5 }, { 0.25, 0.75, -1 }, { 0, 1, 0 } } ) );
+    BOOST_CHECK_EQUAL ( hull.dimension(), 2u );
+    BOOST_CHECK ( lower_vertices ( hull ) == ( std::set<std::size_t> { 0, 1, 3, 4 } ) );
+}
+
+BOOST_AUTO_TEST_CASE ( lower_only_ternary )
+{
+    // A convex energy surface over the unit square: every sampled point is on the lower hull,
+    // and a point above it is not; the points come in batches, as from the sampler
+    LowerConvexHull hull ( 3, std::set<std::size_t>(), true );
+    std::vector<std::vector<double>> batch;
+    for ( int i = 0; i <= 10; ++i ) {
+        for ( int j = 0; j <= 10; ++j ) {
+            const double x = i / 10.0, y = j / 10.0;
+            batch.push_back ( { x, y, ( x - 0.3 ) * ( x - 0.3 ) + ( y - 0.6 ) * ( y - 0.6 ) } );
+        }
+        hull.add_points ( make_points ( batch ) );
+        batch.clear();
+    }
+    hull.add_points ( make_points ( { { 0.5, 0.5, 1 } } ) );
+    const std::set<std::size_t> vertices = lower_vertices ( hull );
+    BOOST_CHECK_EQUAL ( vertices.size(), 121u );
+    BOOST_CHECK ( vertices.find ( 121 ) == vertices.end() );
+    BOOST_CHECK_CLOSE ( projected_area ( hull ), 1.0, 1e-9 );
+    check_points_above_facets ( hull );
+}
+
+BOOST_AUTO_TEST_CASE ( lower_only_random_batches )
+{
+    // Random points in many batches, so that most are found by walking from the last facets
+    std::srand ( 1769 );
+    LowerConvexHull hull ( 3, std::set<std::size_t>(), true );
+    hull.add_points ( make_points ( { { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 } } ) );
+    for ( int batch = 0; batch < 20; ++batch ) {
+        std::vector<std::vector<double>> coordinates;
+        for ( int i = 0; i < 50; ++i ) {
+            const double x = std::rand() / double ( RAND_MAX ), y = std::rand() / double ( RAND_MAX );
+            coordinates.push_back ( { x, y, std::sin ( 7 * x ) * std::cos ( 5 * y ) - std::rand() / double ( RAND_MAX ) } );
+        }
+        hull.add_points ( make_points ( coordinates ) );
+    }
+    BOOST_CHECK_CLOSE ( projected_area ( hull ), 1.0, 1e-9 );
+    check_points_above_facets ( hull );
+}
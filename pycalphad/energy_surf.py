@@ -6,6 +6,8 @@ energy surface of a system.
 from __future__ import division
 from pycalphad import Model
 from pycalphad.minimize import make_callable, point_sample
+from pycalphad.io.columns import ColumnWriter, read_columns
+from pycalphad.libgibbs import CompiledPhase, CompiledModel
 import pycalphad.variables as v
 import pandas as pd
 import numpy as np
@@ -15,7 +17,8 @@ except NameError:
     from sets import Set as set #pylint: disable=W0622
 
 def energy_surf(db, comps, phases,
-                points_per_phase=10000, ast='numpy', **kwargs):
+                points_per_phase=10000, ast='numpy', output=None,
+                tdb_path=None, **kwargs):
     """
     Calculate the energy surface of a system containing the specified
     components and phases. Model parameters are taken from 'db' and any
@@ -30,12 +33,23 @@ def energy_surf(db, comps, phases,
         Names (case-sensitive) of phases to consider in the calculation.
     points_per_phase : int, optional
         Approximate number of points to sample per phase.
-    ast : ['numpy'], optional
+    ast : ['numpy', 'libgibbs'], optional
         Specify how we should construct the callable for the energy.
+        'libgibbs' compiles the Model with libgibbs and evaluates all
+        points of a phase in one call. See pycalphad.libgibbs.
+    output : str, optional
+        Directory of a column store to stream the points to, one phase at
+        a time, instead of building a DataFrame.
+        See pycalphad.io.columns.
+    tdb_path : str, optional
+        Path of the TDB file db was read from. If given, energies are
+        evaluated in place by the compiled models of libgibbs instead of
+        the callables built by `ast`. See pycalphad.libgibbs.
 
     Returns
     -------
-    DataFrame of the energy surface.
+    DataFrame of the energy surface; if output is given, a dict of its
+    memory-mapped columns, as returned by read_columns().
 
     Examples
     --------
@@ -52,29 +66,63 @@ def energy_surf(db, comps, phases,
     # Consider only the active phases
     active_phases = dict((name, db.phases[name]) for name in phases)
     comp_sets = {}
-    # Construct a dataframe to hold all the data
-    all_phases_df = pd.DataFrame()
+    # Construct an ordered list of the variables of each phase
+    phase_variables = {}
+    phase_sublattice_dof = {}
     for phase_name, phase_obj in active_phases.items():
-        # Build the symbolic representation of the energy
-        mod = Model(db, comps, phase_name)
-        # Construct an ordered list of the variables
         variables = []
         sublattice_dof = []
         for idx, sublattice in enumerate(phase_obj.constituents):
             dof = 0
-            for component in set(sublattice).intersection(active_comps):
+            # Sorted, as libgibbs orders the site fractions
+            for component in \
+                    sorted(set(sublattice).intersection(active_comps)):
                 variables.append(v.SiteFraction(phase_name, idx, component))
                 dof += 1
             sublattice_dof.append(dof)
-
-        # Build the "fast" representation of that model
-        comp_sets[phase_name] = make_callable(mod.ast, \
-            list(statevars.keys()) + variables, mode=ast)
-
-        # Make user-friendly site fraction column labels
-        var_names = ['Y('+variable.phase_name+',' + \
-                str(variable.sublattice_index) + ',' + variable.species +')' \
-                for variable in variables]
+        phase_variables[phase_name] = variables
+        phase_sublattice_dof[phase_name] = sublattice_dof
+    # Make user-friendly site fraction column labels
+    var_names = dict((phase_name, ['Y('+variable.phase_name+',' + \
+            str(variable.sublattice_index) + ',' + variable.species +')' \
+            for variable in variables]) \
+        for (phase_name, variables) in phase_variables.items())
+    writer = None
+    if output is not None:
+        # The columns of all phases must be known before the first row
+        columns = list(kwargs.keys()) + ['GM'] + \
+            ['X('+comp+')' for comp in sorted(comps) if comp != 'VA']
+        for phase_name in sorted(var_names.keys()):
+            columns.extend(var_names[phase_name])
+        writer = ColumnWriter(output, columns, ['Phase'])
+    # Per-phase DataFrames, merged once at the end
+    phase_dfs = []
+    # Whether energies are evaluated by libgibbs, all points at once
+    compiled = tdb_path is not None or ast == 'libgibbs'
+    for phase_name, phase_obj in active_phases.items():
+        variables = phase_variables[phase_name]
+        sublattice_dof = phase_sublattice_dof[phase_name]
+
+        if tdb_path is not None:
+            comp_sets[phase_name] = CompiledPhase(tdb_path, comps, phase_name)
+            # The points are laid out and labelled in the order of variables;
+            # libgibbs' parser must agree, or energies go to the wrong points
+            compiled_names = \
+                [str(x) for x in comp_sets[phase_name].variables]
+            if compiled_names != [str(x) for x in variables]:
+                raise ValueError('libgibbs site fractions of ' + phase_name +
+                                 ' ' + str(compiled_names) + ' differ from ' +
+                                 str([str(x) for x in variables]))
+        elif ast == 'libgibbs':
+            # The SymPy expression is compiled as it is; no second TDB parse
+            comp_sets[phase_name] = \
+                CompiledModel(Model(db, comps, phase_name), variables)
+        else:
+            # Build the symbolic representation of the energy
+            mod = Model(db, comps, phase_name)
+            # Build the "fast" representation of that model
+            comp_sets[phase_name] = make_callable(mod.ast, \
+                list(statevars.keys()) + variables, mode=ast)
 
         # Calculate the number of components in each sublattice
         nontrivial_sublattices = len(sublattice_dof) - sublattice_dof.count(1)
@@ -102,13 +150,17 @@ def energy_surf(db, comps, phases,
 
         site_ratios = [c/site_ratio_normalization for c in site_ratios]
 
-        # TODO: not very efficient point sampling strategy
-        # in principle, this could be parallelized
-        for idx, point in enumerate(points):
-            energies[idx] = \
-                comp_sets[phase_name](
-                    *(list(statevars.values()) + list(point))
-                )
+        if compiled:
+            # All points at once, on all cores, without copying
+            comp_sets[phase_name].energies(points, kwargs['T'], \
+                kwargs.get('P', 101325), out=energies)
+        else:
+            # TODO: not very efficient point sampling strategy
+            for idx, point in enumerate(points):
+                energies[idx] = \
+                    comp_sets[phase_name](
+                        *(list(statevars.values()) + list(point))
+                    )
 
         # Add points and calculated energies to the DataFrame
         data_dict = {'GM':energies, 'Phase':phase_name}
@@ -120,7 +172,7 @@ def energy_surf(db, comps, phases,
             data_dict['X('+comp+')'] = [0 for n in range(len(points))]
 
         for column_idx, data in enumerate(points.T):
-            data_dict[var_names[column_idx]] = data
+            data_dict[var_names[phase_name][column_idx]] = data
 
         # Now map the internal degrees of freedom to global coordinates
         for p_idx, p in enumerate(points):
@@ -131,11 +183,21 @@ def energy_surf(db, comps, phases,
                 ratio = site_ratios[cur_var.sublattice_index]
                 data_dict['X('+cur_var.species+')'][p_idx] += ratio*coordinate
 
-        phase_df = pd.DataFrame(data_dict)
-        # Merge dataframe into master dataframe
-        # TODO: Better way to do this than concat (always copies)?
-        all_phases_df = \
-            pd.concat([all_phases_df, phase_df], axis=0, join='outer', \
-                        ignore_index=True)
-    # all_phases_df now contains energy surface information for the system
+        if writer is not None:
+            # Site fractions of the other phases are undefined here
+            for column in writer.value_columns:
+                data_dict.setdefault(column, np.nan)
+            writer.append_many(data_dict, {'Phase': data_dict.pop('Phase')})
+            continue
+        phase_dfs.append(pd.DataFrame(data_dict))
+    if writer is not None:
+        writer.close()
+        return read_columns(output)
+    # Merge once: concatenating inside the loop copied every earlier phase
+    # all_phases_df contains energy surface information for the system
+    # pd.concat() refuses an empty list, e.g., when no phases are given
+    if len(phase_dfs) == 0:
+        return pd.DataFrame()
+    all_phases_df = pd.concat(phase_dfs, axis=0, join='outer', \
+                              ignore_index=True)
     return all_phases_df
@@ -77,16 +77,17 @@ class Equilibrium(object):
 
         self._build_objective_functions(dbf, ast)
 
+        phase_dfs = []
         for phase_obj in [dbf.phases[name] for name in phases]:
             data_dict = \
                 self._calculate_energy_surface(phase_obj, points_per_phase)
 
-            phase_df = pd.DataFrame(data_dict)
             # TODO: Apply phase-specific conditions
-            # Merge dataframe into master dataframe
-            self.data = \
-                pd.concat([self.data, phase_df], axis=0, join='outer', \
-                            ignore_index=True)
+            phase_dfs.append(pd.DataFrame(data_dict))
+        # Merge into master dataframe once; a concat per phase copies
+        # every earlier phase again
+        self.data = pd.concat(phase_dfs, axis=0, join='outer', \
+                              ignore_index=True)
         # self.data now contains energy surface information for the system
         # find simplex for a starting point; refine with optimization
         estimates = self.get_starting_simplex()
@@ -0,0 +1,206 @@
+"""The columns module reads and writes column stores: directories with one
+flat file per column, written row by row as results are produced and read
+back by memory-mapping, so that no result set has to fit in memory at once.
+The format is the one written by libgibbs' ColumnWriter.
+
+A column store holds
+  - columns.txt: the line "libgibbs columns 1", then one line
+    "file<TAB>type<TAB>name" per column, type being 'float64' or 'label';
+  - N.f64 for a float64 column: little-endian doubles;
+  - N.u32 for a label column: little-endian uint32 codes, and N.labels:
+    the label of each code, one per line.
+"""
+import os
+import numpy as np
+import pandas as pd
+
+COLUMN_FORMAT = 'libgibbs columns 1'
+MANIFEST = 'columns.txt'
+
+class ColumnWriter(object):
+    """
+    Append rows to a new column store.
+    Rows are buffered and written `chunk_rows` at a time, or by flush().
+
+    Parameters
+    ----------
+    directory : str
+        Path of the column store; created if missing.
+        Column files already in it are overwritten.
+    value_columns : list
+        Names of the float64 columns.
+    label_columns : list, optional
+        Names of the label columns, e.g., 'Phase'.
+    chunk_rows : int, optional
+        Number of rows to buffer before writing.
+
+    Examples
+    --------
+    >>> with ColumnWriter('surf', ['T', 'GM'], ['Phase']) as writer:
+    ...     writer.append_many({'T': temps, 'GM': energies},
+    ...                        {'Phase': 'FCC_A1'})
+    """
+    def __init__(self, directory, value_columns, label_columns=(),
+                 chunk_rows=65536):
+        if not os.path.isdir(directory):
+            os.makedirs(directory)
+        self.directory = directory
+        self.value_columns = list(value_columns)
+        self.label_columns = list(label_columns)
+        self.chunk_rows = max(int(chunk_rows), 1)
+        self.rows = 0
+        self._value_files = []
+        self._code_files = []
+        self._label_files = []
+        self._dictionaries = [dict() for _ in self.label_columns]
+        self._value_buffers = [[] for _ in self.value_columns]
+        self._code_buffers = [[] for _ in self.label_columns]
+        self._buffered_rows = 0
+        manifest = [COLUMN_FORMAT]
+        for name in self.value_columns + self.label_columns:
+            if '\t' in name or '\n' in name:
+                raise ValueError('Column names may not contain tabs '
+                                 'or newlines: ' + repr(name))
+        file_id = 0
+        for name in self.value_columns:
+            file_name = str(file_id) + '.f64'
+            self._value_files.append(open(self._path(file_name), 'wb'))
+            manifest.append(file_name + '\tfloat64\t' + name)
+            file_id += 1
+        for name in self.label_columns:
+            file_name = str(file_id) + '.u32'
+            self._code_files.append(open(self._path(file_name), 'wb'))
+            self._label_files.append(
+                open(self._path(str(file_id) + '.labels'), 'wb'))
+            manifest.append(file_name + '\tlabel\t' + name)
+            file_id += 1
+        # The manifest is written last, so a reader never finds one
+        # without its files
+        with open(self._path(MANIFEST), 'wb') as manifest_file:
+            manifest_file.write(('\n'.join(manifest) + '\n').encode('utf-8'))
+
+    def _path(self, file_name):
+        "Path of a file of the store."
+        return os.path.join(self.directory, file_name)
+
+    def _code(self, column_idx, label):
+        "Code of a label, adding it to the dictionary of its column."
+        dictionary = self._dictionaries[column_idx]
+        code = dictionary.get(label, None)
+        if code is None:
+            if '\n' in label:
+                raise ValueError('Labels may not contain newlines: ' + \
+                                 repr(label))
+            code = len(dictionary)
+            dictionary[label] = code
+            self._label_files[column_idx].write((label + '\n').encode('utf-8'))
+        return code
+
+    def append_many(self, values, labels=None):
+        """
+        Append a block of rows.
+
+        Parameters
+        ----------
+        values : dict
+            Array-like of equal length for each value column, or a scalar
+            to repeat in every row.
+        labels : dict, optional
+            Label, or list of labels, for each label column.
+        """
+        labels = labels or dict()
+        lengths = [np.size(values[name]) for name in self.value_columns \
+            if np.ndim(values[name]) > 0]
+        lengths += [len(labels[name]) for name in self.label_columns \
+            if np.ndim(labels[name]) > 0]
+        num_rows = lengths[0] if len(lengths) > 0 else 1
+        if any(length != num_rows for length in lengths):
+            raise ValueError('Columns of a block must have equal lengths')
+        for idx, name in enumerate(self.value_columns):
+            column = np.asarray(values[name], dtype='<f8')
+            self._value_buffers[idx].append(
+                np.broadcast_to(column, (num_rows,)).copy())
+        for idx, name in enumerate(self.label_columns):
+            label = labels[name]
+            if np.ndim(label) == 0:
+                codes = np.full(num_rows, self._code(idx, label), dtype='<u4')
+            else:
+                codes = np.array([self._code(idx, x) for x in label],
+                                 dtype='<u4')
+            self._code_buffers[idx].append(codes)
+        self.rows += num_rows
+        self._buffered_rows += num_rows
+        if self._buffered_rows >= self.chunk_rows:
+            self.flush()
+
+    def append(self, values, labels=None):
+        "Append one row; see append_many()."
+        self.append_many(values, labels)
+
+    def flush(self):
+        "Write the buffered rows."
+        # Labels go out before the codes that refer to them
+        for label_file in self._label_files:
+            label_file.flush()
+        for buffers, files in ((self._value_buffers, self._value_files),
+                               (self._code_buffers, self._code_files)):
+            for buf, column_file in zip(buffers, files):
+                for block in buf:
+                    column_file.write(block.tobytes())
+                column_file.flush()
+                del buf[:]
+        self._buffered_rows = 0
+
+    def close(self):
+        "Flush and close all files."
+        self.flush()
+        for column_file in self._value_files + self._code_files + \
+                self._label_files:
+            column_file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+def read_columns(directory):
+    """
+    Memory-map a column store. Rows written but not flushed are not seen.
+
+    Parameters
+    ----------
+    directory : str
+        Path of the column store.
+
+    Returns
+    -------
+    dict of column name to array: read-only memory maps for float64
+    columns, pandas Categoricals (codes memory-mapped) for label columns.
+    """
+    with open(os.path.join(directory, MANIFEST), 'rb') as manifest_file:
+        # Only '\n' ends a line; str.splitlines() would also split at '\r',
+        # '\x0c', '\u2028' and others, which names and labels may contain
+        lines = manifest_file.read().decode('utf-8').split('\n')[:-1]
+    if len(lines) == 0 or lines[0] != COLUMN_FORMAT:
+        raise ValueError(directory + ' is not a column store')
+    columns = [line.split('\t', 2) for line in lines[1:] if line]
+    # A writer may be flushing; take the rows all columns have
+    sizes = {'float64': 8, 'label': 4}
+    num_rows = min([os.path.getsize(os.path.join(directory, file_name)) // \
+        sizes[kind] for file_name, kind, _ in columns] or [0])
+    result = dict()
+    for file_name, kind, name in columns:
+        path = os.path.join(directory, file_name)
+        dtype = '<f8' if kind == 'float64' else '<u4'
+        if num_rows > 0:
+            data = np.memmap(path, dtype=dtype, mode='r', shape=(num_rows,))
+        else:
+            data = np.zeros(0, dtype=dtype)
+        if kind == 'label':
+            labels_path = os.path.splitext(path)[0] + '.labels'
+            with open(labels_path, 'rb') as labels_file:
+                labels = labels_file.read().decode('utf-8').split('\n')[:-1]
+            data = pd.Categorical.from_codes(data, labels)
+        result[name] = data
+    return result
@@ -0,0 +1,434 @@
+"""
+The libgibbs module evaluates phase energies with the compiled models of
+the libgibbs C++ library, through its C interface (phase_evaluator.hpp).
+CompiledPhase builds the models from a TDB file with libgibbs' own parser;
+CompiledModel compiles the SymPy expression of a pycalphad Model instead.
+Points and results are NumPy arrays that libgibbs reads and writes in
+place; the GIL is released while it runs.
+
+The shared library is found from the LIBGIBBS_LIBRARY environment
+variable, or else by its name, 'gibbs', on the library path.
+"""
+
+import ctypes
+import ctypes.util
+import os
+import struct
+import numpy as np
+from sympy import Add, Mul, Pow, Piecewise, And, Or, S, exp, log, Abs
+from sympy.core.relational import Relational
+import pycalphad.variables as v
+
+_ERROR_SIZE = 4096
+_LIBRARY = None
+
+def _library():
+    "Load libgibbs and declare its C interface, once."
+    global _LIBRARY #pylint: disable=W0603
+    if _LIBRARY is not None:
+        return _LIBRARY
+    path = os.environ.get('LIBGIBBS_LIBRARY', None) or \
+        ctypes.util.find_library('gibbs')
+    if path is None:
+        raise OSError('libgibbs not found; set LIBGIBBS_LIBRARY')
+    # CDLL (unlike PyDLL) releases the GIL for the duration of each call
+    lib = ctypes.CDLL(path)
+    size_t = ctypes.c_size_t
+    double_p = ctypes.POINTER(ctypes.c_double)
+    lib.libgibbs_phase_evaluator_create.restype = ctypes.c_void_p
+    lib.libgibbs_phase_evaluator_create.argtypes = \
+        [ctypes.c_char_p, ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p),
+         size_t, ctypes.c_char_p, size_t]
+    lib.libgibbs_phase_evaluator_destroy.restype = None
+    lib.libgibbs_phase_evaluator_destroy.argtypes = [ctypes.c_void_p]
+    lib.libgibbs_phase_evaluator_variable_count.restype = size_t
+    lib.libgibbs_phase_evaluator_variable_count.argtypes = [ctypes.c_void_p]
+    lib.libgibbs_phase_evaluator_sublattice.restype = size_t
+    lib.libgibbs_phase_evaluator_sublattice.argtypes = [ctypes.c_void_p, size_t]
+    lib.libgibbs_phase_evaluator_species.restype = ctypes.c_char_p
+    lib.libgibbs_phase_evaluator_species.argtypes = [ctypes.c_void_p, size_t]
+    lib.libgibbs_phase_evaluator_evaluate.restype = ctypes.c_int
+    lib.libgibbs_phase_evaluator_evaluate.argtypes = \
+        [ctypes.c_void_p, ctypes.c_double, ctypes.c_double, double_p, size_t,
+         size_t, double_p, double_p, size_t, ctypes.c_char_p, size_t]
+    lib.libgibbs_expression_evaluator_create.restype = ctypes.c_void_p
+    lib.libgibbs_expression_evaluator_create.argtypes = \
+        [ctypes.c_char_p, size_t, ctypes.POINTER(ctypes.c_char_p), size_t,
+         ctypes.c_char_p, size_t]
+    lib.libgibbs_expression_evaluator_destroy.restype = None
+    lib.libgibbs_expression_evaluator_destroy.argtypes = [ctypes.c_void_p]
+    lib.libgibbs_expression_evaluator_instruction_count.restype = size_t
+    lib.libgibbs_expression_evaluator_instruction_count.argtypes = \
+        [ctypes.c_void_p]
+    lib.libgibbs_expression_evaluator_evaluate.restype = ctypes.c_int
+    lib.libgibbs_expression_evaluator_evaluate.argtypes = \
+        [ctypes.c_void_p, ctypes.c_double, ctypes.c_double, double_p, size_t,
+         size_t, double_p, double_p, size_t, ctypes.c_char_p, size_t]
+    _LIBRARY = lib
+    return lib
+
+def _evaluate(function, handle, num_vars, points, T, P, out, gradients,
+              threads):
+    "Check the arrays of energies() and call an evaluate function on them."
+    points = np.asarray(points)
+    if points.ndim != 2 or points.shape[1] < num_vars or \
+            points.dtype != np.float64 or points.strides[1] != 8 or \
+            points.strides[0] % 8 != 0 or points.strides[0] < 0:
+        points = np.ascontiguousarray(points, dtype=np.float64)
+    num_points = points.shape[0]
+    if out is None:
+        out = np.empty(num_points)
+    if out.shape != (num_points,) or out.dtype != np.float64 or \
+            not out.flags['C_CONTIGUOUS']:
+        raise ValueError('out must be a contiguous float64 array of '
+                         'one energy per point')
+    gradients_p = None
+    if gradients is not None:
+        if gradients.shape != (num_points, num_vars) or \
+                gradients.dtype != np.float64 or \
+                not gradients.flags['C_CONTIGUOUS']:
+            raise ValueError('gradients must be a C-contiguous float64 '
+                             'array of shape (points, variables)')
+        gradients_p = gradients.ctypes.data_as(
+            ctypes.POINTER(ctypes.c_double))
+    error = ctypes.create_string_buffer(_ERROR_SIZE)
+    double_p = ctypes.POINTER(ctypes.c_double)
+    status = function(
+        handle, T, P, points.ctypes.data_as(double_p), num_points,
+        points.strides[0] // 8 if num_points > 0 else num_vars,
+        out.ctypes.data_as(double_p), gradients_p, threads, error,
+        _ERROR_SIZE)
+    if status != 0:
+        raise ValueError(error.value.decode('utf-8', 'replace'))
+    return out
+
+# Node tags of the AST serialization of libgibbs (ast_serialization.hpp)
+_DOUBLE_NODE = 3
+_STRING_NODE = 4
+_LIST_NODE = 6
+_MAX_DOUBLE = float(np.finfo(np.float64).max)
+_TINY_DOUBLE = float(np.finfo(np.float64).tiny)
+
+def _above(bound):
+    """
+    Smallest double greater than bound that libgibbs accepts as a constant,
+    which excludes subnormal numbers, e.g., the next double after 0.
+    """
+    above = float(np.nextafter(bound, np.inf))
+    if abs(above) < _TINY_DOUBLE:
+        return _TINY_DOUBLE if above > 0 else 0.0
+    return above
+
+class _ExpressionTranslator(object):
+    """
+    Translate a SymPy expression to the abstract syntax trees of libgibbs:
+    nested lists of an operator and its operands, floats, and strings
+    naming variables or symbols. Subexpressions that occur more than once
+    become symbols, '$0', '$1', ..., which libgibbs inlines where they are
+    named and compiles once.
+    """
+    def __init__(self, expr):
+        self.counts = {}
+        self.names = {}
+        self.symbols = {}
+        stack = [expr]
+        while stack:
+            node = stack.pop()
+            if node.is_Atom:
+                continue
+            count = self.counts.get(node, 0)
+            self.counts[node] = count + 1
+            if count == 0:
+                stack.extend(node.args)
+
+    def tree(self, node):
+        "Tree of node, or the name of its symbol if it is shared."
+        if node.is_Atom or self.counts.get(node, 0) < 2:
+            return self._translate(node)
+        name = self.names.get(node, None)
+        if name is None:
+            name = '$' + str(len(self.names))
+            self.names[node] = name
+            self.symbols[name] = self._translate(node)
+        return name
+
+    def _fold(self, operator, args):
+        "Balanced tree of a binary operator over args, to keep it shallow."
+        if len(args) == 1:
+            return self.tree(args[0])
+        half = len(args) // 2
+        return [operator, self._fold(operator, args[:half]),
+                self._fold(operator, args[half:])]
+
+    def _translate(self, node):
+        #pylint: disable=R0911
+        if node.is_number:
+            value = float(node)
+            if np.isnan(value) or np.isinf(value):
+                raise ValueError('Expression has a non-finite constant: ' +
+                                 str(node))
+            return value
+        if node.is_Symbol:
+            return str(node)
+        if isinstance(node, Add):
+            return self._fold('+', node.args)
+        if isinstance(node, Mul):
+            coeff, rest = node.as_coeff_Mul()
+            if coeff == -1:
+                return ['-', self.tree(rest)]
+            return self._fold('*', node.args)
+        if isinstance(node, Pow):
+            base, exponent = node.args
+            if exponent == -1:
+                return ['/', 1.0, self.tree(base)]
+            return ['**', self.tree(base), self.tree(exponent)]
+        if isinstance(node, log):
+            return ['LN', self.tree(node.args[0])]
+        if isinstance(node, exp):
+            return ['EXP', self.tree(node.args[0])]
+        if isinstance(node, Abs):
+            arg = self.tree(node.args[0])
+            return ['@', arg, 0.0, _MAX_DOUBLE, arg,
+                    '@', 0.0, 0.0, 1.0, ['-', arg]]
+        if isinstance(node, Piecewise):
+            # Range checks are tried in order, as the pieces, and the value
+            # is 0 where none holds
+            checks = []
+            for piece, cond in node.args:
+                value = self.tree(piece)
+                for expr, low, high in self._intervals(cond):
+                    checks.extend(['@', expr, low, high, value])
+                if cond == S.true:
+                    break
+            return checks if checks else 0.0
+        raise NotImplementedError('libgibbs cannot compile ' +
+                                  type(node).__name__)
+
+    def _intervals(self, cond):
+        """
+        List of (expression tree, low, high), the range checks
+        low <= expression < high whose union is cond.
+        """
+        if cond == S.true:
+            return [(0.0, 0.0, 1.0)]
+        if cond == S.false:
+            return []
+        if isinstance(cond, Or):
+            return [interval for arg in cond.args
+                    for interval in self._intervals(arg)]
+        if isinstance(cond, And):
+            expr, low, high = None, -_MAX_DOUBLE, _MAX_DOUBLE
+            for arg in cond.args:
+                arg_expr, arg_low, arg_high = self._interval(arg)
+                if expr is not None and arg_expr != expr:
+                    raise NotImplementedError('libgibbs cannot compile '
+                        'conditions on several expressions: ' + str(cond))
+                expr = arg_expr
+                low, high = max(low, arg_low), min(high, arg_high)
+            return [(self.tree(expr), low, high)] if low < high else []
+        expr, low, high = self._interval(cond)
+        return [(self.tree(expr), low, high)]
+
+    @staticmethod
+    def _interval(relation):
+        "(expression, low, high) of a relation, low <= expression < high."
+        if not isinstance(relation, Relational):
+            raise NotImplementedError('libgibbs cannot compile condition ' +
+                                      str(relation))
+        lhs, rhs, operator = relation.lhs, relation.rhs, relation.rel_op
+        if lhs.is_number and not rhs.is_number:
+            flipped = {'<': '>', '<=': '>=', '>': '<', '>=': '<='}
+            lhs, rhs, operator = rhs, lhs, flipped.get(operator, operator)
+        if rhs.is_number:
+            expr, bound = lhs, float(rhs)
+        else:
+            expr, bound = lhs - rhs, 0.0
+        if operator == '<':
+            return expr, -_MAX_DOUBLE, bound
+        if operator == '<=':
+            return expr, -_MAX_DOUBLE, _above(bound)
+        if operator == '>':
+            return expr, _above(bound), _MAX_DOUBLE
+        if operator == '>=':
+            return expr, bound, _MAX_DOUBLE
+        raise NotImplementedError('libgibbs cannot compile condition ' +
+                                  str(relation))
+
+def _write_tree(tree, chunks):
+    "Append the AST serialization of a translated tree to chunks."
+    if isinstance(tree, list):
+        chunks.append(struct.pack('=BQ', _LIST_NODE, len(tree)))
+        for item in tree:
+            _write_tree(item, chunks)
+    elif isinstance(tree, float):
+        chunks.append(struct.pack('=Bd', _DOUBLE_NODE, tree))
+    else:
+        name = tree.encode('utf-8')
+        chunks.append(struct.pack('=BQ', _STRING_NODE, len(name)) + name)
+
+def serialize_expression(expr):
+    """
+    Serialize a SymPy expression for libgibbs (see ExpressionEvaluator in
+    phase_evaluator.hpp): its shared subexpressions as a table of symbols,
+    followed by the expression itself.
+
+    Sums, products, powers, log, exp, Abs and Piecewise are supported; the
+    conditions of a Piecewise must be relations between numbers and one
+    expression per And, combined with And and Or.
+
+    Parameters
+    ----------
+    expr : Expr
+        Expression, e.g., Model.ast.
+
+    Returns
+    -------
+    bytes, in the byte order of this machine.
+    """
+    translator = _ExpressionTranslator(expr)
+    root = translator.tree(expr)
+    chunks = [struct.pack('=Q', len(translator.symbols))]
+    for name in sorted(translator.symbols.keys()):
+        encoded = name.encode('utf-8')
+        chunks.append(struct.pack('=Q', len(encoded)) + encoded)
+        _write_tree(translator.symbols[name], chunks)
+    _write_tree(root, chunks)
+    return b''.join(chunks)
+
+class CompiledPhase(object):
+    """
+    Energy of one phase, compiled once by libgibbs.
+
+    Parameters
+    ----------
+    tdb_path : str
+        Path of the TDB file; libgibbs reads it with its own parser.
+    comps : list
+        Names (case-sensitive) of components to consider, e.g., including
+        'VA'.
+    phase_name : str
+        Name of the phase.
+
+    Attributes
+    ----------
+    variables : list
+        SiteFraction of each column of the points, in libgibbs order:
+        sublattice by sublattice, and by species name within each.
+
+    Examples
+    --------
+    >>> fcc = CompiledPhase('alfe_sei.TDB', ['AL', 'FE', 'VA'], 'FCC_A1')
+    >>> energies = fcc.energies(points, T=1000)
+    """
+    def __init__(self, tdb_path, comps, phase_name):
+        lib = _library()
+        comp_names = [str(c).encode('utf-8') for c in comps]
+        comp_array = (ctypes.c_char_p * len(comp_names))(*comp_names)
+        error = ctypes.create_string_buffer(_ERROR_SIZE)
+        self._handle = lib.libgibbs_phase_evaluator_create(
+            tdb_path.encode('utf-8'), phase_name.encode('utf-8'), comp_array,
+            len(comp_names), error, _ERROR_SIZE)
+        if not self._handle:
+            raise ValueError(error.value.decode('utf-8', 'replace'))
+        self._lib = lib
+        self.phase_name = phase_name
+        num_vars = lib.libgibbs_phase_evaluator_variable_count(self._handle)
+        self.variables = [v.SiteFraction(phase_name,
+            lib.libgibbs_phase_evaluator_sublattice(self._handle, idx),
+            lib.libgibbs_phase_evaluator_species(self._handle, idx).decode(
+                'utf-8')) for idx in range(num_vars)]
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            self._lib.libgibbs_phase_evaluator_destroy(self._handle)
+            self._handle = None
+
+    def energies(self, points, T, P=101325, out=None, gradients=None,
+                 threads=0):
+        """
+        Evaluate the molar Gibbs energy at each row of points.
+
+        Parameters
+        ----------
+        points : ndarray
+            N x M site fractions, one row per point, columns in the order of
+            `variables`. Rows must be C-contiguous float64 (e.g., a
+            row-major array or a slice of one) to be read without a copy.
+        T, P : float
+            Temperature and pressure.
+        out : ndarray, optional
+            Contiguous float64 array of N energies to write into.
+        gradients : ndarray, optional
+            C-contiguous float64 N x M array for the gradients with respect
+            to the site fractions; they are not computed if omitted.
+        threads : int, optional
+            Number of threads; 0 for one per core.
+
+        Returns
+        -------
+        out, the energies.
+        """
+        return _evaluate(self._lib.libgibbs_phase_evaluator_evaluate,
+                         self._handle, len(self.variables), points, T, P,
+                         out, gradients, threads)
+
+class CompiledModel(object):
+    """
+    Energy of a pycalphad Model, compiled once by libgibbs from its SymPy
+    expression, without reading the database again. libgibbs shares
+    repeated subexpressions, specializes the expression to T and P once
+    per call and evaluates the points in batches.
+
+    Parameters
+    ----------
+    model : Model or Expr
+        Model, or an expression such as its ast, in the state variables T
+        and P and the given variables.
+    variables : list
+        Symbols of the columns of the points, e.g., SiteFraction; any
+        order. The state variables are not listed.
+
+    Attributes
+    ----------
+    variables : list
+        As given.
+
+    Examples
+    --------
+    >>> mod = Model(db, ['AL', 'FE', 'VA'], 'FCC_A1')
+    >>> fcc = CompiledModel(mod, variables)
+    >>> energies = fcc.energies(points, T=1000)
+    """
+    def __init__(self, model, variables):
+        lib = _library()
+        data = serialize_expression(getattr(model, 'ast', model))
+        names = [str(variable).encode('utf-8') for variable in variables]
+        name_array = (ctypes.c_char_p * len(names))(*names)
+        error = ctypes.create_string_buffer(_ERROR_SIZE)
+        self._handle = lib.libgibbs_expression_evaluator_create(
+            data, len(data), name_array, len(names), error, _ERROR_SIZE)
+        if not self._handle:
+            raise ValueError(error.value.decode('utf-8', 'replace'))
+        self._lib = lib
+        self.variables = list(variables)
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            self._lib.libgibbs_expression_evaluator_destroy(self._handle)
+            self._handle = None
+
+    def instruction_count(self):
+        "Number of instructions of the compiled expression."
+        return self._lib.libgibbs_expression_evaluator_instruction_count(
+            self._handle)
+
+    def energies(self, points, T, P=101325, out=None, gradients=None,
+                 threads=0):
+        """
+        Evaluate the expression at each row of points, as
+        CompiledPhase.energies(); the gradients are with respect to
+        `variables`.
+        """
+        return _evaluate(self._lib.libgibbs_expression_evaluator_evaluate,
+                         self._handle, len(self.variables), points, T, P,
+                         out, gradients, threads)
@@ -0,0 +1,3 @@
+"""
+The tests package holds the nose tests of pycalphad.
+"""
@@ -0,0 +1,136 @@
+"""
+The columns test module verifies that column stores written by ColumnWriter
+read back with read_columns(), also when written by energy_surf().
+"""
+
+import os
+import shutil
+import tempfile
+import nose.tools
+import numpy as np
+from pycalphad import Database
+from pycalphad.energy_surf import energy_surf
+from pycalphad.io.columns import ColumnWriter, read_columns
+
+TDB_COLUMNS_STRING = """
+ELEMENT VA                VACUUM         0         0         0 !
+ELEMENT AL                FCC_A1    26.982      4540      28.3 !
+ELEMENT NI                FCC_A1     58.69      4787    29.796 !
+
+ TYPE_DEFINITION % SEQ *!
+
+ PHASE LIQUID % 1 1 !
+   CONSTITUENT LIQUID :AL,NI: !
+  PARAMETER G(LIQUID,AL;0)          298.15  +11005.029-11.841867*T; 6000 N !
+  PARAMETER G(LIQUID,NI;0)          298.15  +11235.527+108.457*T;   6000 N !
+  PARAMETER G(LIQUID,AL,NI;0)       298.15  -207109+41.315*T;       6000 N !
+
+ PHASE FCC_A1 % 1 1 !
+   CONSTITUENT FCC_A1 :AL,NI: !
+  PARAMETER G(FCC_A1,AL;0)          298.15  -7976.15+137.093038*T;  6000 N !
+  PARAMETER G(FCC_A1,NI;0)          298.15  -5179.159+117.854*T;    6000 N !
+  PARAMETER G(FCC_A1,AL,NI;0)       298.15  -162408+16.213*T;       6000 N !
+"""
+
+DBF = Database(TDB_COLUMNS_STRING)
+
+def with_directory(test):
+    "Run test(directory) in a new temporary directory, removed afterwards."
+    def wrapper():
+        "Wrapped test."
+        directory = tempfile.mkdtemp()
+        try:
+            test(os.path.join(directory, 'store'))
+        finally:
+            shutil.rmtree(directory)
+    wrapper.__name__ = test.__name__
+    wrapper.__doc__ = test.__doc__
+    return wrapper
+
+@with_directory
+def test_round_trip(directory):
+    "Float and label columns read back as written."
+    with ColumnWriter(directory, ['T', 'GM'], ['Phase'],
+                      chunk_rows=2) as writer:
+        writer.append_many({'T': [300, 400, 500], 'GM': [-1.5, -2.5, 3]},
+                           {'Phase': ['LIQUID', 'FCC_A1', 'LIQUID']})
+        writer.append({'T': 600, 'GM': 0.25}, {'Phase': 'BCC_A2'})
+    columns = read_columns(directory)
+    nose.tools.assert_equal(sorted(columns.keys()), ['GM', 'Phase', 'T'])
+    np.testing.assert_array_equal(columns['T'], [300, 400, 500, 600])
+    np.testing.assert_array_equal(columns['GM'], [-1.5, -2.5, 3, 0.25])
+    nose.tools.assert_equal(list(columns['Phase']),
+                            ['LIQUID', 'FCC_A1', 'LIQUID', 'BCC_A2'])
+
+@with_directory
+def test_line_separators(directory):
+    "Names and labels may contain line separators other than newlines."
+    labels = [u'A\rB', u'C\x0cD', u'E\x85F', u'G\u2028H']
+    with ColumnWriter(directory, [u'T\r'], [u'Phase\u2028']) as writer:
+        writer.append_many({u'T\r': [1, 2, 3, 4]}, {u'Phase\u2028': labels})
+    columns = read_columns(directory)
+    nose.tools.assert_equal(sorted(columns.keys()), [u'Phase\u2028', u'T\r'])
+    nose.tools.assert_equal(list(columns[u'Phase\u2028']), labels)
+
+@with_directory
+def test_scalar_broadcast(directory):
+    "Scalars given to append_many() are repeated in every row of the block."
+    with ColumnWriter(directory, ['T', 'GM'], ['Phase']) as writer:
+        writer.append_many({'T': 300, 'GM': [1, 2, 3]}, {'Phase': 'LIQUID'})
+    columns = read_columns(directory)
+    np.testing.assert_array_equal(columns['T'], [300, 300, 300])
+    np.testing.assert_array_equal(columns['GM'], [1, 2, 3])
+    nose.tools.assert_equal(list(columns['Phase']), ['LIQUID'] * 3)
+
+@with_directory
+def test_length_mismatch(directory):
+    "Columns of different lengths in one block are refused."
+    with ColumnWriter(directory, ['T', 'GM'], ['Phase']) as writer:
+        nose.tools.assert_raises(ValueError, writer.append_many,
+                                 {'T': [300, 400], 'GM': [1, 2, 3]},
+                                 {'Phase': 'LIQUID'})
+        nose.tools.assert_raises(ValueError, writer.append_many,
+                                 {'T': [300, 400], 'GM': [1, 2]},
+                                 {'Phase': ['LIQUID']})
+        nose.tools.assert_equal(writer.rows, 0)
+
+@with_directory
+def test_partial_rows(directory):
+    "Only the rows that every column has are read while writing."
+    writer = ColumnWriter(directory, ['T', 'GM'], ['Phase'])
+    try:
+        writer.append_many({'T': [300, 400], 'GM': [1, 2]},
+                           {'Phase': 'LIQUID'})
+        writer.flush()
+        # Not flushed yet
+        writer.append_many({'T': [500, 600], 'GM': [3, 4]},
+                           {'Phase': 'LIQUID'})
+        nose.tools.assert_equal(len(read_columns(directory)['T']), 2)
+        # As if a flush were under way: one column is a row ahead
+        with open(os.path.join(directory, '1.f64'), 'ab') as gm_file:
+            gm_file.write(np.array([5], dtype='<f8').tobytes())
+        columns = read_columns(directory)
+        for name in ('T', 'GM', 'Phase'):
+            nose.tools.assert_equal(len(columns[name]), 2)
+        np.testing.assert_array_equal(columns['GM'], [1, 2])
+    finally:
+        writer.close()
+
+@with_directory
+def test_energy_surf_output(directory):
+    "energy_surf() writes the same points to a column store as to a DataFrame."
+    np.random.seed(1769)
+    frame = energy_surf(DBF, ['AL', 'NI'], ['LIQUID', 'FCC_A1'],
+                        points_per_phase=20, T=1000)
+    np.random.seed(1769)
+    columns = energy_surf(DBF, ['AL', 'NI'], ['LIQUID', 'FCC_A1'],
+                          points_per_phase=20, output=directory, T=1000)
+    nose.tools.assert_equal(len(columns['GM']), len(frame))
+    for name in ('T', 'GM', 'X(AL)', 'X(NI)'):
+        np.testing.assert_allclose(columns[name], frame[name].values)
+    nose.tools.assert_equal(list(columns['Phase']), list(frame['Phase']))
+
+def test_energy_surf_no_phases():
+    "energy_surf() of no phases is an empty DataFrame."
+    nose.tools.assert_equal(len(energy_surf(DBF, ['AL', 'NI'], [], T=1000)),
+                            0)
@@ -0,0 +1,195 @@
+"""
+The libgibbs test module verifies the translation of SymPy expressions to
+the serialized syntax trees that libgibbs compiles. Nothing here loads the
+libgibbs library: the bytes are decoded and the trees evaluated in Python,
+with libgibbs' rules for range checks.
+"""
+
+import math
+import struct
+import nose.tools
+import numpy as np
+from sympy import Symbol, Piecewise, And, Or, Abs, log, exp, sin, oo
+from pycalphad import Model
+from pycalphad.libgibbs import serialize_expression, _ExpressionTranslator, \
+    _MAX_DOUBLE, _TINY_DOUBLE
+from pycalphad.tests.test_energy import DBF
+import pycalphad.variables as v
+
+X = Symbol('X')
+Y = Symbol('Y')
+
+def decode(data):
+    "The symbols and the tree of bytes written by serialize_expression()."
+    position = [0]
+    def read(fmt):
+        "Unpack fmt at the current position."
+        values = struct.unpack_from(fmt, data, position[0])
+        position[0] += struct.calcsize(fmt)
+        return values
+    def read_string():
+        "Size-prefixed UTF-8 string."
+        size = read('=Q')[0]
+        text = data[position[0]:position[0] + size].decode('utf-8')
+        position[0] += size
+        return text
+    def read_tree():
+        "Tagged node."
+        tag = read('=B')[0]
+        if tag == 3:
+            return read('=d')[0]
+        if tag == 4:
+            return read_string()
+        if tag == 6:
+            return [read_tree() for _ in range(read('=Q')[0])]
+        raise AssertionError('Unexpected node tag %d' % tag)
+    symbols = {}
+    for _ in range(read('=Q')[0]):
+        name = read_string()
+        symbols[name] = read_tree()
+    tree = read_tree()
+    nose.tools.assert_equal(position[0], len(data))
+    return symbols, tree
+
+def evaluate(tree, symbols, values):
+    """
+    Value of a tree as libgibbs computes it: range checks are tried in
+    order, and the value is 0 if none holds.
+    """
+    if isinstance(tree, float):
+        return tree
+    if not isinstance(tree, list):
+        if tree in symbols:
+            return evaluate(symbols[tree], symbols, values)
+        return values[tree]
+    operator = tree[0]
+    if operator == '@':
+        for idx in range(0, len(tree), 5):
+            check, variable, low, high, piece = tree[idx:idx + 5]
+            nose.tools.assert_equal(check, '@')
+            if evaluate(low, symbols, values) <= \
+                    evaluate(variable, symbols, values) < \
+                    evaluate(high, symbols, values):
+                return evaluate(piece, symbols, values)
+        return 0.0
+    args = [evaluate(arg, symbols, values) for arg in tree[1:]]
+    if operator == '-' and len(args) == 1:
+        return -args[0]
+    operations = {
+        '+': lambda a, b: a + b,
+        '-': lambda a, b: a - b,
+        '*': lambda a, b: a * b,
+        '/': lambda a, b: a / b,
+        '**': lambda a, b: a ** b,
+        'LN': math.log,
+        'EXP': math.exp
+    }
+    return operations[operator](*args)
+
+def evaluate_expression(expr, values):
+    "Serialize expr and evaluate the result at values, keyed by name."
+    symbols, tree = decode(serialize_expression(expr))
+    return evaluate(tree, symbols, values)
+
+def test_piecewise_fallback():
+    "A Piecewise is 0 where none of its conditions holds."
+    expr = Piecewise((X, X > 1))
+    nose.tools.assert_equal(evaluate_expression(expr, {'X': 0.5}), 0)
+    nose.tools.assert_equal(evaluate_expression(expr, {'X': 3.0}), 3.0)
+    expr = Piecewise((X, X > 1), (2 * X, True))
+    nose.tools.assert_equal(evaluate_expression(expr, {'X': 0.5}), 1.0)
+
+def test_relation_bounds():
+    "Strict lower and inclusive upper bounds are the next normal double."
+    translator = _ExpressionTranslator(X)
+    #pylint: disable=W0212
+    nose.tools.assert_equal(translator._intervals(X > 1),
+                            [('X', np.nextafter(1.0, np.inf), _MAX_DOUBLE)])
+    nose.tools.assert_equal(translator._intervals(X <= 1),
+                            [('X', -_MAX_DOUBLE, np.nextafter(1.0, np.inf))])
+    nose.tools.assert_equal(translator._intervals(X >= 1),
+                            [('X', 1.0, _MAX_DOUBLE)])
+    nose.tools.assert_equal(translator._intervals(X < 1),
+                            [('X', -_MAX_DOUBLE, 1.0)])
+    # libgibbs refuses subnormal constants, such as the next double after 0
+    nose.tools.assert_equal(translator._intervals(X > 0),
+                            [('X', _TINY_DOUBLE, _MAX_DOUBLE)])
+    nose.tools.assert_equal(translator._intervals(X <= 0),
+                            [('X', -_MAX_DOUBLE, _TINY_DOUBLE)])
+    # Numbers on the left are moved to the right
+    nose.tools.assert_equal(translator._intervals(1 < X),
+                            [('X', np.nextafter(1.0, np.inf), _MAX_DOUBLE)])
+    expr = Piecewise((1, X > 0), (2, X <= 0))
+    nose.tools.assert_equal(evaluate_expression(expr, {'X': 0.0}), 2.0)
+    nose.tools.assert_equal(evaluate_expression(expr, {'X': 1e-300}), 1.0)
+
+def test_abs():
+    "Abs is a pair of range checks."
+    nose.tools.assert_equal(_ExpressionTranslator(Abs(X)).tree(Abs(X)),
+                            ['@', 'X', 0.0, _MAX_DOUBLE, 'X',
+                             '@', 0.0, 0.0, 1.0, ['-', 'X']])
+    for value in (-2.5, 0.0, 2.5):
+        nose.tools.assert_equal(evaluate_expression(Abs(X), {'X': value}),
+                                abs(value))
+
+def test_and_or():
+    "And intersects the intervals of one expression; Or joins intervals."
+    translator = _ExpressionTranslator(X)
+   
+    nose.tools.assert_equal(translator._intervals(And(X >= 0, X < 2)),
+                            [('X', 0.0, 2.0)])
+    nose.tools.assert_equal(translator._intervals(And(X > 2, X < 1)), [])
+    nose.tools.assert_equal(
+        sorted(translator._intervals(Or(X < 0, X >= 2))),
+        [('X', -_MAX_DOUBLE, 0.0), ('X', 2.0, _MAX_DOUBLE)])
+    nose.tools.assert_raises(NotImplementedError, translator._intervals,
+                             And(X > 0, Y > 0))
+    expr = Piecewise((1, Or(X < 0, X >= 2)), (2, True))
+    for value, expected in ((-1.0, 1.0), (1.0, 2.0), (2.0, 1.0)):
+        nose.tools.assert_equal(evaluate_expression(expr, {'X': value}),
+                                expected)
+
+def test_shared_subexpressions():
+    "Subexpressions that occur more than once become symbols."
+    expr = (X + Y) * log(X + Y) + exp(X)
+    symbols, tree = decode(serialize_expression(expr))
+    nose.tools.assert_equal(list(symbols.keys()), ['$0'])
+    nose.tools.assert_equal(symbols['$0'][0], '+')
+    nose.tools.assert_equal(sorted(symbols['$0'][1:]), ['X', 'Y'])
+    nose.tools.assert_almost_equal(
+        evaluate(tree, symbols, {'X': 0.5, 'Y': 2.0}),
+        2.5 * math.log(2.5) + math.exp(0.5))
+    # Nothing is shared
+    symbols, tree = decode(serialize_expression(X * Y + log(X)))
+    nose.tools.assert_equal(symbols, {})
+
+def test_negation_and_reciprocal():
+    "Products with a coefficient of -1 are negations; powers of -1 divide."
+    translator = _ExpressionTranslator(X)
+    nose.tools.assert_equal(translator.tree(-X), ['-', 'X'])
+    nose.tools.assert_equal(translator.tree(-X * Y), ['-', ['*', 'X', 'Y']])
+    nose.tools.assert_equal(translator.tree(1 / X), ['/', 1.0, 'X'])
+    nose.tools.assert_equal(evaluate_expression(X - Y, {'X': 1.0, 'Y': 3.0}),
+                            -2.0)
+    nose.tools.assert_equal(evaluate_expression(-2 * X, {'X': 1.5}), -3.0)
+
+def test_unsupported():
+    "Non-finite constants and unknown functions are refused."
+    nose.tools.assert_raises(ValueError, serialize_expression, X + oo)
+    nose.tools.assert_raises(NotImplementedError, serialize_expression,
+                             sin(X))
+
+def test_model_ast():
+    "The AST of a Model with magnetic and ordering terms evaluates correctly."
+    mod = Model(DBF, ['CR', 'NI'], 'L12_FCC')
+    values = {v.T: 300, v.SiteFraction('L12_FCC', 0, 'CR'): 4.86783e-2,
+              v.SiteFraction('L12_FCC', 0, 'NI'): 9.51322e-1,
+              v.SiteFraction('L12_FCC', 1, 'CR'): 9.33965e-1,
+              v.SiteFraction('L12_FCC', 1, 'NI'): 6.60348e-2}
+    symbols, tree = decode(serialize_expression(mod.ast))
+    nose.tools.assert_true(len(symbols) > 0)
+    energy = evaluate(tree, symbols,
+                      dict((str(key), float(value)) \
+                           for key, value in values.items()))
+    assert abs(1 - energy / -9.23953e3) < 1e-5, energy
+    assert abs(1 - energy / float(mod.ast.subs(values))) < 1e-8, energy